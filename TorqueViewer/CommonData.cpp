@@ -31,12 +31,29 @@
 #include <unordered_map>
 #include <iostream>
 #include <fstream>
+#include <mutex>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <slm/slmath.h>
 #include "CommonData.h"
+#include "deflateIndex.h"
+#include "volumeCodecs.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
 ConsolePersistObject::NamedFuncMap ConsolePersistObject::smNamedCreateFuncs;
 ConsolePersistObject::IDFuncMap ConsolePersistObject::smIDCreateFuncs;
 
@@ -103,7 +120,7 @@ bool Palette::read(MemRStream& mem)
    return true;
 }
 
-Bitmap::Bitmap() : mData(NULL), mPal(NULL)
+Bitmap::Bitmap() : mData(NULL), mDataSize(0), mPal(NULL)
 {;}
 
 Bitmap::~Bitmap()
@@ -113,8 +130,15 @@ Bitmap::~Bitmap()
 
 void Bitmap::reset()
 {
-   if (mData) free(mData);
+   if (mData)
+   {
+      MemTracker::trackFree(MemCategory_Bitmap, mDataSize);
+      free(mData);
+   }
    if (mPal) delete mPal;
+   mData = NULL;
+   mDataSize = 0;
+   mPal = NULL;
    mMipLevels = 0;
 }
 
@@ -200,7 +224,10 @@ bool Bitmap::readStbi(MemRStream& mem)
    mWidth = width;
    mHeight = height;
    mMipLevels = 1;
+   mData = image_data;
+   mDataSize = mStride * height;
    mMips[0] = &mData[0];
+   MemTracker::trackAlloc(MemCategory_Bitmap, mDataSize);
    
    return true;
 }
@@ -224,10 +251,9 @@ bool Bitmap::readBM8(MemRStream& mem)
    mFormat = FORMAT_PAL;
    mBitDepth = 8;
    
-   for (uint32_t i=0; i<mMipLevels; i++)
-   {
-      mem.read(mMips[i]);
-   }
+   uint32_t mipOffsets[MAX_MIPS];
+   if (!readMipOffsets(mem, mipOffsets))
+      return false;
    
    mPal = new Palette();
    if (!mPal->read(mem))
@@ -235,11 +261,41 @@ bool Bitmap::readBM8(MemRStream& mem)
    
    mStride = byteSize / mHeight;
    mData = (uint8_t*)malloc(byteSize);
+   mDataSize = byteSize;
+   MemTracker::trackAlloc(MemCategory_Bitmap, mDataSize);
    mem.read(byteSize, mData);
    
+   return resolveMips(mipOffsets);
+}
+
+bool Bitmap::readMipOffsets(MemRStream& mem, uint32_t* outOffsets)
+{
+   if (mMipLevels == 0 || mMipLevels > MAX_MIPS)
+      return false;
+   
+   for (uint32_t i=0; i<mMipLevels; i++)
+      mem.read(outOffsets[i]);
    return true;
 }
 
+bool Bitmap::resolveMips(const uint32_t* offsets)
+{
+   // Stored as offsets into the data; mips past the end of it are dropped
+   uint32_t bytesPerPixel = std::max<uint32_t>(mBitDepth / 8, 1);
+   for (uint32_t i=0; i<mMipLevels; i++)
+   {
+      uint64_t size = (uint64_t)std::max<uint32_t>(mWidth >> i, 1) * std::max<uint32_t>(mHeight >> i, 1) * bytesPerPixel;
+      if ((uint64_t)offsets[i] + size > mDataSize)
+      {
+         mMipLevels = i;
+         break;
+      }
+      mMips[i] = mData + offsets[i];
+   }
+   
+   return mMipLevels > 0;
+}
+
 bool Bitmap::read(MemRStream& mem)
 {
    // NOTE: Not seen anything actually use this, but it's here
@@ -265,12 +321,14 @@ bool Bitmap::read(MemRStream& mem)
    
    mStride = byteSize / mHeight;
    mData = (uint8_t*)malloc(byteSize);
+   mDataSize = byteSize;
+   MemTracker::trackAlloc(MemCategory_Bitmap, mDataSize);
    mem.read(byteSize, mData);
    mem.read(mMipLevels);
-   for (uint32_t i=0; i<mMipLevels; i++)
-   {
-      mem.read(mMips[i]);
-   }
+   
+   uint32_t mipOffsets[MAX_MIPS];
+   if (!readMipOffsets(mem, mipOffsets))
+      return false;
    
    switch (mFormat)
    {
@@ -278,6 +336,7 @@ bool Bitmap::read(MemRStream& mem)
       case FORMAT_INTENSITY:
       case FORMAT_ALPHA:
          mBitDepth = 8;
+         break;
       case FORMAT_RGB_565:
       case FORMAT_RGBA_5551:
          mBitDepth = 16;
@@ -290,6 +349,8 @@ bool Bitmap::read(MemRStream& mem)
          break;
    }
    
+   // Palettized bitmaps carry their own palette
+   needPal = mFormat == FORMAT_PAL;
    if (needPal)
    {
       mPal = new Palette();
@@ -297,7 +358,7 @@ bool Bitmap::read(MemRStream& mem)
          return false;
    }
    
-   return true;
+   return resolveMips(mipOffsets);
 }
 
 //
@@ -688,6 +749,7 @@ public:
       uint16_t flags;
       uint16_t compression;
       uint16_t filenameSize;
+      uint32_t crc32;
       uint64_t filenameOffset;
       uint64_t dataOffset;
       uint64_t compressedSize;
@@ -705,28 +767,61 @@ public:
       }
    };
    
+   // Random access index for a deflated entry, built on first read
+   struct EntryIndex
+   {
+      std::unique_ptr<DeflateIndex> index;
+      bool cached; // index file is up to date
+   };
+   
+   enum
+   {
+      // Local extra fields usually match the central directory's, but
+      // e.g. alignment padding only exists in the local header
+      LocalExtraSlack = 64
+   };
+   
    std::vector<CentralHeader> mCentralHeaders;
    std::vector<Entry> mEntries;
    std::vector<char> mCDData;
+   std::vector<EntryIndex> mIndices;
+   std::unique_ptr<std::atomic<uint64_t>[]> mDataStarts; // past each local header, 0 until known
+   std::atomic<uint32_t> mNumHeaderReads; // blocking local header reads
+   uint64_t mFileSize;
 
    std::ifstream mFile;
+   std::mutex mFileLock; // mFile is shared by all readers
+   int mFD;              // for async reads, which don't need mFileLock
+   std::mutex mIndexLock;
    std::string mName;
+   std::string mIndexCachePath; // where indices are saved, or empty
 
    inline const char* getCDData()
    {
       return &mCDData[0];
    }
    
-   Volume()
+   Volume() : mNumHeaderReads(0), mFileSize(0), mFD(-1)
    {
    }
    
    ~Volume()
    {
+      MemTracker::trackFree(MemCategory_VolumeDirectory, mCDData.capacity());
+      
       if (mFile.is_open())
       {
          mFile.close();
       }
+      
+      if (mFD >= 0)
+      {
+#ifdef _WIN32
+         ::_close(mFD);
+#else
+         ::close(mFD);
+#endif
+      }
    }
 
    bool readEOCD(std::ifstream& stream, EOCDRecord& eoCD, EOCD64Record& eoCD64)
@@ -749,10 +844,12 @@ public:
 
       for (int64_t offset = (int64_t)maxSize - sizeof(EOCDRecord); offset >= 0; offset--)
       {
-         const uint32_t* ptr = reinterpret_cast<uint32_t*>(&buffer[offset]);
-         if (*ptr == ZIP_END_CENTRAL_DIR_SIG)
+         // Records aren't aligned, so copy them out
+         uint32_t signature = 0;
+         memcpy(&signature, &buffer[offset], sizeof(uint32_t));
+         if (signature == ZIP_END_CENTRAL_DIR_SIG)
          {
-            eoCD = *reinterpret_cast<const EOCDRecord*>(ptr);
+            memcpy(&eoCD, &buffer[offset], sizeof(EOCDRecord));
             eoCDOffset = (size - maxSize) + offset;
             hasEOCD = true;
             break;
@@ -786,8 +883,8 @@ public:
    
    bool read(std::ifstream& stream)
    {
-      EOCDRecord eoCD;
-      EOCD64Record eoCD64;
+      EOCDRecord eoCD = {};
+      EOCD64Record eoCD64 = {};
 
       if (!readEOCD(stream, eoCD, eoCD64))
       {
@@ -807,20 +904,51 @@ public:
          totalFiles = eoCD64.total_entries;
       }
 
+      // Sizes come from the file so can't be trusted
+      stream.seekg(0, std::ios_base::end);
+      uint64_t fileSize = static_cast<uint64_t>(stream.tellg());
+      if (cdStart > fileSize || cdSize > fileSize - cdStart ||
+          totalFiles > cdSize / sizeof(CentralHeader))
+      {
+         return false;
+      }
+
+      size_t oldCDBytes = mCDData.capacity();
       mCDData.resize(cdSize+1);
+      MemTracker::trackResize(MemCategory_VolumeDirectory, oldCDBytes, mCDData.capacity());
       stream.seekg(cdStart);
-      stream.read(&mCDData[0], eoCD64.central_dir_size);
+      stream.read(&mCDData[0], cdSize);
       mCDData[cdSize] = 0;
+      if (stream.fail())
+      {
+         stream.clear();
+         return false;
+      }
 
       // Populate entries
       mEntries.resize(totalFiles);
-      CentralHeader* headerPtr = (CentralHeader*)&mCDData[0];
-      CentralHeader* endHeader = (CentralHeader*)&mCDData[cdSize];
+      const uint8_t* cdPtr = (const uint8_t*)&mCDData[0];
+      const uint8_t* cdEnd = cdPtr + cdSize;
       for (uint32_t i=0; i<totalFiles; i++)
       {
          Entry& e = mEntries[i];
-         if (headerPtr >= endHeader ||
-            headerPtr->signature != ZIP_CENTRAL_DIR_HEADER_SIG)
+         if ((uint64_t)(cdEnd - cdPtr) < sizeof(CentralHeader))
+         {
+            return false;
+         }
+         
+         // Names are any length, so records aren't aligned
+         CentralHeader header;
+         memcpy(&header, cdPtr, sizeof(CentralHeader));
+         const CentralHeader* headerPtr = &header;
+         if (headerPtr->signature != ZIP_CENTRAL_DIR_HEADER_SIG)
+         {
+            return false;
+         }
+         
+         // The whole record has to fit in the directory
+         uint64_t extraLen = headerPtr->file_name_length + headerPtr->file_comment_length + headerPtr->extra_field_length;
+         if ((uint64_t)(cdEnd - cdPtr) < sizeof(CentralHeader) + extraLen)
          {
             return false;
          }
@@ -828,46 +956,66 @@ public:
          e.flags = headerPtr->flags;
          e.compression = headerPtr->compression;
          e.filenameSize = headerPtr->file_name_length;
-         e.filenameOffset = (uint8_t*)(headerPtr+1) - ((uint8_t*)&mCDData[0]);
+         e.filenameOffset = (cdPtr + sizeof(CentralHeader)) - (const uint8_t*)&mCDData[0];
          e.dataOffset = headerPtr->local_header_offset;
          e.compressedSize = headerPtr->compressed_size;
          e.uncompressedSize = headerPtr->uncompressed_size;
+         e.crc32 = headerPtr->crc32;
          
-         uint64_t extraLen = headerPtr->file_name_length + headerPtr->file_comment_length + headerPtr->extra_field_length;
-         headerPtr++;
-         headerPtr = (CentralHeader*)(((uint8_t*)headerPtr) + extraLen);
-         
-         const uint8_t* extraPtr = (((uint8_t*)headerPtr) + headerPtr->file_name_length + headerPtr->file_comment_length);
+         // Extra fields follow the name in this header
+         const uint8_t* extraPtr = cdPtr + sizeof(CentralHeader) + headerPtr->file_name_length;
          const uint8_t* endPtr = extraPtr + headerPtr->extra_field_length;
          
-         while (extraPtr < endPtr)
+         while (extraPtr + 4 <= endPtr)
          {
-            uint16_t type = ((uint16_t*)extraPtr)[0];
-            uint16_t size = ((uint16_t*)extraPtr)[1];
+            uint16_t type = 0;
+            uint16_t size = 0;
+            memcpy(&type, extraPtr, sizeof(uint16_t));
+            memcpy(&size, extraPtr + 2, sizeof(uint16_t));
             extraPtr += 4;
+            if (size > endPtr - extraPtr)
+            {
+               return false;
+            }
             
             if (type == 0x0001)
             {
-               uint64_t value = ((uint16_t*)extraPtr)[0];
-               uint64_t ofs = 0;
-               if (headerPtr->compressed_size == 0xffffffff)
+               // zip64 values are only present for fields which overflowed
+               const uint8_t* valuePtr = extraPtr;
+               const uint8_t* valueEnd = extraPtr + size;
+               if (headerPtr->uncompressed_size == 0xffffffff)
                {
-                  e.compressedSize = ((uint64_t*)headerPtr)[ofs++];
+                  if (valuePtr + sizeof(uint64_t) > valueEnd)
+                     return false;
+                  memcpy(&e.uncompressedSize, valuePtr, sizeof(uint64_t));
+                  valuePtr += sizeof(uint64_t);
                }
-               if (headerPtr->uncompressed_size == 0xffffffff)
+               if (headerPtr->compressed_size == 0xffffffff)
                {
-                  e.uncompressedSize = ((uint64_t*)headerPtr)[ofs++];
+                  if (valuePtr + sizeof(uint64_t) > valueEnd)
+                     return false;
+                  memcpy(&e.compressedSize, valuePtr, sizeof(uint64_t));
+                  valuePtr += sizeof(uint64_t);
                }
                if (headerPtr->local_header_offset == 0xffffffff)
                {
-                  e.dataOffset = ((uint64_t*)headerPtr)[ofs++];
+                  if (valuePtr + sizeof(uint64_t) > valueEnd)
+                     return false;
+                  memcpy(&e.dataOffset, valuePtr, sizeof(uint64_t));
+                  valuePtr += sizeof(uint64_t);
                }
             }
             
             extraPtr += size;
          }
+         
+         cdPtr += sizeof(CentralHeader) + extraLen;
       }
       
+      mIndices.resize(mEntries.size());
+      mDataStarts.reset(new std::atomic<uint64_t>[mEntries.size()]());
+      mFileSize = fileSize;
+      
       for (Entry& e : mEntries)
       {
          std::string name(e.getFilename(&mCDData[0]));
@@ -877,98 +1025,423 @@ public:
       return true;
    }
 
-   static bool handleDeflate(MemRStream& inStream, MemRStream& outStream)
+   int32_t findEntry(const char* filename)
    {
+      uint32_t fnLen = strlen(filename);
+      for (uint32_t i=0; i<mEntries.size(); i++)
+      {
+         const Entry& e = mEntries[i];
+         if (fnLen == e.filenameSize &&
+             strncasecmp(filename, e.getFilenamePtr(&mCDData[0]), fnLen) == 0)
+         {
+            return (int32_t)i;
+         }
+      }
+      
+      return -1;
    }
    
-   bool openStream(std::ifstream& stream, const char* filename, MemRStream& outStream)
+   // Where the data of e starts given the local header at the start of data,
+   // or 0 if it isn't valid
+   uint64_t parseLocalHeader(const Entry& e, const uint8_t* data, uint64_t size)
    {
-      uint32_t fnLen = strlen(filename);
-      for (std::vector<Entry>::const_iterator itr = mEntries.begin(), itrEnd = mEntries.end(); itr != itrEnd; itr++)
+      LocalHeader lh = {};
+      if (size < sizeof(LocalHeader))
+         return 0;
+      
+      memcpy(&lh, data, sizeof(LocalHeader));
+      if (lh.signature != ZIP_LOCAL_FILE_HEADER_SIG)
+         return 0;
+      
+      uint64_t start = e.dataOffset + sizeof(LocalHeader) + lh.file_name_length + lh.extra_field_length;
+      if (start > mFileSize || e.compressedSize > mFileSize - start)
+         return 0;
+      
+      mDataStarts[&e - &mEntries[0]] = start;
+      return start;
+   }
+   
+   // Bytes to read from dataOffset to get the local header and data of e in one go,
+   // assuming the local header is about the same size as the central one
+   uint64_t getEntryReadGuess(const Entry& e)
+   {
+      uint64_t guess = sizeof(LocalHeader) + e.filenameSize + LocalExtraSlack + e.compressedSize;
+      return std::min(guess, mFileSize - std::min(e.dataOffset, mFileSize));
+   }
+   
+   // Finds where the data of e starts, past its local header
+   bool getEntryDataStart(std::ifstream& stream, const Entry& e, uint64_t& outStart)
+   {
+      outStart = mDataStarts[&e - &mEntries[0]];
+      if (outStart != 0)
+         return true;
+      
+      std::lock_guard<std::mutex> lock(mFileLock);
+      mNumHeaderReads++;
+      
+      stream.seekg(e.dataOffset);
+      if (stream.fail())
       {
-         if (fnLen == itr->filenameSize &&
-             strncasecmp(filename, itr->getFilenamePtr(&mCDData[0]), fnLen) == 0)
-         {
-            stream.seekg(itr->dataOffset);
-            if (stream.fail())
-            {
-               return false;
-            }
-
-            // Read past local entry
-            LocalHeader lh = {};
-            stream.read((char*)&lh, sizeof(LocalHeader));
-            if (lh.signature != ZIP_LOCAL_FILE_HEADER_SIG)
-            {
-               return false;
-            }
-
-            uint64_t start = stream.tellg();
-            stream.seekg(start + lh.file_name_length + lh.extra_field_length);
-            uint64_t realStart = start + lh.file_name_length + lh.extra_field_length;
-            
-            if (stream.fail())
-            {
-               return false;
-            }
-
-            uint8_t* dataIn = (uint8_t*)malloc(itr->compressedSize);
-            uint8_t* dataOut = NULL;
-
-            stream.read((char*)dataIn, itr->compressedSize);
-            if (stream.fail())
-            {
-               free(dataIn);
-               return false;
-            }
-
-            if (itr->compression != 0)
-            {
-               if (itr->compression != 8)
-               {
-                  free(dataIn);
-                  return false;
-               }
-               
-               // Validate compression
-               dataOut = (uint8_t*)malloc(itr->uncompressedSize);
-               
-               if (itr->compression == 8)
-               {
-                  // TODO: 64bit
-                  if (stbi_zlib_decode_noheader_buffer((char*)dataOut, itr->uncompressedSize, (char*)dataIn, itr->compressedSize) < 0)
-                  {
-                     free(dataIn);
-                     free(dataOut);
-                     return false;
-                  }
-               }
-               
-            }
+         stream.clear();
+         return false;
+      }
 
-            outStream = MemRStream(itr->uncompressedSize, dataOut ? dataOut : dataIn, true);
-            if (dataIn != dataOut)
-            {
-               free(dataIn);
-            }
+      // Read past local entry
+      uint8_t buffer[sizeof(LocalHeader)];
+      stream.read((char*)buffer, sizeof(buffer));
+      if (stream.fail())
+      {
+         stream.clear();
+         return false;
+      }
 
-            return true;
+      outStart = parseLocalHeader(e, buffer, sizeof(buffer));
+      return outStart != 0;
+   }
+   
+   // Reads size bytes starting at offset in the (compressed) data of e
+   bool readEntryData(std::ifstream& stream, const Entry& e, uint64_t offset, uint64_t size, uint8_t* dest)
+   {
+      uint64_t start = 0;
+      if (offset + size > e.compressedSize || !getEntryDataStart(stream, e, start))
+         return false;
+      
+      std::lock_guard<std::mutex> lock(mFileLock);
+      
+      stream.seekg(start + offset);
+      stream.read((char*)dest, size);
+      if (stream.fail())
+      {
+         stream.clear();
+         return false;
+      }
+      
+      return true;
+   }
+   
+   uint64_t getIndexKey(const Entry& e)
+   {
+      uint64_t seed = ((uint64_t)e.crc32 << 32) ^ e.compressedSize ^ (e.uncompressedSize * 0x9E3779B97F4A7C15ULL);
+      return hashBytes64(e.getFilenamePtr(&mCDData[0]), e.filenameSize, seed);
+   }
+   
+   std::string getIndexCacheName(const Entry& e)
+   {
+      char buffer[PATH_MAX];
+      snprintf(buffer, sizeof(buffer), "%s/%016llx.dfi", mIndexCachePath.c_str(), (unsigned long long)getIndexKey(e));
+      return buffer;
+   }
+   
+   DeflateIndex* getIndex(uint32_t entryIdx)
+   {
+      std::lock_guard<std::mutex> lock(mIndexLock);
+      
+      const Entry& e = mEntries[entryIdx];
+      EntryIndex& info = mIndices[entryIdx];
+      if (!info.index)
+      {
+         info.index.reset(new DeflateIndex(e.compressedSize, e.uncompressedSize));
+         info.cached = false;
+         
+         if (!mIndexCachePath.empty() && e.uncompressedSize > DeflateIndex::DefaultSpacing)
+         {
+            info.cached = info.index->readCache(getIndexCacheName(e).c_str(), getIndexKey(e)) && info.index->isComplete();
          }
       }
       
-      return NULL;
+      return info.index.get();
+   }
+   
+   // Saves the index once it covers the whole entry. Small entries only ever
+   // have the starting checkpoint so aren't worth a file.
+   void saveIndex(uint32_t entryIdx)
+   {
+      std::lock_guard<std::mutex> lock(mIndexLock);
+      
+      const Entry& e = mEntries[entryIdx];
+      EntryIndex& info = mIndices[entryIdx];
+      if (mIndexCachePath.empty() || info.cached ||
+          e.uncompressedSize <= DeflateIndex::DefaultSpacing ||
+          !info.index->isComplete())
+      {
+         return;
+      }
+      
+      info.cached = info.index->writeCache(getIndexCacheName(e).c_str(), getIndexKey(e));
+   }
+   
+   // LZ4 & zstd entries decode quickly enough that they're always decoded in full
+   bool decodeEntry(std::ifstream& stream, const Entry& e, uint64_t offset, uint64_t size, uint8_t* dest)
+   {
+      std::vector<uint8_t> dataIn(e.compressedSize);
+      if (!readEntryData(stream, e, 0, e.compressedSize, dataIn.data()))
+         return false;
+      
+      std::vector<uint8_t> scratch;
+      uint8_t* dataOut = dest;
+      if (offset != 0 || size != e.uncompressedSize)
+      {
+         scratch.resize(e.uncompressedSize);
+         dataOut = scratch.data();
+      }
+      
+      bool ok = false;
+      if (e.compression == ZipMethod_LZ4)
+         ok = LZ4Codec::decompress(dataIn.data(), dataIn.size(), dataOut, e.uncompressedSize);
+      else
+         ok = ZstdCodec::decompress(dataIn.data(), dataIn.size(), dataOut, e.uncompressedSize);
+      
+      if (ok && dataOut != dest)
+         memcpy(dest, dataOut + offset, size);
+      return ok;
+   }
+   
+   // Decodes [offset, offset+size) of an entry. Deflated entries only inflate
+   // from the nearest checkpoint before offset.
+   bool readRange(std::ifstream& stream, uint32_t entryIdx, uint64_t offset, uint64_t size, uint8_t* dest)
+   {
+      const Entry& e = mEntries[entryIdx];
+      if (offset + size > e.uncompressedSize)
+         return false;
+      
+      if (e.compression == ZipMethod_Store)
+         return readEntryData(stream, e, offset, size, dest);
+      else if (e.compression == ZipMethod_LZ4 || e.compression == ZipMethod_Zstd)
+         return decodeEntry(stream, e, offset, size, dest);
+      else if (e.compression != ZipMethod_Deflate)
+         return false;
+      
+      DeflateIndex* index = getIndex(entryIdx);
+      DeflateIndex::ReadPlan plan;
+      index->plan(offset, size, plan);
+      
+      std::vector<uint8_t> dataIn;
+      for (;;)
+      {
+         dataIn.resize(plan.inSize);
+         if (!readEntryData(stream, e, plan.inStart, plan.inSize, dataIn.data()))
+            return false;
+         
+         DeflateDecoder::Status status = index->read(plan, dataIn.data(), offset, size, dest);
+         if (status == DeflateDecoder::Done)
+            break;
+         
+         // Only the ratio estimate can come up short
+         if (status != DeflateDecoder::NeedInput || !index->widen(plan))
+            return false;
+      }
+      
+      saveIndex(entryIdx);
+      return true;
+   }
+   
+   // Decodes a whole entry from its compressed data, which is consumed. Stored
+   // entries hand dataIn straight over.
+   bool decodeEntryBuffer(uint32_t entryIdx, uint8_t* dataIn, uint8_t*& outData)
+   {
+      const Entry& e = mEntries[entryIdx];
+      if (e.compression == ZipMethod_Store)
+      {
+         outData = dataIn;
+         return e.compressedSize == e.uncompressedSize;
+      }
+      
+      outData = (uint8_t*)malloc(std::max<uint64_t>(e.uncompressedSize, 1));
+      bool ok = false;
+      if (e.compression == ZipMethod_Deflate)
+      {
+         // Goes through the index so the checkpoints are recorded for later range reads
+         DeflateIndex* index = getIndex(entryIdx);
+         DeflateIndex::ReadPlan plan;
+         index->plan(0, e.uncompressedSize, plan);
+         plan.inSize = e.compressedSize - plan.inStart;
+         ok = index->read(plan, dataIn + plan.inStart, 0, e.uncompressedSize, outData) == DeflateDecoder::Done;
+         if (ok)
+            saveIndex(entryIdx);
+      }
+      else if (e.compression == ZipMethod_LZ4)
+      {
+         ok = LZ4Codec::decompress(dataIn, e.compressedSize, outData, e.uncompressedSize);
+      }
+      else if (e.compression == ZipMethod_Zstd)
+      {
+         ok = ZstdCodec::decompress(dataIn, e.compressedSize, outData, e.uncompressedSize);
+      }
+      
+      free(dataIn);
+      if (!ok)
+      {
+         free(outData);
+         outData = NULL;
+      }
+      return ok;
+   }
+   
+   bool openStream(std::ifstream& stream, const char* filename, MemRStream& outStream)
+   {
+      return openStreamRange(stream, filename, 0, UINT64_MAX, outStream);
+   }
+   
+   // Reads up to size bytes from offset; fails if offset is past the end
+   bool openStreamRange(std::ifstream& stream, const char* filename, uint64_t offset, uint64_t size, MemRStream& outStream)
+   {
+      int32_t entryIdx = findEntry(filename);
+      if (entryIdx < 0)
+         return false;
+      
+      const Entry& e = mEntries[entryIdx];
+      if (offset > e.uncompressedSize)
+         return false;
+      
+      size = std::min(size, e.uncompressedSize - offset);
+      uint8_t* dataOut = (uint8_t*)malloc(std::max<uint64_t>(size, 1));
+      if (!readRange(stream, entryIdx, offset, size, dataOut))
+      {
+         free(dataOut);
+         return false;
+      }
+      
+      outStream = MemRStream(size, dataOut, true);
+      return true;
+   }
+   
+   void getReadStats(ResManager::ReadStats& stats)
+   {
+      std::lock_guard<std::mutex> lock(mIndexLock);
+      
+      for (EntryIndex& info : mIndices)
+      {
+         if (!info.index)
+            continue;
+         
+         DeflateIndex::Stats indexStats;
+         info.index->getStats(indexStats);
+         stats.numIndices++;
+         stats.numCheckpoints += info.index->getNumCheckpoints();
+         stats.numReads += indexStats.numReads;
+         stats.numRetries += indexStats.numRetries;
+         stats.compressedRead += indexStats.compressedRead;
+         stats.inflated += indexStats.inflated;
+         stats.numRejectedIndexCaches += indexStats.numRejectedCaches;
+      }
+      
+      stats.numHeaderReads += mNumHeaderReads;
    }
 };
 
 
 
+MappedFile::MappedFile() : mPtr(NULL), mSize(0)
+#ifdef _WIN32
+, mFileHandle(INVALID_HANDLE_VALUE), mMapHandle(NULL)
+#else
+, mFD(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+bool MappedFile::open(const char* filename)
+{
+   close();
+   
+#ifdef _WIN32
+   mFileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (mFileHandle == INVALID_HANDLE_VALUE)
+      return false;
+   
+   LARGE_INTEGER size;
+   if (!GetFileSizeEx(mFileHandle, &size) || size.QuadPart == 0)
+   {
+      close();
+      return false;
+   }
+   
+   mMapHandle = CreateFileMappingA(mFileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+   if (mMapHandle == NULL)
+   {
+      close();
+      return false;
+   }
+   
+   mPtr = (const uint8_t*)MapViewOfFile(mMapHandle, FILE_MAP_READ, 0, 0, 0);
+   mSize = size.QuadPart;
+#else
+   mFD = ::open(filename, O_RDONLY);
+   if (mFD < 0)
+      return false;
+   
+   struct stat st;
+   if (fstat(mFD, &st) != 0 || st.st_size == 0)
+   {
+      close();
+      return false;
+   }
+   
+   void* ptr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, mFD, 0);
+   mPtr = ptr == MAP_FAILED ? NULL : (const uint8_t*)ptr;
+   mSize = st.st_size;
+#endif
+   
+   if (mPtr == NULL)
+   {
+      close();
+      return false;
+   }
+   
+   return true;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+   if (mPtr)
+      UnmapViewOfFile(mPtr);
+   if (mMapHandle)
+      CloseHandle(mMapHandle);
+   if (mFileHandle != INVALID_HANDLE_VALUE)
+      CloseHandle(mFileHandle);
+   mMapHandle = NULL;
+   mFileHandle = INVALID_HANDLE_VALUE;
+#else
+   if (mPtr)
+      munmap((void*)mPtr, mSize);
+   if (mFD >= 0)
+      ::close(mFD);
+   mFD = -1;
+#endif
+   mPtr = NULL;
+   mSize = 0;
+}
+
 std::unordered_map<std::string, ResManager::CreateFunc> ResManager::smCreateFuncs;
 
+std::unordered_map<std::string, ResManager::PeekInfo> ResManager::smPeekFuncs;
+
 void ResManager::registerCreateFunc(const char* ext, CreateFunc func)
 {
    smCreateFuncs[ext] = func;
 }
 
+void ResManager::registerPeekFunc(const char* ext, uint32_t headerSize, PeekFunc func)
+{
+   smPeekFuncs[ext] = {headerSize, func};
+}
+
+ResManager::~ResManager()
+{
+   // Outstanding reads still refer to the volumes
+   mAsyncReader.reset();
+   
+   for (Volume* vol : mVolumes)
+      delete vol;
+   mVolumes.clear();
+}
+
 void ResManager::addVolume(const char *filename)
 {
    std::ifstream file(filename, std::ios::binary);
@@ -987,10 +1460,26 @@ void ResManager::addVolume(const char *filename)
       bool didFail = vol->mFile.fail();
       assert(!didFail);
       vol->mName = filename;
+      vol->mIndexCachePath = mIndexCachePath;
+#ifdef _WIN32
+      vol->mFD = ::_open(filename, _O_RDONLY | _O_BINARY);
+#else
+      vol->mFD = ::open(filename, O_RDONLY);
+#endif
       mVolumes.push_back(vol);
    }
 }
 
+void ResManager::setIndexCachePath(const char* path)
+{
+   mIndexCachePath = path ? path : "";
+   for (Volume* vol : mVolumes)
+   {
+      std::lock_guard<std::mutex> lock(vol->mIndexLock);
+      vol->mIndexCachePath = mIndexCachePath;
+   }
+}
+
 bool ResManager::openFile(const char *filename, MemRStream &stream, int32_t forceMount)
 {
    // Check cwd
@@ -1004,7 +1493,7 @@ bool ResManager::openFile(const char *filename, MemRStream &stream, int32_t forc
       }
       char buffer[PATH_MAX];
       snprintf(buffer, PATH_MAX, "%s/%s", path.c_str(), filename);
-      std::ifstream file(filename, std::ios::binary | std::ios::ate);
+      std::ifstream file(buffer, std::ios::binary | std::ios::ate);
       if (file.is_open())
       {
          uint64_t size = file.tellg();
@@ -1044,6 +1533,204 @@ bool ResManager::openFile(const char *filename, MemRStream &stream, int32_t forc
    return false;
 }
 
+bool ResManager::openFileRange(const char *filename, uint64_t offset, uint64_t size, MemRStream &stream, int32_t forceMount)
+{
+   // Check cwd
+   int count = 0;
+   for (std::string &path: mPaths)
+   {
+      if (forceMount >= 0 && count != forceMount)
+      {
+         count++;
+         continue;
+      }
+      char buffer[PATH_MAX];
+      snprintf(buffer, PATH_MAX, "%s/%s", path.c_str(), filename);
+      std::ifstream file(buffer, std::ios::binary | std::ios::ate);
+      if (file.is_open())
+      {
+         uint64_t fileSize = file.tellg();
+         if (offset > fileSize)
+            return false;
+         
+         size = std::min(size, fileSize - offset);
+         file.seekg(offset);
+         uint8_t* data = (uint8_t*)malloc(std::max<uint64_t>(size, 1));
+         file.read((char*)data, size);
+         
+         if (!file.fail())
+         {
+            stream = MemRStream(size, data, true);
+            return true;
+         }
+         free(data);
+         return false;
+      }
+      count++;
+   }
+   
+   // Scan volumes
+   for (Volume* vol: mVolumes)
+   {
+      if (forceMount >= 0 && count != forceMount)
+      {
+         count++;
+         continue;
+      }
+      if (vol->openStreamRange(vol->mFile, filename, offset, size, stream))
+      {
+         return true;
+      }
+      count++;
+   }
+   
+   return false;
+}
+
+AsyncReader* ResManager::getAsyncReader()
+{
+   std::lock_guard<std::mutex> lock(mAsyncLock);
+   if (!mAsyncReader)
+      mAsyncReader.reset(new AsyncReader());
+   return mAsyncReader.get();
+}
+
+bool ResManager::openFileAsync(const char *filename, AsyncReader::Priority priority, OpenFunc onOpen, int32_t forceMount)
+{
+   AsyncReader* reader = getAsyncReader();
+   
+   // Check cwd
+   int count = 0;
+   for (std::string &path: mPaths)
+   {
+      if (forceMount >= 0 && count != forceMount)
+      {
+         count++;
+         continue;
+      }
+      char buffer[PATH_MAX];
+      snprintf(buffer, PATH_MAX, "%s/%s", path.c_str(), filename);
+#ifdef _WIN32
+      int fd = ::_open(buffer, _O_RDONLY | _O_BINARY);
+#else
+      int fd = ::open(buffer, O_RDONLY);
+#endif
+      if (fd >= 0)
+      {
+         struct stat st;
+         if (fstat(fd, &st) != 0)
+         {
+#ifdef _WIN32
+            ::_close(fd);
+#else
+            ::close(fd);
+#endif
+            count++;
+            continue;
+         }
+         
+         reader->read(fd, 0, st.st_size, priority, [fd, onOpen](uint8_t* data, uint64_t size){
+#ifdef _WIN32
+            ::_close(fd);
+#else
+            ::close(fd);
+#endif
+            MemRStream stream;
+            if (data)
+               stream = MemRStream(size, data, true);
+            onOpen(data != NULL, stream);
+         });
+         return true;
+      }
+      count++;
+   }
+   
+   // Scan volumes
+   for (Volume* vol: mVolumes)
+   {
+      if (forceMount >= 0 && count != forceMount)
+      {
+         count++;
+         continue;
+      }
+      
+      int32_t entryIdx = vol->findEntry(filename);
+      if (entryIdx < 0)
+      {
+         count++;
+         continue;
+      }
+      
+      const Volume::Entry& e = vol->mEntries[entryIdx];
+      if (vol->mFD < 0)
+         return false;
+      
+      // The whole entry is read at once, then decoded by the worker
+      auto decode = [vol, entryIdx, onOpen](uint8_t* data, uint64_t size){
+         uint8_t* dataOut = NULL;
+         MemRStream stream;
+         bool ok = data != NULL && vol->decodeEntryBuffer(entryIdx, data, dataOut);
+         if (ok)
+            stream = MemRStream(vol->mEntries[entryIdx].uncompressedSize, dataOut, true);
+         onOpen(ok, stream);
+      };
+      
+      uint64_t start = vol->mDataStarts[entryIdx];
+      if (start != 0)
+      {
+         reader->read(vol->mFD, start, e.compressedSize, priority, decode);
+         return true;
+      }
+      
+      // First read of this entry; the local header comes along with the data
+      // rather than being looked up here with a blocking seek
+      reader->read(vol->mFD, e.dataOffset, vol->getEntryReadGuess(e), priority, [vol, entryIdx, reader, priority, decode](uint8_t* data, uint64_t size){
+         const Volume::Entry& e = vol->mEntries[entryIdx];
+         uint64_t start = data ? vol->parseLocalHeader(e, data, size) : 0;
+         uint64_t headerSize = start - e.dataOffset;
+         if (start == 0)
+         {
+            free(data);
+            decode(NULL, 0);
+         }
+         else if (headerSize + e.compressedSize <= size)
+         {
+            memmove(data, data + headerSize, e.compressedSize);
+            decode(data, e.compressedSize);
+         }
+         else
+         {
+            // Local header was bigger than expected
+            free(data);
+            reader->read(vol->mFD, start, e.compressedSize, priority, decode);
+         }
+      });
+      return true;
+   }
+   
+   return false;
+}
+
+void ResManager::waitAsync()
+{
+   // Not waited on under the lock as callbacks may queue more files
+   AsyncReader* reader = NULL;
+   {
+      std::lock_guard<std::mutex> lock(mAsyncLock);
+      reader = mAsyncReader.get();
+   }
+   
+   if (reader)
+      reader->wait();
+}
+
+void ResManager::getReadStats(ReadStats& outStats)
+{
+   outStats = {};
+   for (Volume* vol : mVolumes)
+      vol->getReadStats(outStats);
+}
+
 void ResManager::enumerateVolume(uint32_t idx, std::vector<EnumEntry> &outList, std::vector<std::string> *restrictExts)
 {
    for (Volume::Entry &e : mVolumes[idx]->mEntries)
@@ -1151,15 +1838,149 @@ ResourceInstance* ResManager::createResource(const char *filename, int32_t force
    
    if (openFile(filename, stream, forceMount))
    {
-      ResourceInstance* inst = itr->second();
-      if (!inst->read(stream))
-      {
-         delete inst;
-         return NULL;
-      }
-      
-      return inst;
+      return createResourceFromStream(filename, stream);
    }
    
    return NULL;
 }
+
+bool ResManager::canRead(const char *filename, int32_t forceMount)
+{
+   const char* ext = strrchr(filename, '.');
+   if (!ext)
+      return true;
+   
+   std::string lowerExt = ext;
+   std::transform(lowerExt.begin(), lowerExt.end(), lowerExt.begin(), ::tolower);
+   auto itr = smPeekFuncs.find(lowerExt);
+   if (itr == smPeekFuncs.end())
+      return true;
+   
+   MemRStream header;
+   if (!openFileRange(filename, 0, itr->second.headerSize, header, forceMount) || header.mSize < itr->second.headerSize)
+      return false;
+   return itr->second.func(header);
+}
+
+bool ResManager::hasCreateFunc(const char *filename)
+{
+   const char* ext = strrchr(filename, '.');
+   if (!ext)
+      return false;
+   
+   std::string lowerExt = ext;
+   std::transform(lowerExt.begin(), lowerExt.end(), lowerExt.begin(), ::tolower);
+   return smCreateFuncs.find(lowerExt) != smCreateFuncs.end();
+}
+
+ResourceInstance* ResManager::createResourceFromStream(const char *filename, MemRStream &stream)
+{
+   const char* ext = strrchr(filename, '.');
+   if (!ext)
+      return NULL;
+   
+   std::string lowerExt = ext;
+   std::transform(lowerExt.begin(), lowerExt.end(), lowerExt.begin(), ::tolower);
+   
+   auto itr = smCreateFuncs.find(lowerExt);
+   if (itr == smCreateFuncs.end())
+      return NULL;
+   
+   ResourceInstance* inst = itr->second();
+   if (!inst->read(stream))
+   {
+      delete inst;
+      return NULL;
+   }
+   
+   return inst;
+}
+
+// Content hash
+
+uint64_t hashContent64(const void* data, size_t size, uint64_t seed)
+{
+   return XXH3_64bits_withSeed(data, size, seed);
+}
+
+// Run of the mill quaternion interpolator
+slm::quat CompatInterpolate( slm::quat const & q1,
+                            slm::quat const & q2, float t )
+{
+   // calculate the cosine of the angle
+   double cosOmega = q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w; // i.e. dot
+   
+   // adjust signs if necessary
+   float sign2;
+   if ( cosOmega < 0.0 )
+   {
+      cosOmega = -cosOmega;
+      sign2 = -1.0f;
+   }
+   else
+      sign2 = 1.0f;
+   
+   // calculate interpolating coeffs
+   double scale1, scale2;
+   if ( (1.0 - cosOmega) > 0.00001 )
+   {
+      // standard case
+      double omega = acos(cosOmega);
+      double sinOmega = sin(omega);
+      scale1 = sin((1.0 - t) * omega) / sinOmega;
+      scale2 = sign2 * sin(t * omega) / sinOmega;
+   }
+   else
+   {
+      // if quats are very close, just do linear interpolation
+      scale1 = 1.0 - t;
+      scale2 = sign2 * t;
+   }
+   
+   // actually do the interpolation
+   return slm::quat(float(scale1 * q1.x + scale2 * q2.x),
+                    float(scale1 * q1.y + scale2 * q2.y),
+                    float(scale1 * q1.z + scale2 * q2.z),
+                    float(scale1 * q1.w + scale2 * q2.w));
+}
+
+void CompatQuatSetMatrix(const slm::quat rot, slm::mat4 &outMat)
+{
+   if( rot.x*rot.x + rot.y*rot.y + rot.z*rot.z < 10E-20f)
+   {
+      outMat = slm::mat4(1);
+      return;
+   }
+   
+   float xs = rot.x * 2.0f;
+   float ys = rot.y * 2.0f;
+   float zs = rot.z * 2.0f;
+   float wx = rot.w * xs;
+   float wy = rot.w * ys;
+   float wz = rot.w * zs;
+   float xx = rot.x * xs;
+   float xy = rot.x * ys;
+   float xz = rot.x * zs;
+   float yy = rot.y * ys;
+   float yz = rot.y * zs;
+   float zz = rot.z * zs;
+   
+   // r,c
+   outMat[0] = slm::vec4(1.0f - (yy + zz),
+                         xy - wz,
+                         xz + wy,
+                         0.0f);
+   
+   outMat[1] = slm::vec4(xy + wz,
+                         1.0f - (xx + zz),
+                         yz - wx,
+                         0.0f);
+   
+   outMat[2] = slm::vec4(xz - wy,
+                         yz + wx,
+                         1.0f - (xx + yy),
+                         0.0f);
+   
+   //outMat = slm::transpose(outMat);
+   outMat[3] = slm::vec4(0.0f,0.0f,0.0f,1.0f);
+}
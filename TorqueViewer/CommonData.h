@@ -24,9 +24,13 @@
 #define _COMMONDATA_H_
 
 #include <algorithm>
+#include <atomic>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <slm/slmath.h>
 #include <string>
+#include <vector>
 
 #ifndef NO_BOOST
 #include <boost/filesystem.hpp>
@@ -37,6 +41,17 @@ namespace fs = std::filesystem;
 #endif
 
 #include "CommonShaderTypes.h"
+#include "memTracker.h"
+#include "asyncReader.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define TV_SSSE3_DISPATCH
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #define BIT(x) (((uint32_t)1)<<(x))
 
@@ -61,6 +76,37 @@ inline uint32_t getNextPow2(uint32_t a)
    return a + 1;
 }
 
+// Fast non-cryptographic hash, used to check if files have changed
+inline uint64_t hashBytes64(const void* data, size_t size, uint64_t seed=0)
+{
+   const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+   const uint8_t* ptr = (const uint8_t*)data;
+   uint64_t h = seed ^ (size * prime);
+   
+   while (size != 0)
+   {
+      uint64_t k = 0;
+      size_t count = size < 8 ? size : 8;
+      memcpy(&k, ptr, count);
+      ptr += count;
+      size -= count;
+      
+      k *= 0xBF58476D1CE4E5B9ULL;
+      k ^= k >> 31;
+      h = (h ^ k) * prime;
+      h = (h << 27) | (h >> 37);
+   }
+   
+   h ^= h >> 33;
+   h *= 0xFF51AFD7ED558CCDULL;
+   h ^= h >> 33;
+   return h;
+}
+
+// Hash for identifying large blobs (e.g. texture contents) by their data. This is
+// XXH3 64-bit, so results match the reference xxHash on every platform.
+extern uint64_t hashContent64(const void* data, size_t size, uint64_t seed=0);
+
 class MemRStream;
 
 class ConsolePersistObject
@@ -112,25 +158,32 @@ public:
    bool mOwnPtr;
    
    MemRStream() : mPos(0), mSize(0), mPtr(NULL), mOwnPtr(false) {;}
-   MemRStream(uint64_t sz, void* ptr, bool ownPtr=false) : mPos(0), mSize(sz), mPtr((uint8_t*)ptr), mOwnPtr(ownPtr) {;}
+   MemRStream(uint64_t sz, void* ptr, bool ownPtr=false) : mPos(0), mSize(sz), mPtr((uint8_t*)ptr), mOwnPtr(ownPtr)
+   {
+      if (mOwnPtr)
+         MemTracker::trackAlloc(MemCategory_Stream, mSize);
+   }
+   
+   // NOTE: copies take ownership of the buffer (if any) from other
    MemRStream(MemRStream &&other)
    {
       mPtr = other.mPtr;
       mPos = other.mPos;
       mSize = other.mSize;
+      mOwnPtr = other.mOwnPtr;
       other.mOwnPtr = false;
-      mOwnPtr = true;
    }
    MemRStream(MemRStream &other)
    {
       mPtr = other.mPtr;
       mPos = other.mPos;
       mSize = other.mSize;
+      mOwnPtr = other.mOwnPtr;
       other.mOwnPtr = false;
-      mOwnPtr = true;
    }
    MemRStream& operator=(MemRStream other)
    {
+      releaseOwnedPtr();
       mPtr = other.mPtr;
       mPos = other.mPos;
       mSize = other.mSize;
@@ -140,8 +193,17 @@ public:
    }
    ~MemRStream()
    {
-      if(mOwnPtr)
-         free(mPtr);
+      releaseOwnedPtr();
+   }
+   
+   inline void releaseOwnedPtr()
+   {
+      if (!mOwnPtr)
+         return;
+      
+      MemTracker::trackFree(MemCategory_Stream, mSize);
+      free(mPtr);
+      mOwnPtr = false;
    }
 
    void setOffsetView(MemRStream &other, std::size_t offset, std::size_t size)
@@ -179,6 +241,9 @@ public:
    
    inline bool read(uint64_t size, void* data)
    {
+      // Empty arrays may pass a NULL data
+      if (size == 0)
+         return true;
       if (mPos >= mSize || mPos+size > mSize)
          return false;
       
@@ -319,6 +384,9 @@ public:
    
    inline bool write(uint64_t size, const void* data)
    {
+      // Empty arrays may pass a NULL data
+      if (size == 0)
+         return true;
       if (mPos >= mSize || mPos+size > mSize)
          return false;
       
@@ -485,6 +553,7 @@ public:
    
    uint8_t* mData;
    uint8_t* mMips[MAX_MIPS];
+   uint32_t mDataSize;
    
    Palette* mPal;
    
@@ -497,6 +566,10 @@ public:
    bool readBM8(MemRStream& mem);
    bool read(MemRStream& mem);
    
+   // Mips are stored as offsets into the data
+   bool readMipOffsets(MemRStream& mem, uint32_t* outOffsets);
+   bool resolveMips(const uint32_t* offsets);
+   
    static int stbi_read_callback(void *user, char *data, int size);
    static void stbi_skip_callback(void *user, int n);
    static int stbi_eof_callback(void *user);
@@ -564,19 +637,137 @@ inline void copyMipDirectPadded2(uint32_t height, uint32_t src_stride, uint32_t
    }
 }
 
+#ifdef TV_SSSE3_DISPATCH
+// Compiled for SSSE3 whatever the build flags are, so only call it once
+// cpuHasSSSE3 says so. Returns the number of pixels converted.
+__attribute__((target("ssse3"))) inline uint32_t copyRGBToRGBA_SSSE3(uint8_t* dest, const uint8_t* src, uint32_t numPixels)
+{
+   // 16 byte loads cover 5 and a bit pixels, so stop before reading past the end
+   const __m128i shuffle = _mm_setr_epi8(0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1);
+   const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+   uint32_t i = 0;
+   for (; i + 6 <= numPixels; i += 4)
+   {
+      __m128i rgb = _mm_loadu_si128((const __m128i*)(src + (i*3)));
+      _mm_storeu_si128((__m128i*)(dest + (i*4)), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alpha));
+   }
+   return i;
+}
+
+inline bool cpuHasSSSE3()
+{
+   static const bool hasSSSE3 = __builtin_cpu_supports("ssse3");
+   return hasSSSE3;
+}
+#endif
+
+// Expands packed RGB to RGBA with opaque alpha
+inline void copyRGBToRGBA(uint8_t* dest, const uint8_t* src, uint32_t numPixels)
+{
+   uint32_t i = 0;
+   
+#if defined(__ARM_NEON)
+   const uint8x16_t alpha = vdupq_n_u8(255);
+   for (; i + 16 <= numPixels; i += 16)
+   {
+      uint8x16x3_t rgb = vld3q_u8(src + (i*3));
+      uint8x16x4_t rgba;
+      rgba.val[0] = rgb.val[0];
+      rgba.val[1] = rgb.val[1];
+      rgba.val[2] = rgb.val[2];
+      rgba.val[3] = alpha;
+      vst4q_u8(dest + (i*4), rgba);
+   }
+#elif defined(TV_SSSE3_DISPATCH)
+   if (cpuHasSSSE3())
+      i = copyRGBToRGBA_SSSE3(dest, src, numPixels);
+#endif
+   
+   // 4 pixels at a time as 3 words in, 4 words out (little endian)
+   for (; i + 4 <= numPixels; i += 4)
+   {
+      uint32_t w[3];
+      uint32_t out[4];
+      memcpy(w, src + (i*3), 12);
+      out[0] = w[0] | 0xFF000000;
+      out[1] = (w[0] >> 24) | (w[1] << 8) | 0xFF000000;
+      out[2] = (w[1] >> 16) | (w[2] << 16) | 0xFF000000;
+      out[3] = (w[2] >> 8) | 0xFF000000;
+      memcpy(dest + (i*4), out, 16);
+   }
+   
+   for (; i < numPixels; i++)
+   {
+      dest[(i*4)+0] = src[(i*3)+0];
+      dest[(i*4)+1] = src[(i*3)+1];
+      dest[(i*4)+2] = src[(i*3)+2];
+      dest[(i*4)+3] = 255;
+   }
+}
+
+// Expands RGB 565 to RGBA, replicating the high bits into the low bits
+inline void copy565ToRGBA(uint8_t* dest, const uint16_t* src, uint32_t numPixels)
+{
+   uint32_t i = 0;
+   
+#if defined(__ARM_NEON)
+   const uint16x8_t mask5 = vdupq_n_u16(0x1F);
+   const uint16x8_t mask6 = vdupq_n_u16(0x3F);
+   for (; i + 8 <= numPixels; i += 8)
+   {
+      uint16x8_t c = vld1q_u16(src + i);
+      uint16x8_t r = vshrq_n_u16(c, 11);
+      uint16x8_t g = vandq_u16(vshrq_n_u16(c, 5), mask6);
+      uint16x8_t b = vandq_u16(c, mask5);
+      uint8x8x4_t rgba;
+      rgba.val[0] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+      rgba.val[1] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+      rgba.val[2] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+      rgba.val[3] = vdup_n_u8(255);
+      vst4_u8(dest + (i*4), rgba);
+   }
+#elif defined(__SSE2__) || defined(_M_X64)
+   // Only needs SSE2, which every x86-64 cpu has, so no dispatch
+   const __m128i mask5 = _mm_set1_epi16(0x1F);
+   const __m128i mask6 = _mm_set1_epi16(0x3F);
+   const __m128i alpha = _mm_set1_epi16((short)0xFF00);
+   for (; i + 8 <= numPixels; i += 8)
+   {
+      __m128i c = _mm_loadu_si128((const __m128i*)(src + i));
+      __m128i r = _mm_srli_epi16(c, 11);
+      __m128i g = _mm_and_si128(_mm_srli_epi16(c, 5), mask6);
+      __m128i b = _mm_and_si128(c, mask5);
+      r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+      g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+      b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+      
+      // (r | g << 8) and (b | 255 << 8) interleave into r,g,b,a bytes
+      __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+      __m128i ba = _mm_or_si128(b, alpha);
+      _mm_storeu_si128((__m128i*)(dest + (i*4)), _mm_unpacklo_epi16(rg, ba));
+      _mm_storeu_si128((__m128i*)(dest + (i*4) + 16), _mm_unpackhi_epi16(rg, ba));
+   }
+#endif
+   
+   for (; i<numPixels; i++)
+   {
+      uint32_t c = src[i];
+      uint32_t r = (c >> 11) & 0x1F;
+      uint32_t g = (c >> 5) & 0x3F;
+      uint32_t b = c & 0x1F;
+      r = (r << 3) | (r >> 2);
+      g = (g << 2) | (g >> 4);
+      b = (b << 3) | (b >> 2);
+      uint32_t rgba = 0xFF000000 | (b << 16) | (g << 8) | r;
+      memcpy(dest + (i*4), &rgba, 4);
+   }
+}
+
 inline void copyMipDirectPadded(uint32_t height, uint32_t src_stride, uint32_t dest_stride, uint8_t* data, uint8_t* out_data)
 {
    for (int y=0; y<height; y++)
    {
-      uint8_t *srcPixels = data + (y*src_stride);
-      uint8_t *destPixels = out_data + (y*dest_stride);
-      for (int x=0; x<src_stride; x+=3)
-      {
-         *destPixels++ = *srcPixels++;
-         *destPixels++ = *srcPixels++;
-         *destPixels++ = *srcPixels++;
-         *destPixels++ = 255;
-      }
+      copyRGBToRGBA(out_data + (y*dest_stride), data + (y*src_stride), src_stride / 3);
    }
 }
 
@@ -629,7 +820,7 @@ public:
     {
         WordBits = sizeof(std::size_t) * 8,
         WordSize = sizeof(std::size_t),
-        TotalWords = (BitSize+sizeof(std::size_t)-1) / sizeof(std::size_t)
+        TotalWords = (BitSize+WordBits-1) / WordBits
     };
 
 public:
@@ -642,20 +833,25 @@ public:
         memset(mWords, 0, sizeof(mWords));
     }
 
+    static inline std::size_t wordBit(std::size_t pos)
+    {
+        return ((std::size_t)1) << (pos % WordBits);
+    }
+
     inline bool operator==(const BitSet& other) const
     {
-        return memcmp(this, other, sizeof(mWords)) == 0;
+        return memcmp(mWords, other.mWords, sizeof(mWords)) == 0;
     }
 
     inline bool operator!=(const BitSet& other) const
     {
-        return memcmp(this, other, sizeof(mWords)) != 0;
+        return memcmp(mWords, other.mWords, sizeof(mWords)) != 0;
     }
 
     inline bool test(std::size_t pos) const
     {
-        std::size_t offset = pos / WordSize;
-        return (mWords[offset] & BIT(pos % WordSize)) != 0;
+        std::size_t offset = pos / WordBits;
+        return (mWords[offset] & wordBit(pos)) != 0;
     }
 
     bool all()
@@ -708,15 +904,13 @@ public:
         return TotalWords * WordBits;
     }
 
+    // Number of words up to and including the last non-zero one
     inline std::size_t setWordSize() const
     {
-      std::size_t lastSize = 0;
-      for (std::size_t i=0; i<TotalWords; i++)
-      {
-         if (mWords[i] != 0)
-            lastSize = i;
-      }
-      return lastSize;
+      std::size_t numWords = TotalWords;
+      while (numWords > 0 && mWords[numWords-1] == 0)
+         numWords--;
+      return numWords;
     }
 
     inline void set()
@@ -726,8 +920,11 @@ public:
 
     inline void set(std::size_t pos, bool value)
     {
-        std::size_t offset = pos / WordSize;
-        mWords[offset] |= BIT(pos % WordSize);
+        std::size_t offset = pos / WordBits;
+        if (value)
+            mWords[offset] |= wordBit(pos);
+        else
+            mWords[offset] &= ~wordBit(pos);
     }
 
     inline void diff(const BitSet<BitSize>& other)
@@ -760,10 +957,10 @@ public:
         }
     }
 
-    inline void flip(std::size_t pos, bool value)
+    inline void flip(std::size_t pos)
     {
-        std::size_t offset = pos / WordSize;
-        mWords[offset] &= ~BIT(pos % WordSize);
+        std::size_t offset = pos / WordBits;
+        mWords[offset] ^= wordBit(pos);
     }
 
     BitSet<BitSize>& operator&=(const BitSet<BitSize>& other)
@@ -804,32 +1001,26 @@ public:
 
     std::ptrdiff_t findFirst() const
     {
-      for (std::size_t i = 0; i < TotalWords; i++)
-      {
-         if (mWords[i] != 0)
-         {
-            return (std::ptrdiff_t)((i * WordBits) + std::countr_zero(mWords[i])); 
-         }
-      }
-      return -1;
+      return findNext(0);
     }
 
     std::ptrdiff_t findLast() const
     {
-      for (std::size_t i = TotalWords-1; i >=0; i--)
+      for (std::size_t i = TotalWords; i > 0; i--)
       {
-         if (mWords[i] != 0)
+         if (mWords[i-1] != 0)
          {
-            return (std::ptrdiff_t)((i * WordBits) + ((WordBits-1) - std::countl_zero(mWords[i]))); 
+            return (std::ptrdiff_t)(((i-1) * WordBits) + ((WordBits-1) - std::countl_zero(mWords[i-1])));
          }
       }
       return -1;
     }
 
-    std::ptrdiff_t findNext(std::ptrdiff_t last) const
+    // First set index >= from, or -1
+    std::ptrdiff_t findNext(std::ptrdiff_t from) const
     {
-      std::size_t startWord = last < 0 ? 0 : (last / WordBits);
-      std::size_t wordShift = last < 0 ? 0 : last % WordBits;
+      std::size_t startWord = from < 0 ? 0 : (from / WordBits);
+      std::size_t wordShift = from < 0 ? 0 : from % WordBits;
 
       for (std::size_t i = startWord; i < TotalWords; i++)
       {
@@ -845,38 +1036,132 @@ public:
     }
 };
 
-template<const std::size_t BS> BitSet<BS>& operator&(const BitSet<BS>& lhs,const BitSet<BS>& rhs)
+template<const std::size_t BS> BitSet<BS> operator&(const BitSet<BS>& lhs,const BitSet<BS>& rhs)
 {
     BitSet<BS> out = lhs;
-    for (std::size_t i=0; i<BitSet<BS>::TotalWords; i++)
-    {
-        out.mWords[i] &= rhs.mWords[i];
-    }
+    out &= rhs;
     return out;
 }
 
-template<const std::size_t BS> BitSet<BS>& operator|(const BitSet<BS>& lhs,const BitSet<BS>& rhs)
+template<const std::size_t BS> BitSet<BS> operator|(const BitSet<BS>& lhs,const BitSet<BS>& rhs)
 {
     BitSet<BS> out = lhs;
-    for (std::size_t i=0; i<BitSet<BS>::TotalWords; i++)
-    {
-        out.mWords[i] |= rhs.mWords[i];
-    }
+    out |= rhs;
     return out;
 }
 
-template<const std::size_t BS> BitSet<BS>& operator^(const BitSet<BS>& lhs,const BitSet<BS>& rhs)
+template<const std::size_t BS> BitSet<BS> operator^(const BitSet<BS>& lhs,const BitSet<BS>& rhs)
 {
     BitSet<BS> out = lhs;
-    for (std::size_t i=0; i<BitSet<BS>::TotalWords; i++)
-    {
-        out.mWords[i] ^= rhs.mWords[i];
-    }
+    out ^= rhs;
     return out;
 }
 
 
-typedef BitSet<IntegerSetBits> IntegerSet;
+/*
+ Set of node or object indices used by sequences. Torque stores these as 32-bit
+ words; only words up to the last set bit are kept, on the heap, since most
+ sequences only touch a handful of nodes.
+ */
+class IntegerSet
+{
+public:
+   enum
+   {
+      WordBits = 32,
+      WordSize = sizeof(uint32_t),
+      MaxWords = IntegerSetBits / WordBits
+   };
+   
+   std::vector<uint32_t> mWords;
+   
+   inline bool operator==(const IntegerSet& other) const
+   {
+      return mWords == other.mWords;
+   }
+   
+   inline bool operator!=(const IntegerSet& other) const
+   {
+      return mWords != other.mWords;
+   }
+   
+   inline bool test(std::size_t pos) const
+   {
+      std::size_t offset = pos / WordBits;
+      return offset < mWords.size() && (mWords[offset] & BIT(pos % WordBits)) != 0;
+   }
+   
+   void set(std::size_t pos, bool value)
+   {
+      std::size_t offset = pos / WordBits;
+      if (offset >= MaxWords)
+         return;
+      
+      if (offset >= mWords.size())
+      {
+         if (!value)
+            return;
+         mWords.resize(offset+1, 0);
+      }
+      
+      if (value)
+         mWords[offset] |= BIT(pos % WordBits);
+      else
+         mWords[offset] &= ~BIT(pos % WordBits);
+   }
+   
+   inline void reset()
+   {
+      mWords.clear();
+   }
+   
+   std::size_t count() const
+   {
+      std::size_t total = 0;
+      for (uint32_t word : mWords)
+      {
+         total += std::popcount(word);
+      }
+      return total;
+   }
+   
+   // Number of words up to and including the last non-zero one
+   std::size_t setWordSize() const
+   {
+      std::size_t numWords = mWords.size();
+      while (numWords > 0 && mWords[numWords-1] == 0)
+         numWords--;
+      return numWords;
+   }
+   
+   inline std::ptrdiff_t findFirst() const
+   {
+      return findNext(0);
+   }
+   
+   // First set index >= from, or -1
+   std::ptrdiff_t findNext(std::ptrdiff_t from) const
+   {
+      std::size_t startWord = from < 0 ? 0 : (from / WordBits);
+      std::size_t wordShift = from < 0 ? 0 : from % WordBits;
+      
+      for (std::size_t i = startWord; i < mWords.size(); i++)
+      {
+         uint32_t val = mWords[i] >> wordShift;
+         if (val != 0)
+         {
+            return (std::ptrdiff_t)((i * WordBits) + wordShift + std::countr_zero(val));
+         }
+         wordShift = 0;
+      }
+      return -1;
+   }
+   
+   inline size_t getHeapBytes() const
+   {
+      return mWords.capacity() * sizeof(uint32_t);
+   }
+};
 
 template<typename T> inline void readIntegerSet(T &fs, IntegerSet &set)
 {
@@ -885,7 +1170,16 @@ template<typename T> inline void readIntegerSet(T &fs, IntegerSet &set)
    set.reset();
    fs.read(numInts);
    fs.read(numWords);
-   fs.read(IntegerSet::WordSize * numWords, &set.mWords[0]);
+   
+   // NOTE: Torque never writes more than MaxWords; skip anything past that
+   set.mWords.resize(std::min<uint32_t>(numWords, IntegerSet::MaxWords));
+   fs.read(IntegerSet::WordSize * set.mWords.size(), set.mWords.data());
+   for (uint32_t i=(uint32_t)set.mWords.size(); i<numWords; i++)
+   {
+      uint32_t word = 0;
+      if (!fs.read(word))
+         break;
+   }
 }
 
 template<typename T> inline void writeIntegerSet(T &fs, const IntegerSet &set)
@@ -895,9 +1189,121 @@ template<typename T> inline void writeIntegerSet(T &fs, const IntegerSet &set)
    
    fs.write(numInts);
    fs.write(numWords);
-   fs.write(IntegerSet::WordSize * numWords, &set.mWords[0]);
+   fs.write(IntegerSet::WordSize * numWords, set.mWords.data());
 }
 
+/*
+ Array whose storage can be aliased by several owners. Copying a SharedArray
+ adds a reference to the same storage rather than duplicating it, so data
+ which is inherited (e.g. child meshes using their parent mesh's vertices)
+ only exists once. Writes and resizes through any alias are seen by all of
+ them; use clone() when a private copy is needed.
+ */
+template<typename T> class SharedArray
+{
+protected:
+   struct Storage
+   {
+      std::vector<T> mData;
+      std::atomic<uint32_t> mRefCount;
+      
+      Storage() : mRefCount(1) {;}
+   };
+   
+   Storage* mStorage;
+   
+   inline void release()
+   {
+      if (mStorage && --mStorage->mRefCount == 0)
+         delete mStorage;
+      mStorage = NULL;
+   }
+   
+public:
+   
+   SharedArray() : mStorage(NULL) {;}
+   SharedArray(const SharedArray& other) : mStorage(other.mStorage) { if (mStorage) mStorage->mRefCount++; }
+   SharedArray(SharedArray&& other) : mStorage(other.mStorage) { other.mStorage = NULL; }
+   ~SharedArray() { release(); }
+   
+   SharedArray& operator=(const SharedArray& other)
+   {
+      if (other.mStorage)
+         other.mStorage->mRefCount++;
+      release();
+      mStorage = other.mStorage;
+      return *this;
+   }
+   
+   SharedArray& operator=(SharedArray&& other)
+   {
+      if (this != &other)
+      {
+         release();
+         mStorage = other.mStorage;
+         other.mStorage = NULL;
+      }
+      return *this;
+   }
+   
+   inline size_t size() const { return mStorage ? mStorage->mData.size() : 0; }
+   inline size_t capacity() const { return mStorage ? mStorage->mData.capacity() : 0; }
+   inline bool empty() const { return size() == 0; }
+   
+   inline T* data() { return mStorage ? mStorage->mData.data() : NULL; }
+   inline const T* data() const { return mStorage ? mStorage->mData.data() : NULL; }
+   inline T& operator[](size_t idx) { return mStorage->mData[idx]; }
+   inline const T& operator[](size_t idx) const { return mStorage->mData[idx]; }
+   inline T* begin() { return data(); }
+   inline T* end() { return data() + size(); }
+   inline const T* begin() const { return data(); }
+   inline const T* end() const { return data() + size(); }
+   
+   void resize(size_t sz)
+   {
+      if (mStorage == NULL)
+      {
+         if (sz == 0)
+            return;
+         mStorage = new Storage();
+      }
+      mStorage->mData.resize(sz);
+   }
+   
+   // Drops this reference; other aliases keep the data
+   inline void clear() { release(); }
+   
+   // Resizes and frees any unused capacity; seen by every alias
+   void shrink(size_t sz)
+   {
+      if (mStorage == NULL)
+         return;
+      mStorage->mData.resize(sz);
+      mStorage->mData.shrink_to_fit();
+   }
+   
+   SharedArray clone() const
+   {
+      SharedArray copy;
+      if (mStorage)
+      {
+         copy.mStorage = new Storage();
+         copy.mStorage->mData = mStorage->mData;
+      }
+      return copy;
+   }
+   
+   inline uint32_t getRefCount() const { return mStorage ? mStorage->mRefCount.load() : 0; }
+   inline bool sharesWith(const SharedArray& other) const { return mStorage != NULL && mStorage == other.mStorage; }
+   
+   // Bytes used by the storage, split evenly between aliases so that
+   // summing over every alias counts the storage once.
+   inline size_t sharedBytes() const
+   {
+      return mStorage ? (capacity() * sizeof(T)) / mStorage->mRefCount.load() : 0;
+   }
+};
+
 struct Box
 {
    slm::vec3 min;
@@ -914,6 +1320,30 @@ public:
    virtual bool read(MemRStream& s) = 0;
 };
 
+// Read-only memory mapped file
+class MappedFile
+{
+public:
+   const uint8_t* mPtr;
+   uint64_t mSize;
+   
+   MappedFile();
+   ~MappedFile();
+   
+   bool open(const char* filename);
+   void close();
+   
+   inline bool isOpen() const { return mPtr != NULL; }
+   
+protected:
+#ifdef _WIN32
+   void* mFileHandle;
+   void* mMapHandle;
+#else
+   int mFD;
+#endif
+};
+
 class Volume;
 
 class ResManager
@@ -930,19 +1360,72 @@ public:
       EnumEntry(std::string_view& name, uint32_t m) : filename(name), mountIdx(m) {;}
    };
    
+   // Totals over the inflate indices of every volume
+   struct ReadStats
+   {
+      uint32_t numIndices;
+      uint32_t numCheckpoints;
+      uint32_t numReads;
+      uint32_t numRetries;     // reads which needed more input than planned
+      uint64_t compressedRead; // compressed bytes read from volumes
+      uint64_t inflated;       // bytes decoded, including output skipped to reach a range
+      uint32_t numHeaderReads; // local headers read with a blocking seek rather than async
+      uint32_t numRejectedIndexCaches; // saved indices that were stale or invalid
+   };
+   
    std::vector<Volume*> mVolumes;
    std::vector<std::string> mPaths;
+   std::string mIndexCachePath;
+   std::unique_ptr<AsyncReader> mAsyncReader;
+   std::mutex mAsyncLock;
    
    typedef std::function<ResourceInstance*()> CreateFunc;
+   
+   // Checks the first headerSize bytes of a file for a version read() supports
+   typedef bool (*PeekFunc)(MemRStream& header);
+   struct PeekInfo
+   {
+      uint32_t headerSize;
+      PeekFunc func;
+   };
+   
+   // Called on an async reader worker; stream holds the whole file when ok
+   typedef std::function<void(bool ok, MemRStream& stream)> OpenFunc;
    static std::unordered_map<std::string, ResManager::CreateFunc> smCreateFuncs;
+   static std::unordered_map<std::string, ResManager::PeekInfo> smPeekFuncs;
+   
+   ~ResManager();
    
    static void registerCreateFunc(const char* ext, CreateFunc func);
+   static void registerPeekFunc(const char* ext, uint32_t headerSize, PeekFunc func);
    static void initStatics();
    
    void addVolume(const char *filename);
    
+   // Saves inflate indices for large volume entries in path so later runs
+   // don't need to rebuild them. Empty keeps them in memory only.
+   void setIndexCachePath(const char* path);
+   
    bool openFile(const char *filename, MemRStream &stream, int32_t forceMount=-1);
    
+   // Reads up to size bytes starting at offset. Deflated volume entries are only
+   // inflated from the nearest indexed point before offset, so this is much
+   // cheaper than openFile when only the start or a small part of a file is needed.
+   bool openFileRange(const char *filename, uint64_t offset, uint64_t size, MemRStream &stream, int32_t forceMount=-1);
+   
+   // Shared reader for openFileAsync, created on first use
+   AsyncReader* getAsyncReader();
+   
+   // Queues a read of the whole file; volume entries are decoded on the reader's
+   // worker before onOpen is called. Returns false without calling onOpen if the
+   // file can't be found.
+   bool openFileAsync(const char *filename, AsyncReader::Priority priority, OpenFunc onOpen, int32_t forceMount=-1);
+   
+   // Blocks until every openFileAsync callback has run
+   void waitAsync();
+   
+   void getReadStats(ReadStats& outStats);
+   
    void enumerateVolume(uint32_t idx, std::vector<EnumEntry> &outList, std::vector<std::string> *restrictExts);
    
    void enumeratePath(uint32_t idx, std::vector<EnumEntry> &outList, std::vector<std::string> *restrictExts);
@@ -951,9 +1434,19 @@ public:
    
    void enumerateSearchPaths(std::vector<const char*> &outList);
    
+   // Only reads the header through openFileRange; files without a peek func pass
+   bool canRead(const char *filename, int32_t forceMount=-1);
+   
    const char *getMountName(uint32_t idx);
    
    ResourceInstance* createResource(const char *filename, int32_t forceMount=-1);
+   
+   // Creates a resource from an already opened file; returns NULL if the type isn't registered.
+   // NOTE: openFile & this are safe to call from multiple threads.
+   static ResourceInstance* createResourceFromStream(const char *filename, MemRStream &stream);
+   
+   // True if filename's extension has a create func
+   static bool hasCreateFunc(const char *filename);
 };
 
 class MaterialList : public ResourceInstance
@@ -1139,5 +1632,9 @@ struct Quat16
    bool operator!=( const Quat16 & q ) const { return !(*this == q); }
 };
 
+// Quaternion helpers matching torque behavior
+extern slm::quat CompatInterpolate(slm::quat const & q1, slm::quat const & q2, float t);
+extern void CompatQuatSetMatrix(const slm::quat rot, slm::mat4 &outMat);
+
 
 #endif /* SharedRender_h */
@@ -47,6 +47,15 @@ enum ModelPipelineState
    ModelPipeline_Count
 };
 
+// Features compiled into model & interior shader permutations. Each bit
+// enables the matching define in ShaderPreprocessor.
+enum ModelShaderFeature
+{
+   ModelFeature_AlphaTest = 1<<0, // ALPHA_TEST
+   ModelFeature_Count = 1,
+   ModelFeature_Permutations = 1<<ModelFeature_Count
+};
+
 enum TerrainPipelineState
 {
    TerrainPipeline_Squares,
@@ -74,6 +83,22 @@ typedef struct
    packed_float2 texcoord;
 } ModelTexVertex;
 
+typedef struct
+{
+   packed_float2 texcoord;
+   packed_float3 lmcoord; // u, v, atlas layer
+} ITRTexVertex;
+
+// Per-instance stream for model & interior draws. transform is applied after
+// the common model matrix; transformOffset is the base index of the instance's
+// node transforms for skinned or animated shapes.
+typedef struct
+{
+   matrix_float4x4 transform;
+   uint32_t transformOffset;
+   uint32_t pad[3];
+} ModelInstance;
+
 typedef struct
 {
    enum
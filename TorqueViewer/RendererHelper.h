@@ -17,6 +17,26 @@ enum CustomTextureFormat
    CustomTexture_TerrainSquare
 };
 
+// Per-frame submission counters, reset at the end of each GFXEndFrame
+struct GFXFrameStats
+{
+   uint32_t drawCalls;
+   uint32_t uiDrawCalls;
+   uint32_t instancesDrawn; // model instances submitted through instanced draws
+   uint32_t pipelineSets;
+   uint32_t pipelineSwitches;
+   uint32_t bindGroupSets;
+   uint32_t vertexBufferBinds;
+   uint32_t indexBufferBinds;
+   uint32_t bufferWrites;
+   uint32_t textureWrites;
+   uint32_t transientBuffersCreated;
+   uint32_t commandBuffersSubmitted;
+   uint64_t bufferWriteBytes;
+   uint64_t textureWriteBytes;
+   uint64_t transientBytes;
+};
+
 extern int GFXSetup(SDL_Window* window, SDL_Renderer* renderer);
 extern void GFXTeardown();
 extern void GFXTestRender(slm::vec3 pos);
@@ -26,10 +46,20 @@ extern void GFXResetSwapChain();
 extern bool GFXBeginFrame();
 extern void GFXEndFrame();
 extern void GFXHandleResize();
+extern void GFXSetHeadless(bool headless);
+extern bool GFXIsHeadless();
+extern bool GFXIsFallbackAdapter();
+extern bool GFXHasGPUTimestamps();
+extern float GFXWaitForGPU(); // GPU time of the last frame if GFXHasGPUTimestamps, otherwise submit to done latency
+extern void GFXGetFrameStats(GFXFrameStats& outStats);
+extern uint32_t GFXGetFrameStatsHistory(GFXFrameStats* outStats, uint32_t maxFrames);
 
 //
 extern int32_t GFXLoadCustomTexture(CustomTextureFormat fmt, uint32_t width, uint32_t height, void* data);
+extern int32_t GFXLoadCustomTextureArray(CustomTextureFormat fmt, uint32_t width, uint32_t height, uint32_t numLayers, void* data);
 extern void GFXUpdateCustomTextureAligned(int32_t texID, void* texData);
+// Swaps in new contents (and size) for texID; bindings using texID are updated to match
+extern bool GFXReplaceCustomTexture(int32_t texID, CustomTextureFormat fmt, uint32_t width, uint32_t height, void* data);
 //
 extern int32_t GFXLoadTexture(Bitmap* bmp, Palette*pal);
 extern int32_t GFXLoadTextureSet(uint32_t numBitmaps, Bitmap** bmps, Palette*pal);
@@ -37,6 +67,11 @@ extern void GFXDeleteTexture(int32_t texID);
 //
 extern void GFXLoadModelData(uint32_t modelId, void* verts, void* texverts, void* inds, void* skin, uint32_t numVerts, uint32_t numTexVerts, uint32_t numInds);
 extern void GFXClearModelData(uint32_t modelId);
+// Replaces numVerts verts starting at startVert, uploading just that range if the model is in this frame.
+// Pass inUse if draws recorded this frame read the range; the verts are then re-uploaded on next bind instead.
+extern void GFXUpdateModelVerts(uint32_t modelId, uint32_t startVert, const ModelVertex* verts, uint32_t numVerts, bool inUse);
+extern void GFXLoadITRModelData(uint32_t itrModelId, void* verts, void* texverts, void* inds, uint32_t numVerts, uint32_t numInds);
+extern void GFXClearITRModelData(uint32_t itrModelId);
 extern void GFXSetModelViewProjection(slm::mat4 &model, slm::mat4 &view, slm::mat4 &proj, uint32_t flags=0);
 extern void GFXSetLightPos(slm::vec3 pos, slm::vec4 ambient);
 //
@@ -47,8 +82,12 @@ extern void GFXBeginITRModelPipelineState(ModelPipelineState state, uint32_t itr
 extern void GFXSetTSPipelineProps(uint32_t matFrame, uint32_t transformOffset, slm::vec4 texGenS, slm::vec4 texGenT);
 //
 extern void GFXSetModelVerts(uint32_t modelId, uint32_t vertOffset, uint32_t texOffset, uint32_t indexOffset);
+extern void GFXSetITRModelVerts(uint32_t itrModelId);
 extern void GFXDrawModelVerts(uint32_t numVerts, uint32_t startVerts);
 extern void GFXDrawModelPrims(uint32_t numVerts, uint32_t numInds, uint32_t startInds, uint32_t startVerts);
+// Instanced draws read per-instance transforms from the last set of uploaded instances
+extern void GFXUploadModelInstances(const ModelInstance* instances, uint32_t numInstances);
+extern void GFXDrawModelPrimsInstanced(uint32_t numVerts, uint32_t numInds, uint32_t startInds, uint32_t startVerts, uint32_t firstInstance, uint32_t numInstances);
 //
 extern void GFXBeginLinePipelineState();
 extern void GFXDrawLine(slm::vec3 start, slm::vec3 end, slm::vec4 color, float width);
@@ -37,10 +37,12 @@
 
 #include "CommonShaderTypes.h"
 #include "CommonData.h"
+#include "shaderPreprocessor.h"
 
 #include "lineShader.wgsl.h"
 #include "modelShader.wgsl.h"
 #include "terrainShader.wgsl.h"
+#include "interiorShader.wgsl.h"
 
 #include "RendererHelper.h"
 
@@ -49,6 +51,9 @@ extern "C"
 {
 #if defined(__APPLE__) || defined(WGPU_NATIVE)
 #include "webgpu.h"
+#if defined(IMGUI_IMPL_WEBGPU_BACKEND_WGPU)
+#include "wgpu.h"
+#endif
 #else
 #include <webgpu/webgpu.h>
 #endif
@@ -79,23 +84,39 @@ struct BaseProgramInfo
    BaseProgramInfo() { memset(&uniforms, '\0', sizeof(CommonUniformStruct)); }
 };
 
+// Pipelines are built on first use for each state & shader feature permutation
 struct ModelProgramInfo : public BaseProgramInfo
 {
-   WGPURenderPipeline pipelines[ModelPipeline_Count];
+   WGPURenderPipeline pipelines[ModelPipeline_Count][ModelFeature_Permutations];
+   WGPUPipelineLayout pipelineLayout;
+   const char* shaderName;
+   bool lightmapped;
    
-   ModelProgramInfo() { memset(pipelines, '\0', sizeof(pipelines)); }
+   ModelProgramInfo() : pipelineLayout(NULL), shaderName(NULL), lightmapped(false) { memset(pipelines, '\0', sizeof(pipelines)); }
    
    void reset()
    {
       for (int i=0; i<ModelPipeline_Count; i++)
       {
-         if (pipelines[i])
-            wgpuRenderPipelineRelease(pipelines[i]);
-         pipelines[i] = NULL;
+         for (int j=0; j<ModelFeature_Permutations; j++)
+         {
+            if (pipelines[i][j])
+               wgpuRenderPipelineRelease(pipelines[i][j]);
+            pipelines[i][j] = NULL;
+         }
       }
+      
+      if (pipelineLayout)
+         wgpuPipelineLayoutRelease(pipelineLayout);
+      pipelineLayout = NULL;
    }
 };
 
+// Defines for each ModelShaderFeature bit
+static const char* const sModelFeatureDefines[ModelFeature_Count] = {
+   "ALPHA_TEST"
+};
+
 struct LineProgramInfo : public BaseProgramInfo
 {
    WGPURenderPipeline pipeline;
@@ -174,6 +195,7 @@ struct SDLState
       
       // uploaded to gpu this frame?
       bool inFrame;
+      bool vertsDirty; // verts changed since they were uploaded this frame
    };
    
    struct TexInfo
@@ -182,13 +204,27 @@ struct SDLState
       WGPUTextureView textureView;
       WGPUBindGroup texBindGroup;
       uint32_t dims[3];
+      uint32_t byteSize; // estimated, for MemTracker
+   };
+   
+   // Interior geometry is static, so it lives in its own buffers rather than being re-uploaded each frame
+   struct ITRModel
+   {
+      WGPUBuffer vertBuffer;
+      WGPUBuffer texVertBuffer;
+      WGPUBuffer indexBuffer;
+      
+      uint32_t numVerts;
+      uint32_t numInds;
    };
    
    std::vector<FrameModel> models;
+   std::vector<ITRModel> itrModels;
    std::vector<TexInfo> textures;
    
    // Resource state
    std::unordered_map<std::string, WGPUShaderModule> shaders;
+   std::unordered_map<std::string, const char*> shaderSources; // for permutations
    std::vector<BufferAlloc> buffers;
    
    WGPUSampler modelCommonSampler;
@@ -197,12 +233,21 @@ struct SDLState
    WGPUBindGroupLayout commonUniformLayout;
    WGPUBindGroupLayout commonTextureLayout;
    WGPUBindGroupLayout terrainTextureLayout;
+   WGPUBindGroupLayout interiorTextureLayout;
    WGPUBindGroupLayout terrainSamplersLayout;
    WGPUBindGroup commonUniformGroup;
    BufferRef commonUniformBuffer;
    
+   // Model instance stream (vertex buffer slot 2)
+   WGPUBuffer identityInstanceBuffer; // single identity instance for non-instanced draws
+   BufferRef instanceData;            // from the last GFXUploadModelInstances this frame
+   uint32_t numInstances;
+   WGPUBuffer boundInstanceBuffer;
+   size_t boundInstanceOffset;
+   
    LineProgramInfo lineProgram;
    ModelProgramInfo modelProgram;
+   ModelProgramInfo interiorProgram;
    TerrainProgramInfo terrainProgram;
    
    //
@@ -230,6 +275,11 @@ struct SDLState
    // Swapchain
    WGPUSurfaceTexture gpuSurfaceTexture;
    WGPUTextureView gpuSurfaceTextureView;
+   
+   // Headless target (used instead of the surface)
+   bool headless;
+   WGPUTexture offscreenTexture;
+   WGPUTextureView offscreenTextureView;
    WGPUTexture depthTexture;
    WGPUTextureView depthTextureView;
    WGPUTextureFormat depthStencilFormat;
@@ -239,6 +289,24 @@ struct SDLState
    WGPUCommandEncoder commandEncoder;
    BaseProgramInfo* currentProgram;
    WGPURenderPipeline currentPipeline;
+   WGPURenderPipeline boundPipeline; // last pipeline set on renderEncoder
+   
+   // Submission stats
+   static const uint32_t FrameStatsHistorySize = 240;
+   GFXFrameStats frameStats;
+   GFXFrameStats frameStatsHistory[FrameStatsHistorySize];
+   uint32_t frameStatsHead;
+   uint32_t frameStatsCount;
+   uint64_t frameFirstSubmitNS; // time of first submit in the current frame
+   
+   // GPU timing; when supported each render pass writes a begin & end timestamp
+   static const uint32_t MaxTimestampPasses = 8;
+   bool hasTimestamps;
+   WGPUQuerySet timestampQuerySet;
+   WGPUBuffer timestampResolveBuffer;
+   WGPUBuffer timestampReadBuffer;
+   uint32_t numTimestampPasses; // written so far this frame
+   uint32_t numResolvedPasses;  // copied to timestampReadBuffer
    
    // Samplers
    
@@ -253,10 +321,20 @@ struct SDLState
    
    std::vector<TerrainGPUResource> terrainResources;
    
+   struct ITRGPUResource
+   {
+      int32_t mBaseTexID;
+      int32_t mLightMapTexID;
+      WGPUBindGroup mBindGroup;
+   };
+   
+   std::vector<ITRGPUResource> itrResources;
+   
    int32_t backingSize[2];
    float backingScale;
    
    GpuInitState gpuInitState; // surface ->
+   bool forceFallbackAdapter; // software adapter, for machines without a GPU
    
    // Util funcs (mainly webgpu related)
    
@@ -266,19 +344,88 @@ struct SDLState
    void requestWGPUAdapter();
    void requestWGPUDevice();
    bool initWGPUSwapchain();
+   void initTimestamps();
    
    void resetWGPUState();
    void resetWGPUSwapChain();
    
    bool loadShaderModule(const char* name, const char* code);
+   WGPUShaderModule getShaderPermutation(const char* name, uint32_t features);
    BufferRef allocBuffer(size_t size, uint32_t flags, uint16_t alignment);
    void resetBufferAllocs();
    
    void beginRenderPass(bool secondary);
-   void endRenderPass();
+   void endRenderPass(bool lastInFrame=false);
+   void pushFrameStats();
+   
+   // Encoder & queue wrappers; these keep frameStats up to date
+   
+   inline void setPipeline(WGPURenderPipeline pipeline)
+   {
+      if (pipeline != boundPipeline)
+         frameStats.pipelineSwitches++;
+      frameStats.pipelineSets++;
+      boundPipeline = pipeline;
+      wgpuRenderPassEncoderSetPipeline(renderEncoder, pipeline);
+   }
+   
+   inline void setBindGroup(uint32_t groupIndex, WGPUBindGroup group, size_t dynamicOffsetCount, const uint32_t* dynamicOffsets)
+   {
+      frameStats.bindGroupSets++;
+      wgpuRenderPassEncoderSetBindGroup(renderEncoder, groupIndex, group, dynamicOffsetCount, dynamicOffsets);
+   }
+   
+   inline void setVertexBuffer(uint32_t slot, WGPUBuffer buffer, uint64_t offset, uint64_t size)
+   {
+      frameStats.vertexBufferBinds++;
+      wgpuRenderPassEncoderSetVertexBuffer(renderEncoder, slot, buffer, offset, size);
+   }
+   
+   // Skips rebinding slot 2 since most draws share the same instance buffer
+   inline void setInstanceBuffer(WGPUBuffer buffer, size_t offset, size_t size)
+   {
+      if (buffer == boundInstanceBuffer && offset == boundInstanceOffset)
+         return;
+      boundInstanceBuffer = buffer;
+      boundInstanceOffset = offset;
+      setVertexBuffer(2, buffer, offset, size);
+   }
+   
+   inline void setIndexBuffer(WGPUBuffer buffer, WGPUIndexFormat format, uint64_t offset, uint64_t size)
+   {
+      frameStats.indexBufferBinds++;
+      wgpuRenderPassEncoderSetIndexBuffer(renderEncoder, buffer, format, offset, size);
+   }
+   
+   inline void draw(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance)
+   {
+      frameStats.drawCalls++;
+      wgpuRenderPassEncoderDraw(renderEncoder, vertexCount, instanceCount, firstVertex, firstInstance);
+   }
+   
+   inline void drawIndexed(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t baseVertex, uint32_t firstInstance)
+   {
+      frameStats.drawCalls++;
+      wgpuRenderPassEncoderDrawIndexed(renderEncoder, indexCount, instanceCount, firstIndex, baseVertex, firstInstance);
+   }
+   
+   inline void writeBuffer(WGPUBuffer buffer, uint64_t offset, const void* data, size_t size)
+   {
+      frameStats.bufferWrites++;
+      frameStats.bufferWriteBytes += size;
+      wgpuQueueWriteBuffer(gpuQueue, buffer, offset, data, size);
+   }
+   
+   inline void writeTexture(const WGPUImageCopyTexture* dest, const void* data, size_t size, const WGPUTextureDataLayout* layout, const WGPUExtent3D* writeSize)
+   {
+      frameStats.textureWrites++;
+      frameStats.textureWriteBytes += size;
+      wgpuQueueWriteTexture(gpuQueue, dest, data, size, layout, writeSize);
+   }
    
    WGPUBindGroup makeSimpleTextureBG(WGPUTextureView tex, WGPUSampler sampler);
    WGPUBindGroup makeTerrainTextureBG(WGPUTextureView squareMatTex, WGPUTextureView heightmapTex, WGPUTextureView mapTex, WGPUTextureView lmTex, WGPUSampler samplerPixel, WGPUSampler samplerLinear);
+   WGPUBindGroup makeInteriorTextureBG(WGPUTextureView baseTex, WGPUTextureView lmTex, WGPUSampler baseSampler, WGPUSampler lmSampler);
    WGPURenderPassDescriptor createRenderPass(bool secondary);
 };
 
@@ -500,173 +647,203 @@ static TerrainProgramInfo buildTerrainProgram()
    return ret;
 }
 
-ModelProgramInfo buildModelProgram()
+static WGPUBuffer createStaticBuffer(const void* data, size_t size, uint32_t usage);
+static void releaseStaticBuffer(WGPUBuffer buffer);
+
+static WGPURenderPipeline buildModelPipeline(const ModelProgramInfo& info, ModelPipelineState state, uint32_t features)
+{
+   WGPUShaderModule module = smState.getShaderPermutation(info.shaderName, features);
+   if (module == NULL)
+      return NULL;
+   
+   // Vertex buffer layout for stream 0 (ModelVertex)
+   WGPUVertexAttribute vertexAttributes0[2];
+   vertexAttributes0[0] = {};
+   vertexAttributes0[0].format = WGPUVertexFormat_Float32x3;
+   vertexAttributes0[0].offset = offsetof(ModelVertex, position);
+   vertexAttributes0[0].shaderLocation = 0;
+   
+   vertexAttributes0[1] = {};
+   vertexAttributes0[1].format = WGPUVertexFormat_Float32x3;
+   vertexAttributes0[1].offset = offsetof(ModelVertex, normal);
+   vertexAttributes0[1].shaderLocation = 1;
+   
+   WGPUVertexBufferLayout vertexBufferLayout0 = {};
+   vertexBufferLayout0.arrayStride = sizeof(ModelVertex);
+   vertexBufferLayout0.stepMode = WGPUVertexStepMode_Vertex; // Per-vertex data
+   vertexBufferLayout0.attributeCount = 2;
+   vertexBufferLayout0.attributes = vertexAttributes0;
+   
+   // Vertex buffer layout for stream 1 (ModelTexVertex or ITRTexVertex)
+   WGPUVertexAttribute vertexAttributes1[2];
+   vertexAttributes1[0] = {};
+   vertexAttributes1[0].format = WGPUVertexFormat_Float32x2;
+   vertexAttributes1[0].offset = info.lightmapped ? offsetof(ITRTexVertex, texcoord) : offsetof(ModelTexVertex, texcoord);
+   vertexAttributes1[0].shaderLocation = 2;
+   
+   vertexAttributes1[1] = {};
+   vertexAttributes1[1].format = WGPUVertexFormat_Float32x3;
+   vertexAttributes1[1].offset = offsetof(ITRTexVertex, lmcoord);
+   vertexAttributes1[1].shaderLocation = 3;
+   
+   WGPUVertexBufferLayout vertexBufferLayout1 = {};
+   vertexBufferLayout1.arrayStride = info.lightmapped ? sizeof(ITRTexVertex) : sizeof(ModelTexVertex);
+   vertexBufferLayout1.stepMode = WGPUVertexStepMode_Vertex; // Per-vertex data
+   vertexBufferLayout1.attributeCount = info.lightmapped ? 2 : 1;
+   vertexBufferLayout1.attributes = vertexAttributes1;
+   
+   // Vertex buffer layout for stream 2 (ModelInstance); transform columns are locations 4-7
+   WGPUVertexAttribute vertexAttributes2[5];
+   for (uint32_t i=0; i<4; i++)
+   {
+      vertexAttributes2[i] = {};
+      vertexAttributes2[i].format = WGPUVertexFormat_Float32x4;
+      vertexAttributes2[i].offset = offsetof(ModelInstance, transform) + (sizeof(float) * 4 * i);
+      vertexAttributes2[i].shaderLocation = 4 + i;
+   }
+   
+   vertexAttributes2[4] = {};
+   vertexAttributes2[4].format = WGPUVertexFormat_Uint32;
+   vertexAttributes2[4].offset = offsetof(ModelInstance, transformOffset);
+   vertexAttributes2[4].shaderLocation = 8;
+   
+   WGPUVertexBufferLayout vertexBufferLayout2 = {};
+   vertexBufferLayout2.arrayStride = sizeof(ModelInstance);
+   vertexBufferLayout2.stepMode = WGPUVertexStepMode_Instance; // Per-instance data
+   vertexBufferLayout2.attributeCount = 5;
+   vertexBufferLayout2.attributes = vertexAttributes2;
+   
+   // Vertex state configuration
+   WGPUVertexState vertexState = {};
+   vertexState.module = module;
+   vertexState.entryPoint = "mainVert";          // Entry point of the vertex shader
+   vertexState.bufferCount = 3;
+   WGPUVertexBufferLayout vertexLayouts[3] = {vertexBufferLayout0, vertexBufferLayout1, vertexBufferLayout2};
+   vertexState.buffers = vertexLayouts;
+   
+   // Fragment state
+   WGPUFragmentState fragmentState = {};
+   fragmentState.module = module;
+   fragmentState.entryPoint = "mainFrag";         // Entry point of the fragment shader
+   fragmentState.targetCount = 1;
+   
+   WGPUColorTargetState colorTargetState = {};
+   colorTargetState.format = WGPUTextureFormat_BGRA8Unorm; // Output texture format
+   
+   WGPUBlendState blendState = {};
+   colorTargetState.blend = NULL;
+   
+   switch (state)
+   {
+      case ModelPipeline_AdditiveBlend:
+         blendState.color.operation = WGPUBlendOperation_Add;
+         blendState.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+         blendState.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+         
+         blendState.alpha.operation = WGPUBlendOperation_Add;
+         blendState.alpha.srcFactor = WGPUBlendFactor_One;
+         blendState.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+         colorTargetState.blend = &blendState;
+         break;
+      case ModelPipeline_SubtractiveBlend:
+         blendState.color.operation = WGPUBlendOperation_Add;
+         blendState.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+         blendState.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+         
+         blendState.alpha.operation = WGPUBlendOperation_Add;
+         blendState.alpha.srcFactor = WGPUBlendFactor_One;
+         blendState.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+         colorTargetState.blend = &blendState;
+         break;
+      case ModelPipeline_TranslucentBlend:
+         blendState.color.operation = WGPUBlendOperation_Add;
+         blendState.color.srcFactor = WGPUBlendFactor_SrcAlpha;
+         blendState.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+         
+         blendState.alpha.operation = WGPUBlendOperation_Add;
+         blendState.alpha.srcFactor = WGPUBlendFactor_One;
+         blendState.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
+         colorTargetState.blend = &blendState;
+         break;
+         
+      case ModelPipeline_DefaultDiffuse:
+      default:
+         break;
+   };
+   
+   colorTargetState.writeMask = WGPUColorWriteMask_All;
+   
+   fragmentState.targets = &colorTargetState;
+   
+   // Define the primitive state
+   WGPUPrimitiveState primitiveState = {};
+   primitiveState.topology = WGPUPrimitiveTopology_TriangleList; // Rendering triangles
+   primitiveState.stripIndexFormat = WGPUIndexFormat_Undefined;  // Non-indexed drawing
+   primitiveState.frontFace = WGPUFrontFace_CW;                 // Counter-clockwise vertices define the front face
+   primitiveState.cullMode = WGPUCullMode_None;//WGPUCullMode_Back;                  // Back-face culling
+   
+   // Multisample state
+   WGPUMultisampleState multisampleState = {};
+   multisampleState.count = 1;
+   multisampleState.mask = ~0;
+   multisampleState.alphaToCoverageEnabled = false;
+   
+   // Depth stencil state
+   WGPUDepthStencilState depthStencilState = {};
+   depthStencilState.format = WGPUTextureFormat_Depth32Float;      // Depth format
+   depthStencilState.depthWriteEnabled = true;                    // Enable depth writing
+   depthStencilState.depthCompare = WGPUCompareFunction_Less;     // Use less-than comparison for depth testing
+   depthStencilState.stencilFront.compare = WGPUCompareFunction_Always;
+   depthStencilState.stencilFront.failOp = WGPUStencilOperation_Keep;
+   depthStencilState.stencilFront.depthFailOp = WGPUStencilOperation_Keep;
+   depthStencilState.stencilFront.passOp = WGPUStencilOperation_Keep;
+   depthStencilState.stencilBack = depthStencilState.stencilFront; // Same as front
+   depthStencilState.stencilReadMask = 0xFFFFFFFF;
+   depthStencilState.stencilWriteMask = 0xFFFFFFFF;
+   depthStencilState.depthBias = 0;                               // No depth bias
+   depthStencilState.depthBiasSlopeScale = 0.0f;
+   depthStencilState.depthBiasClamp = 0.0f;
+   
+   // Create the render pipeline descriptor
+   WGPURenderPipelineDescriptor pipelineDesc = {};
+   pipelineDesc.label = "Render Pipeline";
+   pipelineDesc.layout = info.pipelineLayout;
+   pipelineDesc.vertex = vertexState;
+   pipelineDesc.primitive = primitiveState;
+   pipelineDesc.fragment = &fragmentState;
+   pipelineDesc.depthStencil = &depthStencilState; // Enable depth-stencil state
+   pipelineDesc.multisample = multisampleState;
+   
+   // Finally, create the pipeline
+   return wgpuDeviceCreateRenderPipeline(smState.gpuDevice, &pipelineDesc);
+}
+
+// NOTE: interiors use the same pipeline setup, but with a lightmap coordinate in stream 1
+ModelProgramInfo buildModelProgram(const char* shaderName, WGPUBindGroupLayout textureLayout, bool lightmapped)
 {
    ModelProgramInfo ret;
+   ret.shaderName = shaderName;
+   ret.lightmapped = lightmapped;
    
    // Create the pipeline layout
    WGPUPipelineLayoutDescriptor pipelineLayoutDesc = {};
    pipelineLayoutDesc.label = "Pipeline Layout";
    pipelineLayoutDesc.bindGroupLayoutCount = 2;
-   WGPUBindGroupLayout bindGroupLayouts[2] = {smState.commonUniformLayout, smState.commonTextureLayout};
+   WGPUBindGroupLayout bindGroupLayouts[2] = {smState.commonUniformLayout, textureLayout};
    pipelineLayoutDesc.bindGroupLayouts = bindGroupLayouts;
    
-   WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(smState.gpuDevice, &pipelineLayoutDesc);
-   
-   auto buildPipelineForState = [&pipelineLayout](ModelPipelineState state){
-      // Vertex buffer layout for stream 0 (ModelVertex)
-      WGPUVertexAttribute vertexAttributes0[2];
-      vertexAttributes0[0] = {};
-      vertexAttributes0[0].format = WGPUVertexFormat_Float32x3;
-      vertexAttributes0[0].offset = offsetof(ModelVertex, position);
-      vertexAttributes0[0].shaderLocation = 0;
-      
-      vertexAttributes0[1] = {};
-      vertexAttributes0[1].format = WGPUVertexFormat_Float32x3;
-      vertexAttributes0[1].offset = offsetof(ModelVertex, normal);
-      vertexAttributes0[1].shaderLocation = 1;
-      
-      WGPUVertexBufferLayout vertexBufferLayout0 = {};
-      vertexBufferLayout0.arrayStride = sizeof(ModelVertex);
-      vertexBufferLayout0.stepMode = WGPUVertexStepMode_Vertex; // Per-vertex data
-      vertexBufferLayout0.attributeCount = 2;
-      vertexBufferLayout0.attributes = vertexAttributes0;
-      
-      // Vertex buffer layout for stream 1 (ModelTexVertex)
-      WGPUVertexAttribute vertexAttributes1[1];
-      vertexAttributes1[0] = {};
-      vertexAttributes1[0].format = WGPUVertexFormat_Float32x2;
-      vertexAttributes1[0].offset = offsetof(ModelTexVertex, texcoord);
-      vertexAttributes1[0].shaderLocation = 2;
-      
-      WGPUVertexBufferLayout vertexBufferLayout1 = {};
-      vertexBufferLayout1.arrayStride = sizeof(ModelTexVertex);
-      vertexBufferLayout1.stepMode = WGPUVertexStepMode_Vertex; // Per-vertex data
-      vertexBufferLayout1.attributeCount = 1;
-      vertexBufferLayout1.attributes = vertexAttributes1;
-      
-      // Vertex state configuration
-      WGPUVertexState vertexState = {};
-      vertexState.module = smState.shaders["modelShader"];  // Loaded shader module
-      vertexState.entryPoint = "mainVert";          // Entry point of the vertex shader
-      vertexState.bufferCount = 2;
-      WGPUVertexBufferLayout vertexLayouts[2] = {vertexBufferLayout0, vertexBufferLayout1};
-      vertexState.buffers = vertexLayouts;
-      
-      // Create the pipeline layout
-      WGPUPipelineLayoutDescriptor pipelineLayoutDesc = {};
-      pipelineLayoutDesc.label = "Pipeline Layout";
-      pipelineLayoutDesc.bindGroupLayoutCount = 2;
-      WGPUBindGroupLayout bindGroupLayouts[2] = {smState.commonUniformLayout, smState.commonTextureLayout};
-      pipelineLayoutDesc.bindGroupLayouts = bindGroupLayouts;
-      
-      WGPUPipelineLayout pipelineLayout = wgpuDeviceCreatePipelineLayout(smState.gpuDevice, &pipelineLayoutDesc);
-      
-      // Fragment state
-      WGPUFragmentState fragmentState = {};
-      fragmentState.module = smState.shaders["modelShader"]; // Loaded fragment shader module
-      fragmentState.entryPoint = "mainFrag";         // Entry point of the fragment shader
-      fragmentState.targetCount = 1;
-      
-      WGPUColorTargetState colorTargetState = {};
-      colorTargetState.format = WGPUTextureFormat_BGRA8Unorm; // Output texture format
-      
-      WGPUBlendState blendState = {};
-      colorTargetState.blend = NULL;
-      
-      switch (state)
-      {
-         case ModelPipeline_AdditiveBlend:
-            blendState.color.operation = WGPUBlendOperation_Add;
-            blendState.color.srcFactor = WGPUBlendFactor_SrcAlpha;
-            blendState.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-            
-            blendState.alpha.operation = WGPUBlendOperation_Add;
-            blendState.alpha.srcFactor = WGPUBlendFactor_One;
-            blendState.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-            colorTargetState.blend = &blendState;
-            break;
-         case ModelPipeline_SubtractiveBlend:
-            blendState.color.operation = WGPUBlendOperation_Add;
-            blendState.color.srcFactor = WGPUBlendFactor_SrcAlpha;
-            blendState.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-            
-            blendState.alpha.operation = WGPUBlendOperation_Add;
-            blendState.alpha.srcFactor = WGPUBlendFactor_One;
-            blendState.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-            colorTargetState.blend = &blendState;
-            break;
-         case ModelPipeline_TranslucentBlend:
-            blendState.color.operation = WGPUBlendOperation_Add;
-            blendState.color.srcFactor = WGPUBlendFactor_SrcAlpha;
-            blendState.color.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-            
-            blendState.alpha.operation = WGPUBlendOperation_Add;
-            blendState.alpha.srcFactor = WGPUBlendFactor_One;
-            blendState.alpha.dstFactor = WGPUBlendFactor_OneMinusSrcAlpha;
-            colorTargetState.blend = &blendState;
-            break;
-            
-         case ModelPipeline_DefaultDiffuse:
-         default:
-            break;
-      };
-      
-      colorTargetState.writeMask = WGPUColorWriteMask_All;
-      
-      fragmentState.targets = &colorTargetState;
-      
-      // Define the primitive state
-      WGPUPrimitiveState primitiveState = {};
-      primitiveState.topology = WGPUPrimitiveTopology_TriangleList; // Rendering triangles
-      primitiveState.stripIndexFormat = WGPUIndexFormat_Undefined;  // Non-indexed drawing
-      primitiveState.frontFace = WGPUFrontFace_CW;                 // Counter-clockwise vertices define the front face
-      primitiveState.cullMode = WGPUCullMode_None;//WGPUCullMode_Back;                  // Back-face culling
-      
-      // Multisample state
-      WGPUMultisampleState multisampleState = {};
-      multisampleState.count = 1;
-      multisampleState.mask = ~0;
-      multisampleState.alphaToCoverageEnabled = false;
-      
-      // Depth stencil state
-      WGPUDepthStencilState depthStencilState = {};
-      depthStencilState.format = WGPUTextureFormat_Depth32Float;      // Depth format
-      depthStencilState.depthWriteEnabled = true;                    // Enable depth writing
-      depthStencilState.depthCompare = WGPUCompareFunction_Less;     // Use less-than comparison for depth testing
-      depthStencilState.stencilFront.compare = WGPUCompareFunction_Always;
-      depthStencilState.stencilFront.failOp = WGPUStencilOperation_Keep;
-      depthStencilState.stencilFront.depthFailOp = WGPUStencilOperation_Keep;
-      depthStencilState.stencilFront.passOp = WGPUStencilOperation_Keep;
-      depthStencilState.stencilBack = depthStencilState.stencilFront; // Same as front
-      depthStencilState.stencilReadMask = 0xFFFFFFFF;
-      depthStencilState.stencilWriteMask = 0xFFFFFFFF;
-      depthStencilState.depthBias = 0;                               // No depth bias
-      depthStencilState.depthBiasSlopeScale = 0.0f;
-      depthStencilState.depthBiasClamp = 0.0f;
-      
-      // Create the render pipeline descriptor
-      WGPURenderPipelineDescriptor pipelineDesc = {};
-      pipelineDesc.label = "Render Pipeline";
-      pipelineDesc.layout = pipelineLayout;
-      pipelineDesc.vertex = vertexState;
-      pipelineDesc.primitive = primitiveState;
-      pipelineDesc.fragment = &fragmentState;
-      pipelineDesc.depthStencil = &depthStencilState; // Enable depth-stencil state
-      pipelineDesc.multisample = multisampleState;
-      
-      // Finally, create the pipeline
-      return wgpuDeviceCreateRenderPipeline(smState.gpuDevice, &pipelineDesc);
-   };
-   
-   for (int i=0; i<ModelPipeline_Count; i++)
-   {
-      ret.pipelines[i] = buildPipelineForState((ModelPipelineState)i);
-   }
-   
+   ret.pipelineLayout = wgpuDeviceCreatePipelineLayout(smState.gpuDevice, &pipelineLayoutDesc);
    return ret;
 }
 
+static WGPURenderPipeline getModelPipeline(ModelProgramInfo& info, ModelPipelineState state, uint32_t features)
+{
+   WGPURenderPipeline& pipeline = info.pipelines[state][features];
+   if (pipeline == NULL)
+      pipeline = buildModelPipeline(info, state, features);
+   return pipeline;
+}
+
 int GFXSetup(SDL_Window* window, SDL_Renderer* renderer)
 {
    smState.window = window;
@@ -694,7 +871,7 @@ int GFXSetup(SDL_Window* window, SDL_Renderer* renderer)
    }
    
    // Need to grab adapter
-   if (smState.gpuInitState < SDLState::GOT_SURFACE)
+   if (smState.gpuInitState < SDLState::GOT_SURFACE && !smState.headless)
    {
       if (!smState.initWGPUSurface())
       {
@@ -712,6 +889,21 @@ int GFXSetup(SDL_Window* window, SDL_Renderer* renderer)
       return 1;
    }
    
+   if (smState.gpuAdapter == NULL)
+   {
+      // Headless runs (e.g. on CI) may not have a GPU, so try a software adapter
+      if (smState.headless && !smState.forceFallbackAdapter)
+      {
+         printf("No WebGPU adapter, trying the fallback adapter\n");
+         smState.forceFallbackAdapter = true;
+         smState.gpuInitState = SDLState::GOT_SURFACE;
+         return 1;
+      }
+      
+      printf("Couldn't get a WebGPU adapter\n");
+      return -1;
+   }
+   
    if (smState.gpuInitState < SDLState::GOT_DEVICE)
    {
       if (smState.gpuInitState < SDLState::INIT_DEVICE)
@@ -724,6 +916,7 @@ int GFXSetup(SDL_Window* window, SDL_Renderer* renderer)
    if (smState.gpuInitState < SDLState::INIT_SWAPCHAIN)
    {
       smState.initWGPUSwapchain();
+      smState.initTimestamps();
    }
    
    // Now we should have everything we need to init properly
@@ -735,9 +928,12 @@ int GFXSetup(SDL_Window* window, SDL_Renderer* renderer)
    imInfo.DepthStencilFormat = smState.depthStencilFormat;
    
    smState.loadShaderModule("lineShader", sLineShaderCode);
-   smState.loadShaderModule("modelShader", sModelShaderCode);
    smState.loadShaderModule("terrainShader", sTerrainShaderCode);
    
+   // Model shaders are built per feature permutation as they're needed
+   smState.shaderSources["modelShader"] = sModelShaderCode;
+   smState.shaderSources["interiorShader"] = sInteriorShaderCode;
+   
    // Init gui
    IMGUI_CHECKVERSION();
    ImGui::CreateContext();
@@ -877,6 +1073,32 @@ int GFXSetup(SDL_Window* window, SDL_Renderer* renderer)
    
    smState.terrainTextureLayout = wgpuDeviceCreateBindGroupLayout(smState.gpuDevice, &bindGroupLayoutDescTER);
    
+   // Interior base texture + lightmap
+   WGPUBindGroupLayoutEntry bindGroupLayoutEntriesITR[4];
+   
+   for (int i=0; i<2; i++)
+   {
+      bindGroupLayoutEntriesITR[i*2] = {};
+      bindGroupLayoutEntriesITR[i*2].binding = i*2;
+      bindGroupLayoutEntriesITR[i*2].visibility = WGPUShaderStage_Fragment;
+      bindGroupLayoutEntriesITR[i*2].texture.sampleType = WGPUTextureSampleType_Float;
+      // Lightmaps are packed into array layers
+      bindGroupLayoutEntriesITR[i*2].texture.viewDimension = i == 0 ? WGPUTextureViewDimension_2D : WGPUTextureViewDimension_2DArray;
+      bindGroupLayoutEntriesITR[i*2].texture.multisampled = false;
+      
+      bindGroupLayoutEntriesITR[(i*2)+1] = {};
+      bindGroupLayoutEntriesITR[(i*2)+1].binding = (i*2)+1;
+      bindGroupLayoutEntriesITR[(i*2)+1].visibility = WGPUShaderStage_Fragment;
+      bindGroupLayoutEntriesITR[(i*2)+1].sampler.type = WGPUSamplerBindingType_Filtering;
+   }
+   
+   WGPUBindGroupLayoutDescriptor bindGroupLayoutDescITR = {};
+   bindGroupLayoutDescITR.label = "Interior Bind Group Layout";
+   bindGroupLayoutDescITR.entryCount = 4;
+   bindGroupLayoutDescITR.entries = bindGroupLayoutEntriesITR;
+   
+   smState.interiorTextureLayout = wgpuDeviceCreateBindGroupLayout(smState.gpuDevice, &bindGroupLayoutDescITR);
+   
    WGPUBindGroupEntry commonEntry = {};
    commonEntry.binding = 0;
    commonEntry.buffer = smState.commonUniformBuffer.buffer;
@@ -890,10 +1112,15 @@ int GFXSetup(SDL_Window* window, SDL_Renderer* renderer)
    commonDesc.entries = &commonEntry;
    smState.commonUniformGroup = wgpuDeviceCreateBindGroup(smState.gpuDevice, &commonDesc);
    
-   smState.modelProgram = buildModelProgram();
+   smState.modelProgram = buildModelProgram("modelShader", smState.commonTextureLayout, false);
+   smState.interiorProgram = buildModelProgram("interiorShader", smState.interiorTextureLayout, true);
    smState.lineProgram = buildLineProgram();
    smState.terrainProgram = buildTerrainProgram();
    
+   ModelInstance identity = {};
+   identity.transform = slm::mat4(1);
+   smState.identityInstanceBuffer = createStaticBuffer(&identity, sizeof(ModelInstance), WGPUBufferUsage_Vertex);
+   
    return 0;
 }
 
@@ -902,9 +1129,15 @@ SDLState::SDLState()
    modelCommonSampler = NULL;
    modelCommonLinearSampler = NULL;
    modelCommonLinearClampSampler = NULL;
+   identityInstanceBuffer = NULL;
+   instanceData = {};
+   numInstances = 0;
+   boundInstanceBuffer = NULL;
+   boundInstanceOffset = 0;
    commonUniformLayout = NULL;
    commonTextureLayout = NULL;
    terrainTextureLayout = NULL;
+   interiorTextureLayout = NULL;
    commonUniformGroup = NULL;
    
    projectionMatrix = slm::mat4(1);
@@ -930,6 +1163,9 @@ SDLState::SDLState()
    // Swapchain
    gpuSurfaceTexture = {};
    gpuSurfaceTextureView = NULL;
+   headless = false;
+   offscreenTexture = NULL;
+   offscreenTextureView = NULL;
    depthTexture = NULL;
    depthTextureView = NULL;
    depthStencilFormat = WGPUTextureFormat_Undefined;
@@ -938,8 +1174,23 @@ SDLState::SDLState()
    renderEncoder = NULL;
    commandEncoder = NULL;
    currentPipeline = NULL;
+   boundPipeline = NULL;
+   
+   // Submission stats
+   frameStats = {};
+   frameStatsHead = 0;
+   frameStatsCount = 0;
+   frameFirstSubmitNS = 0;
+   
+   hasTimestamps = false;
+   timestampQuerySet = NULL;
+   timestampResolveBuffer = NULL;
+   timestampReadBuffer = NULL;
+   numTimestampPasses = 0;
+   numResolvedPasses = 0;
    
    gpuInitState = (GpuInitState)0;
+   forceFallbackAdapter = false;
 }
 
 
@@ -950,6 +1201,7 @@ void SDLState::requestWGPUAdapter()
       .backendType = gpuBackendType
    };
    opts.compatibleSurface = gpuSurface;
+   opts.forceFallbackAdapter = forceFallbackAdapter;
    gpuInitState = SDLState::INIT_ADAPTER;
    
    wgpuInstanceRequestAdapter(gpuInstance, &opts, [](WGPURequestAdapterStatus status, WGPUAdapter adapter, const char* message, void* userdata){
@@ -1074,6 +1326,15 @@ void SDLState::requestWGPUDevice()
    deviceDesc.requiredLimits = NULL;
    deviceDesc.defaultQueue.label = "TVQueue";
    
+   // Timestamps give the bench real GPU times; otherwise it can only measure latency
+   WGPUFeatureName timestampFeature = WGPUFeatureName_TimestampQuery;
+   hasTimestamps = wgpuAdapterHasFeature(gpuAdapter, timestampFeature);
+   if (hasTimestamps)
+   {
+      deviceDesc.requiredFeatureCount = 1;
+      deviceDesc.requiredFeatures = &timestampFeature;
+   }
+   
    gpuInitState = SDLState::INIT_DEVICE;
    
    wgpuAdapterRequestDevice(gpuAdapter, &deviceDesc, [](WGPURequestDeviceStatus status, WGPUDevice device, char const * message, WGPU_NULLABLE void * userdata){
@@ -1084,14 +1345,35 @@ void SDLState::requestWGPUDevice()
    }, this);
 }
 
+void SDLState::initTimestamps()
+{
+   if (!hasTimestamps || timestampQuerySet != NULL)
+      return;
+   
+   WGPUQuerySetDescriptor querySetDesc = {};
+   querySetDesc.label = "FrameTimestamps";
+   querySetDesc.type = WGPUQueryType_Timestamp;
+   querySetDesc.count = MaxTimestampPasses * 2;
+   timestampQuerySet = wgpuDeviceCreateQuerySet(gpuDevice, &querySetDesc);
+   
+   WGPUBufferDescriptor bufferDesc = {};
+   bufferDesc.label = "TimestampResolve";
+   bufferDesc.size = sizeof(uint64_t) * MaxTimestampPasses * 2;
+   bufferDesc.usage = WGPUBufferUsage_QueryResolve | WGPUBufferUsage_CopySrc;
+   timestampResolveBuffer = wgpuDeviceCreateBuffer(gpuDevice, &bufferDesc);
+   
+   bufferDesc.label = "TimestampRead";
+   bufferDesc.usage = WGPUBufferUsage_MapRead | WGPUBufferUsage_CopyDst;
+   timestampReadBuffer = wgpuDeviceCreateBuffer(gpuDevice, &bufferDesc);
+   
+   numTimestampPasses = 0;
+   numResolvedPasses = 0;
+}
+
 bool SDLState::initWGPUSwapchain()
 {
    resetWGPUSwapChain();
    
-   // Configure presentation
-   WGPUSurfaceCapabilities surfaceCapabilities = {};
-   wgpuSurfaceGetCapabilities(gpuSurface, gpuAdapter, &surfaceCapabilities);
-   
    // Determine render size
    backingSize[0] = 0;
    backingSize[1] = 0;
@@ -1114,6 +1396,30 @@ bool SDLState::initWGPUSwapchain()
    printf("WebGPU SwapChain configured backingSize=(%u,%u), windowSize=(%u,%u)\n",
           backingSize[0], backingSize[1], windowSize[0], windowSize[1]);
    
+   if (headless)
+   {
+      // Render into a plain texture instead of a surface
+      WGPUTextureDescriptor colorTextureDesc = {};
+      colorTextureDesc.label = "Offscreen Color Texture";
+      colorTextureDesc.size.width = backingSize[0];
+      colorTextureDesc.size.height = backingSize[1];
+      colorTextureDesc.size.depthOrArrayLayers = 1;
+      colorTextureDesc.mipLevelCount = 1;
+      colorTextureDesc.sampleCount = 1;
+      colorTextureDesc.dimension = WGPUTextureDimension_2D;
+      colorTextureDesc.format = WGPUTextureFormat_BGRA8Unorm; // should match pipeline
+      colorTextureDesc.usage = WGPUTextureUsage_RenderAttachment | WGPUTextureUsage_CopySrc;
+      
+      offscreenTexture = wgpuDeviceCreateTexture(gpuDevice, &colorTextureDesc);
+      offscreenTextureView = wgpuTextureCreateView(offscreenTexture, NULL);
+   }
+   else
+   {
+      // Configure presentation
+      WGPUSurfaceCapabilities surfaceCapabilities = {};
+      wgpuSurfaceGetCapabilities(gpuSurface, gpuAdapter, &surfaceCapabilities);
+   }
+   
    // Configure surface
    gpuSurfaceConfig = {};
    gpuSurfaceConfig.device = gpuDevice;
@@ -1126,7 +1432,8 @@ bool SDLState::initWGPUSwapchain()
    gpuSurfaceConfig.width = backingSize[0];
    gpuSurfaceConfig.height = backingSize[1];
    
-   wgpuSurfaceConfigure(gpuSurface, &gpuSurfaceConfig);
+   if (!headless)
+      wgpuSurfaceConfigure(gpuSurface, &gpuSurfaceConfig);
    
    // Make depth
    
@@ -1168,6 +1475,14 @@ void SDLState::resetWGPUSwapChain()
       gpuSurfaceTextureView = NULL;
    }
    
+   if (offscreenTextureView)
+   {
+      wgpuTextureRelease(offscreenTexture);
+      wgpuTextureViewRelease(offscreenTextureView);
+      offscreenTexture = NULL;
+      offscreenTextureView = NULL;
+   }
+   
    if (depthTextureView)
    {
       wgpuTextureRelease(depthTexture);
@@ -1183,6 +1498,23 @@ void SDLState::resetWGPUState()
    
    lineProgram.reset();
    modelProgram.reset();
+   interiorProgram.reset();
+   
+   for (ITRGPUResource& res : itrResources)
+   {
+      if (res.mBindGroup)
+         wgpuBindGroupRelease(res.mBindGroup);
+   }
+   itrResources.clear();
+   
+   for (uint32_t i=0; i<itrModels.size(); i++)
+   {
+      GFXClearITRModelData(i);
+   }
+   itrModels.clear();
+   
+   releaseStaticBuffer(identityInstanceBuffer);
+   identityInstanceBuffer = NULL;
    
    if (commonUniformGroup)
    {
@@ -1190,6 +1522,7 @@ void SDLState::resetWGPUState()
       wgpuBindGroupLayoutRelease(commonUniformLayout);
       wgpuBindGroupLayoutRelease(commonTextureLayout);
       wgpuBindGroupLayoutRelease(terrainTextureLayout);
+      wgpuBindGroupLayoutRelease(interiorTextureLayout);
    }
    
    for (auto& itr : shaders)
@@ -1199,9 +1532,22 @@ void SDLState::resetWGPUState()
    
    for (auto& itr : buffers)
    {
+      MemTracker::trackFree(MemCategory_GPUTransient, itr.size);
       wgpuBufferRelease(itr.buffer);
    }
    
+   if (timestampQuerySet)
+   {
+      wgpuQuerySetRelease(timestampQuerySet);
+      wgpuBufferRelease(timestampResolveBuffer);
+      wgpuBufferRelease(timestampReadBuffer);
+      timestampQuerySet = NULL;
+      timestampResolveBuffer = NULL;
+      timestampReadBuffer = NULL;
+   }
+   numTimestampPasses = 0;
+   numResolvedPasses = 0;
+   
    if (gpuDevice)
       wgpuDeviceRelease(gpuDevice);
    if (gpuAdapter)
@@ -1220,6 +1566,7 @@ void SDLState::resetWGPUState()
    commonUniformLayout = NULL;
    commonTextureLayout = NULL;
    terrainTextureLayout = NULL;
+   interiorTextureLayout = NULL;
    commonUniformGroup = NULL;
 }
 
@@ -1287,12 +1634,43 @@ WGPUBindGroup SDLState::makeTerrainTextureBG(WGPUTextureView squareMatTex, WGPUT
    return wgpuDeviceCreateBindGroup(gpuDevice, &bindGroupDesc);
 }
 
+WGPUBindGroup SDLState::makeInteriorTextureBG(WGPUTextureView baseTex, WGPUTextureView lmTex, WGPUSampler baseSampler, WGPUSampler lmSampler)
+{
+   WGPUBindGroupEntry bindGroupEntries[4];
+   
+   // Texture entry
+   bindGroupEntries[0] = {};
+   bindGroupEntries[0].binding = 0;
+   bindGroupEntries[0].textureView = baseTex;
+   // Sampler entry
+   bindGroupEntries[1] = {};
+   bindGroupEntries[1].binding = 1;
+   bindGroupEntries[1].sampler = baseSampler;
+   // Texture entry
+   bindGroupEntries[2] = {};
+   bindGroupEntries[2].binding = 2;
+   bindGroupEntries[2].textureView = lmTex;
+   // Sampler entry
+   bindGroupEntries[3] = {};
+   bindGroupEntries[3].binding = 3;
+   bindGroupEntries[3].sampler = lmSampler;
+   
+   WGPUBindGroupDescriptor bindGroupDesc = {};
+   bindGroupDesc.label = "InteriorLayout";
+   bindGroupDesc.layout = smState.interiorTextureLayout;
+   bindGroupDesc.entryCount = 4;
+   bindGroupDesc.entries = bindGroupEntries;
+   
+   // Create the bind group
+   return wgpuDeviceCreateBindGroup(gpuDevice, &bindGroupDesc);
+}
+
 // Create the render pass
 WGPURenderPassDescriptor SDLState::createRenderPass(bool secondary)
 {
    // Color attachment
    static WGPURenderPassColorAttachment colorAttachment = {};
-   colorAttachment.view = gpuSurfaceTextureView;
+   colorAttachment.view = headless ? offscreenTextureView : gpuSurfaceTextureView;
    colorAttachment.resolveTarget = NULL;  // No MSAA
    colorAttachment.loadOp = secondary ? WGPULoadOp_Load : WGPULoadOp_Clear;  // Clear the color buffer at the start
    colorAttachment.storeOp = WGPUStoreOp_Store; // Store the color output
@@ -1313,6 +1691,16 @@ WGPURenderPassDescriptor SDLState::createRenderPass(bool secondary)
    renderPassDesc.colorAttachments = &colorAttachment;
    renderPassDesc.depthStencilAttachment = &depthAttachment; // Attach the depth texture
    
+   static WGPURenderPassTimestampWrites timestampWrites = {};
+   if (timestampQuerySet && numTimestampPasses < MaxTimestampPasses)
+   {
+      timestampWrites.querySet = timestampQuerySet;
+      timestampWrites.beginningOfPassWriteIndex = numTimestampPasses * 2;
+      timestampWrites.endOfPassWriteIndex = (numTimestampPasses * 2) + 1;
+      renderPassDesc.timestampWrites = &timestampWrites;
+      numTimestampPasses++;
+   }
+   
    return renderPassDesc;
 }
 
@@ -1337,6 +1725,28 @@ bool SDLState::loadShaderModule(const char* name, const char* code)
    }
 }
 
+WGPUShaderModule SDLState::getShaderPermutation(const char* name, uint32_t features)
+{
+   std::string key = std::string(name) + "#" + std::to_string(features);
+   auto itr = shaders.find(key);
+   if (itr != shaders.end())
+      return itr->second;
+   
+   auto srcItr = shaderSources.find(name);
+   if (srcItr == shaderSources.end())
+      return NULL;
+   
+   std::string code;
+   if (!ShaderPreprocessor::buildPermutation(srcItr->second, features, sModelFeatureDefines, ModelFeature_Count, code) ||
+       !loadShaderModule(key.c_str(), code.c_str()))
+   {
+      printf("Couldn't build shader %s\n", key.c_str());
+      return NULL;
+   }
+   
+   return shaders[key];
+}
+
 static const size_t BufferSize = 1024*1024*10;
 
 SDLState::BufferRef SDLState::allocBuffer(size_t size, uint32_t flags, uint16_t alignment)
@@ -1358,6 +1768,7 @@ SDLState::BufferRef SDLState::allocBuffer(size_t size, uint32_t flags, uint16_t
       ref.offset = alloc.head;
       ref.size = size;
       
+      frameStats.transientBytes += nextSize - alloc.head;
       alloc.head = nextSize;
       return ref;
    }
@@ -1372,6 +1783,8 @@ SDLState::BufferRef SDLState::allocBuffer(size_t size, uint32_t flags, uint16_t
    newAlloc.size = bufferDesc.size;
    newAlloc.buffer = wgpuDeviceCreateBuffer(smState.gpuDevice, &bufferDesc);
    buffers.push_back(newAlloc);
+   MemTracker::trackAlloc(MemCategory_GPUTransient, newAlloc.size);
+   frameStats.transientBuffersCreated++;
    
    return allocBuffer(size, flags, alignment);
 }
@@ -1397,7 +1810,7 @@ void SDLState::beginRenderPass(bool secondary)
    renderEncoder = wgpuCommandEncoderBeginRenderPass(commandEncoder, &renderPassDesc);
 }
 
-void SDLState::endRenderPass()
+void SDLState::endRenderPass(bool lastInFrame)
 {
    if (renderEncoder == NULL)
       return;
@@ -1405,6 +1818,15 @@ void SDLState::endRenderPass()
    // End the render pass
    wgpuRenderPassEncoderEnd(renderEncoder);
    
+   // Copy the frame's timestamps somewhere GFXWaitForGPU can read them back
+   if (lastInFrame && numTimestampPasses > 0)
+   {
+      wgpuCommandEncoderResolveQuerySet(commandEncoder, timestampQuerySet, 0, numTimestampPasses * 2, timestampResolveBuffer, 0);
+      wgpuCommandEncoderCopyBufferToBuffer(commandEncoder, timestampResolveBuffer, 0, timestampReadBuffer, 0, sizeof(uint64_t) * numTimestampPasses * 2);
+      numResolvedPasses = numTimestampPasses;
+      numTimestampPasses = 0;
+   }
+   
    // Finish the command encoder to submit the work
    WGPUCommandBuffer commandBuffer = wgpuCommandEncoderFinish(commandEncoder, NULL);
    
@@ -1419,13 +1841,51 @@ void SDLState::endRenderPass()
    commandEncoder = NULL;
    
    // Submit the command buffer to the GPU queue
+   if (frameStats.commandBuffersSubmitted == 0)
+      frameFirstSubmitNS = SDL_GetTicksNS();
    wgpuQueueSubmit(gpuQueue, 1, &commandBuffer);
+   frameStats.commandBuffersSubmitted++;
    
    //wgpuQueueOnSubmittedWorkDone(WGPUQueue queue, WGPUQueueOnSubmittedWorkDoneCallback callback, WGPU_NULLABLE void * userdata) WGPU_FUNCTION_ATTRIBUTE;
    
    wgpuCommandBufferRelease(commandBuffer);
    
    currentPipeline = NULL;
+   boundPipeline = NULL;
+   boundInstanceBuffer = NULL;
+}
+
+void SDLState::pushFrameStats()
+{
+   frameStatsHistory[frameStatsHead] = frameStats;
+   frameStatsHead = (frameStatsHead + 1) % FrameStatsHistorySize;
+   frameStatsCount = std::min<uint32_t>(frameStatsCount + 1, FrameStatsHistorySize);
+   frameStats = {};
+}
+
+void GFXGetFrameStats(GFXFrameStats& outStats)
+{
+   if (smState.frameStatsCount == 0)
+   {
+      outStats = {};
+      return;
+   }
+   
+   uint32_t lastIdx = (smState.frameStatsHead + SDLState::FrameStatsHistorySize - 1) % SDLState::FrameStatsHistorySize;
+   outStats = smState.frameStatsHistory[lastIdx];
+}
+
+uint32_t GFXGetFrameStatsHistory(GFXFrameStats* outStats, uint32_t maxFrames)
+{
+   uint32_t count = std::min(maxFrames, smState.frameStatsCount);
+   uint32_t startIdx = (smState.frameStatsHead + SDLState::FrameStatsHistorySize - count) % SDLState::FrameStatsHistorySize;
+   
+   for (uint32_t i=0; i<count; i++)
+   {
+      outStats[i] = smState.frameStatsHistory[(startIdx + i) % SDLState::FrameStatsHistorySize];
+   }
+   
+   return count;
 }
 
 void GFXTeardown()
@@ -1454,7 +1914,7 @@ bool GFXBeginFrame()
    }
    
    // Re-use last texture if still present
-   if (smState.gpuSurfaceTexture.texture == NULL)
+   if (!smState.headless && smState.gpuSurfaceTexture.texture == NULL)
    {
       // Grab tex
       wgpuSurfaceGetCurrentTexture(smState.gpuSurface, &smState.gpuSurfaceTexture);
@@ -1503,9 +1963,16 @@ void GFXEndFrame()
    smState.beginRenderPass(true);
    ImGui::EndFrame();
    ImGui::Render();
-   ImGui_ImplWGPU_RenderDrawData(ImGui::GetDrawData(), smState.renderEncoder);
    
-   smState.endRenderPass();
+   ImDrawData* drawData = ImGui::GetDrawData();
+   for (int i=0; i<drawData->CmdListsCount; i++)
+   {
+      smState.frameStats.uiDrawCalls += drawData->CmdLists[i]->CmdBuffer.Size;
+   }
+   
+   ImGui_ImplWGPU_RenderDrawData(drawData, smState.renderEncoder);
+   
+   smState.endRenderPass(true);
    
    if (smState.gpuSurfaceTexture.texture)
    {
@@ -1515,9 +1982,108 @@ void GFXEndFrame()
       smState.gpuSurfaceTexture = {};
    }
    
-   wgpuSurfacePresent(smState.gpuSurface);
+   if (!smState.headless)
+      wgpuSurfacePresent(smState.gpuSurface);
    
    smState.resetBufferAllocs();
+   smState.pushFrameStats();
+}
+
+void GFXSetHeadless(bool headless)
+{
+   // NOTE: needs to be set before GFXSetup
+   smState.headless = headless;
+}
+
+bool GFXIsHeadless()
+{
+   return smState.headless;
+}
+
+bool GFXIsFallbackAdapter()
+{
+   return smState.forceFallbackAdapter && smState.gpuAdapter != NULL;
+}
+
+bool GFXHasGPUTimestamps()
+{
+   return smState.timestampQuerySet != NULL;
+}
+
+static void pollGPU()
+{
+#if defined(IMGUI_IMPL_WEBGPU_BACKEND_WGPU)
+   wgpuDevicePoll(smState.gpuDevice, true, NULL);
+#else
+   wgpuInstanceProcessEvents(smState.gpuInstance);
+#endif
+}
+
+// Sums the time each pass of the last frame spent on the GPU
+static float readFrameTimestamps()
+{
+   struct MapState
+   {
+      bool done;
+      bool ok;
+   } mapState = {};
+   
+   size_t size = sizeof(uint64_t) * smState.numResolvedPasses * 2;
+   wgpuBufferMapAsync(smState.timestampReadBuffer, WGPUMapMode_Read, 0, size, [](WGPUBufferMapAsyncStatus status, void* userdata){
+      MapState* state = (MapState*)userdata;
+      state->ok = status == WGPUBufferMapAsyncStatus_Success;
+      state->done = true;
+   }, &mapState);
+   
+   while (!mapState.done)
+      pollGPU();
+   
+   uint64_t totalNS = 0;
+   if (mapState.ok)
+   {
+      const uint64_t* stamps = (const uint64_t*)wgpuBufferGetConstMappedRange(smState.timestampReadBuffer, 0, size);
+      for (uint32_t i=0; stamps && i<smState.numResolvedPasses; i++)
+      {
+         if (stamps[(i*2)+1] > stamps[i*2])
+            totalNS += stamps[(i*2)+1] - stamps[i*2];
+      }
+      wgpuBufferUnmap(smState.timestampReadBuffer);
+   }
+   
+   smState.numResolvedPasses = 0;
+   return (float)((double)totalNS / 1000000.0);
+}
+
+float GFXWaitForGPU()
+{
+   if (smState.gpuQueue == NULL)
+      return 0.0f;
+   
+   // NOTE: without timestamps this measures from the first submit of the last
+   // frame until the queue reports the work as done, so it's latency rather
+   // than GPU time unless the previous frame has already been waited on.
+   struct WaitState
+   {
+      bool done;
+      uint64_t doneNS;
+   } waitState = {};
+   
+   wgpuQueueOnSubmittedWorkDone(smState.gpuQueue, [](WGPUQueueWorkDoneStatus status, void* userdata){
+      WaitState* state = (WaitState*)userdata;
+      state->doneNS = SDL_GetTicksNS();
+      state->done = true;
+   }, &waitState);
+   
+   while (!waitState.done)
+      pollGPU();
+   
+   if (smState.numResolvedPasses > 0)
+      return readFrameTimestamps();
+   
+   if (smState.frameFirstSubmitNS == 0 || waitState.doneNS < smState.frameFirstSubmitNS)
+      return 0.0f;
+   
+   return (float)((double)(waitState.doneNS - smState.frameFirstSubmitNS) / 1000000.0);
 }
 
 void GFXHandleResize()
@@ -1535,7 +2101,7 @@ void GFXHandleResize()
    }
 }
 
-int32_t GFXLoadCustomTexture(CustomTextureFormat fmt, uint32_t width, uint32_t height, void* data)
+static bool createCustomTexture(CustomTextureFormat fmt, uint32_t width, uint32_t height, void* data, SDLState::TexInfo& outInfo)
 {
    uint8_t* texData = NULL;
    uint32_t pow2W = getNextPow2(width);
@@ -1570,7 +2136,7 @@ int32_t GFXLoadCustomTexture(CustomTextureFormat fmt, uint32_t width, uint32_t h
          break;
       default:
          assert(false);
-         return -1;
+         return false;
    }
    
    uint32_t paddedWidth = (uint32_t)AlignSize(pow2W*bpp, 256);
@@ -1624,48 +2190,93 @@ int32_t GFXLoadCustomTexture(CustomTextureFormat fmt, uint32_t width, uint32_t h
       copyInfo.origin = (WGPUOrigin3D){0, 0, 0};
       copyInfo.aspect = WGPUTextureAspect_All;
       
-      wgpuQueueWriteTexture(smState.gpuQueue,
-                            &copyInfo,
-                            texData,
-                            alignedMipSize, // Assuming padded 4 bytes per pixel (RGBA8 format)
-                            &layout,
-                            &size);
+      smState.writeTexture(
+         &copyInfo,
+         texData,
+         alignedMipSize, // Assuming padded 4 bytes per pixel (RGBA8 format)
+         &layout,
+         &size);
       
       // Clean up texture data after uploading
       delete[] texData;
       
-      SDLState::TexInfo newInfo = {};
-      newInfo.texture = tex;
-      newInfo.textureView = texView;
-      newInfo.texBindGroup = NULL;
-      newInfo.dims[0] = textureDesc.size.width;
-      newInfo.dims[1] = textureDesc.size.height;
-      newInfo.dims[2] = textureDesc.size.depthOrArrayLayers;
-      
-      // Find or add texture to smState.textures
-      int sz = (int)smState.textures.size();
-      for (int i = 0; i < sz; i++)
-      {
-         if (smState.textures[i].texture == NULL)
-         {
-            smState.textures[i] = newInfo;
-            return i;
-         }
-      }
-      
-      smState.textures.push_back(newInfo);
-      return (uint32_t)(smState.textures.size() - 1);
+      outInfo = {};
+      outInfo.texture = tex;
+      outInfo.textureView = texView;
+      outInfo.texBindGroup = NULL;
+      outInfo.dims[0] = textureDesc.size.width;
+      outInfo.dims[1] = textureDesc.size.height;
+      outInfo.dims[2] = textureDesc.size.depthOrArrayLayers;
+      outInfo.byteSize = pow2W * pow2H * bpp;
+      MemTracker::trackAlloc(MemCategory_GPUTexture, outInfo.byteSize);
+      return true;
    }
    else
    {
       // Handle the case where texture creation failed
       delete[] texData;
+      return false;
+   }
+   
+   return false;
+}
+
+int32_t GFXLoadCustomTexture(CustomTextureFormat fmt, uint32_t width, uint32_t height, void* data)
+{
+   SDLState::TexInfo newInfo;
+   if (!createCustomTexture(fmt, width, height, data, newInfo))
       return -1;
+   
+   // Find or add texture to smState.textures
+   int sz = (int)smState.textures.size();
+   for (int i = 0; i < sz; i++)
+   {
+      if (smState.textures[i].texture == NULL)
+      {
+         smState.textures[i] = newInfo;
+         return i;
+      }
    }
    
-   return -1;
+   smState.textures.push_back(newInfo);
+   return (uint32_t)(smState.textures.size() - 1);
 }
 
+bool GFXReplaceCustomTexture(int32_t texID, CustomTextureFormat fmt, uint32_t width, uint32_t height, void* data)
+{
+   if (texID < 0 || texID >= smState.textures.size() || smState.textures[texID].texture == NULL)
+      return false;
+   
+   SDLState::TexInfo newInfo;
+   if (!createCustomTexture(fmt, width, height, data, newInfo))
+      return false;
+   
+   // NOTE: queued draws keep their own reference to the old texture
+   SDLState::TexInfo& tex = smState.textures[texID];
+   if (tex.texBindGroup)
+      wgpuBindGroupRelease(tex.texBindGroup);
+   wgpuTextureViewRelease(tex.textureView);
+   wgpuTextureRelease(tex.texture);
+   MemTracker::trackFree(MemCategory_GPUTexture, tex.byteSize);
+   tex = newInfo;
+   
+   // Interior bind groups point at the old view, so rebuild any which use this texture
+   for (SDLState::ITRGPUResource& res : smState.itrResources)
+   {
+      if (res.mBindGroup == NULL || (res.mBaseTexID != texID && res.mLightMapTexID != texID))
+         continue;
+      
+      wgpuBindGroupRelease(res.mBindGroup);
+      res.mBindGroup = smState.makeInteriorTextureBG(smState.textures[res.mBaseTexID].textureView,
+                                                     smState.textures[res.mLightMapTexID].textureView,
+                                                     smState.modelCommonLinearSampler,
+                                                     smState.modelCommonLinearClampSampler);
+   }
+   
+   return true;
+}
+
+
 void GFXUpdateCustomTextureAligned(int32_t texID, void* texData)
 {
    if (texID < 0)
@@ -1689,12 +2300,12 @@ void GFXUpdateCustomTextureAligned(int32_t texID, void* texData)
    
    uint32_t alignedMipSize = info.dims[0] * info.dims[1];
    
-   wgpuQueueWriteTexture(smState.gpuQueue,
-                         &copyInfo,
-                         texData,
-                         alignedMipSize,
-                         &layout,
-                         &size);
+   smState.writeTexture(
+      &copyInfo,
+      texData,
+      alignedMipSize,
+      &layout,
+      &size);
 }
 
 int32_t GFXLoadTexture(Bitmap* bmp, Palette* defaultPal)
@@ -1758,12 +2369,12 @@ int32_t GFXLoadTexture(Bitmap* bmp, Palette* defaultPal)
       copyInfo.origin = (WGPUOrigin3D){0, 0, 0};
       copyInfo.aspect = WGPUTextureAspect_All;
       
-      wgpuQueueWriteTexture(smState.gpuQueue,
-                            &copyInfo,
-                            texData,
-                            alignedMipSize, // Assuming padded 4 bytes per pixel (RGBA8 format)
-                            &layout,
-                            &size);
+      smState.writeTexture(
+         &copyInfo,
+         texData,
+         alignedMipSize, // Assuming padded 4 bytes per pixel (RGBA8 format)
+         &layout,
+         &size);
       
       // Clean up texture data after uploading
       delete[] texData;
@@ -1775,6 +2386,8 @@ int32_t GFXLoadTexture(Bitmap* bmp, Palette* defaultPal)
       newInfo.dims[1] = textureDesc.size.height;
       newInfo.dims[2] = textureDesc.size.depthOrArrayLayers;
       newInfo.texBindGroup = smState.makeSimpleTextureBG(texView, smState.modelCommonSampler);
+      newInfo.byteSize = pow2W * pow2H * 4;
+      MemTracker::trackAlloc(MemCategory_GPUTexture, newInfo.byteSize);
       
       // Find or add texture to smState.textures
       int sz = (int)smState.textures.size();
@@ -1863,12 +2476,12 @@ int32_t GFXLoadTextureSet(uint32_t numBitmaps, Bitmap** bmps, Palette* defaultPa
         copyInfo.aspect = WGPUTextureAspect_All;
         copyInfo.origin.z = i;  // Target the ith layer of the texture
 
-        wgpuQueueWriteTexture(smState.gpuQueue,
-                              &copyInfo,
-                              texDataArray[i],
-                              alignedMipSize,  // Padded 4 bytes per pixel (RGBA8 format)
-                              &layout,
-                              &size);
+        smState.writeTexture(
+           &copyInfo,
+           texDataArray[i],
+           alignedMipSize,  // Padded 4 bytes per pixel (RGBA8 format)
+           &layout,
+           &size);
     }
 
     // Clean up the texture data after uploading
@@ -1895,6 +2508,8 @@ int32_t GFXLoadTextureSet(uint32_t numBitmaps, Bitmap** bmps, Palette* defaultPa
     newInfo.dims[1] = textureDesc.size.height;
     newInfo.dims[2] = textureDesc.size.depthOrArrayLayers;
     newInfo.texBindGroup = NULL;//smState.makeSimpleTextureBG(texView, smState.modelCommonSampler);
+    newInfo.byteSize = pow2W * pow2H * 4 * numBitmaps;
+    MemTracker::trackAlloc(MemCategory_GPUTexture, newInfo.byteSize);
 
     // Find or add texture to smState.textures
     int sz = (int)smState.textures.size();
@@ -1912,6 +2527,89 @@ int32_t GFXLoadTextureSet(uint32_t numBitmaps, Bitmap** bmps, Palette* defaultPa
 }
 
 
+int32_t GFXLoadCustomTextureArray(CustomTextureFormat fmt, uint32_t width, uint32_t height, uint32_t numLayers, void* data)
+{
+   // NOTE: only RGBA8 is needed so far (lightmap atlases)
+   if (fmt != CustomTexture_RGBA8 || numLayers == 0)
+   {
+      assert(false);
+      return -1;
+   }
+   
+   const uint32_t bpp = 4;
+   uint32_t paddedWidth = (uint32_t)AlignSize(width*bpp, 256);
+   uint32_t alignedLayerSize = paddedWidth * height;
+   uint8_t* texData = NULL;
+   
+   // Rows only need re-padding if they don't already meet the copy alignment
+   if (paddedWidth != width*bpp)
+   {
+      texData = new uint8_t[alignedLayerSize * numLayers];
+      memset(texData, 0, alignedLayerSize * numLayers);
+      copyMipDirect(height * numLayers, width*bpp, paddedWidth, (uint8_t*)data, texData);
+   }
+   
+   WGPUTextureDescriptor textureDesc = {};
+   textureDesc.size = (WGPUExtent3D){width, height, numLayers};
+   textureDesc.mipLevelCount = 1;
+   textureDesc.sampleCount = 1;
+   textureDesc.dimension = WGPUTextureDimension_2D;
+   textureDesc.format = WGPUTextureFormat_RGBA8Unorm;
+   textureDesc.usage = WGPUTextureUsage_CopyDst | WGPUTextureUsage_TextureBinding;
+   WGPUTexture tex = wgpuDeviceCreateTexture(smState.gpuDevice, &textureDesc);
+   
+   // All layers go up in a single write
+   WGPUTextureDataLayout layout = {};
+   layout.offset = 0;
+   layout.bytesPerRow = paddedWidth;
+   layout.rowsPerImage = height;
+   WGPUExtent3D size = {width, height, numLayers};
+   
+   WGPUImageCopyTexture copyInfo = {};
+   copyInfo.texture = tex;
+   copyInfo.mipLevel = 0;
+   copyInfo.origin = (WGPUOrigin3D){0, 0, 0};
+   copyInfo.aspect = WGPUTextureAspect_All;
+   
+   smState.writeTexture(&copyInfo,
+                        texData ? texData : data,
+                        alignedLayerSize * numLayers,
+                        &layout,
+                        &size);
+   
+   delete[] texData;
+   
+   WGPUTextureViewDescriptor textureViewDesc = {};
+   textureViewDesc.format = WGPUTextureFormat_RGBA8Unorm;
+   textureViewDesc.dimension = WGPUTextureViewDimension_2DArray;
+   textureViewDesc.mipLevelCount = 1;
+   textureViewDesc.arrayLayerCount = numLayers;
+   WGPUTextureView texView = wgpuTextureCreateView(tex, &textureViewDesc);
+   
+   SDLState::TexInfo newInfo = {};
+   newInfo.texture = tex;
+   newInfo.textureView = texView;
+   newInfo.texBindGroup = NULL;
+   newInfo.dims[0] = width;
+   newInfo.dims[1] = height;
+   newInfo.dims[2] = numLayers;
+   newInfo.byteSize = width * height * bpp * numLayers;
+   MemTracker::trackAlloc(MemCategory_GPUTexture, newInfo.byteSize);
+   
+   int sz = (int)smState.textures.size();
+   for (int i = 0; i < sz; i++)
+   {
+      if (smState.textures[i].texture == NULL)
+      {
+         smState.textures[i] = newInfo;
+         return i;
+      }
+   }
+   
+   smState.textures.push_back(newInfo);
+   return (int32_t)(smState.textures.size() - 1);
+}
+
 void GFXDeleteTexture(int32_t texID)
 {
    if (texID < 0 || texID >= smState.textures.size())
@@ -1923,9 +2621,19 @@ void GFXDeleteTexture(int32_t texID)
    
    wgpuTextureViewRelease(tex.textureView);
    wgpuTextureRelease(tex.texture);
+   MemTracker::trackFree(MemCategory_GPUTexture, tex.byteSize);
    
    tex.texture = NULL;
    tex.textureView = NULL;
+   tex.byteSize = 0;
+}
+
+static size_t calcModelDataSize(const SDLState::FrameModel& model)
+{
+   return (sizeof(ModelVertex) * model.numVerts) +
+          (sizeof(ModelTexVertex) * model.numTexVerts) +
+          (sizeof(uint16_t) * model.numInds) +
+          (model.skinData ? sizeof(ModelSkinVertex) * model.numVerts : 0);
 }
 
 void GFXLoadModelData(uint32_t modelId, void* verts, void* texverts, void* inds, void* skin, uint32_t numVerts, uint32_t numTexVerts, uint32_t numInds)
@@ -1937,6 +2645,8 @@ void GFXLoadModelData(uint32_t modelId, void* verts, void* texverts, void* inds,
    SDLState::FrameModel& model = smState.models[modelId];
    model.inFrame = false;
    
+   MemTracker::trackResize(MemCategory_ModelData, calcModelDataSize(model), 0);
+   
    if (model.vertData)
       delete[] model.vertData;
    if (model.texVertData)
@@ -1949,6 +2659,7 @@ void GFXLoadModelData(uint32_t modelId, void* verts, void* texverts, void* inds,
    model.vertData = new ModelVertex[numVerts];
    model.texVertData = new ModelTexVertex[numTexVerts];
    model.indexData = new uint16_t[numInds];
+   model.skinData = NULL;
    if (skin)
    {
       model.skinData = new ModelSkinVertex[numVerts];
@@ -1958,12 +2669,43 @@ void GFXLoadModelData(uint32_t modelId, void* verts, void* texverts, void* inds,
    model.numTexVerts = numTexVerts;
    model.numInds = numInds;
    
+   MemTracker::trackResize(MemCategory_ModelData, 0, calcModelDataSize(model));
+   
    memcpy(model.vertData, verts, sizeof(ModelVertex) * numVerts);
    memcpy(model.texVertData, texverts, sizeof(ModelTexVertex) * numTexVerts);
    memcpy(model.indexData, inds, sizeof(uint16_t) * numInds);
    if (skin)
    {
-      memcpy(model.skinData, inds, sizeof(ModelSkinVertex) * numVerts);
+      memcpy(model.skinData, skin, sizeof(ModelSkinVertex) * numVerts);
+   }
+}
+
+void GFXUpdateModelVerts(uint32_t modelId, uint32_t startVert, const ModelVertex* verts, uint32_t numVerts, bool inUse)
+{
+   if (smState.models.size() <= modelId)
+      return;
+   
+   SDLState::FrameModel& model = smState.models[modelId];
+   if (model.vertData == NULL || startVert + numVerts > model.numVerts)
+      return;
+   
+   memcpy(model.vertData + startVert, verts, sizeof(ModelVertex) * numVerts);
+   
+   // Models not yet in this frame pick the change up when they're first bound
+   if (!model.inFrame || model.vertsDirty)
+      return;
+   
+   if (inUse)
+   {
+      // Queue writes land before the frame's draws run, so draws already recorded from
+      // this range need the verts uploaded again to a new allocation on the next bind
+      model.vertsDirty = true;
+   }
+   else
+   {
+      smState.writeBuffer(model.vertOffset.buffer,
+                          model.vertOffset.offset + (sizeof(ModelVertex) * startVert),
+                          verts, sizeof(ModelVertex) * numVerts);
    }
 }
 
@@ -1975,22 +2717,89 @@ void GFXClearModelData(uint32_t modelId)
    SDLState::FrameModel& model = smState.models[modelId];
    model.inFrame = false;
    
+   MemTracker::trackResize(MemCategory_ModelData, calcModelDataSize(model), 0);
+   
    if (model.vertData)
       delete[] model.vertData;
    if (model.texVertData)
       delete[] model.texVertData;
    if (model.indexData)
       delete[] model.indexData;
+   if (model.skinData)
+      delete[] model.skinData;
    
    model.vertData = NULL;
    model.texVertData = NULL;
    model.indexData = NULL;
+   model.skinData = NULL;
    
    model.numVerts = 0;
    model.numTexVerts = 0;
    model.numInds = 0;
 }
 
+static WGPUBuffer createStaticBuffer(const void* data, size_t size, uint32_t usage)
+{
+   assert((size % sizeof(uint32_t)) == 0);
+   WGPUBufferDescriptor desc = {};
+   desc.size = size;
+   desc.usage = WGPUBufferUsage_CopyDst | usage;
+   WGPUBuffer buffer = wgpuDeviceCreateBuffer(smState.gpuDevice, &desc);
+   smState.writeBuffer(buffer, 0, data, desc.size);
+   MemTracker::trackAlloc(MemCategory_GPUStatic, desc.size);
+   return buffer;
+}
+
+static void releaseStaticBuffer(WGPUBuffer buffer)
+{
+   if (buffer == NULL)
+      return;
+   MemTracker::trackFree(MemCategory_GPUStatic, wgpuBufferGetSize(buffer));
+   wgpuBufferRelease(buffer);
+}
+
+void GFXLoadITRModelData(uint32_t itrModelId, void* verts, void* texverts, void* inds, uint32_t numVerts, uint32_t numInds)
+{
+   SDLState::ITRModel blankModel = {};
+   while (smState.itrModels.size() <= itrModelId)
+      smState.itrModels.push_back(blankModel);
+   
+   GFXClearITRModelData(itrModelId);
+   
+   if (numVerts == 0 || numInds == 0)
+      return;
+   
+   SDLState::ITRModel& model = smState.itrModels[itrModelId];
+   model.vertBuffer = createStaticBuffer(verts, sizeof(ModelVertex) * numVerts, WGPUBufferUsage_Vertex);
+   model.texVertBuffer = createStaticBuffer(texverts, sizeof(ITRTexVertex) * numVerts, WGPUBufferUsage_Vertex);
+   model.indexBuffer = createStaticBuffer(inds, sizeof(uint32_t) * numInds, WGPUBufferUsage_Index);
+   model.numVerts = numVerts;
+   model.numInds = numInds;
+}
+
+void GFXClearITRModelData(uint32_t itrModelId)
+{
+   if (smState.itrModels.size() <= itrModelId)
+      return;
+   
+   SDLState::ITRModel& model = smState.itrModels[itrModelId];
+   releaseStaticBuffer(model.vertBuffer);
+   releaseStaticBuffer(model.texVertBuffer);
+   releaseStaticBuffer(model.indexBuffer);
+   model = {};
+}
+
+void GFXSetITRModelVerts(uint32_t itrModelId)
+{
+   SDLState::ITRModel& model = smState.itrModels[itrModelId];
+   if (model.vertBuffer == NULL)
+      return;
+   
+   smState.setIndexBuffer(model.indexBuffer, WGPUIndexFormat_Uint32, 0, sizeof(uint32_t) * model.numInds);
+   smState.setVertexBuffer(0, model.vertBuffer, 0, sizeof(ModelVertex) * model.numVerts);
+   smState.setVertexBuffer(1, model.texVertBuffer, 0, sizeof(ITRTexVertex) * model.numVerts);
+}
+
 void GFXSetModelViewProjection(slm::mat4 &model, slm::mat4 &view, slm::mat4 &proj, uint32_t flags)
 {
    smState.modelMatrix = model;
@@ -2031,14 +2840,45 @@ void GFXSetTSMaterialResources(uint32_t tsGroupID, int32_t diffuseTexID, int32_t
 
 void GFXSetITRMaterialResources(uint32_t itrGroupID, int32_t baseTexID, int32_t emapTexID, int32_t lightmapTexID)
 {
-   // TODO
+   // NOTE: environment maps aren't supported yet so emapTexID is ignored
+   SDLState::ITRGPUResource blankRes = {-1, -1, NULL};
+   while (smState.itrResources.size() <= itrGroupID)
+      smState.itrResources.push_back(blankRes);
+   
+   SDLState::ITRGPUResource& res = smState.itrResources[itrGroupID];
+   if (res.mBindGroup == NULL ||
+       (res.mBaseTexID != baseTexID) ||
+       (res.mLightMapTexID != lightmapTexID))
+   {
+      if (res.mBindGroup != NULL)
+      {
+         wgpuBindGroupRelease(res.mBindGroup);
+         res.mBindGroup = NULL;
+      }
+      
+      if (baseTexID < 0 || lightmapTexID < 0)
+         return;
+      
+      WGPUTextureView baseView = smState.textures[baseTexID].textureView;
+      WGPUTextureView lightMapView = smState.textures[lightmapTexID].textureView;
+      
+      res.mBaseTexID = baseTexID;
+      res.mLightMapTexID = lightmapTexID;
+      res.mBindGroup = smState.makeInteriorTextureBG(baseView, lightMapView, smState.modelCommonLinearSampler, smState.modelCommonLinearClampSampler);
+   }
+}
+
+// Alpha values never exceed 1, so anything from there up doesn't need the test compiled in
+static inline uint32_t calcModelFeatures(ModelPipelineState state, float testVal)
+{
+   return (state == ModelPipeline_DefaultDiffuse && testVal < 1.0f) ? ModelFeature_AlphaTest : 0;
 }
 
 void GFXBeginTSModelPipelineState(ModelPipelineState state, uint32_t tsGroupID, float testVal, bool depthPeel, bool swapDepth)
 {
-   smState.currentPipeline = smState.modelProgram.pipelines[state];
+   smState.currentPipeline = getModelPipeline(smState.modelProgram, state, calcModelFeatures(state, testVal));
    smState.currentProgram = &smState.modelProgram;
-   wgpuRenderPassEncoderSetPipeline(smState.renderEncoder, smState.currentPipeline);
+   smState.setPipeline(smState.currentPipeline);
    
    GFXSetLightPos(smState.lightPos, smState.lightColor);
    GFXSetModelViewProjection(smState.modelMatrix, smState.viewMatrix, smState.projectionMatrix);
@@ -2059,25 +2899,27 @@ void GFXBeginTSModelPipelineState(ModelPipelineState state, uint32_t tsGroupID,
 
 void GFXBeginITRModelPipelineState(ModelPipelineState state, uint32_t itrGroupID, float testVal, bool depthPeel, bool swapDepth)
 {
-   smState.currentPipeline = smState.modelProgram.pipelines[state];
-   smState.currentProgram = &smState.modelProgram;
-   wgpuRenderPassEncoderSetPipeline(smState.renderEncoder, smState.currentPipeline);
+   smState.currentPipeline = getModelPipeline(smState.interiorProgram, state, calcModelFeatures(state, testVal));
+   smState.currentProgram = &smState.interiorProgram;
+   smState.setPipeline(smState.currentPipeline);
    
    GFXSetLightPos(smState.lightPos, smState.lightColor);
    GFXSetModelViewProjection(smState.modelMatrix, smState.viewMatrix, smState.projectionMatrix);
    
    if (state == ModelPipeline_DefaultDiffuse)
    {
-      smState.modelProgram.uniforms.params2.x = testVal;
+      smState.interiorProgram.uniforms.params2.x = testVal;
    }
    else
    {
-      smState.modelProgram.uniforms.params2.x = 1.1f;
+      smState.interiorProgram.uniforms.params2.x = 1.1f;
    }
    
-   // Set texture
-   //SDLState::TexInfo& info = smState.textures[texID];
-   //wgpuRenderPassEncoderSetBindGroup(smState.renderEncoder, 1, info.texBindGroup, 0, NULL);
+   if (itrGroupID < smState.itrResources.size() &&
+       smState.itrResources[itrGroupID].mBindGroup != NULL)
+   {
+      smState.setBindGroup(1, smState.itrResources[itrGroupID].mBindGroup, 0, NULL);
+   }
 }
 
 void GFXSetTSPipelineProps(uint32_t matFrame, uint32_t transformOffset, slm::vec4 texGenS, slm::vec4 texGenT)
@@ -2095,46 +2937,89 @@ void GFXSetModelVerts(uint32_t modelId, uint32_t vertOffset, uint32_t texOffset,
    if (model.inFrame == false)
    {
       model.indexOffset = smState.allocBuffer(model.numInds * sizeof(uint16_t), WGPUBufferUsage_CopyDst | WGPUBufferUsage_Index, sizeof(uint32_t));
-      wgpuQueueWriteBuffer(smState.gpuQueue, model.indexOffset.buffer, model.indexOffset.offset, model.indexData, indexSize);
+      smState.writeBuffer(model.indexOffset.buffer, model.indexOffset.offset, model.indexData, indexSize);
       
       model.vertOffset = smState.allocBuffer(vertSize, WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex, sizeof(ModelVertex));
-      wgpuQueueWriteBuffer(smState.gpuQueue, model.vertOffset.buffer, model.vertOffset.offset, model.vertData, vertSize);
+      smState.writeBuffer(model.vertOffset.buffer, model.vertOffset.offset, model.vertData, vertSize);
       
       model.texVertOffset = smState.allocBuffer(texVertSize, WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex, sizeof(ModelTexVertex));
-      wgpuQueueWriteBuffer(smState.gpuQueue, model.texVertOffset.buffer, model.texVertOffset.offset, model.texVertData, texVertSize);
+      smState.writeBuffer(model.texVertOffset.buffer, model.texVertOffset.offset, model.texVertData, texVertSize);
       
       // Load in frame
       model.inFrame = true;
+      model.vertsDirty = false;
+   }
+   else if (model.vertsDirty)
+   {
+      model.vertOffset = smState.allocBuffer(vertSize, WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex, sizeof(ModelVertex));
+      smState.writeBuffer(model.vertOffset.buffer, model.vertOffset.offset, model.vertData, vertSize);
+      model.vertsDirty = false;
    }
    
-   wgpuRenderPassEncoderSetIndexBuffer(smState.renderEncoder, model.indexOffset.buffer, WGPUIndexFormat_Uint16, model.indexOffset.offset + indexOffset, model.numInds * sizeof(uint16_t));
+   smState.setIndexBuffer(model.indexOffset.buffer, WGPUIndexFormat_Uint16, model.indexOffset.offset + indexOffset, model.numInds * sizeof(uint16_t));
        
-   wgpuRenderPassEncoderSetVertexBuffer(smState.renderEncoder, 0, model.vertOffset.buffer, model.vertOffset.offset + vertOffset, vertSize);
-   wgpuRenderPassEncoderSetVertexBuffer(smState.renderEncoder, 1, model.texVertOffset.buffer, model.texVertOffset.offset + texOffset, texVertSize);
+   smState.setVertexBuffer(0, model.vertOffset.buffer, model.vertOffset.offset + vertOffset, vertSize);
+   smState.setVertexBuffer(1, model.texVertOffset.buffer, model.texVertOffset.offset + texOffset, texVertSize);
 }
 
 void GFXDrawModelVerts(uint32_t numVerts, uint32_t startVerts)
 {
    SDLState::BufferRef uniformData = smState.allocBuffer(sizeof(CommonUniformStruct), WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform, 256);
-   wgpuQueueWriteBuffer(smState.gpuQueue, uniformData.buffer, uniformData.offset, &smState.currentProgram->uniforms, sizeof(CommonUniformStruct));
+   smState.writeBuffer(uniformData.buffer, uniformData.offset, &smState.currentProgram->uniforms, sizeof(CommonUniformStruct));
    
    uint32_t offsets[1];
    offsets[0] = (uint32_t)uniformData.offset;
-   wgpuRenderPassEncoderSetBindGroup(smState.renderEncoder, 0, smState.commonUniformGroup, 1, offsets);
+   smState.setBindGroup(0, smState.commonUniformGroup, 1, offsets);
    
-   wgpuRenderPassEncoderDraw(smState.renderEncoder, numVerts, 1, startVerts, 0);
+   smState.setInstanceBuffer(smState.identityInstanceBuffer, 0, sizeof(ModelInstance));
+   smState.draw(numVerts, 1, startVerts, 0);
 }
 
 void GFXDrawModelPrims(uint32_t numVerts, uint32_t numInds, uint32_t startInds, uint32_t startVerts)
 {
    SDLState::BufferRef uniformData = smState.allocBuffer(sizeof(CommonUniformStruct), WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform, 256);
-   wgpuQueueWriteBuffer(smState.gpuQueue, uniformData.buffer, uniformData.offset, &smState.currentProgram->uniforms, sizeof(CommonUniformStruct));
+   smState.writeBuffer(uniformData.buffer, uniformData.offset, &smState.currentProgram->uniforms, sizeof(CommonUniformStruct));
+   
+   uint32_t offsets[1];
+   offsets[0] = uniformData.offset;
+   smState.setBindGroup(0, smState.commonUniformGroup, 1, offsets);
+   
+   smState.setInstanceBuffer(smState.identityInstanceBuffer, 0, sizeof(ModelInstance));
+   smState.drawIndexed(numInds, 1, startInds, startVerts, 0);
+}
+
+void GFXUploadModelInstances(const ModelInstance* instances, uint32_t numInstances)
+{
+   // Transient buffers are a fixed size, so anything past that won't be drawn
+   const uint32_t maxInstances = (uint32_t)(BufferSize / sizeof(ModelInstance));
+   if (numInstances > maxInstances)
+      numInstances = maxInstances;
+   
+   smState.numInstances = numInstances;
+   if (numInstances == 0)
+      return;
+   
+   const size_t size = sizeof(ModelInstance) * numInstances;
+   smState.instanceData = smState.allocBuffer(size, WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex, 16);
+   smState.writeBuffer(smState.instanceData.buffer, smState.instanceData.offset, instances, size);
+}
+
+void GFXDrawModelPrimsInstanced(uint32_t numVerts, uint32_t numInds, uint32_t startInds, uint32_t startVerts, uint32_t firstInstance, uint32_t numInstances)
+{
+   if (numInstances == 0 || firstInstance + numInstances > smState.numInstances)
+      return;
+   
+   SDLState::BufferRef uniformData = smState.allocBuffer(sizeof(CommonUniformStruct), WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform, 256);
+   smState.writeBuffer(uniformData.buffer, uniformData.offset, &smState.currentProgram->uniforms, sizeof(CommonUniformStruct));
    
    uint32_t offsets[1];
    offsets[0] = uniformData.offset;
-   wgpuRenderPassEncoderSetBindGroup(smState.renderEncoder, 0, smState.commonUniformGroup, 1, offsets);
+   smState.setBindGroup(0, smState.commonUniformGroup, 1, offsets);
    
-   wgpuRenderPassEncoderDrawIndexed(smState.renderEncoder, numInds, 1, startInds, startVerts, 0);
+   // NOTE: the whole upload stays bound so batches only differ by firstInstance
+   smState.setInstanceBuffer(smState.instanceData.buffer, smState.instanceData.offset, sizeof(ModelInstance) * smState.numInstances);
+   smState.drawIndexed(numInds, numInstances, startInds, startVerts, firstInstance);
+   smState.frameStats.instancesDrawn += numInstances;
 }
 
 void GFXSetTerrainResources(uint32_t terrainID, int32_t matTexListID, int32_t heightMapTexID, int32_t gridMapTexID, int32_t lightmapTexID)
@@ -2168,14 +3053,14 @@ void GFXBeginTerrainPipelineState(TerrainPipelineState state, uint32_t terrainID
 {
    smState.currentPipeline = smState.terrainProgram.pipelines[state];
    smState.currentProgram = &smState.terrainProgram;
-   wgpuRenderPassEncoderSetPipeline(smState.renderEncoder, smState.currentPipeline);
+   smState.setPipeline(smState.currentPipeline);
    
    smState.terrainProgram.uniforms.params2.y = squareSize;
    smState.terrainProgram.uniforms.params2.z = gridX;
    
    SDLState::TerrainGPUResource& res = smState.terrainResources[terrainID];
    
-   wgpuRenderPassEncoderSetBindGroup(smState.renderEncoder, 1, res.mBindGroup, 0, NULL);
+   smState.setBindGroup(1, res.mBindGroup, 0, NULL);
    
    memcpy(smState.currentProgram->uniforms.squareTexCoords, matCoords, sizeof(slm::vec4)*16);
    
@@ -2186,7 +3071,7 @@ void GFXBeginLinePipelineState()
 {
    smState.currentPipeline = smState.lineProgram.pipeline;
    smState.currentProgram = &smState.lineProgram;
-   wgpuRenderPassEncoderSetPipeline(smState.renderEncoder, smState.currentPipeline);
+   smState.setPipeline(smState.currentPipeline);
    
    GFXSetModelViewProjection(smState.modelMatrix, smState.viewMatrix, smState.projectionMatrix);
 }
@@ -2223,16 +3108,16 @@ void GFXDrawLine(slm::vec3 start, slm::vec3 end, slm::vec4 color, float width)
    smState.lineProgram.uniforms.params1 = slm::vec4(1.0f / smState.viewportSize.x, 1.0f / smState.viewportSize.y, width, 0.0f);
    
    SDLState::BufferRef uniformData = smState.allocBuffer(sizeof(CommonUniformStruct), WGPUBufferUsage_CopyDst | WGPUBufferUsage_Uniform, 256);
-   wgpuQueueWriteBuffer(smState.gpuQueue, uniformData.buffer, uniformData.offset, &smState.lineProgram.uniforms, sizeof(CommonUniformStruct));
+   smState.writeBuffer(uniformData.buffer, uniformData.offset, &smState.lineProgram.uniforms, sizeof(CommonUniformStruct));
    
    SDLState::BufferRef lineData = smState.allocBuffer(sizeof(verts), WGPUBufferUsage_CopyDst | WGPUBufferUsage_Vertex, sizeof(_LineVert));
-   wgpuQueueWriteBuffer(smState.gpuQueue, lineData.buffer, lineData.offset, verts, sizeof(verts));
+   smState.writeBuffer(lineData.buffer, lineData.offset, verts, sizeof(verts));
    
    uint32_t offsets[1];
    offsets[0] = uniformData.offset;
-   wgpuRenderPassEncoderSetBindGroup(smState.renderEncoder, 0, smState.commonUniformGroup, 1, offsets);
+   smState.setBindGroup(0, smState.commonUniformGroup, 1, offsets);
    
-   wgpuRenderPassEncoderSetVertexBuffer(smState.renderEncoder, 0, lineData.buffer, lineData.offset, sizeof(verts));
+   smState.setVertexBuffer(0, lineData.buffer, lineData.offset, sizeof(verts));
    
-   wgpuRenderPassEncoderDraw(smState.renderEncoder, 6, 1, 0, 0);
+   smState.draw(6, 1, 0, 0);
 }
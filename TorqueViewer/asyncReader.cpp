@@ -0,0 +1,526 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <chrono>
+#include "asyncReader.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#define TV_IO_URING
+#endif
+
+// Blocking read at an offset which doesn't touch the shared file position
+static int64_t readAt(int fd, uint8_t* dest, uint64_t size, uint64_t offset)
+{
+#ifdef _WIN32
+   OVERLAPPED overlapped = {};
+   overlapped.Offset = (DWORD)offset;
+   overlapped.OffsetHigh = (DWORD)(offset >> 32);
+   DWORD bytesRead = 0;
+   if (!ReadFile((HANDLE)_get_osfhandle(fd), dest, (DWORD)size, &bytesRead, &overlapped))
+      return -1;
+   return bytesRead;
+#else
+   return pread(fd, dest, size, offset);
+#endif
+}
+
+#ifdef TV_IO_URING
+
+// Shared rings set up with the raw syscalls, so liburing isn't needed
+struct AsyncReader::IOUring
+{
+   int fd;
+   void* sqMap;
+   size_t sqMapSize;
+   void* cqMap;
+   size_t cqMapSize;
+   io_uring_sqe* sqes;
+   size_t sqesSize;
+   
+   uint32_t* sqHead;
+   uint32_t* sqTail;
+   uint32_t* sqMask;
+   uint32_t* sqArray;
+   uint32_t* cqHead;
+   uint32_t* cqTail;
+   uint32_t* cqMask;
+   io_uring_cqe* cqes;
+   
+   IOUring() : fd(-1), sqMap(MAP_FAILED), sqMapSize(0), cqMap(MAP_FAILED), cqMapSize(0), sqes((io_uring_sqe*)MAP_FAILED), sqesSize(0) {;}
+   
+   ~IOUring()
+   {
+      if (sqes != MAP_FAILED)
+         munmap(sqes, sqesSize);
+      if (cqMap != MAP_FAILED && cqMap != sqMap)
+         munmap(cqMap, cqMapSize);
+      if (sqMap != MAP_FAILED)
+         munmap(sqMap, sqMapSize);
+      if (fd >= 0)
+         close(fd);
+   }
+   
+   bool init(uint32_t entries)
+   {
+      io_uring_params params = {};
+      fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+      if (fd < 0)
+         return false;
+      
+      // IORING_OP_READ needs 5.6; FAST_POLL arrived in 5.7 so implies it
+      if ((params.features & IORING_FEAT_FAST_POLL) == 0)
+         return false;
+      
+      sqMapSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+      cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+      if (singleMap)
+         sqMapSize = cqMapSize = std::max(sqMapSize, cqMapSize);
+      
+      sqMap = mmap(NULL, sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+      if (sqMap == MAP_FAILED)
+         return false;
+      
+      cqMap = singleMap ? sqMap : mmap(NULL, cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if (cqMap == MAP_FAILED)
+         return false;
+      
+      sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+      sqes = (io_uring_sqe*)mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+      if (sqes == MAP_FAILED)
+         return false;
+      
+      uint8_t* sq = (uint8_t*)sqMap;
+      uint8_t* cq = (uint8_t*)cqMap;
+      sqHead = (uint32_t*)(sq + params.sq_off.head);
+      sqTail = (uint32_t*)(sq + params.sq_off.tail);
+      sqMask = (uint32_t*)(sq + params.sq_off.ring_mask);
+      sqArray = (uint32_t*)(sq + params.sq_off.array);
+      cqHead = (uint32_t*)(cq + params.cq_off.head);
+      cqTail = (uint32_t*)(cq + params.cq_off.tail);
+      cqMask = (uint32_t*)(cq + params.cq_off.ring_mask);
+      cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+      return true;
+   }
+   
+   // Returns the number of entries submitted, or -errno
+   int enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags)
+   {
+      int result = (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+      return result < 0 ? -errno : result;
+   }
+};
+
+#else
+
+struct AsyncReader::IOUring
+{
+};
+
+#endif
+
+AsyncReader::AsyncReader(uint32_t numWorkers, uint32_t queueDepth, bool allowIOUring) :
+mBackend(Backend_Threads),
+mRing(NULL),
+mQueueDepth(std::max(queueDepth, 1U)),
+mInFlight(0),
+mNumReady(0),
+mNumRunning(0),
+mShutdown(false)
+{
+   mStats = {};
+   
+   if (allowIOUring && initIOUring())
+   {
+      mBackend = Backend_IOUring;
+      mIOThreads.emplace_back(&AsyncReader::reapThread, this);
+   }
+   else
+   {
+      uint32_t numIOThreads = std::min<uint32_t>(mQueueDepth, MaxIOThreads);
+      for (uint32_t i=0; i<numIOThreads; i++)
+         mIOThreads.emplace_back(&AsyncReader::ioThread, this);
+   }
+   
+   if (numWorkers == 0)
+      numWorkers = std::max(std::thread::hardware_concurrency(), 1U);
+   for (uint32_t i=0; i<numWorkers; i++)
+      mWorkers.emplace_back(&AsyncReader::workerThread, this);
+}
+
+AsyncReader::~AsyncReader()
+{
+   wait();
+   
+   {
+      std::lock_guard<std::mutex> lock(mLock);
+      mShutdown = true;
+   }
+   mIOCondition.notify_all();
+   mWorkCondition.notify_all();
+   
+   for (std::thread& thread : mIOThreads)
+      thread.join();
+   for (std::thread& thread : mWorkers)
+      thread.join();
+   
+   delete mRing;
+}
+
+void AsyncReader::read(int fd, uint64_t offset, uint64_t size, Priority priority, CompleteFunc onComplete)
+{
+   Request* req = new Request;
+   req->fd = fd;
+   req->offset = offset;
+   req->size = size;
+   req->done = 0;
+   req->data = (uint8_t*)malloc(std::max<uint64_t>(size, 1));
+   req->priority = priority;
+   req->onComplete = onComplete;
+   
+   std::lock_guard<std::mutex> lock(mLock);
+   
+   if (req->data == NULL || size == 0)
+   {
+      finishRead(req, req->data != NULL);
+      return;
+   }
+   
+   mPending[priority].push_back(req);
+   if (mBackend == Backend_IOUring)
+      submitIOUring();
+   else
+      mIOCondition.notify_one();
+}
+
+void AsyncReader::wait()
+{
+   std::unique_lock<std::mutex> lock(mLock);
+   mIdleCondition.wait(lock, [this](){
+      return mPending[Priority_Interactive].empty() && mPending[Priority_Prefetch].empty() &&
+             mInFlight == 0 && mNumReady == 0 && mNumRunning == 0;
+   });
+}
+
+void AsyncReader::getStats(Stats& outStats)
+{
+   std::lock_guard<std::mutex> lock(mLock);
+   outStats = mStats;
+}
+
+AsyncReader::Request* AsyncReader::popPending()
+{
+   uint32_t used = mInFlight + mNumReady;
+   
+   Request* req = NULL;
+   if (!mPending[Priority_Interactive].empty() && used < mQueueDepth)
+   {
+      req = mPending[Priority_Interactive].front();
+      mPending[Priority_Interactive].pop_front();
+   }
+   else if (!mPending[Priority_Prefetch].empty() && used < mQueueDepth - (mQueueDepth / 4))
+   {
+      req = mPending[Priority_Prefetch].front();
+      mPending[Priority_Prefetch].pop_front();
+   }
+   
+   return req;
+}
+
+void AsyncReader::finishRead(Request* req, bool ok)
+{
+   if (ok)
+   {
+      mStats.numReads++;
+      mStats.bytesRead += req->size;
+   }
+   else
+   {
+      mStats.numFailed++;
+      free(req->data);
+      req->data = NULL;
+   }
+   
+   mReady[req->priority].push_back(req);
+   mNumReady++;
+   mWorkCondition.notify_one();
+}
+
+bool AsyncReader::initIOUring()
+{
+#ifdef TV_IO_URING
+   mRing = new IOUring();
+   if (mRing->init(mQueueDepth))
+      return true;
+   
+   delete mRing;
+   mRing = NULL;
+#endif
+   return false;
+}
+
+void AsyncReader::submitIOUring()
+{
+#ifdef TV_IO_URING
+   // Caller holds mLock, which makes this the only submission queue producer
+   uint32_t tail = *mRing->sqTail;
+   uint32_t numAdded = 0;
+   
+   for (Request* req = popPending(); req != NULL; req = popPending())
+   {
+      uint32_t index = tail & *mRing->sqMask;
+      io_uring_sqe* sqe = &mRing->sqes[index];
+      memset(sqe, 0, sizeof(io_uring_sqe));
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = req->fd;
+      sqe->off = req->offset + req->done;
+      sqe->addr = (uint64_t)(uintptr_t)(req->data + req->done);
+      sqe->len = (uint32_t)std::min<uint64_t>(req->size - req->done, MaxReadSize);
+      sqe->user_data = (uint64_t)(uintptr_t)req;
+      mRing->sqArray[index] = index;
+      
+      tail++;
+      numAdded++;
+      mInFlight++;
+   }
+   
+   if (numAdded == 0)
+      return;
+   
+   __atomic_store_n(mRing->sqTail, tail, __ATOMIC_RELEASE);
+   flushIOUring();
+   
+   mStats.numSubmits++;
+   mStats.maxInFlight = std::max(mStats.maxInFlight, mInFlight);
+   mIOCondition.notify_one();
+#endif
+}
+
+uint32_t AsyncReader::flushIOUring()
+{
+#ifdef TV_IO_URING
+   // Caller holds mLock; this is the only place entries are handed to the kernel.
+   // Anything it doesn't take now is retried by the reap thread, unless it never will be.
+   uint32_t toSubmit = *mRing->sqTail - __atomic_load_n(mRing->sqHead, __ATOMIC_ACQUIRE);
+   if (toSubmit == 0)
+      return 0;
+   
+   int result = mRing->enter(toSubmit, 0, 0);
+   if (result < 0 && result != -EINTR && result != -EAGAIN && result != -EBUSY)
+   {
+      printf("AsyncReader: io_uring submit failed (%s)\n", strerror(-result));
+      failUnsubmittedIOUring();
+   }
+   
+   return *mRing->sqTail - __atomic_load_n(mRing->sqHead, __ATOMIC_ACQUIRE);
+#else
+   return 0;
+#endif
+}
+
+void AsyncReader::failUnsubmittedIOUring()
+{
+#ifdef TV_IO_URING
+   // Caller holds mLock. The kernel only takes entries inside io_uring_enter, and
+   // only flushIOUring submits (under mLock), so nothing can consume these meanwhile.
+   uint32_t head = __atomic_load_n(mRing->sqHead, __ATOMIC_ACQUIRE);
+   uint32_t tail = *mRing->sqTail;
+   for (uint32_t i=head; i!=tail; i++)
+   {
+      const io_uring_sqe* sqe = &mRing->sqes[mRing->sqArray[i & *mRing->sqMask]];
+      Request* req = (Request*)(uintptr_t)sqe->user_data;
+      mInFlight--;
+      finishRead(req, false);
+   }
+   __atomic_store_n(mRing->sqTail, head, __ATOMIC_RELEASE);
+#endif
+}
+
+void AsyncReader::reapThread()
+{
+#ifdef TV_IO_URING
+   for (;;)
+   {
+      bool anySubmitted = false;
+      {
+         std::unique_lock<std::mutex> lock(mLock);
+         mIOCondition.wait(lock, [this](){ return mShutdown || mInFlight > 0; });
+         if (mInFlight == 0)
+            return;
+         
+         // Push any entries an earlier submit left behind
+         anySubmitted = flushIOUring() < mInFlight;
+      }
+      
+      // Only this thread consumes completions
+      uint32_t head = *mRing->cqHead;
+      if (head == __atomic_load_n(mRing->cqTail, __ATOMIC_ACQUIRE))
+      {
+         // Nothing the kernel has taken, so there's nothing to wait on yet
+         if (!anySubmitted)
+         {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+         }
+         
+         // Waits only; entries are submitted under mLock by flushIOUring
+         int result = mRing->enter(0, 1, IORING_ENTER_GETEVENTS);
+         if (result < 0 && result != -EINTR)
+         {
+            // Out of resources until something completes, so don't spin on it
+            if (result != -EAGAIN && result != -EBUSY)
+               printf("AsyncReader: io_uring wait failed (%s)\n", strerror(-result));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+         }
+         continue;
+      }
+      
+      std::lock_guard<std::mutex> lock(mLock);
+      uint32_t tail = __atomic_load_n(mRing->cqTail, __ATOMIC_ACQUIRE);
+      for (; head != tail; head++)
+      {
+         const io_uring_cqe* cqe = &mRing->cqes[head & *mRing->cqMask];
+         Request* req = (Request*)(uintptr_t)cqe->user_data;
+         int32_t result = cqe->res;
+         mInFlight--;
+         
+         if (result > 0)
+         {
+            // Short reads carry on from where they stopped
+            req->done += result;
+            if (req->done < req->size)
+               mPending[req->priority].push_front(req);
+            else
+               finishRead(req, true);
+         }
+         else if (result == -EINTR || result == -EAGAIN)
+         {
+            mPending[req->priority].push_front(req);
+         }
+         else
+         {
+            finishRead(req, false);
+         }
+      }
+      __atomic_store_n(mRing->cqHead, head, __ATOMIC_RELEASE);
+      
+      submitIOUring();
+   }
+#endif
+}
+
+void AsyncReader::ioThread()
+{
+   for (;;)
+   {
+      Request* req = NULL;
+      {
+         std::unique_lock<std::mutex> lock(mLock);
+         mIOCondition.wait(lock, [this, &req](){
+            req = popPending();
+            return mShutdown || req != NULL;
+         });
+         if (req == NULL)
+            return;
+         
+         mInFlight++;
+         mStats.numSubmits++;
+         mStats.maxInFlight = std::max(mStats.maxInFlight, mInFlight);
+      }
+      
+      bool ok = true;
+      while (req->done < req->size)
+      {
+         uint64_t size = std::min<uint64_t>(req->size - req->done, MaxReadSize);
+         int64_t result = readAt(req->fd, req->data + req->done, size, req->offset + req->done);
+         if (result > 0)
+         {
+            req->done += result;
+         }
+         else if (result < 0 && errno == EINTR)
+         {
+            continue;
+         }
+         else
+         {
+            ok = false;
+            break;
+         }
+      }
+      
+      std::lock_guard<std::mutex> lock(mLock);
+      mInFlight--;
+      finishRead(req, ok);
+   }
+}
+
+void AsyncReader::workerThread()
+{
+   for (;;)
+   {
+      Request* req = NULL;
+      {
+         std::unique_lock<std::mutex> lock(mLock);
+         mWorkCondition.wait(lock, [this](){ return mShutdown || mNumReady > 0; });
+         if (mNumReady == 0)
+            return;
+         
+         std::deque<Request*>& queue = mReady[Priority_Interactive].empty() ? mReady[Priority_Prefetch] : mReady[Priority_Interactive];
+         req = queue.front();
+         queue.pop_front();
+         mNumReady--;
+         mNumRunning++;
+         
+         // A slot has been freed up
+         if (mBackend == Backend_IOUring)
+            submitIOUring();
+         else
+            mIOCondition.notify_one();
+      }
+      
+      req->onComplete(req->data, req->size);
+      delete req;
+      
+      std::lock_guard<std::mutex> lock(mLock);
+      mNumRunning--;
+      if (mNumRunning == 0 && mNumReady == 0 && mInFlight == 0 &&
+          mPending[Priority_Interactive].empty() && mPending[Priority_Prefetch].empty())
+      {
+         mIdleCondition.notify_all();
+      }
+   }
+}
@@ -0,0 +1,149 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _ASYNCREADER_H_
+#define _ASYNCREADER_H_
+
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/*
+ Schedules file reads so I/O overlaps with decoding. Reads are queued by
+ priority and handed to the backend, and each one's completion callback runs
+ on a pool of worker threads (which is where files get decompressed and
+ parsed) while later reads are still in flight.
+ 
+ On Linux reads are submitted in batches through io_uring, with a single thread
+ reaping completions. Elsewhere, or if io_uring isn't available, a pool of I/O
+ threads does blocking preads instead.
+ 
+ Reads in flight plus completions waiting for a worker are limited to the
+ queue depth, which bounds memory and stops the disk from being flooded with
+ requests nobody is ready for. Interactive reads always go first, and a
+ quarter of the depth is kept free for them so prefetching can't hold them up.
+ */
+class AsyncReader
+{
+public:
+   
+   enum Priority
+   {
+      Priority_Interactive, // something is waiting on this
+      Priority_Prefetch,    // might be needed soon
+      Priority_Count
+   };
+   
+   enum Backend
+   {
+      Backend_IOUring,
+      Backend_Threads
+   };
+   
+   enum
+   {
+      DefaultQueueDepth = 32,
+      MaxIOThreads = 8,
+      MaxReadSize = 1 << 30 // larger reads are split
+   };
+   
+   // Called on a worker thread. data is a malloc'd buffer owned by the callee,
+   // or NULL if the read failed.
+   typedef std::function<void(uint8_t* data, uint64_t size)> CompleteFunc;
+   
+   struct Stats
+   {
+      uint32_t numReads;
+      uint32_t numFailed;
+      uint32_t numSubmits;   // backend submissions; io_uring batches several reads per submit
+      uint32_t maxInFlight;
+      uint64_t bytesRead;
+   };
+   
+   // numWorkers=0 picks a default
+   AsyncReader(uint32_t numWorkers=0, uint32_t queueDepth=DefaultQueueDepth, bool allowIOUring=true);
+   ~AsyncReader();
+   
+   // Queues a read of size bytes at offset in fd (a POSIX file descriptor), which
+   // must stay open until onComplete is called
+   void read(int fd, uint64_t offset, uint64_t size, Priority priority, CompleteFunc onComplete);
+   
+   // Blocks until every queued read has completed and its callback has returned
+   void wait();
+   
+   inline Backend getBackend() const { return mBackend; }
+   inline uint32_t getNumWorkers() const { return (uint32_t)mWorkers.size(); }
+   void getStats(Stats& outStats);
+   
+protected:
+   
+   struct Request
+   {
+      int fd;
+      uint64_t offset;
+      uint64_t size;
+      uint64_t done;     // bytes read so far
+      uint8_t* data;
+      Priority priority;
+      CompleteFunc onComplete;
+   };
+   
+   struct IOUring;
+   
+   Backend mBackend;
+   IOUring* mRing;
+   uint32_t mQueueDepth;
+   
+   std::mutex mLock;
+   std::condition_variable mIOCondition;     // requests to read (threads) or reap (io_uring)
+   std::condition_variable mWorkCondition;   // completions to run
+   std::condition_variable mIdleCondition;
+   std::deque<Request*> mPending[Priority_Count];
+   std::deque<Request*> mReady[Priority_Count];
+   uint32_t mInFlight;
+   uint32_t mNumReady;     // completions waiting for a worker
+   uint32_t mNumRunning;   // completions being run
+   bool mShutdown;
+   Stats mStats;
+   
+   std::vector<std::thread> mIOThreads;
+   std::vector<std::thread> mWorkers;
+   
+   // Returns the next request which can start, honoring the depth limits
+   Request* popPending();
+   
+   void finishRead(Request* req, bool ok);
+   
+   bool initIOUring();
+   void submitIOUring();
+   uint32_t flushIOUring(); // returns the number of entries the kernel hasn't taken
+   void failUnsubmittedIOUring();
+   void reapThread();
+   void ioThread();
+   void workerThread();
+};
+
+#endif
@@ -0,0 +1,264 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <slm/slmath.h>
+#include "CommonShaderTypes.h"
+#include "RendererHelper.h"
+#include "memTracker.h"
+#include "benchMode.h"
+
+bool BenchCameraPath::load(const char* filename)
+{
+   FILE* fp = fopen(filename, "rb");
+   if (fp == NULL)
+   {
+      printf("Couldn't open camera path %s\n", filename);
+      return false;
+   }
+   
+   mKeys.clear();
+   
+   char line[512];
+   uint32_t lineNum = 0;
+   while (fgets(line, sizeof(line), fp))
+   {
+      lineNum++;
+      
+      const char* ptr = line;
+      while (*ptr == ' ' || *ptr == '\t')
+         ptr++;
+      if (*ptr == '#' || *ptr == '\r' || *ptr == '\n' || *ptr == '\0')
+         continue;
+      
+      Key key;
+      if (sscanf(ptr, "%f %f %f %f %f %f %f", &key.time,
+                 &key.pos.x, &key.pos.y, &key.pos.z,
+                 &key.rot.x, &key.rot.y, &key.rot.z) != 7)
+      {
+         printf("%s:%u: expected \"time posX posY posZ rotX rotY rotZ\"\n", filename, lineNum);
+         fclose(fp);
+         return false;
+      }
+      
+      if (!mKeys.empty() && key.time < mKeys.back().time)
+      {
+         printf("%s:%u: key times must be increasing\n", filename, lineNum);
+         fclose(fp);
+         return false;
+      }
+      
+      mKeys.push_back(key);
+   }
+   
+   fclose(fp);
+   
+   if (mKeys.empty())
+   {
+      printf("Camera path %s has no keys\n", filename);
+      return false;
+   }
+   
+   return true;
+}
+
+void BenchCameraPath::evaluate(float t, slm::vec3& outPos, slm::vec3& outRot) const
+{
+   if (mKeys.empty())
+   {
+      outPos = slm::vec3(0);
+      outRot = slm::vec3(0);
+      return;
+   }
+   
+   float duration = getDuration();
+   if (duration > 0.0f && t > duration)
+      t = fmodf(t, duration);
+   
+   // Find first key past t
+   auto itr = std::upper_bound(mKeys.begin(), mKeys.end(), t, [](float val, const Key& key){
+      return val < key.time;
+   });
+   
+   if (itr == mKeys.begin())
+   {
+      outPos = itr->pos;
+      outRot = itr->rot;
+      return;
+   }
+   else if (itr == mKeys.end())
+   {
+      outPos = mKeys.back().pos;
+      outRot = mKeys.back().rot;
+      return;
+   }
+   
+   const Key& k1 = *(itr-1);
+   const Key& k2 = *itr;
+   float span = k2.time - k1.time;
+   float f = span > 0.0f ? (t - k1.time) / span : 0.0f;
+   
+   outPos = k1.pos + ((k2.pos - k1.pos) * f);
+   outRot = k1.rot + ((k2.rot - k1.rot) * f);
+}
+
+BenchRecorder::BenchRecorder()
+{
+   mTotalDrawCalls = 0;
+   mTotalPipelineSwitches = 0;
+   mTotalBindGroupSets = 0;
+   mTotalBufferWriteBytes = 0;
+   mTotalTextureWriteBytes = 0;
+   mTotalCommandBuffers = 0;
+   mMaxDrawCalls = 0;
+   mMaxPipelineSwitches = 0;
+   mGPUTimestamps = false;
+   mFallbackAdapter = false;
+}
+
+void BenchRecorder::addFrame(float cpuMS, float gpuMS, const GFXFrameStats& stats)
+{
+   mCPUFrameMS.push_back(cpuMS);
+   mGPUFrameMS.push_back(gpuMS);
+   
+   mTotalDrawCalls += stats.drawCalls;
+   mTotalPipelineSwitches += stats.pipelineSwitches;
+   mTotalBindGroupSets += stats.bindGroupSets;
+   mTotalBufferWriteBytes += stats.bufferWriteBytes;
+   mTotalTextureWriteBytes += stats.textureWriteBytes;
+   mTotalCommandBuffers += stats.commandBuffersSubmitted;
+   mMaxDrawCalls = std::max(mMaxDrawCalls, stats.drawCalls);
+   mMaxPipelineSwitches = std::max(mMaxPipelineSwitches, stats.pipelineSwitches);
+}
+
+static float percentileSorted(const std::vector<float>& sorted, float pct)
+{
+   if (sorted.empty())
+      return 0.0f;
+   
+   // Nearest rank
+   size_t rank = (size_t)ceilf(pct * (float)sorted.size());
+   rank = std::clamp<size_t>(rank, 1, sorted.size());
+   return sorted[rank-1];
+}
+
+void BenchRecorder::summarize(std::vector<float> values, Summary& outSummary)
+{
+   outSummary = {};
+   if (values.empty())
+      return;
+   
+   std::sort(values.begin(), values.end());
+   
+   double sum = 0.0;
+   for (float v : values)
+      sum += v;
+   
+   outSummary.minMS = values.front();
+   outSummary.maxMS = values.back();
+   outSummary.meanMS = (float)(sum / (double)values.size());
+   outSummary.p50MS = percentileSorted(values, 0.50f);
+   outSummary.p90MS = percentileSorted(values, 0.90f);
+   outSummary.p95MS = percentileSorted(values, 0.95f);
+   outSummary.p99MS = percentileSorted(values, 0.99f);
+}
+
+void BenchRecorder::printSummary() const
+{
+   Summary cpu, gpu;
+   summarize(mCPUFrameMS, cpu);
+   summarize(mGPUFrameMS, gpu);
+   
+   size_t numFrames = std::max<size_t>(mCPUFrameMS.size(), 1);
+   
+   MemCategoryStats cpuMem, gpuMem;
+   MemTracker::getTotals(cpuMem, gpuMem);
+   
+   printf("Bench: %u frames%s\n", (uint32_t)mCPUFrameMS.size(), mFallbackAdapter ? " (fallback adapter)" : "");
+   printf("  CPU ms: mean %.3f p50 %.3f p90 %.3f p95 %.3f p99 %.3f max %.3f\n", cpu.meanMS, cpu.p50MS, cpu.p90MS, cpu.p95MS, cpu.p99MS, cpu.maxMS);
+   printf("  %s: mean %.3f p50 %.3f p90 %.3f p95 %.3f p99 %.3f max %.3f\n", mGPUTimestamps ? "GPU ms" : "GPU latency ms",
+          gpu.meanMS, gpu.p50MS, gpu.p90MS, gpu.p95MS, gpu.p99MS, gpu.maxMS);
+   printf("  Draws/frame: %.1f (max %u), pipeline switches/frame: %.1f\n", (double)mTotalDrawCalls / numFrames, mMaxDrawCalls, (double)mTotalPipelineSwitches / numFrames);
+   printf("  Peak memory: CPU %.2f MB, GPU %.2f MB\n", (double)cpuMem.peakBytes / (1024.0*1024.0), (double)gpuMem.peakBytes / (1024.0*1024.0));
+}
+
+static void writeSummaryJSON(FILE* fp, const char* name, const BenchRecorder::Summary& summary)
+{
+   fprintf(fp, "  \"%s\": {\"min\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+           name, summary.minMS, summary.meanMS, summary.p50MS, summary.p90MS, summary.p95MS, summary.p99MS, summary.maxMS);
+}
+
+bool BenchRecorder::writeReport(const char* filename, const char* resourceName, float dt, bool headless) const
+{
+   FILE* fp = fopen(filename, "wb");
+   if (fp == NULL)
+   {
+      printf("Couldn't open %s for writing\n", filename);
+      return false;
+   }
+   
+   Summary cpu, gpu;
+   summarize(mCPUFrameMS, cpu);
+   summarize(mGPUFrameMS, gpu);
+   
+   double numFrames = (double)std::max<size_t>(mCPUFrameMS.size(), 1);
+   
+   MemCategoryStats cpuMem, gpuMem;
+   MemTracker::getTotals(cpuMem, gpuMem);
+   
+   std::string escapedName;
+   for (const char* c = resourceName; *c; c++)
+   {
+      if (*c == '"' || *c == '\\')
+         escapedName += '\\';
+      escapedName += *c;
+   }
+   
+   fprintf(fp, "{\n");
+   fprintf(fp, "  \"resource\": \"%s\",\n", escapedName.c_str());
+   fprintf(fp, "  \"headless\": %s,\n", headless ? "true" : "false");
+   fprintf(fp, "  \"fallback_adapter\": %s,\n", mFallbackAdapter ? "true" : "false");
+   fprintf(fp, "  \"frames\": %u,\n", (uint32_t)mCPUFrameMS.size());
+   fprintf(fp, "  \"dt\": %.6f,\n", dt);
+   writeSummaryJSON(fp, "cpu_ms", cpu);
+   writeSummaryJSON(fp, mGPUTimestamps ? "gpu_ms" : "gpu_latency_ms", gpu);
+   fprintf(fp, "  \"draw_stats\": {\"draw_calls_mean\": %.2f, \"draw_calls_max\": %u, \"pipeline_switches_mean\": %.2f, \"pipeline_switches_max\": %u, \"bind_group_sets_mean\": %.2f, \"buffer_write_bytes_mean\": %.1f, \"texture_write_bytes_mean\": %.1f, \"command_buffers_mean\": %.2f},\n",
+           mTotalDrawCalls / numFrames, mMaxDrawCalls,
+           mTotalPipelineSwitches / numFrames, mMaxPipelineSwitches,
+           mTotalBindGroupSets / numFrames,
+           mTotalBufferWriteBytes / numFrames,
+           mTotalTextureWriteBytes / numFrames,
+           mTotalCommandBuffers / numFrames);
+   fprintf(fp, "  \"memory\": {\"cpu_peak_bytes\": %lld, \"gpu_peak_bytes\": %lld, \"cpu_live_bytes\": %lld, \"gpu_live_bytes\": %lld}\n",
+           (long long)cpuMem.peakBytes, (long long)gpuMem.peakBytes,
+           (long long)cpuMem.liveBytes, (long long)gpuMem.liveBytes);
+   fprintf(fp, "}\n");
+   
+   fclose(fp);
+   return true;
+}
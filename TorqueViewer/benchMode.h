@@ -0,0 +1,120 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _BENCHMODE_H_
+#define _BENCHMODE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <slm/slmath.h>
+
+struct GFXFrameStats;
+
+// Keyframed camera path used by -bench.
+//
+// File format is plain text, one key per line:
+//    time posX posY posZ rotX rotY rotZ
+// where time is in seconds and rot is mCamRot (degrees). Lines starting
+// with '#' are ignored. Keys are linearly interpolated.
+class BenchCameraPath
+{
+public:
+   struct Key
+   {
+      float time;
+      slm::vec3 pos;
+      slm::vec3 rot;
+   };
+   
+   std::vector<Key> mKeys;
+   
+   bool load(const char* filename);
+   
+   float getDuration() const { return mKeys.empty() ? 0.0f : mKeys.back().time; }
+   
+   // Evaluates the path at time t; wraps if t is past the end
+   void evaluate(float t, slm::vec3& outPos, slm::vec3& outRot) const;
+};
+
+// Collects per-frame timings and submission stats and writes the report
+class BenchRecorder
+{
+public:
+   struct Summary
+   {
+      float minMS;
+      float meanMS;
+      float p50MS;
+      float p90MS;
+      float p95MS;
+      float p99MS;
+      float maxMS;
+   };
+   
+   std::vector<float> mCPUFrameMS;
+   std::vector<float> mGPUFrameMS;
+   bool mGPUTimestamps;   // mGPUFrameMS is GPU pass time rather than submit to done latency
+   bool mFallbackAdapter; // ran on a software adapter
+   
+   uint64_t mTotalDrawCalls;
+   uint64_t mTotalPipelineSwitches;
+   uint64_t mTotalBindGroupSets;
+   uint64_t mTotalBufferWriteBytes;
+   uint64_t mTotalTextureWriteBytes;
+   uint64_t mTotalCommandBuffers;
+   uint32_t mMaxDrawCalls;
+   uint32_t mMaxPipelineSwitches;
+   
+   BenchRecorder();
+   
+   void addFrame(float cpuMS, float gpuMS, const GFXFrameStats& stats);
+   
+   static void summarize(std::vector<float> values, Summary& outSummary);
+   
+   void printSummary() const;
+   bool writeReport(const char* filename, const char* resourceName, float dt, bool headless) const;
+};
+
+// State for a -bench run
+struct BenchRun
+{
+   BenchCameraPath mPath;
+   BenchRecorder mRecorder;
+   
+   std::string mPathFile;
+   std::string mReportFile;
+   std::string mResourceName;
+   
+   float mDT;
+   uint32_t mNumFrames;
+   uint32_t mNumWarmupFrames;
+   uint32_t mFrameIdx;
+   
+   BenchRun() : mDT(1.0f / 60.0f), mNumFrames(600), mNumWarmupFrames(30), mFrameIdx(0) {;}
+   
+   inline bool isWarmup() const { return mFrameIdx < mNumWarmupFrames; }
+   inline bool isFinished() const { return mFrameIdx >= mNumWarmupFrames + mNumFrames; }
+   inline float getTime() const { return (float)mFrameIdx * mDT; }
+};
+
+#endif
@@ -0,0 +1,720 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "deflateIndex.h"
+#include "memTracker.h"
+
+static const uint16_t sLengthBase[29] = {
+   3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+   35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t sLengthExtra[29] = {
+   0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+   3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t sDistBase[30] = {
+   1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+   257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t sDistExtra[30] = {
+   0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+   7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const uint8_t sCodeLengthOrder[19] = {
+   16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+bool DeflateDecoder::Huffman::build(const uint8_t* lengths, uint32_t numCodes)
+{
+   memset(count, 0, sizeof(count));
+   memset(fast, 0, sizeof(fast));
+   for (uint32_t i=0; i<numCodes; i++)
+      count[lengths[i]]++;
+   count[0] = 0;
+   
+   // Incomplete codes are allowed (a lone distance code is common), but
+   // over-subscribed ones aren't
+   int32_t left = 1;
+   for (uint32_t len=1; len<=MaxBits; len++)
+   {
+      left = (left << 1) - count[len];
+      if (left < 0)
+         return false;
+   }
+   
+   uint16_t offsets[MaxBits+2];
+   offsets[1] = 0;
+   for (uint32_t len=1; len<=MaxBits; len++)
+      offsets[len+1] = offsets[len] + count[len];
+   
+   for (uint32_t i=0; i<numCodes; i++)
+   {
+      if (lengths[i] != 0)
+         symbol[offsets[lengths[i]]++] = (uint16_t)i;
+   }
+   
+   // Codes are stored msb first, so the table is indexed by the reversed code
+   uint32_t code = 0;
+   uint32_t index = 0;
+   for (uint32_t len=1; len<=FastBits; len++)
+   {
+      for (uint32_t i=0; i<count[len]; i++)
+      {
+         uint32_t rev = 0;
+         for (uint32_t b=0; b<len; b++)
+            rev |= ((code >> b) & 1) << (len - 1 - b);
+         
+         uint16_t entry = (uint16_t)((symbol[index + i] << 4) | len);
+         for (uint32_t j=rev; j<(1<<FastBits); j += (1 << len))
+            fast[j] = entry;
+         code++;
+      }
+      index += count[len];
+      code <<= 1;
+   }
+   
+   return true;
+}
+
+void DeflateDecoder::refill()
+{
+   if (mInPos + 8 <= mInSize)
+   {
+      // Bits above mBitCount are either 0 or the same input bits, so OR-ing
+      // a whole word in is safe
+      uint64_t word;
+      memcpy(&word, mIn + mInPos, 8);
+      mBitBuf |= word << mBitCount;
+      mInPos += (63 - mBitCount) >> 3;
+      mBitCount |= 56;
+   }
+   else
+   {
+      // Past the end feeds zeros; isOverrun catches anything that uses them
+      while (mBitCount < 56)
+      {
+         uint64_t value = mInPos < mInSize ? mIn[mInPos] : 0;
+         mBitBuf |= value << mBitCount;
+         mInPos++;
+         mBitCount += 8;
+      }
+   }
+}
+
+int32_t DeflateDecoder::decodeSymbol(const Huffman& h)
+{
+   uint32_t entry = h.fast[mBitBuf & ((1 << FastBits) - 1)];
+   if (entry != 0)
+   {
+      getBits(entry & 0xF);
+      return entry >> 4;
+   }
+   
+   // Long codes walk the canonical code one bit at a time
+   int32_t code = 0;
+   int32_t first = 0;
+   int32_t index = 0;
+   for (uint32_t len=1; len<=MaxBits; len++)
+   {
+      code |= (int32_t)((mBitBuf >> (len - 1)) & 1);
+      int32_t count = h.count[len];
+      if (code - count < first)
+      {
+         getBits(len);
+         return h.symbol[index + (code - first)];
+      }
+      index += count;
+      first = (first + count) << 1;
+      code <<= 1;
+   }
+   
+   return -1;
+}
+
+DeflateDecoder::Status DeflateDecoder::decodeStored()
+{
+   // Drop to the next byte boundary, then hand the buffered bytes back
+   getBits(mBitCount & 7);
+   mInPos -= mBitCount >> 3;
+   mBitBuf = 0;
+   mBitCount = 0;
+   
+   if (mInPos + 4 > mInSize)
+      return NeedInput;
+   
+   uint32_t len = mIn[mInPos] | (mIn[mInPos+1] << 8);
+   uint32_t nlen = mIn[mInPos+2] | (mIn[mInPos+3] << 8);
+   if (len != (~nlen & 0xFFFF))
+      return Error;
+   mInPos += 4;
+   
+   size_t copySize = std::min<size_t>(len, mOutEnd - mOutPos);
+   if (mInPos + copySize > mInSize)
+      return NeedInput;
+   
+   memcpy(mOut + mOutPos, mIn + mInPos, copySize);
+   mOutPos += copySize;
+   mInPos += copySize;
+   
+   return mOutPos >= mOutEnd ? Stopped : Done;
+}
+
+DeflateDecoder::Status DeflateDecoder::decodeCodes(const Huffman& lit, const Huffman& dist)
+{
+   for (;;)
+   {
+      refill();
+      int32_t sym = decodeSymbol(lit);
+      if (isOverrun())
+         return NeedInput;
+      
+      if (sym < 256)
+      {
+         if (sym < 0)
+            return Error;
+         
+         mOut[mOutPos++] = (uint8_t)sym;
+         if (mOutPos >= mOutEnd)
+            return Stopped;
+      }
+      else if (sym == 256)
+      {
+         return Done;
+      }
+      else
+      {
+         sym -= 257;
+         if (sym >= 29)
+            return Error;
+         
+         size_t len = sLengthBase[sym] + getBits(sLengthExtra[sym]);
+         int32_t distSym = decodeSymbol(dist);
+         if (isOverrun())
+            return NeedInput;
+         if (distSym < 0 || distSym >= 30)
+            return Error;
+         
+         size_t distance = sDistBase[distSym] + getBits(sDistExtra[distSym]);
+         if (isOverrun())
+            return NeedInput;
+         if (distance > mOutPos)
+            return Error;
+         
+         len = std::min<size_t>(len, mOutEnd - mOutPos);
+         uint8_t* dest = mOut + mOutPos;
+         const uint8_t* src = dest - distance;
+         if (distance >= len)
+         {
+            memcpy(dest, src, len);
+         }
+         else if (distance == 1)
+         {
+            memset(dest, *src, len);
+         }
+         else
+         {
+            for (size_t i=0; i<len; i++)
+               dest[i] = src[i];
+         }
+         
+         mOutPos += len;
+         if (mOutPos >= mOutEnd)
+            return Stopped;
+      }
+   }
+}
+
+DeflateDecoder::Status DeflateDecoder::buildFixed()
+{
+   if (mHaveFixed)
+      return Done;
+   
+   uint8_t lengths[MaxLitCodes];
+   memset(lengths, 8, 144);
+   memset(lengths + 144, 9, 256 - 144);
+   memset(lengths + 256, 7, 280 - 256);
+   memset(lengths + 280, 8, MaxLitCodes - 280);
+   mFixedLit.build(lengths, MaxLitCodes);
+   
+   memset(lengths, 5, 30);
+   mFixedDist.build(lengths, 30);
+   
+   mHaveFixed = true;
+   return Done;
+}
+
+DeflateDecoder::Status DeflateDecoder::buildDynamic()
+{
+   refill();
+   uint32_t numLit = getBits(5) + 257;
+   uint32_t numDist = getBits(5) + 1;
+   uint32_t numCodeLengths = getBits(4) + 4;
+   if (numLit > 286 || numDist > 30)
+      return isOverrun() ? NeedInput : Error;
+   
+   uint8_t lengths[MaxLitCodes + MaxDistCodes];
+   memset(lengths, 0, sizeof(lengths));
+   
+   for (uint32_t i=0; i<numCodeLengths; i++)
+   {
+      refill();
+      lengths[sCodeLengthOrder[i]] = (uint8_t)getBits(3);
+   }
+   
+   // mLit holds the code length code until the real tables are read
+   if (!mLit.build(lengths, 19))
+      return isOverrun() ? NeedInput : Error;
+   
+   memset(lengths, 0, sizeof(lengths));
+   uint32_t numLengths = numLit + numDist;
+   uint32_t index = 0;
+   while (index < numLengths)
+   {
+      refill();
+      int32_t sym = decodeSymbol(mLit);
+      if (isOverrun())
+         return NeedInput;
+      if (sym < 0)
+         return Error;
+      
+      if (sym < 16)
+      {
+         lengths[index++] = (uint8_t)sym;
+         continue;
+      }
+      
+      uint8_t value = 0;
+      uint32_t repeat = 0;
+      if (sym == 16)
+      {
+         if (index == 0)
+            return Error;
+         value = lengths[index-1];
+         repeat = 3 + getBits(2);
+      }
+      else if (sym == 17)
+      {
+         repeat = 3 + getBits(3);
+      }
+      else
+      {
+         repeat = 11 + getBits(7);
+      }
+      
+      if (index + repeat > numLengths)
+         return Error;
+      memset(lengths + index, value, repeat);
+      index += repeat;
+   }
+   
+   if (lengths[256] == 0)
+      return Error;
+   
+   if (!mLit.build(lengths, numLit) || !mDist.build(lengths + numLit, numDist))
+      return Error;
+   
+   return Done;
+}
+
+DeflateDecoder::DeflateDecoder() : mHaveFixed(false)
+{
+}
+
+DeflateDecoder::Status DeflateDecoder::decode(const uint8_t* in, size_t inSize, uint32_t startBit,
+                                              uint8_t* out, size_t outPos, size_t outEnd,
+                                              const BlockFunc& onBlock)
+{
+   mIn = in;
+   mInSize = inSize;
+   mInPos = 0;
+   mBitBuf = 0;
+   mBitCount = 0;
+   mOut = out;
+   mOutPos = outPos;
+   mOutEnd = outEnd;
+   
+   if (mOutPos >= mOutEnd)
+      return Stopped;
+   
+   refill();
+   getBits(startBit & 7);
+   
+   for (;;)
+   {
+      if (onBlock)
+         onBlock(getBitPos(), mOutPos);
+      
+      refill();
+      uint32_t final = getBits(1);
+      uint32_t type = getBits(2);
+      if (isOverrun())
+         return NeedInput;
+      
+      Status status = Error;
+      switch (type)
+      {
+         case 0:
+            status = decodeStored();
+            break;
+         case 1:
+            status = buildFixed();
+            if (status == Done)
+               status = decodeCodes(mFixedLit, mFixedDist);
+            break;
+         case 2:
+            status = buildDynamic();
+            if (status == Done)
+               status = decodeCodes(mLit, mDist);
+            break;
+         default:
+            break;
+      }
+      
+      if (status != Done)
+         return status;
+      if (final)
+         return Done;
+   }
+}
+
+//
+
+DeflateIndex::DeflateIndex(uint64_t compressedSize, uint64_t uncompressedSize, uint64_t spacing) :
+mCompressedSize(compressedSize),
+mUncompressedSize(uncompressedSize),
+mSpacing(std::max<uint64_t>(spacing, WindowSize)),
+mComplete(false)
+{
+   mStats = {};
+   
+   Checkpoint start = {};
+   mCheckpoints.push_back(start);
+}
+
+DeflateIndex::~DeflateIndex()
+{
+   MemTracker::trackFree(MemCategory_VolumeDirectory, getMemoryUsage());
+}
+
+void DeflateIndex::addCheckpoint(uint64_t outOffset, uint64_t inBitOffset, const uint8_t* window, uint32_t windowSize)
+{
+   std::unique_ptr<uint8_t[]> data(new uint8_t[windowSize]);
+   memcpy(data.get(), window, windowSize);
+   
+   Checkpoint point = {};
+   point.outOffset = outOffset;
+   point.inBitOffset = inBitOffset;
+   point.window = data.get();
+   point.windowSize = windowSize;
+   mCheckpoints.push_back(point);
+   mWindows.push_back(std::move(data));
+   
+   MemTracker::trackAlloc(MemCategory_VolumeDirectory, windowSize);
+}
+
+void DeflateIndex::plan(uint64_t offset, uint64_t size, ReadPlan& outPlan)
+{
+   std::lock_guard<std::mutex> lock(mLock);
+   
+   auto itr = std::upper_bound(mCheckpoints.begin(), mCheckpoints.end(), offset, [](uint64_t value, const Checkpoint& point){
+      return value < point.outOffset;
+   });
+   itr--;
+   
+   outPlan.start = *itr;
+   outPlan.inStart = itr->inBitOffset / 8;
+   
+   uint64_t end = offset + size;
+   uint64_t inEnd = 0;
+   if ((itr+1) != mCheckpoints.end() && (itr+1)->outOffset >= end)
+   {
+      // Decoding stops before the next checkpoint's block starts
+      inEnd = ((itr+1)->inBitOffset + 7) / 8;
+   }
+   else
+   {
+      // Not indexed that far yet; guess from the overall ratio and widen later if needed
+      double ratio = mUncompressedSize > 0 ? (double)mCompressedSize / (double)mUncompressedSize : 1.0;
+      inEnd = outPlan.inStart + (uint64_t)((double)(end - itr->outOffset) * ratio * 1.25) + 4096;
+   }
+   
+   inEnd = std::min(inEnd, mCompressedSize);
+   outPlan.inSize = inEnd - outPlan.inStart;
+}
+
+bool DeflateIndex::widen(ReadPlan& inOutPlan)
+{
+   if (inOutPlan.inStart + inOutPlan.inSize >= mCompressedSize)
+      return false;
+   
+   inOutPlan.inSize = mCompressedSize - inOutPlan.inStart;
+   
+   std::lock_guard<std::mutex> lock(mLock);
+   mStats.numRetries++;
+   return true;
+}
+
+DeflateDecoder::Status DeflateIndex::read(const ReadPlan& plan, const uint8_t* in, uint64_t offset, uint64_t size, uint8_t* dest)
+{
+   const Checkpoint& start = plan.start;
+   if (offset < start.outOffset || offset + size > mUncompressedSize)
+      return DeflateDecoder::Error;
+   
+   uint64_t nextOut = 0;
+   {
+      std::lock_guard<std::mutex> lock(mLock);
+      nextOut = mCheckpoints.back().outOffset + mSpacing;
+   }
+   
+   // Output goes straight to dest when reading from the start, otherwise
+   // into a scratch buffer which begins with the checkpoint's window
+   uint64_t skip = offset - start.outOffset;
+   size_t bufferStart = start.windowSize;
+   size_t bufferEnd = bufferStart + skip + size;
+   
+   std::vector<uint8_t> scratch;
+   uint8_t* buffer = dest;
+   if (skip != 0 || start.windowSize != 0)
+   {
+      scratch.resize(bufferEnd);
+      if (start.windowSize)
+         memcpy(scratch.data(), start.window, start.windowSize);
+      buffer = scratch.data();
+   }
+   
+   struct Found
+   {
+      uint64_t outOffset;
+      uint64_t inBitOffset;
+      size_t bufferPos;
+   };
+   
+   std::vector<Found> found;
+   uint64_t inBitBase = plan.inStart * 8;
+   uint64_t uncompressedSize = mUncompressedSize;
+   
+   DeflateDecoder decoder;
+   DeflateDecoder::Status status = decoder.decode(in, plan.inSize, (uint32_t)(start.inBitOffset - inBitBase),
+                                                  buffer, bufferStart, bufferEnd,
+                                                  [&](uint64_t inBit, size_t outPos){
+      uint64_t outOffset = start.outOffset + (outPos - bufferStart);
+      if (outOffset >= nextOut && outOffset < uncompressedSize)
+      {
+         Found point = { outOffset, inBitBase + inBit, outPos };
+         found.push_back(point);
+         nextOut = outOffset + mSpacing;
+      }
+   });
+   
+   uint64_t produced = decoder.getOutPos() - bufferStart;
+   bool ok = (status == DeflateDecoder::Done || status == DeflateDecoder::Stopped) && decoder.getOutPos() == bufferEnd;
+   
+   {
+      std::lock_guard<std::mutex> lock(mLock);
+      mStats.numReads++;
+      mStats.compressedRead += plan.inSize;
+      mStats.inflated += produced;
+      
+      // Blocks found before running out of input may be garbage, so only
+      // successful reads add checkpoints
+      if (ok)
+      {
+         for (const Found& point : found)
+         {
+            if (point.outOffset < mCheckpoints.back().outOffset + mSpacing)
+               continue;
+            
+            uint32_t windowSize = (uint32_t)std::min<size_t>(point.bufferPos, WindowSize);
+            addCheckpoint(point.outOffset, point.inBitOffset, buffer + point.bufferPos - windowSize, windowSize);
+         }
+         
+         if (start.outOffset + produced >= mUncompressedSize)
+            mComplete = true;
+      }
+   }
+   
+   if (!ok)
+      return status == DeflateDecoder::NeedInput ? DeflateDecoder::NeedInput : DeflateDecoder::Error;
+   
+   if (buffer != dest)
+      memcpy(dest, buffer + bufferStart + skip, size);
+   
+   return DeflateDecoder::Done;
+}
+
+bool DeflateIndex::isComplete()
+{
+   std::lock_guard<std::mutex> lock(mLock);
+   return mComplete;
+}
+
+uint32_t DeflateIndex::getNumCheckpoints()
+{
+   std::lock_guard<std::mutex> lock(mLock);
+   return (uint32_t)mCheckpoints.size();
+}
+
+void DeflateIndex::getStats(Stats& outStats)
+{
+   std::lock_guard<std::mutex> lock(mLock);
+   outStats = mStats;
+}
+
+uint64_t DeflateIndex::getMemoryUsage()
+{
+   uint64_t bytes = 0;
+   for (const Checkpoint& point : mCheckpoints)
+      bytes += point.windowSize;
+   return bytes;
+}
+
+bool DeflateIndex::readCache(const char* filename, uint64_t key)
+{
+   FILE* fp = fopen(filename, "rb");
+   if (fp == NULL)
+      return false;
+   
+   CacheHeader header = {};
+   bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+             header.magic == CacheMagic &&
+             header.version == CacheVersion &&
+             header.key == key &&
+             header.compressedSize == mCompressedSize &&
+             header.uncompressedSize == mUncompressedSize &&
+             header.spacing == mSpacing &&
+             header.numCheckpoints > 0;
+   
+   // Checkpoints are at least mSpacing apart; don't trust the file's count beyond that
+   uint64_t maxCheckpoints = (mUncompressedSize / mSpacing) + 1;
+   ok = ok && header.numCheckpoints <= maxCheckpoints;
+   
+   std::vector<CacheCheckpoint> points;
+   if (ok)
+   {
+      points.resize(header.numCheckpoints);
+      ok = fread(points.data(), sizeof(CacheCheckpoint), points.size(), fp) == points.size();
+   }
+   
+   // The first checkpoint is always the start of the stream
+   ok = ok && points[0].outOffset == 0 && points[0].inBitOffset == 0 && points[0].windowSize == 0;
+   for (uint32_t i=1; ok && i<points.size(); i++)
+   {
+      const CacheCheckpoint& point = points[i];
+      ok = point.outOffset > points[i-1].outOffset &&
+           point.outOffset < mUncompressedSize &&
+           point.inBitOffset > points[i-1].inBitOffset &&
+           point.inBitOffset < mCompressedSize * 8 &&
+           point.windowSize == std::min<uint64_t>(point.outOffset, WindowSize);
+   }
+   
+   std::vector<std::unique_ptr<uint8_t[]>> windows;
+   for (uint32_t i=1; ok && i<points.size(); i++)
+   {
+      std::unique_ptr<uint8_t[]> data(new uint8_t[points[i].windowSize]);
+      ok = fread(data.get(), 1, points[i].windowSize, fp) == points[i].windowSize;
+      windows.push_back(std::move(data));
+   }
+   
+   fclose(fp);
+   
+   std::lock_guard<std::mutex> lock(mLock);
+   if (!ok)
+   {
+      mStats.numRejectedCaches++;
+      return false;
+   }
+   
+   MemTracker::trackFree(MemCategory_VolumeDirectory, getMemoryUsage());
+   
+   mCheckpoints.resize(1);
+   mWindows = std::move(windows);
+   for (uint32_t i=1; i<points.size(); i++)
+   {
+      Checkpoint point = {};
+      point.outOffset = points[i].outOffset;
+      point.inBitOffset = points[i].inBitOffset;
+      point.window = mWindows[i-1].get();
+      point.windowSize = points[i].windowSize;
+      mCheckpoints.push_back(point);
+   }
+   mComplete = header.complete != 0;
+   
+   MemTracker::trackAlloc(MemCategory_VolumeDirectory, getMemoryUsage());
+   return true;
+}
+
+bool DeflateIndex::writeCache(const char* filename, uint64_t key)
+{
+   std::lock_guard<std::mutex> lock(mLock);
+   
+   CacheHeader header = {};
+   header.magic = CacheMagic;
+   header.version = CacheVersion;
+   header.key = key;
+   header.compressedSize = mCompressedSize;
+   header.uncompressedSize = mUncompressedSize;
+   header.spacing = mSpacing;
+   header.numCheckpoints = (uint32_t)mCheckpoints.size();
+   header.complete = mComplete ? 1 : 0;
+   
+   // Write to a temp file first so a partial write never looks valid
+   std::string tempName = std::string(filename) + ".tmp";
+   FILE* fp = fopen(tempName.c_str(), "wb");
+   if (fp == NULL)
+   {
+      printf("DeflateIndex: couldn't write %s\n", tempName.c_str());
+      return false;
+   }
+   
+   bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+   for (const Checkpoint& point : mCheckpoints)
+   {
+      CacheCheckpoint data = {};
+      data.outOffset = point.outOffset;
+      data.inBitOffset = point.inBitOffset;
+      data.windowSize = point.windowSize;
+      ok = ok && fwrite(&data, sizeof(data), 1, fp) == 1;
+   }
+   for (const Checkpoint& point : mCheckpoints)
+   {
+      if (point.windowSize > 0)
+         ok = ok && fwrite(point.window, 1, point.windowSize, fp) == point.windowSize;
+   }
+   ok = (fclose(fp) == 0) && ok;
+   
+   if (ok)
+   {
+      remove(filename);
+      ok = rename(tempName.c_str(), filename) == 0;
+   }
+   
+   if (!ok)
+   {
+      printf("DeflateIndex: couldn't write %s\n", filename);
+      remove(tempName.c_str());
+   }
+   
+   return ok;
+}
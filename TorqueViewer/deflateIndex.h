@@ -0,0 +1,239 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _DEFLATEINDEX_H_
+#define _DEFLATEINDEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+/*
+ Raw deflate (RFC 1951) decoder. Unlike stbi_zlib_decode_noheader_buffer this can
+ start at any block boundary given the preceding 32KB of output, stops as soon as
+ it has produced the requested amount, and reports where each block starts so
+ DeflateIndex can record resume points.
+ 
+ The output buffer doubles as the history window; any bytes before outPos are
+ treated as previously decoded data.
+ */
+class DeflateDecoder
+{
+public:
+   
+   enum Status
+   {
+      Done,      // Reached the end of the final block
+      Stopped,   // Output buffer filled
+      NeedInput, // Ran off the end of the input
+      Error      // Corrupt stream
+   };
+   
+   // Called at the start of each block with the bit offset in the input and
+   // the current output position.
+   typedef std::function<void(uint64_t inBit, size_t outPos)> BlockFunc;
+   
+   DeflateDecoder();
+   
+   // Decodes in (starting at bit startBit) into out[outPos..outEnd).
+   Status decode(const uint8_t* in, size_t inSize, uint32_t startBit,
+                 uint8_t* out, size_t outPos, size_t outEnd,
+                 const BlockFunc& onBlock=BlockFunc());
+   
+   inline size_t getOutPos() const { return mOutPos; }
+   
+protected:
+   
+   enum
+   {
+      FastBits = 10,
+      MaxBits = 15,
+      MaxLitCodes = 288,
+      MaxDistCodes = 32
+   };
+   
+   struct Huffman
+   {
+      uint16_t fast[1<<FastBits]; // (symbol << 4) | length; 0 falls back to the slow path
+      uint16_t count[MaxBits+1];
+      uint16_t symbol[MaxLitCodes];
+      
+      bool build(const uint8_t* lengths, uint32_t numCodes);
+   };
+   
+   const uint8_t* mIn;
+   size_t mInSize;
+   size_t mInPos;
+   uint64_t mBitBuf;
+   uint32_t mBitCount;
+   
+   uint8_t* mOut;
+   size_t mOutPos;
+   size_t mOutEnd;
+   
+   Huffman mLit;
+   Huffman mDist;
+   Huffman mFixedLit;
+   Huffman mFixedDist;
+   bool mHaveFixed;
+   
+   void refill();
+   
+   inline uint32_t getBits(uint32_t n)
+   {
+      uint32_t value = (uint32_t)(mBitBuf & ((1ULL << n) - 1));
+      mBitBuf >>= n;
+      mBitCount -= n;
+      return value;
+   }
+   
+   // True once more bits have been consumed than the input holds
+   inline bool isOverrun() const
+   {
+      return (mInPos * 8) - mBitCount > mInSize * 8;
+   }
+   
+   inline uint64_t getBitPos() const
+   {
+      return (mInPos * 8) - mBitCount;
+   }
+   
+   int32_t decodeSymbol(const Huffman& h);
+   
+   Status decodeStored();
+   Status decodeCodes(const Huffman& lit, const Huffman& dist);
+   Status buildFixed();
+   Status buildDynamic();
+};
+
+/*
+ Random access into a deflated volume entry, in the style of zlib's zran.
+ Deflate can only be decoded from a block boundary with the previous 32KB of
+ output at hand, so reading from the middle of an entry normally means
+ inflating everything before it.
+ 
+ Instead whenever the entry is decoded, block boundaries at least mSpacing bytes
+ apart are recorded along with a copy of the window leading up to them. A later
+ read only needs to inflate from the nearest checkpoint before it, and only
+ needs the compressed bytes up to the checkpoint after it (or an estimate based
+ on the overall ratio if it hasn't been indexed that far yet).
+ 
+ Checkpoints are never removed once added so reads can run in parallel. The
+ index can be saved alongside the volume so later runs can skip building it.
+ */
+class DeflateIndex
+{
+public:
+   
+   enum
+   {
+      WindowSize = 32768,
+      DefaultSpacing = 1024 * 1024,
+      CacheMagic = 0x58494644, // DFIX
+      CacheVersion = 1
+   };
+   
+   struct Checkpoint
+   {
+      uint64_t outOffset;     // uncompressed offset of the block
+      uint64_t inBitOffset;   // compressed bit offset of the block header
+      const uint8_t* window;  // output preceding outOffset
+      uint32_t windowSize;
+   };
+   
+   // Compressed bytes needed for a read, relative to the start of the entry data
+   struct ReadPlan
+   {
+      Checkpoint start;
+      uint64_t inStart;
+      uint64_t inSize;
+   };
+   
+   struct Stats
+   {
+      uint32_t numReads;
+      uint32_t numRetries;      // reads which needed more input than planned
+      uint64_t compressedRead;  // bytes of compressed input handed to read
+      uint64_t inflated;        // bytes decoded, including skipped output
+      uint32_t numRejectedCaches; // cache files that were stale or invalid
+   };
+   
+   DeflateIndex(uint64_t compressedSize, uint64_t uncompressedSize, uint64_t spacing=DefaultSpacing);
+   ~DeflateIndex();
+   
+   // Works out which compressed bytes are needed to read [offset, offset+size)
+   void plan(uint64_t offset, uint64_t size, ReadPlan& outPlan);
+   
+   // Widens a plan to the rest of the entry after read returns NeedInput
+   bool widen(ReadPlan& inOutPlan);
+   
+   // Inflates [offset, offset+size) into dest. in holds the bytes described by plan.
+   DeflateDecoder::Status read(const ReadPlan& plan, const uint8_t* in, uint64_t offset, uint64_t size, uint8_t* dest);
+   
+   bool isComplete();
+   uint32_t getNumCheckpoints();
+   void getStats(Stats& outStats);
+   uint64_t getMemoryUsage();
+   
+   // Cached indices are only used if key, spacing and the entry sizes match
+   bool readCache(const char* filename, uint64_t key);
+   bool writeCache(const char* filename, uint64_t key);
+   
+protected:
+   
+   struct CacheHeader
+   {
+      uint32_t magic;
+      uint32_t version;
+      uint64_t key;
+      uint64_t compressedSize;
+      uint64_t uncompressedSize;
+      uint64_t spacing;
+      uint32_t numCheckpoints;
+      uint32_t complete;
+   };
+   
+   struct CacheCheckpoint
+   {
+      uint64_t outOffset;
+      uint64_t inBitOffset;
+      uint32_t windowSize;
+      uint32_t pad;
+   };
+   
+   std::mutex mLock;
+   std::vector<Checkpoint> mCheckpoints;
+   std::vector<std::unique_ptr<uint8_t[]>> mWindows;
+   uint64_t mCompressedSize;
+   uint64_t mUncompressedSize;
+   uint64_t mSpacing;
+   bool mComplete;
+   Stats mStats;
+   
+   void addCheckpoint(uint64_t outOffset, uint64_t inBitOffset, const uint8_t* window, uint32_t windowSize);
+};
+
+#endif
@@ -0,0 +1,378 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "CommonData.h"
+#include "interiorData.h"
+#include "interiorCulling.h"
+
+#include <float.h>
+#include <algorithm>
+
+namespace Dif
+{
+
+InteriorCuller::InteriorCuller() : mInterior(NULL), mSurfaceMark(0)
+{
+   mStats = {};
+   mEye = slm::vec3(0);
+}
+
+void InteriorCuller::setInterior(const InteriorResource* interior)
+{
+   mInterior = interior;
+   mDrawList.clear();
+   mSurfaceMark = 0;
+   mSurfaceMarks.assign(interior ? interior->mSurfaces.size() : 0, 0);
+   mZoneOnPath.assign(interior ? interior->mZones.size() : 0, 0);
+   mZoneVisible.assign(interior ? interior->mZones.size() : 0, 0);
+   mSurfaceSpheres.clear();
+   mStats = {};
+   mStats.cameraZone = -1;
+   
+   if (interior == NULL)
+      return;
+   
+   // Bounding sphere of each surface's winding
+   mSurfaceSpheres.resize(interior->mSurfaces.size());
+   for (uint32_t i=0; i<interior->mSurfaces.size(); i++)
+   {
+      const Surface& surface = interior->mSurfaces[i];
+      slm::vec3 minP(FLT_MAX);
+      slm::vec3 maxP(-FLT_MAX);
+      for (uint32_t j=0; j<surface.windingCount; j++)
+      {
+         uint32_t windingIdx = surface.windingStart + j;
+         if (windingIdx >= interior->mWindings.size() || interior->mWindings[windingIdx] >= interior->mPoints.size())
+            continue;
+         slm::vec3 pt = interior->mPoints[interior->mWindings[windingIdx]].toVec();
+         minP = slm::min(minP, pt);
+         maxP = slm::max(maxP, pt);
+      }
+      
+      // Surfaces without valid points are never culled by bounds
+      if (minP.x > maxP.x)
+      {
+         mSurfaceSpheres[i] = slm::vec4(0.0f, 0.0f, 0.0f, FLT_MAX);
+         continue;
+      }
+      
+      slm::vec3 center = (minP + maxP) * 0.5f;
+      mSurfaceSpheres[i] = slm::vec4(center, slm::length(maxP - center));
+   }
+}
+
+void InteriorCuller::extractFrustum(const slm::mat4& viewProj, Frustum& outFrustum)
+{
+   // Planes are combinations of the matrix rows (Gribb & Hartmann)
+   slm::vec4 rows[4];
+   for (int i=0; i<4; i++)
+      rows[i] = slm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+   
+   outFrustum.resize(6);
+   outFrustum[0] = rows[3] + rows[0]; // left
+   outFrustum[1] = rows[3] - rows[0]; // right
+   outFrustum[2] = rows[3] + rows[1]; // bottom
+   outFrustum[3] = rows[3] - rows[1]; // top
+   outFrustum[4] = rows[3] + rows[2]; // near (conservative for 0..1 depth)
+   outFrustum[5] = rows[3] - rows[2]; // far
+   
+   for (slm::vec4& plane : outFrustum)
+   {
+      float len = slm::length(plane.xyz());
+      if (len > 0.0f)
+         plane /= len;
+   }
+}
+
+void InteriorCuller::cull(const slm::vec3& eye, const slm::mat4& viewProj, bool usePortals, bool cullSurfaces)
+{
+   mDrawList.clear();
+   mVisibleSurfaces.clear();
+   mStats = {};
+   mStats.cameraZone = -1;
+   
+   if (mInterior == NULL)
+      return;
+   
+   if (++mSurfaceMark == 0)
+   {
+      // Wrapped; reset marks so stale entries can't match
+      std::fill(mSurfaceMarks.begin(), mSurfaceMarks.end(), 0);
+      mSurfaceMark = 1;
+   }
+   std::fill(mZoneVisible.begin(), mZoneVisible.end(), 0);
+   
+   mEye = eye;
+   int32_t zone = usePortals ? mInterior->findZone(eye) : -1;
+   mStats.cameraZone = zone;
+   
+   Frustum frustum;
+   extractFrustum(viewProj, frustum);
+   
+   if (zone < 0)
+      addAllSurfaces();
+   else
+      visitZone((uint32_t)zone, frustum, 0);
+   
+   if (cullSurfaces)
+      this->cullSurfaces(frustum);
+   
+   mStats.visibleSurfaces = (uint32_t)mVisibleSurfaces.size();
+   mStats.culledSurfaces = mInterior->mSurfaces.size() - mStats.visibleSurfaces;
+   
+   buildDrawList();
+}
+
+void InteriorCuller::visitZone(uint32_t zoneIdx, const Frustum& frustum, uint32_t depth)
+{
+   const InteriorResource& itr = *mInterior;
+   
+   if (!mZoneVisible[zoneIdx])
+   {
+      mZoneVisible[zoneIdx] = 1;
+      mStats.visibleZones++;
+      addZoneSurfaces(zoneIdx);
+   }
+   
+   if (depth >= MaxPortalDepth)
+      return;
+   
+   mZoneOnPath[zoneIdx] = 1;
+   
+   const Zone& zone = itr.mZones[zoneIdx];
+   for (uint32_t i=0; i<zone.portalCount; i++)
+   {
+      uint32_t portalListIdx = zone.portalStart + i;
+      if (portalListIdx >= itr.mZonePortalList.size())
+         break;
+      
+      uint32_t portalIdx = itr.mZonePortalList[portalListIdx];
+      if (portalIdx >= itr.mPortals.size())
+         continue;
+      
+      const Portal& portal = itr.mPortals[portalIdx];
+      uint32_t nextZone = portal.zoneFront == zoneIdx ? portal.zoneBack : portal.zoneFront;
+      if (nextZone >= itr.mZones.size() || mZoneOnPath[nextZone])
+         continue;
+      
+      // Camera sitting in the portal can see through all of it
+      float eyeDist = slm::dot(itr.getPlaneNormal(portal.planeIndex), mEye) + itr.getPlaneDist(portal.planeIndex);
+      if (fabsf(eyeDist) < 0.01f)
+      {
+         mStats.portalsTested++;
+         mStats.portalsPassed++;
+         visitZone(nextZone, frustum, depth+1);
+         continue;
+      }
+      
+      // Each fan is convex, so handle them individually
+      for (uint32_t j=0; j<portal.triFanCount; j++)
+      {
+         uint32_t fanIdx = portal.triFanStart + j;
+         if (fanIdx >= itr.mWindingIndices.size())
+            break;
+         
+         const WindingIndex& fan = itr.mWindingIndices[fanIdx];
+         if ((uint64_t)fan.windingStart + fan.windingCount > itr.mWindings.size())
+            continue;
+         
+         std::vector<slm::vec3>& poly = mClipScratch[0];
+         poly.clear();
+         for (uint32_t k=0; k<fan.windingCount; k++)
+         {
+            uint32_t pointIdx = itr.mWindings[fan.windingStart + k];
+            if (pointIdx < itr.mPoints.size())
+               poly.push_back(itr.mPoints[pointIdx].toVec());
+         }
+         
+         mStats.portalsTested++;
+         if (!clipPolygon(frustum, poly))
+            continue;
+         
+         // Narrow the frustum to the visible part of the portal
+         slm::vec3 center(0);
+         for (const slm::vec3& pt : poly)
+            center += pt;
+         center /= (float)poly.size();
+         
+         Frustum portalFrustum;
+         portalFrustum.reserve(poly.size() + 1);
+         for (size_t k=0; k<poly.size(); k++)
+         {
+            const slm::vec3& a = poly[k];
+            const slm::vec3& b = poly[(k+1) % poly.size()];
+            slm::vec3 normal = slm::cross(a - mEye, b - mEye);
+            float len = slm::length(normal);
+            if (len < 1e-6f)
+               continue;
+            
+            normal /= len;
+            slm::vec4 plane(normal, -slm::dot(normal, mEye));
+            if (slm::dot(plane.xyz(), center) + plane.w < 0.0f)
+               plane = -plane;
+            portalFrustum.push_back(plane);
+         }
+         
+         // Keep the far plane from the view
+         portalFrustum.push_back(frustum.back());
+         
+         mStats.portalsPassed++;
+         visitZone(nextZone, portalFrustum, depth+1);
+      }
+   }
+   
+   mZoneOnPath[zoneIdx] = 0;
+}
+
+bool InteriorCuller::clipPolygon(const Frustum& frustum, std::vector<slm::vec3>& poly)
+{
+   // NOTE: poly is mClipScratch[0], which is reused in recursive calls. Since the
+   // result is consumed before recursing that's fine.
+   std::vector<slm::vec3>& tmp = mClipScratch[1];
+   
+   for (const slm::vec4& plane : frustum)
+   {
+      if (poly.size() < 3)
+         return false;
+      
+      tmp.clear();
+      for (size_t i=0; i<poly.size(); i++)
+      {
+         const slm::vec3& a = poly[i];
+         const slm::vec3& b = poly[(i+1) % poly.size()];
+         float da = slm::dot(plane.xyz(), a) + plane.w;
+         float db = slm::dot(plane.xyz(), b) + plane.w;
+         
+         if (da >= 0.0f)
+            tmp.push_back(a);
+         if ((da >= 0.0f) != (db >= 0.0f))
+            tmp.push_back(a + (b - a) * (da / (da - db)));
+      }
+      
+      poly.swap(tmp);
+   }
+   
+   return poly.size() >= 3;
+}
+
+void InteriorCuller::addZoneSurfaces(uint32_t zoneIdx)
+{
+   const InteriorResource& itr = *mInterior;
+   const Zone& zone = itr.mZones[zoneIdx];
+   
+   for (uint32_t i=0; i<zone.surfaceCount; i++)
+   {
+      uint32_t listIdx = zone.surfaceStart + i;
+      if (listIdx >= itr.mZoneSurfaces.size())
+         break;
+      
+      uint32_t surfaceIdx = itr.mZoneSurfaces[listIdx];
+      if (surfaceIdx >= mSurfaceMarks.size() || mSurfaceMarks[surfaceIdx] == mSurfaceMark)
+         continue;
+      
+      mSurfaceMarks[surfaceIdx] = mSurfaceMark;
+      mVisibleSurfaces.push_back(surfaceIdx);
+   }
+}
+
+void InteriorCuller::addAllSurfaces()
+{
+   mVisibleSurfaces.resize(mInterior->mSurfaces.size());
+   for (uint32_t i=0; i<mVisibleSurfaces.size(); i++)
+      mVisibleSurfaces[i] = i;
+}
+
+void InteriorCuller::cullSurfaces(const Frustum& frustum)
+{
+   const InteriorResource& itr = *mInterior;
+   
+   uint32_t numKept = 0;
+   for (uint32_t surfaceIdx : mVisibleSurfaces)
+   {
+      const Surface& surface = itr.mSurfaces[surfaceIdx];
+      float eyeDist = slm::dot(itr.getPlaneNormal(surface.planeIndex), mEye) + itr.getPlaneDist(surface.planeIndex);
+      if (eyeDist < -0.01f)
+      {
+         mStats.backfaceSurfaces++;
+         continue;
+      }
+      
+      const slm::vec4& sphere = mSurfaceSpheres[surfaceIdx];
+      bool outside = false;
+      for (const slm::vec4& plane : frustum)
+      {
+         if (slm::dot(plane.xyz(), sphere.xyz()) + plane.w < -sphere.w)
+         {
+            outside = true;
+            break;
+         }
+      }
+      if (outside)
+      {
+         mStats.frustumSurfaces++;
+         continue;
+      }
+      
+      mVisibleSurfaces[numKept++] = surfaceIdx;
+   }
+   
+   mVisibleSurfaces.resize(numKept);
+}
+
+void InteriorCuller::buildDrawList()
+{
+   const std::vector<SurfaceRange>& ranges = mInterior->mSurfaceRanges;
+   
+   // Index ranges are already in batch order, so sorting by start
+   // lets neighbouring surfaces collapse into a single draw.
+   std::sort(mVisibleSurfaces.begin(), mVisibleSurfaces.end(), [&ranges](uint32_t a, uint32_t b){
+      return ranges[a].indexStart < ranges[b].indexStart;
+   });
+   
+   for (uint32_t surfaceIdx : mVisibleSurfaces)
+   {
+      const SurfaceRange& range = ranges[surfaceIdx];
+      if (range.indexCount == 0)
+         continue;
+      
+      if (!mDrawList.empty())
+      {
+         DrawRange& last = mDrawList.back();
+         if (last.batchIndex == range.batchIndex &&
+             last.indexStart + last.indexCount == range.indexStart)
+         {
+            last.indexCount += range.indexCount;
+            continue;
+         }
+      }
+      
+      DrawRange draw;
+      draw.batchIndex = range.batchIndex;
+      draw.indexStart = range.indexStart;
+      draw.indexCount = range.indexCount;
+      mDrawList.push_back(draw);
+   }
+   
+   mStats.drawRanges = (uint32_t)mDrawList.size();
+}
+
+}
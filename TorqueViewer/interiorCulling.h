@@ -0,0 +1,116 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _INTERIORCULLING_H_
+#define _INTERIORCULLING_H_
+
+#include <stdint.h>
+#include <vector>
+#include <slm/slmath.h>
+
+namespace Dif
+{
+
+class InteriorResource;
+
+// Contiguous run of indices which can be drawn with a single batch's resources
+struct DrawRange
+{
+   uint32_t batchIndex;
+   uint32_t indexStart;
+   uint32_t indexCount;
+};
+
+/*
+ Zone & portal visibility for interiors.
+ 
+ The zone containing the camera is found with a BSP point query. From there we
+ walk through each portal of the zone, clip the portal polygon against the
+ current frustum and, if anything is left, build a narrower frustum from the eye
+ through the clipped polygon to use in the neighbouring zone.
+ 
+ If the camera isn't in a zone (i.e. it's outside or in solid space) every surface is
+ a candidate.
+ 
+ Candidate surfaces can then be culled individually: surfaces are flat, so one
+ facing away from the eye (behind its plane) is skipped, as is one whose bounding
+ sphere is outside the view frustum.
+ */
+class InteriorCuller
+{
+public:
+   
+   enum
+   {
+      MaxPortalDepth = 32
+   };
+   
+   struct Stats
+   {
+      int32_t cameraZone;
+      uint32_t visibleZones;
+      uint32_t portalsTested;
+      uint32_t portalsPassed;
+      uint32_t visibleSurfaces;
+      uint32_t culledSurfaces;
+      uint32_t frustumSurfaces;  // culled by the surface frustum test
+      uint32_t backfaceSurfaces; // culled for facing away
+      uint32_t drawRanges;
+   };
+   
+   typedef std::vector<slm::vec4> Frustum; // planes, inside is dot(n,p)+d >= 0
+   
+   const InteriorResource* mInterior;
+   std::vector<DrawRange> mDrawList;
+   Stats mStats;
+   
+   InteriorCuller();
+   
+   void setInterior(const InteriorResource* interior);
+   
+   // eye and viewProj should be in interior space
+   void cull(const slm::vec3& eye, const slm::mat4& viewProj, bool usePortals=true, bool cullSurfaces=true);
+   
+   static void extractFrustum(const slm::mat4& viewProj, Frustum& outFrustum);
+   
+protected:
+   
+   slm::vec3 mEye;
+   uint32_t mSurfaceMark;
+   std::vector<uint32_t> mSurfaceMarks;
+   std::vector<uint8_t> mZoneOnPath;
+   std::vector<uint8_t> mZoneVisible;
+   std::vector<uint32_t> mVisibleSurfaces;
+   std::vector<slm::vec4> mSurfaceSpheres; // center, radius
+   std::vector<slm::vec3> mClipScratch[2];
+   
+   void visitZone(uint32_t zoneIdx, const Frustum& frustum, uint32_t depth);
+   void addZoneSurfaces(uint32_t zoneIdx);
+   void addAllSurfaces();
+   void cullSurfaces(const Frustum& frustum);
+   void buildDrawList();
+   bool clipPolygon(const Frustum& frustum, std::vector<slm::vec3>& poly);
+};
+
+}
+
+#endif
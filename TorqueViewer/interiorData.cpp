@@ -0,0 +1,606 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "CommonData.h"
+#include "interiorData.h"
+#include "lightmapAtlas.h"
+#include "memTracker.h"
+
+#include <algorithm>
+
+namespace Dif
+{
+
+// Points a view at the next count-prefixed array in the stream
+template<class T> static bool readView(MemRStream& s, ArrayView<T>& view)
+{
+   uint32_t count = 0;
+   if (!s.read(count))
+      return false;
+
+   uint64_t byteSize = (uint64_t)count * sizeof(T);
+   if (s.mPos + byteSize > s.mSize)
+      return false;
+
+   view.mPtr = (const T*)(s.mPtr + s.mPos);
+   view.mSize = count;
+   s.mPos += byteSize;
+   return true;
+}
+
+static inline uint32_t readBE32(const uint8_t* ptr)
+{
+   return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) | ((uint32_t)ptr[2] << 8) | (uint32_t)ptr[3];
+}
+
+// Walks the chunks of an embedded PNG so we know where it ends without decoding it
+static bool skipPNG(MemRStream& s, uint32_t& outSize)
+{
+   static const uint8_t sPNGSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+   uint64_t start = s.mPos;
+   if (start + 8 > s.mSize || memcmp(s.mPtr + start, sPNGSignature, 8) != 0)
+      return false;
+
+   uint64_t pos = start + 8;
+   while (pos + 12 <= s.mSize)
+   {
+      uint32_t chunkSize = readBE32(s.mPtr + pos);
+      const uint8_t* chunkType = s.mPtr + pos + 4;
+      pos += 12 + (uint64_t)chunkSize; // length + type + data + crc
+
+      if (pos > s.mSize)
+         return false;
+
+      if (memcmp(chunkType, "IEND", 4) == 0)
+      {
+         outSize = (uint32_t)(pos - start);
+         s.mPos = pos;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static size_t calcRenderDataSize(const InteriorResource& res)
+{
+   return (res.mRenderVerts.capacity() * sizeof(RenderVertex)) +
+          (res.mRenderTexVerts.capacity() * sizeof(RenderTexVertex)) +
+          (res.mRenderIndices.capacity() * sizeof(uint32_t)) +
+          (res.mRenderBatches.capacity() * sizeof(RenderBatch)) +
+          (res.mSurfaceRanges.capacity() * sizeof(SurfaceRange));
+}
+
+InteriorResource::InteriorResource() :
+mDetailLevel(0),
+mMinPixels(0),
+mBoundsMin(0),
+mBoundsMax(0),
+mBoundingSphere(0),
+mHasAlarmState(false),
+mNumLightStateEntries(0),
+mLightmapsPacked(false)
+{
+   mMaterialList.mVariant = MaterialList::VARIANT_NORMAL;
+}
+
+InteriorResource::~InteriorResource()
+{
+   clearRenderData();
+}
+
+bool InteriorResource::read(MemRStream& s)
+{
+   // Keep the file data around since everything is viewed in-place
+   if (s.mOwnPtr)
+   {
+      mBuffer = s;
+   }
+   else
+   {
+      void* data = malloc(s.mSize);
+      memcpy(data, s.mPtr, s.mSize);
+      mBuffer = MemRStream(s.mSize, data, true);
+      mBuffer.mPos = s.mPos;
+   }
+
+   MemRStream& mem = mBuffer;
+
+   uint32_t fileVersion = 0;
+   uint8_t previewIncluded = 0;
+   uint32_t numDetailLevels = 0;
+
+   mem.read(fileVersion);
+   if (fileVersion != ResourceFileVersion)
+   {
+      printf("InteriorResource: unsupported resource version %u\n", fileVersion);
+      return false;
+   }
+
+   mem.read(previewIncluded);
+   if (previewIncluded)
+   {
+      uint32_t previewSize = 0;
+      if (!skipPNG(mem, previewSize))
+         return false;
+   }
+
+   // NOTE: only the highest detail is needed for viewing
+   if (!mem.read(numDetailLevels) || numDetailLevels == 0)
+      return false;
+
+   if (!readInterior(mem))
+   {
+      printf("InteriorResource: failed to read detail level 0\n");
+      return false;
+   }
+
+   if (!validate())
+   {
+      printf("InteriorResource: detail level 0 has out of range indices\n");
+      return false;
+   }
+
+   buildRenderData();
+   return true;
+}
+
+bool InteriorResource::peekHeader(MemRStream& header)
+{
+   uint32_t fileVersion = 0;
+   header.read(fileVersion);
+   return fileVersion == ResourceFileVersion;
+}
+
+bool InteriorResource::readInterior(MemRStream& s)
+{
+   uint32_t fileVersion = 0;
+   s.read(fileVersion);
+   if (fileVersion != InteriorFileVersion)
+   {
+      printf("InteriorResource: unsupported interior version %u\n", fileVersion);
+      return false;
+   }
+
+   float bounds[6];
+   uint8_t hasAlarmState = 0;
+
+   s.read(mDetailLevel);
+   s.read(mMinPixels);
+   s.read(bounds);
+   s.read(mBoundingSphere);
+   s.read(hasAlarmState);
+   s.read(mNumLightStateEntries);
+
+   mBoundsMin = slm::vec3(bounds[0], bounds[1], bounds[2]);
+   mBoundsMax = slm::vec3(bounds[3], bounds[4], bounds[5]);
+   mHasAlarmState = hasAlarmState != 0;
+
+   if (!readView(s, mNormals)) return false;
+   if (!readView(s, mPlanes)) return false;
+   if (!readView(s, mPoints)) return false;
+   if (!readView(s, mPointVisibility)) return false;
+   if (!readView(s, mTexGenEQs)) return false;
+   if (!readView(s, mBSPNodes)) return false;
+   if (!readView(s, mBSPSolidLeaves)) return false;
+
+   // Material list; names are short so these get copied
+   uint8_t matVersion = 0;
+   uint32_t numMaterials = 0;
+   s.read(matVersion);
+   if (matVersion != MaterialList::BINARY_FILE_VERSION || !s.read(numMaterials))
+      return false;
+
+   mMaterialList.mMaterials.reserve(numMaterials);
+   for (uint32_t i=0; i<numMaterials; i++)
+   {
+      char buffer[256];
+      uint8_t nameLen = 0;
+      if (!s.read(nameLen) || !s.read(nameLen, buffer))
+         return false;
+      buffer[nameLen] = '\0';
+      mMaterialList.push_back(MaterialList::stripToolPath(buffer));
+   }
+
+   if (!readView(s, mWindings)) return false;
+   if (!readView(s, mWindingIndices)) return false;
+   if (!readView(s, mZones)) return false;
+   if (!readView(s, mZoneSurfaces)) return false;
+   if (!readView(s, mZonePortalList)) return false;
+   if (!readView(s, mPortals)) return false;
+   if (!readView(s, mSurfaces)) return false;
+   if (!readView(s, mNormalLMapIndices)) return false;
+   if (!readView(s, mAlarmLMapIndices)) return false;
+   if (!readView(s, mNullSurfaces)) return false;
+
+   uint32_t numLightmaps = 0;
+   if (!s.read(numLightmaps))
+      return false;
+
+   mLightmaps.resize(numLightmaps);
+   for (Lightmap& lm : mLightmaps)
+   {
+      uint8_t keep = 0;
+      lm.offset = (uint32_t)s.mPos;
+      if (!skipPNG(s, lm.size) || !s.read(keep))
+         return false;
+      lm.keep = keep != 0;
+   }
+
+   // NOTE: the rest of the interior (light states, animated lights, etc) isn't used here
+   return true;
+}
+
+bool InteriorResource::validate() const
+{
+   for (const Plane& plane : mPlanes)
+   {
+      if (plane.normalIndex >= mNormals.size())
+         return false;
+   }
+
+   for (const PackedU32& idx : mWindings)
+   {
+      if (idx.value >= mPoints.size())
+         return false;
+   }
+
+   if (mNormalLMapIndices.size() < mSurfaces.size())
+      return false;
+
+   for (uint32_t i=0; i<mSurfaces.size(); i++)
+   {
+      const Surface& surface = mSurfaces[i];
+      if ((uint64_t)surface.windingStart + surface.windingCount > mWindings.size() ||
+          (surface.planeIndex & Surface::PlaneMask) >= mPlanes.size() ||
+          surface.textureIndex >= mMaterialList.size() ||
+          surface.texGenIndex >= mTexGenEQs.size())
+         return false;
+   }
+
+   for (const BSPNode& node : mBSPNodes)
+   {
+      if ((node.planeIndex & Surface::PlaneMask) >= mPlanes.size())
+         return false;
+
+      // Empty leaves name a zone, which findZone checks
+      for (uint32_t child : { (uint32_t)node.frontIndex, (uint32_t)node.backIndex })
+      {
+         uint32_t index = child & ~(BSPNode::LeafFlag | BSPNode::SolidFlag);
+         if (!(child & BSPNode::LeafFlag) && child >= mBSPNodes.size())
+            return false;
+         if ((child & BSPNode::LeafFlag) && (child & BSPNode::SolidFlag) && index >= mBSPSolidLeaves.size())
+            return false;
+      }
+   }
+
+   for (const WindingIndex& fan : mWindingIndices)
+   {
+      if ((uint64_t)fan.windingStart + fan.windingCount > mWindings.size())
+         return false;
+   }
+
+   for (const Zone& zone : mZones)
+   {
+      if ((uint32_t)zone.portalStart + zone.portalCount > mZonePortalList.size() ||
+          (uint64_t)zone.surfaceStart + zone.surfaceCount > mZoneSurfaces.size())
+         return false;
+   }
+
+   for (const PackedU16& idx : mZoneSurfaces)
+   {
+      if (idx.value >= mSurfaces.size())
+         return false;
+   }
+
+   for (const PackedU16& idx : mZonePortalList)
+   {
+      if (idx.value >= mPortals.size())
+         return false;
+   }
+
+   for (const Portal& portal : mPortals)
+   {
+      if ((portal.planeIndex & Surface::PlaneMask) >= mPlanes.size() ||
+          (uint64_t)portal.triFanStart + portal.triFanCount > mWindingIndices.size() ||
+          portal.zoneFront >= mZones.size() || portal.zoneBack >= mZones.size())
+         return false;
+   }
+
+   return true;
+}
+
+void InteriorResource::calcLightmapTexGen(const Surface& surface, slm::vec4& outPlaneX, slm::vec4& outPlaneY)
+{
+   // finalWord packs the log2 scale for each axis along with which
+   // pair of world axes the lightmap is projected along.
+   static const uint8_t sAxisMap[6][2] = {{0,1}, {0,2}, {1,0}, {1,2}, {2,0}, {2,1}};
+
+   uint32_t logScaleY = (surface.lmFinalWord >> 0) & ((1 << 6) - 1);
+   uint32_t logScaleX = (surface.lmFinalWord >> 6) & ((1 << 6) - 1);
+   uint32_t stEnc = (surface.lmFinalWord >> 13) & 7;
+   if (stEnc > 5)
+      stEnc = 0;
+
+   outPlaneX = slm::vec4(0, 0, 0, surface.lmTexGenXDist);
+   outPlaneY = slm::vec4(0, 0, 0, surface.lmTexGenYDist);
+   outPlaneX[sAxisMap[stEnc][0]] = (float)(1.0 / (double)(1ULL << logScaleX));
+   outPlaneY[sAxisMap[stEnc][1]] = (float)(1.0 / (double)(1ULL << logScaleY));
+}
+
+void InteriorResource::buildRenderData()
+{
+   clearRenderData();
+
+   // Sort by material then lightmap so each batch is a contiguous index range
+   std::vector<uint32_t> order(mSurfaces.size());
+   uint32_t numVerts = 0;
+   uint32_t numInds = 0;
+   for (uint32_t i=0; i<mSurfaces.size(); i++)
+   {
+      order[i] = i;
+      uint32_t count = mSurfaces[i].windingCount;
+      numVerts += count;
+      numInds += count > 2 ? (count - 2) * 3 : 0;
+   }
+
+   std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b){
+      const Surface& sa = mSurfaces[a];
+      const Surface& sb = mSurfaces[b];
+      if (sa.textureIndex != sb.textureIndex)
+         return sa.textureIndex < sb.textureIndex;
+      return mNormalLMapIndices[a] < mNormalLMapIndices[b];
+   });
+
+   mRenderVerts.reserve(numVerts);
+   mRenderTexVerts.reserve(numVerts);
+   mRenderIndices.reserve(numInds);
+   mSurfaceRanges.resize(mSurfaces.size());
+
+   for (uint32_t surfaceIdx : order)
+   {
+      const Surface& surface = mSurfaces[surfaceIdx];
+      const TexGenPlanes& texGen = mTexGenEQs[surface.texGenIndex];
+      uint16_t lmIndex = mNormalLMapIndices[surfaceIdx];
+
+      slm::vec3 normal = getPlaneNormal(surface.planeIndex);
+      slm::vec4 planeS(texGen.planeS[0], texGen.planeS[1], texGen.planeS[2], texGen.planeS[3]);
+      slm::vec4 planeT(texGen.planeT[0], texGen.planeT[1], texGen.planeT[2], texGen.planeT[3]);
+      slm::vec4 lmPlaneX, lmPlaneY;
+      calcLightmapTexGen(surface, lmPlaneX, lmPlaneY);
+
+      uint32_t baseVert = (uint32_t)mRenderVerts.size();
+      for (uint32_t i=0; i<surface.windingCount; i++)
+      {
+         slm::vec4 pos(mPoints[mWindings[surface.windingStart + i]].toVec(), 1.0f);
+
+         RenderVertex vert;
+         vert.position = pos.xyz();
+         vert.normal = normal;
+         mRenderVerts.push_back(vert);
+
+         RenderTexVertex tvert;
+         tvert.texCoord = slm::vec2(slm::dot(planeS, pos), slm::dot(planeT, pos));
+         tvert.lmCoord = slm::vec3(slm::dot(lmPlaneX, pos), slm::dot(lmPlaneY, pos), 0.0f);
+         mRenderTexVerts.push_back(tvert);
+      }
+
+      // Windings are triangle strips
+      SurfaceRange& range = mSurfaceRanges[surfaceIdx];
+      range.indexStart = (uint32_t)mRenderIndices.size();
+      for (uint32_t i=2; i<surface.windingCount; i++)
+      {
+         if ((i & 1) == 0)
+         {
+            mRenderIndices.push_back(baseVert + i - 2);
+            mRenderIndices.push_back(baseVert + i - 1);
+         }
+         else
+         {
+            mRenderIndices.push_back(baseVert + i - 1);
+            mRenderIndices.push_back(baseVert + i - 2);
+         }
+         mRenderIndices.push_back(baseVert + i);
+      }
+      range.indexCount = (uint32_t)mRenderIndices.size() - range.indexStart;
+
+      if (mRenderBatches.empty() ||
+          mRenderBatches.back().textureIndex != surface.textureIndex ||
+          mRenderBatches.back().lightmapIndex != lmIndex)
+      {
+         RenderBatch batch;
+         batch.textureIndex = surface.textureIndex;
+         batch.lightmapIndex = lmIndex;
+         batch.indexStart = range.indexStart;
+         batch.indexCount = 0;
+         mRenderBatches.push_back(batch);
+      }
+
+      range.batchIndex = (uint32_t)mRenderBatches.size() - 1;
+      mRenderBatches.back().indexCount += range.indexCount;
+   }
+
+   MemTracker::trackAlloc(MemCategory_Interior, calcRenderDataSize(*this));
+}
+
+void InteriorResource::clearRenderData()
+{
+   size_t byteSize = calcRenderDataSize(*this);
+   if (byteSize != 0)
+      MemTracker::trackFree(MemCategory_Interior, byteSize);
+
+   mRenderVerts = std::vector<RenderVertex>();
+   mRenderTexVerts = std::vector<RenderTexVertex>();
+   mRenderIndices = std::vector<uint32_t>();
+   mRenderBatches = std::vector<RenderBatch>();
+   mSurfaceRanges = std::vector<SurfaceRange>();
+   mLightmapsPacked = false;
+}
+
+int32_t InteriorResource::findZone(const slm::vec3& pt) const
+{
+   if (mBSPNodes.size() == 0)
+      return -1;
+
+   uint32_t nodeIndex = 0;
+   for (uint32_t i=0; i<mBSPNodes.size(); i++)
+   {
+      const BSPNode& node = mBSPNodes[nodeIndex];
+      float dist = slm::dot(getPlaneNormal(node.planeIndex), pt) + getPlaneDist(node.planeIndex);
+      uint32_t next = dist >= 0.0f ? node.frontIndex : node.backIndex;
+
+      if (next & BSPNode::LeafFlag)
+      {
+         if (next & BSPNode::SolidFlag)
+            return -1;
+
+         // Empty leaves encode the zone they belong to
+         uint32_t zone = next & ~(BSPNode::LeafFlag | BSPNode::SolidFlag);
+         return zone < mZones.size() ? (int32_t)zone : -1;
+      }
+
+      if (next >= mBSPNodes.size())
+         return -1;
+      nodeIndex = next;
+   }
+
+   // Malformed tree
+   return -1;
+}
+
+bool InteriorResource::readLightmap(uint32_t idx, Bitmap& outBmp)
+{
+   if (idx >= mLightmaps.size())
+      return false;
+
+   const Lightmap& lm = mLightmaps[idx];
+   MemRStream view(lm.size, mBuffer.mPtr + lm.offset);
+   return outBmp.readStbi(view);
+}
+
+bool InteriorResource::getLightmapSize(uint32_t idx, uint32_t& outWidth, uint32_t& outHeight) const
+{
+   if (idx >= mLightmaps.size())
+      return false;
+
+   // IHDR is always the first chunk: signature(8) + length(4) + type(4) + width(4) + height(4)
+   const Lightmap& lm = mLightmaps[idx];
+   if (lm.size < 24)
+      return false;
+
+   const uint8_t* ptr = mBuffer.mPtr + lm.offset;
+   if (memcmp(ptr + 12, "IHDR", 4) != 0)
+      return false;
+
+   outWidth = readBE32(ptr + 16);
+   outHeight = readBE32(ptr + 20);
+   return outWidth <= 0xFFFF && outHeight <= 0xFFFF;
+}
+
+bool InteriorResource::packLightmaps(LightmapAtlas& outAtlas, uint32_t maxLayerSize)
+{
+   if (mLightmapsPacked)
+   {
+      printf("InteriorResource: lightmaps already packed\n");
+      return false;
+   }
+
+   // Last entry is a white lightmap for surfaces with a bad index
+   uint32_t numLightmaps = (uint32_t)mLightmaps.size();
+   uint32_t whiteEntry = numLightmaps;
+   std::vector<uint16_t> sizes((numLightmaps + 1) * 2, 1);
+   for (uint32_t i=0; i<numLightmaps; i++)
+   {
+      uint32_t width = 1;
+      uint32_t height = 1;
+      if (getLightmapSize(i, width, height))
+      {
+         sizes[i*2] = (uint16_t)width;
+         sizes[(i*2)+1] = (uint16_t)height;
+      }
+   }
+
+   if (!outAtlas.pack(numLightmaps + 1, &sizes[0], maxLayerSize))
+      return false;
+
+   for (uint32_t i=0; i<numLightmaps; i++)
+   {
+      Bitmap bmp;
+      if (!readLightmap(i, bmp) || !outAtlas.copyBitmap(i, bmp))
+      {
+         printf("InteriorResource: couldn't decode lightmap %u\n", i);
+         outAtlas.fillEntry(i, 0xFFFFFFFF);
+      }
+   }
+   outAtlas.fillEntry(whiteEntry, 0xFFFFFFFF);
+
+   // Surfaces own their vertices, so each one only needs remapping once
+   std::vector<uint8_t> remapped(mRenderTexVerts.size(), 0);
+   for (uint32_t i=0; i<mSurfaces.size(); i++)
+   {
+      const SurfaceRange& range = mSurfaceRanges[i];
+      uint32_t entryIdx = mNormalLMapIndices[i] < numLightmaps ? mNormalLMapIndices[i] : whiteEntry;
+
+      for (uint32_t j=0; j<range.indexCount; j++)
+      {
+         uint32_t vertIdx = mRenderIndices[range.indexStart + j];
+         if (remapped[vertIdx])
+            continue;
+
+         RenderTexVertex& tvert = mRenderTexVerts[vertIdx];
+         tvert.lmCoord = outAtlas.remapCoord(entryIdx, slm::vec2(tvert.lmCoord.x, tvert.lmCoord.y));
+         remapped[vertIdx] = 1;
+      }
+   }
+
+   // Batches are sorted by material so anything left to merge is adjacent
+   size_t oldSize = calcRenderDataSize(*this);
+   std::vector<uint32_t> batchRemap(mRenderBatches.size());
+   uint32_t numBatches = 0;
+   for (uint32_t i=0; i<mRenderBatches.size(); i++)
+   {
+      const RenderBatch& batch = mRenderBatches[i];
+      if (numBatches > 0 && mRenderBatches[numBatches-1].textureIndex == batch.textureIndex)
+      {
+         mRenderBatches[numBatches-1].indexCount += batch.indexCount;
+      }
+      else
+      {
+         mRenderBatches[numBatches] = batch;
+         mRenderBatches[numBatches].lightmapIndex = RenderBatch::AtlasLightmap;
+         numBatches++;
+      }
+      batchRemap[i] = numBatches - 1;
+   }
+
+   mRenderBatches.resize(numBatches);
+   mRenderBatches.shrink_to_fit();
+   for (SurfaceRange& range : mSurfaceRanges)
+      range.batchIndex = batchRemap[range.batchIndex];
+   MemTracker::trackResize(MemCategory_Interior, oldSize, calcRenderDataSize(*this));
+
+   mLightmapsPacked = true;
+   return true;
+}
+
+}
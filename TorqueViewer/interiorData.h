@@ -0,0 +1,325 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _INTERIORDATA_H_
+#define _INTERIORDATA_H_
+
+#include "CommonData.h"
+
+#include <vector>
+#include <stdint.h>
+
+class LightmapAtlas;
+
+/*
+ Interiors (.dif) are BSP based static geometry, typically used for mission buildings.
+
+ Nearly everything in an interior is a flat array prefixed by a 32bit count, so rather
+ than copying each element out we keep the file buffer around and point straight into it.
+ All of the view types below are packed so they match the on-disk layout and can be
+ accessed from any alignment.
+
+ Surfaces are stored as triangle strips of indices into the point list. Since we want to
+ draw everything from a single vertex buffer, at load time surfaces are expanded into
+ triangles and merged into buffers sorted by material and lightmap.
+ */
+namespace Dif
+{
+
+enum
+{
+   ResourceFileVersion = 44,
+   InteriorFileVersion = 0
+};
+
+// Read-only view of an array in the resource buffer
+template<class T> struct ArrayView
+{
+   const T* mPtr;
+   uint32_t mSize;
+
+   ArrayView() : mPtr(NULL), mSize(0) {;}
+
+   inline uint32_t size() const { return mSize; }
+   inline const T& operator[](uint32_t idx) const { return mPtr[idx]; }
+   inline const T* begin() const { return mPtr; }
+   inline const T* end() const { return mPtr + mSize; }
+};
+
+#pragma pack(push, 1)
+
+struct PackedU16
+{
+   uint16_t value;
+   inline operator uint32_t() const { return value; }
+};
+
+struct PackedU32
+{
+   uint32_t value;
+   inline operator uint32_t() const { return value; }
+};
+
+struct Point3
+{
+   float x, y, z;
+   inline slm::vec3 toVec() const { return slm::vec3(x, y, z); }
+};
+
+struct Plane
+{
+   uint16_t normalIndex;
+   float d;
+};
+
+struct TexGenPlanes
+{
+   float planeS[4];
+   float planeT[4];
+};
+
+struct BSPNode
+{
+   enum
+   {
+      LeafFlag = 0x8000,    // set on front/back if the index refers to a leaf
+      SolidFlag = 0x4000    // set on leaf indices if the leaf is solid
+   };
+
+   uint16_t planeIndex;
+   uint16_t frontIndex;
+   uint16_t backIndex;
+};
+
+struct BSPSolidLeaf
+{
+   uint32_t surfaceIndex;
+   uint16_t surfaceCount;
+};
+
+struct WindingIndex
+{
+   uint32_t windingStart;
+   uint32_t windingCount;
+};
+
+struct Zone
+{
+   uint16_t portalStart;
+   uint16_t portalCount;
+   uint32_t surfaceStart;
+   uint32_t surfaceCount;
+};
+
+struct Portal
+{
+   uint16_t planeIndex;
+   uint16_t triFanCount;
+   uint32_t triFanStart;
+   uint16_t zoneFront;
+   uint16_t zoneBack;
+};
+
+struct Surface
+{
+   enum
+   {
+      PlaneFlipped = 0x8000,
+      PlaneMask = 0x7FFF
+   };
+
+   enum Flags : uint8_t
+   {
+      SurfaceDetail = 1<<0,
+      SurfaceAmbiguous = 1<<1,
+      SurfaceOrphan = 1<<2,
+      SurfaceSharedLMaps = 1<<3,
+      SurfaceOutsideVisible = 1<<4
+   };
+
+   uint32_t windingStart;
+   uint8_t windingCount;
+   uint16_t planeIndex;
+   uint16_t textureIndex;
+   uint32_t texGenIndex;
+   uint8_t surfaceFlags;
+   uint32_t fanMask;
+   // Lightmap texgen, packed (see calcLightmapTexGen)
+   uint16_t lmFinalWord;
+   float lmTexGenXDist;
+   float lmTexGenYDist;
+   //
+   uint16_t lightCount;
+   uint32_t lightStateInfoStart;
+   uint8_t mapOffsetX;
+   uint8_t mapOffsetY;
+   uint8_t mapSizeX;
+   uint8_t mapSizeY;
+};
+
+struct NullSurface
+{
+   uint32_t windingStart;
+   uint16_t planeIndex;
+   uint8_t surfaceFlags;
+   uint8_t windingCount;
+};
+
+#pragma pack(pop)
+
+// PNG lightmap stored in the resource buffer
+struct Lightmap
+{
+   uint32_t offset;
+   uint32_t size;
+   bool keep;
+};
+
+// Merged geometry, laid out to match ModelVertex / ITRTexVertex
+struct RenderVertex
+{
+   slm::vec3 position;
+   slm::vec3 normal;
+};
+
+struct RenderTexVertex
+{
+   slm::vec2 texCoord;
+   slm::vec3 lmCoord; // uv in the surface lightmap, or atlas (u, v, layer) once packed
+};
+
+// Run of indices sharing the same material and lightmap
+struct RenderBatch
+{
+   enum
+   {
+      AtlasLightmap = 0xFFFF // lightmaps are addressed through the atlas coords
+   };
+   
+
+   uint16_t textureIndex;
+   uint16_t lightmapIndex;
+   uint32_t indexStart;
+   uint32_t indexCount;
+};
+
+struct SurfaceRange
+{
+   uint32_t indexStart;
+   uint32_t indexCount;
+   uint32_t batchIndex;
+};
+
+class InteriorResource : public ResourceInstance
+{
+public:
+
+   // NOTE: everything below points into this buffer
+   MemRStream mBuffer;
+
+   uint32_t mDetailLevel;
+   uint32_t mMinPixels;
+   slm::vec3 mBoundsMin;
+   slm::vec3 mBoundsMax;
+   slm::vec4 mBoundingSphere;
+   bool mHasAlarmState;
+   uint32_t mNumLightStateEntries;
+
+   ArrayView<Point3> mNormals;
+   ArrayView<Plane> mPlanes;
+   ArrayView<Point3> mPoints;
+   ArrayView<uint8_t> mPointVisibility;
+   ArrayView<TexGenPlanes> mTexGenEQs;
+   ArrayView<BSPNode> mBSPNodes;
+   ArrayView<BSPSolidLeaf> mBSPSolidLeaves;
+
+   MaterialList mMaterialList;
+
+   ArrayView<PackedU32> mWindings;
+   ArrayView<WindingIndex> mWindingIndices;
+
+   ArrayView<Zone> mZones;
+   ArrayView<PackedU16> mZoneSurfaces;
+   ArrayView<PackedU16> mZonePortalList;
+   ArrayView<Portal> mPortals;
+
+   ArrayView<Surface> mSurfaces;
+   ArrayView<uint8_t> mNormalLMapIndices;
+   ArrayView<uint8_t> mAlarmLMapIndices;
+   ArrayView<NullSurface> mNullSurfaces;
+
+   std::vector<Lightmap> mLightmaps;
+
+   // Merged render data
+   std::vector<RenderVertex> mRenderVerts;
+   std::vector<RenderTexVertex> mRenderTexVerts;
+   std::vector<uint32_t> mRenderIndices;
+   std::vector<RenderBatch> mRenderBatches;
+   std::vector<SurfaceRange> mSurfaceRanges; // indexed by surface
+   bool mLightmapsPacked;
+
+   InteriorResource();
+   ~InteriorResource();
+
+   bool read(MemRStream& s);
+
+   // Checks the resource version, for ResManager::registerPeekFunc
+   static bool peekHeader(MemRStream& header);
+
+   // Decodes a lightmap from the resource buffer
+   bool readLightmap(uint32_t idx, Bitmap& outBmp);
+   
+   // Gets the dimensions of a lightmap without decoding it
+   bool getLightmapSize(uint32_t idx, uint32_t& outWidth, uint32_t& outHeight) const;
+   
+   // Packs all lightmaps into outAtlas and remaps lightmap coords to match.
+   // Batches which only differed by lightmap are merged.
+   bool packLightmaps(LightmapAtlas& outAtlas, uint32_t maxLayerSize);
+
+   inline slm::vec3 getPlaneNormal(uint32_t planeIndex) const
+   {
+      slm::vec3 normal = mNormals[mPlanes[planeIndex & Surface::PlaneMask].normalIndex].toVec();
+      return (planeIndex & Surface::PlaneFlipped) ? -normal : normal;
+   }
+
+   inline float getPlaneDist(uint32_t planeIndex) const
+   {
+      float d = mPlanes[planeIndex & Surface::PlaneMask].d;
+      return (planeIndex & Surface::PlaneFlipped) ? -d : d;
+   }
+
+   // Returns the zone containing pt, or -1 if pt is in solid space or outside all zones
+   int32_t findZone(const slm::vec3& pt) const;
+
+   static void calcLightmapTexGen(const Surface& surface, slm::vec4& outPlaneX, slm::vec4& outPlaneY);
+
+protected:
+
+   bool readInterior(MemRStream& s);
+   bool validate() const;
+   void buildRenderData();
+   void clearRenderData();
+};
+
+}
+
+#endif
@@ -0,0 +1,77 @@
+// Permutations (see ShaderPreprocessor):
+//   ALPHA_TEST - discard by params2.x
+
+struct CommonUniforms {
+    projMat: mat4x4<f32>,
+    viewMat: mat4x4<f32>,
+    modelMat: mat4x4<f32>,
+    params1: vec4<f32>, // viewportScale.xy, lineWidth
+    params2: vec4<f32>, // alphaTestF
+    lightPos: vec4<f32>,
+    lightColor: vec4<f32>,
+};
+
+@group(0) @binding(0) var<uniform> commonUniforms: CommonUniforms;
+
+
+@group(1) @binding(0) var texture0: texture_2d<f32>;
+@group(1) @binding(1) var sampler0: sampler;
+@group(1) @binding(2) var lightMap: texture_2d_array<f32>;
+@group(1) @binding(3) var lightMapSampler: sampler;
+
+struct VertexInput {
+    @location(0) aPosition: vec3<f32>,
+    @location(1) aNormal: vec3<f32>,
+    @location(2) aTexCoord0: vec2<f32>,
+    @location(3) aLMCoord: vec3<f32>, // u, v, layer
+};
+
+struct InstanceInput {
+    @location(4) aInstanceMat0: vec4<f32>,
+    @location(5) aInstanceMat1: vec4<f32>,
+    @location(6) aInstanceMat2: vec4<f32>,
+    @location(7) aInstanceMat3: vec4<f32>,
+    @location(8) aTransformOffset: u32,
+};
+
+struct VertexOutput {
+    @builtin(position) position: vec4<f32>,
+    @location(0) vTexCoord0: vec2<f32>,
+    @location(1) vLMCoord: vec2<f32>,
+    @location(2) @interpolate(flat) vLMLayer: i32,
+};
+
+struct FragmentOutput {
+    @location(0) Color: vec4<f32>,
+};
+
+
+@vertex
+fn mainVert(input: VertexInput, instance: InstanceInput) -> VertexOutput {
+    let instanceMat = mat4x4<f32>(instance.aInstanceMat0, instance.aInstanceMat1, instance.aInstanceMat2, instance.aInstanceMat3);
+    let mvpMat: mat4x4<f32> = commonUniforms.projMat * commonUniforms.viewMat * commonUniforms.modelMat * instanceMat;
+
+    var output: VertexOutput;
+    output.position = mvpMat * vec4<f32>(input.aPosition, 1.0);
+    output.vTexCoord0 = input.aTexCoord0;
+    output.vLMCoord = input.aLMCoord.xy;
+    output.vLMLayer = i32(input.aLMCoord.z + 0.5);
+
+    return output;
+}
+
+@fragment
+fn mainFrag(input: VertexOutput) -> FragmentOutput {
+    var color: vec4<f32> = textureSample(texture0, sampler0, input.vTexCoord0);
+    let light: vec4<f32> = textureSample(lightMap, lightMapSampler, input.vLMCoord, input.vLMLayer);
+
+#ifdef ALPHA_TEST
+    if (color.a > commonUniforms.params2.x) {
+        discard;
+    }
+#endif
+
+    var out: FragmentOutput;
+    out.Color = vec4<f32>(color.rgb * light.rgb, color.a);
+    return out;
+}
@@ -0,0 +1,206 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "CommonData.h"
+#include "lightmapAtlas.h"
+#include "memTracker.h"
+
+#define STB_RECT_PACK_IMPLEMENTATION
+#define STBRP_STATIC
+#include "imstb_rectpack.h"
+
+LightmapAtlas::LightmapAtlas() : mLayerSize(0), mNumLayers(0)
+{
+}
+
+LightmapAtlas::~LightmapAtlas()
+{
+   clear();
+}
+
+void LightmapAtlas::clear()
+{
+   MemTracker::trackResize(MemCategory_Interior, mPixels.capacity(), 0);
+   mPixels = std::vector<uint8_t>();
+   mEntries.clear();
+   mLayerSize = 0;
+   mNumLayers = 0;
+}
+
+bool LightmapAtlas::pack(uint32_t numEntries, const uint16_t* sizes, uint32_t maxLayerSize)
+{
+   clear();
+   
+   // Start with the smallest square which could hold everything
+   uint64_t totalArea = 0;
+   uint32_t maxDim = 1;
+   std::vector<stbrp_rect> rects(numEntries);
+   for (uint32_t i=0; i<numEntries; i++)
+   {
+      stbrp_rect& rect = rects[i];
+      rect.id = (int)i;
+      rect.w = sizes[i*2] + (Padding*2);
+      rect.h = sizes[(i*2)+1] + (Padding*2);
+      rect.x = rect.y = 0;
+      rect.was_packed = 0;
+      totalArea += (uint64_t)rect.w * rect.h;
+      maxDim = std::max(maxDim, (uint32_t)std::max(rect.w, rect.h));
+   }
+   
+   if (maxDim > maxLayerSize)
+   {
+      printf("LightmapAtlas: %u texel lightmap won't fit in a %u layer\n", maxDim, maxLayerSize);
+      return false;
+   }
+   
+   uint32_t layerSize = getNextPow2(maxDim);
+   while (layerSize < maxLayerSize && (uint64_t)layerSize * layerSize < totalArea)
+      layerSize *= 2;
+   layerSize = std::min(layerSize, maxLayerSize);
+   
+   std::vector<stbrp_node> nodes;
+   stbrp_context ctx;
+   
+   // Grow a single layer until it fits, then spill into more layers at the max size
+   mEntries.resize(numEntries);
+   std::vector<stbrp_rect> remaining = rects;
+   uint32_t layer = 0;
+   
+   while (!remaining.empty())
+   {
+      nodes.resize(layerSize);
+      stbrp_init_target(&ctx, (int)layerSize, (int)layerSize, &nodes[0], (int)nodes.size());
+      bool allPacked = stbrp_pack_rects(&ctx, &remaining[0], (int)remaining.size()) != 0;
+      
+      if (!allPacked && layer == 0 && layerSize < maxLayerSize)
+      {
+         layerSize *= 2;
+         continue;
+      }
+      
+      size_t numLeft = 0;
+      for (const stbrp_rect& rect : remaining)
+      {
+         if (!rect.was_packed)
+         {
+            remaining[numLeft++] = rect;
+            continue;
+         }
+         
+         Entry& entry = mEntries[rect.id];
+         entry.layer = (uint16_t)layer;
+         entry.x = (uint16_t)(rect.x + Padding);
+         entry.y = (uint16_t)(rect.y + Padding);
+         entry.width = (uint16_t)(rect.w - (Padding*2));
+         entry.height = (uint16_t)(rect.h - (Padding*2));
+      }
+      
+      if (numLeft == remaining.size())
+         return false; // shouldn't happen since maxDim fits
+      
+      remaining.resize(numLeft);
+      layer++;
+   }
+   
+   mLayerSize = layerSize;
+   mNumLayers = std::max(layer, 1U);
+   mPixels.resize((size_t)mLayerSize * mLayerSize * 4 * mNumLayers);
+   MemTracker::trackAlloc(MemCategory_Interior, mPixels.capacity());
+   return true;
+}
+
+bool LightmapAtlas::copyBitmap(uint32_t entryIdx, const Bitmap& bmp)
+{
+   const Entry& entry = mEntries[entryIdx];
+   if (bmp.mWidth != entry.width || bmp.mHeight != entry.height || bmp.mMips[0] == NULL)
+      return false;
+   
+   for (uint32_t y=0; y<entry.height; y++)
+   {
+      const uint8_t* src = bmp.mMips[0] + (y * bmp.mStride);
+      uint8_t* dest = getPixel(entry.layer, entry.x, entry.y + y);
+      
+      switch (bmp.mFormat)
+      {
+         case Bitmap::FORMAT_RGB:
+            copyRGBToRGBA(dest, src, entry.width);
+            break;
+         case Bitmap::FORMAT_RGBA:
+            memcpy(dest, src, entry.width * 4);
+            break;
+         case Bitmap::FORMAT_RGB_565:
+            copy565ToRGBA(dest, (const uint16_t*)src, entry.width);
+            break;
+         case Bitmap::FORMAT_LUMINANCE:
+            for (uint32_t x=0; x<entry.width; x++, dest += 4)
+            {
+               dest[0] = dest[1] = dest[2] = src[x];
+               dest[3] = 255;
+            }
+            break;
+         default:
+            return false;
+      }
+   }
+   
+   fillPadding(entry);
+   return true;
+}
+
+void LightmapAtlas::fillEntry(uint32_t entryIdx, uint32_t rgba)
+{
+   const Entry& entry = mEntries[entryIdx];
+   for (uint32_t y=0; y<entry.height; y++)
+   {
+      uint8_t* dest = getPixel(entry.layer, entry.x, entry.y + y);
+      for (uint32_t x=0; x<entry.width; x++)
+         memcpy(dest + (x*4), &rgba, 4);
+   }
+   
+   fillPadding(entry);
+}
+
+void LightmapAtlas::fillPadding(const Entry& entry)
+{
+   if (entry.width == 0 || entry.height == 0)
+      return;
+   
+   // Extend the edge columns, then copy the (now full width) edge rows
+   for (uint32_t y=0; y<entry.height; y++)
+   {
+      uint8_t* row = getPixel(entry.layer, entry.x, entry.y + y);
+      for (uint32_t p=1; p<=Padding; p++)
+      {
+         memcpy(row - (p*4), row, 4);
+         memcpy(row + ((entry.width - 1 + p) * 4), row + ((entry.width - 1) * 4), 4);
+      }
+   }
+   
+   size_t rowBytes = (entry.width + (Padding*2)) * 4;
+   uint8_t* firstRow = getPixel(entry.layer, entry.x - Padding, entry.y);
+   uint8_t* lastRow = getPixel(entry.layer, entry.x - Padding, entry.y + entry.height - 1);
+   for (uint32_t p=1; p<=Padding; p++)
+   {
+      memcpy(getPixel(entry.layer, entry.x - Padding, entry.y - p), firstRow, rowBytes);
+      memcpy(getPixel(entry.layer, entry.x - Padding, entry.y + entry.height - 1 + p), lastRow, rowBytes);
+   }
+}
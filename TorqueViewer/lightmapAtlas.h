@@ -0,0 +1,93 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _LIGHTMAPATLAS_H_
+#define _LIGHTMAPATLAS_H_
+
+#include <stdint.h>
+#include <vector>
+#include <slm/slmath.h>
+
+class Bitmap;
+
+/*
+ Packs lots of small lightmaps into a few square RGBA8 layers so they can
+ be bound as a single array texture.
+ 
+ Each image gets a gutter of its own edge pixels so bilinear filtering at
+ the border doesn't pick up a neighbour. If everything doesn't fit in one
+ layer of maxLayerSize, additional layers of the same size are used.
+ */
+class LightmapAtlas
+{
+public:
+   
+   enum
+   {
+      Padding = 1
+   };
+   
+   struct Entry
+   {
+      uint16_t layer;
+      uint16_t x, y; // top left of the image, excluding padding
+      uint16_t width, height;
+   };
+   
+   uint32_t mLayerSize;
+   uint32_t mNumLayers;
+   std::vector<Entry> mEntries;
+   std::vector<uint8_t> mPixels; // RGBA8, layers stored one after the other
+   
+   LightmapAtlas();
+   ~LightmapAtlas();
+   
+   // Assigns a location for each (width,height) pair. Returns false if an entry can't fit in maxLayerSize.
+   bool pack(uint32_t numEntries, const uint16_t* sizes, uint32_t maxLayerSize);
+   
+   // Copies bmp into the atlas at entryIdx (RGB, RGBA, 565 or luminance)
+   bool copyBitmap(uint32_t entryIdx, const Bitmap& bmp);
+   
+   // Fills entryIdx with a solid color
+   void fillEntry(uint32_t entryIdx, uint32_t rgba);
+   
+   // Maps a normalised uv in the source image to (u, v, layer) in the atlas
+   inline slm::vec3 remapCoord(uint32_t entryIdx, slm::vec2 uv) const
+   {
+      const Entry& entry = mEntries[entryIdx];
+      float invSize = 1.0f / (float)mLayerSize;
+      return slm::vec3((entry.x + (uv.x * entry.width)) * invSize, (entry.y + (uv.y * entry.height)) * invSize, (float)entry.layer);
+   }
+   
+   inline uint8_t* getPixel(uint32_t layer, uint32_t x, uint32_t y)
+   {
+      return &mPixels[((((size_t)layer * mLayerSize) + y) * mLayerSize + x) * 4];
+   }
+   
+   void clear();
+   
+protected:
+   
+   void fillPadding(const Entry& entry);
+};
+
+#endif
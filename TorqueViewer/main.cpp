@@ -28,9 +28,13 @@
 #include <string>
 #include <vector>
 #include <cmath>
+#include <float.h>
 #include <iostream>
 #include <fstream>
 #include <unordered_map>
+#include <chrono>
+#include <atomic>
+#include <memory>
 
 #include "imgui.h"
 #include "imgui_impl_sdl3.h"
@@ -49,102 +53,33 @@ namespace fs = std::filesystem;
 
 #include "CommonData.h"
 #include "shapeData.h"
+#include "shapeSimplify.h"
+#include "shapeAnimation.h"
+#include "meshletCulling.h"
+#include "interiorData.h"
+#include "interiorCulling.h"
+#include "lightmapAtlas.h"
+#include "missionData.h"
+#include "sceneContainer.h"
+#include "missionSnapshot.h"
+#include "textureCache.h"
+#include "textureStreamer.h"
+#include "materialTextures.h"
 #include "CommonShaderTypes.h"
 #include "RendererHelper.h"
+#include "benchMode.h"
 
 // The max number of command buffers in flight
 static const uint32_t TVMaxBuffersInFlight = 3;
 
-// Run of the mill quaternion interpolator
-slm::quat CompatInterpolate( slm::quat const & q1,
-                            slm::quat const & q2, float t )
-{
-   // calculate the cosine of the angle
-   double cosOmega = q1.x * q2.x + q1.y * q2.y + q1.z * q2.z + q1.w * q2.w; // i.e. dot
-   
-   // adjust signs if necessary
-   float sign2;
-   if ( cosOmega < 0.0 )
-   {
-      cosOmega = -cosOmega;
-      sign2 = -1.0f;
-   }
-   else
-      sign2 = 1.0f;
-   
-   // calculate interpolating coeffs
-   double scale1, scale2;
-   if ( (1.0 - cosOmega) > 0.00001 )
-   {
-      // standard case
-      double omega = acos(cosOmega);
-      double sinOmega = sin(omega);
-      scale1 = sin((1.0 - t) * omega) / sinOmega;
-      scale2 = sign2 * sin(t * omega) / sinOmega;
-   }
-   else
-   {
-      // if quats are very close, just do linear interpolation
-      scale1 = 1.0 - t;
-      scale2 = sign2 * t;
-   }
-   
-   // actually do the interpolation
-   return slm::quat(float(scale1 * q1.x + scale2 * q2.x),
-                    float(scale1 * q1.y + scale2 * q2.y),
-                    float(scale1 * q1.z + scale2 * q2.z),
-                    float(scale1 * q1.w + scale2 * q2.w));
-}
-
 #include "encodedNormals.h"
 
-void CompatQuatSetMatrix(const slm::quat rot, slm::mat4 &outMat)
-{
-   if( rot.x*rot.x + rot.y*rot.y + rot.z*rot.z < 10E-20f)
-   {
-      outMat = slm::mat4(1);
-      return;
-   }
-   
-   float xs = rot.x * 2.0f;
-   float ys = rot.y * 2.0f;
-   float zs = rot.z * 2.0f;
-   float wx = rot.w * xs;
-   float wy = rot.w * ys;
-   float wz = rot.w * zs;
-   float xx = rot.x * xs;
-   float xy = rot.x * ys;
-   float xz = rot.x * zs;
-   float yy = rot.y * ys;
-   float yz = rot.y * zs;
-   float zz = rot.z * zs;
-   
-   // r,c
-   outMat[0] = slm::vec4(1.0f - (yy + zz),
-                         xy - wz,
-                         xz + wy,
-                         0.0f);
-   
-   outMat[1] = slm::vec4(xy + wz,
-                         1.0f - (xx + zz),
-                         yz - wx,
-                         0.0f);
-   
-   outMat[2] = slm::vec4(xz - wy,
-                         yz + wx,
-                         1.0f - (xx + yy),
-                         0.0f);
-   
-   //outMat = slm::transpose(outMat);
-   outMat[3] = slm::vec4(0.0f,0.0f,0.0f,1.0f);
-}
-
-
 #include "CommonData.h"
 
 
 void ConsolePersistObject::initStatics()
 {
+   Mission::registerClasses();
 }
 
 
@@ -186,11 +121,27 @@ public:
    slm::vec4 mLightColor;
    slm::vec3 mLightPos;
    
+   // Material textures go through its cache & streamer when they're set
+   static MaterialTextureLoader smMaterialTextures;
+   static float smViewportHeight;
+   
    GenericViewer() : mResourceManager(NULL), mPalette(NULL), mMaterialList(NULL)
    {
       useShared = false;
    }
    
+   // Screen pixels covered by one world unit at dist from the camera
+   float getPixelsPerUnit(float dist) const
+   {
+      return (mProjectionMatrix[1][1] * 0.5f * smViewportHeight) / std::max(dist, 0.01f);
+   }
+   
+   static void requestTextureSize(int32_t texID, float texels)
+   {
+      if (smMaterialTextures.mStreamer && texID >= 0)
+         smMaterialTextures.mStreamer->requestSize(texID, texels);
+   }
+   
    void updateMVP()
    {
       GFXSetModelViewProjection(mModelMatrix, mViewMatrix, mProjectionMatrix);
@@ -305,10 +256,48 @@ public:
       MemRStream mem(0, NULL);
       if (mResourceManager->openFile(filename, mem))
       {
+         // The same file with the same palette gives the same texture. These are
+         // palettized uploads, so are seeded apart from loadMaterialTexture's keys.
+         uint64_t hash = hashContent64(mem.mPtr, mem.mSize, mPalette ? hashBytes64(&mPalette->mData, sizeof(Palette::Data), 1) : 1);
+         TextureCache* cache = smMaterialTextures.mCache;
+         int32_t texID = cache ? cache->acquire(hash) : -1;
+         if (texID >= 0)
+         {
+            // Already uploaded, so only the dimensions are needed from the header
+            MemRStream header;
+            header.setOffsetView(mem, 0, mem.mSize);
+            uint32_t version = 0;
+            uint32_t format = 0;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            header.read(version);
+            header.read(format);
+            header.read(width);
+            header.read(height);
+            
+            outTexInfo.bmpFlags = 0;// TOFIX bmp->mFlags;
+            outTexInfo.texID = texID;
+            outTexInfo.width = width;
+            outTexInfo.height = height;
+            mLoadedTextures[fname] = outTexInfo;
+            return true;
+         }
+         
          Bitmap* bmp = new Bitmap();
          if (bmp->read(mem))
          {
-            int32_t texID = GFXLoadTexture(bmp, mPalette);
+            // Palettized bitmaps stream up from the mips they store
+            if (bmp->mFormat == Bitmap::FORMAT_PAL)
+            {
+               texID = smMaterialTextures.uploadPalettized(mResourceManager, filename, *bmp, mPalette, hash);
+            }
+            else
+            {
+               texID = GFXLoadTexture(bmp, mPalette);
+               if (texID >= 0 && cache)
+                  cache->insert(hash, texID, (uint64_t)getNextPow2(bmp->mWidth) * getNextPow2(bmp->mHeight) * 4);
+            }
+            
             if (texID >= 0)
             {
                printf("Loaded texture %s dimensions %ix%i\n", filename, bmp->mWidth, bmp->mHeight);
@@ -331,7 +320,7 @@ public:
    
    void clearTextures()
    {
-      for (auto itr: mLoadedTextures) { GFXDeleteTexture(itr.second.texID); }
+      for (auto itr: mLoadedTextures) { releaseMaterialTexture(itr.second.texID); }
       mLoadedTextures.clear();
       
       if (mSharedMaterials.tex.texID != 0)
@@ -341,8 +330,31 @@ public:
       }
    }
    
+   // Frees a texture without going through the cache
+   static void freeTexture(int32_t texID)
+   {
+      smMaterialTextures.freeTexture(texID);
+   }
+   
+   // Frees a texture from loadMaterialTexture or loadTexture
+   static void releaseMaterialTexture(int32_t texID)
+   {
+      smMaterialTextures.release(texID);
+   }
+   
+   // Loads a texture by material name, which normally won't include the extension
+   static int32_t loadMaterialTexture(ResManager* resManager, const char* name)
+   {
+      return smMaterialTextures.load(resManager, name);
+   }
 };
 
+MaterialTextureLoader GenericViewer::smMaterialTextures([](uint32_t width, uint32_t height, const uint8_t* pixels) {
+                                                           return GFXLoadCustomTexture(CustomTexture_RGBA8, width, height, (void*)pixels);
+                                                        },
+                                                        [](int32_t texID) { GFXDeleteTexture(texID); });
+float GenericViewer::smViewportHeight = 700.0f;
+
 class ViewController
 {
 public:
@@ -357,13 +369,111 @@ public:
    
    virtual void update(float dt) = 0;
    virtual bool isResourceLoaded() = 0;
+   
+   // Returns true if the view changes on its own (i.e. without input)
+   virtual bool isAnimating() { return false; }
 };
 
-class ShapeViewer : public GenericViewer
+// Texture used to stream transforms (or indices) to the shape shaders
+template<typename T> struct FrameTexInfo
 {
-public:
+   int32_t texID;
+   uint32_t memoryUsed;
+   uint32_t memorySize;
+   T* updateMem;
    
-   struct RuntimeMeshInfo
+   FrameTexInfo() : texID(-1), memoryUsed(0), memorySize(0), updateMem(NULL)
+   {
+   }
+   
+   void reset()
+   {
+      if (texID >= 0)
+      {
+         GFXDeleteTexture(texID);
+      }
+      if (updateMem)
+      {
+         MemTracker::trackFree(MemCategory_TransformBuffer, memorySize * sizeof(T));
+         delete[] updateMem;
+         updateMem = NULL;
+      }
+      texID = -1;
+      memoryUsed = 0;
+      memorySize = 0;
+   }
+   
+   uint32_t getRequiredDim()
+   {
+      uint32_t baseSize = static_cast<uint32_t>(std::pow(2, std::ceil(std::log2(std::sqrt(memoryUsed)))));
+      return std::min<uint32_t>(baseSize, 256);
+   }
+   
+   uint32_t allocTransforms(uint32_t numTransforms)
+   {
+      uint32_t offset = memoryUsed;
+      memoryUsed += numTransforms;
+      return offset;
+   }
+   
+   // initialCount is in elements of T
+   void ensureValid(uint32_t initialCount, T* initialMem)
+   {
+      if (memoryUsed > memorySize)
+      {
+         uint32_t pow2Size = getRequiredDim();
+         
+         if (updateMem)
+         {
+            MemTracker::trackFree(MemCategory_TransformBuffer, memorySize * sizeof(T));
+            delete[] updateMem;
+         }
+         
+         updateMem = new T[pow2Size * pow2Size];
+         MemTracker::trackAlloc(MemCategory_TransformBuffer, (pow2Size * pow2Size) * sizeof(T));
+         memset(updateMem, 0, (pow2Size * pow2Size) * sizeof(T));
+         if (initialMem)
+         {
+            memcpy(updateMem, initialMem, initialCount * sizeof(T));
+         }
+         memorySize = (pow2Size * pow2Size);
+         
+         if (texID >= 0)
+         {
+            GFXDeleteTexture(texID);
+         }
+         
+         texID = GFXLoadCustomTexture(CustomTexture_Float, pow2Size, pow2Size, updateMem);
+      }
+      else
+      {
+         if (initialMem)
+         {
+            memcpy(updateMem, initialMem, initialCount * sizeof(T));
+         }
+         GFXUpdateCustomTextureAligned(texID, updateMem);
+      }
+   }
+};
+
+class ShapeResourceManager;
+
+/*
+ Everything about a shape which stays the same once it's loaded: the parsed shape,
+ where each mesh lives in the merged model buffers, the base skin transforms and the
+ material textures. This is shared by every viewer showing the shape; viewers only
+ keep their own threads, node transforms and visibility.
+ */
+struct SharedShape
+{
+   enum
+   {
+      MaxMaterials = 256, // TS material groups reserved per shape
+      DeltaRingSlots = 4, // decoded frames kept in the vertex buffer per delta mesh
+      MeshletMinTriangles = 1024 // smaller meshes aren't worth culling per meshlet
+   };
+   
+   struct MeshInfo
    {
       Dts3::Mesh* mMesh;
       //
@@ -374,233 +484,222 @@ public:
       uint32_t mVertOffset;
       uint32_t mIndexOffset;
       //
-      uint32_t mMeshFrame;     // verts frame offset
-      uint32_t mMeshTexFrame;  // tverts frame offset
       uint32_t mMeshTransformOffset;
-      //
-      uint32_t mRenderFlags;
+      MeshInfo* mVertSource; // parent mesh whose verts are reused, if any
+      
+      // Delta encoded frames; decoded frames are kept in a ring of slots at mVertOffset
+      Dts3::DeltaFrames* mDeltaFrames;
+      int32_t mRingFrames[DeltaRingSlots];
+      uint32_t mRingUseFrame[DeltaRingSlots]; // render frame each slot was last drawn in
+      uint32_t mNextRingSlot;
+      
+      // Index range is reordered into meshlets; NULL if the mesh is drawn whole
+      MeshletSet* mMeshlets;
       
       bool mUseSkinData;
       
-      RuntimeMeshInfo() { memset(this, 0, sizeof(RuntimeMeshInfo)); }
-      ~RuntimeMeshInfo() {;}
+      MeshInfo() { memset(this, 0, sizeof(MeshInfo)); }
    };
    
-   struct RuntimeIflMaterialInfo
-   {
-      int32_t mFrame;
-   };
+   ShapeResourceManager* mManager;
+   std::string mKey;
+   Dts3::Shape* mShape;
+   uint32_t mRefCount;
+   uint32_t mGeneration; // bumped whenever mShape is replaced
    
-   struct RuntimeDecalInfo
-   {
-      int32_t mFrame;
-   };
+   uint32_t mModelID;
+   uint32_t mGroupBase;
    
-   struct RuntimeObjectInfo
-   {
-      uint32_t mObjectState;
-      bool mDraw;
-      
-      int32_t mLastMatFrame;
-      int32_t mLastMeshframe;
-      float mLastVis;
-      
-      RuntimeObjectInfo() : mLastMatFrame(0), mLastMeshframe(0), mLastVis(1.0), mDraw(true) {;}
-      ~RuntimeObjectInfo() {;}
-   };
+   std::vector<MeshInfo> mMeshInfos;
+   std::vector<int32_t> mMaterialTexIDs;
    
-   struct RuntimeDetailInfo
-   {
-      uint32_t startRenderObject;
-      uint32_t numRenderObjects;
-      uint32_t meshIndex;
-      
-      RuntimeDetailInfo() {;}
-      RuntimeDetailInfo(uint32_t so, uint32_t nro) : startRenderObject(so), numRenderObjects(nro) {;}
-   };
+   FrameTexInfo<float> mMeshTransformsTex;
+   FrameTexInfo<uint32_t> mMeshIndexTex;
    
-   std::vector<Dts3::Thread> mThreads;
+   // Delta frame encoding for animated meshes
+   bool mUseDeltaFrames;
+   size_t mDeltaBytes;    // encoded size of all delta meshes
+   size_t mDeltaRawBytes; // size of the same frames as ModelVertex
+   std::vector<ModelVertex> mDecodeScratch;
    
-   Dts3::Shape* mShape;
+   static uint32_t smRenderFrame; // bumped once per rendered frame
    
-   std::vector<slm::mat4> mNodeTransforms; // Current transform list
-   std::vector<slm::quat> mActiveRotations; // non-gl xfms
-   std::vector<slm::vec4> mActiveTranslations; // non-gl xfms
-   std::vector<slm::vec3> mActiveScales; // non-gl xfms
+   // Meshlets for large static meshes
+   bool mUseMeshlets;
+   uint32_t mNumMeshlets;
+   size_t mMeshletBytes;
    
-   std::vector<RuntimeMeshInfo> mRuntimeMeshInfos;
-   std::vector<RuntimeObjectInfo> mRuntimeObjectInfos;
-   std::vector<RuntimeIflMaterialInfo> mRuntimeIflMaterialInfos;
-   std::vector<RuntimeDecalInfo> mRuntimeDecalInfos;
-   std::vector<RuntimeDetailInfo> mRuntimeDetailInfos;
+   // Compressed node keyframes; one report per sequence
+   size_t mKeyframeBytes;
+   size_t mKeyframeRawBytes;
+   std::vector<Dts3::KeyframeCurves::SequenceReport> mKeyframeReports;
    
-   int32_t mDefaultMaterials;
-   int32_t mAlwaysNode;
-   int32_t mCurrentDetail;
+   SharedShape() : mManager(NULL), mShape(NULL), mRefCount(0), mGeneration(0), mModelID(0), mGroupBase(0),
+   mUseDeltaFrames(true), mDeltaBytes(0), mDeltaRawBytes(0), mUseMeshlets(true), mNumMeshlets(0), mMeshletBytes(0),
+   mKeyframeBytes(0), mKeyframeRawBytes(0)
+   {
+   }
    
-   template<typename T> struct TransformTexInfo
+   ~SharedShape()
    {
-      int32_t texID;
-      uint32_t memoryUsed;
-      uint32_t memorySize;
-      T* updateMem;
+      clear();
+   }
+   
+   void init(ResManager* resManager)
+   {
+      initShapeObjects();
+      initRenderMaterials();
+      initMeshes();
+      initVertexBuffer();
+      initMaterials(resManager);
+   }
+   
+   void clear()
+   {
+      clearModel();
       
-      TransformTexInfo() : texID(-1), memoryUsed(0), memorySize(0), updateMem(NULL)
-      {
-      }
+      for (int32_t texID : mMaterialTexIDs) { GenericViewer::releaseMaterialTexture(texID); }
+      mMaterialTexIDs.clear();
+      
+      if (mShape)
+         delete mShape;
+      mShape = NULL;
+   }
+   
+   // Frees everything built from mShape's meshes; materials are left alone
+   void clearModel()
+   {
+      mMeshTransformsTex.reset();
+      mMeshIndexTex.reset();
       
-      void reset()
+      GFXClearModelData(mModelID);
+      
+      for (MeshInfo& info : mMeshInfos)
       {
-         if (texID >= 0)
-         {
-            GFXDeleteTexture(texID);
-         }
-         if (updateMem)
-         {
-            delete[] updateMem;
-            updateMem = NULL;
-         }
-         texID = -1;
+         if (info.mDeltaFrames)
+            delete info.mDeltaFrames;
+         if (info.mMeshlets)
+            delete info.mMeshlets;
       }
+      mMeshInfos.clear();
+      
+      MemTracker::trackResize(MemCategory_ModelData, mDeltaBytes, 0);
+      mDeltaBytes = 0;
+      mDeltaRawBytes = 0;
+      MemTracker::trackResize(MemCategory_ModelData, mMeshletBytes, 0);
+      mMeshletBytes = 0;
+      mNumMeshlets = 0;
+   }
+   
+   // Rebuilds the model from shape, which has the same materials as the current
+   // one (e.g. with generated detail levels added). Returns the old shape, which
+   // the caller frees once nothing refers to it.
+   Dts3::Shape* replaceShape(Dts3::Shape* shape)
+   {
+      clearModel();
       
-      uint32_t getRequiredDim()
+      Dts3::Shape* oldShape = mShape;
+      mShape = shape;
+      initShapeObjects();
+      initRenderMaterials();
+      initMeshes();
+      initVertexBuffer();
+      mGeneration++;
+      return oldShape;
+   }
+   
+   void initShapeObjects()
+   {
+      for (Dts3::Node& n : mShape->mNodes)
       {
-         uint32_t baseSize = static_cast<uint32_t>(std::pow(2, std::ceil(std::log2(std::sqrt(memoryUsed)))));
-         return std::min<uint32_t>(baseSize, 256);
+         n.resetRuntime();
       }
-      
-      uint32_t allocTransforms(uint32_t numTransforms)
+      for (Dts3::Object& o : mShape->mObjects)
       {
-         uint32_t offset = memoryUsed;
-         memoryUsed += numTransforms;
-         return offset;
+         o.resetRuntime();
       }
       
-      void ensureValid(uint32_t initialTransformSize, T* initialMem)
+      // Assign sibling nodes
+      for (uint32_t i=0; i<mShape->mNodes.size(); i++)
       {
-         if (memoryUsed > memorySize)
+         Dts3::Node& n = mShape->mNodes[i];
+         int32_t parentIdx = n.parent;
+         
+         if (parentIdx >= 0)
          {
-            uint32_t pow2Size = getRequiredDim();
-            
-            if (updateMem)
+            if (mShape->mNodes[parentIdx].firstChild < 0)
             {
-               delete[] updateMem;
+               mShape->mNodes[parentIdx].firstChild = i;
             }
-            
-            updateMem = new T[pow2Size * pow2Size];
-            memset(updateMem, 0, (pow2Size * pow2Size) * sizeof(T));
-            if (initialMem)
+            else
             {
-               memcpy(updateMem, initialMem, initialTransformSize * sizeof(T) * 16);
+               int32_t childIdx=mShape->mNodes[parentIdx].firstChild;
+               while (mShape->mNodes[childIdx].nextSibling>=0)
+               {
+                  childIdx = mShape->mNodes[childIdx].nextSibling;
+               }
+               mShape->mNodes[childIdx].nextSibling = i;
             }
-            memorySize = (pow2Size * pow2Size);
-            
-            if (texID >= 0)
+         }
+      }
+      
+      // Assign sibling objects
+      for (uint32_t i=0; i<mShape->mObjects.size(); i++)
+      {
+         Dts3::Object& o = mShape->mObjects[i];
+         int32_t nodeIdx = o.node;
+         
+         if (nodeIdx >= 0)
+         {
+            if (mShape->mNodes[nodeIdx].firstObject < 0)
             {
-               GFXDeleteTexture(texID);
+               mShape->mNodes[nodeIdx].firstObject = i;
             }
-            
-            texID = GFXLoadCustomTexture(CustomTexture_Float, pow2Size, pow2Size, updateMem);
+            else
+            {
+               int32_t objectIdx=mShape->mNodes[nodeIdx].firstObject;
+               while (mShape->mObjects[objectIdx].nextSibling>=0)
+               {
+                  objectIdx = mShape->mObjects[objectIdx].nextSibling;
+               }
+               mShape->mObjects[objectIdx].nextSibling = i;
+            }
+         }
+      }
+      
+      // Assign sibling decals
+      for (uint32_t i=0; i<mShape->mDecals.size(); i++)
+      {
+         Dts3::Decal& d = mShape->mDecals[i];
+         int32_t objectIdx = d.object;
+      
+         if (mShape->mObjects[objectIdx].firstDecal < 0)
+         {
+            mShape->mObjects[objectIdx].firstDecal = i;
          }
          else
          {
-            if (initialMem)
+            int32_t decalIdx=mShape->mObjects[objectIdx].firstDecal;
+            while (mShape->mDecals[decalIdx].nextSibling>=0)
             {
-               memcpy(updateMem, initialMem, initialTransformSize * sizeof(T) * 16);
+               decalIdx = mShape->mDecals[decalIdx].nextSibling;
             }
-            GFXUpdateCustomTextureAligned(texID, updateMem);
+            mShape->mObjects[decalIdx].nextSibling = i;
          }
       }
-   };
-   
-   typedef FrameTexInfo<float> TransformTexInfo;
-   typedef FrameTexInfo<uint32_t> TransformIndexTexInfo;
-   
-   TransformTexInfo nodeMeshTransformsTex;
-   TransformIndexTexInfo nodeMeshIndexTex;
-   TransformTexInfo nodeInstTransformsTex;
-   
-   
-   ShapeViewer(ResManager* res)
-   {
-      mShape = NULL;
-      mResourceManager = res;
-      initVB = false;
-   }
-   
-   ~ShapeViewer()
-   {
-      clear();
-   }
-   
-   void clear()
-   {
-      nodeMeshTransformsTex.reset();
-      nodeMeshIndexTex.reset();
-      nodeInstTransformsTex.reset();
-      
-      clearVertexBuffer();
-      clearTextures();
-      clearRender();
-   }
-   
-   void initRender()
-   {
-      mLightColor = slm::vec4(1,1,1,1);
-      mLightPos = slm::vec3(0,2, 2);
-      if (mShape == NULL)
-         return;
-      
-      mRuntimeMeshInfos.resize(mShape->mMeshes.size());
-      mRuntimeObjectInfos.resize(mShape->mObjects.size());
-      mRuntimeIflMaterialInfos.resize(mShape->mIflMaterials.size());
-      mRuntimeDecalInfos.resize(mShape->mDecals.size());
-      mRuntimeDetailInfos.resize(mShape->mDetailLevels.size());
-      
-      std::vector<slm::mat4> meshTransforms;
-      std::vector<uint32_t> boneIndexes;
-      
-      // Load meshes
-      uint32_t count = 0;
-      for (RuntimeMeshInfo& rm : mRuntimeMeshInfos)
-      {
-         rm.mMesh = &mShape->mMeshes[count];
-         rm.mMeshTransformOffset = meshTransforms.size();
-         
-         Dts3::SkinData* sd = rm.mMesh->getSkinData();
-         if (sd)
-         {
-            for (slm::mat4 mt : sd->nodeTransforms)
-            {
-               // TODO: transpose?
-               meshTransforms.push_back(mt);
-            }
-            for (uint32_t idx : sd->nodeIndex)
-            {
-               boneIndexes.push_back(idx);
-            }
-         }
-         
-         count++;
-      }
       
-      // Load base skin transforms texture
-      nodeMeshTransformsTex.reset();
-      if (meshTransforms.size() > 0)
+      // Set runtime flag for sequence
+      mShape->mRuntimeFlags = 0;
+      for (Dts3::Sequence& seq : mShape->mSequences)
       {
-         nodeMeshTransformsTex.allocTransforms(meshTransforms.size() * 16);
-         nodeMeshTransformsTex.ensureValid(meshTransforms.size(), (float*)&meshTransforms[0]);
+         if (!seq.testFlags(Dts3::Shape::AnyScale))
+            continue;
          
-         nodeMeshIndexTex.allocTransforms(boneIndexes.size());
-         nodeMeshTransformsTex.ensureValid(boneIndexes.size(), (uint32_t*)&boneIndexes[0]);
+         uint8_t baseFlag = mShape->mRuntimeFlags & Dts3::Shape::AnyScale;
+         uint8_t seqFlag = seq.flags & Dts3::Shape::AnyScale;
+         mShape->mRuntimeFlags &= ~Dts3::Shape::AnyScale;
+         mShape->mRuntimeFlags |= std::max(baseFlag, seqFlag);
       }
-      
-      // Alloc node transform texture for single instance
-      nodeInstTransformsTex.reset();
-      nodeInstTransformsTex.allocTransforms(mShape->mNodes.size() * 16);
-      nodeInstTransformsTex.ensureValid(0, NULL);
-      
-      initRenderMaterials();
    }
    
    void initRenderMaterials()
@@ -613,10 +712,10 @@ public:
          // firstObject...numObjects instead of firstObject..(firstObject+numObjects)
          // IN ADDITION: to keep things simple, we ignore primitives on decal meshes.
          s.firstTranslucent = s.firstObject + s.numObjects;
-         for (uint32_t i=0; i<s.numObjects; i++)
+         for (int32_t i=0; i<s.numObjects; i++)
          {
             Dts3::Object& obj = mShape->mObjects[s.firstObject+i];
-            for (uint32_t j=0; j<obj.numMeshes; j++)
+            for (int32_t j=0; j<obj.numMeshes; j++)
             {
                Dts3::Mesh& mesh = mShape->mMeshes[obj.firstMesh + j];
                Dts3::BasicData* bd = mesh.getBasicData();
@@ -653,155 +752,191 @@ public:
       }
    }
    
-   void clearRender()
-   {
-      nodeMeshTransformsTex.reset();
-      nodeMeshIndexTex.reset();
-      nodeInstTransformsTex.reset();
-   }
-   
-   // Sequence Handling
-   
-   
-   uint32_t addThread()
-   {
-      return 0;
-   }
-   
-   void setThreadSequence(uint32_t idx, int32_t sequenceId)
-   {
-   }
-   
-   void removeThread(uint32_t idx)
-   {
-   }
-   
-   void advanceThreads(float dt)
-   {
-   }
-   
-   void updateTransformTexture()
+   void initMeshes()
    {
-      // TODO
+      mMeshInfos.resize(mShape->mMeshes.size());
+      
+      std::vector<slm::mat4> meshTransforms;
+      std::vector<uint32_t> boneIndexes;
+      
+      uint32_t count = 0;
+      for (MeshInfo& info : mMeshInfos)
+      {
+         info.mMesh = &mShape->mMeshes[count];
+         info.mMeshTransformOffset = meshTransforms.size();
+         info.mVertSource = NULL;
+         
+         // Child skins alias their parent's transforms
+         Dts3::SkinData* sd = info.mMesh->getSkinData();
+         int32_t parent = info.mMesh->mParent;
+         Dts3::SkinData* parentSd = (parent >= 0 && parent < (int32_t)count) ? mShape->mMeshes[parent].getSkinData() : NULL;
+         if (sd && parentSd && sd->nodeTransforms.sharesWith(parentSd->nodeTransforms))
+         {
+            info.mMeshTransformOffset = mMeshInfos[parent].mMeshTransformOffset;
+         }
+         else if (sd)
+         {
+            for (slm::mat4 mt : sd->nodeTransforms)
+            {
+               // TODO: transpose?
+               meshTransforms.push_back(mt);
+            }
+            for (uint32_t idx : sd->nodeIndex)
+            {
+               boneIndexes.push_back(idx);
+            }
+         }
+         
+         count++;
+      }
+      
+      // Load base skin transforms texture
+      if (meshTransforms.size() > 0)
+      {
+         mMeshTransformsTex.allocTransforms(meshTransforms.size() * 16);
+         mMeshTransformsTex.ensureValid(meshTransforms.size() * 16, (float*)&meshTransforms[0]);
+         
+         mMeshIndexTex.allocTransforms(boneIndexes.size());
+         mMeshIndexTex.ensureValid(boneIndexes.size(), &boneIndexes[0]);
+      }
    }
    
-   void animateNodes()
-   {
-      updateTransformTexture();
+   // Returns the mesh whose GPU vertex range info can reuse, or NULL if info needs its own.
+   // Child meshes alias their parent's vertex arrays, so can point at the parent's range
+   // as long as both live in the same (skinned or basic) part of the buffer.
+   MeshInfo* findVertSource(const MeshInfo& info)
+   {
+      int32_t parent = info.mMesh->mParent;
+      if (parent < 0 || parent >= (int32_t)(&info - &mMeshInfos[0]))
+         return NULL;
+      
+      MeshInfo& parentInfo = mMeshInfos[parent];
+      Dts3::BasicData* bd = info.mMesh->getBasicData();
+      Dts3::BasicData* parentBd = parentInfo.mMesh->getBasicData();
+      if (bd == NULL || parentBd == NULL)
+         return NULL;
+      if ((info.mMesh->getSkinData() != NULL) != (parentInfo.mMesh->getSkinData() != NULL))
+         return NULL;
+      if (!bd->verts.sharesWith(parentBd->verts) || !bd->tverts.sharesWith(parentBd->tverts))
+         return NULL;
+      
+      return parentInfo.mVertSource ? parentInfo.mVertSource : &parentInfo;
    }
    
-   // Loading
-   
-   void loadShape(Dts3::Shape& inShape)
+   // Encodes the frames of an animated mesh as deltas, if worthwhile
+   bool initDeltaFrames(MeshInfo& info)
    {
-      clear();
+      Dts3::Mesh* mesh = info.mMesh;
+      Dts3::BasicData* bd = mesh->getBasicData();
+      if (!mUseDeltaFrames || bd == NULL || mesh->getSortedData() || mesh->getSkinData())
+         return false;
       
-      mShape = &inShape;
+      uint32_t vertsPerFrame = mesh->mVertsPerFrame;
+      if (mesh->mNumFrames <= 1 || vertsPerFrame == 0 ||
+          bd->verts.size() != vertsPerFrame * mesh->mNumFrames ||
+          bd->normals.size() != bd->verts.size())
+         return false;
       
-      initShapeObjects();
+      // Keep errors well below what's visible at the shape's scale
+      float maxError = std::max(mesh->mRadius, 1.0f) / 4096.0f;
       
-      // Setup default pose for nodes
-      animateNodes();
+      Dts3::DeltaFrames* frames = new Dts3::DeltaFrames();
+      if (!frames->encode(bd->verts.data(), bd->normals.data(), vertsPerFrame, mesh->mNumFrames, maxError) ||
+          frames->getDataSize() >= frames->getRawSize())
+      {
+         delete frames;
+         return false;
+      }
+      
+      info.mDeltaFrames = frames;
+      mDeltaBytes += frames->getDataSize();
+      mDeltaRawBytes += frames->getRawSize();
+      MemTracker::trackAlloc(MemCategory_ModelData, frames->getDataSize());
+      return true;
    }
    
-   void initShapeObjects()
+   // Splits the triangles of a large static mesh into meshlets. outInds is the mesh's
+   // copy of its indices in the index buffer, which gets reordered to match.
+   bool initMeshlets(MeshInfo& info, uint16_t* outInds)
    {
-      for (Dts3::Node& n : mShape->mNodes)
+      Dts3::Mesh* mesh = info.mMesh;
+      Dts3::BasicData* bd = mesh->getBasicData();
+      if (!mUseMeshlets || bd == NULL || mesh->getSortedData() || mesh->getSkinData() || mesh->mNumFrames > 1)
+         return false;
+      if (mesh->getPolyCount() < MeshletMinTriangles || bd->normals.size() < bd->verts.size())
+         return false;
+      
+      for (const Dts3::Primitive& prim : bd->primitives)
       {
-         n.resetRuntime();
+         if ((prim.matIndex & Dts3::Primitive::TypeMask) != Dts3::Primitive::Triangles)
+            return false;
       }
-      for (Dts3::Object& o : mShape->mObjects)
+      
+      MeshletSet* meshlets = new MeshletSet();
+      for (uint32_t i=0; i<bd->primitives.size(); i++)
       {
-         o.resetRuntime();
+         const Dts3::Primitive& prim = bd->primitives[i];
+         meshlets->build(bd->verts.data(), bd->normals.data(), (uint32_t)bd->verts.size(),
+                         outInds, prim.firstElement, prim.numElements, i);
       }
       
-      // Assign sibling nodes
-      for (int32_t i=0; i<mShape->mNodes.size(); i++)
+      if (meshlets->mMeshlets.size() < 2)
       {
-         Dts3::Node& n = mShape->mNodes[i];
-         int32_t parentIdx = n.parent;
-         
-         if (parentIdx >= 0)
-         {
-            if (mShape->mNodes[parentIdx].firstChild < 0)
-            {
-               mShape->mNodes[parentIdx].firstChild = i;
-            }
-            else
-            {
-               int32_t childIdx=mShape->mNodes[parentIdx].firstChild;
-               while (mShape->mNodes[childIdx].nextSibling>=0)
-               {
-                  childIdx = mShape->mNodes[childIdx].nextSibling;
-               }
-               mShape->mNodes[childIdx].nextSibling = i;
-            }
-         }
+         delete meshlets;
+         return false;
       }
       
-      // Assign sibling objects
-      for (int32_t i=0; i<mShape->mObjects.size(); i++)
+      meshlets->finalize();
+      info.mMeshlets = meshlets;
+      mNumMeshlets += (uint32_t)meshlets->mMeshlets.size();
+      mMeshletBytes += meshlets->getMemoryUsage();
+      MemTracker::trackAlloc(MemCategory_ModelData, meshlets->getMemoryUsage());
+      return true;
+   }
+   
+   // Returns the vertex offset of frame in info's vertex range, decoding it first for delta meshes
+   uint32_t getFrameVertOffset(const MeshInfo& info, uint32_t frame)
+   {
+      const MeshInfo* src = info.mVertSource ? info.mVertSource : &info;
+      if (src->mDeltaFrames == NULL)
+         return info.mVertOffset + (frame * info.mRealVertsPerFrame);
+      
+      MeshInfo& ring = mMeshInfos[src - &mMeshInfos[0]];
+      uint32_t vertsPerFrame = ring.mDeltaFrames->mVertsPerFrame;
+      for (uint32_t slot=0; slot<DeltaRingSlots; slot++)
       {
-         Dts3::Object& o = mShape->mObjects[i];
-         int32_t nodeIdx = o.node;
-         
-         if (nodeIdx >= 0)
+         if (ring.mRingFrames[slot] == (int32_t)frame)
          {
-            if (mShape->mNodes[nodeIdx].firstObject < 0)
-            {
-               mShape->mNodes[nodeIdx].firstObject = i;
-            }
-            else
-            {
-               int32_t objectIdx=mShape->mNodes[nodeIdx].firstObject;
-               while (mShape->mObjects[objectIdx].nextSibling>=0)
-               {
-                  objectIdx = mShape->mObjects[objectIdx].nextSibling;
-               }
-               mShape->mObjects[objectIdx].nextSibling = i;
-            }
+            ring.mRingUseFrame[slot] = smRenderFrame;
+            return ring.mVertOffset + (slot * vertsPerFrame);
          }
       }
       
-      // Assign sibling decals
-      for (int32_t i=0; i<mShape->mDecals.size(); i++)
+      // Prefer a slot nothing has drawn from this frame, so it can be overwritten in place
+      uint32_t slot = ring.mNextRingSlot;
+      for (uint32_t i=0; i<DeltaRingSlots; i++)
       {
-         Dts3::Decal& d = mShape->mDecals[i];
-         int32_t objectIdx = d.object;
-      
-         if (mShape->mObjects[objectIdx].firstDecal < 0)
-         {
-            mShape->mObjects[objectIdx].firstDecal = i;
-         }
-         else
+         uint32_t candidate = (ring.mNextRingSlot + i) % DeltaRingSlots;
+         if (ring.mRingUseFrame[candidate] != smRenderFrame)
          {
-            int32_t decalIdx=mShape->mObjects[objectIdx].firstDecal;
-            while (mShape->mDecals[decalIdx].nextSibling>=0)
-            {
-               decalIdx = mShape->mDecals[decalIdx].nextSibling;
-            }
-            mShape->mObjects[decalIdx].nextSibling = i;
+            slot = candidate;
+            break;
          }
       }
+      bool inUse = ring.mRingUseFrame[slot] == smRenderFrame;
+      ring.mNextRingSlot = (slot + 1) % DeltaRingSlots;
+      ring.mRingFrames[slot] = frame;
+      ring.mRingUseFrame[slot] = smRenderFrame;
       
-      // Set runtime flag for sequence
-      mShape->mRuntimeFlags = 0;
-      for (Dts3::Sequence& seq : mShape->mSequences)
-      {
-         if (!seq.testFlags(Dts3::Shape::AnyScale))
-            continue;
-         
-         uint8_t baseFlag = mShape->mRuntimeFlags & Dts3::Shape::AnyScale;
-         uint8_t seqFlag = seq.flags & Dts3::Shape::AnyScale;
-         mShape->mRuntimeFlags &= ~Dts3::Shape::AnyScale;
-         mShape->mRuntimeFlags |= std::max(baseFlag, seqFlag);
-      }
+      uint32_t offset = ring.mVertOffset + (slot * vertsPerFrame);
+      mDecodeScratch.resize(vertsPerFrame);
+      ring.mDeltaFrames->decodeFrame(frame, &mDecodeScratch[0]);
+      GFXUpdateModelVerts(mModelID, offset, &mDecodeScratch[0], vertsPerFrame, inUse);
+      return offset;
    }
    
    void initVertexBuffer()
    {
-      clearVertexBuffer();
-      
       /*
        NOTE: We put skin data first, then follow it with basic data. This is so
        we can bind the skin data without dealing with alignment issues.
@@ -810,50 +945,60 @@ public:
       std::vector<ModelVertex> modelVerts;
       std::vector<ModelTexVertex> modelTexVerts;
       std::vector<ModelSkinVertex> packedSkinVertices;
-      std::vector<RuntimeMeshInfo*> skinMeshList;
-      std::vector<RuntimeMeshInfo*> basicMeshList;
+      std::vector<MeshInfo*> skinMeshList;
+      std::vector<MeshInfo*> basicMeshList;
       std::vector<uint16_t> modelInds;
       
       // Load meshes
-      uint32_t count = 0;
       uint32_t vertCount = 0;
       uint32_t indexCount = 0;
       uint32_t skinVertCount = 0;
       
-      for (RuntimeMeshInfo& rm : mRuntimeMeshInfos)
+      for (MeshInfo& info : mMeshInfos)
       {
-         ModelVertex* mv = NULL;
-         Dts3::BasicData* bd = rm.mMesh->getBasicData();
-         Dts3::BasicData* sd = rm.mMesh->getSkinData();
+         Dts3::BasicData* bd = info.mMesh->getBasicData();
+         Dts3::BasicData* sd = info.mMesh->getSkinData();
+         
+         info.mVertSource = findVertSource(info);
+         uint32_t numNewVerts = info.mVertSource ? 0 : (bd ? bd->verts.size() : 0);
          
          if (sd)
          {
-            rm.mVertCount = sd->verts.size();
-            skinVertCount += sd->verts.size();
-            skinMeshList.push_back(&rm);
-            rm.mUseSkinData = true;
+            info.mVertCount = sd->verts.size();
+            skinVertCount += numNewVerts;
+            skinMeshList.push_back(&info);
+            info.mUseSkinData = true;
          }
          else if (bd)
          {
-            rm.mVertCount = bd->verts.size();
-            vertCount += bd->verts.size();
-            basicMeshList.push_back(&rm);
-            rm.mUseSkinData = false;
+            info.mVertCount = bd->verts.size();
+            if (info.mVertSource == NULL && initDeltaFrames(info))
+            {
+               // Only the ring of decoded frames goes in the buffer
+               info.mVertCount = info.mDeltaFrames->mVertsPerFrame * DeltaRingSlots;
+               numNewVerts = info.mVertCount;
+            }
+            vertCount += numNewVerts;
+            basicMeshList.push_back(&info);
+            info.mUseSkinData = false;
          }
          
          if (bd)
          {
-            rm.mRealVertsPerFrame = rm.mMesh->mVertsPerFrame;
-            rm.mIndexCount = indexCount;
+            info.mRealVertsPerFrame = info.mMesh->mVertsPerFrame;
+            info.mIndexCount = bd->indices.size();
             indexCount += bd->indices.size();
          }
          else
          {
-            rm.mRealVertsPerFrame = 0;
-            rm.mIndexCount = 0;
+            info.mRealVertsPerFrame = 0;
+            info.mIndexCount = 0;
          }
       }
       
+      if (vertCount + skinVertCount == 0 || indexCount == 0)
+         return;
+      
       modelVerts.resize(vertCount + skinVertCount);
       modelTexVerts.resize(vertCount + skinVertCount);
       if (skinMeshList.size() != 0)
@@ -864,547 +1009,2132 @@ public:
       
       skinVertCount = 0;
       indexCount = 0;
-      for (RuntimeMeshInfo* rm : skinMeshList)
+      for (MeshInfo* info : skinMeshList)
       {
-         Dts3::SkinData* sd = rm->mMesh->getSkinData();
+         Dts3::SkinData* sd = info->mMesh->getSkinData();
          
-         // Copy verts
-         Dts3::EmitModelVertices(sd, &modelVerts[skinVertCount]);
-         Dts3::EmitModelTexVertices(sd, &modelTexVerts[skinVertCount]);
-         Dts3::EmitPackedSkinVertices(sd, &packedSkinVertices[skinVertCount]);
+         // Copy verts, unless they're already in the buffer
+         if (info->mVertSource)
+         {
+            info->mVertOffset = info->mVertSource->mVertOffset;
+         }
+         else
+         {
+            Dts3::EmitModelVertices(sd, &modelVerts[skinVertCount]);
+            Dts3::EmitModelTexVertices(sd, &modelTexVerts[skinVertCount]);
+            Dts3::EmitPackedSkinVertices(sd, &packedSkinVertices[skinVertCount]);
+            info->mVertOffset = skinVertCount;
+            skinVertCount += info->mVertCount;
+         }
          memcpy(&modelInds[indexCount], &sd->indices[0], sizeof(uint16_t) * sd->indices.size());
          
          // Count & offsets
-         rm->mVertOffset = skinVertCount;
-         rm->mIndexOffset = indexCount;
-         skinVertCount += rm->mVertCount;
-         indexCount += rm->mIndexCount;
+         info->mIndexOffset = indexCount;
+         indexCount += info->mIndexCount;
       }
       
       vertCount = skinVertCount;
-      for (RuntimeMeshInfo* rm : basicMeshList)
+      for (MeshInfo* info : basicMeshList)
       {
-         Dts3::BasicData* bd = rm->mMesh->getBasicData();
+         Dts3::BasicData* bd = info->mMesh->getBasicData();
          
-         // Copy verts
-         Dts3::EmitModelVertices(bd, &modelVerts[vertCount]);
-         Dts3::EmitModelTexVertices(bd, &modelTexVerts[vertCount]);
+         // Copy verts, unless they're already in the buffer
+         if (info->mVertSource)
+         {
+            info->mVertOffset = info->mVertSource->mVertOffset;
+         }
+         else if (info->mDeltaFrames)
+         {
+            // Ring starts with frame 0 in the first slot; every slot uses the base tverts
+            uint32_t vertsPerFrame = info->mDeltaFrames->mVertsPerFrame;
+            uint32_t numTVerts = std::min<uint32_t>(vertsPerFrame, bd->tverts.size());
+            info->mDeltaFrames->decodeFrame(0, &modelVerts[vertCount]);
+            for (uint32_t slot=0; slot<DeltaRingSlots; slot++)
+            {
+               ModelTexVertex* outTex = &modelTexVerts[vertCount + (slot * vertsPerFrame)];
+               for (uint32_t i=0; i<numTVerts; i++)
+                  outTex[i].texcoord = bd->tverts[i];
+               info->mRingFrames[slot] = slot == 0 ? 0 : -1;
+            }
+            info->mNextRingSlot = 1;
+            info->mVertOffset = vertCount;
+            vertCount += info->mVertCount;
+         }
+         else
+         {
+            Dts3::EmitModelVertices(bd, &modelVerts[vertCount]);
+            Dts3::EmitModelTexVertices(bd, &modelTexVerts[vertCount]);
+            info->mVertOffset = vertCount;
+            vertCount += info->mVertCount;
+         }
          memcpy(&modelInds[indexCount], &bd->indices[0], sizeof(uint16_t) * bd->indices.size());
+         initMeshlets(*info, &modelInds[indexCount]);
          
          // Count & offsets
-         rm->mVertOffset = vertCount;
-         rm->mIndexOffset = indexCount;
-         vertCount += rm->mVertCount;
-         indexCount += rm->mIndexCount;
+         info->mIndexOffset = indexCount;
+         indexCount += info->mIndexCount;
       }
       
-      if (packedSkinVertices.size() == 0)
-      {
-         GFXLoadModelData(0, &modelVerts[0], &modelTexVerts[0], &modelInds, &packedSkinVertices, modelVerts.size(), modelTexVerts.size(), modelInds.size());
-      }
-      else
-      {
-         GFXLoadModelData(0, &modelVerts[0], &modelTexVerts[0], &modelInds, NULL, modelVerts.size(), modelTexVerts.size(), modelInds.size());
-      }
-   }
-   
-   void clearVertexBuffer()
-   {
-      if (!initVB)
-         return;
+      GFXLoadModelData(mModelID, &modelVerts[0], &modelTexVerts[0], &modelInds[0],
+                       packedSkinVertices.size() > 0 ? &packedSkinVertices[0] : NULL,
+                       modelVerts.size(), modelTexVerts.size(), modelInds.size());
       
-      GFXLoadModelData(0, NULL, NULL, NULL, NULL, 0, 0, 0);
-      initVB = false;
+      freeDeltaSourceFrames();
    }
    
-   // Rendering
-   
-   void determineNodeVisibility()
+   // Delta meshes decode from mDeltaFrames, so only the first frame of the raw verts &
+   // normals is kept (for anything which wants the mesh at rest). Storage which is
+   // aliased by a mesh not drawn from the ring is left alone.
+   void freeDeltaSourceFrames()
    {
-   }
+      bool freed = false;
+      for (MeshInfo& info : mMeshInfos)
+      {
+         if (info.mDeltaFrames == NULL)
+            continue;
+         
+         Dts3::BasicData* bd = info.mMesh->getBasicData();
+         uint32_t numVertAliases = 0;
+         uint32_t numNormalAliases = 0;
+         for (MeshInfo& other : mMeshInfos)
+         {
+            Dts3::BasicData* otherBd = other.mMesh->getBasicData();
+            if (otherBd == NULL || (&other != &info && other.mVertSource != &info))
+               continue;
+            
+            numVertAliases += otherBd->verts.sharesWith(bd->verts) ? 1 : 0;
+            numNormalAliases += otherBd->normals.sharesWith(bd->normals) ? 1 : 0;
+         }
+         
+         if (numVertAliases != bd->verts.getRefCount() || numNormalAliases != bd->normals.getRefCount())
+            continue;
+         
+         bd->verts.shrink(info.mDeltaFrames->mVertsPerFrame);
+         bd->normals.shrink(info.mDeltaFrames->mVertsPerFrame);
+         freed = true;
+      }
+      
+      if (freed)
+         mShape->updateMemoryTracking();
+   }
    
-   void selectDetail(float dist, int w, int h)
+   void initMaterials(ResManager* resManager)
    {
-      mCurrentDetail = 0;
+      mMaterialTexIDs.resize(mShape->mMaterials.size());
+      for (uint32_t i=0; i<mShape->mMaterials.size(); i++)
+      {
+         mMaterialTexIDs[i] = GenericViewer::loadMaterialTexture(resManager, mShape->mMaterials[i].name.c_str());
+         if (i < MaxMaterials)
+            GFXSetTSMaterialResources(mGroupBase + i, mMaterialTexIDs[i], -1, -1, -1);
+      }
+   }
+};
+
+uint32_t SharedShape::smRenderFrame = 0;
+
+// Refcounted reference to a SharedShape; the shape is freed when the last one is released
+class ShapeHandle
+{
+public:
+   ShapeHandle() : mShared(NULL) {;}
+   explicit ShapeHandle(SharedShape* shared) : mShared(shared) { if (mShared) mShared->mRefCount++; }
+   ShapeHandle(const ShapeHandle& other) : ShapeHandle(other.mShared) {;}
+   ShapeHandle(ShapeHandle&& other) : mShared(other.mShared) { other.mShared = NULL; }
+   ~ShapeHandle() { reset(); }
+   
+   ShapeHandle& operator=(const ShapeHandle& other)
+   {
+      if (other.mShared)
+         other.mShared->mRefCount++;
+      reset();
+      mShared = other.mShared;
+      return *this;
    }
    
-   void drawLine(slm::vec3 start, slm::vec3 end, slm::vec4 color, float width)
+   ShapeHandle& operator=(ShapeHandle&& other)
    {
-      updateMVP();
-      GFXBeginLinePipelineState();
-      GFXDrawLine(start, end, color, width);
+      if (this != &other)
+      {
+         reset();
+         mShared = other.mShared;
+         other.mShared = NULL;
+      }
+      return *this;
    }
    
-   void render()
+   void reset();
+   
+   inline bool isValid() const { return mShared != NULL; }
+   inline SharedShape* get() const { return mShared; }
+   inline SharedShape* operator->() const { return mShared; }
+   
+protected:
+   SharedShape* mShared;
+};
+
+/*
+ Loads each shape once and hands out handles to it, so any number of viewers or
+ placed instances of the same file share one copy of the shape and its GPU data.
+ Shapes are keyed by lowercase filename (and forced mount, if any).
+ 
+ Generated detail levels are cooked on the async reader's workers from a fresh
+ copy of the file; update() swaps the cooked copy in once it's done.
+ 
+ NOTE: handles are only used from the main thread, so refcounts aren't atomic.
+ All handles need to be released before GFXTeardown.
+ */
+class ShapeResourceManager
+{
+public:
+   struct Stats
+   {
+      uint32_t numLoads;  // shapes read from disk
+      uint32_t numShared; // acquires which reused a loaded shape
+      uint64_t deltaBytes;    // delta encoded animation frames
+      uint64_t deltaRawBytes; // the same frames unencoded
+      uint32_t numLODsGenerated; // shapes given generated detail levels
+      uint32_t numLODsCached;    // ... of which came from the LOD cache
+      float lodMS;
+      uint32_t numMeshlets; // across all loaded shapes
+      uint64_t keyframeBytes;    // compressed node keyframes
+      uint64_t keyframeRawBytes; // the same keyframes uncompressed
+   };
+   
+   // A copy of a shape being given detail levels; shared with the reader's callback
+   // so the shape can be released while it's in flight
+   struct LODJob
    {
-      renderDetail(0);
+      enum
+      {
+         Pending,
+         Done,
+         Failed
+      };
+      
+      Dts3::Shape* shape;
+      Dts3::LODGenerator::Report report;
+      bool fromCache;
+      bool compressed; // keyframeReport is valid
+      Dts3::KeyframeCurves::Report keyframeReport;
+      std::atomic<uint32_t> state;
+      
+      LODJob() : shape(NULL), fromCache(false), compressed(false), state(Pending) {;}
+      ~LODJob() { if (shape) delete shape; }
+   };
+   
+   ResManager* mResourceManager;
+   std::unordered_map<std::string, SharedShape*> mShapes;
+   std::vector<uint32_t> mFreeModelIDs;
+   uint32_t mNextModelID;
+   bool mUseDeltaFrames; // applies to shapes loaded afterwards
+   bool mUseMeshlets;    // ...
+   bool mGenerateLODs;   // adds detail levels to shapes which only have one
+   bool mCompressKeyframes;
+   float mKeyRotTolerance;   // radians
+   float mKeyTransTolerance; // shape units
+   std::vector<float> mLODRatios;
+   std::string mLODCacheDir;
+   std::unordered_map<SharedShape*, std::shared_ptr<LODJob> > mLODJobs;
+   Stats mStats;
+   
+   // Called once a shape's data has been replaced, before the old Dts3::Shape is freed
+   std::function<void(SharedShape*)> mOnShapeReplaced;
+   
+   ShapeResourceManager(ResManager* res) : mResourceManager(res), mNextModelID(0), mUseDeltaFrames(true), mUseMeshlets(true), mGenerateLODs(true), mCompressKeyframes(true), mKeyRotTolerance(0.005f), mKeyTransTolerance(0.001f)
+   {
+      mStats = {};
+      mLODRatios = {0.5f, 0.25f, 0.125f};
+      mLODCacheDir = "lodcache";
    }
    
-   void renderObject(uint32_t objectIndex, uint32_t meshNum)
+   // Reads filename again on a reader worker and gives that copy detail levels (and
+   // compressed keyframes, to match), so nothing slow happens on the main thread
+   void requestLODs(SharedShape* shared, const char* filename, int32_t pathIdx)
    {
-      Dts3::Object& obj = mShape->mObjects[objectIndex];
-      if (meshNum > obj.numMeshes)
+      if (Dts3::LODGenerator::findBaseLevel(shared->mShape) < 0)
          return;
       
-      RuntimeObjectInfo& ri = mRuntimeObjectInfos[objectIndex];
-      RuntimeMeshInfo& mi = mRuntimeMeshInfos[obj.firstMesh + meshNum];
+      std::shared_ptr<LODJob> job = std::make_shared<LODJob>();
+      std::string cacheDir = mLODCacheDir;
+      std::string cachePath = Dts3::LODGenerator::getCachePath(mLODCacheDir.c_str(), shared->mKey.c_str());
+      std::vector<float> ratios = mLODRatios;
+      bool compress = mCompressKeyframes;
+      float rotTolerance = mKeyRotTolerance;
+      float transTolerance = mKeyTransTolerance;
+      
+      bool queued = mResourceManager->openFileAsync(filename, AsyncReader::Priority_Prefetch,
+                                                    [job, cacheDir, cachePath, ratios, compress, rotTolerance, transTolerance](bool ok, MemRStream& mem) {
+         Dts3::Shape* shape = new Dts3::Shape();
+         if (!ok || !shape->read(mem))
+         {
+            delete shape;
+            job->state.store(LODJob::Failed, std::memory_order_release);
+            return;
+         }
+         
+         if (Dts3::LODGenerator::readCache(cachePath.c_str(), shape, ratios, job->report))
+         {
+            job->fromCache = true;
+         }
+         else if (Dts3::LODGenerator::generate(shape, ratios, 0, job->report))
+         {
+            SDL_CreateDirectory(cacheDir.c_str());
+            Dts3::LODGenerator::writeCache(cachePath.c_str(), shape, ratios, job->report);
+         }
+         else
+         {
+            delete shape;
+            job->state.store(LODJob::Failed, std::memory_order_release);
+            return;
+         }
+         
+         if (compress && !shape->mSequences.empty())
+            job->compressed = shape->compressKeyframes(rotTolerance, transTolerance, job->keyframeReport);
+         
+         job->shape = shape;
+         job->state.store(LODJob::Done, std::memory_order_release);
+      }, pathIdx);
       
-      // Need to take different paths here
-      Dts3::SkinData* sd = mi.mMesh->getSkinData();
-      Dts3::BasicData* bd = mi.mMesh->getBasicData();
-      Dts3::SortedData* sort = mi.mMesh->getSortedData();
+      if (queued)
+         mLODJobs[shared] = job;
+   }
+   
+   // Swaps in shapes whose detail levels have finished cooking
+   void update()
+   {
+      for (auto itr = mLODJobs.begin(); itr != mLODJobs.end();)
+      {
+         uint32_t state = itr->second->state.load(std::memory_order_acquire);
+         if (state == LODJob::Pending)
+         {
+            ++itr;
+            continue;
+         }
+         
+         if (state == LODJob::Done)
+            applyLODs(itr->first, *itr->second);
+         itr = mLODJobs.erase(itr);
+      }
+   }
+   
+   void applyLODs(SharedShape* shared, LODJob& job)
+   {
+      mStats.deltaBytes -= shared->mDeltaBytes;
+      mStats.deltaRawBytes -= shared->mDeltaRawBytes;
+      mStats.numMeshlets -= shared->mNumMeshlets;
+      mStats.keyframeBytes -= shared->mKeyframeBytes;
+      mStats.keyframeRawBytes -= shared->mKeyframeRawBytes;
+      
+      Dts3::Shape* oldShape = shared->replaceShape(job.shape);
+      job.shape = NULL;
+      
+      shared->mKeyframeBytes = job.compressed ? job.keyframeReport.bytes : 0;
+      shared->mKeyframeRawBytes = job.compressed ? job.keyframeReport.rawBytes : 0;
+      shared->mKeyframeReports.clear();
+      if (job.compressed)
+         shared->mKeyframeReports.swap(job.keyframeReport.sequences);
+      
+      mStats.deltaBytes += shared->mDeltaBytes;
+      mStats.deltaRawBytes += shared->mDeltaRawBytes;
+      mStats.numMeshlets += shared->mNumMeshlets;
+      mStats.keyframeBytes += shared->mKeyframeBytes;
+      mStats.keyframeRawBytes += shared->mKeyframeRawBytes;
+      mStats.numLODsGenerated++;
+      mStats.numLODsCached += job.fromCache ? 1 : 0;
+      mStats.lodMS += job.report.generateMS;
+      
+      if (mOnShapeReplaced)
+         mOnShapeReplaced(shared);
+      delete oldShape;
+   }
+   
+   void compressKeyframes(SharedShape* shared)
+   {
+      Dts3::Shape* shape = shared->mShape;
+      Dts3::KeyframeCurves::Report report;
+      if (shape->mSequences.empty() || !shape->compressKeyframes(mKeyRotTolerance, mKeyTransTolerance, report))
+         return;
       
-      /*
-       General logic:
-       
-       - Node transform texture gets updated for all mesh types
-       - A secondary texture is used to provide initial transforms
-          - Static meshes use the same base identity matrices for initial transforms
-          - Skinned meshes use static sets of base matrices custom per mesh
-       - Render uniforms set:
-          - The base texture offset
-          - The initial transforms offset
-          - Dimensions both both textures
-       - Vertex shader transforms vertices according to transform lookups
-       - Fragment shader applies core and extra features with flags in uniforms
-       
-       */
+      shared->mKeyframeBytes = report.bytes;
+      shared->mKeyframeRawBytes = report.rawBytes;
+      shared->mKeyframeReports.swap(report.sequences);
+      mStats.keyframeBytes += report.bytes;
+      mStats.keyframeRawBytes += report.rawBytes;
+   }
+   
+   // Lists the keyframe error of every compressed sequence, worst first, so bad tolerances are easy to spot
+   void drawKeyframeReport()
+   {
+      struct Row
+      {
+         const SharedShape* shape;
+         uint32_t seqIdx;
+      };
       
-      if (sort)
+      std::vector<Row> rows;
+      for (auto& itr : mShapes)
       {
-         // Sorted meshes have an array for offsets
-         // NOTE: tverts or verts change here, not both.
-         uint32_t nc = std::min<uint32_t>(mi.mMeshFrame, sort->numVerts.size());
-         uint32_t mf = std::min<uint32_t>(mi.mMeshFrame, sort->firstVerts.size());
-         uint32_t tf = std::min<uint32_t>(mi.mMeshTexFrame ? mi.mMeshTexFrame : mi.mMeshFrame, sort->firstTVerts.size());
-         
-         // NOTE: ideally we should render in cluster order here, but
-         // to keep things simple we'll just let the GPU do all the work.
-         renderMesh(mi, bd,
-                    sort->numVerts[nc],
-                    sort->firstVerts[mf],
-                    sort->firstTVerts[tf],
-                    true);
+         for (uint32_t i=0; i<itr.second->mKeyframeReports.size(); i++)
+            rows.push_back({itr.second, i});
       }
-      else if (bd)
+      
+      std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b){
+         const Dts3::KeyframeCurves::SequenceReport& ra = a.shape->mKeyframeReports[a.seqIdx];
+         const Dts3::KeyframeCurves::SequenceReport& rb = b.shape->mKeyframeReports[b.seqIdx];
+         return ra.maxRotError > rb.maxRotError;
+      });
+      
+      if (!ImGui::BeginTable("Keyframes", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY, ImVec2(0, 150)))
+         return;
+      
+      ImGui::TableSetupColumn("Shape");
+      ImGui::TableSetupColumn("Sequence");
+      ImGui::TableSetupColumn("Keys");
+      ImGui::TableSetupColumn("Rot deg");
+      ImGui::TableSetupColumn("Trans");
+      ImGui::TableHeadersRow();
+      
+      for (const Row& row : rows)
+      {
+         const Dts3::Shape* shape = row.shape->mShape;
+         const Dts3::KeyframeCurves::SequenceReport& report = row.shape->mKeyframeReports[row.seqIdx];
+         ImGui::TableNextRow();
+         ImGui::TableNextColumn();
+         ImGui::TextUnformatted(row.shape->mKey.c_str());
+         ImGui::TableNextColumn();
+         ImGui::TextUnformatted(shape->mNameTable.get(shape->mSequences[row.seqIdx].nameIndex).c_str());
+         ImGui::TableNextColumn();
+         ImGui::Text("%u/%u", report.keys, report.rawKeys);
+         ImGui::TableNextColumn();
+         ImGui::Text("%.3f", slm::degrees(report.maxRotError));
+         ImGui::TableNextColumn();
+         ImGui::Text("%.4f", report.maxTransError);
+      }
+      
+      ImGui::EndTable();
+   }
+   
+   static std::string getKey(const char* filename, int32_t pathIdx)
+   {
+      std::string key = filename;
+      std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+      if (pathIdx >= 0)
+         key += "@" + std::to_string(pathIdx);
+      return key;
+   }
+   
+   ShapeHandle acquire(const char* filename, int32_t pathIdx=-1)
+   {
+      std::string key = getKey(filename, pathIdx);
+      auto itr = mShapes.find(key);
+      if (itr != mShapes.end())
       {
-         Dts3::SortedData* sd = mi.mMesh->getSortedData();
-         renderMesh(mi, bd,
-                    mi.mRealVertsPerFrame,
-                    (mi.mMeshFrame    * mi.mRealVertsPerFrame),
-                    (mi.mMeshTexFrame * mi.mRealVertsPerFrame),
-                    false);
+         mStats.numShared++;
+         return ShapeHandle(itr->second);
+      }
+      
+      ResourceInstance* inst = mResourceManager->createResource(filename, pathIdx);
+      Dts3::Shape* shape = dynamic_cast<Dts3::Shape*>(inst);
+      if (shape == NULL)
+      {
+         if (inst)
+            delete inst;
+         return ShapeHandle();
+      }
+      
+      return addShape(key, shape, filename, pathIdx);
+   }
+   
+   // Takes ownership of a shape which was already read elsewhere (e.g. parsed by the
+   // mission loader on a reader thread). If the file is already loaded, that copy is
+   // used and shape is freed.
+   ShapeHandle adopt(const char* filename, Dts3::Shape* shape)
+   {
+      std::string key = getKey(filename, -1);
+      auto itr = mShapes.find(key);
+      if (itr != mShapes.end())
+      {
+         delete shape;
+         mStats.numShared++;
+         return ShapeHandle(itr->second);
+      }
+      
+      return addShape(key, shape, filename, -1);
+   }
+   
+   ShapeHandle addShape(const std::string& key, Dts3::Shape* shape, const char* filename, int32_t pathIdx)
+   {
+      SharedShape* shared = new SharedShape();
+      shared->mManager = this;
+      shared->mKey = key;
+      shared->mShape = shape;
+      if (mCompressKeyframes)
+         compressKeyframes(shared);
+      
+      if (mFreeModelIDs.empty())
+      {
+         shared->mModelID = mNextModelID++;
       }
       else
       {
-         Dts3::DecalData* dd = mi.mMesh->getDecalData();
-         if (dd)
-         {
-            RuntimeMeshInfo& smi = mRuntimeMeshInfos[dd->meshIndex];
-            renderDecal(mi, smi, bd, dd);
-         }
+         shared->mModelID = mFreeModelIDs.back();
+         mFreeModelIDs.pop_back();
       }
+      shared->mGroupBase = shared->mModelID * SharedShape::MaxMaterials;
+      shared->mUseDeltaFrames = mUseDeltaFrames;
+      shared->mUseMeshlets = mUseMeshlets;
+      shared->init(mResourceManager);
+      
+      mShapes[key] = shared;
+      mStats.numLoads++;
+      mStats.deltaBytes += shared->mDeltaBytes;
+      mStats.deltaRawBytes += shared->mDeltaRawBytes;
+      mStats.numMeshlets += shared->mNumMeshlets;
+      
+      if (mGenerateLODs)
+         requestLODs(shared, filename, pathIdx);
+      return ShapeHandle(shared);
+   }
+   
+   // Called by ShapeHandle once the last reference is gone
+   void release(SharedShape* shared)
+   {
+      mStats.deltaBytes -= shared->mDeltaBytes;
+      mStats.deltaRawBytes -= shared->mDeltaRawBytes;
+      mStats.numMeshlets -= shared->mNumMeshlets;
+      mStats.keyframeBytes -= shared->mKeyframeBytes;
+      mStats.keyframeRawBytes -= shared->mKeyframeRawBytes;
+      mShapes.erase(shared->mKey);
+      mLODJobs.erase(shared);
+      mFreeModelIDs.push_back(shared->mModelID);
+      delete shared;
    }
    
-   ModelPipelineState calcPipelineState(uint32_t flags) const
+   inline uint32_t getNumShapes() const { return (uint32_t)mShapes.size(); }
+   inline uint32_t getNumPendingLODs() const { return (uint32_t)mLODJobs.size(); }
+};
+
+inline void ShapeHandle::reset()
+{
+   if (mShared && --mShared->mRefCount == 0)
+      mShared->mManager->release(mShared);
+   mShared = NULL;
+}
+
+class ShapeViewer : public GenericViewer
+{
+public:
+   
+   struct RuntimeMeshInfo
    {
-      if ((flags & (MaterialList::Additive | MaterialList::Subtractive)) != 0)
+      const SharedShape::MeshInfo* mInfo;
+      //
+      uint32_t mMeshFrame;     // verts frame offset
+      uint32_t mMeshTexFrame;  // tverts frame offset
+      //
+      uint32_t mRenderFlags;
+      
+      RuntimeMeshInfo() { memset(this, 0, sizeof(RuntimeMeshInfo)); }
+      ~RuntimeMeshInfo() {;}
+   };
+   
+   struct RuntimeIflMaterialInfo
+   {
+      int32_t mFrame;
+   };
+   
+   struct RuntimeDecalInfo
+   {
+      int32_t mFrame;
+   };
+   
+   struct RuntimeObjectInfo
+   {
+      uint32_t mObjectState;
+      bool mDraw;
+      
+      int32_t mLastMatFrame;
+      int32_t mLastMeshframe;
+      float mLastVis;
+      
+      RuntimeObjectInfo() : mLastMatFrame(0), mLastMeshframe(0), mLastVis(1.0), mDraw(true) {;}
+      ~RuntimeObjectInfo() {;}
+   };
+   
+   struct RuntimeDetailInfo
+   {
+      uint32_t startRenderObject;
+      uint32_t numRenderObjects;
+      uint32_t meshIndex;
+      
+      RuntimeDetailInfo() {;}
+      RuntimeDetailInfo(uint32_t so, uint32_t nro) : startRenderObject(so), numRenderObjects(nro) {;}
+   };
+   
+   ShapeHandle mHandle;
+   Dts3::Shape* mShape;
+   
+   std::vector<slm::mat4> mNodeTransforms; // Current transform list
+   std::vector<slm::quat> mActiveRotations; // non-gl xfms
+   std::vector<slm::vec4> mActiveTranslations; // non-gl xfms
+   std::vector<slm::vec3> mActiveScales; // non-gl xfms
+   
+   std::vector<RuntimeMeshInfo> mRuntimeMeshInfos;
+   std::vector<RuntimeObjectInfo> mRuntimeObjectInfos;
+   std::vector<RuntimeIflMaterialInfo> mRuntimeIflMaterialInfos;
+   std::vector<RuntimeDecalInfo> mRuntimeDecalInfos;
+   std::vector<RuntimeDetailInfo> mRuntimeDetailInfos;
+   
+   int32_t mDefaultMaterials;
+   int32_t mAlwaysNode;
+   int32_t mCurrentDetail;
+   
+   // Node animation is sampled by the scheduler, at a rate depending on our size on screen
+   static Dts3::AnimationScheduler* smAnimScheduler;
+   int32_t mAnimInstance;
+   
+   // Meshlet culling; frustum & eye are in model space
+   bool mUseMeshletCulling;
+   Dif::InteriorCuller::Frustum mCullFrustum;
+   slm::vec3 mCullEye;
+   std::vector<MeshletSet::DrawRange> mCullRanges;
+   MeshletSet::Stats mMeshletStats;
+   
+   typedef FrameTexInfo<float> TransformTexInfo;
+   
+   TransformTexInfo nodeInstTransformsTex;
+   
+   
+   ShapeViewer(ResManager* res)
+   {
+      mShape = NULL;
+      mResourceManager = res;
+      mCurrentDetail = 0;
+      mAnimInstance = -1;
+      mUseMeshletCulling = true;
+      mMeshletStats = {};
+      initVB = false;
+   }
+   
+   ~ShapeViewer()
+   {
+      clear();
+   }
+   
+   void clear()
+   {
+      clearRender();
+      
+      if (smAnimScheduler && mAnimInstance >= 0)
+         smAnimScheduler->removeInstance(mAnimInstance);
+      mAnimInstance = -1;
+      
+      mHandle.reset();
+      mShape = NULL;
+      mMaterialList = NULL;
+   }
+   
+   // Sets up the per-viewer state; anything which doesn't change lives in mHandle
+   void initRender()
+   {
+      mLightColor = slm::vec4(1,1,1,1);
+      mLightPos = slm::vec3(0,2, 2);
+      if (mShape == NULL)
+         return;
+      
+      mRuntimeMeshInfos.resize(mShape->mMeshes.size());
+      mRuntimeObjectInfos.resize(mShape->mObjects.size());
+      mRuntimeIflMaterialInfos.resize(mShape->mIflMaterials.size());
+      mRuntimeDecalInfos.resize(mShape->mDecals.size());
+      mRuntimeDetailInfos.resize(mShape->mDetailLevels.size());
+      
+      for (uint32_t i=0; i<mRuntimeMeshInfos.size(); i++)
+      {
+         mRuntimeMeshInfos[i].mInfo = &mHandle->mMeshInfos[i];
+      }
+      
+      // Alloc node transform texture for single instance
+      nodeInstTransformsTex.reset();
+      nodeInstTransformsTex.allocTransforms(mShape->mNodes.size() * 16);
+      nodeInstTransformsTex.ensureValid(0, NULL);
+   }
+   
+   void clearRender()
+   {
+      nodeInstTransformsTex.reset();
+      
+      mRuntimeMeshInfos.clear();
+      mRuntimeObjectInfos.clear();
+      mRuntimeIflMaterialInfos.clear();
+      mRuntimeDecalInfos.clear();
+      mRuntimeDetailInfos.clear();
+   }
+   
+   // Sequence Handling
+   
+   
+   uint32_t addThread()
+   {
+      return 0;
+   }
+   
+   // NOTE: only a single sequence is played for now
+   void setThreadSequence(uint32_t idx, int32_t sequenceId)
+   {
+      if (smAnimScheduler && mAnimInstance >= 0)
+         smAnimScheduler->setSequence(mAnimInstance, sequenceId);
+   }
+   
+   void removeThread(uint32_t idx)
+   {
+      setThreadSequence(idx, -1);
+   }
+   
+   // Time is advanced for every instance by smAnimScheduler
+   void advanceThreads(float dt)
+   {
+   }
+   
+   void updateTransformTexture()
+   {
+      // TODO
+   }
+   
+   void animateNodes()
+   {
+      if (smAnimScheduler && mAnimInstance >= 0)
+         mNodeTransforms = smAnimScheduler->getNodeTransforms(mAnimInstance);
+      updateTransformTexture();
+      animateMeshFrames();
+   }
+   
+   // Picks vertex and texture frames from the playing sequence's object states (nearest keyframe)
+   void animateMeshFrames()
+   {
+      for (RuntimeMeshInfo& rmi : mRuntimeMeshInfos)
+      {
+         rmi.mMeshFrame = 0;
+         rmi.mMeshTexFrame = 0;
+      }
+      
+      int32_t seqIdx = (smAnimScheduler && mAnimInstance >= 0) ? smAnimScheduler->getSequence(mAnimInstance) : -1;
+      if (seqIdx < 0 || seqIdx >= (int32_t)mShape->mSequences.size())
+         return;
+      
+      const Dts3::Sequence& seq = mShape->mSequences[seqIdx];
+      if (seq.numKeyFrames <= 0 || seq.baseObjectState < 0)
+         return;
+      
+      uint32_t numKeys = (uint32_t)seq.numKeyFrames;
+      float pos = smAnimScheduler->getPos(mAnimInstance);
+      uint32_t key = seq.testFlags(Dts3::Sequence::Cyclic) ? ((uint32_t)((pos * numKeys) + 0.5f) % numKeys) :
+                                                             std::min<uint32_t>((uint32_t)((pos * (numKeys-1)) + 0.5f), numKeys-1);
+      
+      // States are stored for every object any of vis, frame or matFrame matters for
+      uint32_t matter = 0;
+      for (uint32_t i=0; i<mShape->mObjects.size(); i++)
+      {
+         bool frameMatters = seq.mattersFrame.test(i);
+         bool matFrameMatters = seq.mattersMatframe.test(i);
+         if (!frameMatters && !matFrameMatters && !seq.mattersVis.test(i))
+            continue;
+         
+         size_t stateIdx = (size_t)seq.baseObjectState + ((size_t)matter * numKeys) + key;
+         matter++;
+         if (!(frameMatters || matFrameMatters) || stateIdx >= mShape->mObjectStates.size())
+            continue;
+         
+         const Dts3::ObjectState& state = mShape->mObjectStates[stateIdx];
+         const Dts3::Object& obj = mShape->mObjects[i];
+         if (obj.firstMesh < 0 || obj.numMeshes < 0 || (size_t)obj.firstMesh + obj.numMeshes > mRuntimeMeshInfos.size())
+            continue;
+         
+         for (int32_t m=0; m<obj.numMeshes; m++)
+         {
+            RuntimeMeshInfo& rmi = mRuntimeMeshInfos[obj.firstMesh + m];
+            const Dts3::Mesh* mesh = rmi.mInfo ? rmi.mInfo->mMesh : NULL;
+            if (mesh == NULL)
+               continue;
+            
+            if (frameMatters && state.frame >= 0 && (uint32_t)state.frame < mesh->mNumFrames)
+               rmi.mMeshFrame = state.frame;
+            if (matFrameMatters && state.matFrame >= 0 && (uint32_t)state.matFrame < mesh->mNumMatFrames)
+               rmi.mMeshTexFrame = state.matFrame;
+         }
+      }
+   }
+   
+   // Loading
+   
+   void loadShape(const ShapeHandle& handle)
+   {
+      clear();
+      
+      mHandle = handle;
+      if (!mHandle.isValid())
+         return;
+      
+      mShape = mHandle->mShape;
+      mMaterialList = &mShape->mMaterials;
+      initRender();
+      
+      if (smAnimScheduler)
+         mAnimInstance = smAnimScheduler->addInstance(mShape);
+      
+      // Setup default pose for nodes
+      animateNodes();
+   }
+   
+   // Rendering
+   
+   void determineNodeVisibility()
+   {
+   }
+   
+   // Returns the first level whose pixel size fits the projected radius, or the smallest
+   static uint32_t findDetail(const Dts3::Shape* shape, float pixelSize)
+   {
+      int32_t smallest = -1;
+      for (uint32_t i=0; i<shape->mDetailLevels.size(); i++)
+      {
+         const Dts3::DetailLevel& level = shape->mDetailLevels[i];
+         if (level.size < 0.0f || level.subshape < 0)
+            continue;
+         
+         if (pixelSize >= level.size)
+            return i;
+         smallest = i;
+      }
+      
+      return smallest >= 0 ? smallest : 0;
+   }
+   
+   // Picks the detail level for the projected shape (assuming a 90 degree fov)
+   void selectDetail(float dist, int w, int h)
+   {
+      mCurrentDetail = 0;
+      if (mShape == NULL || dist <= 0.0f)
+         return;
+      
+      float pixelSize = (mShape->mRadius / dist) * (float)h;
+      mCurrentDetail = findDetail(mShape, pixelSize);
+      
+      if (smAnimScheduler && mAnimInstance >= 0)
+         smAnimScheduler->setDetail(mAnimInstance, mCurrentDetail, pixelSize);
+   }
+   
+   void render()
+   {
+      mMeshletStats = {};
+      if (mUseMeshletCulling)
+      {
+         // Meshes are drawn with just the model matrix, so model space == mesh space
+         slm::mat4 modelView = mViewMatrix * mModelMatrix;
+         Dif::InteriorCuller::extractFrustum(mProjectionMatrix * modelView, mCullFrustum);
+         mCullEye = (slm::inverse(modelView) * slm::vec4(0.0f, 0.0f, 0.0f, 1.0f)).xyz();
+      }
+      
+      // Shape skins normally cover the shape about once, so the projected size is the texel density
+      if (smMaterialTextures.mStreamer && mShape && mHandle.isValid())
+      {
+         slm::vec3 eye = (slm::inverse(mViewMatrix * mModelMatrix) * slm::vec4(0.0f, 0.0f, 0.0f, 1.0f)).xyz();
+         float dist = slm::length(eye - mShape->mCenter) - mShape->mRadius;
+         float texels = getPixelsPerUnit(dist) * mShape->mRadius * 2.0f;
+         for (int32_t texID : mHandle->mMaterialTexIDs)
+            requestTextureSize(texID, texels);
+      }
+      
+      decodeDetailFrames(mCurrentDetail);
+      renderDetail(mCurrentDetail);
+   }
+   
+   // Decodes the delta frames every mesh of the level draws with, so the model's
+   // verts are only updated before it's first bound this frame rather than between draws.
+   void decodeDetailFrames(uint32_t detailLevel)
+   {
+      const Dts3::DetailLevel& level = mShape->mDetailLevels[detailLevel];
+      if (level.subshape < 0 || level.objectDetail < 0)
+         return;
+      
+      const Dts3::SubShape& ss = mShape->mSubshapes[level.subshape];
+      for (int32_t i=ss.firstObject; i<ss.firstObject+ss.numObjects; i++)
+      {
+         const Dts3::Object& obj = mShape->mObjects[i];
+         if (level.objectDetail >= obj.numMeshes)
+            continue;
+         
+         RuntimeMeshInfo* mi = &mRuntimeMeshInfos[obj.firstMesh + level.objectDetail];
+         Dts3::DecalData* dd = mi->mInfo->mMesh->getDecalData();
+         if (dd)
+            mi = &mRuntimeMeshInfos[dd->meshIndex];
+         
+         mHandle->getFrameVertOffset(*mi->mInfo, mi->mMeshFrame);
+      }
+   }
+   
+   void renderObject(uint32_t objectIndex, uint32_t meshNum)
+   {
+      Dts3::Object& obj = mShape->mObjects[objectIndex];
+      if (meshNum >= (uint32_t)obj.numMeshes)
+         return;
+      
+      RuntimeObjectInfo& ri = mRuntimeObjectInfos[objectIndex];
+      RuntimeMeshInfo& mi = mRuntimeMeshInfos[obj.firstMesh + meshNum];
+      Dts3::Mesh* mesh = mi.mInfo->mMesh;
+      
+      // Need to take different paths here
+      Dts3::BasicData* bd = mesh->getBasicData();
+      Dts3::SortedData* sort = mesh->getSortedData();
+      
+      /*
+       General logic:
+       
+       - Node transform texture gets updated for all mesh types
+       - A secondary texture is used to provide initial transforms
+          - Static meshes use the same base identity matrices for initial transforms
+          - Skinned meshes use static sets of base matrices custom per mesh
+       - Render uniforms set:
+          - The base texture offset
+          - The initial transforms offset
+          - Dimensions both both textures
+       - Vertex shader transforms vertices according to transform lookups
+       - Fragment shader applies core and extra features with flags in uniforms
+       
+       */
+      
+      if (sort)
+      {
+         // Sorted meshes have an array for offsets
+         // NOTE: tverts or verts change here, not both.
+         uint32_t nc = std::min<uint32_t>(mi.mMeshFrame, sort->numVerts.size());
+         uint32_t mf = std::min<uint32_t>(mi.mMeshFrame, sort->firstVerts.size());
+         uint32_t tf = std::min<uint32_t>(mi.mMeshTexFrame ? mi.mMeshTexFrame : mi.mMeshFrame, sort->firstTVerts.size());
+         
+         // NOTE: ideally we should render in cluster order here, but
+         // to keep things simple we'll just let the GPU do all the work.
+         renderMesh(mi, bd,
+                    sort->numVerts[nc],
+                    sort->firstVerts[mf],
+                    sort->firstTVerts[tf],
+                    true);
+      }
+      else if (bd)
+      {
+         renderMesh(mi, bd,
+                    mi.mInfo->mRealVertsPerFrame,
+                    (mi.mMeshFrame    * mi.mInfo->mRealVertsPerFrame),
+                    (mi.mMeshTexFrame * mi.mInfo->mRealVertsPerFrame),
+                    false);
+      }
+      else
+      {
+         Dts3::DecalData* dd = mesh->getDecalData();
+         if (dd)
+         {
+            RuntimeMeshInfo& smi = mRuntimeMeshInfos[dd->meshIndex];
+            renderDecal(mi, smi, bd, dd);
+         }
+      }
+   }
+   
+   static ModelPipelineState calcPipelineState(uint32_t flags)
+   {
+      if ((flags & (MaterialList::Additive | MaterialList::Subtractive)) != 0)
+      {
+         if ((flags & (MaterialList::Additive)) != 0)
+            return ModelPipeline_AdditiveBlend;
+         else
+            return ModelPipeline_SubtractiveBlend;
+      }
+      else if ((flags & MaterialList::Translucent) != 0)
+      {
+         return ModelPipeline_TranslucentBlend;
+      }
+      else
+      {
+         return ModelPipeline_DefaultDiffuse;
+      }
+   }
+   
+   void renderDecal(RuntimeMeshInfo& mi, RuntimeMeshInfo& smi, Dts3::BasicData* bd, Dts3::DecalData* dd)
+   {
+      // Decals draw over the verts of their source mesh
+      uint32_t vertOffset = mHandle->getFrameVertOffset(*smi.mInfo, smi.mMeshFrame);
+      
+      GFXSetModelVerts(mHandle->mModelID, 0, 0, 0);
+      GFXSetModelViewProjection(mModelMatrix, mViewMatrix, mProjectionMatrix, smi.mRenderFlags);
+      GFXSetTSPipelineProps(mi.mMeshTexFrame, smi.mInfo->mMeshTransformOffset, dd->texGenS[mi.mMeshFrame], dd->texGenT[mi.mMeshFrame]);
+      
+      uint32_t start = dd->startPrimitive[mi.mMeshFrame];
+      uint32_t end = mi.mMeshFrame+1 < dd->startPrimitive.size() ? dd->startPrimitive[mi.mMeshFrame+1] : dd->primitives.size();
+      
+      for (uint32_t i=start; i<end; i++)
+      {
+         Dts3::Primitive& prim = dd->primitives[i];
+         uint32_t matIndex = dd->matIndex & Dts3::Primitive::MaterialMask;
+         uint32_t drawMode = prim.matIndex & Dts3::Primitive::TypeMask;
+         
+         // To keep things simple, everything is assembled into a single texture group, though
+         // this should not include env maps and whatnot.
+         const MaterialList::Material& mat = mMaterialList->operator[](matIndex);
+         uint32_t groupID = mHandle->mGroupBase + matIndex;
+         
+         ModelPipelineState pipelineState = calcPipelineState(mat.tsProps.flags);
+         GFXBeginTSModelPipelineState(pipelineState,
+                                      groupID,
+                                      1.1f, false, false);
+         
+         assert(drawMode == Dts3::Primitive::Triangles);
+         
+         GFXDrawModelPrims(smi.mInfo->mRealVertsPerFrame,
+                           prim.numElements,
+                           mi.mInfo->mIndexOffset + prim.firstElement,
+                           vertOffset);
+      }
+   }
+   
+   void renderMesh(RuntimeMeshInfo& mi, Dts3::BasicData* bd, uint32_t drawVerts, uint32_t firstVert, uint32_t firstTVert, bool depthPeel=false)
+   {
+      // NOTE: already decoded by decodeDetailFrames, so this doesn't update the bound model
+      uint32_t vertOffset = mHandle->getFrameVertOffset(*mi.mInfo, mi.mMeshFrame);
+      
+      GFXSetModelVerts(mHandle->mModelID, 0, 0, 0);
+      GFXSetModelViewProjection(mModelMatrix, mViewMatrix, mProjectionMatrix, mi.mRenderFlags);
+      GFXSetTSPipelineProps(mi.mMeshTexFrame, mi.mInfo->mMeshTransformOffset, slm::vec4(0), slm::vec4(0));
+      
+      // NOTE: if we wanted to more optimally batch, emitting a drawcall per matIndex would make
+      // more sense here.
+      // Unfortunately we can't use texture arrays for everything here since the material list
+      // doesn't guarantee that every texture is consistently sized.
+      
+      uint32_t passes = depthPeel ? 4 : 1;
+      
+      // Large meshes only draw the meshlets which survive culling
+      if (mUseMeshletCulling && mi.mInfo->mMeshlets && !depthPeel)
+      {
+         mCullRanges.clear();
+         mi.mInfo->mMeshlets->cull(mCullFrustum.data(), (uint32_t)mCullFrustum.size(), mCullEye, mCullRanges, mMeshletStats);
+         
+         int32_t lastGroup = -1;
+         for (const MeshletSet::DrawRange& range : mCullRanges)
+         {
+            if ((int32_t)range.group != lastGroup)
+            {
+               uint32_t matIndex = bd->primitives[range.group].matIndex & Dts3::Primitive::MaterialMask;
+               MaterialList::Material& mat = mMaterialList->operator[](matIndex);
+               GFXBeginTSModelPipelineState(calcPipelineState(mat.tsProps.flags),
+                                            mHandle->mGroupBase + matIndex,
+                                            1.1f, false, false);
+               lastGroup = range.group;
+            }
+            
+            GFXDrawModelPrims(mi.mInfo->mRealVertsPerFrame,
+                              range.indexCount,
+                              mi.mInfo->mIndexOffset + range.indexStart,
+                              vertOffset);
+         }
+         return;
+      }
+      
+      for (uint32_t i=0; i<passes; i++)
+      {
+         for (Dts3::Primitive& prim : bd->primitives)
+         {
+            uint32_t matIndex = prim.matIndex & Dts3::Primitive::MaterialMask;
+            uint32_t drawMode = prim.matIndex & Dts3::Primitive::TypeMask;
+            
+            // To keep things simple, everything is assembled into a single texture group.
+            // IFL materials make use of the texture array feature.
+            MaterialList::Material& mat = mMaterialList->operator[](matIndex);
+            uint32_t groupID = mHandle->mGroupBase + matIndex;
+            
+            ModelPipelineState pipelineState = calcPipelineState(mat.tsProps.flags);
+            GFXBeginTSModelPipelineState(pipelineState, 
+                                         groupID,
+                                         1.1f, depthPeel, (passes % 2) == 0);
+            
+            assert(drawMode == Dts3::Primitive::Triangles);
+            
+            GFXDrawModelPrims(mi.mInfo->mRealVertsPerFrame,
+                              prim.numElements,
+                              mi.mInfo->mIndexOffset + prim.firstElement,
+                              vertOffset);
+         }
+      }
+   }
+   
+   void renderDetail(uint32_t detailLevel)
+   {
+      Dts3::DetailLevel& level = mShape->mDetailLevels[detailLevel];
+      if (level.subshape < 0)
+      {
+         // render billboard
+         return;
+      }
+      
+      if (level.objectDetail < 0)
+         return;
+      
+      // Setup IFL
+      // TODO
+      
+      Dts3::SubShape& ss = mShape->mSubshapes[level.subshape];
+      if (ss.firstTranslucent < 0)
+      {
+         ss.firstTranslucent = ss.firstObject + ss.numObjects;
+      }
+      
+      // NOTE: The original render code treats all meshes as separate and renders them one-by-one.
+      // Instead we opt to stick everything in a single vertex buffer and render everything in two main batches.
+      
+      for (uint32_t i=ss.firstObject; i<ss.firstTranslucent; i++)
+      {
+         renderObject(i, level.objectDetail);
+      }
+      for (uint32_t i=ss.firstTranslucent; i<ss.firstObject+ss.numObjects; i++)
+      {
+         renderObject(i, level.objectDetail);
+      }
+   }
+   
+   // Draws a detail level of a shape for a run of uploaded instances, one draw per
+   // mesh & material. Placed shapes aren't animated, so only the first frame is used.
+   static void renderInstanced(SharedShape& shared, uint32_t detailLevel, uint32_t firstInstance, uint32_t numInstances)
+   {
+      Dts3::Shape* shape = shared.mShape;
+      if (detailLevel >= shape->mDetailLevels.size() || numInstances == 0)
+         return;
+      
+      const Dts3::DetailLevel& level = shape->mDetailLevels[detailLevel];
+      if (level.subshape < 0 || level.objectDetail < 0)
+         return;
+      
+      // Decode any delta meshes before the model is bound
+      const Dts3::SubShape& ss = shape->mSubshapes[level.subshape];
+      for (int32_t i=ss.firstObject; i<ss.firstObject+ss.numObjects; i++)
+      {
+         const Dts3::Object& obj = shape->mObjects[i];
+         if (level.objectDetail < obj.numMeshes)
+            shared.getFrameVertOffset(shared.mMeshInfos[obj.firstMesh + level.objectDetail], 0);
+      }
+      
+      // Translucent objects are at the end of the subshape, so they're drawn last
+      for (int32_t i=ss.firstObject; i<ss.firstObject+ss.numObjects; i++)
+      {
+         const Dts3::Object& obj = shape->mObjects[i];
+         if (level.objectDetail >= obj.numMeshes)
+            continue;
+         
+         SharedShape::MeshInfo& info = shared.mMeshInfos[obj.firstMesh + level.objectDetail];
+         Dts3::BasicData* bd = info.mMesh->getBasicData();
+         if (bd == NULL)
+            continue;
+         
+         uint32_t vertOffset = shared.getFrameVertOffset(info, 0);
+         GFXSetModelVerts(shared.mModelID, 0, 0, 0);
+         GFXSetTSPipelineProps(0, info.mMeshTransformOffset, slm::vec4(0), slm::vec4(0));
+         
+         for (const Dts3::Primitive& prim : bd->primitives)
+         {
+            uint32_t matIndex = prim.matIndex & Dts3::Primitive::MaterialMask;
+            GFXBeginTSModelPipelineState(calcPipelineState(shape->mMaterials[matIndex].tsProps.flags),
+                                         shared.mGroupBase + matIndex,
+                                         1.1f, false, false);
+            GFXDrawModelPrimsInstanced(info.mRealVertsPerFrame,
+                                       prim.numElements,
+                                       info.mIndexOffset + prim.firstElement,
+                                       vertOffset,
+                                       firstInstance, numInstances);
+         }
+      }
+   }
+};
+
+Dts3::AnimationScheduler* ShapeViewer::smAnimScheduler = NULL;
+
+class ShapeViewerController : public ViewController
+{
+public:
+   ShapeViewer mViewer;
+   ShapeResourceManager* mShapeManager;
+   SDL_Window* mWindow;
+   float xRot, yRot, mDetailDist;
+   Dts3::Shape* mShape;
+   
+   std::vector<const char*> mSequenceList;
+   int32_t mSequenceIdx;
+   
+   ShapeViewerController(SDL_Window* window, ResManager* mgr, ShapeResourceManager* shapeMgr) :
+   mViewer(mgr)
+   {
+      mShapeManager = shapeMgr;
+      mViewPos = slm::vec3(0,0,0);
+      mCamRot = slm::vec3(0,0,0);
+      mViewer.initRender();
+      mWindow = window;
+      xRot = mDetailDist = 0;
+      yRot = slm::radians(180.0f);
+      mShape = NULL;
+      mSequenceIdx = -1;
+   }
+   
+   ~ShapeViewerController()
+   {
+      mViewer.clear();
+   }
+   
+   bool isResourceLoaded()
+   {
+      return mShape != NULL;
+   }
+   
+   bool isAnimating()
+   {
+      return mViewer.mAnimInstance >= 0 && mSequenceIdx >= 0;
+   }
+   
+   void loadShape(const char *filename, int pathIdx=-1)
+   {
+      // NOTE: acquire before clearing so reloading the same shape doesn't free it
+      setShape(mShapeManager->acquire(filename, pathIdx));
+   }
+   
+   // Picks up the new Dts3::Shape once generated detail levels are swapped in
+   void onShapeReplaced(SharedShape* shared)
+   {
+      if (mViewer.mHandle.get() != shared)
+         return;
+      
+      int32_t sequenceIdx = mSequenceIdx;
+      slm::vec3 viewPos = mViewPos;
+      setShape(ShapeHandle(shared));
+      mViewPos = viewPos;
+      if (sequenceIdx >= 0 && sequenceIdx < (int32_t)mSequenceList.size())
+      {
+         mSequenceIdx = sequenceIdx;
+         mViewer.setThreadSequence(0, mSequenceIdx);
+      }
+   }
+   
+   void setShape(ShapeHandle handle)
+   {
+      mViewer.clear();
+      mShape = NULL;
+      mSequenceList.clear();
+      mSequenceIdx = -1;
+      
+      if (handle.isValid())
+      {
+         mShape = handle->mShape;
+         mViewer.loadShape(handle);
+         
+         mViewPos = slm::vec3(0);//slm::vec3(0, mViewer.mShape->mCenter.z, mViewer.mShape->mRadius);
+         
+         // Play the first sequence by default
+         for (const Dts3::Sequence& seq : mShape->mSequences)
+         {
+            mSequenceList.push_back(mShape->mNameTable.get(seq.nameIndex).c_str());
+         }
+         
+         if (mSequenceList.size() > 0)
+         {
+            mSequenceIdx = 0;
+            mViewer.setThreadSequence(mViewer.addThread(), mSequenceIdx);
+         }
+      }
+   }
+   
+   void update(float dt)
+   {
+      mViewer.mModelMatrix = slm::rotation_x(xRot) * slm::rotation_y(yRot);
+      slm::mat4 rotMat = slm::rotation_z(slm::radians(mCamRot.z)) * slm::rotation_y(slm::radians(mCamRot.y)) *  slm::rotation_x(slm::radians(mCamRot.x));
+      rotMat = inverse(rotMat);
+      mViewer.mViewMatrix = slm::mat4(1) * rotMat * slm::translation(-mViewPos);
+      
+      int w, h;
+      SDL_GetWindowSize(mWindow, &w, &h);
+      mViewer.mProjectionMatrix = slm::perspective_fov_rh( slm::radians(90.0), (float)w/(float)h, 0.01f, 10000.0f);
+      
+      if (mShape == NULL)
+         return;
+      
+      // NOTE: time is advanced by the animation scheduler before controllers update
+      mViewer.selectDetail(mDetailDist, w, h);
+      mViewer.animateNodes();
+      mViewer.render();
+      
+      // Now render gui
+      ImGui::Begin("Anim");
+      int32_t nextSequence = mSequenceIdx;
+      if (mSequenceList.size() > 0)
+         ImGui::ListBox("Sequences", &nextSequence, &mSequenceList[0], (int)mSequenceList.size());
+      else
+         ImGui::Text("No sequences");
+      ImGui::End();
+      
+      ImGui::Begin("View");
+      ImGui::SliderAngle("X Rotation", &xRot);
+      ImGui::SliderAngle("Y Rotation", &yRot);
+      ImGui::SliderFloat("Detail Distance", &mDetailDist, 0, 1000.0f);
+      ImGui::Text("Detail: %i", mViewer.mCurrentDetail);
+      ImGui::Checkbox("Meshlet culling", &mViewer.mUseMeshletCulling);
+      ImGui::Text("Meshlets: %u/%u culled (%u frustum, %u backface), %u/%u tris",
+                  mViewer.mMeshletStats.frustumRejected + mViewer.mMeshletStats.backfaceRejected, mViewer.mMeshletStats.meshletsTested,
+                  mViewer.mMeshletStats.frustumRejected, mViewer.mMeshletStats.backfaceRejected,
+                  mViewer.mMeshletStats.trianglesRejected, mViewer.mMeshletStats.trianglesTested);
+      ImGui::End();
+      
+      // Update state changed by gui
+      if (nextSequence != mSequenceIdx)
+      {
+         mSequenceIdx = nextSequence;
+         mViewer.setThreadSequence(0, mSequenceIdx);
+      }
+   }
+   
+};
+
+class InteriorViewer : public GenericViewer
+{
+public:
+   Dif::InteriorResource* mInterior;
+   Dif::InteriorCuller mCuller;
+   bool mUsePortals;
+   bool mCullSurfaces; // frustum & backface tests per surface
+   
+   // GPU slots, so more than one interior can be loaded at once
+   uint32_t mModelID;
+   uint32_t mGroupBase;
+   
+   std::vector<int32_t> mMaterialTexIDs;
+   std::vector<float> mMaterialRepeatSize; // largest world size of one texture repeat
+   int32_t mLightmapAtlasTexID;
+   int32_t mWhiteTexID;
+   uint32_t mLightmapAtlasSize;
+   uint32_t mLightmapAtlasLayers;
+   
+   enum
+   {
+      MaxLightmapAtlasSize = 2048
+   };
+   
+   InteriorViewer(ResManager* res)
+   {
+      mInterior = NULL;
+      mUsePortals = true;
+      mCullSurfaces = true;
+      mModelID = 0;
+      mGroupBase = 0;
+      mResourceManager = res;
+      mWhiteTexID = -1;
+      mLightmapAtlasTexID = -1;
+      mLightmapAtlasSize = 0;
+      mLightmapAtlasLayers = 0;
+      mLightColor = slm::vec4(1,1,1,1);
+      mLightPos = slm::vec3(0,2,2);
+   }
+   
+   ~InteriorViewer()
+   {
+      clear();
+   }
+   
+   void loadInterior(Dif::InteriorResource& res)
+   {
+      clear();
+      mInterior = &res;
+      mCuller.setInterior(&res);
+      
+      uint32_t white = 0xFFFFFFFF;
+      mWhiteTexID = GFXLoadCustomTexture(CustomTexture_RGBA8, 1, 1, &white);
+      
+      mMaterialTexIDs.resize(res.mMaterialList.size());
+      for (uint32_t i=0; i<res.mMaterialList.size(); i++)
+      {
+         mMaterialTexIDs[i] = loadMaterialTexture(mResourceManager, res.mMaterialList[i].name.c_str());
+      }
+      
+      mMaterialRepeatSize.resize(res.mMaterialList.size(), 0.0f);
+      for (const Dif::Surface& surface : res.mSurfaces)
       {
-         if ((flags & (MaterialList::Additive)) != 0)
-            return ModelPipeline_AdditiveBlend;
-         else
-            return ModelPipeline_SubtractiveBlend;
+         if (surface.textureIndex >= mMaterialRepeatSize.size() || surface.texGenIndex >= res.mTexGenEQs.size())
+            continue;
+         
+         const Dif::TexGenPlanes& texGen = res.mTexGenEQs[surface.texGenIndex];
+         float scale = std::min(slm::length(slm::vec3(texGen.planeS[0], texGen.planeS[1], texGen.planeS[2])),
+                                slm::length(slm::vec3(texGen.planeT[0], texGen.planeT[1], texGen.planeT[2])));
+         if (scale > 0.0f)
+            mMaterialRepeatSize[surface.textureIndex] = std::max(mMaterialRepeatSize[surface.textureIndex], 1.0f / scale);
       }
-      else if ((flags & MaterialList::Translucent) != 0)
+      
+      // All lightmaps go into one array texture, so batches are only split by material
+      LightmapAtlas atlas;
+      if (res.packLightmaps(atlas, MaxLightmapAtlasSize))
       {
-         return ModelPipeline_TranslucentBlend;
+         mLightmapAtlasTexID = GFXLoadCustomTextureArray(CustomTexture_RGBA8, atlas.mLayerSize, atlas.mLayerSize, atlas.mNumLayers, &atlas.mPixels[0]);
+         mLightmapAtlasSize = atlas.mLayerSize;
+         mLightmapAtlasLayers = atlas.mNumLayers;
       }
       else
       {
-         return ModelPipeline_DefaultDiffuse;
+         uint32_t whiteLayer = 0xFFFFFFFF;
+         mLightmapAtlasTexID = GFXLoadCustomTextureArray(CustomTexture_RGBA8, 1, 1, 1, &whiteLayer);
+      }
+      
+      for (uint32_t i=0; i<res.mRenderBatches.size(); i++)
+      {
+         const Dif::RenderBatch& batch = res.mRenderBatches[i];
+         int32_t baseTexID = mMaterialTexIDs[batch.textureIndex];
+         GFXSetITRMaterialResources(mGroupBase + i,
+                                    baseTexID >= 0 ? baseTexID : mWhiteTexID,
+                                    -1,
+                                    mLightmapAtlasTexID);
       }
+      
+      GFXLoadITRModelData(mModelID,
+                          &res.mRenderVerts[0],
+                          &res.mRenderTexVerts[0],
+                          &res.mRenderIndices[0],
+                          (uint32_t)res.mRenderVerts.size(),
+                          (uint32_t)res.mRenderIndices.size());
    }
    
-   void renderDecal(RuntimeMeshInfo& mi, RuntimeMeshInfo& smi, Dts3::BasicData* bd, Dts3::DecalData* dd)
+   void clear()
    {
-      GFXSetModelVerts(0, 0, 0, 0);
-      GFXSetModelViewProjection(mModelMatrix, mViewMatrix, mProjectionMatrix, smi.mRenderFlags);
-      GFXSetTSPipelineProps(mi.mMeshTexFrame, smi.mMeshTransformOffset, dd->texGenS[mi.mMeshFrame], dd->texGenT[mi.mMeshFrame]);
-      
-      uint32_t start = dd->startPrimitive[mi.mMeshFrame];
-      uint32_t end = mi.mMeshFrame+1 < dd->startPrimitive.size() ? dd->startPrimitive[mi.mMeshFrame+1] : dd->primitives.size();
+      GFXClearITRModelData(mModelID);
       
-      for (uint32_t i=start; i<end; i++)
+      // Frees the bind groups, which would otherwise hold on to the textures
+      if (mInterior)
       {
-         Dts3::Primitive& prim = dd->primitives[i];
-         uint32_t matIndex = dd->matIndex & Dts3::Primitive::MaterialMask;
-         uint32_t drawMode = prim.matIndex & Dts3::Primitive::TypeMask;
-         
-         // To keep things simple, everything is assembled into a single texture group, though
-         // this should not include env maps and whatnot.
-         const MaterialList::Material& mat = mMaterialList->operator[](matIndex);
-         ActiveMaterial& amat = mActiveMaterials[matIndex];
-         uint32_t groupID = amat.tex.texID; // TOOD
-         
-         ModelPipelineState pipelineState = calcPipelineState(mat.tsProps.flags);
-         GFXBeginTSModelPipelineState(pipelineState,
-                                      groupID,
-                                      1.1f, false, false);
-         
-         assert(drawMode == Dts3::Primitive::Triangles);
-         
-         GFXDrawModelPrims(smi.mRealVertsPerFrame,
-                           prim.numElements,
-                           mi.mIndexOffset + prim.firstElement,
-                           mi.mVertOffset + (smi.mMeshFrame * smi.mRealVertsPerFrame));
+         for (uint32_t i=0; i<mInterior->mRenderBatches.size(); i++)
+            GFXSetITRMaterialResources(mGroupBase + i, -1, -1, -1);
       }
+      
+      for (int32_t texID : mMaterialTexIDs) { releaseMaterialTexture(texID); }
+      GFXDeleteTexture(mLightmapAtlasTexID);
+      GFXDeleteTexture(mWhiteTexID);
+      
+      mMaterialTexIDs.clear();
+      mMaterialRepeatSize.clear();
+      mLightmapAtlasTexID = -1;
+      mLightmapAtlasSize = 0;
+      mLightmapAtlasLayers = 0;
+      mWhiteTexID = -1;
+      mInterior = NULL;
+      mCuller.setInterior(NULL);
    }
    
-   void renderMesh(RuntimeMeshInfo& mi, Dts3::BasicData* bd, uint32_t drawVerts, uint32_t firstVert, uint32_t firstTVert, bool depthPeel=false)
+   // Requests enough texels for each material at the given density
+   void requestTextures(float pixelsPerUnit)
    {
-      GFXSetModelVerts(0, 0, 0, 0);
-      GFXSetModelViewProjection(mModelMatrix, mViewMatrix, mProjectionMatrix, mi.mRenderFlags);
-      GFXSetTSPipelineProps(mi.mMeshTexFrame, mi.mMeshTransformOffset, slm::vec4(0), slm::vec4(0));
+      for (uint32_t i=0; i<mMaterialTexIDs.size(); i++)
+         requestTextureSize(mMaterialTexIDs[i], pixelsPerUnit * mMaterialRepeatSize[i]);
+   }
+   
+   void render(const slm::vec3& eye)
+   {
+      if (mInterior == NULL || mInterior->mRenderBatches.empty())
+         return;
       
-      // NOTE: if we wanted to more optimally batch, emitting a drawcall per matIndex would make
-      // more sense here.
-      // Unfortunately we can't use texture arrays for everything here since the material list
-      // doesn't guarantee that every texture is consistently sized.
+      // Interior space == model space
+      slm::mat4 invModel = slm::inverse(mModelMatrix);
+      slm::vec3 localEye = (invModel * slm::vec4(eye, 1.0f)).xyz();
       
-      uint32_t passes = depthPeel ? 4 : 1;
+      const slm::vec4& sphere = mInterior->mBoundingSphere;
+      requestTextures(getPixelsPerUnit(slm::length(localEye - sphere.xyz()) - sphere.w));
+      mCuller.cull(localEye, mProjectionMatrix * mViewMatrix * mModelMatrix, mUsePortals, mCullSurfaces);
       
-      for (uint32_t i=0; i<passes; i++)
+      uint32_t numVerts = (uint32_t)mInterior->mRenderVerts.size();
+      uint32_t lastBatch = UINT32_MAX;
+      bool setVerts = false;
+      
+      for (const Dif::DrawRange& draw : mCuller.mDrawList)
       {
-         for (Dts3::Primitive& prim : bd->primitives)
+         if (draw.batchIndex != lastBatch)
          {
-            uint32_t matIndex = prim.matIndex & Dts3::Primitive::MaterialMask;
-            uint32_t drawMode = prim.matIndex & Dts3::Primitive::TypeMask;
-            
-            // To keep things simple, everything is assembled into a single texture group.
-            // IFL materials make use of the texture array feature.
-            MaterialList::Material& mat = mMaterialList->operator[](matIndex);
-            ActiveMaterial& amat = mActiveMaterials[matIndex];
-            uint32_t groupID = amat.texGroupID; // TODO
-            
-            ModelPipelineState pipelineState = calcPipelineState(mat.tsProps.flags);
-            GFXBeginTSModelPipelineState(pipelineState, 
-                                         groupID,
-                                         1.1f, depthPeel, (passes % 2) == 0);
-            
-            assert(drawMode == Dts3::Primitive::Triangles);
-            
-            GFXDrawModelPrims(mi.mRealVertsPerFrame,
-                              prim.numElements,
-                              mi.mIndexOffset + prim.firstElement,
-                              mi.mVertOffset + (mi.mMeshFrame * mi.mRealVertsPerFrame));
+            GFXBeginITRModelPipelineState(ModelPipeline_DefaultDiffuse, mGroupBase + draw.batchIndex, 1.1f, false, false);
+            lastBatch = draw.batchIndex;
+         }
+         
+         if (!setVerts)
+         {
+            updateMVP();
+            GFXSetITRModelVerts(mModelID);
+            setVerts = true;
          }
+         
+         GFXDrawModelPrims(numVerts, draw.indexCount, draw.indexStart, 0);
       }
    }
    
-   void renderDetail(uint32_t detailLevel)
+   // Draws one uploaded instance through the culler; used when the camera is
+   // inside it, which is where portals cut down what's drawn.
+   void renderCulled(uint32_t instance, const slm::mat4& transform, const slm::vec3& eye)
    {
-      Dts3::DetailLevel& level = mShape->mDetailLevels[detailLevel];
-      if (level.subshape < 0)
-      {
-         // render billboard
+      if (mInterior == NULL || mInterior->mRenderBatches.empty())
          return;
-      }
       
-      if (level.objectDetail < 0)
-         return;
+      slm::vec3 localEye = (slm::inverse(transform) * slm::vec4(eye, 1.0f)).xyz();
+      mCuller.cull(localEye, mProjectionMatrix * mViewMatrix * transform, mUsePortals, mCullSurfaces);
       
-      // Setup IFL
-      // TODO
+      uint32_t numVerts = (uint32_t)mInterior->mRenderVerts.size();
+      uint32_t lastBatch = UINT32_MAX;
+      bool setVerts = false;
       
-      Dts3::SubShape& ss = mShape->mSubshapes[level.subshape];
-      if (ss.firstTranslucent < 0)
+      for (const Dif::DrawRange& draw : mCuller.mDrawList)
       {
-         ss.firstTranslucent = ss.firstObject + ss.numObjects;
+         if (draw.batchIndex != lastBatch)
+         {
+            GFXBeginITRModelPipelineState(ModelPipeline_DefaultDiffuse, mGroupBase + draw.batchIndex, 1.1f, false, false);
+            lastBatch = draw.batchIndex;
+         }
+         
+         if (!setVerts)
+         {
+            updateMVP();
+            GFXSetITRModelVerts(mModelID);
+            setVerts = true;
+         }
+         
+         GFXDrawModelPrimsInstanced(numVerts, draw.indexCount, draw.indexStart, 0, instance, 1);
       }
+   }
+   
+   // Draws every batch once for a range of uploaded instances the camera is
+   // outside of, where every zone can be seen.
+   void renderInstanced(uint32_t firstInstance, uint32_t numInstances)
+   {
+      if (mInterior == NULL || mInterior->mRenderBatches.empty() || numInstances == 0)
+         return;
       
-      // NOTE: The original render code treats all meshes as separate and renders them one-by-one.
-      // Instead we opt to stick everything in a single vertex buffer and render everything in two main batches.
+      uint32_t numVerts = (uint32_t)mInterior->mRenderVerts.size();
       
-      for (uint32_t i=ss.firstObject; i<ss.firstTranslucent; i++)
-      {
-         renderObject(i, level.objectDetail);
-      }
-      for (uint32_t i=ss.firstTranslucent; i<ss.firstObject+ss.numObjects; i++)
+      for (uint32_t i=0; i<mInterior->mRenderBatches.size(); i++)
       {
-         renderObject(i, level.objectDetail);
+         const Dif::RenderBatch& batch = mInterior->mRenderBatches[i];
+         GFXBeginITRModelPipelineState(ModelPipeline_DefaultDiffuse, mGroupBase + i, 1.1f, false, false);
+         
+         if (i == 0)
+         {
+            updateMVP();
+            GFXSetITRModelVerts(mModelID);
+         }
+         
+         GFXDrawModelPrimsInstanced(numVerts, batch.indexCount, batch.indexStart, 0, firstInstance, numInstances);
       }
    }
+};
+
+class InteriorViewerController : public ViewController
+{
+public:
+   InteriorViewer mViewer;
+   SDL_Window* mWindow;
+   Dif::InteriorResource* mInterior;
+   
+   InteriorViewerController(SDL_Window* window, ResManager* mgr) :
+   mViewer(mgr)
+   {
+      mViewPos = slm::vec3(0,0,0);
+      mCamRot = slm::vec3(0,0,0);
+      mWindow = window;
+      mInterior = NULL;
+   }
    
-   void renderNodes(int32_t nodeIdx, slm::vec3 parentPos, int32_t highlightIdx)
+   ~InteriorViewerController()
    {
-      if (nodeIdx < 0)
-         return;
-      
-#if 0
-      slm::mat4 firstXfm = slm::inverse(mNodeTransforms[0]);
-      slm::mat4 baseModel = mModelMatrix;
-      slm::mat4 y_up = slm::rotation_x(slm::radians(-90.0f));
-      
-      slm::mat4 slmMat = mNodeTransforms[nodeIdx];
+      mViewer.clear();
+      if (mInterior)
+         delete mInterior;
+   }
+   
+   bool isResourceLoaded()
+   {
+      return mInterior != NULL;
+   }
+   
+   void loadInterior(const char *filename, int pathIdx=-1)
+   {
+      mViewer.clear();
+      if (mInterior)
+         delete mInterior;
+      mInterior = NULL;
       
-      slmMat[3] = slm::vec4(0,0,0,1);
-      //slmMat = slm::transpose(slmMat);
-      slmMat[3] = mNodeTransforms[nodeIdx][3];
+      ResourceInstance* inst = mViewer.mResourceManager->createResource(filename, pathIdx);
       
-      assert(slmMat[3].w == 1);
+      if (inst)
+      {
+         mInterior = (Dif::InteriorResource*)inst;
+         mViewer.loadInterior(*mInterior);
+         
+         // Start looking at the interior from outside its bounds
+         slm::vec3 center = (mInterior->mBoundsMin + mInterior->mBoundsMax) * 0.5f;
+         float radius = slm::length(mInterior->mBoundsMax - mInterior->mBoundsMin) * 0.5f;
+         mViewPos = center + slm::vec3(0, 0, radius);
+         mViewSpeed = std::max(radius * 0.5f, 1.0f);
+      }
+   }
+   
+   void update(float dt)
+   {
+      mViewer.mModelMatrix = slm::mat4(1);
+      slm::mat4 rotMat = slm::rotation_z(slm::radians(mCamRot.z)) * slm::rotation_y(slm::radians(mCamRot.y)) *  slm::rotation_x(slm::radians(mCamRot.x));
+      rotMat = inverse(rotMat);
+      mViewer.mViewMatrix = slm::mat4(1) * rotMat * slm::translation(-mViewPos);
       
-      slm::vec4 pos = baseModel * y_up * firstXfm * slmMat * slm::vec4(0,0,0,1);
+      int w, h;
+      SDL_GetWindowSize(mWindow, &w, &h);
+      mViewer.mProjectionMatrix = slm::perspective_fov_rh( slm::radians(90.0), (float)w/(float)h, 0.01f, 10000.0f);
       
-      drawLine(pos.xyz(), parentPos, nodeIdx == highlightIdx ? slm::vec4(0,1,0,1) : slm::vec4(1,0,0,1), 1);
+      mViewer.render(mViewPos);
       
-      // Recurse
-      Shape::NodeChildInfo info = mShape->mNodeChildren[nodeIdx+1];
-      for (int32_t i=0; i<info.numChildren; i++)
+      if (mInterior)
       {
-         renderNodes(mShape->mNodeChildIds[info.firstChild+i], pos.xyz(), highlightIdx);
+         const Dif::InteriorCuller::Stats& stats = mViewer.mCuller.mStats;
+         
+         ImGui::Begin("Interior");
+         ImGui::Text("Surfaces: %u", mInterior->mSurfaces.size());
+         ImGui::Text("Batches: %u", (uint32_t)mInterior->mRenderBatches.size());
+         ImGui::Text("Verts: %u Indices: %u", (uint32_t)mInterior->mRenderVerts.size(), (uint32_t)mInterior->mRenderIndices.size());
+         ImGui::Text("Lightmaps: %u (%u x %ux%u atlas)", (uint32_t)mInterior->mLightmaps.size(), mViewer.mLightmapAtlasLayers, mViewer.mLightmapAtlasSize, mViewer.mLightmapAtlasSize);
+         ImGui::Separator();
+         ImGui::Checkbox("Portal culling", &mViewer.mUsePortals);
+         ImGui::Checkbox("Surface culling", &mViewer.mCullSurfaces);
+         if (stats.cameraZone >= 0)
+            ImGui::Text("Camera zone: %i (%u/%u zones visible)", stats.cameraZone, stats.visibleZones, mInterior->mZones.size());
+         else
+            ImGui::Text("Camera zone: outside");
+         ImGui::Text("Portals: %u/%u passed", stats.portalsPassed, stats.portalsTested);
+         ImGui::Text("Surfaces drawn: %u culled: %u", stats.visibleSurfaces, stats.culledSurfaces);
+         ImGui::Text("Surfaces rejected: %u frustum, %u backface", stats.frustumSurfaces, stats.backfaceSurfaces);
+         ImGui::Text("Draw ranges: %u", stats.drawRanges);
+         ImGui::End();
       }
-#endif
    }
 };
 
-class ShapeViewerController : public ViewController
+class MissionViewerController : public ViewController
 {
 public:
-   ShapeViewer mViewer;
+   GenericViewer mViewer;
    SDL_Window* mWindow;
-   float xRot, yRot, mDetailDist;
-   Dts3::Shape* mShape;
-   int32_t mHighlightNodeIdx;
+   Mission::MissionFile* mMission;
+   SceneContainer mScene;
+   std::vector<uint32_t> mVisibleIds;
+   Dif::InteriorCuller::Frustum mFrustum;
    
-   std::vector<const char*> mSequenceList;
-   std::vector<int> mNextSequence;
+   enum
+   {
+      // Kept clear of the slots used by InteriorViewerController
+      FirstInteriorModelID = 1,
+      FirstInteriorGroupID = 1024
+   };
+   
+   // One viewer per unique interior; visible instances are grouped by viewer
+   // so each interior batch is a single instanced draw. Instances the camera
+   // is inside of are drawn on their own with portal culling.
+   struct InteriorDraw
+   {
+      InteriorViewer* viewer;
+      bool inside;
+      uint32_t id;
+      
+      inline bool operator<(const InteriorDraw& other) const
+      {
+         if (viewer != other.viewer)
+            return viewer < other.viewer;
+         if (inside != other.inside)
+            return inside < other.inside;
+         return id < other.id;
+      }
+   };
    
-   int32_t mRemoveThreadId;
-   bool mRenderNodes;
-   bool mManualThreads;
+   std::unordered_map<ResourceInstance*, InteriorViewer*> mInteriorViewers;
+   std::vector<InteriorDraw> mInteriorDraws;
    
-   ShapeViewerController(SDL_Window* window, ResManager* mgr) :
-   mViewer(mgr)
+   // Shapes are handed over to the shape manager, so they're shared with the shape viewer.
+   // Visible instances are grouped by shape, so each mesh & material is one instanced draw.
+   struct ShapeDraw
    {
+      SharedShape* shape;
+      uint32_t id;
+      
+      inline bool operator<(const ShapeDraw& other) const
+      {
+         if (shape != other.shape)
+            return shape < other.shape;
+         return id < other.id;
+      }
+   };
+   
+   ShapeResourceManager* mShapeManager;
+   std::unordered_map<Mission::LoadedResource*, ShapeHandle> mShapes;
+   std::vector<ShapeDraw> mShapeDraws;
+   std::vector<ModelInstance> mShapeInstanceData;
+   uint32_t mNumShapesDrawn;
+   uint32_t mNumShapeRuns;
+   std::vector<ModelInstance> mInstanceData;
+   uint32_t mNumInteriorsDrawn;
+   uint32_t mNumInteriorRuns;
+   uint32_t mNumInteriorsCulled; // drawn through portals
+   
+   std::string mSnapshotDir;
+   bool mFromSnapshot;
+   float mOpenMS;
+   
+   MissionViewerController(SDL_Window* window, ResManager* mgr, ShapeResourceManager* shapeMgr)
+   {
+      mViewer.mResourceManager = mgr;
+      mShapeManager = shapeMgr;
       mViewPos = slm::vec3(0,0,0);
       mCamRot = slm::vec3(0,0,0);
-      mViewer.initRender();
       mWindow = window;
-      xRot = mDetailDist = 0;
-      yRot = slm::radians(180.0f);
-      mShape = NULL;
-      mHighlightNodeIdx = -1;
-      mRemoveThreadId = -1;
-      mRenderNodes = true;
-      mManualThreads = false;
+      mMission = NULL;
+      mSnapshotDir = "snapshots";
+      mFromSnapshot = false;
+      mOpenMS = 0.0f;
+      mNumInteriorsDrawn = 0;
+      mNumInteriorRuns = 0;
+      mNumInteriorsCulled = 0;
+      mNumShapesDrawn = 0;
+      mNumShapeRuns = 0;
    }
    
-   ~ShapeViewerController()
+   ~MissionViewerController()
    {
-      if (mShape)
-         delete mShape;
+      clearInteriors();
+      clearShapes();
+      if (mMission)
+         delete mMission;
    }
    
    bool isResourceLoaded()
    {
-      return mShape != NULL;
+      return mMission != NULL;
+   }
+   
+   void loadMission(const char *filename, int pathIdx=-1)
+   {
+      clearInteriors();
+      clearShapes();
+      mScene.clear();
+      if (mMission)
+         delete mMission;
+      mMission = NULL;
+      
+      auto startTime = std::chrono::steady_clock::now();
+      
+      MemRStream stream;
+      if (!mViewer.mResourceManager->openFile(filename, stream, pathIdx))
+         return;
+      
+      // Use the snapshot from the last time this was opened if the script hasn't changed
+      std::string snapshotPath = Mission::MissionSnapshot::getCachePath(mSnapshotDir.c_str(), filename);
+      Mission::MissionSnapshot snapshot;
+      mMission = new Mission::MissionFile();
+      mFromSnapshot = snapshot.open(snapshotPath.c_str()) &&
+                      snapshot.mHeader->missionHash == hashBytes64(stream.mPtr, stream.mSize) &&
+                      snapshot.mHeader->missionSize == stream.mSize &&
+                      mMission->restore(snapshot);
+      
+      if (!mFromSnapshot && !mMission->read(stream))
+      {
+         delete mMission;
+         mMission = NULL;
+         return;
+      }
+      
+      mMission->loadResources(*mViewer.mResourceManager);
+      loadShapes();
+      
+      // Falls back to building the scene if any of the resources changed
+      if (mFromSnapshot && !snapshot.restoreScene(*mMission, mScene))
+         mFromSnapshot = false;
+      snapshot.close();
+      
+      if (!mFromSnapshot)
+      {
+         buildScene();
+         
+         SDL_CreateDirectory(mSnapshotDir.c_str());
+         Mission::MissionSnapshot::write(snapshotPath.c_str(), *mMission, mScene);
+      }
+      
+      mOpenMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+      
+      loadInteriors();
+      
+      const Mission::MissionFile::Stats& stats = mMission->mStats;
+      printf("Mission %s: %u objects, %u resources (%u missing) %s in %.2fms, loaded in %.2fms on %u threads\n",
+             filename, stats.numObjects, stats.numResources, stats.numResourcesMissing,
+             mFromSnapshot ? "restored" : "parsed", stats.parseMS, stats.loadMS, stats.numThreads);
+      
+      // Start above the first interior if there is one
+      mViewPos = slm::vec3(0, 0, 100);
+      mMission->forEachObject([this](Mission::SimObject* obj){
+         Mission::InteriorInstance* itr = dynamic_cast<Mission::InteriorInstance*>(obj);
+         if (itr && mViewPos == slm::vec3(0, 0, 100))
+            mViewPos = itr->mPosition + slm::vec3(0, -50, 50);
+      });
+      mViewSpeed = 50.0f;
+   }
+   
+   void buildScene()
+   {
+      // Terrains tile, so anything placed will usually be within a couple of blocks of the origin
+      mScene.reset(slm::vec3(0), 4096.0f);
+      mMission->forEachObject([this](Mission::SimObject* obj){
+         Mission::SceneObject* sceneObj = dynamic_cast<Mission::SceneObject*>(obj);
+         if (sceneObj == NULL || dynamic_cast<Mission::TerrainBlock*>(obj))
+            return;
+         
+         ResourceInstance* res = NULL;
+         slm::vec3 boundsMin(-0.5f);
+         slm::vec3 boundsMax(0.5f);
+         
+         Mission::InteriorInstance* itr = dynamic_cast<Mission::InteriorInstance*>(obj);
+         if (itr && itr->mResource && itr->mResource->instance)
+         {
+            Dif::InteriorResource* itrRes = (Dif::InteriorResource*)itr->mResource->instance;
+            res = itrRes;
+            boundsMin = itrRes->mBoundsMin;
+            boundsMax = itrRes->mBoundsMax;
+         }
+         else if (Mission::TSStatic* ts = dynamic_cast<Mission::TSStatic*>(obj))
+         {
+            auto shapeItr = mShapes.find(ts->mResource);
+            if (shapeItr != mShapes.end())
+            {
+               boundsMin = shapeItr->second->mShape->mBounds.min;
+               boundsMax = shapeItr->second->mShape->mBounds.max;
+            }
+            else
+            {
+               boundsMin = slm::vec3(-1);
+               boundsMax = slm::vec3(1);
+            }
+         }
+         
+         mScene.addInstance(res, sceneObj->getTransform(), boundsMin, boundsMax, obj);
+      });
    }
    
-   void updateNextSequence()
+   // Shapes are parsed on the reader threads along with everything else, then
+   // handed to the shape manager which owns them from then on
+   void loadShapes()
    {
-      #if 0
-      mNextSequence.resize(mViewer.mThreads.size());
-      for (int i=0; i<mViewer.mThreads.size(); i++)
+      for (Mission::LoadedResource* res : mMission->mResources)
       {
-         mNextSequence[i] = mViewer.mThreads[i].sequenceIdx;
+         Dts3::Shape* shape = dynamic_cast<Dts3::Shape*>(res->instance);
+         if (shape == NULL)
+            continue;
+         
+         res->instance = NULL;
+         ShapeHandle handle = mShapeManager->adopt(res->resolvedName.c_str(), shape);
+         if (handle.isValid())
+            mShapes[res] = handle;
       }
-      #endif
    }
    
-   void loadShape(const char *filename, int pathIdx=-1)
+   void clearShapes()
    {
-      MemRStream rStream(0, NULL);
-      mViewer.clear();
-      if (mShape)
-         delete mShape;
-      mShape = NULL;
+      mShapeDraws.clear();
+      mShapes.clear();
+   }
+   
+   // Returns the loaded shape for obj, or NULL if it isn't a TSStatic or its shape didn't load
+   SharedShape* findShape(Mission::SimObject* obj)
+   {
+      Mission::TSStatic* ts = dynamic_cast<Mission::TSStatic*>(obj);
+      if (ts == NULL)
+         return NULL;
       
-      ResourceInstance* inst = mViewer.mResourceManager->createResource(filename, pathIdx);
+      auto itr = mShapes.find(ts->mResource);
+      return itr != mShapes.end() ? itr->second.get() : NULL;
+   }
+   
+   void renderShapes()
+   {
+      slm::vec3 eye = (slm::inverse(mViewer.mViewMatrix) * slm::vec4(0.0f, 0.0f, 0.0f, 1.0f)).xyz();
       
-      if (inst)
+      mShapeDraws.clear();
+      for (uint32_t id : mVisibleIds)
       {
-         Dts3::Shape* shape = (Dts3::Shape*)inst;
-         mShape = shape;
-         mViewer.clear();
-         mViewer.loadShape(*mShape);
-         
-         //uint32_t thr = mViewer.addThread();
-         //mViewer.setThreadSequence(thr, 0);
+         SharedShape* shape = findShape((Mission::SimObject*)mScene.mInstances[id].userData);
+         if (shape)
+            mShapeDraws.push_back({shape, id});
+      }
+      
+      // Sorting by shape makes each shape's instances contiguous
+      std::sort(mShapeDraws.begin(), mShapeDraws.end());
+      
+      mShapeInstanceData.resize(mShapeDraws.size());
+      for (uint32_t i=0; i<mShapeDraws.size(); i++)
+      {
+         mShapeInstanceData[i].transform = mScene.mInstances[mShapeDraws[i].id].transform;
+         mShapeInstanceData[i].transformOffset = 0;
+      }
+      
+      mNumShapesDrawn = (uint32_t)mShapeDraws.size();
+      mNumShapeRuns = 0;
+      if (mShapeDraws.empty())
+         return;
+      
+      GFXUploadModelInstances(&mShapeInstanceData[0], (uint32_t)mShapeInstanceData.size());
+      mViewer.updateMVP();
+      
+      for (uint32_t start=0; start<mShapeDraws.size();)
+      {
+         SharedShape* shape = mShapeDraws[start].shape;
+         uint32_t end = start;
+         float minDist = FLT_MAX; // to the nearest instance's bounds
+         for (; end < mShapeDraws.size() && mShapeDraws[end].shape == shape; end++)
+         {
+            const SceneContainer::Instance& inst = mScene.mInstances[mShapeDraws[end].id];
+            minDist = std::min(minDist, slm::length(eye - inst.center) - slm::length(inst.extent));
+         }
          
-         mViewPos = slm::vec3(0);//slm::vec3(0, mViewer.mShape->mCenter.z, mViewer.mShape->mRadius);
+         // The whole run uses the detail & texture size the nearest instance needs
+         float pixelsPerUnit = mViewer.getPixelsPerUnit(minDist);
+         for (int32_t texID : shape->mMaterialTexIDs)
+            GenericViewer::requestTextureSize(texID, pixelsPerUnit * shape->mShape->mRadius * 2.0f);
          
-         //mSequenceList.resize(mShape->mSequences.size());
-         //updateNextSequence();
+         uint32_t detail = ShapeViewer::findDetail(shape->mShape, pixelsPerUnit * shape->mShape->mRadius);
+         ShapeViewer::renderInstanced(*shape, detail, start, end - start);
+         mNumShapeRuns++;
          
-         //for (int i=0; i<mViewer.mShape->mSequences.size(); i++)
-         //{
-         //   mSequenceList[i] = mShape->getName(mShape->mSequences[i].name);
-         //}
+         start = end;
       }
    }
    
-   void update(float dt)
+   void loadInteriors()
    {
-      #if 0
-      mViewer.mModelMatrix = slm::rotation_x(xRot) * slm::rotation_y(yRot);
-      slm::mat4 rotMat = slm::rotation_z(slm::radians(mCamRot.z)) * slm::rotation_y(slm::radians(mCamRot.y)) *  slm::rotation_x(slm::radians(mCamRot.x));
-      rotMat = inverse(rotMat);
-      mViewer.mViewMatrix = slm::mat4(1) * rotMat * slm::translation(-mViewPos);
+      uint32_t nextGroupID = FirstInteriorGroupID;
       
-      int w, h;
-      SDL_GetWindowSize(mWindow, &w, &h);
-      mViewer.mProjectionMatrix = slm::perspective_fov_rh( slm::radians(90.0), (float)w/(float)h, 0.01f, 10000.0f);
+      mMission->forEachObject([this, &nextGroupID](Mission::SimObject* obj){
+         Mission::InteriorInstance* itr = dynamic_cast<Mission::InteriorInstance*>(obj);
+         if (itr == NULL || itr->mResource == NULL || itr->mResource->instance == NULL)
+            return;
+         
+         ResourceInstance* res = itr->mResource->instance;
+         if (mInteriorViewers.find(res) != mInteriorViewers.end())
+            return;
+         
+         Dif::InteriorResource* itrRes = (Dif::InteriorResource*)res;
+         InteriorViewer* viewer = new InteriorViewer(mViewer.mResourceManager);
+         viewer->mModelID = FirstInteriorModelID + (uint32_t)mInteriorViewers.size();
+         viewer->mGroupBase = nextGroupID;
+         viewer->loadInterior(*itrRes);
+         nextGroupID += (uint32_t)itrRes->mRenderBatches.size();
+         
+         mInteriorViewers[res] = viewer;
+      });
+   }
+   
+   void clearInteriors()
+   {
+      for (auto& itr : mInteriorViewers)
+         delete itr.second;
+      mInteriorViewers.clear();
+      mInteriorDraws.clear();
+   }
+   
+   void renderInteriors()
+   {
+      slm::vec3 eye = (slm::inverse(mViewer.mViewMatrix) * slm::vec4(0.0f, 0.0f, 0.0f, 1.0f)).xyz();
       
-      if (!mManualThreads)
-         mViewer.advanceThreads(dt);
-      mViewer.selectDetail(mDetailDist, w, h);
-      mViewer.animateNodes();
-      mViewer.render();
-      if (mRenderNodes)
+      mInteriorDraws.clear();
+      for (uint32_t id : mVisibleIds)
       {
-         mViewer.renderNodes(mShape->mDetails[mViewer.mCurrentDetail].rootNode, slm::vec3(0,0,0), mHighlightNodeIdx);
+         const SceneContainer::Instance& inst = mScene.mInstances[id];
+         auto itr = mInteriorViewers.find(inst.resource);
+         if (itr == mInteriorViewers.end())
+            continue;
+         
+         InteriorDraw draw;
+         draw.viewer = itr->second;
+         draw.id = id;
+         draw.inside = false;
+         if (draw.viewer->mUsePortals)
+         {
+            slm::vec3 localEye = (slm::inverse(inst.transform) * slm::vec4(eye, 1.0f)).xyz();
+            draw.inside = draw.viewer->mInterior->findZone(localEye) >= 0;
+         }
+         mInteriorDraws.push_back(draw);
       }
       
-      // Now render gui
-      ImGui::Begin("Nodes");
-      ImGui::PushStyleVar(ImGuiStyleVar_Alpha, 0.75);
-      nodeTree(0);
-      ImGui::PopStyleVar(1);
-      ImGui::End();
-      
-      ImGui::Begin("Anim");
-      char buffer[1024];
+      // Sorting by viewer makes each interior's instances contiguous
+      std::sort(mInteriorDraws.begin(), mInteriorDraws.end());
       
-      if (ImGui::Button("Add Thread"))
+      mInstanceData.resize(mInteriorDraws.size());
+      for (uint32_t i=0; i<mInteriorDraws.size(); i++)
       {
-         mViewer.addThread();
-         updateNextSequence();
+         mInstanceData[i].transform = mScene.mInstances[mInteriorDraws[i].id].transform;
+         mInstanceData[i].transformOffset = 0;
       }
       
-      ImGui::SameLine();
-      ImGui::Checkbox("Manual Control", &mManualThreads);
+      mNumInteriorsDrawn = (uint32_t)mInteriorDraws.size();
+      mNumInteriorRuns = 0;
+      mNumInteriorsCulled = 0;
+      if (mInteriorDraws.empty())
+         return;
       
-      if (mRemoveThreadId >= 0)
-      {
-         mViewer.removeThread(mRemoveThreadId);
-         mRemoveThreadId = -1;
-      }
+      GFXUploadModelInstances(&mInstanceData[0], (uint32_t)mInstanceData.size());
       
-      for (ShapeViewer::ShapeThread &thread : mViewer.mThreads)
+      for (uint32_t start=0; start<mInteriorDraws.size();)
       {
-         int32_t idx = &thread - &mViewer.mThreads[0];
-         snprintf(buffer, 1024, "Thread %i", idx);
+         InteriorViewer* viewer = mInteriorDraws[start].viewer;
+         bool inside = mInteriorDraws[start].inside;
+         uint32_t end = start;
+         float minDist = FLT_MAX; // to the nearest instance's bounds
+         for (; end < mInteriorDraws.size() && mInteriorDraws[end].viewer == viewer && mInteriorDraws[end].inside == inside; end++)
+         {
+            const SceneContainer::Instance& inst = mScene.mInstances[mInteriorDraws[end].id];
+            minDist = std::min(minDist, slm::length(eye - inst.center) - slm::length(inst.extent));
+         }
          
-         bool vis = ImGui::CollapsingHeader(buffer);
-         ImGui::SameLine();
+         viewer->mModelMatrix = slm::mat4(1);
+         viewer->mViewMatrix = mViewer.mViewMatrix;
+         viewer->mProjectionMatrix = mViewer.mProjectionMatrix;
+         viewer->requestTextures(viewer->getPixelsPerUnit(minDist));
          
-         if (thread.sequenceIdx == -1 || thread.sequenceIdx >= mViewer.mShape->mSequences.size())
+         if (inside)
          {
-            snprintf(buffer, 1024, "INVALID");
+            for (uint32_t i=start; i<end; i++)
+               viewer->renderCulled(i, mInstanceData[i].transform, eye);
+            mNumInteriorsCulled += end - start;
          }
          else
          {
-            snprintf(buffer, 1024, "seq=%s pos=%f",
-                     thread.sequenceIdx == -1 ? "NULL" : mShape->getName(mShape->mSequences[thread.sequenceIdx].name),
-                     thread.pos);
+            viewer->renderInstanced(start, end - start);
+            mNumInteriorRuns++;
          }
          
-         ImGui::Text(buffer);
-         
-         if (vis)
-         {
-            snprintf(buffer, 1024, "Enabled##th%i", idx);
-            ImGui::Checkbox(buffer, &mViewer.mThreads[idx].enabled);
-            ImGui::SameLine();
-            snprintf(buffer, 1024, "Remove##th%i", idx);
-            if (ImGui::Button(buffer))
-               mRemoveThreadId = idx;
-            snprintf(buffer, 1024, "Pos##th%i", idx);
-            ImGui::SliderFloat(buffer, &mViewer.mThreads[idx].pos, 0.0f, 1.0f);
-            ImGui::NewLine();
-            snprintf(buffer, 1024, "Sequences##th%i", idx);
-            ImGui::ListBox(buffer, &mNextSequence[idx], &mSequenceList[0], mShape->mSequences.size());
-         }
+         start = end;
+      }
+   }
+   
+   void drawBox(const slm::mat4& xfm, slm::vec3 bmin, slm::vec3 bmax, slm::vec4 color)
+   {
+      slm::vec3 corners[8];
+      for (int i=0; i<8; i++)
+      {
+         slm::vec3 pt((i & 1) ? bmax.x : bmin.x, (i & 2) ? bmax.y : bmin.y, (i & 4) ? bmax.z : bmin.z);
+         corners[i] = (xfm * slm::vec4(pt, 1.0f)).xyz();
       }
       
-      ImGui::End();
-      
-      ImGui::Begin("View");
-      ImGui::SliderAngle("X Rotation", &xRot);
-      ImGui::SliderAngle("Y Rotation", &yRot);
-      ImGui::SliderFloat("Detail Distance", &mDetailDist, 0, 1000.0f);
-      ImGui::Checkbox("Render Nodes", &mRenderNodes);
-      ImGui::End();
-      
-      // Update state changed by gui
-      for (int i=0; i<mNextSequence.size(); i++)
+      for (int i=0; i<8; i++)
       {
-         if (mNextSequence[i] != mViewer.mThreads[i].sequenceIdx)
+         for (int axis=1; axis<8; axis <<= 1)
          {
-            mViewer.setThreadSequence(i, mNextSequence[i]);
+            if ((i & axis) == 0)
+               GFXDrawLine(corners[i], corners[i | axis], color, 2.0f);
          }
       }
-      #endif
    }
    
-   void nodeTree(int32_t nodeIdx)
+   void render()
    {
-      #if 0
-      if (nodeIdx < 0)
-         return;
+      Dif::InteriorCuller::extractFrustum(mViewer.mProjectionMatrix * mViewer.mViewMatrix, mFrustum);
+      mScene.findInFrustum(mFrustum.data(), (uint32_t)mFrustum.size(), mVisibleIds);
       
-      Shape::NodeChildInfo info = mShape->mNodeChildren[nodeIdx+1];
-      uint32_t baseFlags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_OpenOnDoubleClick;
+      renderInteriors();
+      renderShapes();
       
-      bool visDetail = (nodeIdx == mShape->mDetails[mViewer.mCurrentDetail].rootNode);
-      
-      if (visDetail)
-      {
-         ImGui::PushStyleVar(ImGuiStyleVar_Alpha, 1.0);
-      }
+      mViewer.updateMVP();
+      GFXBeginLinePipelineState();
       
-      bool vis = ImGui::TreeNodeEx(mShape->getName(mShape->mNodes[nodeIdx].name), info.numChildren > 0 ? baseFlags : baseFlags|ImGuiTreeNodeFlags_Leaf);
-      if (ImGui::IsItemClicked())
+      // NOTE: anything without a loaded model is shown as a box
+      for (uint32_t id : mVisibleIds)
       {
-         mHighlightNodeIdx = nodeIdx;
+         const SceneContainer::Instance& inst = mScene.mInstances[id];
+         Mission::SimObject* obj = (Mission::SimObject*)inst.userData;
+         
+         if (mInteriorViewers.find(inst.resource) != mInteriorViewers.end() || findShape(obj))
+            continue;
+         
+         slm::vec4 color(0.6f, 0.6f, 0.6f, 1);
+         if (inst.resource)
+            color = slm::vec4(1, 0.8f, 0.2f, 1);
+         else if (dynamic_cast<Mission::TSStatic*>(obj))
+            color = slm::vec4(0.2f, 0.6f, 1, 1);
+         
+         drawBox(inst.transform, inst.objBoundsMin, inst.objBoundsMax, color);
       }
+   }
+   
+   void drawObjectTree(Mission::SimObject* obj)
+   {
+      char label[256];
+      snprintf(label, sizeof(label), "%s %s##%p", obj->mClassName.c_str(), obj->mName.c_str(), obj);
       
-      if (vis)
+      if (obj->isGroup())
       {
-         for (int32_t i=0; i<info.numChildren; i++)
+         if (ImGui::TreeNode(label))
          {
-            nodeTree(mShape->mNodeChildIds[info.firstChild+i]);
+            for (Mission::SimObject* child : ((Mission::SimGroup*)obj)->mObjects)
+               drawObjectTree(child);
+            ImGui::TreePop();
          }
-         ImGui::TreePop();
+         return;
       }
       
-      if (visDetail)
+      Mission::SceneObject* sceneObj = dynamic_cast<Mission::SceneObject*>(obj);
+      if (ImGui::Selectable(label) && sceneObj)
       {
-         ImGui::PopStyleVar(1);
+         mViewPos = sceneObj->mPosition + slm::vec3(0, -20, 10);
       }
-      #endif
    }
    
+   void update(float dt)
+   {
+      mViewer.mModelMatrix = slm::mat4(1);
+      slm::mat4 rotMat = slm::rotation_z(slm::radians(mCamRot.z)) * slm::rotation_y(slm::radians(mCamRot.y)) *  slm::rotation_x(slm::radians(mCamRot.x));
+      rotMat = inverse(rotMat);
+      mViewer.mViewMatrix = slm::mat4(1) * rotMat * slm::translation(-mViewPos);
+      
+      int w, h;
+      SDL_GetWindowSize(mWindow, &w, &h);
+      mViewer.mProjectionMatrix = slm::perspective_fov_rh( slm::radians(90.0), (float)w/(float)h, 0.1f, 10000.0f);
+      
+      if (mMission == NULL)
+         return;
+      
+      render();
+      
+      const Mission::MissionFile::Stats& stats = mMission->mStats;
+      ImGui::Begin("Mission");
+      ImGui::Text("Objects: %u (%u unknown)", stats.numObjects, stats.numUnknownObjects);
+      ImGui::Text("Resources: %u (%u missing)", stats.numResources, stats.numResourcesMissing);
+      ImGui::Text("%s: %.2fms Load: %.2fms (%u threads)", mFromSnapshot ? "Restore" : "Parse", stats.parseMS, stats.loadMS, stats.numThreads);
+      ImGui::Text("Opened in %.2fms%s", mOpenMS, mFromSnapshot ? " from snapshot" : "");
+      ImGui::Text("Visible: %u/%u (%u nodes visited, %u objects tested)", mScene.mStats.objectsFound, mScene.getNumInstances(),
+                  mScene.mStats.nodesVisited, mScene.mStats.objectsTested);
+      ImGui::Text("Interiors: %u drawn as %u instanced runs, %u portal culled (%u unique)", mNumInteriorsDrawn, mNumInteriorRuns, mNumInteriorsCulled, (uint32_t)mInteriorViewers.size());
+      ImGui::Text("Shapes: %u drawn as %u instanced runs (%u unique)", mNumShapesDrawn, mNumShapeRuns, (uint32_t)mShapes.size());
+      ImGui::Separator();
+      for (Mission::SimObject* obj : mMission->mRootObjects)
+         drawObjectTree(obj);
+      ImGui::End();
+   }
 };
 
 
 static const uint64_t tickMS = 1000.0 / 60;
 
+// Max time to block for events when idle in on-demand mode
+static const uint64_t idleWaitMS = 250;
+
+// Frames to keep rendering after input so ImGui can settle (hover, popups, etc)
+static const uint32_t redrawFramesAfterInput = 3;
+
 struct MainState
 {
    ResManager resManager;
+   ShapeResourceManager shapeManager;
    ShapeViewerController* shapeController;
-   //InteriorViewerController* interiorController;
+   InteriorViewerController* interiorController;
+   MissionViewerController* missionController;
    //TerrainViewerController* terrainController;
    ViewController *currentController;
    
@@ -1432,11 +3162,41 @@ struct MainState
    bool isGFXSetup;
    bool running;
    
+   // On-demand rendering
+   bool onDemandRender;
+   uint32_t redrawFrames;
+   uint64_t framesSkipped;
+   
+   // Set when running with -bench
+   BenchRun* benchRun;
+   
    SDL_Window* window;
    
-   MainState() : shapeController(NULL), /* interiorController(NULL), terrainController(NULL),*/ currentController(NULL), in_argc(0), isGFXSetup(false)
+   // Material texture residency & sharing; used by all the viewers
+   TextureStreamer textureStreamer;
+   TextureCache textureCache;
+   
+   // Samples node animation for all shapes
+   Dts3::AnimationScheduler animScheduler;
+   
+   MainState() : shapeManager(&resManager), shapeController(NULL), interiorController(NULL), missionController(NULL), /* terrainController(NULL),*/ currentController(NULL), in_argc(0), isGFXSetup(false),
+   textureStreamer([this](int32_t texID, uint32_t width, uint32_t height, const uint8_t* pixels) {
+                      if (texID < 0)
+                         return GFXLoadCustomTexture(CustomTexture_RGBA8, width, height, (void*)pixels);
+                      if (!GFXReplaceCustomTexture(texID, CustomTexture_RGBA8, width, height, (void*)pixels))
+                         return -1;
+                      // Keep the shared bytes in step with the resident mip
+                      textureCache.setBytes(texID, TextureStreamer::getMipBytes(width, height, 0));
+                      return texID;
+                   },
+                   [](int32_t texID) { GFXDeleteTexture(texID); }),
+   textureCache([](int32_t texID) { GenericViewer::freeTexture(texID); })
    {
       lastTicks = 0;
+      onDemandRender = false;
+      redrawFrames = redrawFramesAfterInput;
+      framesSkipped = 0;
+      benchRun = NULL;
       selectedFileIdx = -1;
       selectedVolumeIdx = -1;
       oldSelectedVolumeIdx = -1;
@@ -1453,14 +3213,37 @@ struct MainState
       in_argc = argc;
       in_argv = argv;
       
-      shapeController = new ShapeViewerController(window, &resManager);
-      //interiorController = new InteriorViewerController(window, &resManager);
+      GenericViewer::smMaterialTextures.mStreamer = &textureStreamer;
+      GenericViewer::smMaterialTextures.mCache = &textureCache;
+      ShapeViewer::smAnimScheduler = &animScheduler;
+      
+      shapeController = new ShapeViewerController(window, &resManager, &shapeManager);
+      shapeManager.mOnShapeReplaced = [this](SharedShape* shared) { shapeController->onShapeReplaced(shared); };
+      interiorController = new InteriorViewerController(window, &resManager);
+      missionController = new MissionViewerController(window, &resManager, &shapeManager);
       //terrainController = new TerrainViewerController(window, &resManager);
    }
    
    int boot();
    int loop();
    
+   void handleEvent(SDL_Event& event);
+   bool needsRedraw();
+   
+   void removeUnreadableFiles();
+   
+   bool parseBenchArgs();
+   void updateBench(float& dt);
+   void finishBenchFrame(uint64_t frameStartNS);
+   
+   void drawMemoryPanel();
+   void drawGPUStatsPanel();
+   
+   void requestRedraw(uint32_t numFrames=redrawFramesAfterInput)
+   {
+      redrawFrames = std::max(redrawFrames, numFrames);
+   }
+   
    int testBoot();
    int testLoop();
    
@@ -1475,6 +3258,10 @@ template<class T> static ResourceInstance* _createClass() { return new T(); }
 void ResManager::initStatics()
 {
    registerCreateFunc(".dts", _createClass<Dts3::Shape>);
+   registerCreateFunc(".dif", _createClass<Dif::InteriorResource>);
+   registerCreateFunc(".mis", _createClass<Mission::MissionFile>);
+   registerPeekFunc(".dts", 16, Dts3::Shape::peekHeader);
+   registerPeekFunc(".dif", 4, Dif::InteriorResource::peekHeader);
 }
 
 
@@ -1490,6 +3277,16 @@ int main(int argc, const char * argv[])
    ConsolePersistObject::initStatics();
    ResManager::initStatics();
    
+   for (int i=1; i<argc; i++)
+   {
+      if (strcasecmp(argv[i], "-headless") == 0)
+      {
+         // No display needed; render to an offscreen target instead
+         SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+         GFXSetHeadless(true);
+      }
+   }
+   
    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) < 0) {
       printf("Couldn't initialize SDL: %s\n", SDL_GetError());
       return (1);
@@ -1505,15 +3302,15 @@ int main(int argc, const char * argv[])
    
    int setupCode = GFXSetup(window, renderer);
    
-   if (setupCode < 0)
+   // Non-Emscripten setup
+   while (setupCode > 0)
    {
-      return 1;
+      setupCode = GFXSetup(window, renderer);
    }
    
-   // Non-Emscripten setup
-   while (setupCode != 0)
+   if (setupCode < 0)
    {
-      setupCode = GFXSetup(window, renderer);
+      return 1;
    }
    
    int ret = gMainState.boot();
@@ -1532,30 +3329,72 @@ int main(int argc, const char * argv[])
 
 void MainState::shutdown()
 {
+   if (benchRun)
+   {
+      delete benchRun;
+      benchRun = NULL;
+   }
+   
    if (shapeController)
    {
       delete shapeController;
-      //delete interiorController;
+      delete interiorController;
+      delete missionController;
       //delete terrainController;
       shapeController = NULL;
-      //interiorController = NULL;
+      interiorController = NULL;
+      missionController = NULL;
       //terrainController = NULL;
    }
    
+   textureCache.clear();
+   GenericViewer::smMaterialTextures.mCache = NULL;
+   textureStreamer.clear();
+   GenericViewer::smMaterialTextures.mStreamer = NULL;
+   animScheduler.clear();
+   ShapeViewer::smAnimScheduler = NULL;
+   
    GFXTeardown();
    SDL_DestroyWindow( gMainState.window );
    SDL_Quit();
 }
 
+// Flags which are followed by a value; any other argument starting with '-' stands alone
+static bool argTakesValue(const char* arg)
+{
+   static const char* sValueArgs[] = { "-bench", "-benchframes", "-benchwarmup", "-benchdt", "-benchout" };
+   for (const char* valueArg : sValueArgs)
+   {
+      if (strcasecmp(arg, valueArg) == 0)
+         return true;
+   }
+   return false;
+}
+
 int MainState::boot()
 {
    currentController = shapeController;
    
+   for (int i=1; i<in_argc; i++)
+   {
+      if (strcasecmp(in_argv[i], "-ondemand") == 0)
+         onDemandRender = true;
+   }
+   
+   // Inflate indices for large volume entries are kept between runs
+   SDL_CreateDirectory("inflatecache");
+   resManager.setIndexCachePath("inflatecache");
+   
+   // Files can be given before or after any flags
    for (int i=1; i<in_argc; i++)
    {
       const char *path = in_argv[i];
-      if (path && path[0] == '-')
-         break;
+      if (path[0] == '-')
+      {
+         if (argTakesValue(path))
+            i++;
+         continue;
+      }
       
       fs::path filePath = path;
       std::string  ext = filePath.extension();
@@ -1572,8 +3411,13 @@ int MainState::boot()
       }
       else if (ext == ".dif")
       {
-         //interiorController->loadInterior(path);
-         //currentController = interiorController;
+         interiorController->loadInterior(path);
+         currentController = interiorController;
+      }
+      else if (ext == ".mis")
+      {
+         missionController->loadMission(path);
+         currentController = missionController;
       }
       else if (ext == ".ter")
       {
@@ -1588,10 +3432,13 @@ int MainState::boot()
    
    if (!currentController->isResourceLoaded())
    {
-      fprintf(stderr, "please specify a starting shape or interior or terrain to load\n");
+      fprintf(stderr, "please specify a starting shape, interior, mission or terrain to load\n");
       return 1;
    }
    
+   if (!parseBenchArgs())
+      return 1;
+   
    running = true;
    
    deltaMovement = slm::vec3(0);
@@ -1605,7 +3452,9 @@ int MainState::boot()
    restrictExtList.push_back(".dts");
    restrictExtList.push_back(".dif");
    restrictExtList.push_back(".ter");
+   restrictExtList.push_back(".mis");
    resManager.enumerateFiles(fileList, selectedVolumeIdx, &restrictExtList);
+   removeUnreadableFiles();
    sFileList.resize(fileList.size());
    
    for (int i=0; i<fileList.size(); i++)
@@ -1634,12 +3483,33 @@ int MainState::loop()
    ImGui::StyleColorsDark();
    
    SDL_Event event;
+   uint64_t frameStartNS = SDL_GetTicksNS();
+   
+   if (onDemandRender && !benchRun && !needsRedraw())
+   {
+      // Nothing is going to change so block until something happens
+      // rather than presenting the same frame again.
+      uint64_t waitStart = SDL_GetTicks();
+      bool gotEvent = SDL_WaitEventTimeout(&event, idleWaitMS);
+      uint64_t waitEnd = SDL_GetTicks();
+      
+      framesSkipped += (waitEnd - waitStart) / tickMS;
+      lastTicks = waitEnd; // idle time shouldn't count towards dt
+      
+      if (!gotEvent)
+         return running ? 0 : 1;
+      
+      handleEvent(event);
+   }
    
    uint64_t curTicks = SDL_GetTicks();
    uint64_t oldLastTicks = lastTicks;
    float dt = ((float)(curTicks - lastTicks)) / 1000.0f;
    lastTicks = curTicks;
    
+   if (benchRun)
+      updateBench(dt);
+   
    currentController->mCamRot += deltaRot * dt * 100;
    slm::mat4 rotMat = slm::rotation_z(slm::radians(currentController->mCamRot.z)) * slm::rotation_y(slm::radians(currentController->mCamRot.y)) *  slm::rotation_x(slm::radians(currentController->mCamRot.x));
    //rotMat = inverse(rotMat);
@@ -1655,6 +3525,7 @@ int MainState::loop()
    {
       fileList.clear();
       resManager.enumerateFiles(fileList, selectedVolumeIdx, &restrictExtList);
+      removeUnreadableFiles();
       oldSelectedVolumeIdx = selectedVolumeIdx;
       
       cFileList.clear();
@@ -1678,8 +3549,13 @@ int MainState::loop()
       
       if (ext == ".dif")
       {
-         //interiorController->loadInterior(cFileList[selectedFileIdx], selectedVolumeIdx);
-         //currentController = interiorController;
+         interiorController->loadInterior(cFileList[selectedFileIdx], selectedVolumeIdx);
+         currentController = interiorController;
+      }
+      else if (ext == ".mis")
+      {
+         missionController->loadMission(cFileList[selectedFileIdx], selectedVolumeIdx);
+         currentController = missionController;
       }
       else if (ext == ".ter")
       {
@@ -1693,49 +3569,27 @@ int MainState::loop()
       }
 
       oldSelectedFileIdx = selectedFileIdx;
+      requestRedraw();
    }
    
    while (SDL_PollEvent(&event))
    {
-      ImGui_ImplSDL3_ProcessEvent(&event);
-      
-      switch (event.type)
-      {
-         case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
-         case SDL_EVENT_WINDOW_RESIZED:
-            GFXHandleResize();
-            break;
-            
-         case SDL_EVENT_KEY_DOWN:
-         case SDL_EVENT_KEY_UP:
-         {
-            slm::vec3 forwardVec = slm::vec3();
-            switch (event.key.key)
-            {
-               case SDLK_A:  deltaMovement.x = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
-               case SDLK_D:  deltaMovement.x = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
-               case SDLK_Q:  deltaMovement.y = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
-               case SDLK_E:  deltaMovement.y = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
-               case SDLK_W:  deltaMovement.z = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
-               case SDLK_S:  deltaMovement.z = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
-               case SDLK_LEFT:  deltaRot.y = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
-               case SDLK_RIGHT: deltaRot.y = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
-               case SDLK_UP:  deltaRot.x = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
-               case SDLK_DOWN: deltaRot.x = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
-            }
-         }
-            break;
-            
-         case SDL_EVENT_QUIT:
-            running = false;
-            break;
-      }
+      handleEvent(event);
    }
    
    if (GFXBeginFrame())
    {
+      GenericViewer::smViewportHeight = (float)h;
+      SharedShape::smRenderFrame++;
+      shapeManager.update();
+      animScheduler.update(dt);
       currentController->update(dt);
       
+      // Viewers have made their texture requests while drawing
+      textureStreamer.update();
+      if (textureStreamer.mStats.deferred > 0)
+         requestRedraw(1);
+      
       ImGui::Begin("Browse");
       ImGui::Columns(2);
       ImGui::ListBox("##bvols", &selectedVolumeIdx, &cVolumeList[0], cVolumeList.size());
@@ -1743,7 +3597,28 @@ int MainState::loop()
       ImGui::ListBox("##bfiles", &selectedFileIdx, &cFileList[0], cFileList.size());
       ImGui::End();
       
+      ImGui::Begin("Render");
+      ImGui::Checkbox("On-demand rendering", &onDemandRender);
+      ImGui::Text("Frames skipped: %llu", (unsigned long long)framesSkipped);
+      ImGui::End();
+      
+      drawMemoryPanel();
+      drawGPUStatsPanel();
+      
+      // Keep going while a widget is being dragged or edited
+      if (ImGui::IsAnyItemActive())
+         requestRedraw(1);
+      
       GFXEndFrame();
+      
+      if (redrawFrames > 0)
+         redrawFrames--;
+      
+      if (benchRun)
+      {
+         finishBenchFrame(frameStartNS);
+         return running ? 0 : 1;
+      }
    }
    else
    {
@@ -1759,6 +3634,330 @@ int MainState::loop()
    return running ? 0 : 1;
 }
 
+bool MainState::parseBenchArgs()
+{
+   for (int i=1; i<in_argc; i++)
+   {
+      const char* arg = in_argv[i];
+      const bool hasValue = i+1 < in_argc;
+      
+      if (strcasecmp(arg, "-bench") == 0 && hasValue)
+      {
+         if (benchRun == NULL)
+            benchRun = new BenchRun();
+         benchRun->mPathFile = in_argv[++i];
+      }
+      else if (strcasecmp(arg, "-benchframes") == 0 && hasValue)
+      {
+         if (benchRun == NULL)
+            benchRun = new BenchRun();
+         benchRun->mNumFrames = std::max(1, atoi(in_argv[++i]));
+      }
+      else if (strcasecmp(arg, "-benchwarmup") == 0 && hasValue)
+      {
+         if (benchRun == NULL)
+            benchRun = new BenchRun();
+         benchRun->mNumWarmupFrames = std::max(0, atoi(in_argv[++i]));
+      }
+      else if (strcasecmp(arg, "-benchdt") == 0 && hasValue)
+      {
+         if (benchRun == NULL)
+            benchRun = new BenchRun();
+         benchRun->mDT = std::max(0.0001f, (float)atof(in_argv[++i]));
+      }
+      else if (strcasecmp(arg, "-benchout") == 0 && hasValue)
+      {
+         if (benchRun == NULL)
+            benchRun = new BenchRun();
+         benchRun->mReportFile = in_argv[++i];
+      }
+   }
+   
+   if (benchRun == NULL)
+      return true;
+   
+   if (benchRun->mPathFile.empty())
+   {
+      fprintf(stderr, "-bench needs a camera path file\n");
+      return false;
+   }
+   
+   if (!benchRun->mPath.load(benchRun->mPathFile.c_str()))
+      return false;
+   
+   // Use the last loaded resource as the name for the report
+   for (int i=1; i<in_argc; i++)
+   {
+      if (in_argv[i][0] == '-')
+      {
+         if (argTakesValue(in_argv[i]))
+            i++;
+         continue;
+      }
+      benchRun->mResourceName = in_argv[i];
+   }
+   
+   benchRun->mRecorder.mGPUTimestamps = GFXHasGPUTimestamps();
+   benchRun->mRecorder.mFallbackAdapter = GFXIsFallbackAdapter();
+   
+   onDemandRender = false;
+   printf("Bench: %u warmup + %u frames, dt=%.4f, path %s (%.2fs)%s%s\n",
+          benchRun->mNumWarmupFrames, benchRun->mNumFrames, benchRun->mDT,
+          benchRun->mPathFile.c_str(), benchRun->mPath.getDuration(),
+          GFXIsHeadless() ? ", headless" : "",
+          GFXHasGPUTimestamps() ? "" : ", GPU times are latency (no timestamp queries)");
+   return true;
+}
+
+void MainState::updateBench(float& dt)
+{
+   // Camera comes entirely from the path with a fixed timestep
+   dt = benchRun->mDT;
+   deltaMovement = slm::vec3(0);
+   deltaRot = slm::vec3(0);
+   benchRun->mPath.evaluate(benchRun->getTime(), currentController->mViewPos, currentController->mCamRot);
+   
+   if (benchRun->mFrameIdx == benchRun->mNumWarmupFrames)
+   {
+      // Peak memory should reflect the run, not loading
+      MemTracker::resetPeaks();
+   }
+}
+
+void MainState::finishBenchFrame(uint64_t frameStartNS)
+{
+   uint64_t frameEndNS = SDL_GetTicksNS();
+   
+   // Wait so each frame's GPU time is measured on its own
+   float gpuMS = GFXWaitForGPU();
+   float cpuMS = (float)((double)(frameEndNS - frameStartNS) / 1000000.0);
+   
+   if (!benchRun->isWarmup())
+   {
+      GFXFrameStats stats;
+      GFXGetFrameStats(stats);
+      benchRun->mRecorder.addFrame(cpuMS, gpuMS, stats);
+   }
+   
+   benchRun->mFrameIdx++;
+   
+   if (benchRun->isFinished())
+   {
+      benchRun->mRecorder.printSummary();
+      
+      if (!benchRun->mReportFile.empty())
+      {
+         benchRun->mRecorder.writeReport(benchRun->mReportFile.c_str(), benchRun->mResourceName.c_str(), benchRun->mDT, GFXIsHeadless());
+      }
+      
+      running = false;
+   }
+}
+
+void MainState::handleEvent(SDL_Event& event)
+{
+   ImGui_ImplSDL3_ProcessEvent(&event);
+   requestRedraw();
+   
+   switch (event.type)
+   {
+      case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+      case SDL_EVENT_WINDOW_RESIZED:
+         GFXHandleResize();
+         break;
+         
+      case SDL_EVENT_KEY_DOWN:
+      case SDL_EVENT_KEY_UP:
+      {
+         switch (event.key.key)
+         {
+            case SDLK_A:  deltaMovement.x = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
+            case SDLK_D:  deltaMovement.x = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
+            case SDLK_Q:  deltaMovement.y = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
+            case SDLK_E:  deltaMovement.y = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
+            case SDLK_W:  deltaMovement.z = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
+            case SDLK_S:  deltaMovement.z = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
+            case SDLK_LEFT:  deltaRot.y = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
+            case SDLK_RIGHT: deltaRot.y = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
+            case SDLK_UP:  deltaRot.x = event.type == SDL_EVENT_KEY_DOWN ? 1 : 0; break;
+            case SDLK_DOWN: deltaRot.x = event.type == SDL_EVENT_KEY_DOWN ? -1 : 0; break;
+         }
+      }
+         break;
+         
+      case SDL_EVENT_QUIT:
+         running = false;
+         break;
+   }
+}
+
+static void formatMemSize(char* buffer, size_t bufferSize, int64_t bytes)
+{
+   if (bytes >= 1024*1024 || bytes <= -1024*1024)
+      snprintf(buffer, bufferSize, "%.2f MB", (double)bytes / (1024.0*1024.0));
+   else if (bytes >= 1024 || bytes <= -1024)
+      snprintf(buffer, bufferSize, "%.2f KB", (double)bytes / 1024.0);
+   else
+      snprintf(buffer, bufferSize, "%lli B", (long long)bytes);
+}
+
+static void memoryPanelRow(const char* name, const MemCategoryStats& stats)
+{
+   char buffer[64];
+   
+   ImGui::TableNextRow();
+   ImGui::TableNextColumn();
+   ImGui::TextUnformatted(name);
+   ImGui::TableNextColumn();
+   formatMemSize(buffer, sizeof(buffer), stats.liveBytes);
+   ImGui::TextUnformatted(buffer);
+   ImGui::TableNextColumn();
+   formatMemSize(buffer, sizeof(buffer), stats.peakBytes);
+   ImGui::TextUnformatted(buffer);
+   ImGui::TableNextColumn();
+   ImGui::Text("%llu", (unsigned long long)(stats.numAllocs - stats.numFrees));
+   ImGui::TableNextColumn();
+   ImGui::Text("%llu", (unsigned long long)stats.numAllocs);
+}
+
+// Drops files with versions the loaders would reject; only their headers are read
+void MainState::removeUnreadableFiles()
+{
+   fileList.erase(std::remove_if(fileList.begin(), fileList.end(), [this](ResManager::EnumEntry& entry) {
+      return !resManager.canRead(entry.filename.c_str(), entry.mountIdx);
+   }), fileList.end());
+}
+
+void MainState::drawMemoryPanel()
+{
+   ImGui::Begin("Memory");
+   
+   if (ImGui::Button("Reset Peaks"))
+      MemTracker::resetPeaks();
+   
+   if (ImGui::BeginTable("##memcats", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+   {
+      ImGui::TableSetupColumn("Category");
+      ImGui::TableSetupColumn("Live");
+      ImGui::TableSetupColumn("Peak");
+      ImGui::TableSetupColumn("Objects");
+      ImGui::TableSetupColumn("Allocs");
+      ImGui::TableHeadersRow();
+      
+      for (uint32_t i=0; i<MemCategory_Count; i++)
+      {
+         MemCategoryStats stats;
+         MemTracker::getStats((MemCategory)i, stats);
+         memoryPanelRow(MemTracker::getCategoryName((MemCategory)i), stats);
+      }
+      
+      MemCategoryStats cpuTotal, gpuTotal;
+      MemTracker::getTotals(cpuTotal, gpuTotal);
+      memoryPanelRow("Total CPU", cpuTotal);
+      memoryPanelRow("Total GPU", gpuTotal);
+      
+      ImGui::EndTable();
+   }
+   
+   ImGui::End();
+}
+
+void MainState::drawGPUStatsPanel()
+{
+   static GFXFrameStats history[240];
+   static float plotValues[240];
+   char buffer[64];
+   
+   // NOTE: these are the stats for the last completed frame
+   uint32_t numFrames = GFXGetFrameStatsHistory(history, 240);
+   if (numFrames == 0)
+      return;
+   
+   const GFXFrameStats& stats = history[numFrames-1];
+   
+   ImGui::Begin("GPU Stats");
+   
+   ImGui::Text("Draw calls: %u (+%u UI)", stats.drawCalls, stats.uiDrawCalls);
+   ImGui::Text("Instances drawn: %u", stats.instancesDrawn);
+   ImGui::Text("Pipeline switches: %u / %u sets", stats.pipelineSwitches, stats.pipelineSets);
+   ImGui::Text("Bind group sets: %u", stats.bindGroupSets);
+   ImGui::Text("Vertex / index binds: %u / %u", stats.vertexBufferBinds, stats.indexBufferBinds);
+   formatMemSize(buffer, sizeof(buffer), stats.bufferWriteBytes);
+   ImGui::Text("Buffer writes: %u (%s)", stats.bufferWrites, buffer);
+   formatMemSize(buffer, sizeof(buffer), stats.textureWriteBytes);
+   ImGui::Text("Texture writes: %u (%s)", stats.textureWrites, buffer);
+   formatMemSize(buffer, sizeof(buffer), stats.transientBytes);
+   ImGui::Text("Transient used: %s (%u new buffers)", buffer, stats.transientBuffersCreated);
+   ImGui::Text("Command buffers: %u", stats.commandBuffersSubmitted);
+   
+   for (uint32_t i=0; i<numFrames; i++)
+      plotValues[i] = (float)history[i].drawCalls;
+   ImGui::PlotLines("Draws", plotValues, numFrames, 0, NULL, 0.0f, FLT_MAX, ImVec2(0, 40));
+   
+   for (uint32_t i=0; i<numFrames; i++)
+      plotValues[i] = (float)history[i].pipelineSwitches;
+   ImGui::PlotLines("Pipelines", plotValues, numFrames, 0, NULL, 0.0f, FLT_MAX, ImVec2(0, 40));
+   
+   for (uint32_t i=0; i<numFrames; i++)
+      plotValues[i] = (float)(history[i].bufferWriteBytes + history[i].textureWriteBytes) / 1024.0f;
+   ImGui::PlotLines("Upload KB", plotValues, numFrames, 0, NULL, 0.0f, FLT_MAX, ImVec2(0, 40));
+   
+   const TextureStreamer::Stats& texStats = textureStreamer.mStats;
+   int budgetMB = (int)(textureStreamer.mBudgetBytes / (1024 * 1024));
+   int uploadKB = (int)(textureStreamer.mUploadBytesPerFrame / 1024);
+   ImGui::Separator();
+   if (ImGui::SliderInt("Texture budget MB", &budgetMB, 1, 2048))
+      textureStreamer.mBudgetBytes = (uint64_t)budgetMB * 1024 * 1024;
+   if (ImGui::SliderInt("Upload KB / frame", &uploadKB, 64, 65536))
+      textureStreamer.mUploadBytesPerFrame = (uint64_t)uploadKB * 1024;
+   formatMemSize(buffer, sizeof(buffer), texStats.residentBytes);
+   ImGui::Text("Streamed textures: %u, %s resident", texStats.numTextures, buffer);
+   formatMemSize(buffer, sizeof(buffer), texStats.wantedBytes);
+   ImGui::Text("Wanted: %s", buffer);
+   ImGui::Text("Uploads: %u, evictions: %u, deferred: %u", texStats.uploads, texStats.evictions, texStats.deferred);
+   ImGui::Text("Reloads: %u started, %u pending, %u failed", texStats.reloads, texStats.reloadsPending, texStats.failedReloads);
+   
+   const TextureCache::Stats& cacheStats = textureCache.mStats;
+   formatMemSize(buffer, sizeof(buffer), cacheStats.savedBytes);
+   ImGui::Text("Shared textures: %u unique, %u refs, %s saved", cacheStats.numTextures, cacheStats.numRefs, buffer);
+   
+   const ShapeResourceManager::Stats& shapeStats = shapeManager.mStats;
+   ImGui::Separator();
+   ImGui::Text("Shapes: %u loaded, %u loads, %u shared, %u meshlets", shapeManager.getNumShapes(), shapeStats.numLoads, shapeStats.numShared, shapeStats.numMeshlets);
+   formatMemSize(buffer, sizeof(buffer), shapeStats.deltaBytes);
+   ImGui::Text("Delta frames: %s (%.1f%% of raw)", buffer, shapeStats.deltaRawBytes ? (100.0f * shapeStats.deltaBytes) / shapeStats.deltaRawBytes : 0.0f);
+   ImGui::Text("Generated LODs: %u (%u cached, %u pending, %.2f ms)", shapeStats.numLODsGenerated, shapeStats.numLODsCached, shapeManager.getNumPendingLODs(), shapeStats.lodMS);
+   formatMemSize(buffer, sizeof(buffer), shapeStats.keyframeBytes);
+   ImGui::Text("Keyframes: %s (%.1f%% of raw)", buffer,
+               shapeStats.keyframeRawBytes ? (100.0f * shapeStats.keyframeBytes) / shapeStats.keyframeRawBytes : 0.0f);
+   if (ImGui::TreeNode("Keyframe errors"))
+   {
+      shapeManager.drawKeyframeReport();
+      ImGui::TreePop();
+   }
+   
+   const Dts3::AnimationScheduler::Stats& animStats = animScheduler.mStats;
+   ImGui::Separator();
+   ImGui::SliderFloat("Animation budget ms", &animScheduler.mBudgetMS, 0.0f, 8.0f);
+   ImGui::SliderFloat("Full rate pixels", &animScheduler.mFullRatePixels, 16.0f, 1024.0f);
+   ImGui::Text("Animated shapes: %u, sampled: %u, deferred: %u", animStats.numInstances, animStats.sampled, animStats.deferred);
+   ImGui::Text("Nodes sampled: %u (%.3f ms)", animStats.nodesSampled, animStats.sampleMS);
+   
+   ImGui::End();
+}
+
+bool MainState::needsRedraw()
+{
+   if (redrawFrames > 0)
+      return true;
+   
+   // Camera is moving
+   if (slm::length(deltaMovement) > 0.0f || slm::length(deltaRot) > 0.0f)
+      return true;
+   
+   return currentController && currentController->isAnimating();
+}
+
 int MainState::testBoot()
 {
    lastTicks = SDL_GetTicks();
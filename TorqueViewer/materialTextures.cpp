@@ -0,0 +1,210 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+
+#include "CommonData.h"
+#include "materialTextures.h"
+#include "textureCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+MaterialTextureLoader::MaterialTextureLoader(UploadFunc upload, DeleteFunc del) :
+mCache(NULL),
+mStreamer(NULL),
+mUpload(upload),
+mDelete(del)
+{
+}
+
+bool MaterialTextureLoader::convertToRGBA8(const Bitmap& bmp, std::vector<uint8_t>& outPixels)
+{
+   uint32_t numPixels = bmp.mWidth * bmp.mHeight;
+   outPixels.resize(numPixels * 4);
+   const uint8_t* src = bmp.mMips[0];
+   uint8_t* dest = &outPixels[0];
+   
+   switch (bmp.mFormat)
+   {
+      case Bitmap::FORMAT_RGBA:
+         memcpy(dest, src, numPixels * 4);
+         break;
+      case Bitmap::FORMAT_RGB:
+         copyRGBToRGBA(dest, src, numPixels);
+         break;
+      case Bitmap::FORMAT_LUMINANCE:
+         for (uint32_t i=0; i<numPixels; i++, src++, dest += 4)
+         {
+            dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 255;
+         }
+         break;
+      default:
+         return false;
+   }
+   
+   return true;
+}
+
+uint32_t MaterialTextureLoader::expandPalettized(const Bitmap& bmp, const Palette* pal, std::vector<uint8_t>& outPixels)
+{
+   if (bmp.mFormat != Bitmap::FORMAT_PAL || pal == NULL || bmp.mMipLevels == 0)
+      return 0;
+   
+   Palette::Data data = pal->mData;
+   outPixels.resize(TextureStreamer::getChainSize(bmp.mWidth, bmp.mHeight, bmp.mMipLevels));
+   uint8_t* dest = &outPixels[0];
+   
+   for (uint32_t i=0; i<bmp.mMipLevels; i++)
+   {
+      uint32_t numPixels = std::max<uint32_t>(bmp.mWidth >> i, 1) * std::max<uint32_t>(bmp.mHeight >> i, 1);
+      const uint8_t* src = bmp.mMips[i];
+      for (uint32_t p=0; p<numPixels; p++, dest += 4)
+      {
+         if (data.type == Palette::FORMAT_RGBA)
+         {
+            data.lookupRGBA(src[p], dest[0], dest[1], dest[2], dest[3]);
+         }
+         else
+         {
+            data.lookupRGB(src[p], dest[0], dest[1], dest[2]);
+            dest[3] = 255;
+         }
+      }
+   }
+   
+   return bmp.mMipLevels;
+}
+
+int32_t MaterialTextureLoader::uploadPalettized(ResManager* resManager, const char* filename, Bitmap& bmp, const Palette* defaultPal, uint64_t hash)
+{
+   const Palette* pal = bmp.mPal ? bmp.mPal : defaultPal;
+   std::vector<uint8_t> pixels;
+   uint32_t numMips = expandPalettized(bmp, pal, pixels);
+   if (numMips == 0)
+      return -1;
+   
+   // Reloads expand the stored mips again on the async reader's workers, with the same palette
+   std::string fname = filename;
+   Palette palCopy = *pal;
+   auto reload = [resManager, fname, palCopy](TextureStreamer::ReloadDoneFunc onDone) {
+      return resManager->openFileAsync(fname.c_str(), AsyncReader::Priority_Interactive, [onDone, palCopy](bool ok, MemRStream& reloadMem) {
+         Bitmap reloadBmp;
+         std::vector<uint8_t> pixels;
+         uint32_t numMips = (ok && reloadBmp.read(reloadMem)) ? expandPalettized(reloadBmp, &palCopy, pixels) : 0;
+         onDone(numMips > 0, pixels, numMips);
+      });
+   };
+   
+   int32_t texID = mStreamer ? mStreamer->addTexture(bmp.mWidth, bmp.mHeight, &pixels[0], reload, numMips) :
+                               mUpload(bmp.mWidth, bmp.mHeight, &pixels[0]);
+   if (texID >= 0 && mCache)
+   {
+      uint64_t bytes = mStreamer ? mStreamer->getResidentBytes(texID) : TextureStreamer::getMipBytes(bmp.mWidth, bmp.mHeight, 0);
+      mCache->insert(hash, texID, bytes);
+   }
+   
+   return texID;
+}
+
+int32_t MaterialTextureLoader::uploadBitmap(Bitmap& bmp, uint64_t fileHash, TextureStreamer::ReloadFunc reload)
+{
+   std::vector<uint8_t> pixels;
+   if (!convertToRGBA8(bmp, pixels))
+      return -1;
+   
+   uint64_t pixelHash = 0;
+   if (mCache)
+   {
+      pixelHash = hashContent64(&pixels[0], pixels.size(), ((uint64_t)bmp.mWidth << 32) | bmp.mHeight);
+      int32_t texID = mCache->acquire(pixelHash);
+      if (texID >= 0)
+      {
+         mCache->addAlias(fileHash, texID);
+         return texID;
+      }
+   }
+   
+   int32_t texID = mStreamer ? mStreamer->addTexture(bmp.mWidth, bmp.mHeight, &pixels[0], reload) :
+                               mUpload(bmp.mWidth, bmp.mHeight, &pixels[0]);
+   if (texID >= 0 && mCache)
+   {
+      // Streamed textures only start with their preview mip on the GPU
+      uint64_t bytes = mStreamer ? mStreamer->getResidentBytes(texID) : TextureStreamer::getMipBytes(bmp.mWidth, bmp.mHeight, 0);
+      mCache->insert(pixelHash, texID, bytes);
+      mCache->addAlias(fileHash, texID);
+   }
+   
+   return texID;
+}
+
+void MaterialTextureLoader::freeTexture(int32_t texID)
+{
+   if (mStreamer && mStreamer->removeTexture(texID))
+      return;
+   mDelete(texID);
+}
+
+void MaterialTextureLoader::release(int32_t texID)
+{
+   if (mCache && mCache->release(texID))
+      return;
+   freeTexture(texID);
+}
+
+int32_t MaterialTextureLoader::load(ResManager* resManager, const char* name)
+{
+   static const char* sExtensions[] = {"", ".png", ".jpg"};
+   
+   for (const char* ext : sExtensions)
+   {
+      std::string fname = std::string(name) + ext;
+      MemRStream mem(0, NULL);
+      if (!resManager->openFile(fname.c_str(), mem))
+         continue;
+      
+      // Identical files (e.g. copies in mod volumes) share a texture without being decoded again
+      uint64_t fileHash = hashContent64(mem.mPtr, mem.mSize);
+      if (mCache)
+      {
+         int32_t texID = mCache->acquire(fileHash);
+         if (texID >= 0)
+            return texID;
+      }
+      
+      Bitmap bmp;
+      if (bmp.readStbi(mem))
+      {
+         // Reloads are read and decoded on the async reader's workers
+         return uploadBitmap(bmp, fileHash, [resManager, fname](TextureStreamer::ReloadDoneFunc onDone) {
+            return resManager->openFileAsync(fname.c_str(), AsyncReader::Priority_Interactive, [onDone](bool ok, MemRStream& reloadMem) {
+               Bitmap reloadBmp;
+               std::vector<uint8_t> pixels;
+               ok = ok && reloadBmp.readStbi(reloadMem) && convertToRGBA8(reloadBmp, pixels);
+               onDone(ok, pixels, 1);
+            });
+         });
+      }
+   }
+   
+   printf("Couldn't find material texture %s\n", name);
+   return -1;
+}
@@ -0,0 +1,85 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+
+#ifndef _MATERIALTEXTURES_H_
+#define _MATERIALTEXTURES_H_
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include "textureStreamer.h"
+
+class Bitmap;
+class Palette;
+class ResManager;
+class TextureCache;
+
+/*
+ Loads material textures by name, going through the texture cache (so copies of
+ the same image share a texture) and the texture streamer when they're set.
+ Without a streamer textures are uploaded at full size through the upload function.
+ */
+class MaterialTextureLoader
+{
+public:
+   
+   // Uploads an RGBA8 image, returning its texID or -1
+   typedef std::function<int32_t(uint32_t width, uint32_t height, const uint8_t* pixels)> UploadFunc;
+   typedef std::function<void(int32_t texID)> DeleteFunc;
+   
+   TextureCache* mCache;
+   TextureStreamer* mStreamer;
+   
+   MaterialTextureLoader(UploadFunc upload, DeleteFunc del);
+   
+   // Loads a texture by material name, which normally won't include the extension
+   int32_t load(ResManager* resManager, const char* name);
+   
+   // Frees a texture from load, or one the caller added to the cache
+   void release(int32_t texID);
+   
+   // Frees a texture without going through the cache
+   void freeTexture(int32_t texID);
+   
+   // Uploads any stbi-decoded bitmap as RGBA8, sharing it if the pixels are already loaded.
+   // fileHash is also registered so later loads of the same file skip decoding.
+   // reload lets the streamer decode the file again rather than keeping every mip in memory.
+   int32_t uploadBitmap(Bitmap& bmp, uint64_t fileHash, TextureStreamer::ReloadFunc reload=TextureStreamer::ReloadFunc());
+   
+   // Uploads a palettized bitmap under hash, streaming from the mips it stores. The
+   // bitmap's own palette is used if it has one, otherwise defaultPal.
+   int32_t uploadPalettized(ResManager* resManager, const char* filename, Bitmap& bmp, const Palette* defaultPal, uint64_t hash);
+   
+   // Expands any stbi-decoded bitmap to RGBA8
+   static bool convertToRGBA8(const Bitmap& bmp, std::vector<uint8_t>& outPixels);
+   
+   // Expands every stored mip of a palettized bitmap to RGBA8, back to back. Returns the number of mips.
+   static uint32_t expandPalettized(const Bitmap& bmp, const Palette* pal, std::vector<uint8_t>& outPixels);
+   
+protected:
+   
+   UploadFunc mUpload;
+   DeleteFunc mDelete;
+};
+
+#endif
@@ -0,0 +1,86 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "memTracker.h"
+
+MemTracker::Counter MemTracker::smCounters[MemCategory_Count];
+
+static const char* sCategoryNames[MemCategory_Count] = {
+   "Volume directory",
+   "Streams",
+   "Shapes",
+   "Integer sets",
+   "Bitmaps",
+   "Transform buffers",
+   "Model data",
+   "Interiors",
+   "GPU transient buffers",
+   "GPU textures",
+   "GPU static buffers"
+};
+
+void MemTracker::getStats(MemCategory cat, MemCategoryStats& outStats)
+{
+   const Counter& c = smCounters[cat];
+   outStats.liveBytes = c.liveBytes.load(std::memory_order_relaxed);
+   outStats.peakBytes = c.peakBytes.load(std::memory_order_relaxed);
+   outStats.numAllocs = c.numAllocs.load(std::memory_order_relaxed);
+   outStats.numFrees = c.numFrees.load(std::memory_order_relaxed);
+}
+
+void MemTracker::getTotals(MemCategoryStats& outCPU, MemCategoryStats& outGPU)
+{
+   outCPU = {};
+   outGPU = {};
+   
+   // NOTE: summed peaks are an upper bound since categories peak at different times
+   for (uint32_t i=0; i<MemCategory_Count; i++)
+   {
+      MemCategoryStats stats;
+      getStats((MemCategory)i, stats);
+      
+      MemCategoryStats& total = isGPUCategory((MemCategory)i) ? outGPU : outCPU;
+      total.liveBytes += stats.liveBytes;
+      total.peakBytes += stats.peakBytes;
+      total.numAllocs += stats.numAllocs;
+      total.numFrees += stats.numFrees;
+   }
+}
+
+const char* MemTracker::getCategoryName(MemCategory cat)
+{
+   return cat < MemCategory_Count ? sCategoryNames[cat] : "NULL";
+}
+
+bool MemTracker::isGPUCategory(MemCategory cat)
+{
+   return cat == MemCategory_GPUTransient || cat == MemCategory_GPUTexture || cat == MemCategory_GPUStatic;
+}
+
+void MemTracker::resetPeaks()
+{
+   for (uint32_t i=0; i<MemCategory_Count; i++)
+   {
+      Counter& c = smCounters[i];
+      c.peakBytes.store(c.liveBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+   }
+}
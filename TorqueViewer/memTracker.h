@@ -0,0 +1,118 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _MEMTRACKER_H_
+#define _MEMTRACKER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+// Categories for tagged allocations. GPU categories are sized from the
+// resource descriptors, so they are estimates of what the driver allocates.
+enum MemCategory : uint32_t
+{
+   MemCategory_VolumeDirectory,  // Volume central directory copies & inflate indices
+   MemCategory_Stream,           // MemRStream buffers (decompressed files)
+   MemCategory_Shape,            // Dts3::Shape arrays
+   MemCategory_IntegerSet,       // Dts3::Sequence IntegerSets
+   MemCategory_Bitmap,           // Bitmap pixels
+   MemCategory_TransformBuffer,  // TransformTexInfo::updateMem
+   MemCategory_ModelData,        // Renderer-side copies of model data
+   MemCategory_Interior,         // Dif::InteriorResource merged render data
+   MemCategory_GPUTransient,     // SDLState::buffers
+   MemCategory_GPUTexture,       // Textures in SDLState::textures
+   MemCategory_GPUStatic,        // Persistent vertex/index buffers (interiors)
+   MemCategory_Count
+};
+
+struct MemCategoryStats
+{
+   int64_t liveBytes;
+   int64_t peakBytes;
+   uint64_t numAllocs;
+   uint64_t numFrees;
+};
+
+// Lock-free per-category counters. Everything uses relaxed atomics so the
+// tracking calls are cheap enough to leave enabled in release builds.
+class MemTracker
+{
+public:
+   
+   static inline void trackAlloc(MemCategory cat, size_t bytes)
+   {
+      Counter& c = smCounters[cat];
+      int64_t live = c.liveBytes.fetch_add((int64_t)bytes, std::memory_order_relaxed) + (int64_t)bytes;
+      c.numAllocs.fetch_add(1, std::memory_order_relaxed);
+      
+      int64_t peak = c.peakBytes.load(std::memory_order_relaxed);
+      while (live > peak && !c.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+      {
+         ;
+      }
+   }
+   
+   static inline void trackFree(MemCategory cat, size_t bytes)
+   {
+      Counter& c = smCounters[cat];
+      c.liveBytes.fetch_sub((int64_t)bytes, std::memory_order_relaxed);
+      c.numFrees.fetch_add(1, std::memory_order_relaxed);
+   }
+   
+   // Replaces a tracked allocation of oldBytes with one of newBytes
+   static inline void trackResize(MemCategory cat, size_t oldBytes, size_t newBytes)
+   {
+      if (oldBytes != 0)
+         trackFree(cat, oldBytes);
+      if (newBytes != 0)
+         trackAlloc(cat, newBytes);
+   }
+   
+   template<typename T> static inline size_t vectorBytes(const std::vector<T>& vec)
+   {
+      return vec.capacity() * sizeof(T);
+   }
+   
+   static void getStats(MemCategory cat, MemCategoryStats& outStats);
+   static void getTotals(MemCategoryStats& outCPU, MemCategoryStats& outGPU);
+   static const char* getCategoryName(MemCategory cat);
+   static bool isGPUCategory(MemCategory cat);
+   
+   // Sets every peak back to the current live value
+   static void resetPeaks();
+   
+private:
+   
+   struct Counter
+   {
+      std::atomic<int64_t> liveBytes;
+      std::atomic<int64_t> peakBytes;
+      std::atomic<uint64_t> numAllocs;
+      std::atomic<uint64_t> numFrees;
+   };
+   
+   static Counter smCounters[MemCategory_Count];
+};
+
+#endif
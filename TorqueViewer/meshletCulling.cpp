@@ -0,0 +1,360 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "meshletCulling.h"
+
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MESHLET_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define MESHLET_NEON
+#endif
+
+// Minimal 4-wide float ops for the bounds tests
+
+#if defined(MESHLET_SSE)
+
+typedef __m128 Float4;
+static inline Float4 f4Load(const float* p) { return _mm_loadu_ps(p); }
+static inline Float4 f4Splat(float f) { return _mm_set1_ps(f); }
+static inline Float4 f4Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+static inline Float4 f4Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+static inline Float4 f4Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+static inline Float4 f4Sqrt(Float4 a) { return _mm_sqrt_ps(a); }
+static inline uint32_t f4NegativeMask(Float4 a) { return (uint32_t)_mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps())); }
+
+#elif defined(MESHLET_NEON)
+
+typedef float32x4_t Float4;
+static inline Float4 f4Load(const float* p) { return vld1q_f32(p); }
+static inline Float4 f4Splat(float f) { return vdupq_n_f32(f); }
+static inline Float4 f4Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+static inline Float4 f4Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+static inline Float4 f4Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+static inline Float4 f4Sqrt(Float4 a) { return vsqrtq_f32(a); }
+static inline uint32_t f4NegativeMask(Float4 a)
+{
+   static const uint32_t bits[4] = {1, 2, 4, 8};
+   uint32x4_t lanes = vandq_u32(vcltq_f32(a, vdupq_n_f32(0.0f)), vld1q_u32(bits));
+   return vaddvq_u32(lanes);
+}
+
+#else
+
+struct Float4 { float v[4]; };
+static inline Float4 f4Load(const float* p) { Float4 r; for (int i=0; i<4; i++) r.v[i] = p[i]; return r; }
+static inline Float4 f4Splat(float f) { Float4 r; for (int i=0; i<4; i++) r.v[i] = f; return r; }
+static inline Float4 f4Add(Float4 a, Float4 b) { for (int i=0; i<4; i++) a.v[i] += b.v[i]; return a; }
+static inline Float4 f4Sub(Float4 a, Float4 b) { for (int i=0; i<4; i++) a.v[i] -= b.v[i]; return a; }
+static inline Float4 f4Mul(Float4 a, Float4 b) { for (int i=0; i<4; i++) a.v[i] *= b.v[i]; return a; }
+static inline Float4 f4Sqrt(Float4 a) { for (int i=0; i<4; i++) a.v[i] = sqrtf(a.v[i]); return a; }
+static inline uint32_t f4NegativeMask(Float4 a)
+{
+   uint32_t mask = 0;
+   for (int i=0; i<4; i++)
+      mask |= a.v[i] < 0.0f ? (1U << i) : 0;
+   return mask;
+}
+
+#endif
+
+// Normal cone only counts if every triangle is within this of the running axis
+static const float kMinConeDot = 0.5f;
+
+MeshletSet::MeshletSet()
+{
+}
+
+uint32_t MeshletSet::build(const slm::vec3* positions, const slm::vec3* normals, uint32_t numVerts,
+                           uint16_t* indices, uint32_t indexStart, uint32_t indexCount, uint32_t group)
+{
+   return buildMeshlets(positions, normals, numVerts, indices, indexStart, indexCount, group);
+}
+
+uint32_t MeshletSet::build(const slm::vec3* positions, const slm::vec3* normals, uint32_t numVerts,
+                           uint32_t* indices, uint32_t indexStart, uint32_t indexCount, uint32_t group)
+{
+   return buildMeshlets(positions, normals, numVerts, indices, indexStart, indexCount, group);
+}
+
+template<typename T> uint32_t MeshletSet::buildMeshlets(const slm::vec3* positions, const slm::vec3* normals, uint32_t numVerts,
+                                                        T* indices, uint32_t indexStart, uint32_t indexCount, uint32_t group)
+{
+   const uint32_t numTris = indexCount / 3;
+   T* tris = indices + indexStart;
+   if (numTris == 0)
+      return 0;
+   
+   for (uint32_t i=0; i<numTris*3; i++)
+   {
+      if (tris[i] >= numVerts)
+         return 0;
+   }
+   
+   // Face normals, facing the same way as the vertex normals
+   std::vector<slm::vec3> faceNormals(numTris);
+   for (uint32_t i=0; i<numTris; i++)
+   {
+      const T* tri = &tris[i*3];
+      slm::vec3 n = slm::cross(positions[tri[1]] - positions[tri[0]], positions[tri[2]] - positions[tri[0]]);
+      float len = slm::length(n);
+      n = len > 1e-12f ? n / len : slm::vec3(0);
+      if (normals && slm::dot(n, normals[tri[0]] + normals[tri[1]] + normals[tri[2]]) < 0.0f)
+         n = -n;
+      faceNormals[i] = n;
+   }
+   
+   // Triangles using each vertex
+   std::vector<uint32_t> vertTriStart(numVerts + 1, 0);
+   std::vector<uint32_t> vertTris(numTris * 3);
+   for (uint32_t i=0; i<numTris*3; i++)
+      vertTriStart[tris[i] + 1]++;
+   for (uint32_t i=0; i<numVerts; i++)
+      vertTriStart[i+1] += vertTriStart[i];
+   {
+      std::vector<uint32_t> fill(vertTriStart.begin(), vertTriStart.end() - 1);
+      for (uint32_t i=0; i<numTris*3; i++)
+         vertTris[fill[tris[i]]++] = i / 3;
+   }
+   
+   std::vector<uint8_t> used(numTris, 0);
+   std::vector<uint32_t> vertMark(numVerts, UINT32_MAX);
+   std::vector<T> outIndices;
+   std::vector<uint32_t> candidates;
+   std::vector<uint32_t> meshletTris;
+   outIndices.reserve(numTris * 3);
+   
+   uint32_t numAdded = 0;
+   uint32_t seed = 0;
+   
+   while (true)
+   {
+      while (seed < numTris && used[seed])
+         seed++;
+      if (seed == numTris)
+         break;
+      
+      const uint32_t meshletId = (uint32_t)mMeshlets.size();
+      uint32_t meshletVerts = 0;
+      slm::vec3 axisSum(0);
+      
+      meshletTris.clear();
+      candidates.clear();
+      candidates.push_back(seed);
+      
+      for (uint32_t head=0; head<candidates.size() && meshletTris.size() < MaxTriangles; head++)
+      {
+         uint32_t tri = candidates[head];
+         if (used[tri])
+            continue;
+         
+         uint32_t newVerts = 0;
+         for (uint32_t j=0; j<3; j++)
+            newVerts += vertMark[tris[(tri*3)+j]] != meshletId ? 1 : 0;
+         if (meshletVerts + newVerts > MaxVertices)
+            continue;
+         
+         // Leave triangles facing elsewhere for another meshlet
+         const slm::vec3& n = faceNormals[tri];
+         float axisLen = slm::length(axisSum);
+         if (axisLen > 1e-6f && slm::dot(n, n) > 0.0f && slm::dot(n, axisSum / axisLen) < kMinConeDot)
+            continue;
+         
+         used[tri] = 1;
+         axisSum += n;
+         meshletTris.push_back(tri);
+         for (uint32_t j=0; j<3; j++)
+         {
+            uint32_t v = tris[(tri*3)+j];
+            if (vertMark[v] != meshletId)
+            {
+               vertMark[v] = meshletId;
+               meshletVerts++;
+            }
+            
+            for (uint32_t k=vertTriStart[v]; k<vertTriStart[v+1]; k++)
+            {
+               if (!used[vertTris[k]])
+                  candidates.push_back(vertTris[k]);
+            }
+         }
+      }
+      
+      Meshlet meshlet;
+      meshlet.indexStart = indexStart + (uint32_t)outIndices.size();
+      meshlet.indexCount = (uint32_t)meshletTris.size() * 3;
+      meshlet.group = group;
+      
+      slm::vec3 minP(FLT_MAX);
+      slm::vec3 maxP(-FLT_MAX);
+      for (uint32_t tri : meshletTris)
+      {
+         for (uint32_t j=0; j<3; j++)
+         {
+            T v = tris[(tri*3)+j];
+            outIndices.push_back(v);
+            minP = slm::min(minP, positions[v]);
+            maxP = slm::max(maxP, positions[v]);
+         }
+      }
+      
+      meshlet.center = (minP + maxP) * 0.5f;
+      meshlet.radius = 0.0f;
+      for (uint32_t tri : meshletTris)
+      {
+         for (uint32_t j=0; j<3; j++)
+            meshlet.radius = std::max(meshlet.radius, slm::length(positions[tris[(tri*3)+j]] - meshlet.center));
+      }
+      
+      // Cone from the widest triangle; sin(angle) makes the eye test a single compare
+      float axisLen = slm::length(axisSum);
+      meshlet.coneAxis = axisLen > 1e-6f ? axisSum / axisLen : slm::vec3(0, 0, 1);
+      float minDot = axisLen > 1e-6f ? 1.0f : -1.0f;
+      for (uint32_t tri : meshletTris)
+      {
+         const slm::vec3& n = faceNormals[tri];
+         if (slm::dot(n, n) > 0.0f)
+            minDot = std::min(minDot, slm::dot(n, meshlet.coneAxis));
+      }
+      meshlet.coneCutoff = minDot > 0.1f ? sqrtf(1.0f - (minDot * minDot)) : 2.0f;
+      
+      mMeshlets.push_back(meshlet);
+      numAdded++;
+   }
+   
+   std::copy(outIndices.begin(), outIndices.end(), tris);
+   return numAdded;
+}
+
+void MeshletSet::finalize()
+{
+   mBlocks.resize((mMeshlets.size() + 3) / 4);
+   for (uint32_t i=0; i<mBlocks.size(); i++)
+   {
+      Block& block = mBlocks[i];
+      for (uint32_t j=0; j<4; j++)
+      {
+         uint32_t idx = (i * 4) + j;
+         if (idx >= mMeshlets.size())
+         {
+            // Padding; never read
+            block.centerX[j] = block.centerY[j] = block.centerZ[j] = block.radius[j] = 0.0f;
+            block.axisX[j] = block.axisY[j] = block.axisZ[j] = 0.0f;
+            block.cutoff[j] = 2.0f;
+            continue;
+         }
+         
+         const Meshlet& meshlet = mMeshlets[idx];
+         block.centerX[j] = meshlet.center.x;
+         block.centerY[j] = meshlet.center.y;
+         block.centerZ[j] = meshlet.center.z;
+         block.radius[j] = meshlet.radius;
+         block.axisX[j] = meshlet.coneAxis.x;
+         block.axisY[j] = meshlet.coneAxis.y;
+         block.axisZ[j] = meshlet.coneAxis.z;
+         block.cutoff[j] = meshlet.coneCutoff;
+      }
+   }
+}
+
+void MeshletSet::clear()
+{
+   mMeshlets.clear();
+   mBlocks.clear();
+}
+
+void MeshletSet::cull(const slm::vec4* planes, uint32_t numPlanes, const slm::vec3& eye,
+                      std::vector<DrawRange>& outRanges, Stats& stats) const
+{
+   const Float4 eyeX = f4Splat(eye.x);
+   const Float4 eyeY = f4Splat(eye.y);
+   const Float4 eyeZ = f4Splat(eye.z);
+   const size_t firstRange = outRanges.size();
+   
+   for (uint32_t i=0; i<mBlocks.size(); i++)
+   {
+      const Block& block = mBlocks[i];
+      Float4 cx = f4Load(block.centerX);
+      Float4 cy = f4Load(block.centerY);
+      Float4 cz = f4Load(block.centerZ);
+      Float4 r = f4Load(block.radius);
+      
+      // Outside if the sphere is entirely behind any plane
+      uint32_t outside = 0;
+      for (uint32_t p=0; p<numPlanes; p++)
+      {
+         Float4 dist = f4Add(f4Add(f4Mul(cx, f4Splat(planes[p].x)), f4Mul(cy, f4Splat(planes[p].y))),
+                             f4Add(f4Mul(cz, f4Splat(planes[p].z)), f4Add(f4Splat(planes[p].w), r)));
+         outside |= f4NegativeMask(dist);
+      }
+      
+      // Backfacing if dot(center - eye, axis) >= cutoff * |center - eye| + radius
+      Float4 dx = f4Sub(cx, eyeX);
+      Float4 dy = f4Sub(cy, eyeY);
+      Float4 dz = f4Sub(cz, eyeZ);
+      Float4 len = f4Sqrt(f4Add(f4Add(f4Mul(dx, dx), f4Mul(dy, dy)), f4Mul(dz, dz)));
+      Float4 facing = f4Add(f4Add(f4Mul(dx, f4Load(block.axisX)), f4Mul(dy, f4Load(block.axisY))), f4Mul(dz, f4Load(block.axisZ)));
+      Float4 margin = f4Sub(f4Add(f4Mul(f4Load(block.cutoff), len), r), facing);
+      uint32_t backfacing = f4NegativeMask(margin);
+      
+      uint32_t numLanes = std::min<uint32_t>(4, (uint32_t)mMeshlets.size() - (i * 4));
+      for (uint32_t j=0; j<numLanes; j++)
+      {
+         const Meshlet& meshlet = mMeshlets[(i * 4) + j];
+         uint32_t numTris = meshlet.indexCount / 3;
+         stats.meshletsTested++;
+         stats.trianglesTested += numTris;
+         
+         if (outside & (1U << j))
+         {
+            stats.frustumRejected++;
+            stats.trianglesRejected += numTris;
+            continue;
+         }
+         if (backfacing & (1U << j))
+         {
+            stats.backfaceRejected++;
+            stats.trianglesRejected += numTris;
+            continue;
+         }
+         
+         if (outRanges.size() > firstRange)
+         {
+            DrawRange& last = outRanges.back();
+            if (last.group == meshlet.group && last.indexStart + last.indexCount == meshlet.indexStart)
+            {
+               last.indexCount += meshlet.indexCount;
+               continue;
+            }
+         }
+         
+         outRanges.push_back({meshlet.group, meshlet.indexStart, meshlet.indexCount});
+      }
+   }
+   
+   stats.drawRanges += (uint32_t)(outRanges.size() - firstRange);
+}
@@ -0,0 +1,128 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _MESHLETCULLING_H_
+#define _MESHLETCULLING_H_
+
+#include <stdint.h>
+#include <vector>
+#include <slm/slmath.h>
+
+/*
+ Splits large meshes into small clusters of triangles (meshlets) so whole
+ clusters can be skipped on the CPU each view.
+ 
+ Meshlets are grown greedily from the first unused triangle through triangles
+ sharing a vertex, preferring ones that face the same way so each meshlet gets a
+ tight normal cone. The triangles of a range are reordered in place so every
+ meshlet ends up as one contiguous run of indices.
+ 
+ Each meshlet stores a bounding sphere and a normal cone. A meshlet is rejected
+ if its sphere is outside the frustum, or if every triangle in it faces away from
+ the eye. Bounds are kept in SoA blocks of four meshlets which are tested at once
+ with SIMD. Surviving meshlets are merged into as few index ranges as possible.
+ 
+ Triangle facing comes from the vertex normals rather than the winding, so the
+ test doesn't depend on the pipeline's front face setting.
+ */
+class MeshletSet
+{
+public:
+   
+   enum
+   {
+      MaxTriangles = 124,
+      MaxVertices = 64
+   };
+   
+   struct Meshlet
+   {
+      slm::vec3 center;
+      float radius;
+      slm::vec3 coneAxis;
+      float coneCutoff;    // sin of the cone half angle; > 1 if the cone can't be used
+      uint32_t indexStart;
+      uint32_t indexCount;
+      uint32_t group;      // caller supplied, e.g. the primitive
+   };
+   
+   struct DrawRange
+   {
+      uint32_t group;
+      uint32_t indexStart;
+      uint32_t indexCount;
+   };
+   
+   struct Stats
+   {
+      uint32_t meshletsTested;
+      uint32_t frustumRejected;
+      uint32_t backfaceRejected;
+      uint32_t trianglesTested;
+      uint32_t trianglesRejected;
+      uint32_t drawRanges;
+   };
+   
+   std::vector<Meshlet> mMeshlets;
+   
+   MeshletSet();
+   
+   // Builds meshlets for the triangle list in indices[indexStart..indexStart+indexCount),
+   // reordering its triangles. Returns the number of meshlets added.
+   uint32_t build(const slm::vec3* positions, const slm::vec3* normals, uint32_t numVerts,
+                  uint16_t* indices, uint32_t indexStart, uint32_t indexCount, uint32_t group);
+   uint32_t build(const slm::vec3* positions, const slm::vec3* normals, uint32_t numVerts,
+                  uint32_t* indices, uint32_t indexStart, uint32_t indexCount, uint32_t group);
+   
+   // Needs to be called after the last build
+   void finalize();
+   void clear();
+   
+   // Appends the visible index ranges to outRanges (which is not cleared) and adds to stats.
+   // Planes & eye are in mesh space, planes in the same form as InteriorCuller::Frustum.
+   void cull(const slm::vec4* planes, uint32_t numPlanes, const slm::vec3& eye,
+             std::vector<DrawRange>& outRanges, Stats& stats) const;
+   
+   inline size_t getMemoryUsage() const { return (mMeshlets.capacity() * sizeof(Meshlet)) + (mBlocks.capacity() * sizeof(Block)); }
+   
+protected:
+   
+   // Bounds of 4 meshlets in SoA form
+   struct Block
+   {
+      float centerX[4];
+      float centerY[4];
+      float centerZ[4];
+      float radius[4];
+      float axisX[4];
+      float axisY[4];
+      float axisZ[4];
+      float cutoff[4];
+   };
+   
+   std::vector<Block> mBlocks;
+   
+   template<typename T> uint32_t buildMeshlets(const slm::vec3* positions, const slm::vec3* normals, uint32_t numVerts,
+                                               T* indices, uint32_t indexStart, uint32_t indexCount, uint32_t group);
+};
+
+#endif
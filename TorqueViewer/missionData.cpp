@@ -0,0 +1,749 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "CommonData.h"
+#include "missionData.h"
+#include "missionSnapshot.h"
+
+#include <chrono>
+#include <unordered_map>
+#include <strings.h>
+
+namespace Mission
+{
+
+// Tokenizer
+
+enum TokenType
+{
+   Token_End,
+   Token_Ident,
+   Token_Number,
+   Token_String,
+   Token_Punct
+};
+
+struct Token
+{
+   TokenType type;
+   std::string_view text; // strings exclude quotes and still contain escapes
+};
+
+class ScriptLexer
+{
+public:
+   const char* mPtr;
+   const char* mEnd;
+   uint32_t mLine;
+   
+   ScriptLexer(const char* text, size_t size) : mPtr(text), mEnd(text + size), mLine(1) {;}
+   
+   void skipWhitespace()
+   {
+      while (mPtr < mEnd)
+      {
+         char c = *mPtr;
+         if (c == '\n')
+         {
+            mLine++;
+            mPtr++;
+         }
+         else if (c == ' ' || c == '\t' || c == '\r')
+         {
+            mPtr++;
+         }
+         else if (c == '/' && mPtr+1 < mEnd && mPtr[1] == '/')
+         {
+            while (mPtr < mEnd && *mPtr != '\n')
+               mPtr++;
+         }
+         else if (c == '/' && mPtr+1 < mEnd && mPtr[1] == '*')
+         {
+            mPtr += 2;
+            while (mPtr+1 < mEnd && !(mPtr[0] == '*' && mPtr[1] == '/'))
+            {
+               if (*mPtr == '\n')
+                  mLine++;
+               mPtr++;
+            }
+            mPtr = std::min(mPtr + 2, mEnd);
+         }
+         else
+         {
+            break;
+         }
+      }
+   }
+   
+   Token next()
+   {
+      skipWhitespace();
+      
+      Token tok;
+      if (mPtr >= mEnd)
+      {
+         tok.type = Token_End;
+         return tok;
+      }
+      
+      const char* start = mPtr;
+      char c = *mPtr;
+      
+      if (isalpha((unsigned char)c) || c == '_' || c == '$' || c == '%')
+      {
+         mPtr++;
+         while (mPtr < mEnd && (isalnum((unsigned char)*mPtr) || *mPtr == '_' || *mPtr == ':'))
+            mPtr++;
+         tok.type = Token_Ident;
+         tok.text = std::string_view(start, mPtr - start);
+      }
+      else if (isdigit((unsigned char)c) || (c == '.' && mPtr+1 < mEnd && isdigit((unsigned char)mPtr[1])))
+      {
+         mPtr++;
+         while (mPtr < mEnd && (isalnum((unsigned char)*mPtr) || *mPtr == '.'))
+            mPtr++;
+         tok.type = Token_Number;
+         tok.text = std::string_view(start, mPtr - start);
+      }
+      else if (c == '"' || c == '\'')
+      {
+         mPtr++;
+         while (mPtr < mEnd && *mPtr != c)
+         {
+            if (*mPtr == '\\' && mPtr+1 < mEnd)
+               mPtr++;
+            else if (*mPtr == '\n')
+               mLine++;
+            mPtr++;
+         }
+         tok.type = Token_String;
+         tok.text = std::string_view(start + 1, mPtr - (start + 1));
+         if (mPtr < mEnd)
+            mPtr++;
+      }
+      else
+      {
+         mPtr++;
+         tok.type = Token_Punct;
+         tok.text = std::string_view(start, 1);
+      }
+      
+      return tok;
+   }
+   
+   Token peek()
+   {
+      const char* oldPtr = mPtr;
+      uint32_t oldLine = mLine;
+      Token tok = next();
+      mPtr = oldPtr;
+      mLine = oldLine;
+      return tok;
+   }
+   
+   static inline bool isPunct(const Token& tok, char c)
+   {
+      return tok.type == Token_Punct && tok.text[0] == c;
+   }
+   
+   // Skips to just past the next ';' at the current brace depth
+   void skipStatement()
+   {
+      int depth = 0;
+      for (Token tok = next(); tok.type != Token_End; tok = next())
+      {
+         if (isPunct(tok, '{'))
+            depth++;
+         else if (isPunct(tok, '}'))
+         {
+            if (--depth < 0)
+            {
+               mPtr--; // leave for the caller
+               return;
+            }
+         }
+         else if (isPunct(tok, ';') && depth == 0)
+            return;
+      }
+   }
+};
+
+static std::string unescapeString(std::string_view text)
+{
+   std::string out;
+   out.reserve(text.size());
+   
+   for (size_t i=0; i<text.size(); i++)
+   {
+      char c = text[i];
+      if (c != '\\' || i+1 >= text.size())
+      {
+         out.push_back(c);
+         continue;
+      }
+      
+      c = text[++i];
+      switch (c)
+      {
+         case 'n': out.push_back('\n'); break;
+         case 't': out.push_back('\t'); break;
+         case 'r': out.push_back('\r'); break;
+         case 'c':
+            // Color codes; \c0..\c9 map to 0x2..0xB skipping \n
+            if (i+1 < text.size() && isdigit((unsigned char)text[i+1]))
+            {
+               static const char sColorCodes[10] = {0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0x8, 0xB, 0xC, 0xE};
+               out.push_back(sColorCodes[text[++i] - '0']);
+            }
+            break;
+         case 'x':
+            if (i+2 < text.size())
+            {
+               char hex[3] = {text[i+1], text[i+2], 0};
+               out.push_back((char)strtol(hex, NULL, 16));
+               i += 2;
+            }
+            break;
+         default:
+            out.push_back(c);
+            break;
+      }
+   }
+   
+   return out;
+}
+
+static inline std::string toLower(std::string_view text)
+{
+   std::string out(text);
+   std::transform(out.begin(), out.end(), out.begin(), ::tolower);
+   return out;
+}
+
+// SimObject
+
+const char* SimObject::getField(const char* name, const char* defaultValue) const
+{
+   for (const auto& field : mFields)
+   {
+      if (strcasecmp(field.first.c_str(), name) == 0)
+         return field.second.c_str();
+   }
+   return defaultValue;
+}
+
+void SimObject::setField(std::string_view name, std::string_view value)
+{
+   std::string lowerName = toLower(name);
+   for (auto& field : mFields)
+   {
+      if (field.first == lowerName)
+      {
+         field.second = value;
+         return;
+      }
+   }
+   mFields.emplace_back(lowerName, std::string(value));
+}
+
+SimGroup::~SimGroup()
+{
+   for (SimObject* obj : mObjects)
+      delete obj;
+}
+
+void SimGroup::addObject(SimObject* obj)
+{
+   obj->mParent = this;
+   mObjects.push_back(obj);
+}
+
+// Reads up to count space separated floats, returning how many were read
+static uint32_t parseFloats(const char* str, float* out, uint32_t count)
+{
+   uint32_t numRead = 0;
+   for (; numRead<count; numRead++)
+   {
+      char* end = NULL;
+      out[numRead] = strtof(str, &end);
+      if (end == str)
+         break;
+      str = end;
+   }
+   return numRead;
+}
+
+SceneObject::SceneObject() : mPosition(0), mRotation(0, 0, 0, 1), mScale(1)
+{
+}
+
+void SceneObject::onFieldsSet()
+{
+   const char* position = getField("position");
+   const char* rotation = getField("rotation");
+   const char* scale = getField("scale");
+   
+   float values[4];
+   if (position && parseFloats(position, values, 3) == 3)
+      mPosition = slm::vec3(values[0], values[1], values[2]);
+   
+   if (rotation && parseFloats(rotation, values, 4) == 4)
+   {
+      // Axis + angle in degrees
+      slm::vec3 axis(values[0], values[1], values[2]);
+      if (slm::length(axis) > 0.0f)
+         mRotation = slm::quat(slm::radians(values[3]), slm::normalize(axis));
+   }
+   
+   if (scale && parseFloats(scale, values, 3) == 3)
+      mScale = slm::vec3(values[0], values[1], values[2]);
+}
+
+slm::mat4 SceneObject::getTransform() const
+{
+   return slm::translation(mPosition) * slm::mat4(mRotation) * slm::scaling(mScale);
+}
+
+void TerrainBlock::onFieldsSet()
+{
+   SceneObject::onFieldsSet();
+   mTerrainFile = getField("terrainFile", "");
+   mSquareSize = (float)atof(getField("squareSize", "8"));
+}
+
+bool TerrainBlock::getResourceRequest(std::string& outFilename, const char*& outSearchDir) const
+{
+   outFilename = mTerrainFile;
+   outSearchDir = "terrains";
+   return !mTerrainFile.empty();
+}
+
+void InteriorInstance::onFieldsSet()
+{
+   SceneObject::onFieldsSet();
+   mInteriorFile = getField("interiorFile", "");
+}
+
+bool InteriorInstance::getResourceRequest(std::string& outFilename, const char*& outSearchDir) const
+{
+   outFilename = mInteriorFile;
+   outSearchDir = "interiors";
+   return !mInteriorFile.empty();
+}
+
+void TSStatic::onFieldsSet()
+{
+   SceneObject::onFieldsSet();
+   mShapeName = getField("shapeName", "");
+}
+
+bool TSStatic::getResourceRequest(std::string& outFilename, const char*& outSearchDir) const
+{
+   outFilename = mShapeName;
+   outSearchDir = "shapes";
+   return !mShapeName.empty();
+}
+
+// MissionFile
+
+MissionFile::MissionFile() : mSourceHash(0), mSourceSize(0)
+{
+   mStats = {};
+}
+
+MissionFile::~MissionFile()
+{
+   clear();
+}
+
+void MissionFile::clear()
+{
+   for (SimObject* obj : mRootObjects)
+      delete obj;
+   for (LoadedResource* res : mResources)
+      delete res;
+   mRootObjects.clear();
+   mResources.clear();
+   mSourceHash = 0;
+   mSourceSize = 0;
+   mStats = {};
+}
+
+bool MissionFile::read(MemRStream& s)
+{
+   return parse((const char*)s.mPtr + s.mPos, s.mSize - s.mPos);
+}
+
+static SimObject* parseObject(ScriptLexer& lexer, uint32_t& numObjects, uint32_t& numUnknown)
+{
+   // new Class(Name) [: CopySource] { fields; objects; };
+   Token classTok = lexer.next();
+   if (classTok.type != Token_Ident || !ScriptLexer::isPunct(lexer.next(), '('))
+   {
+      printf("MissionFile: expected object declaration on line %u\n", lexer.mLine);
+      return NULL;
+   }
+   
+   std::string name;
+   Token tok = lexer.next();
+   if (tok.type == Token_Ident || tok.type == Token_String || tok.type == Token_Number)
+   {
+      name = tok.text;
+      tok = lexer.next();
+   }
+   
+   // Skip constructor args
+   while (tok.type != Token_End && !ScriptLexer::isPunct(tok, ')'))
+      tok = lexer.next();
+   
+   tok = lexer.next();
+   if (ScriptLexer::isPunct(tok, ':'))
+   {
+      lexer.next();
+      tok = lexer.next();
+   }
+   
+   std::string className(classTok.text);
+   SimObject* obj = dynamic_cast<SimObject*>(ConsolePersistObject::createClassByName(className));
+   if (obj == NULL)
+   {
+      obj = new SimObject();
+      numUnknown++;
+   }
+   
+   obj->mClassName = className;
+   obj->mName = name;
+   numObjects++;
+   
+   if (ScriptLexer::isPunct(tok, '{'))
+   {
+      for (tok = lexer.next(); tok.type != Token_End && !ScriptLexer::isPunct(tok, '}'); tok = lexer.next())
+      {
+         if (tok.type == Token_Ident && strncasecmp(tok.text.data(), "new", 3) == 0 && tok.text.size() == 3)
+         {
+            SimObject* child = parseObject(lexer, numObjects, numUnknown);
+            if (child == NULL)
+               continue;
+            
+            if (obj->isGroup())
+            {
+               ((SimGroup*)obj)->addObject(child);
+            }
+            else
+            {
+               printf("MissionFile: %s isn't a group; ignoring child %s\n", className.c_str(), child->mClassName.c_str());
+               delete child;
+            }
+            continue;
+         }
+         
+         if (tok.type != Token_Ident)
+         {
+            lexer.skipStatement();
+            continue;
+         }
+         
+         // field[index] = value;
+         std::string fieldName(tok.text);
+         Token op = lexer.next();
+         if (ScriptLexer::isPunct(op, '['))
+         {
+            // Array fields are stored with the index appended
+            for (Token idx = lexer.next(); idx.type != Token_End && !ScriptLexer::isPunct(idx, ']'); idx = lexer.next())
+               fieldName += idx.text;
+            op = lexer.next();
+         }
+         
+         if (!ScriptLexer::isPunct(op, '='))
+         {
+            lexer.skipStatement();
+            continue;
+         }
+         
+         Token value = lexer.next();
+         if (value.type == Token_String)
+         {
+            obj->setField(fieldName, unescapeString(value.text));
+         }
+         else if (ScriptLexer::isPunct(value, '-'))
+         {
+            Token number = lexer.next();
+            obj->setField(fieldName, std::string("-") + std::string(number.text));
+         }
+         else
+         {
+            obj->setField(fieldName, value.text);
+         }
+         
+         // Ignore anything else in the expression
+         lexer.skipStatement();
+      }
+      
+      tok = lexer.next();
+   }
+   
+   if (!ScriptLexer::isPunct(tok, ';'))
+      printf("MissionFile: missing ';' after %s on line %u\n", className.c_str(), lexer.mLine);
+   
+   obj->onFieldsSet();
+   return obj;
+}
+
+bool MissionFile::parse(const char* text, size_t size)
+{
+   clear();
+   
+   auto startTime = std::chrono::steady_clock::now();
+   mSourceHash = hashBytes64(text, size);
+   mSourceSize = size;
+   ScriptLexer lexer(text, size);
+   int depth = 0;
+   
+   // Only object declarations at the top level are interesting
+   for (Token tok = lexer.next(); tok.type != Token_End; tok = lexer.next())
+   {
+      if (ScriptLexer::isPunct(tok, '{'))
+         depth++;
+      else if (ScriptLexer::isPunct(tok, '}'))
+         depth = std::max(depth - 1, 0);
+      else if (depth == 0 && tok.type == Token_Ident && tok.text.size() == 3 && strncasecmp(tok.text.data(), "new", 3) == 0)
+      {
+         SimObject* obj = parseObject(lexer, mStats.numObjects, mStats.numUnknownObjects);
+         if (obj)
+            mRootObjects.push_back(obj);
+      }
+   }
+   
+   mStats.parseMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+   return !mRootObjects.empty();
+}
+
+bool MissionFile::restore(const MissionSnapshot& snapshot)
+{
+   clear();
+   if (!snapshot.isOpen())
+      return false;
+   
+   auto startTime = std::chrono::steady_clock::now();
+   const MissionSnapshot::Header& header = *snapshot.mHeader;
+   
+   // NOTE: open() has already checked all the indices are in range
+   std::vector<SimObject*> objects(header.numObjects);
+   for (uint32_t i=0; i<header.numObjects; i++)
+   {
+      const MissionSnapshot::ObjectRecord& rec = snapshot.mObjects[i];
+      const char* className = snapshot.getString(rec.className);
+      
+      SimObject* obj = dynamic_cast<SimObject*>(ConsolePersistObject::createClassByName(className));
+      if (obj == NULL)
+      {
+         obj = new SimObject();
+         mStats.numUnknownObjects++;
+      }
+      
+      obj->mClassName = className;
+      obj->mName = snapshot.getString(rec.name);
+      obj->mFields.reserve(rec.fieldCount);
+      for (uint32_t j=0; j<rec.fieldCount; j++)
+      {
+         const MissionSnapshot::FieldRecord& field = snapshot.mFields[rec.fieldStart + j];
+         obj->mFields.emplace_back(snapshot.getString(field.name), snapshot.getString(field.value));
+      }
+      obj->onFieldsSet();
+      objects[i] = obj;
+      
+      if (rec.parent == MissionSnapshot::InvalidIndex)
+      {
+         mRootObjects.push_back(obj);
+      }
+      else if (objects[rec.parent]->isGroup())
+      {
+         ((SimGroup*)objects[rec.parent])->addObject(obj);
+      }
+      else
+      {
+         // Class registrations must have changed
+         delete obj;
+         clear();
+         return false;
+      }
+   }
+   
+   for (uint32_t i=0; i<header.numResources; i++)
+   {
+      const MissionSnapshot::ResourceRecord& rec = snapshot.mResources[i];
+      LoadedResource* res = new LoadedResource();
+      res->filename = snapshot.getString(rec.filename);
+      res->resolvedName = snapshot.getString(rec.resolvedName);
+      mResources.push_back(res);
+   }
+   
+   mSourceHash = header.missionHash;
+   mSourceSize = header.missionSize;
+   mStats.numObjects = header.numObjects;
+   mStats.parseMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+   return true;
+}
+
+// Queues the first candidate from firstCandidate on which exists. If reading or
+// parsing it fails on the reader's worker, the next candidate is queued from there.
+static void loadResourceCandidate(ResManager& mgr, LoadedResource& res, std::shared_ptr<std::vector<std::string>> candidates, uint32_t firstCandidate)
+{
+   // Files with no create func are only kept as raw data, so they can wait
+   // behind the interiors and shapes which are going to be shown
+   AsyncReader::Priority priority = ResManager::hasCreateFunc(res.filename.c_str()) ? AsyncReader::Priority_Interactive : AsyncReader::Priority_Prefetch;
+   
+   for (uint32_t i=firstCandidate; i<candidates->size(); i++)
+   {
+      std::string name = (*candidates)[i];
+      LoadedResource* resPtr = &res;
+      ResManager* mgrPtr = &mgr;
+      bool queued = mgr.openFileAsync(name.c_str(), priority, [mgrPtr, resPtr, candidates, i, name](bool ok, MemRStream& stream){
+         ResourceInstance* instance = NULL;
+         if (ok)
+         {
+            instance = ResManager::createResourceFromStream(name.c_str(), stream);
+            ok = instance != NULL || !ResManager::hasCreateFunc(name.c_str());
+         }
+         
+         if (!ok)
+         {
+            printf("MissionFile: couldn't load %s\n", name.c_str());
+            loadResourceCandidate(*mgrPtr, *resPtr, candidates, i+1);
+            return;
+         }
+         
+         resPtr->found = true;
+         resPtr->resolvedName = name;
+         resPtr->size = stream.mSize;
+         resPtr->hash = hashBytes64(stream.mPtr, stream.mSize);
+         resPtr->instance = instance;
+         if (instance == NULL)
+            resPtr->data = stream;
+      });
+      
+      if (queued)
+         return;
+   }
+}
+
+static void loadResource(ResManager& mgr, LoadedResource& res)
+{
+   // Missions typically only name the file, so try the usual folder too
+   std::shared_ptr<std::vector<std::string>> candidates = std::make_shared<std::vector<std::string>>();
+   if (!res.resolvedName.empty())
+      candidates->push_back(res.resolvedName);
+   candidates->push_back(res.filename);
+   if (res.searchDir && res.filename.find('/') == std::string::npos)
+      candidates->push_back(std::string(res.searchDir) + "/" + res.filename);
+   
+   loadResourceCandidate(mgr, res, candidates, 0);
+}
+
+void MissionFile::loadResources(ResManager& mgr)
+{
+   auto startTime = std::chrono::steady_clock::now();
+   
+   // Gather unique files; the same interior or shape is usually placed many times
+   std::unordered_map<std::string, LoadedResource*> resourceLookup;
+   std::vector<std::pair<SimObject*, LoadedResource*> > objectResources;
+   for (LoadedResource* res : mResources)
+      resourceLookup[toLower(res->filename)] = res;
+   
+   forEachObject([&](SimObject* obj){
+      std::string filename;
+      const char* searchDir = NULL;
+      if (!obj->getResourceRequest(filename, searchDir))
+         return;
+      
+      std::string key = toLower(filename);
+      auto itr = resourceLookup.find(key);
+      LoadedResource* res = NULL;
+      if (itr == resourceLookup.end())
+      {
+         res = new LoadedResource();
+         res->filename = filename;
+         res->searchDir = searchDir;
+         mResources.push_back(res);
+         resourceLookup[key] = res;
+      }
+      else
+      {
+         res = itr->second;
+         if (res->searchDir == NULL)
+            res->searchDir = searchDir;
+      }
+      objectResources.emplace_back(obj, res);
+   });
+   
+   // Reads overlap with parsing the files which have already arrived
+   for (LoadedResource* res : mResources)
+   {
+      if (!res->found)
+         loadResource(mgr, *res);
+   }
+   mgr.waitAsync();
+   
+   mStats.numResources = (uint32_t)mResources.size();
+   mStats.numResourcesMissing = 0;
+   mStats.bytesLoaded = 0;
+   mStats.numThreads = mgr.getAsyncReader()->getNumWorkers();
+   for (LoadedResource* res : mResources)
+   {
+      if (!res->found)
+      {
+         printf("MissionFile: couldn't find %s\n", res->filename.c_str());
+         mStats.numResourcesMissing++;
+      }
+      mStats.bytesLoaded += res->size;
+   }
+   
+   for (auto& pair : objectResources)
+      pair.first->setResource(pair.second);
+   
+   mStats.loadMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void registerClasses()
+{
+   ConsolePersistObject::registerClass("SimGroup", ConsolePersistObject::_createClass<SimGroup>);
+   ConsolePersistObject::registerClass("Path", ConsolePersistObject::_createClass<SimGroup>);
+   ConsolePersistObject::registerClass("TerrainBlock", ConsolePersistObject::_createClass<TerrainBlock>);
+   ConsolePersistObject::registerClass("InteriorInstance", ConsolePersistObject::_createClass<InteriorInstance>);
+   ConsolePersistObject::registerClass("TSStatic", ConsolePersistObject::_createClass<TSStatic>);
+   
+   // Objects we only need the transform of
+   static const char* sSceneClasses[] = {
+      "StaticShape", "Item", "Turret", "Marker", "WayPoint", "SpawnSphere",
+      "WaterBlock", "Sky", "Sun", "MissionArea", "Trigger", "PhysicalZone",
+      "AudioEmitter", "Camera", "ForceFieldBare", "Precipitation", "Lightning",
+      "FireballAtmosphere", "ParticleEmissionDummy"
+   };
+   
+   for (const char* className : sSceneClasses)
+   {
+      if (ConsolePersistObject::smNamedCreateFuncs.find(className) == ConsolePersistObject::smNamedCreateFuncs.end())
+         ConsolePersistObject::registerClass(className, ConsolePersistObject::_createClass<SceneObject>);
+   }
+}
+
+}
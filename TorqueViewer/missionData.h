@@ -0,0 +1,227 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _MISSIONDATA_H_
+#define _MISSIONDATA_H_
+
+#include "CommonData.h"
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+ Missions (.mis) are TorqueScript files. All we care about is the object tree, e.g.
+ 
+    new SimGroup(MissionGroup) {
+       musicTrack = "lush";
+       new InteriorInstance() {
+          position = "-100 20 150.5";
+          rotation = "0 0 1 45";
+          interiorFile = "bbunk2.dif";
+       };
+    };
+ 
+ Anything else at the top level (functions, quote blocks, etc) is skipped.
+ Objects are created through ConsolePersistObject::createClassByName so anything
+ registered there will be used; unknown classes become plain SimObjects which
+ keep their fields.
+ 
+ Once parsed, the files referenced by objects are resolved and loaded on a
+ set of worker threads through ResManager.
+ */
+namespace Mission
+{
+
+class MissionSnapshot;
+
+struct LoadedResource
+{
+   std::string filename;     // as referenced by the mission
+   std::string resolvedName; // path it was actually found at
+   const char* searchDir;    // default folder for this kind of file
+   ResourceInstance* instance; // NULL if there's no create func for this type or it failed
+   MemRStream data;          // raw file, kept when there's no create func
+   uint64_t size;
+   uint64_t hash;            // of the file contents
+   bool found;
+   
+   LoadedResource() : searchDir(NULL), instance(NULL), size(0), hash(0), found(false) {;}
+   ~LoadedResource() { delete instance; }
+};
+
+class SimObject : public ConsolePersistObject
+{
+public:
+   typedef std::vector<std::pair<std::string, std::string> > FieldList;
+   
+   std::string mClassName;
+   std::string mName;
+   SimObject* mParent;
+   FieldList mFields; // names are lowercase since script fields are case insensitive
+   
+   SimObject() : mParent(NULL) {;}
+   virtual ~SimObject() {;}
+   
+   const char* getField(const char* name, const char* defaultValue=NULL) const;
+   void setField(std::string_view name, std::string_view value);
+   
+   // Called once all fields in the declaration have been set
+   virtual void onFieldsSet() {;}
+   
+   // Gets the file this object depends on, if any
+   virtual bool getResourceRequest(std::string& /*outFilename*/, const char*& /*outSearchDir*/) const { return false; }
+   virtual void setResource(LoadedResource* /*res*/) {;}
+   
+   virtual bool isGroup() const { return false; }
+};
+
+class SimGroup : public SimObject
+{
+public:
+   std::vector<SimObject*> mObjects;
+   
+   ~SimGroup();
+   
+   void addObject(SimObject* obj);
+   bool isGroup() const { return true; }
+};
+
+class SceneObject : public SimObject
+{
+public:
+   slm::vec3 mPosition;
+   slm::quat mRotation;
+   slm::vec3 mScale;
+   
+   SceneObject();
+   
+   void onFieldsSet();
+   slm::mat4 getTransform() const;
+};
+
+class TerrainBlock : public SceneObject
+{
+public:
+   std::string mTerrainFile;
+   float mSquareSize;
+   LoadedResource* mResource;
+   
+   TerrainBlock() : mSquareSize(8.0f), mResource(NULL) {;}
+   
+   void onFieldsSet();
+   bool getResourceRequest(std::string& outFilename, const char*& outSearchDir) const;
+   void setResource(LoadedResource* res) { mResource = res; }
+};
+
+class InteriorInstance : public SceneObject
+{
+public:
+   std::string mInteriorFile;
+   LoadedResource* mResource;
+   
+   InteriorInstance() : mResource(NULL) {;}
+   
+   void onFieldsSet();
+   bool getResourceRequest(std::string& outFilename, const char*& outSearchDir) const;
+   void setResource(LoadedResource* res) { mResource = res; }
+};
+
+class TSStatic : public SceneObject
+{
+public:
+   std::string mShapeName;
+   LoadedResource* mResource;
+   
+   TSStatic() : mResource(NULL) {;}
+   
+   void onFieldsSet();
+   bool getResourceRequest(std::string& outFilename, const char*& outSearchDir) const;
+   void setResource(LoadedResource* res) { mResource = res; }
+};
+
+class MissionFile : public ResourceInstance
+{
+public:
+   
+   struct Stats
+   {
+      uint32_t numObjects;
+      uint32_t numUnknownObjects;
+      uint32_t numResources;
+      uint32_t numResourcesMissing;
+      uint32_t numThreads;
+      uint64_t bytesLoaded;
+      float parseMS;
+      float loadMS;
+   };
+   
+   std::vector<SimObject*> mRootObjects;
+   std::vector<LoadedResource*> mResources;
+   uint64_t mSourceHash; // of the script text
+   uint64_t mSourceSize;
+   Stats mStats;
+   
+   MissionFile();
+   ~MissionFile();
+   
+   bool read(MemRStream& s);
+   
+   // Parses script text; can be called directly for missions which aren't on disk
+   bool parse(const char* text, size_t size);
+   
+   // Recreates the objects & resource list from a snapshot instead of parsing
+   bool restore(const MissionSnapshot& snapshot);
+   
+   // Resolves & loads referenced resources through the manager's async reader.
+   // Resources which already have a resolvedName (i.e. restored) are opened directly.
+   void loadResources(ResManager& mgr);
+   
+   // Visits every object in the tree, parents first
+   template<typename F> void forEachObject(F func) const
+   {
+      for (SimObject* obj : mRootObjects)
+         visitObject(obj, func);
+   }
+   
+   void clear();
+   
+protected:
+   
+   template<typename F> static void visitObject(SimObject* obj, F& func)
+   {
+      func(obj);
+      if (obj->isGroup())
+      {
+         for (SimObject* child : ((SimGroup*)obj)->mObjects)
+            visitObject(child, func);
+      }
+   }
+};
+
+// Registers the mission object classes with ConsolePersistObject
+void registerClasses();
+
+}
+
+#endif
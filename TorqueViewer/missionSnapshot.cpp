@@ -0,0 +1,344 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "missionSnapshot.h"
+#include "missionData.h"
+#include "sceneContainer.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#include <vector>
+
+namespace Mission
+{
+
+MissionSnapshot::MissionSnapshot() :
+mHeader(NULL),
+mStringOffsets(NULL),
+mStringData(NULL),
+mObjects(NULL),
+mFields(NULL),
+mResources(NULL),
+mInstances(NULL)
+{
+}
+
+void MissionSnapshot::close()
+{
+   mFile.close();
+   mHeader = NULL;
+   mStringOffsets = NULL;
+   mStringData = NULL;
+   mObjects = NULL;
+   mFields = NULL;
+   mResources = NULL;
+   mInstances = NULL;
+}
+
+template<class T> static const T* getSection(const MappedFile& file, uint32_t offset, uint32_t count)
+{
+   if ((offset % 8) != 0 || (uint64_t)offset + ((uint64_t)count * sizeof(T)) > file.mSize)
+      return NULL;
+   return (const T*)(file.mPtr + offset);
+}
+
+bool MissionSnapshot::open(const char* filename)
+{
+   close();
+   
+   if (!mFile.open(filename))
+      return false;
+   
+   const Header* header = (const Header*)mFile.mPtr;
+   if (mFile.mSize < sizeof(Header) || header->magic != Magic || header->version != Version)
+   {
+      close();
+      return false;
+   }
+   
+   mStringOffsets = getSection<uint32_t>(mFile, header->stringOffsetsOffset, header->numStrings);
+   mStringData = getSection<char>(mFile, header->stringDataOffset, header->stringDataSize);
+   mObjects = getSection<ObjectRecord>(mFile, header->objectsOffset, header->numObjects);
+   mFields = getSection<FieldRecord>(mFile, header->fieldsOffset, header->numFields);
+   mResources = getSection<ResourceRecord>(mFile, header->resourcesOffset, header->numResources);
+   mInstances = getSection<InstanceRecord>(mFile, header->instancesOffset, header->numInstances);
+   
+   bool valid = mStringOffsets && mStringData && mObjects && mFields && mResources && mInstances;
+   
+   // Check every index so restoring doesn't need to
+   valid = valid && header->stringDataSize > 0 && mStringData[header->stringDataSize-1] == '\0';
+   for (uint32_t i=0; valid && i<header->numStrings; i++)
+      valid = mStringOffsets[i] < header->stringDataSize;
+   
+   for (uint32_t i=0; valid && i<header->numObjects; i++)
+   {
+      const ObjectRecord& rec = mObjects[i];
+      valid = rec.className < header->numStrings && rec.name < header->numStrings &&
+              (rec.parent == InvalidIndex || rec.parent < i) &&
+              (uint64_t)rec.fieldStart + rec.fieldCount <= header->numFields;
+   }
+   
+   for (uint32_t i=0; valid && i<header->numFields; i++)
+      valid = mFields[i].name < header->numStrings && mFields[i].value < header->numStrings;
+   
+   for (uint32_t i=0; valid && i<header->numResources; i++)
+      valid = mResources[i].filename < header->numStrings && mResources[i].resolvedName < header->numStrings;
+   
+   for (uint32_t i=0; valid && i<header->numInstances; i++)
+   {
+      valid = mInstances[i].object < header->numObjects &&
+              (mInstances[i].resource == InvalidIndex || mInstances[i].resource < header->numResources);
+   }
+   
+   if (!valid)
+   {
+      printf("MissionSnapshot: %s is corrupt\n", filename);
+      close();
+      return false;
+   }
+   
+   mHeader = header;
+   return true;
+}
+
+const char* MissionSnapshot::getString(uint32_t idx) const
+{
+   return idx < mHeader->numStrings ? mStringData + mStringOffsets[idx] : "";
+}
+
+bool MissionSnapshot::restoreScene(const MissionFile& mission, SceneContainer& scene) const
+{
+   if (mHeader == NULL || mHeader->numResources != mission.mResources.size())
+      return false;
+   
+   for (uint32_t i=0; i<mHeader->numResources; i++)
+   {
+      const LoadedResource* res = mission.mResources[i];
+      const ResourceRecord& rec = mResources[i];
+      if (res->found != (rec.found != 0) || res->hash != rec.hash || res->size != rec.size)
+         return false;
+   }
+   
+   std::vector<SimObject*> objects;
+   objects.reserve(mHeader->numObjects);
+   mission.forEachObject([&objects](SimObject* obj){
+      objects.push_back(obj);
+   });
+   
+   if (objects.size() != mHeader->numObjects)
+      return false;
+   
+   scene.reset(slm::vec3(mHeader->worldCenter[0], mHeader->worldCenter[1], mHeader->worldCenter[2]), mHeader->worldHalfSize);
+   for (uint32_t i=0; i<mHeader->numInstances; i++)
+   {
+      const InstanceRecord& rec = mInstances[i];
+      ResourceInstance* res = rec.resource != InvalidIndex ? mission.mResources[rec.resource]->instance : NULL;
+      
+      slm::mat4 transform;
+      for (uint32_t col=0; col<4; col++)
+      {
+         for (uint32_t row=0; row<4; row++)
+            transform[col][row] = rec.transform[(col*4) + row];
+      }
+      
+      scene.addInstance(res, transform,
+                        slm::vec3(rec.boundsMin[0], rec.boundsMin[1], rec.boundsMin[2]),
+                        slm::vec3(rec.boundsMax[0], rec.boundsMax[1], rec.boundsMax[2]),
+                        objects[rec.object]);
+   }
+   
+   return true;
+}
+
+// Builds the string table for a snapshot
+class SnapshotStrings
+{
+public:
+   std::unordered_map<std::string, uint32_t> mLookup;
+   std::vector<uint32_t> mOffsets;
+   std::string mData;
+   
+   uint32_t add(const std::string& str)
+   {
+      auto itr = mLookup.find(str);
+      if (itr != mLookup.end())
+         return itr->second;
+      
+      uint32_t idx = (uint32_t)mOffsets.size();
+      mOffsets.push_back((uint32_t)mData.size());
+      mData.append(str.c_str(), str.size() + 1);
+      mLookup[str] = idx;
+      return idx;
+   }
+};
+
+template<class T> static uint32_t appendSection(std::vector<uint8_t>& buffer, const T* data, size_t count)
+{
+   buffer.resize((buffer.size() + 7) & ~7);
+   uint32_t offset = (uint32_t)buffer.size();
+   if (count > 0)
+      buffer.insert(buffer.end(), (const uint8_t*)data, (const uint8_t*)(data + count));
+   return offset;
+}
+
+bool MissionSnapshot::write(const char* filename, const MissionFile& mission, const SceneContainer& scene)
+{
+   SnapshotStrings strings;
+   std::vector<ObjectRecord> objects;
+   std::vector<FieldRecord> fields;
+   std::vector<ResourceRecord> resources;
+   std::vector<InstanceRecord> instances;
+   std::unordered_map<const SimObject*, uint32_t> objectLookup;
+   std::unordered_map<const ResourceInstance*, uint32_t> resourceLookup;
+   
+   strings.add("");
+   
+   mission.forEachObject([&](SimObject* obj){
+      ObjectRecord rec;
+      rec.className = strings.add(obj->mClassName);
+      rec.name = strings.add(obj->mName);
+      rec.parent = obj->mParent ? objectLookup[obj->mParent] : InvalidIndex;
+      rec.fieldStart = (uint32_t)fields.size();
+      rec.fieldCount = (uint32_t)obj->mFields.size();
+      
+      for (const auto& field : obj->mFields)
+         fields.push_back({strings.add(field.first), strings.add(field.second)});
+      
+      objectLookup[obj] = (uint32_t)objects.size();
+      objects.push_back(rec);
+   });
+   
+   for (const LoadedResource* res : mission.mResources)
+   {
+      ResourceRecord rec = {};
+      rec.filename = strings.add(res->filename);
+      rec.resolvedName = strings.add(res->resolvedName);
+      rec.found = res->found ? 1 : 0;
+      rec.size = res->size;
+      rec.hash = res->hash;
+      
+      if (res->instance)
+         resourceLookup[res->instance] = (uint32_t)resources.size();
+      resources.push_back(rec);
+   }
+   
+   for (uint32_t id=0; id<scene.mInstances.size(); id++)
+   {
+      if (!scene.isValid(id))
+         continue;
+      
+      const SceneContainer::Instance& inst = scene.mInstances[id];
+      auto objItr = objectLookup.find((const SimObject*)inst.userData);
+      if (objItr == objectLookup.end())
+         continue;
+      
+      InstanceRecord rec;
+      rec.object = objItr->second;
+      rec.resource = InvalidIndex;
+      if (inst.resource)
+      {
+         auto resItr = resourceLookup.find(inst.resource);
+         if (resItr != resourceLookup.end())
+            rec.resource = resItr->second;
+      }
+      
+      for (uint32_t col=0; col<4; col++)
+      {
+         for (uint32_t row=0; row<4; row++)
+            rec.transform[(col*4) + row] = inst.transform[col][row];
+      }
+      
+      rec.boundsMin[0] = inst.objBoundsMin.x;
+      rec.boundsMin[1] = inst.objBoundsMin.y;
+      rec.boundsMin[2] = inst.objBoundsMin.z;
+      rec.boundsMax[0] = inst.objBoundsMax.x;
+      rec.boundsMax[1] = inst.objBoundsMax.y;
+      rec.boundsMax[2] = inst.objBoundsMax.z;
+      instances.push_back(rec);
+   }
+   
+   Header header = {};
+   header.magic = Magic;
+   header.version = Version;
+   header.missionHash = mission.mSourceHash;
+   header.missionSize = mission.mSourceSize;
+   header.worldCenter[0] = scene.getWorldCenter().x;
+   header.worldCenter[1] = scene.getWorldCenter().y;
+   header.worldCenter[2] = scene.getWorldCenter().z;
+   header.worldHalfSize = scene.getWorldHalfSize();
+   header.numStrings = (uint32_t)strings.mOffsets.size();
+   header.stringDataSize = (uint32_t)strings.mData.size();
+   header.numObjects = (uint32_t)objects.size();
+   header.numFields = (uint32_t)fields.size();
+   header.numResources = (uint32_t)resources.size();
+   header.numInstances = (uint32_t)instances.size();
+   
+   std::vector<uint8_t> buffer(sizeof(Header));
+   header.stringOffsetsOffset = appendSection(buffer, strings.mOffsets.data(), strings.mOffsets.size());
+   header.stringDataOffset = appendSection(buffer, strings.mData.data(), strings.mData.size());
+   header.objectsOffset = appendSection(buffer, objects.data(), objects.size());
+   header.fieldsOffset = appendSection(buffer, fields.data(), fields.size());
+   header.resourcesOffset = appendSection(buffer, resources.data(), resources.size());
+   header.instancesOffset = appendSection(buffer, instances.data(), instances.size());
+   memcpy(buffer.data(), &header, sizeof(Header));
+   
+   // Write to a temp file first so a partial write never looks valid
+   std::string tempName = std::string(filename) + ".tmp";
+   FILE* fp = fopen(tempName.c_str(), "wb");
+   if (fp == NULL)
+   {
+      printf("MissionSnapshot: couldn't write %s\n", tempName.c_str());
+      return false;
+   }
+   
+   bool ok = fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+   ok = (fclose(fp) == 0) && ok;
+   
+   if (ok)
+   {
+      remove(filename);
+      ok = rename(tempName.c_str(), filename) == 0;
+   }
+   
+   if (!ok)
+   {
+      printf("MissionSnapshot: couldn't write %s\n", filename);
+      remove(tempName.c_str());
+   }
+   
+   return ok;
+}
+
+std::string MissionSnapshot::getCachePath(const char* cacheDir, const char* missionName)
+{
+   std::string name = missionName;
+   for (char& c : name)
+   {
+      if (c == '/' || c == '\\' || c == ':')
+         c = '_';
+   }
+   
+   return std::string(cacheDir) + "/" + name + ".tvsnap";
+}
+
+}
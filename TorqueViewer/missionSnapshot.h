@@ -0,0 +1,148 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _MISSIONSNAPSHOT_H_
+#define _MISSIONSNAPSHOT_H_
+
+#include <stdint.h>
+#include <string>
+#include "CommonData.h"
+
+class SceneContainer;
+
+/*
+ Binary snapshot of a loaded mission, so reopening it doesn't need to parse the
+ script, search for resources or work out object bounds again.
+ 
+ The file is a header followed by flat arrays of fixed size records which are
+ used straight from a memory mapping. Strings are stored once in a table and
+ referenced by index. Data is in native byte order; a snapshot is only a cache
+ so is just rebuilt if anything doesn't match.
+ 
+ A snapshot is only valid for the exact mission text it was made from
+ (checked with mMissionHash), and each instance is only restored if the file
+ it uses still has the same hash once loaded.
+ */
+namespace Mission
+{
+
+class MissionFile;
+
+class MissionSnapshot
+{
+public:
+   
+   enum
+   {
+      Magic = 0x534D5654, // "TVMS"
+      Version = 1,
+      InvalidIndex = 0xFFFFFFFF
+   };
+   
+   struct Header
+   {
+      uint32_t magic;
+      uint32_t version;
+      uint64_t missionHash;
+      uint64_t missionSize;
+      float worldCenter[3];
+      float worldHalfSize;
+      uint32_t numStrings;
+      uint32_t stringOffsetsOffset;
+      uint32_t stringDataSize;
+      uint32_t stringDataOffset;
+      uint32_t numObjects;
+      uint32_t objectsOffset;
+      uint32_t numFields;
+      uint32_t fieldsOffset;
+      uint32_t numResources;
+      uint32_t resourcesOffset;
+      uint32_t numInstances;
+      uint32_t instancesOffset;
+   };
+   
+   // Objects are stored parents first, in MissionFile::forEachObject order
+   struct ObjectRecord
+   {
+      uint32_t className;
+      uint32_t name;
+      uint32_t parent; // InvalidIndex for root objects
+      uint32_t fieldStart;
+      uint32_t fieldCount;
+   };
+   
+   struct FieldRecord
+   {
+      uint32_t name;
+      uint32_t value;
+   };
+   
+   struct ResourceRecord
+   {
+      uint32_t filename;
+      uint32_t resolvedName;
+      uint32_t found;
+      uint32_t pad;
+      uint64_t size;
+      uint64_t hash;
+   };
+   
+   struct InstanceRecord
+   {
+      uint32_t object;
+      uint32_t resource; // InvalidIndex if the instance doesn't use one
+      float transform[16];
+      float boundsMin[3];
+      float boundsMax[3];
+   };
+   
+   MappedFile mFile;
+   const Header* mHeader;
+   const uint32_t* mStringOffsets;
+   const char* mStringData;
+   const ObjectRecord* mObjects;
+   const FieldRecord* mFields;
+   const ResourceRecord* mResources;
+   const InstanceRecord* mInstances;
+   
+   MissionSnapshot();
+   
+   // Maps a snapshot and checks it's well formed
+   bool open(const char* filename);
+   void close();
+   
+   inline bool isOpen() const { return mHeader != NULL; }
+   const char* getString(uint32_t idx) const;
+   
+   // Restores instances into scene. Fails if any resource has changed since the snapshot was made.
+   bool restoreScene(const MissionFile& mission, SceneContainer& scene) const;
+   
+   // Writes mission & its placed objects in scene (userData should point to the SimObject)
+   static bool write(const char* filename, const MissionFile& mission, const SceneContainer& scene);
+   
+   // Gets a filename in cacheDir to use for a mission
+   static std::string getCachePath(const char* cacheDir, const char* missionName);
+};
+
+}
+
+#endif
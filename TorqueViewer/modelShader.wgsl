@@ -0,0 +1,80 @@
+// Permutations (see ShaderPreprocessor):
+//   ALPHA_TEST - discard by params2.x
+
+struct CommonUniforms {
+    projMat: mat4x4<f32>,
+    viewMat: mat4x4<f32>,
+    modelMat: mat4x4<f32>,
+    params1: vec4<f32>, // viewportScale.xy, lineWidth
+    params2: vec4<f32>, // alphaTestF
+    lightPos: vec4<f32>,
+    lightColor: vec4<f32>,
+};
+
+@group(0) @binding(0) var<uniform> commonUniforms: CommonUniforms;
+
+
+@group(1) @binding(0) var texture0: texture_2d<f32>;
+@group(1) @binding(1) var sampler0: sampler;
+
+struct VertexInput {
+    @location(0) aPosition: vec3<f32>,
+    @location(1) aNormal: vec3<f32>,
+    @location(2) aTexCoord0: vec2<f32>,
+};
+
+struct InstanceInput {
+    @location(4) aInstanceMat0: vec4<f32>,
+    @location(5) aInstanceMat1: vec4<f32>,
+    @location(6) aInstanceMat2: vec4<f32>,
+    @location(7) aInstanceMat3: vec4<f32>,
+    @location(8) aTransformOffset: u32, // base node transform, unused until skinning is done on the GPU
+};
+
+struct VertexOutput {
+    @builtin(position) position: vec4<f32>,
+    @location(0) vTexCoord0: vec2<f32>,
+    @location(1) vColor0: vec4<f32>,
+};
+
+struct FragmentOutput {
+    @location(0) Color: vec4<f32>,
+};
+
+
+@vertex
+fn mainVert(input: VertexInput, instance: InstanceInput) -> VertexOutput {
+    let instanceMat = mat4x4<f32>(instance.aInstanceMat0, instance.aInstanceMat1, instance.aInstanceMat2, instance.aInstanceMat3);
+    let modelMat: mat4x4<f32> = commonUniforms.modelMat * instanceMat;
+
+    let mvpMat: mat4x4<f32> = commonUniforms.projMat * commonUniforms.viewMat * modelMat;
+
+    var output: VertexOutput;
+    output.position = mvpMat * vec4<f32>(input.aPosition, 1.0);
+    output.vTexCoord0 = input.aTexCoord0;
+    output.vColor0 = vec4<f32>(1.0, 1.0, 1.0, 1.0); // Set to white color as per original shader
+    output.vColor0.a = 1.0;
+
+    return output;
+}
+
+@fragment
+fn mainFrag(input: VertexOutput) -> FragmentOutput {
+    var color: vec4<f32> = textureSample(texture0, sampler0, input.vTexCoord0);
+
+#ifdef ALPHA_TEST
+    if (color.a > commonUniforms.params2.x) {
+        discard;
+    }
+#endif
+
+    var outputColor: vec4<f32>;
+    outputColor.r = color.r * input.vColor0.r * input.vColor0.a;
+    outputColor.g = color.g * input.vColor0.g * input.vColor0.a;
+    outputColor.b = color.b * input.vColor0.b * input.vColor0.a;
+    outputColor.a = color.a;
+
+    var out: FragmentOutput;
+    out.Color = outputColor;
+    return out;
+}
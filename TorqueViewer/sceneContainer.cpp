@@ -0,0 +1,533 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "sceneContainer.h"
+
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define SCENE_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define SCENE_NEON
+#endif
+
+// Minimal 4-wide float ops for the plane tests
+
+#if defined(SCENE_SSE)
+
+typedef __m128 Float4;
+static inline Float4 f4Load(const float* p) { return _mm_loadu_ps(p); }
+static inline Float4 f4Splat(float f) { return _mm_set1_ps(f); }
+static inline Float4 f4Add(Float4 a, Float4 b) { return _mm_add_ps(a, b); }
+static inline Float4 f4Sub(Float4 a, Float4 b) { return _mm_sub_ps(a, b); }
+static inline Float4 f4Mul(Float4 a, Float4 b) { return _mm_mul_ps(a, b); }
+static inline bool f4AnyNegative(Float4 a) { return _mm_movemask_ps(_mm_cmplt_ps(a, _mm_setzero_ps())) != 0; }
+
+#elif defined(SCENE_NEON)
+
+typedef float32x4_t Float4;
+static inline Float4 f4Load(const float* p) { return vld1q_f32(p); }
+static inline Float4 f4Splat(float f) { return vdupq_n_f32(f); }
+static inline Float4 f4Add(Float4 a, Float4 b) { return vaddq_f32(a, b); }
+static inline Float4 f4Sub(Float4 a, Float4 b) { return vsubq_f32(a, b); }
+static inline Float4 f4Mul(Float4 a, Float4 b) { return vmulq_f32(a, b); }
+static inline bool f4AnyNegative(Float4 a) { return vmaxvq_u32(vcltq_f32(a, vdupq_n_f32(0.0f))) != 0; }
+
+#else
+
+struct Float4 { float v[4]; };
+static inline Float4 f4Load(const float* p) { Float4 r; for (int i=0; i<4; i++) r.v[i] = p[i]; return r; }
+static inline Float4 f4Splat(float f) { Float4 r; for (int i=0; i<4; i++) r.v[i] = f; return r; }
+static inline Float4 f4Add(Float4 a, Float4 b) { for (int i=0; i<4; i++) a.v[i] += b.v[i]; return a; }
+static inline Float4 f4Sub(Float4 a, Float4 b) { for (int i=0; i<4; i++) a.v[i] -= b.v[i]; return a; }
+static inline Float4 f4Mul(Float4 a, Float4 b) { for (int i=0; i<4; i++) a.v[i] *= b.v[i]; return a; }
+static inline bool f4AnyNegative(Float4 a) { return a.v[0] < 0.0f || a.v[1] < 0.0f || a.v[2] < 0.0f || a.v[3] < 0.0f; }
+
+#endif
+
+SceneContainer::SceneContainer(const slm::vec3& worldCenter, float worldHalfSize, uint32_t maxDepth) :
+mNumInstances(0),
+mMaxDepth(maxDepth)
+{
+   mStats = {};
+   reset(worldCenter, worldHalfSize);
+}
+
+void SceneContainer::reset(const slm::vec3& worldCenter, float worldHalfSize)
+{
+   clear();
+   Node& root = mNodes[0];
+   root.center = worldCenter;
+   root.halfSize = worldHalfSize;
+}
+
+void SceneContainer::clear()
+{
+   slm::vec3 center(0);
+   float halfSize = 4096.0f;
+   if (!mNodes.empty())
+   {
+      center = mNodes[0].center;
+      halfSize = mNodes[0].halfSize;
+   }
+   
+   mInstances.clear();
+   mFreeInstances.clear();
+   mFreeNodes.clear();
+   mNodes.clear();
+   mNumInstances = 0;
+   
+   mNodes.emplace_back();
+   Node& root = mNodes[0];
+   root.center = center;
+   root.halfSize = halfSize;
+   root.depth = 0;
+   root.parent = InvalidIndex;
+   root.subtreeCount = 0;
+   std::fill(root.children, root.children+8, (uint32_t)InvalidIndex);
+}
+
+void SceneContainer::updateWorldBounds(Instance& inst)
+{
+   slm::vec3 center = (inst.objBoundsMin + inst.objBoundsMax) * 0.5f;
+   slm::vec3 extent = (inst.objBoundsMax - inst.objBoundsMin) * 0.5f;
+   const slm::mat4& m = inst.transform;
+   
+   inst.center = (m * slm::vec4(center, 1.0f)).xyz();
+   inst.extent.x = (fabsf(m[0][0]) * extent.x) + (fabsf(m[1][0]) * extent.y) + (fabsf(m[2][0]) * extent.z);
+   inst.extent.y = (fabsf(m[0][1]) * extent.x) + (fabsf(m[1][1]) * extent.y) + (fabsf(m[2][1]) * extent.z);
+   inst.extent.z = (fabsf(m[0][2]) * extent.x) + (fabsf(m[1][2]) * extent.y) + (fabsf(m[2][2]) * extent.z);
+}
+
+uint32_t SceneContainer::allocNode(uint32_t parent, uint32_t octant)
+{
+   uint32_t idx = 0;
+   if (!mFreeNodes.empty())
+   {
+      idx = mFreeNodes.back();
+      mFreeNodes.pop_back();
+   }
+   else
+   {
+      idx = (uint32_t)mNodes.size();
+      mNodes.emplace_back();
+   }
+   
+   Node& parentNode = mNodes[parent];
+   Node& node = mNodes[idx];
+   float half = parentNode.halfSize * 0.5f;
+   
+   node.center = parentNode.center + slm::vec3((octant & 1) ? half : -half,
+                                               (octant & 2) ? half : -half,
+                                               (octant & 4) ? half : -half);
+   node.halfSize = half;
+   node.depth = parentNode.depth + 1;
+   node.parent = parent;
+   node.subtreeCount = 0;
+   node.objects.clear();
+   std::fill(node.children, node.children+8, (uint32_t)InvalidIndex);
+   
+   parentNode.children[octant] = idx;
+   return idx;
+}
+
+uint32_t SceneContainer::findNode(const slm::vec3& center, const slm::vec3& extent)
+{
+   // Objects outside the root cell just stay in the root
+   const Node& root = mNodes[0];
+   slm::vec3 delta = center - root.center;
+   if (fabsf(delta.x) > root.halfSize || fabsf(delta.y) > root.halfSize || fabsf(delta.z) > root.halfSize)
+      return 0;
+   
+   // Go down while the object fits in the loose bounds of the next level
+   float size = std::max(extent.x, std::max(extent.y, extent.z));
+   float childHalf = root.halfSize * 0.5f;
+   uint32_t nodeIdx = 0;
+   
+   while (mNodes[nodeIdx].depth < mMaxDepth && size <= childHalf)
+   {
+      const Node& node = mNodes[nodeIdx];
+      uint32_t octant = (center.x >= node.center.x ? 1 : 0) |
+                        (center.y >= node.center.y ? 2 : 0) |
+                        (center.z >= node.center.z ? 4 : 0);
+      uint32_t child = node.children[octant];
+      if (child == InvalidIndex)
+         child = allocNode(nodeIdx, octant);
+      
+      nodeIdx = child;
+      childHalf *= 0.5f;
+   }
+   
+   return nodeIdx;
+}
+
+void SceneContainer::insertIntoNode(uint32_t id, uint32_t nodeIdx)
+{
+   Instance& inst = mInstances[id];
+   Node& node = mNodes[nodeIdx];
+   
+   ObjectBounds bounds;
+   bounds.center = inst.center;
+   bounds.id = id;
+   bounds.extent = inst.extent;
+   bounds.pad = 0.0f;
+   
+   inst.node = nodeIdx;
+   inst.slot = (uint32_t)node.objects.size();
+   node.objects.push_back(bounds);
+   
+   for (uint32_t idx = nodeIdx; idx != InvalidIndex; idx = mNodes[idx].parent)
+      mNodes[idx].subtreeCount++;
+}
+
+void SceneContainer::removeFromNode(uint32_t nodeIdx, uint32_t slot)
+{
+   Node& node = mNodes[nodeIdx];
+   if (slot+1 < node.objects.size())
+   {
+      node.objects[slot] = node.objects.back();
+      mInstances[node.objects[slot].id].slot = slot;
+   }
+   node.objects.pop_back();
+   
+   // Empty nodes are unlinked so queries don't visit them
+   uint32_t idx = nodeIdx;
+   while (idx != InvalidIndex)
+   {
+      Node& current = mNodes[idx];
+      uint32_t parent = current.parent;
+      
+      if (--current.subtreeCount == 0 && parent != InvalidIndex)
+      {
+         Node& parentNode = mNodes[parent];
+         for (uint32_t i=0; i<8; i++)
+         {
+            if (parentNode.children[i] == idx)
+               parentNode.children[i] = InvalidIndex;
+         }
+         mFreeNodes.push_back(idx);
+      }
+      
+      idx = parent;
+   }
+}
+
+uint32_t SceneContainer::addInstance(ResourceInstance* resource, const slm::mat4& transform, const slm::vec3& boundsMin, const slm::vec3& boundsMax, void* userData)
+{
+   uint32_t id = 0;
+   if (!mFreeInstances.empty())
+   {
+      id = mFreeInstances.back();
+      mFreeInstances.pop_back();
+   }
+   else
+   {
+      id = (uint32_t)mInstances.size();
+      mInstances.emplace_back();
+   }
+   
+   Instance& inst = mInstances[id];
+   inst.transform = transform;
+   inst.objBoundsMin = boundsMin;
+   inst.objBoundsMax = boundsMax;
+   inst.resource = resource;
+   inst.userData = userData;
+   updateWorldBounds(inst);
+   
+   insertIntoNode(id, findNode(inst.center, inst.extent));
+   mNumInstances++;
+   return id;
+}
+
+void SceneContainer::removeInstance(uint32_t id)
+{
+   if (!isValid(id))
+      return;
+   
+   Instance& inst = mInstances[id];
+   removeFromNode(inst.node, inst.slot);
+   inst.node = InvalidIndex;
+   inst.resource = NULL;
+   inst.userData = NULL;
+   mFreeInstances.push_back(id);
+   mNumInstances--;
+}
+
+void SceneContainer::setTransform(uint32_t id, const slm::mat4& transform)
+{
+   if (!isValid(id))
+      return;
+   
+   Instance& inst = mInstances[id];
+   inst.transform = transform;
+   updateWorldBounds(inst);
+   
+   uint32_t target = findNode(inst.center, inst.extent);
+   if (target == inst.node)
+   {
+      // Common case, object is still in the same cell
+      ObjectBounds& bounds = mNodes[target].objects[inst.slot];
+      bounds.center = inst.center;
+      bounds.extent = inst.extent;
+      return;
+   }
+   
+   // NOTE: insert first so the new node's parents can't be freed on removal
+   uint32_t oldNode = inst.node;
+   uint32_t oldSlot = inst.slot;
+   insertIntoNode(id, target);
+   removeFromNode(oldNode, oldSlot);
+}
+
+void SceneContainer::setObjectBounds(uint32_t id, const slm::vec3& boundsMin, const slm::vec3& boundsMax)
+{
+   if (!isValid(id))
+      return;
+   
+   Instance& inst = mInstances[id];
+   inst.objBoundsMin = boundsMin;
+   inst.objBoundsMax = boundsMax;
+   setTransform(id, inst.transform);
+}
+
+SceneContainer::TestResult SceneContainer::testBox(const PlaneGroup* groups, uint32_t numGroups, const slm::vec3& center, const slm::vec3& extent)
+{
+   Float4 cx = f4Splat(center.x);
+   Float4 cy = f4Splat(center.y);
+   Float4 cz = f4Splat(center.z);
+   Float4 ex = f4Splat(extent.x);
+   Float4 ey = f4Splat(extent.y);
+   Float4 ez = f4Splat(extent.z);
+   
+   TestResult result = Inside;
+   for (uint32_t i=0; i<numGroups; i++)
+   {
+      const PlaneGroup& g = groups[i];
+      Float4 dist = f4Add(f4Add(f4Mul(f4Load(g.x), cx), f4Mul(f4Load(g.y), cy)), f4Add(f4Mul(f4Load(g.z), cz), f4Load(g.w)));
+      Float4 radius = f4Add(f4Add(f4Mul(f4Load(g.absX), ex), f4Mul(f4Load(g.absY), ey)), f4Mul(f4Load(g.absZ), ez));
+      
+      if (f4AnyNegative(f4Add(dist, radius)))
+         return Outside;
+      if (f4AnyNegative(f4Sub(dist, radius)))
+         result = Intersects;
+   }
+   
+   return result;
+}
+
+void SceneContainer::collectSubtree(uint32_t nodeIdx, std::vector<uint32_t>& outIds)
+{
+   const Node& node = mNodes[nodeIdx];
+   for (const ObjectBounds& obj : node.objects)
+      outIds.push_back(obj.id);
+   
+   for (uint32_t i=0; i<8; i++)
+   {
+      if (node.children[i] != InvalidIndex)
+         collectSubtree(node.children[i], outIds);
+   }
+}
+
+void SceneContainer::frustumVisit(uint32_t nodeIdx, const PlaneGroup* groups, uint32_t numGroups, std::vector<uint32_t>& outIds)
+{
+   const Node& node = mNodes[nodeIdx];
+   mStats.nodesVisited++;
+   
+   // Root also holds anything outside the world, so always check its objects
+   if (nodeIdx != 0)
+   {
+      TestResult result = testBox(groups, numGroups, node.center, slm::vec3(node.halfSize * 2.0f));
+      if (result == Outside)
+         return;
+      
+      if (result == Inside)
+      {
+         mStats.nodesInside++;
+         collectSubtree(nodeIdx, outIds);
+         return;
+      }
+   }
+   
+   mStats.objectsTested += (uint32_t)node.objects.size();
+   for (const ObjectBounds& obj : node.objects)
+   {
+      if (testBox(groups, numGroups, obj.center, obj.extent) != Outside)
+         outIds.push_back(obj.id);
+   }
+   
+   for (uint32_t i=0; i<8; i++)
+   {
+      if (node.children[i] != InvalidIndex)
+         frustumVisit(node.children[i], groups, numGroups, outIds);
+   }
+}
+
+void SceneContainer::findInFrustum(const slm::vec4* planes, uint32_t numPlanes, std::vector<uint32_t>& outIds)
+{
+   outIds.clear();
+   mStats = {};
+   
+   numPlanes = std::min<uint32_t>(numPlanes, MaxFrustumPlanes);
+   uint32_t numGroups = (numPlanes + 3) / 4;
+   PlaneGroup groups[MaxFrustumPlanes / 4];
+   
+   for (uint32_t i=0; i<numGroups*4; i++)
+   {
+      // Unused lanes get a plane everything is in front of
+      slm::vec4 plane = i < numPlanes ? planes[i] : slm::vec4(0, 0, 0, 1);
+      PlaneGroup& g = groups[i / 4];
+      g.x[i & 3] = plane.x;
+      g.y[i & 3] = plane.y;
+      g.z[i & 3] = plane.z;
+      g.w[i & 3] = plane.w;
+      g.absX[i & 3] = fabsf(plane.x);
+      g.absY[i & 3] = fabsf(plane.y);
+      g.absZ[i & 3] = fabsf(plane.z);
+   }
+   
+   if (mNodes[0].subtreeCount != 0)
+      frustumVisit(0, groups, numGroups, outIds);
+   
+   mStats.objectsFound = (uint32_t)outIds.size();
+}
+
+static inline bool sphereOverlapsBox(const slm::vec3& sphereCenter, float radiusSq, const slm::vec3& center, const slm::vec3& extent)
+{
+   slm::vec3 delta = center - sphereCenter;
+   float dx = std::max(fabsf(delta.x) - extent.x, 0.0f);
+   float dy = std::max(fabsf(delta.y) - extent.y, 0.0f);
+   float dz = std::max(fabsf(delta.z) - extent.z, 0.0f);
+   return (dx*dx) + (dy*dy) + (dz*dz) <= radiusSq;
+}
+
+void SceneContainer::sphereVisit(uint32_t nodeIdx, const slm::vec3& center, float radius, std::vector<uint32_t>& outIds)
+{
+   const Node& node = mNodes[nodeIdx];
+   float radiusSq = radius * radius;
+   mStats.nodesVisited++;
+   
+   if (nodeIdx != 0 && !sphereOverlapsBox(center, radiusSq, node.center, slm::vec3(node.halfSize * 2.0f)))
+      return;
+   
+   mStats.objectsTested += (uint32_t)node.objects.size();
+   for (const ObjectBounds& obj : node.objects)
+   {
+      if (sphereOverlapsBox(center, radiusSq, obj.center, obj.extent))
+         outIds.push_back(obj.id);
+   }
+   
+   for (uint32_t i=0; i<8; i++)
+   {
+      if (node.children[i] != InvalidIndex)
+         sphereVisit(node.children[i], center, radius, outIds);
+   }
+}
+
+void SceneContainer::findInSphere(const slm::vec3& center, float radius, std::vector<uint32_t>& outIds)
+{
+   outIds.clear();
+   mStats = {};
+   
+   if (mNodes[0].subtreeCount != 0)
+      sphereVisit(0, center, radius, outIds);
+   
+   mStats.objectsFound = (uint32_t)outIds.size();
+}
+
+bool SceneContainer::testRay(const slm::vec3& start, const slm::vec3& invDir, float maxDist, const slm::vec3& center, const slm::vec3& extent, float& outDist)
+{
+   // Slab test
+   float tMin = 0.0f;
+   float tMax = maxDist;
+   
+   for (int i=0; i<3; i++)
+   {
+      float t1 = (center[i] - extent[i] - start[i]) * invDir[i];
+      float t2 = (center[i] + extent[i] - start[i]) * invDir[i];
+      if (t1 > t2)
+         std::swap(t1, t2);
+      
+      // NaN (ray parallel & on the slab) compares false so doesn't narrow the range
+      if (t1 > tMin)
+         tMin = t1;
+      if (t2 < tMax)
+         tMax = t2;
+      if (tMin > tMax)
+         return false;
+   }
+   
+   outDist = tMin;
+   return true;
+}
+
+void SceneContainer::rayVisit(uint32_t nodeIdx, const slm::vec3& start, const slm::vec3& invDir, float maxDist)
+{
+   const Node& node = mNodes[nodeIdx];
+   float dist = 0.0f;
+   mStats.nodesVisited++;
+   
+   if (nodeIdx != 0 && !testRay(start, invDir, maxDist, node.center, slm::vec3(node.halfSize * 2.0f), dist))
+      return;
+   
+   mStats.objectsTested += (uint32_t)node.objects.size();
+   for (const ObjectBounds& obj : node.objects)
+   {
+      if (testRay(start, invDir, maxDist, obj.center, obj.extent, dist))
+         mRayHits.push_back({dist, obj.id});
+   }
+   
+   for (uint32_t i=0; i<8; i++)
+   {
+      if (node.children[i] != InvalidIndex)
+         rayVisit(node.children[i], start, invDir, maxDist);
+   }
+}
+
+void SceneContainer::findOnRay(const slm::vec3& start, const slm::vec3& dir, float maxDist, std::vector<uint32_t>& outIds, std::vector<float>* outDists)
+{
+   outIds.clear();
+   if (outDists)
+      outDists->clear();
+   mStats = {};
+   mRayHits.clear();
+   
+   slm::vec3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+   if (mNodes[0].subtreeCount != 0)
+      rayVisit(0, start, invDir, maxDist);
+   
+   std::sort(mRayHits.begin(), mRayHits.end(), [](const RayHit& a, const RayHit& b){
+      return a.dist < b.dist;
+   });
+   
+   outIds.reserve(mRayHits.size());
+   for (const RayHit& hit : mRayHits)
+   {
+      outIds.push_back(hit.id);
+      if (outDists)
+         outDists->push_back(hit.dist);
+   }
+   
+   mStats.objectsFound = (uint32_t)outIds.size();
+}
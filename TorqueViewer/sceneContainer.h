@@ -0,0 +1,177 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _SCENECONTAINER_H_
+#define _SCENECONTAINER_H_
+
+#include <stdint.h>
+#include <vector>
+#include <slm/slmath.h>
+
+class ResourceInstance;
+
+/*
+ Spatial index for placed objects (shapes, interiors, etc).
+ 
+ Objects live in a loose octree: each node's bounds are twice the size of its
+ cell, so an object only needs its center to be inside a cell and its extent to
+ be no bigger than the cell's half size. This means the node an object goes in
+ can be found directly from its size and position, and moving an object usually
+ just updates its bounds in place.
+ 
+ Each node keeps a compact array of its objects' world bounds so queries only
+ touch contiguous memory. Frustum tests check four planes at a time with SIMD,
+ and once a node is fully inside the frustum its whole subtree is accepted
+ without further tests.
+ 
+ Ids returned by addInstance stay valid until removeInstance, and are what the
+ queries return.
+ */
+class SceneContainer
+{
+public:
+   
+   enum
+   {
+      DefaultMaxDepth = 5,
+      MaxFrustumPlanes = 8,
+      InvalidIndex = 0xFFFFFFFF
+   };
+   
+   struct Instance
+   {
+      slm::mat4 transform;
+      slm::vec3 objBoundsMin; // object space
+      slm::vec3 objBoundsMax;
+      slm::vec3 center;       // world space AABB
+      slm::vec3 extent;
+      ResourceInstance* resource;
+      void* userData;
+      uint32_t node; // InvalidIndex if this slot is free
+      uint32_t slot; // index in node's object list
+   };
+   
+   struct Stats
+   {
+      uint32_t nodesVisited;
+      uint32_t nodesInside;
+      uint32_t objectsTested;
+      uint32_t objectsFound;
+   };
+   
+   std::vector<Instance> mInstances;
+   Stats mStats;
+   
+   SceneContainer(const slm::vec3& worldCenter=slm::vec3(0), float worldHalfSize=4096.0f, uint32_t maxDepth=DefaultMaxDepth);
+   
+   // Objects which aren't inside the world bounds still work, they just aren't culled as well
+   void reset(const slm::vec3& worldCenter, float worldHalfSize);
+   void clear();
+   
+   uint32_t addInstance(ResourceInstance* resource, const slm::mat4& transform, const slm::vec3& boundsMin, const slm::vec3& boundsMax, void* userData=NULL);
+   void removeInstance(uint32_t id);
+   void setTransform(uint32_t id, const slm::mat4& transform);
+   void setObjectBounds(uint32_t id, const slm::vec3& boundsMin, const slm::vec3& boundsMax);
+   
+   inline const slm::vec3& getWorldCenter() const { return mNodes[0].center; }
+   inline float getWorldHalfSize() const { return mNodes[0].halfSize; }
+   inline uint32_t getNumInstances() const { return mNumInstances; }
+   inline uint32_t getNumNodes() const { return (uint32_t)(mNodes.size() - mFreeNodes.size()); }
+   inline bool isValid(uint32_t id) const { return id < mInstances.size() && mInstances[id].node != InvalidIndex; }
+   
+   // Planes are in the same form as InteriorCuller::Frustum, inside is dot(n,p)+d >= 0
+   void findInFrustum(const slm::vec4* planes, uint32_t numPlanes, std::vector<uint32_t>& outIds);
+   void findInSphere(const slm::vec3& center, float radius, std::vector<uint32_t>& outIds);
+   
+   // Finds objects whose bounds are hit by the ray, nearest first.
+   // outDists optionally gets the distance to each hit.
+   void findOnRay(const slm::vec3& start, const slm::vec3& dir, float maxDist, std::vector<uint32_t>& outIds, std::vector<float>* outDists=NULL);
+   
+protected:
+   
+   struct ObjectBounds
+   {
+      slm::vec3 center;
+      uint32_t id;
+      slm::vec3 extent;
+      float pad;
+   };
+   
+   struct Node
+   {
+      slm::vec3 center;
+      float halfSize; // of the cell; the loose bounds are twice this
+      uint32_t depth;
+      uint32_t parent;
+      uint32_t children[8];
+      uint32_t subtreeCount; // objects in this node and below
+      std::vector<ObjectBounds> objects;
+   };
+   
+   // Planes in SoA form, 4 at a time
+   struct PlaneGroup
+   {
+      float x[4];
+      float y[4];
+      float z[4];
+      float w[4];
+      float absX[4];
+      float absY[4];
+      float absZ[4];
+   };
+   
+   enum TestResult
+   {
+      Outside,
+      Intersects,
+      Inside
+   };
+   
+   std::vector<Node> mNodes;
+   std::vector<uint32_t> mFreeNodes;
+   std::vector<uint32_t> mFreeInstances;
+   uint32_t mNumInstances;
+   uint32_t mMaxDepth;
+   
+   struct RayHit
+   {
+      float dist;
+      uint32_t id;
+   };
+   std::vector<RayHit> mRayHits;
+   
+   void updateWorldBounds(Instance& inst);
+   uint32_t findNode(const slm::vec3& center, const slm::vec3& extent);
+   uint32_t allocNode(uint32_t parent, uint32_t octant);
+   void insertIntoNode(uint32_t id, uint32_t nodeIdx);
+   void removeFromNode(uint32_t nodeIdx, uint32_t slot);
+   
+   static TestResult testBox(const PlaneGroup* groups, uint32_t numGroups, const slm::vec3& center, const slm::vec3& extent);
+   static bool testRay(const slm::vec3& start, const slm::vec3& invDir, float maxDist, const slm::vec3& center, const slm::vec3& extent, float& outDist);
+   
+   void frustumVisit(uint32_t nodeIdx, const PlaneGroup* groups, uint32_t numGroups, std::vector<uint32_t>& outIds);
+   void sphereVisit(uint32_t nodeIdx, const slm::vec3& center, float radius, std::vector<uint32_t>& outIds);
+   void rayVisit(uint32_t nodeIdx, const slm::vec3& start, const slm::vec3& invDir, float maxDist);
+   void collectSubtree(uint32_t nodeIdx, std::vector<uint32_t>& outIds);
+};
+
+#endif
@@ -0,0 +1,209 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "shaderPreprocessor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static inline bool isIdentChar(char c)
+{
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static inline const char* skipSpace(const char* ptr, const char* end)
+{
+   while (ptr < end && (*ptr == ' ' || *ptr == '\t'))
+      ptr++;
+   return ptr;
+}
+
+ShaderPreprocessor::ShaderPreprocessor() : mError(NULL), mErrorLine(0)
+{
+}
+
+void ShaderPreprocessor::define(const char* name)
+{
+   if (!isDefined(name, strlen(name)))
+      mDefines.push_back(name);
+}
+
+void ShaderPreprocessor::undefine(const char* name)
+{
+   size_t len = strlen(name);
+   for (size_t i=0; i<mDefines.size(); i++)
+   {
+      if (mDefines[i].size() == len && memcmp(mDefines[i].data(), name, len) == 0)
+      {
+         mDefines.erase(mDefines.begin() + i);
+         return;
+      }
+   }
+}
+
+bool ShaderPreprocessor::isDefined(const char* name, size_t len) const
+{
+   for (const std::string& def : mDefines)
+   {
+      if (def.size() == len && memcmp(def.data(), name, len) == 0)
+         return true;
+   }
+   return false;
+}
+
+bool ShaderPreprocessor::process(const char* source, std::string& outCode)
+{
+   struct Block
+   {
+      bool parentActive;
+      bool taken;    // condition was true
+      bool seenElse;
+   };
+   
+   std::vector<Block> blocks;
+   bool active = true;
+   uint32_t lineNumber = 0;
+   
+   mError = NULL;
+   mErrorLine = 0;
+   outCode.clear();
+   outCode.reserve(strlen(source));
+   
+   const char* ptr = source;
+   while (*ptr)
+   {
+      const char* lineEnd = strchr(ptr, '\n');
+      if (lineEnd == NULL)
+         lineEnd = ptr + strlen(ptr);
+      bool hasNewline = *lineEnd == '\n';
+      lineNumber++;
+      
+      const char* start = skipSpace(ptr, lineEnd);
+      if (start < lineEnd && *start == '#')
+      {
+         const char* word = start + 1;
+         const char* wordEnd = word;
+         while (wordEnd < lineEnd && isIdentChar(*wordEnd))
+            wordEnd++;
+         
+         const char* arg = skipSpace(wordEnd, lineEnd);
+         const char* argEnd = arg;
+         while (argEnd < lineEnd && isIdentChar(*argEnd))
+            argEnd++;
+         
+         std::string directive(word, wordEnd - word);
+         bool needsArg = directive == "define" || directive == "undef" || directive == "ifdef" || directive == "ifndef";
+         
+         if (needsArg && argEnd == arg)
+         {
+            mError = "missing name";
+         }
+         else if (directive == "define" || directive == "undef")
+         {
+            if (active)
+            {
+               std::string name(arg, argEnd - arg);
+               if (directive == "define")
+                  define(name.c_str());
+               else
+                  undefine(name.c_str());
+            }
+         }
+         else if (directive == "ifdef" || directive == "ifndef")
+         {
+            bool cond = isDefined(arg, argEnd - arg) == (directive == "ifdef");
+            blocks.push_back({active, cond, false});
+            active = active && cond;
+         }
+         else if (directive == "else")
+         {
+            if (blocks.empty() || blocks.back().seenElse)
+            {
+               mError = "unexpected #else";
+            }
+            else
+            {
+               blocks.back().seenElse = true;
+               active = blocks.back().parentActive && !blocks.back().taken;
+            }
+         }
+         else if (directive == "endif")
+         {
+            if (blocks.empty())
+            {
+               mError = "unexpected #endif";
+            }
+            else
+            {
+               active = blocks.back().parentActive;
+               blocks.pop_back();
+            }
+         }
+         else
+         {
+            mError = "unknown directive";
+         }
+         
+         if (mError)
+         {
+            mErrorLine = lineNumber;
+            return false;
+         }
+      }
+      else if (active)
+      {
+         outCode.append(ptr, lineEnd - ptr);
+      }
+      
+      if (hasNewline)
+         outCode.push_back('\n');
+      ptr = hasNewline ? lineEnd + 1 : lineEnd;
+   }
+   
+   if (!blocks.empty())
+   {
+      mError = "missing #endif";
+      mErrorLine = lineNumber;
+      return false;
+   }
+   
+   return true;
+}
+
+bool ShaderPreprocessor::buildPermutation(const char* source, uint32_t featureMask, const char* const* featureDefines, uint32_t numFeatures,
+                                          std::string& outCode)
+{
+   ShaderPreprocessor pp;
+   for (uint32_t i=0; i<numFeatures; i++)
+   {
+      if (featureMask & (1U << i))
+         pp.define(featureDefines[i]);
+   }
+   
+   if (!pp.process(source, outCode))
+   {
+      printf("Shader preprocessor: %s on line %u\n", pp.mError, pp.mErrorLine);
+      return false;
+   }
+   
+   return true;
+}
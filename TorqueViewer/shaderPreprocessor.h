@@ -0,0 +1,66 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _SHADERPREPROCESSOR_H_
+#define _SHADERPREPROCESSOR_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ A minimal preprocessor for WGSL, which has no conditional compilation of its own.
+ 
+ Shaders are written with #ifdef blocks around optional features, and a permutation
+ is built for each combination of features that gets used. That way a feature which
+ is off costs nothing, rather than every fragment testing a uniform for it.
+ 
+ Supported directives (which must start their line) are #define NAME, #undef NAME,
+ #ifdef NAME, #ifndef NAME, #else and #endif. Directives and lines in inactive
+ blocks are output as empty lines, so line numbers in shader compiler errors still
+ match the source.
+ */
+class ShaderPreprocessor
+{
+public:
+   
+   std::vector<std::string> mDefines;
+   
+   // Set when process fails
+   const char* mError;
+   uint32_t mErrorLine;
+   
+   ShaderPreprocessor();
+   
+   void define(const char* name);
+   void undefine(const char* name);
+   bool isDefined(const char* name, size_t len) const;
+   
+   // Returns false if a directive is unknown or blocks aren't balanced
+   bool process(const char* source, std::string& outCode);
+   
+   // Processes source with the define from featureDefines for each bit set in featureMask
+   static bool buildPermutation(const char* source, uint32_t featureMask, const char* const* featureDefines, uint32_t numFeatures,
+                                std::string& outCode);
+};
+
+#endif
@@ -0,0 +1,399 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "shapeAnimation.h"
+
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+namespace Dts3
+{
+
+AnimationScheduler::AnimationScheduler() :
+mBudgetMS(1.0f),
+mFullRatePixels(256.0f),
+mFrame(0),
+mFrameTime(0.0f)
+{
+   mStats = {};
+}
+
+AnimationScheduler::~AnimationScheduler()
+{
+   clear();
+}
+
+void AnimationScheduler::clear()
+{
+   mInstances.clear();
+   mFreeInstances.clear();
+   mDue.clear();
+}
+
+int32_t AnimationScheduler::addInstance(Shape* shape)
+{
+   int32_t id;
+   if (!mFreeInstances.empty())
+   {
+      id = mFreeInstances.back();
+      mFreeInstances.pop_back();
+   }
+   else
+   {
+      id = (int32_t)mInstances.size();
+      mInstances.emplace_back();
+   }
+   
+   Instance& inst = mInstances[id];
+   inst.shape = shape;
+   inst.sequence = -1;
+   inst.pos = 0.0f;
+   inst.timeScale = 1.0f;
+   inst.detailLevel = -1;
+   inst.pixelSize = 0.0f;
+   inst.firstNode = 0;
+   inst.numNodes = 0;
+   inst.interval = 1;
+   inst.lastSampleFrame = mFrame;
+   inst.builtFrame = UINT32_MAX;
+   inst.blendTime = 0.0f;
+   inst.blendDuration = 0.0f;
+   inst.active = true;
+   inst.dirty = true;
+   
+   // Everything starts in the default pose
+   uint32_t numNodes = (uint32_t)shape->mNodes.size();
+   inst.curRots.resize(numNodes);
+   inst.curTrans.resize(numNodes);
+   inst.transforms.resize(numNodes);
+   sampleNodes(*shape, -1, 0.0f, 0, numNodes, inst.curRots.data(), inst.curTrans.data());
+   buildTransforms(*shape, inst.curRots.data(), inst.curTrans.data(), 0, numNodes, inst.transforms.data());
+   
+   updateRange(inst);
+   return id;
+}
+
+void AnimationScheduler::removeInstance(int32_t id)
+{
+   if (id < 0 || id >= (int32_t)mInstances.size() || !mInstances[id].active)
+      return;
+   
+   Instance& inst = mInstances[id];
+   inst = Instance();
+   inst.active = false;
+   mFreeInstances.push_back(id);
+}
+
+void AnimationScheduler::setSequence(int32_t id, int32_t seqIdx, float pos, float timeScale)
+{
+   Instance& inst = mInstances[id];
+   inst.sequence = (seqIdx >= 0 && seqIdx < (int32_t)inst.shape->mSequences.size()) ? seqIdx : -1;
+   inst.pos = pos;
+   inst.timeScale = timeScale;
+   inst.dirty = true;
+}
+
+void AnimationScheduler::setDetail(int32_t id, int32_t detailLevel, float pixelSize)
+{
+   Instance& inst = mInstances[id];
+   inst.pixelSize = pixelSize;
+   if (inst.detailLevel != detailLevel)
+   {
+      inst.detailLevel = detailLevel;
+      updateRange(inst);
+   }
+}
+
+// Picks the node range from the subshape of the current detail level
+void AnimationScheduler::updateRange(Instance& inst)
+{
+   const Shape& shape = *inst.shape;
+   uint32_t firstNode = 0;
+   uint32_t numNodes = (uint32_t)shape.mNodes.size();
+   
+   if (inst.detailLevel >= 0 && inst.detailLevel < (int32_t)shape.mDetailLevels.size())
+   {
+      int32_t subshape = shape.mDetailLevels[inst.detailLevel].subshape;
+      if (subshape >= 0 && subshape < (int32_t)shape.mSubshapes.size())
+      {
+         const SubShape& ss = shape.mSubshapes[subshape];
+         firstNode = std::min<uint32_t>(ss.firstNode, numNodes);
+         numNodes = std::min<uint32_t>(ss.numNodes, numNodes - firstNode);
+      }
+   }
+   
+   if (firstNode == inst.firstNode && numNodes == inst.numNodes && !inst.fromRots.empty())
+      return;
+   
+   inst.firstNode = firstNode;
+   inst.numNodes = numNodes;
+   inst.fromRots.resize(numNodes);
+   inst.toRots.resize(numNodes);
+   inst.fromTrans.resize(numNodes);
+   inst.toTrans.resize(numNodes);
+   inst.dirty = true;
+}
+
+float AnimationScheduler::advancePos(const Shape& shape, int32_t seqIdx, float pos, float dt)
+{
+   if (seqIdx < 0)
+      return pos;
+   
+   const Sequence& seq = shape.mSequences[seqIdx];
+   if (seq.duration <= 0.0f)
+      return pos;
+   
+   pos += dt / seq.duration;
+   if (seq.testFlags(Sequence::Cyclic))
+      return pos - floorf(pos);
+   return std::min(std::max(pos, 0.0f), 1.0f);
+}
+
+void AnimationScheduler::sampleNodes(const Shape& shape, int32_t seqIdx, float pos, uint32_t firstNode, uint32_t numNodes,
+                                     slm::quat* outRots, slm::vec3* outTrans)
+{
+   for (uint32_t i=0; i<numNodes; i++)
+   {
+      uint32_t node = firstNode + i;
+      outRots[i] = node < shape.mDefaultRotations.size() ? shape.mDefaultRotations[node].toQuat() : slm::quat(0, 0, 0, 1);
+      outTrans[i] = node < shape.mDefaultTranslations.size() ? shape.mDefaultTranslations[node] : slm::vec3(0);
+   }
+   
+   if (seqIdx < 0 || seqIdx >= (int32_t)shape.mSequences.size())
+      return;
+   
+   const Sequence& seq = shape.mSequences[seqIdx];
+   int32_t numKeys = seq.numKeyFrames;
+   if (numKeys <= 0)
+      return;
+   
+   // Same keyframe selection as Torque; cyclic sequences wrap back to the first key
+   bool cyclic = seq.testFlags(Sequence::Cyclic);
+   float keyPos = pos * (float)(cyclic ? numKeys : numKeys - 1);
+   int32_t keyA = std::min(std::max((int32_t)keyPos, 0), numKeys - 1);
+   int32_t keyB = cyclic ? (keyA + 1) % numKeys : std::min(keyA + 1, numKeys - 1);
+   float t = std::min(std::max(keyPos - (float)keyA, 0.0f), 1.0f);
+   
+   uint32_t endNode = firstNode + numNodes;
+   
+   // Channels follow the same order as the keyframes they replace
+   const KeyframeCurves* curves = shape.mKeyframeCurves;
+   if (curves)
+   {
+      const KeyframeCurves::SequenceCurves& seqCurves = curves->mSequences[seqIdx];
+      
+      uint32_t matter = 0;
+      for (std::ptrdiff_t j = seq.mattersRot.findFirst(); j >= 0 && (uint32_t)j < endNode; j = seq.mattersRot.findNext(j+1), matter++)
+      {
+         if ((uint32_t)j >= firstNode)
+            outRots[j - firstNode] = curves->sampleRot(seqCurves.firstRot + matter, keyPos);
+      }
+      
+      matter = 0;
+      for (std::ptrdiff_t j = seq.mattersTranslation.findFirst(); j >= 0 && (uint32_t)j < endNode; j = seq.mattersTranslation.findNext(j+1), matter++)
+      {
+         if ((uint32_t)j >= firstNode)
+            outTrans[j - firstNode] = curves->sampleTrans(seqCurves.firstTrans + matter, keyPos);
+      }
+      return;
+   }
+   
+   // Keyframes are stored per animated node, in node order
+   uint32_t matter = 0;
+   for (std::ptrdiff_t j = seq.mattersRot.findFirst(); j >= 0 && (uint32_t)j < endNode; j = seq.mattersRot.findNext(j+1), matter++)
+   {
+      size_t base = (size_t)seq.baseRot + ((size_t)matter * numKeys);
+      if (seq.baseRot < 0 || base + numKeys > shape.mNodeRotations.size())
+         break;
+      if ((uint32_t)j < firstNode)
+         continue;
+      
+      outRots[j - firstNode] = CompatInterpolate(shape.mNodeRotations[base + keyA].toQuat(),
+                                                 shape.mNodeRotations[base + keyB].toQuat(), t);
+   }
+   
+   matter = 0;
+   for (std::ptrdiff_t j = seq.mattersTranslation.findFirst(); j >= 0 && (uint32_t)j < endNode; j = seq.mattersTranslation.findNext(j+1), matter++)
+   {
+      size_t base = (size_t)seq.baseTrans + ((size_t)matter * numKeys);
+      if (seq.baseTrans < 0 || base + numKeys > shape.mNodeTranslations.size())
+         break;
+      if ((uint32_t)j < firstNode)
+         continue;
+      
+      const slm::vec3& a = shape.mNodeTranslations[base + keyA];
+      const slm::vec3& b = shape.mNodeTranslations[base + keyB];
+      outTrans[j - firstNode] = a + ((b - a) * t);
+   }
+}
+
+void AnimationScheduler::buildTransforms(const Shape& shape, const slm::quat* rots, const slm::vec3* trans,
+                                         uint32_t firstNode, uint32_t numNodes, slm::mat4* outTransforms)
+{
+   for (uint32_t i=0; i<numNodes; i++)
+   {
+      uint32_t node = firstNode + i;
+      slm::mat4 local;
+      CompatQuatSetMatrix(rots[i], local);
+      local[3] = slm::vec4(trans[i], 1.0f);
+      
+      int32_t parent = shape.mNodes[node].parent;
+      outTransforms[node] = parent >= 0 ? outTransforms[parent] * local : local;
+   }
+}
+
+// Interpolates the pose between the last and next samples into curRots & curTrans
+void AnimationScheduler::blendPose(Instance& inst)
+{
+   float t = inst.blendDuration > 0.0f ? std::min(inst.blendTime / inst.blendDuration, 1.0f) : 1.0f;
+   
+   for (uint32_t i=0; i<inst.numNodes; i++)
+   {
+      const slm::quat& a = inst.fromRots[i];
+      slm::quat b = inst.toRots[i];
+      if ((a.x * b.x) + (a.y * b.y) + (a.z * b.z) + (a.w * b.w) < 0.0f)
+         b = slm::quat(-b.x, -b.y, -b.z, -b.w);
+      
+      // nlerp is plenty for the small steps between samples
+      slm::quat q((a.x * (1.0f - t)) + (b.x * t),
+                  (a.y * (1.0f - t)) + (b.y * t),
+                  (a.z * (1.0f - t)) + (b.z * t),
+                  (a.w * (1.0f - t)) + (b.w * t));
+      float len = sqrtf((q.x * q.x) + (q.y * q.y) + (q.z * q.z) + (q.w * q.w));
+      float invLen = len > 0.0f ? 1.0f / len : 0.0f;
+      
+      inst.curRots[inst.firstNode + i] = slm::quat(q.x * invLen, q.y * invLen, q.z * invLen, q.w * invLen);
+      inst.curTrans[inst.firstNode + i] = inst.fromTrans[i] + ((inst.toTrans[i] - inst.fromTrans[i]) * t);
+   }
+}
+
+void AnimationScheduler::sampleInstance(Instance& inst)
+{
+   if (inst.dirty)
+   {
+      sampleNodes(*inst.shape, inst.sequence, inst.pos, inst.firstNode, inst.numNodes, inst.toRots.data(), inst.toTrans.data());
+      inst.fromRots = inst.toRots;
+      inst.fromTrans = inst.toTrans;
+      inst.blendDuration = 0.0f;
+      inst.dirty = false;
+   }
+   else
+   {
+      // Head from what's currently shown towards where we'll be at the next sample
+      blendPose(inst);
+      std::copy(inst.curRots.begin() + inst.firstNode, inst.curRots.begin() + inst.firstNode + inst.numNodes, inst.fromRots.begin());
+      std::copy(inst.curTrans.begin() + inst.firstNode, inst.curTrans.begin() + inst.firstNode + inst.numNodes, inst.fromTrans.begin());
+      
+      inst.blendDuration = (float)inst.interval * mFrameTime;
+      float nextPos = advancePos(*inst.shape, inst.sequence, inst.pos, inst.blendDuration * inst.timeScale);
+      sampleNodes(*inst.shape, inst.sequence, nextPos, inst.firstNode, inst.numNodes, inst.toRots.data(), inst.toTrans.data());
+   }
+   
+   inst.blendTime = 0.0f;
+   inst.builtFrame = UINT32_MAX;
+   mStats.nodesSampled += inst.numNodes;
+}
+
+void AnimationScheduler::update(float dt)
+{
+   mFrame++;
+   mFrameTime = mFrameTime > 0.0f ? (mFrameTime * 0.9f) + (dt * 0.1f) : dt;
+   mStats = {};
+   mDue.clear();
+   
+   for (uint32_t i=0; i<mInstances.size(); i++)
+   {
+      Instance& inst = mInstances[i];
+      if (!inst.active)
+         continue;
+      
+      mStats.numInstances++;
+      inst.pos = advancePos(*inst.shape, inst.sequence, inst.pos, dt * inst.timeScale);
+      inst.blendTime += dt;
+      
+      // Halve the rate each time the instance halves in size
+      inst.interval = 1;
+      if (inst.pixelSize <= 0.0f)
+      {
+         inst.interval = MaxInterval;
+      }
+      else
+      {
+         float ratio = mFullRatePixels / inst.pixelSize;
+         while ((float)inst.interval < ratio && inst.interval < MaxInterval)
+            inst.interval <<= 1;
+      }
+      
+      if (inst.dirty || (inst.sequence >= 0 && mFrame - inst.lastSampleFrame >= inst.interval))
+         mDue.push_back(i);
+   }
+   
+   // New poses first, then the most overdue, then the largest
+   std::sort(mDue.begin(), mDue.end(), [this](int32_t a, int32_t b) {
+      const Instance& ia = mInstances[a];
+      const Instance& ib = mInstances[b];
+      if (ia.dirty != ib.dirty)
+         return ia.dirty;
+      float lateA = (float)(mFrame - ia.lastSampleFrame) / (float)ia.interval;
+      float lateB = (float)(mFrame - ib.lastSampleFrame) / (float)ib.interval;
+      if (lateA != lateB)
+         return lateA > lateB;
+      return ia.pixelSize > ib.pixelSize;
+   });
+   
+   auto startTime = std::chrono::steady_clock::now();
+   for (uint32_t i=0; i<mDue.size(); i++)
+   {
+      if (i > 0 && std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count() >= mBudgetMS)
+      {
+         mStats.deferred = (uint32_t)(mDue.size() - i);
+         break;
+      }
+      
+      Instance& inst = mInstances[mDue[i]];
+      bool wasDirty = inst.dirty;
+      sampleInstance(inst);
+      
+      // Spread new instances over the frames of their interval so they don't come due together
+      inst.lastSampleFrame = wasDirty ? mFrame - (mDue[i] % inst.interval) : mFrame;
+      mStats.sampled++;
+   }
+   
+   mStats.sampleMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+const std::vector<slm::mat4>& AnimationScheduler::getNodeTransforms(int32_t id)
+{
+   Instance& inst = mInstances[id];
+   if (inst.builtFrame != mFrame && !inst.dirty)
+   {
+      blendPose(inst);
+      buildTransforms(*inst.shape, inst.curRots.data() + inst.firstNode, inst.curTrans.data() + inst.firstNode,
+                      inst.firstNode, inst.numNodes, inst.transforms.data());
+      inst.builtFrame = mFrame;
+   }
+   
+   return inst.transforms;
+}
+
+}
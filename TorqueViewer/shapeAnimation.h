@@ -0,0 +1,155 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _SHAPEANIMATION_H_
+#define _SHAPEANIMATION_H_
+
+#include "shapeData.h"
+
+#include <stdint.h>
+#include <vector>
+
+/*
+ Node animation for many shape instances with a bounded cost per frame.
+ 
+ Sampling a sequence (decoding and slerping keyframes for every animated node)
+ is the expensive part, so rather than doing it for every instance every frame
+ each instance gets an update interval based on its size on screen: full size
+ instances are sampled every frame, and smaller ones every 2, 4 or 8 frames.
+ Instances are staggered so they don't all come due on the same frame.
+ 
+ When an instance is sampled, the pose it will have at its next sample is
+ evaluated and the frames in between are interpolated from the pose currently
+ shown, so reduced rates don't lag behind or pop. Sampling stops for the frame
+ once mBudgetMS is used up; anything left over stays due and goes first next
+ time, so the cost stays bounded however many instances there are.
+ 
+ Only the nodes in the subshape of the instance's detail level are animated,
+ as in Torque; everything else keeps its default transform. Scale keyframes
+ aren't applied.
+ */
+namespace Dts3
+{
+
+class AnimationScheduler
+{
+public:
+   
+   enum
+   {
+      MaxInterval = 8
+   };
+   
+   struct Stats
+   {
+      uint32_t numInstances;
+      uint32_t sampled;       // instances sampled this update
+      uint32_t deferred;      // due but left for a later update
+      uint32_t nodesSampled;
+      float sampleMS;
+   };
+   
+   float mBudgetMS;        // time allowed for sampling per update
+   float mFullRatePixels;  // instances at least this tall on screen are sampled every frame
+   Stats mStats;
+   
+   AnimationScheduler();
+   ~AnimationScheduler();
+   
+   int32_t addInstance(Shape* shape);
+   void removeInstance(int32_t id);
+   
+   // seqIdx < 0 holds the default pose
+   void setSequence(int32_t id, int32_t seqIdx, float pos=0.0f, float timeScale=1.0f);
+   
+   // pixelSize is the instance's current height on screen; 0 if it isn't visible
+   void setDetail(int32_t id, int32_t detailLevel, float pixelSize);
+   
+   void update(float dt);
+   
+   // Node transforms for the current frame, built on first use
+   const std::vector<slm::mat4>& getNodeTransforms(int32_t id);
+   
+   inline int32_t getSequence(int32_t id) const { return mInstances[id].sequence; }
+   inline float getPos(int32_t id) const { return mInstances[id].pos; }
+   inline uint32_t getInterval(int32_t id) const { return mInstances[id].interval; }
+   // Updates since the instance was last sampled
+   inline uint32_t getSampleAge(int32_t id) const { return mFrame - mInstances[id].lastSampleFrame; }
+   
+   void clear();
+   
+   // Evaluates seqIdx at pos for nodes [firstNode, firstNode+numNodes). Nodes the
+   // sequence doesn't animate get their default transform. Uses Shape::mKeyframeCurves if present.
+   static void sampleNodes(const Shape& shape, int32_t seqIdx, float pos, uint32_t firstNode, uint32_t numNodes,
+                           slm::quat* outRots, slm::vec3* outTrans);
+   
+   // Composes local transforms for [firstNode, firstNode+numNodes) into outTransforms.
+   // Parents must come before their children, which is how Torque stores them.
+   static void buildTransforms(const Shape& shape, const slm::quat* rots, const slm::vec3* trans,
+                               uint32_t firstNode, uint32_t numNodes, slm::mat4* outTransforms);
+   
+protected:
+   
+   struct Instance
+   {
+      Shape* shape;
+      int32_t sequence;
+      float pos;
+      float timeScale;
+      int32_t detailLevel;
+      float pixelSize;
+      uint32_t firstNode;
+      uint32_t numNodes;
+      uint32_t interval;
+      uint32_t lastSampleFrame;
+      uint32_t builtFrame;
+      float blendTime;
+      float blendDuration;
+      bool active;
+      bool dirty; // needs sampling before it can be shown
+      
+      // Indexed from firstNode
+      std::vector<slm::quat> fromRots;
+      std::vector<slm::quat> toRots;
+      std::vector<slm::vec3> fromTrans;
+      std::vector<slm::vec3> toTrans;
+      std::vector<slm::quat> curRots;
+      std::vector<slm::vec3> curTrans;
+      
+      std::vector<slm::mat4> transforms; // all nodes
+   };
+   
+   std::vector<Instance> mInstances;
+   std::vector<int32_t> mFreeInstances;
+   std::vector<int32_t> mDue;
+   uint32_t mFrame;
+   float mFrameTime; // smoothed dt, used to look ahead to the next sample
+   
+   static float advancePos(const Shape& shape, int32_t seqIdx, float pos, float dt);
+   void updateRange(Instance& inst);
+   void blendPose(Instance& inst);
+   void sampleInstance(Instance& inst);
+};
+
+}
+
+#endif
@@ -1,6 +1,8 @@
 #include "CommonData.h"
 #include "shapeData.h"
 
+#include <chrono>
+
 namespace Dts3
 {
 
@@ -52,7 +54,572 @@ bool Shape::read(MemRStream& stream)
 {
    SplitStream split;
    split.floodFromStream(stream);
-   return IO::readShape(this, split);
+   bool ret = IO::readShape(this, split);
+   updateMemoryTracking();
+   return ret;
+}
+
+bool Shape::peekHeader(MemRStream& header)
+{
+   // SplitStream::floodFromStream asserts on anything older
+   uint32_t hdr[4];
+   return header.read(sizeof(hdr), hdr) && (hdr[0] & 0xFF) >= 19;
+}
+
+static size_t calcMeshDataUsage(const Mesh& mesh)
+{
+   size_t total = 0;
+   
+   if (mesh.getDecalData())
+   {
+      DecalData* dd = mesh.getDecalData();
+      total += sizeof(DecalData);
+      total += MemTracker::vectorBytes(dd->primitives);
+      total += MemTracker::vectorBytes(dd->indices);
+      total += MemTracker::vectorBytes(dd->startPrimitive);
+      total += MemTracker::vectorBytes(dd->texGenS);
+      total += MemTracker::vectorBytes(dd->texGenT);
+      return total;
+   }
+   
+   BasicData* bd = mesh.getBasicData();
+   if (bd == NULL)
+      return 0;
+   
+   // Vertex data may be aliased by child meshes, so is split between them
+   total += bd->verts.sharedBytes();
+   total += bd->tverts.sharedBytes();
+   total += bd->normals.sharedBytes();
+   total += bd->enormals.sharedBytes();
+   total += MemTracker::vectorBytes(bd->primitives);
+   total += MemTracker::vectorBytes(bd->indices);
+   total += MemTracker::vectorBytes(bd->mergeIndices);
+   
+   if (mesh.getSkinData())
+   {
+      SkinData* sd = mesh.getSkinData();
+      total += sizeof(SkinData);
+      total += sd->vindex.sharedBytes();
+      total += sd->bindex.sharedBytes();
+      total += sd->vweight.sharedBytes();
+      total += sd->nodeIndex.sharedBytes();
+      total += sd->nodeTransforms.sharedBytes();
+   }
+   else if (mesh.getSortedData())
+   {
+      SortedData* sd = mesh.getSortedData();
+      total += sizeof(SortedData);
+      total += MemTracker::vectorBytes(sd->clusters);
+      total += MemTracker::vectorBytes(sd->startCluster);
+      total += MemTracker::vectorBytes(sd->firstVerts);
+      total += MemTracker::vectorBytes(sd->numVerts);
+      total += MemTracker::vectorBytes(sd->firstTVerts);
+   }
+   else
+   {
+      total += sizeof(BasicData);
+   }
+   
+   return total;
+}
+
+size_t Shape::calcMemoryUsage(size_t& outIntegerSetBytes) const
+{
+   size_t total = 0;
+   
+   for (const Mesh& mesh : mMeshes)
+   {
+      total += calcMeshDataUsage(mesh);
+   }
+   
+   // IntegerSet words live in their own allocations, apart from the sequence array
+   outIntegerSetBytes = 0;
+   for (const Sequence& seq : mSequences)
+   {
+      outIntegerSetBytes += seq.mattersRot.getHeapBytes() + seq.mattersTranslation.getHeapBytes() +
+                            seq.mattersScale.getHeapBytes() + seq.mattersDecal.getHeapBytes() +
+                            seq.mattersIfl.getHeapBytes() + seq.mattersVis.getHeapBytes() +
+                            seq.mattersFrame.getHeapBytes() + seq.mattersMatframe.getHeapBytes();
+   }
+   total += MemTracker::vectorBytes(mSequences);
+   
+   total += MemTracker::vectorBytes(mMeshes);
+   total += MemTracker::vectorBytes(mNodes);
+   total += MemTracker::vectorBytes(mTriggers);
+   total += MemTracker::vectorBytes(mObjects);
+   total += MemTracker::vectorBytes(mObjectStates);
+   total += MemTracker::vectorBytes(mIflMaterials);
+   total += MemTracker::vectorBytes(mSubshapes);
+   total += MemTracker::vectorBytes(mDetailLevels);
+   total += MemTracker::vectorBytes(mDecals);
+   total += MemTracker::vectorBytes(mDecalStates);
+   total += MemTracker::vectorBytes(mDefaultRotations);
+   total += MemTracker::vectorBytes(mDefaultTranslations);
+   total += MemTracker::vectorBytes(mNodeTranslations);
+   total += MemTracker::vectorBytes(mNodeRotations);
+   total += MemTracker::vectorBytes(mNodeUniformScales);
+   total += MemTracker::vectorBytes(mNodeAlignedScales);
+   total += MemTracker::vectorBytes(mNodeArbitraryScaleFactors);
+   total += MemTracker::vectorBytes(mNodeArbitraryScaleRotations);
+   total += MemTracker::vectorBytes(mGroundTranslations);
+   total += MemTracker::vectorBytes(mGroundRotations);
+   total += MemTracker::vectorBytes(mAlphaIn);
+   total += MemTracker::vectorBytes(mAlphaOut);
+   total += MemTracker::vectorBytes(mPreviousMerge);
+   total += MemTracker::vectorBytes(mMaterials.mMaterials);
+   
+   if (mKeyframeCurves)
+      total += sizeof(KeyframeCurves) + mKeyframeCurves->getDataSize();
+   
+   return total;
+}
+
+void Shape::updateMemoryTracking()
+{
+   size_t integerSetBytes = 0;
+   size_t shapeBytes = calcMemoryUsage(integerSetBytes);
+   
+   MemTracker::trackResize(MemCategory_Shape, mTrackedShapeBytes, shapeBytes);
+   MemTracker::trackResize(MemCategory_IntegerSet, mTrackedIntegerSetBytes, integerSetBytes);
+   mTrackedShapeBytes = shapeBytes;
+   mTrackedIntegerSetBytes = integerSetBytes;
+}
+
+bool Shape::compressKeyframes(float rotTolerance, float transTolerance, KeyframeCurves::Report& outReport)
+{
+   if (mKeyframeCurves)
+      return false;
+   
+   KeyframeCurves* curves = new KeyframeCurves();
+   if (!curves->build(*this, rotTolerance, transTolerance, outReport))
+   {
+      delete curves;
+      return false;
+   }
+   
+   mKeyframeCurves = curves;
+   std::vector<Quat16>().swap(mNodeRotations);
+   std::vector<slm::vec3>().swap(mNodeTranslations);
+   updateMemoryTracking();
+   return true;
+}
+
+DeltaFrames::DeltaFrames() :
+mVertsPerFrame(0), mNumFrames(0), mPositionBits(0), mMaxError(0.0f)
+{
+}
+
+bool DeltaFrames::encode(const slm::vec3* verts, const slm::vec3* normals, uint32_t vertsPerFrame, uint32_t numFrames, float maxError)
+{
+   if (vertsPerFrame == 0 || numFrames == 0)
+      return false;
+   
+   const uint32_t numDeltaVerts = vertsPerFrame * (numFrames-1);
+   
+   // Delta range of each frame decides its step size
+   std::vector<FrameRange> ranges(numFrames-1);
+   float maxStep = 0.0f;
+   for (uint32_t f=1; f<numFrames; f++)
+   {
+      const slm::vec3* frameVerts = verts + (f * vertsPerFrame);
+      slm::vec3 minDelta(FLT_MAX);
+      slm::vec3 maxDelta(-FLT_MAX);
+      for (uint32_t i=0; i<vertsPerFrame; i++)
+      {
+         slm::vec3 delta = frameVerts[i] - verts[i];
+         minDelta = slm::min(minDelta, delta);
+         maxDelta = slm::max(maxDelta, delta);
+      }
+      
+      FrameRange& range = ranges[f-1];
+      range.min = minDelta;
+      range.step = maxDelta - minDelta;
+      maxStep = std::max(maxStep, std::max(range.step.x, std::max(range.step.y, range.step.z)));
+   }
+   
+   // Rounding means the error is at most half a step
+   uint32_t positionBits = 0;
+   if ((maxStep / 255.0f) * 0.5f <= maxError)
+      positionBits = 8;
+   else if ((maxStep / 65535.0f) * 0.5f <= maxError)
+      positionBits = 16;
+   else
+      return false;
+   
+   const float maxQ = positionBits == 8 ? 255.0f : 65535.0f;
+   for (FrameRange& range : ranges)
+   {
+      range.step /= maxQ;
+   }
+   
+   mVertsPerFrame = vertsPerFrame;
+   mNumFrames = numFrames;
+   mPositionBits = positionBits;
+   mMaxError = (maxStep / maxQ) * 0.5f;
+   mRanges = ranges;
+   
+   mBaseFrame.resize(vertsPerFrame);
+   for (uint32_t i=0; i<vertsPerFrame; i++)
+   {
+      mBaseFrame[i].position = verts[i];
+      mBaseFrame[i].normal = normals[i];
+   }
+   
+   mPositions8.clear();
+   mPositions16.clear();
+   if (positionBits == 8)
+      mPositions8.resize(numDeltaVerts * 3);
+   else
+      mPositions16.resize(numDeltaVerts * 3);
+   mNormals.resize(numDeltaVerts * 3);
+   
+   for (uint32_t f=1; f<numFrames; f++)
+   {
+      const FrameRange& range = mRanges[f-1];
+      const slm::vec3* frameVerts = verts + (f * vertsPerFrame);
+      const slm::vec3* frameNormals = normals + (f * vertsPerFrame);
+      const uint32_t frameStart = (f-1) * vertsPerFrame * 3;
+      
+      for (uint32_t i=0; i<vertsPerFrame; i++)
+      {
+         slm::vec3 delta = frameVerts[i] - verts[i];
+         for (uint32_t c=0; c<3; c++)
+         {
+            float q = range.step[c] > 0.0f ? ((delta[c] - range.min[c]) / range.step[c]) + 0.5f : 0.0f;
+            q = std::min(std::max(q, 0.0f), maxQ);
+            
+            if (positionBits == 8)
+               mPositions8[frameStart + (i*3) + c] = (uint8_t)q;
+            else
+               mPositions16[frameStart + (i*3) + c] = (uint16_t)q;
+            
+            float n = std::min(std::max(frameNormals[i][c], -1.0f), 1.0f);
+            mNormals[frameStart + (i*3) + c] = (int8_t)std::lround(n * 127.0f);
+         }
+      }
+   }
+   
+   return true;
+}
+
+void DeltaFrames::decodeFrame(uint32_t frame, ModelVertex* outVerts) const
+{
+   if (frame == 0 || frame >= mNumFrames)
+   {
+      memcpy(outVerts, &mBaseFrame[0], sizeof(ModelVertex) * mVertsPerFrame);
+      return;
+   }
+   
+   const FrameRange& range = mRanges[frame-1];
+   const uint32_t frameStart = (frame-1) * mVertsPerFrame * 3;
+   const int8_t* normals = &mNormals[frameStart];
+   const float normalScale = 1.0f / 127.0f;
+   
+   if (mPositionBits == 8)
+   {
+      const uint8_t* positions = &mPositions8[frameStart];
+      for (uint32_t i=0; i<mVertsPerFrame; i++)
+      {
+         const uint8_t* q = positions + (i*3);
+         const int8_t* n = normals + (i*3);
+         outVerts[i].position = mBaseFrame[i].position + range.min + (slm::vec3(q[0], q[1], q[2]) * range.step);
+         outVerts[i].normal = slm::vec3(n[0], n[1], n[2]) * normalScale;
+      }
+   }
+   else
+   {
+      const uint16_t* positions = &mPositions16[frameStart];
+      for (uint32_t i=0; i<mVertsPerFrame; i++)
+      {
+         const uint16_t* q = positions + (i*3);
+         const int8_t* n = normals + (i*3);
+         outVerts[i].position = mBaseFrame[i].position + range.min + (slm::vec3(q[0], q[1], q[2]) * range.step);
+         outVerts[i].normal = slm::vec3(n[0], n[1], n[2]) * normalScale;
+      }
+   }
+}
+
+size_t DeltaFrames::getDataSize() const
+{
+   return MemTracker::vectorBytes(mBaseFrame) +
+          MemTracker::vectorBytes(mRanges) +
+          MemTracker::vectorBytes(mPositions8) +
+          MemTracker::vectorBytes(mPositions16) +
+          MemTracker::vectorBytes(mNormals);
+}
+
+// Rotations are compared by the angle between them
+static inline float keyError(const slm::quat& a, const slm::quat& b)
+{
+   float lenSq = ((a.x * a.x) + (a.y * a.y) + (a.z * a.z) + (a.w * a.w)) *
+                 ((b.x * b.x) + (b.y * b.y) + (b.z * b.z) + (b.w * b.w));
+   if (lenSq <= 0.0f)
+      return 0.0f;
+   float d = fabsf((a.x * b.x) + (a.y * b.y) + (a.z * b.z) + (a.w * b.w)) / sqrtf(lenSq);
+   return 2.0f * acosf(std::min(d, 1.0f));
+}
+
+static inline float keyError(const slm::vec3& a, const slm::vec3& b)
+{
+   return slm::length(a - b);
+}
+
+static inline slm::quat keyLerp(const slm::quat& a, const slm::quat& b, float t)
+{
+   return CompatInterpolate(a, b, t);
+}
+
+static inline slm::vec3 keyLerp(const slm::vec3& a, const slm::vec3& b, float t)
+{
+   return a + ((b - a) * t);
+}
+
+// Checks every frame between start & end can be made by interpolating them
+template<class T> static bool keySpanFits(const T* values, uint32_t start, uint32_t end, float tolerance)
+{
+   float invSpan = 1.0f / (float)(end - start);
+   for (uint32_t f=start+1; f<end; f++)
+   {
+      if (keyError(keyLerp(values[start], values[end], (float)(f - start) * invSpan), values[f]) > tolerance)
+         return false;
+   }
+   return true;
+}
+
+// Picks the frames to keep. Spans are grown greedily from each kept frame.
+template<class T> static void reduceKeys(const T* values, uint32_t numFrames, float tolerance, std::vector<uint16_t>& outFrames)
+{
+   outFrames.clear();
+   outFrames.push_back(0);
+   
+   bool constant = true;
+   for (uint32_t f=1; f<numFrames; f++)
+   {
+      if (keyError(values[0], values[f]) > tolerance)
+      {
+         constant = false;
+         break;
+      }
+   }
+   if (constant)
+      return;
+   
+   uint32_t start = 0;
+   while (start < numFrames - 1)
+   {
+      uint32_t end = start + 1;
+      while (end + 1 < numFrames && keySpanFits(values, start, end + 1, tolerance))
+         end++;
+      outFrames.push_back((uint16_t)end);
+      start = end;
+   }
+}
+
+// Adds a channel for the kept frames of src (numFrames long)
+template<class K> static void addKeyChannel(const K* src, uint32_t numFrames, const std::vector<uint16_t>& frames,
+                                            std::vector<KeyframeCurves::Channel>& channels, std::vector<K>& keys,
+                                            std::vector<uint16_t>& keyFrames, KeyframeCurves::Report& report)
+{
+   KeyframeCurves::Channel ch;
+   ch.firstKey = (uint32_t)keys.size();
+   ch.firstFrame = KeyframeCurves::FullRate;
+   ch.numKeys = (uint32_t)frames.size();
+   
+   if (frames.size() == 1)
+   {
+      report.numConstant++;
+   }
+   else if (frames.size() == numFrames)
+   {
+      report.numFullRate++;
+   }
+   else
+   {
+      ch.firstFrame = (uint32_t)keyFrames.size();
+      keyFrames.insert(keyFrames.end(), frames.begin(), frames.end());
+      report.numVariable++;
+   }
+   
+   for (uint16_t frame : frames)
+      keys.push_back(src[frame]);
+   
+   channels.push_back(ch);
+}
+
+bool KeyframeCurves::build(const Shape& shape, float rotTolerance, float transTolerance, Report& outReport)
+{
+   auto startTime = std::chrono::steady_clock::now();
+   
+   mSequences.clear();
+   mRotChannels.clear();
+   mTransChannels.clear();
+   mRotKeys.clear();
+   mTransKeys.clear();
+   mKeyFrames.clear();
+   
+   outReport = Report();
+   outReport.sequences.resize(shape.mSequences.size());
+   
+   std::vector<Quat16> srcRots;
+   std::vector<slm::vec3> srcTrans;
+   std::vector<slm::quat> rots;
+   std::vector<uint16_t> frames;
+   
+   for (size_t i=0; i<shape.mSequences.size(); i++)
+   {
+      const Sequence& seq = shape.mSequences[i];
+      SequenceReport& seqReport = outReport.sequences[i];
+      seqReport = {};
+      seqReport.bytes = sizeof(SequenceCurves);
+      
+      SequenceCurves curves;
+      curves.firstRot = (uint32_t)mRotChannels.size();
+      curves.firstTrans = (uint32_t)mTransChannels.size();
+      curves.numFrames = 0;
+      
+      uint32_t numKeys = seq.numKeyFrames > 0 ? (uint32_t)seq.numKeyFrames : 0;
+      bool cyclic = seq.testFlags(Sequence::Cyclic);
+      if (numKeys == 0)
+      {
+         mSequences.push_back(curves);
+         continue;
+      }
+      
+      uint32_t numFrames = numKeys + (cyclic ? 1 : 0);
+      if (numFrames > MaxFrames)
+         return false;
+      curves.numFrames = numFrames;
+      
+      srcRots.resize(numFrames);
+      rots.resize(numFrames);
+      srcTrans.resize(numFrames);
+      
+      uint32_t matter = 0;
+      for (std::ptrdiff_t j = seq.mattersRot.findFirst(); j >= 0; j = seq.mattersRot.findNext(j+1), matter++)
+      {
+         size_t base = (size_t)seq.baseRot + ((size_t)matter * numKeys);
+         if (seq.baseRot < 0 || base + numKeys > shape.mNodeRotations.size())
+            return false;
+         
+         for (uint32_t f=0; f<numFrames; f++)
+         {
+            srcRots[f] = shape.mNodeRotations[base + (f % numKeys)];
+            rots[f] = srcRots[f].toQuat();
+         }
+         
+         reduceKeys(rots.data(), numFrames, rotTolerance, frames);
+         addKeyChannel(srcRots.data(), numFrames, frames, mRotChannels, mRotKeys, mKeyFrames, outReport);
+         
+         uint32_t channel = (uint32_t)mRotChannels.size() - 1;
+         for (uint32_t f=0; f<numFrames; f++)
+            seqReport.maxRotError = std::max(seqReport.maxRotError, keyError(sampleRot(channel, (float)f), rots[f]));
+         
+         seqReport.rawKeys += numKeys;
+         seqReport.keys += (uint32_t)frames.size();
+         seqReport.rawBytes += numKeys * sizeof(Quat16);
+         seqReport.bytes += sizeof(Channel) + (uint32_t)(frames.size() * sizeof(Quat16));
+         if (mRotChannels[channel].firstFrame != FullRate)
+            seqReport.bytes += (uint32_t)(frames.size() * sizeof(uint16_t));
+      }
+      
+      matter = 0;
+      for (std::ptrdiff_t j = seq.mattersTranslation.findFirst(); j >= 0; j = seq.mattersTranslation.findNext(j+1), matter++)
+      {
+         size_t base = (size_t)seq.baseTrans + ((size_t)matter * numKeys);
+         if (seq.baseTrans < 0 || base + numKeys > shape.mNodeTranslations.size())
+            return false;
+         
+         for (uint32_t f=0; f<numFrames; f++)
+            srcTrans[f] = shape.mNodeTranslations[base + (f % numKeys)];
+         
+         reduceKeys(srcTrans.data(), numFrames, transTolerance, frames);
+         addKeyChannel(srcTrans.data(), numFrames, frames, mTransChannels, mTransKeys, mKeyFrames, outReport);
+         
+         uint32_t channel = (uint32_t)mTransChannels.size() - 1;
+         for (uint32_t f=0; f<numFrames; f++)
+            seqReport.maxTransError = std::max(seqReport.maxTransError, keyError(sampleTrans(channel, (float)f), srcTrans[f]));
+         
+         seqReport.rawKeys += numKeys;
+         seqReport.keys += (uint32_t)frames.size();
+         seqReport.rawBytes += numKeys * sizeof(slm::vec3);
+         seqReport.bytes += sizeof(Channel) + (uint32_t)(frames.size() * sizeof(slm::vec3));
+         if (mTransChannels[channel].firstFrame != FullRate)
+            seqReport.bytes += (uint32_t)(frames.size() * sizeof(uint16_t));
+      }
+      
+      outReport.maxRotError = std::max(outReport.maxRotError, seqReport.maxRotError);
+      outReport.maxTransError = std::max(outReport.maxTransError, seqReport.maxTransError);
+      mSequences.push_back(curves);
+   }
+   
+   mSequences.shrink_to_fit();
+   mRotChannels.shrink_to_fit();
+   mTransChannels.shrink_to_fit();
+   mRotKeys.shrink_to_fit();
+   mTransKeys.shrink_to_fit();
+   mKeyFrames.shrink_to_fit();
+   
+   outReport.rawBytes = MemTracker::vectorBytes(shape.mNodeRotations) + MemTracker::vectorBytes(shape.mNodeTranslations);
+   outReport.bytes = getDataSize();
+   outReport.compressMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+   return true;
+}
+
+void KeyframeCurves::findKeys(const Channel& ch, float keyPos, uint32_t& outKey, float& outT) const
+{
+   if (ch.firstFrame == FullRate)
+   {
+      keyPos = std::min(std::max(keyPos, 0.0f), (float)(ch.numKeys - 1));
+      outKey = std::min((uint32_t)keyPos, ch.numKeys - 2);
+      outT = keyPos - (float)outKey;
+      return;
+   }
+   
+   // Kept keys always include the first & last frame
+   const uint16_t* frames = &mKeyFrames[ch.firstFrame];
+   const uint16_t* next = std::upper_bound(frames + 1, frames + ch.numKeys - 1, keyPos,
+                                           [](float pos, uint16_t frame) { return pos < (float)frame; });
+   outKey = (uint32_t)(next - frames) - 1;
+   
+   float start = (float)frames[outKey];
+   float span = (float)(frames[outKey + 1] - frames[outKey]);
+   outT = std::min(std::max((keyPos - start) / span, 0.0f), 1.0f);
+}
+
+slm::quat KeyframeCurves::sampleRot(uint32_t channel, float keyPos) const
+{
+   const Channel& ch = mRotChannels[channel];
+   const Quat16* keys = &mRotKeys[ch.firstKey];
+   if (ch.numKeys == 1)
+      return keys[0].toQuat();
+   
+   uint32_t key;
+   float t;
+   findKeys(ch, keyPos, key, t);
+   return CompatInterpolate(keys[key].toQuat(), keys[key + 1].toQuat(), t);
+}
+
+slm::vec3 KeyframeCurves::sampleTrans(uint32_t channel, float keyPos) const
+{
+   const Channel& ch = mTransChannels[channel];
+   const slm::vec3* keys = &mTransKeys[ch.firstKey];
+   if (ch.numKeys == 1)
+      return keys[0];
+   
+   uint32_t key;
+   float t;
+   findKeys(ch, keyPos, key, t);
+   return keys[key] + ((keys[key + 1] - keys[key]) * t);
+}
+
+size_t KeyframeCurves::getDataSize() const
+{
+   return MemTracker::vectorBytes(mSequences) +
+          MemTracker::vectorBytes(mRotChannels) +
+          MemTracker::vectorBytes(mTransChannels) +
+          MemTracker::vectorBytes(mRotKeys) +
+          MemTracker::vectorBytes(mTransKeys) +
+          MemTracker::vectorBytes(mKeyFrames);
 }
 
 }
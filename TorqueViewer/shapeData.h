@@ -1,3 +1,6 @@
+#ifndef _SHAPEDATA_H_
+#define _SHAPEDATA_H_
+
 #include "CommonData.h"
 
 #include <iostream>
@@ -146,7 +149,7 @@ struct Decal
 
 struct DetailLevel
 {
-   DetailLevel(int na=0, int ss=0, int od=0, float sz=0.0f, int ae=-1, int me=-1, int pc=0) :
+   DetailLevel(int na=0, int ss=0, int od=0, float sz=0.0f, float ae=-1.0f, float me=-1.0f, int pc=0) :
    name(na), subshape(ss), objectDetail(od), size(sz), avgError(ae), maxError(me), polyCount(pc)
    {
    }
@@ -155,8 +158,8 @@ struct DetailLevel
    int subshape;     ///< Subshape to use for this detail level
    int objectDetail; ///< Mesh index to use for objects
    float size;       ///< Pixel size
-   int avgError;
-   int maxError;
+   float avgError;   ///< Average distance from the full detail surface
+   float maxError;   ///< Max distance from the full detail surface
    int polyCount;
 };
 
@@ -388,12 +391,15 @@ struct AbstractData
    }
 };
 
+// NOTE: vertex data is shared with child meshes (mParent >= 0),
+// which alias their parent's arrays instead of storing their own.
+
 struct BasicData : public AbstractData
 {
-   std::vector<slm::vec3> verts;
-   std::vector<slm::vec2> tverts;
-   std::vector<slm::vec3> normals;
-   std::vector<uint8_t> enormals;
+   SharedArray<slm::vec3> verts;
+   SharedArray<slm::vec2> tverts;
+   SharedArray<slm::vec3> normals;
+   SharedArray<uint8_t> enormals;
    std::vector<Primitive> primitives;
    std::vector<uint16_t> indices;
    std::vector<uint16_t> mergeIndices;
@@ -412,11 +418,11 @@ struct DecalData : public AbstractData
 
 struct SkinData : public BasicData
 {
-   std::vector<uint32_t> vindex; // local vertex
-   std::vector<uint32_t> bindex; // local node index
-   std::vector<float> vweight;   // local node weight
-   std::vector<uint32_t> nodeIndex;       // global node -> local node
-   std::vector<slm::mat4> nodeTransforms; // local node conversion transform
+   SharedArray<uint32_t> vindex; // local vertex
+   SharedArray<uint32_t> bindex; // local node index
+   SharedArray<float> vweight;   // local node weight
+   SharedArray<uint32_t> nodeIndex;       // global node -> local node
+   SharedArray<slm::mat4> nodeTransforms; // local node conversion transform
 };
 
 struct SortedData : public BasicData
@@ -429,6 +435,132 @@ struct SortedData : public BasicData
    bool alwaysWriteDepth;
 };
 
+/*
+ Vertex animation frames (Mesh::mNumFrames > 1) stored as quantised deltas.
+ 
+ Frame 0 is kept at full precision. Position deltas of later frames from frame 0
+ are quantised per axis over each frame's delta range, using 8 bits per component
+ if that meets the requested error bound or 16 bits otherwise. Normals of later
+ frames are stored as snorm8. Frames are decoded on demand, so only frames which
+ are actually drawn need to exist as ModelVertex.
+ */
+class DeltaFrames
+{
+public:
+   
+   struct FrameRange
+   {
+      slm::vec3 min;  // smallest delta
+      slm::vec3 step; // size of one quantisation step
+   };
+   
+   uint32_t mVertsPerFrame;
+   uint32_t mNumFrames;
+   uint32_t mPositionBits;
+   float mMaxError; // largest position error of any decoded component
+   
+   std::vector<ModelVertex> mBaseFrame;
+   std::vector<FrameRange> mRanges;     // frames 1..n
+   std::vector<uint8_t> mPositions8;    // frames 1..n, if mPositionBits == 8
+   std::vector<uint16_t> mPositions16;  // frames 1..n, if mPositionBits == 16
+   std::vector<int8_t> mNormals;        // frames 1..n
+   
+   DeltaFrames();
+   
+   // Encodes numFrames frames of vertsPerFrame verts. Fails if positions
+   // can't be stored within maxError using 16 bits.
+   bool encode(const slm::vec3* verts, const slm::vec3* normals, uint32_t vertsPerFrame, uint32_t numFrames, float maxError);
+   
+   void decodeFrame(uint32_t frame, ModelVertex* outVerts) const;
+   
+   // Heap usage of the encoded frames
+   size_t getDataSize() const;
+   
+   // Size of the same frames stored as ModelVertex
+   inline size_t getRawSize() const { return sizeof(ModelVertex) * mVertsPerFrame * mNumFrames; }
+};
+
+/*
+ Node keyframes (Shape::mNodeRotations & mNodeTranslations) with redundant keys removed.
+ 
+ Each node in a sequence's mattersRot or mattersTranslation set gets a channel. Keys
+ which interpolating their neighbours reproduces within a tolerance are dropped: a
+ channel which never changes keeps one key, and one which couldn't lose any keeps
+ them all. Only channels in between (variable rate) store the frame of each kept key,
+ which sampling finds with a binary search. Kept keys are copied unchanged.
+ 
+ Cyclic sequences blend from the last keyframe back to the first, so their channels
+ cover numKeyFrames+1 frames with the first key repeated at the end.
+ */
+class KeyframeCurves
+{
+public:
+   
+   enum
+   {
+      FullRate = 0xFFFFFFFF, // Channel::firstFrame when every frame has a key
+      MaxFrames = 0xFFFF
+   };
+   
+   struct Channel
+   {
+      uint32_t firstKey;   // into mRotKeys or mTransKeys
+      uint32_t firstFrame; // into mKeyFrames, or FullRate
+      uint32_t numKeys;
+   };
+   
+   struct SequenceCurves
+   {
+      uint32_t firstRot;   // channel for each node in mattersRot
+      uint32_t firstTrans; // ... and mattersTranslation
+      uint32_t numFrames;
+   };
+   
+   struct SequenceReport
+   {
+      uint32_t rawKeys;
+      uint32_t keys;
+      uint32_t rawBytes;
+      uint32_t bytes;
+      float maxRotError;   // radians
+      float maxTransError; // distance
+   };
+   
+   struct Report
+   {
+      size_t rawBytes;
+      size_t bytes;
+      uint32_t numConstant;
+      uint32_t numVariable;
+      uint32_t numFullRate;
+      float maxRotError;
+      float maxTransError;
+      float compressMS;
+      std::vector<SequenceReport> sequences;
+   };
+   
+   std::vector<SequenceCurves> mSequences;
+   std::vector<Channel> mRotChannels;
+   std::vector<Channel> mTransChannels;
+   std::vector<Quat16> mRotKeys;
+   std::vector<slm::vec3> mTransKeys;
+   std::vector<uint16_t> mKeyFrames;
+   
+   // Reduces the keyframes of every sequence in shape. Fails if the keyframe data
+   // doesn't match the sequences or a sequence is too long.
+   bool build(const Shape& shape, float rotTolerance, float transTolerance, Report& outReport);
+   
+   // keyPos is in frames, from 0 to SequenceCurves::numFrames-1
+   slm::quat sampleRot(uint32_t channel, float keyPos) const;
+   slm::vec3 sampleTrans(uint32_t channel, float keyPos) const;
+   
+   size_t getDataSize() const;
+   
+protected:
+   
+   // Finds the keys either side of keyPos in ch
+   void findKeys(const Channel& ch, float keyPos, uint32_t& outKey, float& outT) const;
+};
 
 static void EmitModelVertices(BasicData* basicData, ModelVertex* outv)
 {
@@ -511,7 +643,7 @@ public:
    Box mBounds;
    
    Mesh(Type t = T_Null)
-   : mRadius(0.0), mNumFrames(1), mNumMatFrames(1), mVertsPerFrame(0), mParent(-1), mFlags(0), mType(t)
+   : mRadius(0.0), mNumFrames(1), mNumMatFrames(1), mVertsPerFrame(0), mParent(-1), mFlags(0), mType(t), mData(NULL)
    {
       
    }
@@ -672,7 +804,7 @@ public:
    {
       BasicData* data = getBasicData();
       if (data == NULL)
-         return 0;
+         return;
       
       mNumFrames = n;
       mVertsPerFrame = (uint32_t)data->verts.size() / n;
@@ -685,7 +817,7 @@ public:
       mBounds.min = slm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
       BasicData* data = getBasicData();
       if (data == NULL)
-         return 0;
+         return;
       
       for (const auto& vertex : data->verts)
       {
@@ -837,6 +969,9 @@ public:
    std::vector<slm::vec3> mGroundTranslations;
    std::vector<Quat16> mGroundRotations;
    
+   // Replaces mNodeRotations & mNodeTranslations once compressKeyframes is called
+   KeyframeCurves* mKeyframeCurves;
+   
    // Detail level state
    std::vector<float> mAlphaIn;
    std::vector<float> mAlphaOut;
@@ -854,9 +989,14 @@ public:
    
    uint32_t mRuntimeFlags;
    
+   // Bytes currently reported to MemTracker
+   size_t mTrackedShapeBytes;
+   size_t mTrackedIntegerSetBytes;
+   
 public:
-   Shape() : mTubeRadius(0), mRadius(0), mExportMerge(false),
-   mSmallestVisibleSize(0), mSmallestVisibleDetailLevel(0) {}
+   Shape() : mTubeRadius(0), mRadius(0), mKeyframeCurves(NULL), mExportMerge(false),
+   mSmallestVisibleSize(0), mSmallestVisibleDetailLevel(0),
+   mTrackedShapeBytes(0), mTrackedIntegerSetBytes(0) {}
    
    ~Shape()
    {
@@ -864,8 +1004,22 @@ public:
       {
          mesh.clearData();
       }
+      
+      if (mKeyframeCurves)
+         delete mKeyframeCurves;
+      
+      MemTracker::trackResize(MemCategory_Shape, mTrackedShapeBytes, 0);
+      MemTracker::trackResize(MemCategory_IntegerSet, mTrackedIntegerSetBytes, 0);
    }
    
+   // Calculates the heap footprint of the shape; IntegerSets are reported separately
+   size_t calcMemoryUsage(size_t& outIntegerSetBytes) const;
+   void updateMemoryTracking();
+   
+   // Moves node keyframes into mKeyframeCurves, dropping keys within the given tolerances.
+   // The raw keys are freed, so a compressed shape can't be written back out (IO::writeShape refuses).
+   bool compressKeyframes(float rotTolerance, float transTolerance, KeyframeCurves::Report& outReport);
+   
    Node* getNode(const std::string_view& name);
    int getNodeIndex(const std::string_view& name);
    
@@ -874,8 +1028,13 @@ public:
    bool checkSkip(int meshNumber, int currentObject, int currentDecal, int skipDetailLevel);
    
    virtual bool read(MemRStream& stream);
+   
+   // Checks the split stream header, for ResManager::registerPeekFunc
+   static bool peekHeader(MemRStream& header);
 };
 
 }
 
 #include "shapeIO.h"
+
+#endif
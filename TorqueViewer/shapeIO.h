@@ -181,7 +181,8 @@ struct IO
       {
          uint32_t sz = 0;
          ds.read(sz);
-         ds.read32(sz, &meshIndexList[0]);
+         meshIndexList.resize(sz);
+         ds.read32(sz, meshIndexList.data());
       }
       
       // Reading default translations and rotations
@@ -329,6 +330,11 @@ struct IO
    
    template<typename T> static bool writeShape(Shape* shape, T& ds, uint32_t version)
    {
+      // Compressed shapes no longer have their raw node keys to write
+      if (shape->mKeyframeCurves)
+         return false;
+      
+      // TODO
       return false;
    }
    
@@ -574,6 +580,23 @@ struct IO
    bool readSplit(MemRStream& stream, Shape* shape);
    bool writeSplit(MemRStream& write, Shape* shape, uint32_t version=DefaultVersion);
    
+   // Returns the already loaded data of mesh's parent, or NULL if mesh has no usable parent
+   static BasicData* getParentData(Mesh* mesh, Shape* shape)
+   {
+      if (mesh->mParent < 0)
+         return NULL;
+      
+      // Parents are always written before their children
+      int32_t meshIndex = (int32_t)(mesh - &shape->mMeshes[0]);
+      if (mesh->mParent >= meshIndex)
+      {
+         printf("Mesh %i has invalid parent %i\n", meshIndex, mesh->mParent);
+         return NULL;
+      }
+      
+      return shape->mMeshes[mesh->mParent].getBasicData();
+   }
+   
    template<typename T> static bool readMesh(Mesh* mesh, Shape* shape, T& ds)
    {
       uint32_t sz = 0;
@@ -588,6 +611,7 @@ struct IO
       
       BasicData* basicData = NULL;
       SkinData* skinData = NULL;
+      BasicData* parentData = NULL;
       
       if (mesh->mType == Mesh::T_Skin)
       {
@@ -611,6 +635,16 @@ struct IO
          IO::readPoint3F(ds, mesh->mCenter);
          ds.read(mesh->mRadius);
          
+         // Child meshes only store counts; their vertex data is the parent's
+         parentData = getParentData(mesh, shape);
+         if (parentData)
+         {
+            basicData->verts = parentData->verts;
+            basicData->tverts = parentData->tverts;
+            basicData->normals = parentData->normals;
+            basicData->enormals = parentData->enormals;
+         }
+         
          if (mesh->mParent < 0)
          {
             ds.read(sz);
@@ -622,7 +656,11 @@ struct IO
          }
          else
          {
-            ds.read(sz); // TODO: important?
+            ds.read(sz);
+            if (sz != basicData->verts.size())
+            {
+               printf("Mesh parent has %u verts, expected %u\n", (uint32_t)basicData->verts.size(), sz);
+            }
          }
          
          if (mesh->mParent < 0)
@@ -636,7 +674,11 @@ struct IO
          }
          else
          {
-            ds.read(sz); // TODO: important?
+            ds.read(sz);
+            if (sz != basicData->tverts.size())
+            {
+               printf("Mesh parent has %u tverts, expected %u\n", (uint32_t)basicData->tverts.size(), sz);
+            }
          }
          
          if (mesh->mParent < 0)
@@ -667,11 +709,11 @@ struct IO
          
          ds.read(sz);
          basicData->indices.resize(sz);
-         ds.read16(sz, &basicData->indices[0]);
+         ds.read16(sz, basicData->indices.data());
          
          ds.read(sz);
          basicData->mergeIndices.resize(sz);
-         ds.read16(sz, &basicData->mergeIndices[0]);
+         ds.read16(sz, basicData->mergeIndices.data());
          
          ds.read(mesh->mVertsPerFrame);
          ds.read(mesh->mFlags);
@@ -734,12 +776,13 @@ struct IO
             skinData->vindex.resize(sz);
             skinData->bindex.resize(sz);
             skinData->vweight.resize(sz);
-            ds.read32(sz, &skinData->vindex[0]);
-            ds.read32(sz, &skinData->bindex[0]);
-            ds.read32(sz, &skinData->vweight[0]);
+            ds.read32(sz, skinData->vindex.data());
+            ds.read32(sz, skinData->bindex.data());
+            ds.read32(sz, skinData->vweight.data());
             
             ds.read(sz);
-            ds.read32(sz, &skinData->nodeIndex[0]);
+            skinData->nodeIndex.resize(sz);
+            ds.read32(sz, skinData->nodeIndex.data());
          }
          else
          {
@@ -748,6 +791,16 @@ struct IO
                uint32_t val = 0;
                ds.read(val);
             }
+            
+            SkinData* parentSkin = parentData ? shape->mMeshes[mesh->mParent].getSkinData() : NULL;
+            if (parentSkin)
+            {
+               skinData->nodeTransforms = parentSkin->nodeTransforms;
+               skinData->vindex = parentSkin->vindex;
+               skinData->bindex = parentSkin->bindex;
+               skinData->vweight = parentSkin->vweight;
+               skinData->nodeIndex = parentSkin->nodeIndex;
+            }
          }
          
          ds.readCheck();
@@ -766,12 +819,12 @@ struct IO
          }
          
          ds.read(sz);
-         basicData->indices.resize(sz);
-         ds.read16(sz, &decalData->indices[0]);
+         decalData->indices.resize(sz);
+         ds.read16(sz, decalData->indices.data());
          
          ds.read(sz);
          decalData->startPrimitive.resize(sz);
-         ds.read32(sz, &decalData->startPrimitive[0]);
+         ds.read32(sz, decalData->startPrimitive.data());
          
          ds.read(sz);
          decalData->texGenS.resize(sz);
@@ -807,24 +860,26 @@ struct IO
          
          ds.read(sz);
          sortedData->startCluster.resize(sz);
-         ds.read32(sz, &sortedData->startCluster[0]);
+         ds.read32(sz, sortedData->startCluster.data());
          
          ds.read(sz);
          sortedData->firstVerts.resize(sz);
-         ds.read32(sz, &sortedData->firstVerts[0]);
+         ds.read32(sz, sortedData->firstVerts.data());
          
          ds.read(sz);
          sortedData->numVerts.resize(sz);
-         ds.read32(sz, &sortedData->numVerts[0]);
+         ds.read32(sz, sortedData->numVerts.data());
          
          ds.read(sz);
          sortedData->firstTVerts.resize(sz);
-         ds.read32(sz, &sortedData->firstTVerts[0]);
+         ds.read32(sz, sortedData->firstTVerts.data());
          
          ds.read(sortedData->alwaysWriteDepth);
          
          ds.readCheck();
       }
+      
+      return true;
    }
    
    template<typename T> static bool writeMesh(Mesh* mesh, Shape* shape, T& ds, uint32_t version)
@@ -866,6 +921,7 @@ struct BasicStream
       srcStream.read(sizeof(hdr), hdr);
       version = hdr[1] & 0xFFFF;
       baseStream = &srcStream;
+      return true;
    }
    
    bool readCheck()
@@ -985,7 +1041,6 @@ struct SplitStream
       sourceStream.mPos += totalSize*4;
       
       checkCount = 0;
-      return true;
    }
    
    void storeCheck(int32_t checkPoint = -1)
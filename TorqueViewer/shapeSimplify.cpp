@@ -0,0 +1,1268 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "shapeSimplify.h"
+
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+namespace Dts3
+{
+
+// Error quadric; symmetric 4x4 stored as the upper triangle
+struct SimplifyQuadric
+{
+   double a[10];
+   
+   SimplifyQuadric() { memset(a, 0, sizeof(a)); }
+   
+   void addPlane(const slm::vec3& n, float d)
+   {
+      a[0] += n.x*n.x; a[1] += n.x*n.y; a[2] += n.x*n.z; a[3] += n.x*d;
+      a[4] += n.y*n.y; a[5] += n.y*n.z; a[6] += n.y*d;
+      a[7] += n.z*n.z; a[8] += n.z*d;
+      a[9] += d*d;
+   }
+   
+   SimplifyQuadric& operator+=(const SimplifyQuadric& other)
+   {
+      for (uint32_t i=0; i<10; i++)
+         a[i] += other.a[i];
+      return *this;
+   }
+   
+   // Sum of squared distances from p to the planes
+   double eval(const slm::vec3& p) const
+   {
+      double x = p.x, y = p.y, z = p.z;
+      return (a[0]*x*x) + (2.0*a[1]*x*y) + (2.0*a[2]*x*z) + (2.0*a[3]*x) +
+             (a[4]*y*y) + (2.0*a[5]*y*z) + (2.0*a[6]*y) +
+             (a[7]*z*z) + (2.0*a[8]*z) + a[9];
+   }
+};
+
+class MeshSimplifier
+{
+public:
+   
+   struct Tri
+   {
+      uint32_t v[3];
+      uint32_t mat;
+      bool removed;
+      
+      inline bool contains(uint32_t idx) const { return v[0] == idx || v[1] == idx || v[2] == idx; }
+   };
+   
+   struct Candidate
+   {
+      double cost;
+      uint32_t from;
+      uint32_t to;
+      uint32_t version;
+      
+      // Lowest cost first
+      inline bool operator<(const Candidate& other) const { return cost > other.cost; }
+   };
+   
+   const slm::vec3* mPositions;
+   uint32_t mNumVerts;
+   
+   std::vector<Tri> mTris;
+   std::vector<std::vector<uint32_t> > mVertTris;
+   std::vector<SimplifyQuadric> mQuadrics;
+   std::vector<uint8_t> mLocked;
+   std::vector<uint8_t> mRemoved;
+   std::vector<uint32_t> mGroup; // verts at the same position (UV seams, split normals) share a group
+   std::vector<std::vector<uint32_t> > mGroupVerts;
+   std::vector<uint32_t> mVersion;
+   std::vector<uint64_t> mBoneSets; // only for skinned meshes
+   std::priority_queue<Candidate> mQueue;
+   std::vector<uint32_t> mNeighbours;
+   mutable std::vector<uint32_t> mEvalPairs; // scratch for evaluate
+   
+   uint32_t mNumActiveTris;
+   double mMaxError;
+   double mSumError;
+   uint32_t mNumCollapses;
+   
+   MeshSimplifier() : mPositions(NULL), mNumVerts(0), mNumActiveTris(0), mMaxError(0), mSumError(0), mNumCollapses(0) {;}
+   
+   void addTri(uint32_t a, uint32_t b, uint32_t c, uint32_t mat)
+   {
+      if (a == b || b == c || a == c || a >= mNumVerts || b >= mNumVerts || c >= mNumVerts)
+         return;
+      Tri t = {{a, b, c}, mat, false};
+      mTris.push_back(t);
+   }
+   
+   void addPrimitives(const BasicData* bd)
+   {
+      for (const Primitive& prim : bd->primitives)
+      {
+         if (prim.firstElement + prim.numElements > bd->indices.size())
+            continue;
+         
+         const uint16_t* idx = &bd->indices[prim.firstElement];
+         uint32_t type = prim.matIndex & Primitive::TypeMask;
+         uint32_t mat = prim.matIndex & ~Primitive::TypeMask;
+         
+         if (type == Primitive::Triangles)
+         {
+            for (uint32_t i=0; i+2<prim.numElements; i+=3)
+               addTri(idx[i], idx[i+1], idx[i+2], mat);
+         }
+         else if (type == Primitive::Strip)
+         {
+            for (uint32_t i=0; i+2<prim.numElements; i++)
+            {
+               if (i & 1)
+                  addTri(idx[i+1], idx[i], idx[i+2], mat);
+               else
+                  addTri(idx[i], idx[i+1], idx[i+2], mat);
+            }
+         }
+         else
+         {
+            for (uint32_t i=1; i+1<prim.numElements; i++)
+               addTri(idx[0], idx[i], idx[i+1], mat);
+         }
+      }
+   }
+   
+   void init(const BasicData* bd, const SkinData* sd, uint32_t numVerts)
+   {
+      mPositions = bd->verts.data();
+      mNumVerts = numVerts;
+      addPrimitives(bd);
+      mNumActiveTris = (uint32_t)mTris.size();
+      
+      mVertTris.resize(numVerts);
+      mQuadrics.resize(numVerts);
+      mLocked.resize(numVerts, 0);
+      mRemoved.resize(numVerts, 0);
+      mVersion.resize(numVerts, 0);
+      
+      mGroup.resize(numVerts);
+      std::unordered_map<uint64_t, uint32_t> positionGroups;
+      for (uint32_t i=0; i<numVerts; i++)
+      {
+         auto itr = positionGroups.emplace(hashBytes64(&mPositions[i], sizeof(slm::vec3)), (uint32_t)mGroupVerts.size());
+         if (itr.second)
+            mGroupVerts.emplace_back();
+         mGroup[i] = itr.first->second;
+         mGroupVerts[mGroup[i]].push_back(i);
+      }
+      
+      // Border edges only have one triangle. Edges are counted between positions
+      // so the two sides of a seam count as one edge.
+      std::unordered_map<uint64_t, uint32_t> edgeCounts;
+      std::vector<uint32_t> vertMat(numVerts, 0xFFFFFFFF);
+      
+      for (uint32_t i=0; i<mTris.size(); i++)
+      {
+         const Tri& t = mTris[i];
+         slm::vec3 p0 = mPositions[t.v[0]];
+         slm::vec3 n = slm::cross(mPositions[t.v[1]] - p0, mPositions[t.v[2]] - p0);
+         float len = slm::length(n);
+         if (len > 1e-12f)
+            n /= len;
+         float d = -slm::dot(n, p0);
+         
+         for (uint32_t j=0; j<3; j++)
+         {
+            uint32_t a = t.v[j];
+            uint32_t ga = mGroup[a];
+            uint32_t gb = mGroup[t.v[(j+1)%3]];
+            edgeCounts[((uint64_t)std::min(ga,gb) << 32) | std::max(ga,gb)]++;
+            
+            mVertTris[a].push_back(i);
+            if (len > 1e-12f)
+               mQuadrics[a].addPlane(n, d);
+            
+            // Material boundaries
+            if (vertMat[a] == 0xFFFFFFFF)
+               vertMat[a] = t.mat;
+            else if (vertMat[a] != t.mat)
+               mLocked[a] = 1;
+         }
+      }
+      
+      for (auto& itr : edgeCounts)
+      {
+         if (itr.second != 1)
+            continue;
+         for (uint32_t v : mGroupVerts[itr.first >> 32])
+            mLocked[v] = 1;
+         for (uint32_t v : mGroupVerts[itr.first & 0xFFFFFFFF])
+            mLocked[v] = 1;
+      }
+      
+      if (sd)
+      {
+         // Order independent signature of the bones influencing each vertex
+         mBoneSets.resize(numVerts, 0);
+         for (uint32_t i=0; i<sd->vindex.size(); i++)
+         {
+            uint32_t v = sd->vindex[i];
+            if (v < numVerts)
+               mBoneSets[v] += hashBytes64(&sd->bindex[i], sizeof(uint32_t), 0x5EED);
+         }
+      }
+   }
+   
+   // Checks no remaining triangle around from flips or degenerates if from moves to to
+   bool isCollapseValid(uint32_t from, uint32_t to) const
+   {
+      slm::vec3 target = mPositions[to];
+      for (uint32_t ti : mVertTris[from])
+      {
+         const Tri& t = mTris[ti];
+         if (t.removed || t.contains(to))
+            continue;
+         
+         slm::vec3 p[3];
+         slm::vec3 np[3];
+         for (uint32_t j=0; j<3; j++)
+         {
+            p[j] = mPositions[t.v[j]];
+            np[j] = t.v[j] == from ? target : p[j];
+         }
+         
+         slm::vec3 oldN = slm::cross(p[1] - p[0], p[2] - p[0]);
+         slm::vec3 newN = slm::cross(np[1] - np[0], np[2] - np[0]);
+         float newLen = slm::length(newN);
+         float oldLen = slm::length(oldN);
+         if (newLen <= 1e-12f || slm::dot(oldN, newN) < 0.2f * oldLen * newLen)
+            return false;
+      }
+      return true;
+   }
+   
+   // Pairs every copy of a seam vert with the copy of to it shares a triangle
+   // with, so the whole seam collapses together and stays closed. Fails if a
+   // copy has no partner or several, or two copies would land on one partner.
+   bool findSeamPairs(uint32_t from, uint32_t to, std::vector<uint32_t>& outPairs) const
+   {
+      outPairs.clear();
+      const std::vector<uint32_t>& fromVerts = mGroupVerts[mGroup[from]];
+      if (fromVerts.size() == 1)
+      {
+         outPairs.push_back(from);
+         outPairs.push_back(to);
+         return true;
+      }
+      if (mGroup[from] == mGroup[to])
+         return false;
+      
+      for (uint32_t f : fromVerts)
+      {
+         uint32_t partner = UINT32_MAX;
+         bool used = false;
+         for (uint32_t ti : mVertTris[f])
+         {
+            const Tri& t = mTris[ti];
+            if (t.removed)
+               continue;
+            used = true;
+            for (uint32_t j=0; j<3; j++)
+            {
+               if (mGroup[t.v[j]] != mGroup[to])
+                  continue;
+               if (partner != UINT32_MAX && partner != t.v[j])
+                  return false;
+               partner = t.v[j];
+            }
+         }
+         
+         // Copies without triangles left can stay behind
+         if (!used)
+            continue;
+         if (partner == UINT32_MAX)
+            return false;
+         for (size_t k=1; k<outPairs.size(); k+=2)
+         {
+            if (outPairs[k] == partner)
+               return false;
+         }
+         outPairs.push_back(f);
+         outPairs.push_back(partner);
+      }
+      return true;
+   }
+   
+   // Cost of collapsing from onto to along with any seam copies; false if it
+   // isn't allowed or doesn't cost less than maxCost
+   bool evaluateCollapse(uint32_t from, uint32_t to, std::vector<uint32_t>& outPairs, double& outCost, double maxCost=DBL_MAX) const
+   {
+      if (!findSeamPairs(from, to, outPairs))
+         return false;
+      
+      outCost = 0.0;
+      for (size_t k=0; k<outPairs.size(); k+=2)
+      {
+         uint32_t f = outPairs[k];
+         uint32_t t = outPairs[k+1];
+         if (mLocked[f] || (!mBoneSets.empty() && mBoneSets[t] != mBoneSets[f]))
+            return false;
+         
+         SimplifyQuadric q = mQuadrics[f];
+         q += mQuadrics[t];
+         outCost += std::max(q.eval(mPositions[to]), 0.0);
+      }
+      if (outCost >= maxCost)
+         return false;
+      
+      for (size_t k=0; k<outPairs.size(); k+=2)
+      {
+         if (!isCollapseValid(outPairs[k], outPairs[k+1]))
+            return false;
+      }
+      return true;
+   }
+   
+   bool evaluate(uint32_t from, Candidate& outCandidate) const
+   {
+      if (mLocked[from] || mRemoved[from])
+         return false;
+      
+      bool found = false;
+      outCandidate.cost = DBL_MAX;
+      for (uint32_t ti : mVertTris[from])
+      {
+         const Tri& t = mTris[ti];
+         if (t.removed)
+            continue;
+         
+         for (uint32_t j=0; j<3; j++)
+         {
+            uint32_t to = t.v[j];
+            if (to == from || mRemoved[to])
+               continue;
+            
+            double cost = 0.0;
+            if (evaluateCollapse(from, to, mEvalPairs, cost, outCandidate.cost))
+            {
+               outCandidate.cost = cost;
+               outCandidate.from = from;
+               outCandidate.to = to;
+               outCandidate.version = mVersion[from];
+               found = true;
+            }
+         }
+      }
+      return found;
+   }
+   
+   void collapseVert(uint32_t from, uint32_t to)
+   {
+      for (uint32_t ti : mVertTris[from])
+      {
+         Tri& t = mTris[ti];
+         if (t.removed)
+            continue;
+         
+         if (t.contains(to))
+         {
+            t.removed = true;
+            mNumActiveTris--;
+            continue;
+         }
+         
+         for (uint32_t j=0; j<3; j++)
+         {
+            if (t.v[j] == from)
+               t.v[j] = to;
+         }
+         mVertTris[to].push_back(ti);
+      }
+      
+      mQuadrics[to] += mQuadrics[from];
+      mRemoved[from] = 1;
+      mVertTris[from].clear();
+      
+      std::vector<uint32_t>& toTris = mVertTris[to];
+      toTris.erase(std::remove_if(toTris.begin(), toTris.end(), [this](uint32_t ti){ return mTris[ti].removed; }), toTris.end());
+   }
+   
+   // pairs holds from/to verts, more than one pair when collapsing along a seam
+   void collapse(const std::vector<uint32_t>& pairs, double cost)
+   {
+      for (size_t k=0; k<pairs.size(); k+=2)
+         collapseVert(pairs[k], pairs[k+1]);
+      
+      double error = sqrt(cost);
+      mMaxError = std::max(mMaxError, error);
+      mSumError += error;
+      mNumCollapses++;
+      
+      // Everything around the targets has a new neighbourhood
+      mNeighbours.clear();
+      for (size_t k=1; k<pairs.size(); k+=2)
+      {
+         for (uint32_t ti : mVertTris[pairs[k]])
+         {
+            const Tri& t = mTris[ti];
+            for (uint32_t j=0; j<3; j++)
+            {
+               if (std::find(mNeighbours.begin(), mNeighbours.end(), t.v[j]) == mNeighbours.end())
+                  mNeighbours.push_back(t.v[j]);
+            }
+         }
+      }
+      for (uint32_t idx : mNeighbours)
+         requeue(idx);
+   }
+   
+   void requeue(uint32_t idx)
+   {
+      if (mLocked[idx] || mRemoved[idx])
+         return;
+      
+      mVersion[idx]++;
+      Candidate c;
+      if (evaluate(idx, c))
+         mQueue.push(c);
+   }
+   
+   void run(uint32_t targetTris)
+   {
+      for (uint32_t i=0; i<mNumVerts; i++)
+      {
+         Candidate c;
+         if (evaluate(i, c))
+            mQueue.push(c);
+      }
+      
+      std::vector<uint32_t> pairs;
+      while (mNumActiveTris > targetTris && !mQueue.empty())
+      {
+         Candidate c = mQueue.top();
+         mQueue.pop();
+         
+         if (mRemoved[c.from] || c.version != mVersion[c.from])
+            continue;
+         
+         // Stale target or neighbourhood; find the next best collapse
+         double cost = 0.0;
+         if (mRemoved[c.to] || !evaluateCollapse(c.from, c.to, pairs, cost))
+         {
+            requeue(c.from);
+            continue;
+         }
+         
+         collapse(pairs, cost);
+      }
+   }
+};
+
+static void copyMeshCommon(const Mesh& src, Mesh& outMesh)
+{
+   outMesh.mType = src.mType;
+   outMesh.mFlags = src.mFlags;
+   outMesh.mNumFrames = src.mNumFrames;
+   outMesh.mNumMatFrames = src.mNumMatFrames;
+   outMesh.mVertsPerFrame = src.mVertsPerFrame;
+   outMesh.mParent = -1;
+   outMesh.mRadius = src.mRadius;
+   outMesh.mCenter = src.mCenter;
+   outMesh.mBounds = src.mBounds;
+}
+
+// Makes outMesh use src's data at full detail. Vertex data is aliased so the
+// mesh is treated like a child of srcIndex.
+static void aliasMesh(const Mesh& src, int32_t srcIndex, Mesh& outMesh)
+{
+   outMesh.clearData();
+   copyMeshCommon(src, outMesh);
+   
+   if (src.getSortedData())
+      outMesh.mData = new SortedData(*src.getSortedData());
+   else if (src.getSkinData())
+      outMesh.mData = new SkinData(*src.getSkinData());
+   else if (src.getBasicData())
+      outMesh.mData = new BasicData(*src.getBasicData());
+   else
+      outMesh.mType = Mesh::T_Null;
+   
+   if (outMesh.mData)
+      outMesh.mParent = srcIndex;
+}
+
+bool simplifyMesh(const Mesh& src, float targetRatio, Mesh& outMesh, SimplifyResult& outResult)
+{
+   BasicData* bd = src.getBasicData();
+   SkinData* sd = src.getSkinData();
+   if (bd == NULL || src.getSortedData() || src.mNumFrames > 1 || src.mNumMatFrames > 1)
+      return false;
+   
+   uint32_t numVerts = src.mVertsPerFrame > 0 ? std::min<uint32_t>(src.mVertsPerFrame, bd->verts.size()) : bd->verts.size();
+   if (numVerts == 0 || bd->normals.size() < numVerts)
+      return false;
+   
+   MeshSimplifier simplifier;
+   simplifier.init(bd, sd, numVerts);
+   
+   uint32_t numSourceTris = (uint32_t)simplifier.mTris.size();
+   if (numSourceTris == 0)
+      return false;
+   
+   uint32_t targetTris = (uint32_t)std::max(1.0f, numSourceTris * targetRatio);
+   simplifier.run(targetTris);
+   
+   // Compact the remaining verts, keeping their original order
+   std::vector<int32_t> remap(numVerts, -1);
+   uint32_t numOutVerts = 0;
+   for (const MeshSimplifier::Tri& t : simplifier.mTris)
+   {
+      if (t.removed)
+         continue;
+      for (uint32_t j=0; j<3; j++)
+         remap[t.v[j]] = 0;
+   }
+   for (uint32_t i=0; i<numVerts; i++)
+   {
+      if (remap[i] >= 0)
+         remap[i] = numOutVerts++;
+   }
+   
+   // Triangles are grouped by material, in order of first use
+   std::vector<uint32_t> mats;
+   std::vector<std::vector<uint16_t> > matIndices;
+   for (const MeshSimplifier::Tri& t : simplifier.mTris)
+   {
+      if (t.removed)
+         continue;
+      
+      auto itr = std::find(mats.begin(), mats.end(), t.mat);
+      size_t matSlot = itr - mats.begin();
+      if (itr == mats.end())
+      {
+         mats.push_back(t.mat);
+         matIndices.emplace_back();
+      }
+      for (uint32_t j=0; j<3; j++)
+         matIndices[matSlot].push_back((uint16_t)remap[t.v[j]]);
+   }
+   
+   // Primitives store their first index and count as 16 bits, so the whole
+   // level has to fit in 0xFFFF indices; splitting a material can't help
+   size_t numIndices = 0;
+   for (const std::vector<uint16_t>& indices : matIndices)
+      numIndices += indices.size();
+   if (numIndices > 0xFFFF)
+      return false;
+   
+   BasicData* outData = sd ? new SkinData() : new BasicData();
+   for (uint32_t i=0; i<mats.size(); i++)
+   {
+      Primitive prim((int)outData->indices.size(), (int)matIndices[i].size(), (Primitive::Type)(Primitive::Triangles | Primitive::Indexed | (mats[i] & ~Primitive::Indexed)));
+      outData->primitives.push_back(prim);
+      outData->indices.insert(outData->indices.end(), matIndices[i].begin(), matIndices[i].end());
+   }
+   
+   outData->verts.resize(numOutVerts);
+   outData->normals.resize(numOutVerts);
+   outData->tverts.resize(bd->tverts.size() >= numVerts ? numOutVerts : 0);
+   for (uint32_t i=0; i<numVerts; i++)
+   {
+      if (remap[i] < 0)
+         continue;
+      outData->verts[remap[i]] = bd->verts[i];
+      outData->normals[remap[i]] = bd->normals[i];
+      if (!outData->tverts.empty())
+         outData->tverts[remap[i]] = bd->tverts[i];
+   }
+   
+   if (sd)
+   {
+      // Weights of remaining verts; bone setup is shared with the source
+      SkinData* outSkin = static_cast<SkinData*>(outData);
+      std::vector<uint32_t> vindex, bindex;
+      std::vector<float> vweight;
+      for (uint32_t i=0; i<sd->vindex.size(); i++)
+      {
+         uint32_t v = sd->vindex[i];
+         if (v >= numVerts || remap[v] < 0)
+            continue;
+         vindex.push_back(remap[v]);
+         bindex.push_back(sd->bindex[i]);
+         vweight.push_back(sd->vweight[i]);
+      }
+      
+      outSkin->vindex.resize(vindex.size());
+      outSkin->bindex.resize(bindex.size());
+      outSkin->vweight.resize(vweight.size());
+      std::copy(vindex.begin(), vindex.end(), outSkin->vindex.begin());
+      std::copy(bindex.begin(), bindex.end(), outSkin->bindex.begin());
+      std::copy(vweight.begin(), vweight.end(), outSkin->vweight.begin());
+      outSkin->nodeIndex = sd->nodeIndex;
+      outSkin->nodeTransforms = sd->nodeTransforms;
+   }
+   
+   outMesh.clearData();
+   copyMeshCommon(src, outMesh);
+   outMesh.mFlags &= ~Mesh::F_EncodedNormals;
+   outMesh.mNumFrames = 1;
+   outMesh.mNumMatFrames = 1;
+   outMesh.mVertsPerFrame = numOutVerts;
+   outMesh.mData = outData;
+   outMesh.calculateBounds();
+   
+   outResult.numSourceTris = numSourceTris;
+   outResult.numTris = simplifier.mNumActiveTris;
+   outResult.numVerts = numOutVerts;
+   outResult.maxError = (float)simplifier.mMaxError;
+   outResult.avgError = simplifier.mNumCollapses > 0 ? (float)(simplifier.mSumError / simplifier.mNumCollapses) : 0.0f;
+   return true;
+}
+
+// Transfers src to dst, leaving src empty
+static void moveMesh(Mesh& dst, Mesh& src)
+{
+   dst.clearData();
+   dst = src;
+   src.mData = NULL;
+   src.mType = Mesh::T_Null;
+}
+
+int32_t LODGenerator::findBaseLevel(const Shape* shape)
+{
+   // Only shapes with a single visible level; collision levels have a negative size
+   int32_t baseLevel = -1;
+   for (uint32_t i=0; i<shape->mDetailLevels.size(); i++)
+   {
+      const DetailLevel& level = shape->mDetailLevels[i];
+      if (level.size < 0.0f || level.subshape < 0 || level.objectDetail < 0)
+         continue;
+      if (baseLevel >= 0)
+         return -1;
+      baseLevel = i;
+   }
+   return baseLevel;
+}
+
+bool LODGenerator::generate(Shape* shape, const std::vector<float>& ratios, uint32_t numThreads, Report& outReport)
+{
+   auto startTime = std::chrono::steady_clock::now();
+   
+   outReport = Report();
+   outReport.sourceHash = hashShape(shape);
+   outReport.baseLevel = findBaseLevel(shape);
+   if (outReport.baseLevel < 0 || ratios.empty() || ratios.size() > MaxLevels)
+      return false;
+   
+   const DetailLevel& base = shape->mDetailLevels[outReport.baseLevel];
+   const SubShape& ss = shape->mSubshapes[base.subshape];
+   const uint32_t numLevels = (uint32_t)ratios.size();
+   const uint32_t numObjects = (uint32_t)shape->mObjects.size();
+   
+   // New levels go after the most meshes any object has
+   uint32_t firstObjectDetail = base.objectDetail + 1;
+   for (const Object& obj : shape->mObjects)
+      firstObjectDetail = std::max<uint32_t>(firstObjectDetail, obj.numMeshes);
+   
+   struct Job
+   {
+      uint32_t object;
+      uint32_t level;
+      int32_t sourceMesh;
+   };
+   
+   std::vector<Job> jobs;
+   for (uint32_t i=ss.firstObject; i<(uint32_t)(ss.firstObject+ss.numObjects) && i<numObjects; i++)
+   {
+      const Object& obj = shape->mObjects[i];
+      if (base.objectDetail >= obj.numMeshes)
+         continue;
+      
+      int32_t sourceMesh = obj.firstMesh + base.objectDetail;
+      if (shape->mMeshes[sourceMesh].getBasicData() == NULL)
+         continue;
+      
+      for (uint32_t j=0; j<numLevels; j++)
+         jobs.push_back({i, j, sourceMesh});
+   }
+   
+   std::vector<Mesh> levelMeshes(numObjects * numLevels);
+   std::vector<SimplifyResult> results(jobs.size());
+   std::vector<uint8_t> simplified(jobs.size(), 0);
+   
+   if (numThreads == 0)
+      numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+   numThreads = std::min(numThreads, (uint32_t)std::max(jobs.size(), (size_t)1));
+   
+   // Workers pull the next mesh until everything is done
+   std::atomic<uint32_t> nextJob(0);
+   auto worker = [&](){
+      for (uint32_t i = nextJob.fetch_add(1); i < jobs.size(); i = nextJob.fetch_add(1))
+      {
+         const Job& job = jobs[i];
+         const Mesh& src = shape->mMeshes[job.sourceMesh];
+         Mesh& out = levelMeshes[(job.object * numLevels) + job.level];
+         
+         if (simplifyMesh(src, ratios[job.level], out, results[i]))
+         {
+            simplified[i] = 1;
+         }
+         else
+         {
+            aliasMesh(src, job.sourceMesh, out);
+            results[i] = SimplifyResult();
+            results[i].numSourceTris = results[i].numTris = (uint32_t)src.getPolyCount();
+         }
+      }
+   };
+   
+   std::vector<std::thread> threads;
+   for (uint32_t i=1; i<numThreads; i++)
+      threads.emplace_back(worker);
+   worker();
+   for (std::thread& thread : threads)
+      thread.join();
+   
+   outReport.numThreads = numThreads;
+   outReport.levels.resize(numLevels);
+   for (uint32_t i=0; i<numLevels; i++)
+   {
+      LevelReport& level = outReport.levels[i];
+      level = LevelReport();
+      level.ratio = ratios[i];
+      // Triangle density should stay about the same on screen
+      level.size = base.size * sqrtf(ratios[i]);
+   }
+   
+   // Errors are weighted by the source triangles they cover
+   std::vector<double> errorWeights(numLevels, 0.0);
+   for (uint32_t i=0; i<jobs.size(); i++)
+   {
+      LevelReport& level = outReport.levels[jobs[i].level];
+      const SimplifyResult& res = results[i];
+      level.polyCount += res.numTris;
+      level.maxError = std::max(level.maxError, res.maxError);
+      level.avgError += res.avgError * res.numSourceTris;
+      errorWeights[jobs[i].level] += res.numSourceTris;
+      
+      if (jobs[i].level == 0)
+      {
+         outReport.basePolyCount += res.numSourceTris;
+      }
+      if (simplified[i])
+         outReport.numSimplified++;
+      else
+         outReport.numAliased++;
+   }
+   
+   for (uint32_t i=0; i<numLevels; i++)
+   {
+      if (errorWeights[i] > 0.0)
+         outReport.levels[i].avgError /= errorWeights[i];
+   }
+   
+   applyLevels(shape, firstObjectDetail, levelMeshes, outReport);
+   
+   outReport.generateMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+   return true;
+}
+
+void LODGenerator::applyLevels(Shape* shape, uint32_t firstObjectDetail, std::vector<Mesh>& levelMeshes, Report& report)
+{
+   const uint32_t numLevels = (uint32_t)report.levels.size();
+   const uint32_t numOldMeshes = (uint32_t)shape->mMeshes.size();
+   
+   // Lay meshes out again with room for the new levels in every object
+   // NOTE: Mesh copies are shallow, so meshes must never reallocate
+   std::vector<int32_t> remap(numOldMeshes, -1);
+   std::vector<Mesh> meshes;
+   meshes.reserve(numOldMeshes + (shape->mObjects.size() * (firstObjectDetail + numLevels)));
+   
+   for (uint32_t i=0; i<shape->mObjects.size(); i++)
+   {
+      Object& obj = shape->mObjects[i];
+      int32_t firstMesh = (int32_t)meshes.size();
+      meshes.resize(meshes.size() + firstObjectDetail + numLevels);
+      
+      for (int32_t j=0; j<obj.numMeshes; j++)
+      {
+         remap[obj.firstMesh + j] = firstMesh + j;
+         moveMesh(meshes[firstMesh + j], shape->mMeshes[obj.firstMesh + j]);
+      }
+      for (uint32_t j=0; j<numLevels; j++)
+         moveMesh(meshes[firstMesh + firstObjectDetail + j], levelMeshes[(i * numLevels) + j]);
+      
+      obj.firstMesh = firstMesh;
+      obj.numMeshes = firstObjectDetail + numLevels;
+   }
+   
+   for (Decal& decal : shape->mDecals)
+   {
+      int32_t firstMesh = (int32_t)meshes.size();
+      meshes.resize(meshes.size() + decal.numMeshes);
+      for (int32_t j=0; j<decal.numMeshes; j++)
+      {
+         remap[decal.firstMesh + j] = firstMesh + j;
+         moveMesh(meshes[firstMesh + j], shape->mMeshes[decal.firstMesh + j]);
+      }
+      decal.firstMesh = firstMesh;
+   }
+   
+   // Anything not referenced goes on the end
+   for (uint32_t i=0; i<numOldMeshes; i++)
+   {
+      if (remap[i] >= 0)
+         continue;
+      remap[i] = (int32_t)meshes.size();
+      meshes.emplace_back();
+      moveMesh(meshes.back(), shape->mMeshes[i]);
+   }
+   
+   // Parents (including aliased level meshes) refer to the old indices
+   for (Mesh& mesh : meshes)
+   {
+      if (mesh.mParent >= 0 && mesh.mParent < (int32_t)numOldMeshes)
+         mesh.mParent = remap[mesh.mParent];
+      
+      DecalData* dd = mesh.getDecalData();
+      if (dd && dd->meshIndex < numOldMeshes)
+         dd->meshIndex = remap[dd->meshIndex];
+   }
+   
+   shape->mMeshes.swap(meshes);
+   
+   // Levels follow the base level, smallest last
+   const DetailLevel base = shape->mDetailLevels[report.baseLevel];
+   for (uint32_t i=0; i<numLevels; i++)
+   {
+      const LevelReport& level = report.levels[i];
+      char name[64];
+      snprintf(name, sizeof(name), "detail%i", (int)level.size);
+      
+      DetailLevel dl(shape->mNameTable.addString(name), base.subshape, firstObjectDetail + i,
+                     level.size, level.avgError, level.maxError, (int)level.polyCount);
+      uint32_t insertAt = report.baseLevel + 1 + i;
+      shape->mDetailLevels.insert(shape->mDetailLevels.begin() + insertAt, dl);
+      
+      if (shape->mAlphaIn.size() + 1 == shape->mDetailLevels.size())
+         shape->mAlphaIn.insert(shape->mAlphaIn.begin() + insertAt, 0.0f);
+      if (shape->mAlphaOut.size() + 1 == shape->mDetailLevels.size())
+         shape->mAlphaOut.insert(shape->mAlphaOut.begin() + insertAt, 0.0f);
+   }
+   
+   if (shape->mSmallestVisibleDetailLevel >= report.baseLevel)
+   {
+      shape->mSmallestVisibleDetailLevel = report.baseLevel + numLevels;
+      shape->mSmallestVisibleSize = (int)report.levels.back().size;
+   }
+   
+   shape->updateMemoryTracking();
+}
+
+// Cooked cache file
+//
+// Header, then LevelRecords, then MeshRecords, then the arrays of each mesh
+// one after the other. Like mission snapshots it is native byte order and
+// simply rebuilt if anything doesn't match.
+
+struct LODCacheHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t sourceHash;
+   uint64_t ratioHash;
+   int32_t baseLevel;
+   uint32_t firstObjectDetail;
+   uint32_t basePolyCount;
+   uint32_t numLevels;
+   uint32_t numMeshes;
+   uint32_t dataSize;
+};
+
+struct LODCacheLevel
+{
+   float ratio;
+   float size;
+   float maxError;
+   float avgError;
+   uint32_t polyCount;
+   uint32_t pad;
+};
+
+struct LODCacheMesh
+{
+   enum
+   {
+      Aliased = 1 // full detail copy of the base mesh
+   };
+   
+   uint32_t object;
+   uint32_t level;
+   uint32_t type;
+   uint32_t flags;
+   uint32_t cacheFlags;
+   uint32_t numVerts;
+   uint32_t numTVerts;
+   uint32_t numPrimitives;
+   uint32_t numIndices;
+   uint32_t numSkinWeights;
+   uint32_t dataOffset;
+   float radius;
+   float center[3];
+};
+
+template<typename T> static void appendCacheData(std::vector<uint8_t>& buffer, const T* data, size_t count)
+{
+   size_t bytes = count * sizeof(T);
+   size_t offset = buffer.size();
+   buffer.resize(offset + ((bytes + 7) & ~7));
+   if (bytes)
+      memcpy(&buffer[offset], data, bytes);
+}
+
+// Bytes count elements of T take up in the cache, including padding
+template<typename T> static inline size_t getCacheDataSize(size_t count)
+{
+   return ((count * sizeof(T)) + 7) & ~7;
+}
+
+template<typename T> static bool readCacheData(const uint8_t*& ptr, const uint8_t* end, T* outData, size_t count)
+{
+   size_t bytes = count * sizeof(T);
+   size_t padded = (bytes + 7) & ~7;
+   if ((size_t)(end - ptr) < padded)
+      return false;
+   if (bytes)
+      memcpy(outData, ptr, bytes);
+   ptr += padded;
+   return true;
+}
+
+static uint64_t hashRatios(const std::vector<float>& ratios)
+{
+   return hashBytes64(ratios.data(), ratios.size() * sizeof(float), LODGenerator::CacheVersion);
+}
+
+bool LODGenerator::writeCache(const char* filename, const Shape* shape, const std::vector<float>& ratios, const Report& report)
+{
+   if (report.baseLevel < 0 || report.levels.size() != ratios.size())
+      return false;
+   
+   const DetailLevel& base = shape->mDetailLevels[report.baseLevel];
+   const uint32_t numLevels = (uint32_t)ratios.size();
+   const uint32_t firstObjectDetail = shape->mDetailLevels[report.baseLevel + 1].objectDetail;
+   const SubShape& ss = shape->mSubshapes[base.subshape];
+   
+   std::vector<LODCacheLevel> levels(numLevels);
+   for (uint32_t i=0; i<numLevels; i++)
+   {
+      const LevelReport& lr = report.levels[i];
+      levels[i] = {lr.ratio, lr.size, lr.maxError, lr.avgError, lr.polyCount, 0};
+   }
+   
+   std::vector<LODCacheMesh> records;
+   std::vector<uint8_t> data;
+   for (uint32_t i=ss.firstObject; i<(uint32_t)(ss.firstObject+ss.numObjects); i++)
+   {
+      const Object& obj = shape->mObjects[i];
+      for (uint32_t j=0; j<numLevels; j++)
+      {
+         const Mesh& mesh = shape->mMeshes[obj.firstMesh + firstObjectDetail + j];
+         const BasicData* bd = mesh.getBasicData();
+         if (bd == NULL)
+            continue;
+         
+         LODCacheMesh rec = {};
+         rec.object = i;
+         rec.level = j;
+         rec.type = mesh.mType;
+         rec.flags = mesh.mFlags;
+         rec.radius = mesh.mRadius;
+         rec.center[0] = mesh.mCenter.x;
+         rec.center[1] = mesh.mCenter.y;
+         rec.center[2] = mesh.mCenter.z;
+         rec.dataOffset = (uint32_t)data.size();
+         
+         if (mesh.mParent >= 0)
+         {
+            rec.cacheFlags = LODCacheMesh::Aliased;
+            records.push_back(rec);
+            continue;
+         }
+         
+         const SkinData* sd = mesh.getSkinData();
+         rec.numVerts = (uint32_t)bd->verts.size();
+         rec.numTVerts = (uint32_t)bd->tverts.size();
+         rec.numPrimitives = (uint32_t)bd->primitives.size();
+         rec.numIndices = (uint32_t)bd->indices.size();
+         rec.numSkinWeights = sd ? (uint32_t)sd->vindex.size() : 0;
+         
+         appendCacheData(data, bd->verts.data(), bd->verts.size());
+         appendCacheData(data, bd->normals.data(), bd->normals.size());
+         appendCacheData(data, bd->tverts.data(), bd->tverts.size());
+         appendCacheData(data, bd->primitives.data(), bd->primitives.size());
+         appendCacheData(data, bd->indices.data(), bd->indices.size());
+         if (sd)
+         {
+            appendCacheData(data, sd->vindex.data(), sd->vindex.size());
+            appendCacheData(data, sd->bindex.data(), sd->bindex.size());
+            appendCacheData(data, sd->vweight.data(), sd->vweight.size());
+         }
+         records.push_back(rec);
+      }
+   }
+   
+   LODCacheHeader header = {};
+   header.magic = CacheMagic;
+   header.version = CacheVersion;
+   header.sourceHash = report.sourceHash;
+   header.ratioHash = hashRatios(ratios);
+   header.baseLevel = report.baseLevel;
+   header.firstObjectDetail = firstObjectDetail;
+   header.basePolyCount = report.basePolyCount;
+   header.numLevels = numLevels;
+   header.numMeshes = (uint32_t)records.size();
+   header.dataSize = (uint32_t)data.size();
+   
+   std::vector<uint8_t> buffer;
+   appendCacheData(buffer, &header, 1);
+   appendCacheData(buffer, levels.data(), levels.size());
+   appendCacheData(buffer, records.data(), records.size());
+   buffer.insert(buffer.end(), data.begin(), data.end());
+   
+   // Write to a temp file first so a partial write never looks valid
+   std::string tempName = std::string(filename) + ".tmp";
+   FILE* fp = fopen(tempName.c_str(), "wb");
+   if (fp == NULL)
+   {
+      printf("LODGenerator: couldn't write %s\n", tempName.c_str());
+      return false;
+   }
+   
+   bool ok = fwrite(buffer.data(), 1, buffer.size(), fp) == buffer.size();
+   ok = (fclose(fp) == 0) && ok;
+   
+   if (ok)
+   {
+      remove(filename);
+      ok = rename(tempName.c_str(), filename) == 0;
+   }
+   
+   if (!ok)
+   {
+      printf("LODGenerator: couldn't write %s\n", filename);
+      remove(tempName.c_str());
+   }
+   
+   return ok;
+}
+
+bool LODGenerator::readCache(const char* filename, Shape* shape, const std::vector<float>& ratios, Report& outReport)
+{
+   auto startTime = std::chrono::steady_clock::now();
+   
+   MappedFile file;
+   if (!file.open(filename))
+      return false;
+   
+   const uint8_t* ptr = file.mPtr;
+   const uint8_t* end = file.mPtr + file.mSize;
+   
+   LODCacheHeader header;
+   if (!readCacheData(ptr, end, &header, 1) ||
+       header.magic != CacheMagic || header.version != CacheVersion ||
+       header.ratioHash != hashRatios(ratios) || header.numLevels != ratios.size() ||
+       header.sourceHash != hashShape(shape) || header.baseLevel != findBaseLevel(shape))
+      return false;
+   
+   // Check the counts against the file before allocating anything for them
+   const uint32_t numObjects = (uint32_t)shape->mObjects.size();
+   if (header.numMeshes > numObjects * header.numLevels ||
+       (size_t)(end - ptr) < getCacheDataSize<LODCacheLevel>(header.numLevels) + getCacheDataSize<LODCacheMesh>(header.numMeshes))
+      return false;
+   
+   std::vector<LODCacheLevel> levels(header.numLevels);
+   std::vector<LODCacheMesh> records(header.numMeshes);
+   if (!readCacheData(ptr, end, levels.data(), levels.size()) ||
+       !readCacheData(ptr, end, records.data(), records.size()) ||
+       (size_t)(end - ptr) < header.dataSize)
+      return false;
+   
+   const uint8_t* data = ptr;
+   const uint8_t* dataEnd = ptr + header.dataSize;
+   const DetailLevel& base = shape->mDetailLevels[header.baseLevel];
+   
+   uint32_t firstObjectDetail = base.objectDetail + 1;
+   for (const Object& obj : shape->mObjects)
+      firstObjectDetail = std::max<uint32_t>(firstObjectDetail, obj.numMeshes);
+   if (firstObjectDetail != header.firstObjectDetail)
+      return false;
+   
+   std::vector<Mesh> levelMeshes(numObjects * header.numLevels);
+   
+   outReport = Report();
+   outReport.sourceHash = header.sourceHash;
+   outReport.baseLevel = header.baseLevel;
+   outReport.basePolyCount = header.basePolyCount;
+   outReport.fromCache = true;
+   
+   for (const LODCacheMesh& rec : records)
+   {
+      if (rec.object >= numObjects || rec.level >= header.numLevels || rec.dataOffset > header.dataSize)
+         return false;
+      
+      const Object& obj = shape->mObjects[rec.object];
+      if (base.objectDetail >= obj.numMeshes)
+         return false;
+      
+      int32_t sourceIndex = obj.firstMesh + base.objectDetail;
+      const Mesh& src = shape->mMeshes[sourceIndex];
+      Mesh& out = levelMeshes[(rec.object * header.numLevels) + rec.level];
+      
+      if (rec.cacheFlags & LODCacheMesh::Aliased)
+      {
+         aliasMesh(src, sourceIndex, out);
+         outReport.numAliased++;
+         continue;
+      }
+      
+      if (rec.type != Mesh::T_Standard && rec.type != Mesh::T_Skin)
+         return false;
+      if (rec.type == Mesh::T_Skin && src.getSkinData() == NULL)
+         return false;
+      
+      size_t recBytes = (getCacheDataSize<slm::vec3>(rec.numVerts) * 2) + getCacheDataSize<slm::vec2>(rec.numTVerts) +
+                        getCacheDataSize<Primitive>(rec.numPrimitives) + getCacheDataSize<uint16_t>(rec.numIndices);
+      if (rec.type == Mesh::T_Skin)
+         recBytes += (getCacheDataSize<uint32_t>(rec.numSkinWeights) * 2) + getCacheDataSize<float>(rec.numSkinWeights);
+      if (recBytes > header.dataSize - rec.dataOffset)
+      {
+         printf("LODGenerator: %s is corrupt\n", filename);
+         return false;
+      }
+      
+      SkinData* sd = rec.type == Mesh::T_Skin ? new SkinData() : NULL;
+      BasicData* bd = sd ? sd : new BasicData();
+      out.mType = (Mesh::Type)rec.type;
+      out.mFlags = rec.flags;
+      out.mData = bd;
+      out.mVertsPerFrame = rec.numVerts;
+      out.mRadius = rec.radius;
+      out.mCenter = slm::vec3(rec.center[0], rec.center[1], rec.center[2]);
+      
+      bd->verts.resize(rec.numVerts);
+      bd->normals.resize(rec.numVerts);
+      bd->tverts.resize(rec.numTVerts);
+      bd->primitives.resize(rec.numPrimitives);
+      bd->indices.resize(rec.numIndices);
+      
+      const uint8_t* recData = data + rec.dataOffset;
+      bool valid = readCacheData(recData, dataEnd, bd->verts.data(), rec.numVerts) &&
+                   readCacheData(recData, dataEnd, bd->normals.data(), rec.numVerts) &&
+                   readCacheData(recData, dataEnd, bd->tverts.data(), rec.numTVerts) &&
+                   readCacheData(recData, dataEnd, bd->primitives.data(), rec.numPrimitives) &&
+                   readCacheData(recData, dataEnd, bd->indices.data(), rec.numIndices);
+      if (valid && sd)
+      {
+         SkinData* srcSkin = src.getSkinData();
+         sd->vindex.resize(rec.numSkinWeights);
+         sd->bindex.resize(rec.numSkinWeights);
+         sd->vweight.resize(rec.numSkinWeights);
+         valid = readCacheData(recData, dataEnd, sd->vindex.data(), rec.numSkinWeights) &&
+                 readCacheData(recData, dataEnd, sd->bindex.data(), rec.numSkinWeights) &&
+                 readCacheData(recData, dataEnd, sd->vweight.data(), rec.numSkinWeights);
+         sd->nodeIndex = srcSkin->nodeIndex;
+         sd->nodeTransforms = srcSkin->nodeTransforms;
+         
+         uint32_t numBones = (uint32_t)std::min(sd->nodeIndex.size(), sd->nodeTransforms.size());
+         for (uint32_t i=0; valid && i<rec.numSkinWeights; i++)
+            valid = sd->vindex[i] < rec.numVerts && sd->bindex[i] < numBones;
+      }
+      
+      // Indices are trusted by the renderer, so check them here
+      for (uint32_t i=0; valid && i<rec.numIndices; i++)
+         valid = bd->indices[i] < rec.numVerts;
+      for (uint32_t i=0; valid && i<rec.numPrimitives; i++)
+         valid = (uint32_t)bd->primitives[i].firstElement + bd->primitives[i].numElements <= rec.numIndices;
+      
+      if (!valid)
+      {
+         printf("LODGenerator: %s is corrupt\n", filename);
+         return false;
+      }
+      
+      out.calculateBounds();
+      outReport.numSimplified++;
+   }
+   
+   outReport.levels.resize(header.numLevels);
+   for (uint32_t i=0; i<header.numLevels; i++)
+   {
+      const LODCacheLevel& cl = levels[i];
+      outReport.levels[i] = {cl.ratio, cl.size, cl.polyCount, cl.maxError, cl.avgError};
+   }
+   
+   applyLevels(shape, firstObjectDetail, levelMeshes, outReport);
+   
+   outReport.generateMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+   return true;
+}
+
+std::string LODGenerator::getCachePath(const char* cacheDir, const char* shapeName)
+{
+   std::string name = shapeName;
+   for (char& c : name)
+   {
+      if (c == '/' || c == '\\' || c == ':')
+         c = '_';
+   }
+   
+   return std::string(cacheDir) + "/" + name + ".tvlod";
+}
+
+uint64_t LODGenerator::hashShape(const Shape* shape)
+{
+   uint64_t hash = hashBytes64(shape->mDetailLevels.data(), shape->mDetailLevels.size() * sizeof(DetailLevel));
+   hash = hashBytes64(shape->mObjects.data(), shape->mObjects.size() * sizeof(Object), hash);
+   
+   for (const Mesh& mesh : shape->mMeshes)
+   {
+      uint32_t info[4] = {mesh.mType, mesh.mNumFrames, mesh.mVertsPerFrame, (uint32_t)mesh.mParent};
+      hash = hashBytes64(info, sizeof(info), hash);
+      
+      const BasicData* bd = mesh.getBasicData();
+      if (bd == NULL)
+         continue;
+      
+      hash = hashBytes64(bd->verts.data(), bd->verts.size() * sizeof(slm::vec3), hash);
+      hash = hashBytes64(bd->indices.data(), bd->indices.size() * sizeof(uint16_t), hash);
+      hash = hashBytes64(bd->primitives.data(), bd->primitives.size() * sizeof(Primitive), hash);
+   }
+   
+   return hash;
+}
+
+}
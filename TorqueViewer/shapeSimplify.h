@@ -0,0 +1,122 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _SHAPESIMPLIFY_H_
+#define _SHAPESIMPLIFY_H_
+
+#include "shapeData.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ Automatic detail levels for shapes which only come with one.
+ 
+ Meshes are simplified with quadric error metrics using half-edge collapses, so
+ every remaining vertex keeps its original position, texture coordinate, normal
+ and skin weights. Vertices on open borders, material boundaries and UV seams
+ (several verts at one position) are locked, and collapses between verts with
+ different bone sets are skipped, so none of those get distorted.
+ 
+ Meshes which can't be simplified (decals, sorted or animated meshes) are
+ aliased into the new levels at full detail.
+ 
+ Generated meshes are appended after each object's existing meshes, and the
+ new detail levels follow the base level in mDetailLevels. Results can be
+ written to a cooked cache so the work only needs doing once per shape.
+ */
+namespace Dts3
+{
+
+struct SimplifyResult
+{
+   uint32_t numSourceTris;
+   uint32_t numTris;
+   uint32_t numVerts;
+   float maxError; // upper bound on the distance from the source surface
+   float avgError; // mean error over all collapses
+};
+
+// Simplifies the first frame of src to roughly targetRatio of its triangles.
+// Returns false if src can't be simplified, or if the result needs more than
+// 0xFFFF indices (primitives only have 16 bits for their range).
+bool simplifyMesh(const Mesh& src, float targetRatio, Mesh& outMesh, SimplifyResult& outResult);
+
+class LODGenerator
+{
+public:
+   
+   enum
+   {
+      CacheMagic = 0x444C5654, // "TVLD"
+      CacheVersion = 2,
+      MaxLevels = 8
+   };
+   
+   struct LevelReport
+   {
+      float ratio;
+      float size;
+      uint32_t polyCount;
+      float maxError;
+      float avgError;
+   };
+   
+   struct Report
+   {
+      uint64_t sourceHash;     // hashShape() before levels were added
+      int32_t baseLevel;
+      uint32_t basePolyCount;
+      uint32_t numSimplified;  // meshes simplified
+      uint32_t numAliased;     // meshes used at full detail
+      uint32_t numThreads;
+      float generateMS;
+      bool fromCache;
+      std::vector<LevelReport> levels;
+   };
+   
+   // Returns the level new levels are made from, or -1 if the shape already has levels
+   static int32_t findBaseLevel(const Shape* shape);
+   
+   // Adds a detail level for each ratio of the base level's triangles. numThreads=0 picks a default.
+   static bool generate(Shape* shape, const std::vector<float>& ratios, uint32_t numThreads, Report& outReport);
+   
+   // Adds levels from a cache made by writeCache. Fails if the shape or ratios don't match.
+   static bool readCache(const char* filename, Shape* shape, const std::vector<float>& ratios, Report& outReport);
+   static bool writeCache(const char* filename, const Shape* shape, const std::vector<float>& ratios, const Report& report);
+   
+   // Gets a filename in cacheDir to use for a shape
+   static std::string getCachePath(const char* cacheDir, const char* shapeName);
+   
+   // Hash of the geometry & detail setup of a shape
+   static uint64_t hashShape(const Shape* shape);
+   
+protected:
+   
+   // Moves generated meshes (numObjects * numLevels, ordered by object) into shape
+   static void applyLevels(Shape* shape, uint32_t firstObjectDetail, std::vector<Mesh>& levelMeshes, Report& report);
+};
+
+}
+
+#endif
@@ -0,0 +1,117 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "textureCache.h"
+
+TextureCache::TextureCache(ReleaseFunc release) : mRelease(release)
+{
+   mStats = {};
+}
+
+TextureCache::~TextureCache()
+{
+   clear();
+}
+
+int32_t TextureCache::acquire(uint64_t hash)
+{
+   auto itr = mLookup.find(hash);
+   if (itr == mLookup.end())
+      return -1;
+   
+   Entry& entry = mEntries[itr->second];
+   entry.refCount++;
+   mStats.numRefs++;
+   mStats.hits++;
+   mStats.savedBytes += entry.bytes;
+   return itr->second;
+}
+
+void TextureCache::insert(uint64_t hash, int32_t texID, uint64_t bytes)
+{
+   Entry& entry = mEntries[texID];
+   entry.refCount = 1;
+   entry.bytes = bytes;
+   entry.keys.clear();
+   entry.keys.push_back(hash);
+   mLookup[hash] = texID;
+   
+   mStats.numTextures++;
+   mStats.numRefs++;
+   mStats.residentBytes += bytes;
+}
+
+void TextureCache::addAlias(uint64_t hash, int32_t texID)
+{
+   auto itr = mEntries.find(texID);
+   if (itr == mEntries.end() || mLookup.find(hash) != mLookup.end())
+      return;
+   
+   itr->second.keys.push_back(hash);
+   mLookup[hash] = texID;
+}
+
+void TextureCache::setBytes(int32_t texID, uint64_t bytes)
+{
+   auto itr = mEntries.find(texID);
+   if (itr == mEntries.end())
+      return;
+   
+   Entry& entry = itr->second;
+   mStats.residentBytes = mStats.residentBytes - entry.bytes + bytes;
+   mStats.savedBytes = mStats.savedBytes - (entry.bytes * (entry.refCount-1)) + (bytes * (entry.refCount-1));
+   entry.bytes = bytes;
+}
+
+bool TextureCache::release(int32_t texID)
+{
+   auto itr = mEntries.find(texID);
+   if (itr == mEntries.end())
+      return false;
+   
+   Entry& entry = itr->second;
+   mStats.numRefs--;
+   if (--entry.refCount > 0)
+   {
+      mStats.savedBytes -= entry.bytes;
+      return true;
+   }
+   
+   for (uint64_t key : entry.keys)
+      mLookup.erase(key);
+   mStats.numTextures--;
+   mStats.residentBytes -= entry.bytes;
+   mEntries.erase(itr);
+   
+   mRelease(texID);
+   return true;
+}
+
+void TextureCache::clear()
+{
+   for (auto& itr : mEntries)
+      mRelease(itr.first);
+   
+   mEntries.clear();
+   mLookup.clear();
+   mStats = {};
+}
@@ -0,0 +1,94 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _TEXTURECACHE_H_
+#define _TEXTURECACHE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+/*
+ Shares textures between everything that loads them, based on a hash of their
+ contents rather than their name. Mods and volumes often carry identical copies
+ of the same image under different names, and each of these would otherwise be
+ decoded and uploaded separately.
+ 
+ A texture can be registered under more than one key; materials typically look up
+ the hash of the file first (which skips decoding entirely), and on a miss the
+ hash of the decoded pixels is checked so re-encoded copies are also shared.
+ Textures are refcounted, and the release callback is called once the last
+ reference is gone.
+ */
+class TextureCache
+{
+public:
+   
+   typedef std::function<void(int32_t texID)> ReleaseFunc;
+   
+   struct Stats
+   {
+      uint32_t numTextures;
+      uint32_t numRefs;
+      uint32_t hits;         // lookups which found an existing texture
+      uint64_t residentBytes;
+      uint64_t savedBytes;   // extra bytes the shared references would have used
+   };
+   
+   Stats mStats;
+   
+   TextureCache(ReleaseFunc release);
+   ~TextureCache();
+   
+   // Returns the texture for hash with a new reference, or -1
+   int32_t acquire(uint64_t hash);
+   
+   // Adds a new texture with a single reference. bytes is the GPU size.
+   void insert(uint64_t hash, int32_t texID, uint64_t bytes);
+   
+   // Registers another key for a texture which is already in the cache
+   void addAlias(uint64_t hash, int32_t texID);
+   
+   // Updates the GPU size of texID, e.g. when a streamed texture changes mip
+   void setBytes(int32_t texID, uint64_t bytes);
+   
+   // Drops a reference. Returns false if texID isn't in the cache.
+   bool release(int32_t texID);
+   
+   void clear();
+   
+protected:
+   
+   struct Entry
+   {
+      uint32_t refCount;
+      uint64_t bytes;
+      std::vector<uint64_t> keys;
+   };
+   
+   ReleaseFunc mRelease;
+   std::unordered_map<uint64_t, int32_t> mLookup;
+   std::unordered_map<int32_t, Entry> mEntries;
+};
+
+#endif
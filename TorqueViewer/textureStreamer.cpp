@@ -0,0 +1,522 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "CommonData.h"
+#include "textureStreamer.h"
+#include "memTracker.h"
+#include <string.h>
+#include <algorithm>
+#include <queue>
+
+static inline float getMipTexels(uint32_t width, uint32_t height, uint32_t mip)
+{
+   return (float)std::max<uint32_t>(std::max(width, height) >> mip, 1);
+}
+
+static inline size_t getMipSize(uint32_t width, uint32_t height, uint32_t mip)
+{
+   return (size_t)std::max<uint32_t>(width >> mip, 1) * std::max<uint32_t>(height >> mip, 1) * 4;
+}
+
+TextureStreamer::TextureStreamer(UploadFunc upload, DeleteFunc del) :
+mBudgetBytes(256 * 1024 * 1024),
+mUploadBytesPerFrame(4 * 1024 * 1024),
+mUpload(upload),
+mDelete(del),
+mFrame(0)
+{
+   mStats = {};
+}
+
+TextureStreamer::~TextureStreamer()
+{
+   clear();
+}
+
+uint64_t TextureStreamer::getMipBytes(uint32_t width, uint32_t height, uint32_t mip)
+{
+   uint32_t w = std::max<uint32_t>(width >> mip, 1);
+   uint32_t h = std::max<uint32_t>(height >> mip, 1);
+   return (uint64_t)getNextPow2(w) * getNextPow2(h) * 4;
+}
+
+void TextureStreamer::downsample(uint32_t width, uint32_t height, const uint8_t* src, uint8_t* dest)
+{
+   uint32_t destW = std::max<uint32_t>(width >> 1, 1);
+   uint32_t destH = std::max<uint32_t>(height >> 1, 1);
+   
+   for (uint32_t y=0; y<destH; y++)
+   {
+      const uint8_t* row0 = src + ((size_t)std::min(y*2, height-1) * width * 4);
+      const uint8_t* row1 = src + ((size_t)std::min(y*2+1, height-1) * width * 4);
+      
+      for (uint32_t x=0; x<destW; x++)
+      {
+         uint32_t x0 = std::min(x*2, width-1) * 4;
+         uint32_t x1 = std::min(x*2+1, width-1) * 4;
+         
+         for (uint32_t c=0; c<4; c++)
+         {
+            uint32_t sum = row0[x0+c] + row0[x1+c] + row1[x0+c] + row1[x1+c];
+            *dest++ = (uint8_t)((sum + 2) >> 2);
+         }
+      }
+   }
+}
+
+size_t TextureStreamer::getChainSize(uint32_t width, uint32_t height, uint32_t numMips)
+{
+   size_t total = 0;
+   for (uint32_t i=0; i<numMips; i++)
+      total += getMipSize(width, height, i);
+   return total;
+}
+
+// Fills out (laid out from firstMip down to 1x1) from the numSrcMips mips in src,
+// box filtering any past those. src may be modified.
+static void buildMipChain(uint32_t width, uint32_t height, std::vector<uint8_t>& src, uint32_t numSrcMips,
+                          uint32_t firstMip, std::vector<uint8_t>& out)
+{
+   uint32_t lastMip = firstMip;
+   while ((width >> lastMip) > 1 || (height >> lastMip) > 1)
+      lastMip++;
+   
+   out.resize(TextureStreamer::getChainSize(width, height, lastMip+1) - TextureStreamer::getChainSize(width, height, firstMip));
+   
+   // Get to firstMip if it isn't stored
+   if (firstMip >= numSrcMips)
+   {
+      size_t srcOffset = TextureStreamer::getChainSize(width, height, numSrcMips-1);
+      std::vector<uint8_t> level(src.begin() + srcOffset, src.begin() + srcOffset + getMipSize(width, height, numSrcMips-1));
+      std::vector<uint8_t> dest;
+      for (uint32_t i=numSrcMips; i<=firstMip; i++)
+      {
+         dest.resize(getMipSize(width, height, i));
+         TextureStreamer::downsample(std::max<uint32_t>(width >> (i-1), 1), std::max<uint32_t>(height >> (i-1), 1), &level[0], &dest[0]);
+         level.swap(dest);
+      }
+      memcpy(&out[0], &level[0], level.size());
+   }
+   
+   size_t offset = 0;
+   for (uint32_t i=firstMip; i<=lastMip; i++)
+   {
+      size_t size = getMipSize(width, height, i);
+      if (i < numSrcMips)
+      {
+         memcpy(&out[offset], &src[TextureStreamer::getChainSize(width, height, i)], size);
+      }
+      else if (i > firstMip)
+      {
+         size_t prevSize = getMipSize(width, height, i-1);
+         TextureStreamer::downsample(std::max<uint32_t>(width >> (i-1), 1), std::max<uint32_t>(height >> (i-1), 1),
+                                     &out[offset - prevSize], &out[offset]);
+      }
+      offset += size;
+   }
+}
+
+int32_t TextureStreamer::addTexture(uint32_t width, uint32_t height, const uint8_t* pixels, ReloadFunc reload, uint32_t numSrcMips)
+{
+   if (width == 0 || height == 0)
+      return -1;
+   
+   Entry* entry = new Entry();
+   entry->texID = -1;
+   entry->width = width;
+   entry->height = height;
+   entry->frameRequest = 0.0f;
+   entry->lastRequest = 0.0f;
+   entry->lastRequestFrame = 0;
+   entry->firstCPUMip = 0;
+   entry->reload = reload;
+   entry->reloadFailed = false;
+   
+   // Lay out the whole chain first so pixels only needs to be allocated once
+   size_t totalSize = 0;
+   uint32_t numMips = 0;
+   for (; numMips<MaxMips; numMips++)
+   {
+      uint32_t w = std::max<uint32_t>(width >> numMips, 1);
+      uint32_t h = std::max<uint32_t>(height >> numMips, 1);
+      entry->mipOffsets[numMips] = totalSize;
+      totalSize += (size_t)w * h * 4;
+      if (w == 1 && h == 1)
+      {
+         numMips++;
+         break;
+      }
+   }
+   
+   entry->numMips = numMips;
+   entry->pixels.resize(totalSize);
+   MemTracker::trackAlloc(MemCategory_Bitmap, totalSize);
+   
+   // Stored mips are copied as they are
+   numSrcMips = std::min(std::max(numSrcMips, 1U), numMips);
+   memcpy(&entry->pixels[0], pixels, entry->mipOffsets[numSrcMips-1] + getMipSize(width, height, numSrcMips-1));
+   for (uint32_t i=numSrcMips; i<numMips; i++)
+   {
+      downsample(std::max<uint32_t>(width >> (i-1), 1),
+                 std::max<uint32_t>(height >> (i-1), 1),
+                 &entry->pixels[entry->mipOffsets[i-1]],
+                 &entry->pixels[entry->mipOffsets[i]]);
+   }
+   
+   entry->previewMip = 0;
+   while (entry->previewMip+1 < numMips && (std::max(width, height) >> entry->previewMip) > PreviewSize)
+      entry->previewMip++;
+   entry->residentMip = entry->previewMip;
+   entry->targetMip = entry->previewMip;
+   
+   if (!uploadMip(*entry, entry->previewMip))
+   {
+      MemTracker::trackFree(MemCategory_Bitmap, totalSize);
+      delete entry;
+      return -1;
+   }
+   
+   // Anything finer than the preview can be decoded again when it's needed
+   if (entry->reload)
+      trimCPUMips(*entry, entry->previewMip);
+   
+   mEntryLookup[entry->texID] = (uint32_t)mEntries.size();
+   mEntries.push_back(entry);
+   return entry->texID;
+}
+
+bool TextureStreamer::removeTexture(int32_t texID)
+{
+   auto itr = mEntryLookup.find(texID);
+   if (itr == mEntryLookup.end())
+      return false;
+   
+   uint32_t idx = itr->second;
+   Entry* entry = mEntries[idx];
+   mEntryLookup.erase(itr);
+   
+   mDelete(entry->texID);
+   MemTracker::trackFree(MemCategory_Bitmap, entry->pixels.size());
+   delete entry;
+   
+   if (idx+1 < mEntries.size())
+   {
+      mEntries[idx] = mEntries.back();
+      mEntryLookup[mEntries[idx]->texID] = idx;
+   }
+   mEntries.pop_back();
+   return true;
+}
+
+void TextureStreamer::clear()
+{
+   for (Entry* entry : mEntries)
+   {
+      mDelete(entry->texID);
+      MemTracker::trackFree(MemCategory_Bitmap, entry->pixels.size());
+      delete entry;
+   }
+   
+   mEntries.clear();
+   mEntryLookup.clear();
+}
+
+void TextureStreamer::requestSize(int32_t texID, float texels)
+{
+   auto itr = mEntryLookup.find(texID);
+   if (itr == mEntryLookup.end())
+      return;
+   
+   Entry* entry = mEntries[itr->second];
+   entry->frameRequest = std::max(entry->frameRequest, texels);
+}
+
+int32_t TextureStreamer::getResidentMip(int32_t texID) const
+{
+   auto itr = mEntryLookup.find(texID);
+   return itr != mEntryLookup.end() ? (int32_t)mEntries[itr->second]->residentMip : -1;
+}
+
+uint64_t TextureStreamer::getResidentBytes(int32_t texID) const
+{
+   auto itr = mEntryLookup.find(texID);
+   if (itr == mEntryLookup.end())
+      return 0;
+   
+   const Entry* entry = mEntries[itr->second];
+   return getMipBytes(entry->width, entry->height, entry->residentMip);
+}
+
+uint32_t TextureStreamer::calcWantedMip(const Entry& entry) const
+{
+   if (mFrame - entry.lastRequestFrame > IdleFrames || entry.lastRequest <= 0.0f)
+      return entry.previewMip;
+   
+   // Smallest mip which still has at least the requested number of texels
+   uint32_t maxDim = std::max(entry.width, entry.height);
+   uint32_t mip = entry.reloadFailed ? entry.firstCPUMip : 0;
+   while (mip < entry.previewMip && (float)(maxDim >> (mip+1)) >= entry.lastRequest)
+      mip++;
+   return mip;
+}
+
+bool TextureStreamer::uploadMip(Entry& entry, uint32_t mip)
+{
+   if (mip < entry.firstCPUMip)
+      return false;
+   
+   uint32_t w = std::max<uint32_t>(entry.width >> mip, 1);
+   uint32_t h = std::max<uint32_t>(entry.height >> mip, 1);
+   const uint8_t* pixels = &entry.pixels[entry.mipOffsets[mip] - entry.mipOffsets[entry.firstCPUMip]];
+   
+   int32_t texID = mUpload(entry.texID, w, h, pixels);
+   if (texID < 0)
+      return false;
+   
+   entry.texID = texID;
+   entry.residentMip = mip;
+   mStats.uploads++;
+   mStats.uploadedBytes += getMipBytes(entry.width, entry.height, mip);
+   return true;
+}
+
+void TextureStreamer::trimCPUMips(Entry& entry, uint32_t mip)
+{
+   if (mip <= entry.firstCPUMip)
+      return;
+   
+   size_t base = entry.mipOffsets[mip] - entry.mipOffsets[entry.firstCPUMip];
+   std::vector<uint8_t> coarse(entry.pixels.begin() + base, entry.pixels.end());
+   entry.pixels.swap(coarse);
+   entry.firstCPUMip = mip;
+   MemTracker::trackFree(MemCategory_Bitmap, base);
+}
+
+bool TextureStreamer::startReload(Entry& entry, uint32_t mip)
+{
+   std::shared_ptr<ReloadJob> job = std::make_shared<ReloadJob>();
+   job->width = entry.width;
+   job->height = entry.height;
+   job->firstMip = mip;
+   job->state = ReloadJob::Pending;
+   
+   // Runs on the reload's thread; only touches the job, as the streamer may be gone
+   bool started = entry.reload([job](bool ok, std::vector<uint8_t>& src, uint32_t numSrcMips) {
+      numSrcMips = std::max(numSrcMips, 1U);
+      if (!ok || src.size() < getChainSize(job->width, job->height, numSrcMips))
+      {
+         job->state.store(ReloadJob::Failed, std::memory_order_release);
+         return;
+      }
+      
+      // Rebuild the chain the same way addTexture did
+      buildMipChain(job->width, job->height, src, numSrcMips, job->firstMip, job->pixels);
+      job->state.store(ReloadJob::Done, std::memory_order_release);
+   });
+   
+   if (!started)
+   {
+      entry.reloadFailed = true;
+      mStats.failedReloads++;
+      return false;
+   }
+   
+   entry.reloadJob = job;
+   mStats.reloads++;
+   return true;
+}
+
+void TextureStreamer::finishReload(Entry& entry)
+{
+   ReloadJob* job = entry.reloadJob.get();
+   uint32_t state = job->state.load(std::memory_order_acquire);
+   if (state == ReloadJob::Pending)
+      return;
+   
+   bool matches = job->pixels.size() == entry.mipOffsets[entry.numMips-1] + 4 - entry.mipOffsets[job->firstMip];
+   if (state == ReloadJob::Done && matches)
+   {
+      // Coarser mips may have been trimmed since the reload started
+      if (job->firstMip < entry.firstCPUMip)
+      {
+         MemTracker::trackAlloc(MemCategory_Bitmap, job->pixels.size());
+         MemTracker::trackFree(MemCategory_Bitmap, entry.pixels.size());
+         entry.pixels.swap(job->pixels);
+         entry.firstCPUMip = job->firstMip;
+      }
+   }
+   else
+   {
+      // Stick with what's on the CPU rather than retrying every frame
+      entry.reloadFailed = true;
+      mStats.failedReloads++;
+   }
+   
+   entry.reloadJob.reset();
+}
+
+void TextureStreamer::update()
+{
+   mFrame++;
+   mStats = {};
+   mStats.numTextures = (uint32_t)mEntries.size();
+   
+   for (Entry* entry : mEntries)
+   {
+      if (entry->reloadJob)
+         finishReload(*entry);
+   }
+   
+   // Pick targets, keeping any extra resolution that's already resident
+   uint64_t targetBytes = 0;
+   for (Entry* entry : mEntries)
+   {
+      if (entry->frameRequest > 0.0f)
+      {
+         entry->lastRequest = entry->frameRequest;
+         entry->lastRequestFrame = mFrame;
+         entry->frameRequest = 0.0f;
+      }
+      
+      uint32_t wanted = calcWantedMip(*entry);
+      entry->targetMip = std::min(entry->residentMip, wanted);
+      targetBytes += getMipBytes(entry->width, entry->height, entry->targetMip);
+      mStats.wantedBytes += getMipBytes(entry->width, entry->height, wanted);
+   }
+   
+   // Drop whatever has the most texels per requested texel until everything fits
+   if (targetBytes > mBudgetBytes)
+   {
+      auto calcExcess = [this](const Entry* entry) {
+         float texels = getMipTexels(entry->width, entry->height, entry->targetMip);
+         if (mFrame - entry->lastRequestFrame > IdleFrames || entry->lastRequest <= 0.0f)
+            return texels * 1.0e6f;
+         return texels / std::max(entry->lastRequest, 1.0f);
+      };
+      
+      std::priority_queue<std::pair<float, uint32_t> > queue;
+      for (uint32_t i=0; i<mEntries.size(); i++)
+      {
+         if (mEntries[i]->targetMip < mEntries[i]->previewMip)
+            queue.push(std::make_pair(calcExcess(mEntries[i]), i));
+      }
+      
+      while (targetBytes > mBudgetBytes && !queue.empty())
+      {
+         Entry* entry = mEntries[queue.top().second];
+         uint32_t idx = queue.top().second;
+         queue.pop();
+         
+         targetBytes -= getMipBytes(entry->width, entry->height, entry->targetMip);
+         entry->targetMip++;
+         targetBytes += getMipBytes(entry->width, entry->height, entry->targetMip);
+         
+         if (entry->targetMip < entry->previewMip)
+            queue.push(std::make_pair(calcExcess(entry), idx));
+      }
+   }
+   
+   // Drops free memory so always go through. Mips coarser than the resident one
+   // are kept on the CPU, so if an upload fails the next coarser mip is tried.
+   std::vector<Entry*> raises;
+   for (Entry* entry : mEntries)
+   {
+      if (entry->targetMip > entry->residentMip)
+      {
+         for (uint32_t mip=entry->targetMip; mip<entry->numMips; mip++)
+         {
+            if (uploadMip(*entry, mip))
+            {
+               mStats.evictions++;
+               break;
+            }
+         }
+      }
+      else if (entry->targetMip < entry->residentMip)
+      {
+         raises.push_back(entry);
+      }
+   }
+   
+   // Raise the blurriest textures first
+   std::sort(raises.begin(), raises.end(), [](const Entry* a, const Entry* b) {
+      return (a->lastRequest / getMipTexels(a->width, a->height, a->residentMip)) >
+             (b->lastRequest / getMipTexels(b->width, b->height, b->residentMip));
+   });
+   
+   uint64_t frameBytes = 0;
+   uint32_t numRaised = 0;
+   for (Entry* entry : raises)
+   {
+      uint32_t mip = entry->targetMip;
+      while (mip < entry->residentMip && frameBytes + getMipBytes(entry->width, entry->height, mip) > mUploadBytesPerFrame)
+         mip++;
+      
+      // A single step is always allowed so large textures can't stall forever
+      if (mip == entry->residentMip && numRaised == 0)
+         mip = entry->residentMip - 1;
+      
+      if (mip == entry->residentMip)
+      {
+         mStats.deferred++;
+         continue;
+      }
+      
+      if (mip < entry->firstCPUMip)
+      {
+         // Decode the source for a later frame, counting it like an upload
+         uint64_t srcBytes = (uint64_t)entry->width * entry->height * 4;
+         mStats.deferred++;
+         if (entry->reloadJob || (frameBytes + srcBytes > mUploadBytesPerFrame && numRaised > 0))
+            continue;
+         
+         if (startReload(*entry, entry->targetMip))
+         {
+            frameBytes += srcBytes;
+            numRaised++;
+         }
+         continue;
+      }
+      
+      if (mip != entry->targetMip)
+         mStats.deferred++;
+      
+      if (uploadMip(*entry, mip))
+      {
+         frameBytes += getMipBytes(entry->width, entry->height, mip);
+         numRaised++;
+      }
+   }
+   
+   for (Entry* entry : mEntries)
+   {
+      // Only keep what a drop (or a pending raise) needs on the CPU
+      if (entry->reload)
+      {
+         uint32_t keepMip = entry->targetMip < entry->residentMip ? entry->targetMip : entry->residentMip+1;
+         trimCPUMips(*entry, std::min(keepMip, entry->previewMip));
+      }
+      
+      mStats.residentBytes += getMipBytes(entry->width, entry->height, entry->residentMip);
+      mStats.reloadsPending += entry->reloadJob ? 1 : 0;
+   }
+}
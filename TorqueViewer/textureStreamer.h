@@ -0,0 +1,182 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _TEXTURESTREAMER_H_
+#define _TEXTURESTREAMER_H_
+
+#include <stdint.h>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <unordered_map>
+
+/*
+ Keeps material textures within a GPU memory budget by only uploading as much
+ of each texture's mip chain as is needed on screen.
+ 
+ An RGBA8 mip chain is kept on the CPU, and a texture starts off with a
+ small preview mip resident. Mips the source already stores are used as they
+ are; only the ones past them are box filtered. Textures added with a reload function only keep
+ the mips coarser than the resident one, so any drop can be served straight
+ away. Finer mips are rebuilt from the source image off the main thread (the
+ reload normally decodes on an AsyncReader worker), then uploaded by a later
+ update() and freed again. Each frame viewers report how many texels they
+ would like across one repeat of a texture (i.e. the on-screen size of the
+ surfaces using it), and update() picks a target mip for each texture:
+ 
+ - Textures keep whatever resolution they have while there's room, so moving
+   back and forth doesn't cause repeated uploads.
+ - If the targets don't fit in the budget, the texture with the most texels
+   per requested texel drops a mip until they do. Textures which haven't been
+   requested for a while go first.
+ - Drops are applied straight away. Raises are done most-needed first and
+   limited to a number of bytes per frame so loading doesn't cause hitches;
+   if a full raise won't fit, the largest mip that does is used instead.
+   Starting a reload counts the decoded source size against the same limit.
+ 
+ The renderer only gets a single level at a time, so changing mip replaces
+ the texture contents while keeping the same texID.
+ */
+class TextureStreamer
+{
+public:
+   
+   enum
+   {
+      PreviewSize = 32,  // largest dimension of the initial mip, which is always resident
+      IdleFrames = 120,  // updates without a request before a texture is treated as unused
+      MaxMips = 16
+   };
+   
+   // Creates a texture if texID < 0, otherwise replaces texID's contents. Returns the texID or -1.
+   typedef std::function<int32_t(int32_t texID, uint32_t width, uint32_t height, const uint8_t* pixels)> UploadFunc;
+   typedef std::function<void(int32_t texID)> DeleteFunc;
+   // Called from any thread with the source image decoded as RGBA8 at its original size,
+   // plus any further stored mips (numMips in total) laid out back to back
+   typedef std::function<void(bool ok, std::vector<uint8_t>& pixels, uint32_t numMips)> ReloadDoneFunc;
+   // Starts decoding the source image again, calling onDone when finished. Returns false if it couldn't start.
+   typedef std::function<bool(ReloadDoneFunc onDone)> ReloadFunc;
+   
+   struct Stats
+   {
+      uint64_t residentBytes;
+      uint64_t wantedBytes;   // what would be resident with no budget
+      uint64_t uploadedBytes;
+      uint32_t uploads;
+      uint32_t evictions;     // mip drops due to the budget or idle textures
+      uint32_t deferred;      // raises pushed back to a later frame
+      uint32_t reloads;       // reloads of the source image started
+      uint32_t reloadsPending;
+      uint32_t failedReloads;
+      uint32_t numTextures;
+   };
+   
+   uint64_t mBudgetBytes;
+   uint64_t mUploadBytesPerFrame;
+   Stats mStats; // for the last update
+   
+   TextureStreamer(UploadFunc upload, DeleteFunc del);
+   ~TextureStreamer();
+   
+   // Uploads the preview mip of an RGBA8 image, returning its texID. pixels can hold numSrcMips
+   // stored mips back to back (e.g. from a BM8), and only mips past those are built here.
+   int32_t addTexture(uint32_t width, uint32_t height, const uint8_t* pixels, ReloadFunc reload=ReloadFunc(), uint32_t numSrcMips=1);
+   
+   // Size of numMips mips laid out back to back from mip 0
+   static size_t getChainSize(uint32_t width, uint32_t height, uint32_t numMips);
+   
+   // Returns false if texID wasn't added through the streamer
+   bool removeTexture(int32_t texID);
+   
+   // Requests at least texels across one repeat of texID for this frame
+   void requestSize(int32_t texID, float texels);
+   
+   void update();
+   void clear();
+   
+   // Returns the resident mip of texID, or -1
+   int32_t getResidentMip(int32_t texID) const;
+   
+   // Returns the GPU size of texID's resident mip, or 0
+   uint64_t getResidentBytes(int32_t texID) const;
+   
+   // GPU size of a mip, which the renderer pads to powers of 2
+   static uint64_t getMipBytes(uint32_t width, uint32_t height, uint32_t mip);
+   
+   // Box filters src (RGBA8) down to half size, rounding down to a minimum of 1
+   static void downsample(uint32_t width, uint32_t height, const uint8_t* src, uint8_t* dest);
+   
+protected:
+   
+   // Mip chain being rebuilt from a reload; shared with the reload's callback so the
+   // entry can be removed while it's in flight
+   struct ReloadJob
+   {
+      enum
+      {
+         Pending,
+         Done,
+         Failed
+      };
+      
+      uint32_t width;
+      uint32_t height;
+      uint32_t firstMip;
+      std::vector<uint8_t> pixels; // chain from firstMip down, laid out like Entry::pixels
+      std::atomic<uint32_t> state;
+   };
+   
+   struct Entry
+   {
+      int32_t texID;
+      uint32_t width;
+      uint32_t height;
+      uint32_t numMips;
+      uint32_t previewMip;
+      uint32_t residentMip;
+      uint32_t targetMip;
+      float frameRequest;  // max request this frame
+      float lastRequest;   // last frame with any request
+      uint32_t lastRequestFrame;
+      size_t mipOffsets[MaxMips];  // in the full chain
+      uint32_t firstCPUMip;        // pixels starts at this mip
+      std::vector<uint8_t> pixels;
+      ReloadFunc reload;
+      std::shared_ptr<ReloadJob> reloadJob;
+      bool reloadFailed;  // mips finer than firstCPUMip can't be rebuilt
+   };
+   
+   UploadFunc mUpload;
+   DeleteFunc mDelete;
+   std::vector<Entry*> mEntries;
+   std::unordered_map<int32_t, uint32_t> mEntryLookup; // texID -> mEntries index
+   uint32_t mFrame;
+   
+   uint32_t calcWantedMip(const Entry& entry) const;
+   bool uploadMip(Entry& entry, uint32_t mip);
+   bool startReload(Entry& entry, uint32_t mip);
+   void finishReload(Entry& entry);
+   void trimCPUMips(Entry& entry, uint32_t mip);
+};
+
+#endif
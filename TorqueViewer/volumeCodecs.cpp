@@ -0,0 +1,433 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <string.h>
+#include <algorithm>
+#include "volumeCodecs.h"
+
+// Without USE_ZSTD entries are decoded by the vendored single file decoder
+#ifdef TV_ZSTD
+#include <zstd.h>
+#else
+#include "zstd/zstd.h"
+#endif
+
+uint32_t zipCRC32(const void* data, size_t size, uint32_t crc)
+{
+   static uint32_t sTable[256];
+   static bool sTableBuilt = false;
+   if (!sTableBuilt)
+   {
+      for (uint32_t i=0; i<256; i++)
+      {
+         uint32_t value = i;
+         for (uint32_t j=0; j<8; j++)
+            value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+         sTable[i] = value;
+      }
+      sTableBuilt = true;
+   }
+   
+   const uint8_t* ptr = (const uint8_t*)data;
+   crc = ~crc;
+   for (size_t i=0; i<size; i++)
+      crc = sTable[(crc ^ ptr[i]) & 0xFF] ^ (crc >> 8);
+   return ~crc;
+}
+
+static inline uint32_t readLE32(const uint8_t* ptr)
+{
+   uint32_t value;
+   memcpy(&value, ptr, 4);
+   return value;
+}
+
+static inline void appendLE32(std::vector<uint8_t>& out, uint32_t value)
+{
+   for (uint32_t i=0; i<4; i++)
+      out.push_back((uint8_t)(value >> (i * 8)));
+}
+
+static inline uint32_t rotl32(uint32_t value, uint32_t bits)
+{
+   return (value << bits) | (value >> (32 - bits));
+}
+
+uint32_t LZ4Codec::xxHash32(const void* data, size_t size, uint32_t seed)
+{
+   const uint32_t prime1 = 2654435761U;
+   const uint32_t prime2 = 2246822519U;
+   const uint32_t prime3 = 3266489917U;
+   const uint32_t prime4 = 668265263U;
+   const uint32_t prime5 = 374761393U;
+   
+   const uint8_t* ptr = (const uint8_t*)data;
+   const uint8_t* end = ptr + size;
+   uint32_t hash = 0;
+   
+   if (size >= 16)
+   {
+      uint32_t v[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+      while (ptr + 16 <= end)
+      {
+         for (uint32_t i=0; i<4; i++)
+         {
+            v[i] = rotl32(v[i] + readLE32(ptr) * prime2, 13) * prime1;
+            ptr += 4;
+         }
+      }
+      hash = rotl32(v[0], 1) + rotl32(v[1], 7) + rotl32(v[2], 12) + rotl32(v[3], 18);
+   }
+   else
+   {
+      hash = seed + prime5;
+   }
+   
+   hash += (uint32_t)size;
+   while (ptr + 4 <= end)
+   {
+      hash = rotl32(hash + readLE32(ptr) * prime3, 17) * prime4;
+      ptr += 4;
+   }
+   while (ptr < end)
+   {
+      hash = rotl32(hash + (*ptr) * prime5, 11) * prime1;
+      ptr++;
+   }
+   
+   hash ^= hash >> 15;
+   hash *= prime2;
+   hash ^= hash >> 13;
+   hash *= prime3;
+   hash ^= hash >> 16;
+   return hash;
+}
+
+static void writeLength(std::vector<uint8_t>& out, size_t length)
+{
+   while (length >= 255)
+   {
+      out.push_back(255);
+      length -= 255;
+   }
+   out.push_back((uint8_t)length);
+}
+
+static void writeSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t numLiterals, uint32_t offset, size_t matchLength)
+{
+   // matchLength == 0 is the final literal-only sequence
+   size_t matchCode = matchLength > 0 ? matchLength - 4 : 0;
+   out.push_back((uint8_t)((std::min<size_t>(numLiterals, 15) << 4) | std::min<size_t>(matchCode, 15)));
+   if (numLiterals >= 15)
+      writeLength(out, numLiterals - 15);
+   out.insert(out.end(), literals, literals + numLiterals);
+   
+   if (matchLength == 0)
+      return;
+   
+   out.push_back((uint8_t)(offset & 0xFF));
+   out.push_back((uint8_t)(offset >> 8));
+   if (matchCode >= 15)
+      writeLength(out, matchCode - 15);
+}
+
+void LZ4Codec::compressBlock(const uint8_t* data, size_t size, std::vector<uint8_t>& outData)
+{
+   enum
+   {
+      HashBits = 16,
+      MinMatch = 4,
+      LastLiterals = 5, // format requires the block to end with literals
+      MatchLimit = 12,  // ... and the last match to start this far from the end
+      MaxOffset = 65535
+   };
+   
+   size_t anchor = 0;
+   if (size > MatchLimit)
+   {
+      std::vector<int32_t> table(1 << HashBits, -1);
+      size_t pos = 0;
+      size_t limit = size - MatchLimit;
+      size_t matchEnd = size - LastLiterals;
+      
+      while (pos < limit)
+      {
+         uint32_t sequence = readLE32(data + pos);
+         uint32_t hash = (sequence * 2654435761U) >> (32 - HashBits);
+         int32_t ref = table[hash];
+         table[hash] = (int32_t)pos;
+         
+         if (ref < 0 || pos - ref > MaxOffset || readLE32(data + ref) != sequence)
+         {
+            // Skip faster through data which isn't matching
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+         }
+         
+         size_t length = MinMatch;
+         while (pos + length < matchEnd && data[ref + length] == data[pos + length])
+            length++;
+         
+         writeSequence(outData, data + anchor, pos - anchor, (uint32_t)(pos - ref), length);
+         pos += length;
+         anchor = pos;
+         
+         if (pos < limit)
+         {
+            uint32_t prev = readLE32(data + pos - 2);
+            table[(prev * 2654435761U) >> (32 - HashBits)] = (int32_t)(pos - 2);
+         }
+      }
+   }
+   
+   writeSequence(outData, data + anchor, size - anchor, 0, 0);
+}
+
+int64_t LZ4Codec::decompressBlock(const uint8_t* data, size_t size, uint8_t* out, size_t outPos, size_t outEnd)
+{
+   const uint8_t* ip = data;
+   const uint8_t* inEnd = data + size;
+   uint8_t* op = out + outPos;
+   uint8_t* opEnd = out + outEnd;
+   
+   while (ip < inEnd)
+   {
+      uint32_t token = *ip++;
+      
+      size_t numLiterals = token >> 4;
+      if (numLiterals == 15)
+      {
+         uint32_t value = 255;
+         while (value == 255 && ip < inEnd)
+         {
+            value = *ip++;
+            numLiterals += value;
+         }
+      }
+      
+      if (numLiterals > (size_t)(inEnd - ip) || numLiterals > (size_t)(opEnd - op))
+         return -1;
+      
+      // Short runs are most common; copy a fixed 16 bytes when there's room
+      if (numLiterals <= 16 && ip + 16 <= inEnd && op + 16 <= opEnd)
+         memcpy(op, ip, 16);
+      else
+         memcpy(op, ip, numLiterals);
+      ip += numLiterals;
+      op += numLiterals;
+      
+      // Last sequence has no match
+      if (ip >= inEnd)
+         break;
+      
+      if (inEnd - ip < 2)
+         return -1;
+      size_t offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (size_t)(op - out))
+         return -1;
+      
+      size_t matchLength = (token & 0xF) + 4;
+      if (matchLength == 19)
+      {
+         uint32_t value = 255;
+         while (value == 255 && ip < inEnd)
+         {
+            value = *ip++;
+            matchLength += value;
+         }
+      }
+      
+      if (matchLength > (size_t)(opEnd - op))
+         return -1;
+      
+      const uint8_t* src = op - offset;
+      uint8_t* dest = op;
+      op += matchLength;
+      if (offset >= 16 && op + 16 <= opEnd)
+      {
+         // Chunks can't overlap, and overshoot is rewritten by later sequences
+         do
+         {
+            memcpy(dest, src, 16);
+            dest += 16;
+            src += 16;
+         } while (dest < op);
+      }
+      else if (offset >= matchLength)
+      {
+         memcpy(dest, src, matchLength);
+      }
+      else
+      {
+         for (; dest < op; dest++, src++)
+            *dest = *src;
+      }
+   }
+   
+   return op - out;
+}
+
+void LZ4Codec::compress(const uint8_t* data, size_t size, std::vector<uint8_t>& outData)
+{
+   outData.clear();
+   outData.reserve(size / 2 + 64);
+   
+   appendLE32(outData, FrameMagic);
+   
+   // Version 1, independent blocks, content size present; 4MB blocks
+   size_t descStart = outData.size();
+   outData.push_back(0x68);
+   outData.push_back(0x70);
+   for (uint32_t i=0; i<8; i++)
+      outData.push_back((uint8_t)((uint64_t)size >> (i * 8)));
+   outData.push_back((uint8_t)(xxHash32(outData.data() + descStart, outData.size() - descStart) >> 8));
+   
+   std::vector<uint8_t> block;
+   for (size_t pos=0; pos<size; pos += MaxBlockSize)
+   {
+      size_t blockSize = std::min<size_t>(size - pos, MaxBlockSize);
+      block.clear();
+      compressBlock(data + pos, blockSize, block);
+      
+      // Incompressible blocks are stored, flagged by the high bit
+      if (block.size() >= blockSize)
+      {
+         appendLE32(outData, (uint32_t)blockSize | 0x80000000);
+         outData.insert(outData.end(), data + pos, data + pos + blockSize);
+      }
+      else
+      {
+         appendLE32(outData, (uint32_t)block.size());
+         outData.insert(outData.end(), block.begin(), block.end());
+      }
+   }
+   
+   appendLE32(outData, 0);
+}
+
+bool LZ4Codec::decompress(const uint8_t* data, size_t size, uint8_t* out, size_t outSize)
+{
+   if (size < 7 || readLE32(data) != FrameMagic)
+      return false;
+   
+   const uint8_t* ptr = data + 4;
+   const uint8_t* end = data + size;
+   
+   uint8_t flags = ptr[0];
+   bool blockChecksum = (flags & 0x10) != 0;
+   bool hasContentSize = (flags & 0x08) != 0;
+   bool contentChecksum = (flags & 0x04) != 0;
+   if ((flags >> 6) != 1 || (flags & 0x01) != 0)
+      return false; // unknown version or needs a dictionary
+   
+   size_t descSize = 2 + (hasContentSize ? 8 : 0);
+   if ((size_t)(end - ptr) < descSize + 1)
+      return false;
+   
+   if (hasContentSize)
+   {
+      uint64_t contentSize = 0;
+      memcpy(&contentSize, ptr + 2, 8);
+      if (contentSize != outSize)
+         return false;
+   }
+   
+   if (ptr[descSize] != (uint8_t)(xxHash32(ptr, descSize) >> 8))
+      return false;
+   ptr += descSize + 1;
+   
+   // Blocks are decoded back to back so linked frames also work
+   size_t outPos = 0;
+   for (;;)
+   {
+      if (end - ptr < 4)
+         return false;
+      uint32_t blockSize = readLE32(ptr);
+      ptr += 4;
+      if (blockSize == 0)
+         break;
+      
+      bool stored = (blockSize & 0x80000000) != 0;
+      blockSize &= 0x7FFFFFFF;
+      if (blockSize > (size_t)(end - ptr))
+         return false;
+      
+      if (stored)
+      {
+         if (blockSize > outSize - outPos)
+            return false;
+         memcpy(out + outPos, ptr, blockSize);
+         outPos += blockSize;
+      }
+      else
+      {
+         int64_t newPos = decompressBlock(ptr, blockSize, out, outPos, outSize);
+         if (newPos < 0)
+            return false;
+         outPos = (size_t)newPos;
+      }
+      
+      ptr += blockSize + (blockChecksum ? 4 : 0);
+   }
+   
+   if (contentChecksum && end - ptr < 4)
+      return false;
+   
+   return outPos == outSize;
+}
+
+bool ZstdCodec::canCompress()
+{
+#ifdef TV_ZSTD
+   return true;
+#else
+   return false;
+#endif
+}
+
+bool ZstdCodec::compress(const uint8_t* data, size_t size, std::vector<uint8_t>& outData, int level)
+{
+#ifdef TV_ZSTD
+   outData.resize(ZSTD_compressBound(size));
+   size_t outSize = ZSTD_compress(outData.data(), outData.size(), data, size, level);
+   if (ZSTD_isError(outSize))
+   {
+      outData.clear();
+      return false;
+   }
+   outData.resize(outSize);
+   return true;
+#else
+   (void)data;
+   (void)size;
+   (void)level;
+   outData.clear();
+   return false;
+#endif
+}
+
+bool ZstdCodec::decompress(const uint8_t* data, size_t size, uint8_t* out, size_t outSize)
+{
+   size_t result = ZSTD_decompress(out, outSize, data, size);
+   return !ZSTD_isError(result) && result == outSize;
+}
@@ -0,0 +1,94 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _VOLUMECODECS_H_
+#define _VOLUMECODECS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Zip compression methods which Volume can read. APPNOTE doesn't assign an id
+// to LZ4, so it uses one from the unassigned range.
+enum ZipMethod : uint16_t
+{
+   ZipMethod_Store = 0,
+   ZipMethod_Deflate = 8,
+   ZipMethod_Zstd = 93,
+   ZipMethod_LZ4 = 0x4C34
+};
+
+extern uint32_t zipCRC32(const void* data, size_t size, uint32_t crc=0);
+
+/*
+ LZ4 frame format codec. Volumes care about load speed far more than size, and
+ LZ4 decodes several times faster than deflate as it has no entropy coding;
+ each sequence is just a literal run and a match copy.
+ 
+ The encoder is a plain greedy hash matcher (roughly the reference "fast" mode)
+ and writes independent 4MB blocks with the content size set. The decoder handles
+ any single frame without a dictionary, with block checksums skipped.
+ */
+class LZ4Codec
+{
+public:
+   
+   enum
+   {
+      FrameMagic = 0x184D2204,
+      MaxBlockSize = 4 * 1024 * 1024
+   };
+   
+   static void compress(const uint8_t* data, size_t size, std::vector<uint8_t>& outData);
+   
+   // Output must be exactly outSize bytes
+   static bool decompress(const uint8_t* data, size_t size, uint8_t* out, size_t outSize);
+   
+   // Raw blocks. decompressBlock writes at out[outPos..outEnd), matches can
+   // reach back to out[0]. Returns the new output position or -1.
+   static void compressBlock(const uint8_t* data, size_t size, std::vector<uint8_t>& outData);
+   static int64_t decompressBlock(const uint8_t* data, size_t size, uint8_t* out, size_t outPos, size_t outEnd);
+   
+   static uint32_t xxHash32(const void* data, size_t size, uint32_t seed=0);
+};
+
+/*
+ Zstandard entries can always be decoded, using the single file decoder in
+ include/zstd. Writing them needs the full library, so compress only works
+ when built with USE_ZSTD, which links the system libzstd instead.
+ */
+class ZstdCodec
+{
+public:
+   
+   enum
+   {
+      DefaultLevel = 19
+   };
+   
+   static bool canCompress();
+   
+   static bool compress(const uint8_t* data, size_t size, std::vector<uint8_t>& outData, int level=DefaultLevel);
+   static bool decompress(const uint8_t* data, size_t size, uint8_t* out, size_t outSize);
+};
+
+#endif
@@ -0,0 +1,218 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <string.h>
+#include <algorithm>
+#include "volumeWriter.h"
+#include "volumeCodecs.h"
+
+static void appendLE(std::vector<uint8_t>& out, uint64_t value, uint32_t bytes)
+{
+   for (uint32_t i=0; i<bytes; i++)
+      out.push_back((uint8_t)(value >> (i * 8)));
+}
+
+// APPNOTE version needed to extract
+static uint16_t getVersionNeeded(uint16_t method)
+{
+   return method == ZipMethod_Store ? 10 : 63;
+}
+
+// DOS date for 1980-01-01; 0 isn't a valid date
+static const uint16_t sEntryDate = (1 << 5) | 1;
+
+VolumeWriter::VolumeWriter() : mFile(NULL), mOffset(0)
+{
+   mStats = {};
+}
+
+VolumeWriter::~VolumeWriter()
+{
+   if (mFile)
+      fclose(mFile);
+}
+
+bool VolumeWriter::open(const char* filename)
+{
+   mFile = fopen(filename, "wb");
+   if (mFile == NULL)
+   {
+      printf("VolumeWriter: couldn't write %s\n", filename);
+      return false;
+   }
+   
+   mOffset = 0;
+   mEntries.clear();
+   mStats = {};
+   return true;
+}
+
+bool VolumeWriter::write(const void* data, size_t size)
+{
+   if (fwrite(data, 1, size, mFile) != size)
+      return false;
+   mOffset += size;
+   return true;
+}
+
+bool VolumeWriter::addEntry(const char* name, const uint8_t* data, size_t size, uint16_t method, uint32_t alignment)
+{
+   if (mFile == NULL)
+      return false;
+   
+   // Name and alignment extra lengths are 16 bit; extra is 6 bytes + up to alignment-1 padding
+   if (strlen(name) > 0xFFFF || alignment > 0xFFFF - 5)
+   {
+      printf("VolumeWriter: %s name or alignment too large\n", name);
+      return false;
+   }
+   
+   std::vector<uint8_t> compressed;
+   if (method == ZipMethod_LZ4)
+   {
+      LZ4Codec::compress(data, size, compressed);
+   }
+   else if (method == ZipMethod_Zstd)
+   {
+      if (!ZstdCodec::compress(data, size, compressed))
+      {
+         printf("VolumeWriter: writing zstd entries needs USE_ZSTD (%s)\n", name);
+         return false;
+      }
+   }
+   else if (method != ZipMethod_Store)
+   {
+      printf("VolumeWriter: can't write method %u for %s\n", method, name);
+      return false;
+   }
+   
+   // Not worth the decode
+   if (method != ZipMethod_Store && compressed.size() >= size - (size / 16))
+      method = ZipMethod_Store;
+   
+   const uint8_t* entryData = method == ZipMethod_Store ? data : compressed.data();
+   size_t entrySize = method == ZipMethod_Store ? size : compressed.size();
+   
+   if (size > UINT32_MAX || entrySize > UINT32_MAX || mOffset > UINT32_MAX)
+   {
+      printf("VolumeWriter: %s doesn't fit without zip64\n", name);
+      return false;
+   }
+   
+   Entry entry;
+   entry.name = name;
+   entry.method = method;
+   entry.crc32 = zipCRC32(data, size);
+   entry.compressedSize = (uint32_t)entrySize;
+   entry.uncompressedSize = (uint32_t)size;
+   entry.headerOffset = (uint32_t)mOffset;
+   
+   uint32_t nameLen = (uint32_t)entry.name.size();
+   
+   std::vector<uint8_t> extra;
+   if (method == ZipMethod_Store && alignment > 1)
+   {
+      uint64_t dataStart = mOffset + 30 + nameLen + 6;
+      uint64_t padding = (alignment - (dataStart % alignment)) % alignment;
+      appendLE(extra, AlignmentExtraID, 2);
+      appendLE(extra, 2 + padding, 2);
+      appendLE(extra, alignment, 2);
+      extra.resize(extra.size() + padding, 0);
+      mStats.paddingBytes += extra.size();
+   }
+   
+   std::vector<uint8_t> header;
+   appendLE(header, 0x04034b50, 4);
+   appendLE(header, getVersionNeeded(method), 2);
+   appendLE(header, 0, 2);
+   appendLE(header, method, 2);
+   appendLE(header, 0, 2);
+   appendLE(header, sEntryDate, 2);
+   appendLE(header, entry.crc32, 4);
+   appendLE(header, entry.compressedSize, 4);
+   appendLE(header, entry.uncompressedSize, 4);
+   appendLE(header, nameLen, 2);
+   appendLE(header, extra.size(), 2);
+   header.insert(header.end(), entry.name.begin(), entry.name.end());
+   header.insert(header.end(), extra.begin(), extra.end());
+   
+   if (!write(header.data(), header.size()) || !write(entryData, entrySize))
+   {
+      printf("VolumeWriter: couldn't write %s\n", name);
+      return false;
+   }
+   
+   mEntries.push_back(entry);
+   mStats.numEntries++;
+   mStats.numMethod[method == ZipMethod_Store ? 0 : method == ZipMethod_LZ4 ? 1 : 2]++;
+   mStats.inputBytes += size;
+   mStats.outputBytes += entrySize;
+   return true;
+}
+
+bool VolumeWriter::close()
+{
+   if (mFile == NULL)
+      return false;
+   
+   uint64_t cdOffset = mOffset;
+   std::vector<uint8_t> data;
+   for (const Entry& entry : mEntries)
+   {
+      appendLE(data, 0x02014b50, 4);
+      appendLE(data, 63, 2);
+      appendLE(data, getVersionNeeded(entry.method), 2);
+      appendLE(data, 0, 2);
+      appendLE(data, entry.method, 2);
+      appendLE(data, 0, 2);
+      appendLE(data, sEntryDate, 2);
+      appendLE(data, entry.crc32, 4);
+      appendLE(data, entry.compressedSize, 4);
+      appendLE(data, entry.uncompressedSize, 4);
+      appendLE(data, entry.name.size(), 2);
+      appendLE(data, 0, 2);
+      appendLE(data, 0, 2);
+      appendLE(data, 0, 2);
+      appendLE(data, 0, 2);
+      appendLE(data, 0, 4);
+      appendLE(data, entry.headerOffset, 4);
+      data.insert(data.end(), entry.name.begin(), entry.name.end());
+   }
+   uint64_t cdSize = data.size();
+   
+   appendLE(data, 0x06054b50, 4);
+   appendLE(data, 0, 2);
+   appendLE(data, 0, 2);
+   appendLE(data, mEntries.size(), 2);
+   appendLE(data, mEntries.size(), 2);
+   appendLE(data, cdSize, 4);
+   appendLE(data, cdOffset, 4);
+   appendLE(data, 0, 2);
+   
+   bool ok = mEntries.size() <= 0xFFFF && cdOffset + cdSize <= UINT32_MAX && write(data.data(), data.size());
+   ok = (fclose(mFile) == 0) && ok;
+   mFile = NULL;
+   
+   if (!ok)
+      printf("VolumeWriter: couldn't write central directory\n");
+   return ok;
+}
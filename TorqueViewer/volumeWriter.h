@@ -0,0 +1,94 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _VOLUMEWRITER_H_
+#define _VOLUMEWRITER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*
+ Writes zip volumes which Volume can read, with each entry compressed using
+ one of the methods in ZipMethod. Used to repack game volumes into a form
+ which is quicker to load.
+ 
+ Entries which don't shrink by at least 1/16 are stored instead. The data of
+ stored entries is padded (using the same extra field as Android's zipalign)
+ to start on an alignment boundary, so they can be used straight from a
+ mapping of the volume.
+ 
+ zip64 isn't written, so entries and the volume itself are limited to 4GB.
+ */
+class VolumeWriter
+{
+public:
+   
+   enum
+   {
+      AlignmentExtraID = 0xD935,
+      DefaultAlignment = 4096
+   };
+   
+   struct Stats
+   {
+      uint32_t numEntries;
+      uint32_t numMethod[3];    // stored, LZ4, zstd
+      uint64_t inputBytes;
+      uint64_t outputBytes;     // compressed data, excluding headers
+      uint64_t paddingBytes;    // added to align stored entries
+   };
+   
+   Stats mStats;
+   
+   VolumeWriter();
+   ~VolumeWriter();
+   
+   bool open(const char* filename);
+   
+   // method is a ZipMethod; deflate can't be written
+   bool addEntry(const char* name, const uint8_t* data, size_t size, uint16_t method, uint32_t alignment=DefaultAlignment);
+   
+   // Writes the central directory
+   bool close();
+   
+protected:
+   
+   struct Entry
+   {
+      std::string name;
+      uint16_t method;
+      uint32_t crc32;
+      uint32_t compressedSize;
+      uint32_t uncompressedSize;
+      uint32_t headerOffset;
+   };
+   
+   FILE* mFile;
+   uint64_t mOffset;
+   std::vector<Entry> mEntries;
+   
+   bool write(const void* data, size_t size);
+};
+
+#endif
@@ -0,0 +1,380 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _BENCHCODECFRAMES_H_
+#define _BENCHCODECFRAMES_H_
+
+#include <stdint.h>
+
+/*
+ Frames written by the reference lz4 (v1.9.4) and zstd (v1.5.6) command line
+ tools, so the decoders are checked against something other than our own
+ encoder. The input is a 1000 byte fillCompressible(seed 31) tile repeated
+ to kReferenceFrameSize bytes. -B4 splits the lz4 input into three 64KB blocks
+ and the zstd input is over the 128KB block limit, so every frame has
+ several blocks. Each was made with:
+ 
+   sLZ4FrameDefault       lz4 in.bin
+   sLZ4FrameLinked        lz4 -B4 -BD in.bin
+   sLZ4FrameBlockChecksum lz4 -B4 -BX in.bin
+   sZstdFrameLevel3       zstd -3 in.bin
+   sZstdFrameLevel19      zstd -19 in.bin
+ */
+
+static const uint32_t kReferenceFrameTileSize = 1000;
+static const uint32_t kReferenceFrameSize = 163840;
+
+static const uint8_t sLZ4FrameDefault[] = {
+   0x04, 0x22, 0x4D, 0x18, 0x64, 0x50, 0x08, 0x09, 0x04, 0x00, 0x00, 0xF4, 0x20, 0x64, 0x61, 0x74,
+   0x61, 0x42, 0x6C, 0x6F, 0x63, 0x6B, 0x20, 0x3D, 0x20, 0x22, 0x36, 0x34, 0x72, 0x6F, 0x74, 0x61,
+   0x74, 0x69, 0x6F, 0x6E, 0x20, 0x3D, 0x20, 0x22, 0x31, 0x20, 0x30, 0x20, 0x30, 0x20, 0x30, 0x22,
+   0x3B, 0x0A, 0x6F, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x3D, 0x20, 0x22, 0x12, 0x00, 0xF2, 0x1C,
+   0x2E, 0x64, 0x74, 0x73, 0x22, 0x3B, 0x0A, 0x6E, 0x65, 0x77, 0x20, 0x53, 0x69, 0x6D, 0x47, 0x72,
+   0x6F, 0x75, 0x70, 0x28, 0x29, 0x32, 0x36, 0x34, 0x32, 0x65, 0x6D, 0x61, 0x70, 0x20, 0x3D, 0x20,
+   0x74, 0x72, 0x75, 0x65, 0x3B, 0x0A, 0x73, 0x63, 0x61, 0x6C, 0x65, 0x4B, 0x00, 0x8E, 0x31, 0x20,
+   0x31, 0x22, 0x3B, 0x0A, 0x7B, 0x7D, 0x14, 0x00, 0x00, 0x82, 0x00, 0x11, 0x62, 0x82, 0x00, 0x09,
+   0x8C, 0x00, 0x14, 0x7D, 0x64, 0x00, 0x03, 0x07, 0x00, 0x0D, 0x4C, 0x00, 0x0E, 0x95, 0x00, 0xFE,
+   0x13, 0x6D, 0x6F, 0x75, 0x6E, 0x74, 0x50, 0x6F, 0x69, 0x6E, 0x74, 0x20, 0x3D, 0x20, 0x30, 0x3B,
+   0x0A, 0x53, 0x68, 0x61, 0x70, 0x65, 0x42, 0x61, 0x73, 0x65, 0x49, 0x6D, 0x61, 0x67, 0x65, 0x44,
+   0x61, 0x74, 0x61, 0x12, 0x00, 0xA2, 0x20, 0x20, 0x20, 0x73, 0x68, 0x61, 0x70, 0x65, 0x46, 0x69,
+   0xAA, 0x00, 0x49, 0x33, 0x32, 0x37, 0x39, 0xC4, 0x00, 0x39, 0x7D, 0x0A, 0x28, 0x10, 0x00, 0x29,
+   0x31, 0x37, 0x0F, 0x00, 0x23, 0x33, 0x37, 0xA0, 0x00, 0x0C, 0x7D, 0x00, 0x09, 0x1B, 0x01, 0x1E,
+   0x28, 0xAD, 0x00, 0x44, 0x70, 0x6F, 0x73, 0x69, 0x6A, 0x01, 0x0F, 0x76, 0x01, 0x03, 0x0E, 0xAD,
+   0x00, 0x09, 0x54, 0x00, 0x0E, 0x1F, 0x00, 0x0C, 0x83, 0x00, 0x48, 0x38, 0x31, 0x34, 0x32, 0x67,
+   0x00, 0x1E, 0x29, 0x33, 0x00, 0x03, 0xBD, 0x00, 0x3E, 0x36, 0x35, 0x7B, 0xA2, 0x00, 0x06, 0x99,
+   0x01, 0x1C, 0x29, 0x26, 0x01, 0x09, 0x89, 0x00, 0x06, 0x28, 0x00, 0x0D, 0xA4, 0x01, 0x0D, 0x11,
+   0x00, 0x0C, 0x6F, 0x01, 0x29, 0x32, 0x34, 0x4B, 0x00, 0x09, 0x0D, 0x00, 0x0C, 0xCF, 0x00, 0x09,
+   0x1D, 0x00, 0x09, 0x0D, 0x00, 0x2F, 0x38, 0x37, 0x42, 0x01, 0x03, 0x49, 0x35, 0x33, 0x29, 0x28,
+   0x55, 0x02, 0x29, 0x30, 0x33, 0x38, 0x00, 0x0D, 0x9F, 0x00, 0x13, 0x29, 0x10, 0x01, 0x19, 0x7B,
+   0x36, 0x00, 0x0E, 0x37, 0x01, 0x09, 0x03, 0x02, 0x0D, 0x46, 0x00, 0x06, 0x11, 0x01, 0x08, 0x7E,
+   0x01, 0x03, 0x5B, 0x00, 0x03, 0x07, 0x00, 0x26, 0x34, 0x33, 0x26, 0x00, 0x09, 0x94, 0x00, 0x28,
+   0x28, 0x28, 0x35, 0x00, 0x08, 0x0C, 0x00, 0x03, 0x3A, 0x00, 0x06, 0x38, 0x00, 0x0E, 0xB3, 0x01,
+   0x03, 0x23, 0x00, 0x0C, 0x3A, 0x01, 0x39, 0x72, 0x6F, 0x74, 0xD1, 0x00, 0x0F, 0xE8, 0x03, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x71, 0x50, 0x73,
+   0x63, 0x61, 0x6C, 0x65, 0x00, 0x00, 0x00, 0x00, 0x88, 0xE2, 0xDB, 0x55
+};
+
+static const uint8_t sLZ4FrameLinked[] = {
+   0x04, 0x22, 0x4D, 0x18, 0x44, 0x40, 0x5E, 0x87, 0x02, 0x00, 0x00, 0xF4, 0x20, 0x64, 0x61, 0x74,
+   0x61, 0x42, 0x6C, 0x6F, 0x63, 0x6B, 0x20, 0x3D, 0x20, 0x22, 0x36, 0x34, 0x72, 0x6F, 0x74, 0x61,
+   0x74, 0x69, 0x6F, 0x6E, 0x20, 0x3D, 0x20, 0x22, 0x31, 0x20, 0x30, 0x20, 0x30, 0x20, 0x30, 0x22,
+   0x3B, 0x0A, 0x6F, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20, 0x3D, 0x20, 0x22, 0x12, 0x00, 0xF2, 0x1C,
+   0x2E, 0x64, 0x74, 0x73, 0x22, 0x3B, 0x0A, 0x6E, 0x65, 0x77, 0x20, 0x53, 0x69, 0x6D, 0x47, 0x72,
+   0x6F, 0x75, 0x70, 0x28, 0x29, 0x32, 0x36, 0x34, 0x32, 0x65, 0x6D, 0x61, 0x70, 0x20, 0x3D, 0x20,
+   0x74, 0x72, 0x75, 0x65, 0x3B, 0x0A, 0x73, 0x63, 0x61, 0x6C, 0x65, 0x4B, 0x00, 0x8E, 0x31, 0x20,
+   0x31, 0x22, 0x3B, 0x0A, 0x7B, 0x7D, 0x14, 0x00, 0x00, 0x82, 0x00, 0x11, 0x62, 0x82, 0x00, 0x09,
+   0x8C, 0x00, 0x14, 0x7D, 0x64, 0x00, 0x03, 0x07, 0x00, 0x0D, 0x4C, 0x00, 0x0E, 0x95, 0x00, 0xFE,
+   0x13, 0x6D, 0x6F, 0x75, 0x6E, 0x74, 0x50, 0x6F, 0x69, 0x6E, 0x74, 0x20, 0x3D, 0x20, 0x30, 0x3B,
+   0x0A, 0x53, 0x68, 0x61, 0x70, 0x65, 0x42, 0x61, 0x73, 0x65, 0x49, 0x6D, 0x61, 0x67, 0x65, 0x44,
+   0x61, 0x74, 0x61, 0x12, 0x00, 0xA2, 0x20, 0x20, 0x20, 0x73, 0x68, 0x61, 0x70, 0x65, 0x46, 0x69,
+   0xAA, 0x00, 0x49, 0x33, 0x32, 0x37, 0x39, 0xC4, 0x00, 0x39, 0x7D, 0x0A, 0x28, 0x10, 0x00, 0x29,
+   0x31, 0x37, 0x0F, 0x00, 0x23, 0x33, 0x37, 0xA0, 0x00, 0x0C, 0x7D, 0x00, 0x09, 0x1B, 0x01, 0x1E,
+   0x28, 0xAD, 0x00, 0x44, 0x70, 0x6F, 0x73, 0x69, 0x6A, 0x01, 0x0F, 0x76, 0x01, 0x03, 0x0E, 0xAD,
+   0x00, 0x09, 0x54, 0x00, 0x0E, 0x1F, 0x00, 0x0C, 0x83, 0x00, 0x48, 0x38, 0x31, 0x34, 0x32, 0x67,
+   0x00, 0x1E, 0x29, 0x33, 0x00, 0x03, 0xBD, 0x00, 0x3E, 0x36, 0x35, 0x7B, 0xA2, 0x00, 0x06, 0x99,
+   0x01, 0x1C, 0x29, 0x26, 0x01, 0x09, 0x89, 0x00, 0x06, 0x28, 0x00, 0x0D, 0xA4, 0x01, 0x0D, 0x11,
+   0x00, 0x0C, 0x6F, 0x01, 0x29, 0x32, 0x34, 0x4B, 0x00, 0x09, 0x0D, 0x00, 0x0C, 0xCF, 0x00, 0x09,
+   0x1D, 0x00, 0x09, 0x0D, 0x00, 0x2F, 0x38, 0x37, 0x42, 0x01, 0x03, 0x49, 0x35, 0x33, 0x29, 0x28,
+   0x55, 0x02, 0x29, 0x30, 0x33, 0x38, 0x00, 0x0D, 0x9F, 0x00, 0x13, 0x29, 0x10, 0x01, 0x19, 0x7B,
+   0x36, 0x00, 0x0E, 0x37, 0x01, 0x09, 0x03, 0x02, 0x0D, 0x46, 0x00, 0x06, 0x11, 0x01, 0x08, 0x7E,
+   0x01, 0x03, 0x5B, 0x00, 0x03, 0x07, 0x00, 0x26, 0x34, 0x33, 0x26, 0x00, 0x09, 0x94, 0x00, 0x28,
+   0x28, 0x28, 0x35, 0x00, 0x08, 0x0C, 0x00, 0x03, 0x3A, 0x00, 0x06, 0x38, 0x00, 0x0E, 0xB3, 0x01,
+   0x03, 0x23, 0x00, 0x0C, 0x3A, 0x01, 0x39, 0x72, 0x6F, 0x74, 0xD1, 0x00, 0x0F, 0xE8, 0x03, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0x50, 0x30, 0x20, 0x30,
+   0x20, 0x30, 0x0D, 0x01, 0x00, 0x00, 0x09, 0x51, 0xFC, 0x0F, 0xE8, 0xFD, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xDB, 0x50, 0x69, 0x6D,
+   0x47, 0x72, 0x6F, 0x0A, 0x02, 0x00, 0x00, 0xFE, 0x19, 0x75, 0x70, 0x28, 0x29, 0x32, 0x36, 0x34,
+   0x32, 0x65, 0x6D, 0x61, 0x70, 0x20, 0x3D, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3B, 0x0A, 0x73, 0x63,
+   0x61, 0x6C, 0x65, 0x20, 0x3D, 0x20, 0x22, 0x31, 0x20, 0x31, 0x20, 0x31, 0x22, 0x3B, 0x0A, 0x7B,
+   0x7D, 0x14, 0x00, 0xF1, 0x00, 0x64, 0x61, 0x74, 0x61, 0x62, 0x6C, 0x6F, 0x63, 0x6B, 0x20, 0x64,
+   0x61, 0x74, 0x61, 0x42, 0x0A, 0x00, 0xB4, 0x3D, 0x20, 0x22, 0x7D, 0x0A, 0x2E, 0x64, 0x74, 0x73,
+   0x22, 0x3B, 0x07, 0x00, 0x0D, 0x4C, 0x00, 0xFE, 0x25, 0x6F, 0x66, 0x66, 0x73, 0x65, 0x74, 0x20,
+   0x3D, 0x20, 0x22, 0x30, 0x20, 0x30, 0x20, 0x30, 0x22, 0x3B, 0x0A, 0x6D, 0x6F, 0x75, 0x6E, 0x74,
+   0x50, 0x6F, 0x69, 0x6E, 0x74, 0x20, 0x3D, 0x20, 0x30, 0x3B, 0x0A, 0x53, 0x68, 0x61, 0x70, 0x65,
+   0x42, 0x61, 0x73, 0x65, 0x49, 0x6D, 0x61, 0x67, 0x65, 0x44, 0x61, 0x74, 0x61, 0x12, 0x00, 0xA2,
+   0x20, 0x20, 0x20, 0x73, 0x68, 0x61, 0x70, 0x65, 0x46, 0x69, 0xAA, 0x00, 0x49, 0x33, 0x32, 0x37,
+   0x39, 0xC4, 0x00, 0x39, 0x7D, 0x0A, 0x28, 0x10, 0x00, 0x29, 0x31, 0x37, 0x0F, 0x00, 0x23, 0x33,
+   0x37, 0xA7, 0x00, 0x0C, 0x7D, 0x00, 0xEE, 0x6E, 0x65, 0x77, 0x20, 0x53, 0x69, 0x6D, 0x47, 0x72,
+   0x6F, 0x75, 0x70, 0x28, 0x28, 0xAD, 0x00, 0xF4, 0x01, 0x70, 0x6F, 0x73, 0x69, 0x74, 0x69, 0x6F,
+   0x6E, 0x20, 0x3D, 0x20, 0x22, 0x72, 0x6F, 0x74, 0x61, 0x0C, 0x00, 0x24, 0x31, 0x20, 0xCF, 0x00,
+   0x0E, 0xAD, 0x00, 0x09, 0x54, 0x00, 0x0E, 0x1F, 0x00, 0x0C, 0x83, 0x00, 0x48, 0x38, 0x31, 0x34,
+   0x32, 0x67, 0x00, 0x1E, 0x29, 0x33, 0x00, 0x03, 0xBD, 0x00, 0x3E, 0x36, 0x35, 0x7B, 0xA2, 0x00,
+   0x06, 0x99, 0x01, 0x1C, 0x29, 0x26, 0x01, 0x09, 0x89, 0x00, 0x06, 0x28, 0x00, 0x0D, 0xA4, 0x01,
+   0x0D, 0x11, 0x00, 0x0C, 0x6F, 0x01, 0x29, 0x32, 0x34, 0x4B, 0x00, 0x09, 0x0D, 0x00, 0x0C, 0xCF,
+   0x00, 0x09, 0x1D, 0x00, 0x09, 0x0D, 0x00, 0x2F, 0x38, 0x37, 0x42, 0x01, 0x03, 0x49, 0x35, 0x33,
+   0x29, 0x28, 0x55, 0x02, 0x29, 0x30, 0x33, 0x38, 0x00, 0x0D, 0x9F, 0x00, 0x13, 0x29, 0x10, 0x01,
+   0x19, 0x7B, 0x36, 0x00, 0x0E, 0x37, 0x01, 0x09, 0x03, 0x02, 0x0D, 0x46, 0x00, 0x06, 0x11, 0x01,
+   0x08, 0x7E, 0x01, 0x03, 0x5B, 0x00, 0x03, 0x07, 0x00, 0x26, 0x34, 0x33, 0x26, 0x00, 0x09, 0x94,
+   0x00, 0x28, 0x28, 0x28, 0x35, 0x00, 0x08, 0x0C, 0x00, 0x03, 0x3A, 0x00, 0x06, 0x38, 0x00, 0x0E,
+   0xB3, 0x01, 0x03, 0x23, 0x00, 0x0C, 0x3A, 0x01, 0x39, 0x72, 0x6F, 0x74, 0xD1, 0x00, 0x2F, 0x36,
+   0x34, 0x30, 0x01, 0x03, 0x0F, 0x51, 0x00, 0x06, 0x09, 0xA2, 0x00, 0x0F, 0xE8, 0x03, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x79, 0x50, 0x73, 0x63, 0x61, 0x6C,
+   0x65, 0x00, 0x00, 0x00, 0x00, 0x88, 0xE2, 0xDB, 0x55
+};
+
+static const uint8_t sLZ4FrameBlockChecksum[] = {
+   0x04, 0x22, 0x4D, 0x18, 0x74, 0x40, 0xBD, 0x92, 0x02, 0x00, 0x00, 0xF0, 0x08, 0x64, 0x61, 0x74,
+   0x61, 0x42, 0x6C, 0x6F, 0x63, 0x6B, 0x20, 0x3D, 0x20, 0x22, 0x36, 0x34, 0x72, 0x6F, 0x74, 0x61,
+   0x74, 0x69, 0x6F, 0x6E, 0x0E, 0x00, 0x30, 0x31, 0x20, 0x30, 0x02, 0x00, 0x90, 0x22, 0x3B, 0x0A,
+   0x6F, 0x66, 0x66, 0x73, 0x65, 0x74, 0x14, 0x00, 0x04, 0x12, 0x00, 0xF0, 0x1C, 0x2E, 0x64, 0x74,
+   0x73, 0x22, 0x3B, 0x0A, 0x6E, 0x65, 0x77, 0x20, 0x53, 0x69, 0x6D, 0x47, 0x72, 0x6F, 0x75, 0x70,
+   0x28, 0x29, 0x32, 0x36, 0x34, 0x32, 0x65, 0x6D, 0x61, 0x70, 0x20, 0x3D, 0x20, 0x74, 0x72, 0x75,
+   0x65, 0x3B, 0x0A, 0x73, 0x63, 0x61, 0x6C, 0x65, 0x37, 0x00, 0xAE, 0x31, 0x20, 0x31, 0x20, 0x31,
+   0x22, 0x3B, 0x0A, 0x7B, 0x7D, 0x14, 0x00, 0x00, 0x82, 0x00, 0x11, 0x62, 0x82, 0x00, 0x00, 0x0A,
+   0x00, 0x05, 0x8C, 0x00, 0x14, 0x7D, 0x64, 0x00, 0x03, 0x07, 0x00, 0x0D, 0x4C, 0x00, 0x0E, 0x95,
+   0x00, 0x90, 0x6D, 0x6F, 0x75, 0x6E, 0x74, 0x50, 0x6F, 0x69, 0x6E, 0xAB, 0x00, 0xFE, 0x06, 0x30,
+   0x3B, 0x0A, 0x53, 0x68, 0x61, 0x70, 0x65, 0x42, 0x61, 0x73, 0x65, 0x49, 0x6D, 0x61, 0x67, 0x65,
+   0x44, 0x61, 0x74, 0x61, 0x12, 0x00, 0x40, 0x20, 0x20, 0x20, 0x73, 0x27, 0x00, 0x22, 0x46, 0x69,
+   0xAA, 0x00, 0x49, 0x33, 0x32, 0x37, 0x39, 0xC4, 0x00, 0x39, 0x7D, 0x0A, 0x28, 0x10, 0x00, 0x29,
+   0x31, 0x37, 0x0F, 0x00, 0x23, 0x33, 0x37, 0xA0, 0x00, 0x0C, 0x7D, 0x00, 0x09, 0x1B, 0x01, 0x1E,
+   0x28, 0xAD, 0x00, 0x44, 0x70, 0x6F, 0x73, 0x69, 0x6A, 0x01, 0x0F, 0x76, 0x01, 0x03, 0x0E, 0xAD,
+   0x00, 0x09, 0x54, 0x00, 0x0E, 0x1F, 0x00, 0x0C, 0x83, 0x00, 0x48, 0x38, 0x31, 0x34, 0x32, 0x67,
+   0x00, 0x1E, 0x29, 0x33, 0x00, 0x03, 0xBD, 0x00, 0x3E, 0x36, 0x35, 0x7B, 0xA2, 0x00, 0x00, 0x8F,
+   0x01, 0x02, 0x99, 0x01, 0x1C, 0x29, 0x26, 0x01, 0x09, 0x89, 0x00, 0x06, 0x28, 0x00, 0x0D, 0xA4,
+   0x01, 0x0D, 0x11, 0x00, 0x0C, 0x49, 0x00, 0x29, 0x32, 0x34, 0x4B, 0x00, 0x09, 0x0D, 0x00, 0x0C,
+   0xCF, 0x00, 0x09, 0x1D, 0x00, 0x09, 0x0D, 0x00, 0x2F, 0x38, 0x37, 0x42, 0x01, 0x03, 0x31, 0x35,
+   0x33, 0x29, 0x9E, 0x00, 0x05, 0x55, 0x02, 0x29, 0x30, 0x33, 0x38, 0x00, 0x0D, 0x9F, 0x00, 0x13,
+   0x29, 0x10, 0x01, 0x19, 0x7B, 0x36, 0x00, 0x0E, 0x37, 0x01, 0x09, 0x03, 0x02, 0x0D, 0x46, 0x00,
+   0x00, 0x3D, 0x00, 0x02, 0x39, 0x01, 0x08, 0x7E, 0x01, 0x03, 0x5B, 0x00, 0x03, 0x07, 0x00, 0x26,
+   0x34, 0x33, 0x26, 0x00, 0x09, 0x94, 0x00, 0x28, 0x28, 0x28, 0x35, 0x00, 0x08, 0x0C, 0x00, 0x03,
+   0x3A, 0x00, 0x06, 0x38, 0x00, 0x0E, 0xB3, 0x01, 0x03, 0x23, 0x00, 0x0C, 0x3A, 0x01, 0x30, 0x72,
+   0x6F, 0x74, 0x36, 0x00, 0x05, 0x07, 0x01, 0x0F, 0xE8, 0x03, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0x50, 0x30, 0x20, 0x30, 0x20, 0x30, 0x04, 0xD8, 0x32,
+   0x97, 0x95, 0x02, 0x00, 0x00, 0xF6, 0x1C, 0x22, 0x3B, 0x0A, 0x64, 0x61, 0x74, 0x61, 0x62, 0x6C,
+   0x6F, 0x63, 0x6B, 0x20, 0x29, 0x20, 0x20, 0x20, 0x73, 0x68, 0x61, 0x70, 0x65, 0x46, 0x69, 0x6C,
+   0x65, 0x20, 0x3D, 0x20, 0x22, 0x6E, 0x65, 0x77, 0x20, 0x53, 0x69, 0x6D, 0x47, 0x72, 0x6F, 0x75,
+   0x70, 0x28, 0x28, 0x00, 0x32, 0x73, 0x63, 0x61, 0x20, 0x00, 0x8D, 0x31, 0x20, 0x31, 0x20, 0x31,
+   0x22, 0x3B, 0x0A, 0x11, 0x00, 0x0C, 0x49, 0x00, 0x29, 0x32, 0x34, 0x4B, 0x00, 0x09, 0x0D, 0x00,
+   0xF9, 0x01, 0x6D, 0x6F, 0x75, 0x6E, 0x74, 0x50, 0x6F, 0x69, 0x6E, 0x74, 0x20, 0x3D, 0x20, 0x30,
+   0x3B, 0x0A, 0x1D, 0x00, 0x09, 0x0D, 0x00, 0xA0, 0x38, 0x37, 0x72, 0x6F, 0x74, 0x61, 0x74, 0x69,
+   0x6F, 0x6E, 0x9D, 0x00, 0x30, 0x31, 0x20, 0x30, 0x02, 0x00, 0x61, 0x22, 0x3B, 0x0A, 0x35, 0x33,
+   0x29, 0x9E, 0x00, 0x11, 0x42, 0xC6, 0x00, 0x59, 0x3D, 0x20, 0x22, 0x30, 0x33, 0x38, 0x00, 0x0D,
+   0x9F, 0x00, 0x90, 0x29, 0x2E, 0x64, 0x74, 0x73, 0x22, 0x3B, 0x0A, 0x7B, 0xD4, 0x00, 0x05, 0x36,
+   0x00, 0x10, 0x53, 0xFB, 0x00, 0xFF, 0x09, 0x42, 0x61, 0x73, 0x65, 0x49, 0x6D, 0x61, 0x67, 0x65,
+   0x44, 0x61, 0x74, 0x61, 0x65, 0x6D, 0x61, 0x70, 0x20, 0x3D, 0x20, 0x74, 0x72, 0x75, 0x65, 0xE5,
+   0x00, 0x00, 0x00, 0x3D, 0x00, 0x02, 0x39, 0x01, 0x44, 0x70, 0x6F, 0x73, 0x69, 0x97, 0x00, 0x03,
+   0x5B, 0x00, 0x03, 0x07, 0x00, 0x26, 0x34, 0x33, 0x26, 0x00, 0x09, 0x94, 0x00, 0x28, 0x28, 0x28,
+   0x35, 0x00, 0x08, 0x0C, 0x00, 0x03, 0x3A, 0x00, 0x06, 0x38, 0x00, 0x50, 0x6F, 0x66, 0x66, 0x73,
+   0x65, 0x1D, 0x01, 0x14, 0x22, 0xF1, 0x00, 0x03, 0x23, 0x00, 0x0C, 0x3A, 0x01, 0x30, 0x72, 0x6F,
+   0x74, 0x36, 0x00, 0x05, 0xD1, 0x00, 0x2F, 0x36, 0x34, 0x30, 0x01, 0x03, 0x0F, 0x51, 0x00, 0x06,
+   0x09, 0xA2, 0x00, 0x5F, 0x29, 0x32, 0x36, 0x34, 0x32, 0x02, 0x01, 0x0B, 0x2E, 0x7B, 0x7D, 0xFB,
+   0x01, 0x00, 0x82, 0x00, 0x02, 0x16, 0x01, 0x00, 0x0A, 0x00, 0x05, 0x8C, 0x00, 0x14, 0x7D, 0xB5,
+   0x00, 0x03, 0x07, 0x00, 0x0D, 0x94, 0x01, 0x0E, 0x95, 0x00, 0x0C, 0xDF, 0x00, 0x0E, 0xA0, 0x01,
+   0x0E, 0x12, 0x00, 0x0C, 0x79, 0x02, 0x49, 0x33, 0x32, 0x37, 0x39, 0xC4, 0x00, 0x39, 0x7D, 0x0A,
+   0x28, 0x10, 0x00, 0x29, 0x31, 0x37, 0x0F, 0x00, 0x23, 0x33, 0x37, 0xA0, 0x00, 0x0C, 0x7D, 0x00,
+   0x09, 0x1B, 0x01, 0x1E, 0x28, 0xAD, 0x00, 0x08, 0xC2, 0x01, 0x0F, 0x76, 0x01, 0x03, 0x0E, 0xAD,
+   0x00, 0x09, 0x54, 0x00, 0x0E, 0x1F, 0x00, 0x0C, 0x83, 0x00, 0x48, 0x38, 0x31, 0x34, 0x32, 0x67,
+   0x00, 0x1E, 0x29, 0x33, 0x00, 0x03, 0xBD, 0x00, 0x3E, 0x36, 0x35, 0x7B, 0xA2, 0x00, 0x00, 0x8F,
+   0x01, 0x02, 0x99, 0x01, 0x0F, 0xE8, 0x03, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xEF, 0x50, 0x69, 0x6D, 0x47, 0x72, 0x6F, 0x73, 0x28, 0xAB, 0xC0, 0x11, 0x02,
+   0x00, 0x00, 0xFE, 0x19, 0x75, 0x70, 0x28, 0x29, 0x32, 0x36, 0x34, 0x32, 0x65, 0x6D, 0x61, 0x70,
+   0x20, 0x3D, 0x20, 0x74, 0x72, 0x75, 0x65, 0x3B, 0x0A, 0x73, 0x63, 0x61, 0x6C, 0x65, 0x20, 0x3D,
+   0x20, 0x22, 0x31, 0x20, 0x31, 0x20, 0x31, 0x22, 0x3B, 0x0A, 0x7B, 0x7D, 0x14, 0x00, 0xA0, 0x64,
+   0x61, 0x74, 0x61, 0x62, 0x6C, 0x6F, 0x63, 0x6B, 0x20, 0x0A, 0x00, 0x11, 0x42, 0x0A, 0x00, 0xB4,
+   0x3D, 0x20, 0x22, 0x7D, 0x0A, 0x2E, 0x64, 0x74, 0x73, 0x22, 0x3B, 0x07, 0x00, 0x0D, 0x4C, 0x00,
+   0x60, 0x6F, 0x66, 0x66, 0x73, 0x65, 0x74, 0x5E, 0x00, 0xF0, 0x02, 0x30, 0x20, 0x30, 0x20, 0x30,
+   0x22, 0x3B, 0x0A, 0x6D, 0x6F, 0x75, 0x6E, 0x74, 0x50, 0x6F, 0x69, 0x6E, 0x16, 0x00, 0xFE, 0x06,
+   0x30, 0x3B, 0x0A, 0x53, 0x68, 0x61, 0x70, 0x65, 0x42, 0x61, 0x73, 0x65, 0x49, 0x6D, 0x61, 0x67,
+   0x65, 0x44, 0x61, 0x74, 0x61, 0x12, 0x00, 0x40, 0x20, 0x20, 0x20, 0x73, 0x27, 0x00, 0x22, 0x46,
+   0x69, 0xAA, 0x00, 0x49, 0x33, 0x32, 0x37, 0x39, 0xC4, 0x00, 0x39, 0x7D, 0x0A, 0x28, 0x10, 0x00,
+   0x29, 0x31, 0x37, 0x0F, 0x00, 0x23, 0x33, 0x37, 0xA7, 0x00, 0x0C, 0x7D, 0x00, 0xEE, 0x6E, 0x65,
+   0x77, 0x20, 0x53, 0x69, 0x6D, 0x47, 0x72, 0x6F, 0x75, 0x70, 0x28, 0x28, 0xAD, 0x00, 0x80, 0x70,
+   0x6F, 0x73, 0x69, 0x74, 0x69, 0x6F, 0x6E, 0xC1, 0x00, 0x44, 0x72, 0x6F, 0x74, 0x61, 0x0C, 0x00,
+   0x10, 0x31, 0xCD, 0x00, 0x01, 0xCF, 0x00, 0x0E, 0xAD, 0x00, 0x09, 0x54, 0x00, 0x0E, 0x1F, 0x00,
+   0x0C, 0x83, 0x00, 0x48, 0x38, 0x31, 0x34, 0x32, 0x67, 0x00, 0x1E, 0x29, 0x33, 0x00, 0x03, 0xBD,
+   0x00, 0x3E, 0x36, 0x35, 0x7B, 0xA2, 0x00, 0x00, 0x8F, 0x01, 0x02, 0x99, 0x01, 0x1C, 0x29, 0x26,
+   0x01, 0x09, 0x89, 0x00, 0x06, 0x28, 0x00, 0x0D, 0xA4, 0x01, 0x0D, 0x11, 0x00, 0x0C, 0x49, 0x00,
+   0x29, 0x32, 0x34, 0x4B, 0x00, 0x09, 0x0D, 0x00, 0x0C, 0xCF, 0x00, 0x09, 0x1D, 0x00, 0x09, 0x0D,
+   0x00, 0x2F, 0x38, 0x37, 0x42, 0x01, 0x03, 0x31, 0x35, 0x33, 0x29, 0x9E, 0x00, 0x05, 0x55, 0x02,
+   0x29, 0x30, 0x33, 0x38, 0x00, 0x0D, 0x9F, 0x00, 0x13, 0x29, 0x10, 0x01, 0x19, 0x7B, 0x36, 0x00,
+   0x0E, 0x37, 0x01, 0x09, 0x03, 0x02, 0x0D, 0x46, 0x00, 0x00, 0x3D, 0x00, 0x02, 0x39, 0x01, 0x08,
+   0x7E, 0x01, 0x03, 0x5B, 0x00, 0x03, 0x07, 0x00, 0x26, 0x34, 0x33, 0x26, 0x00, 0x09, 0x94, 0x00,
+   0x28, 0x28, 0x28, 0x35, 0x00, 0x08, 0x0C, 0x00, 0x03, 0x3A, 0x00, 0x06, 0x38, 0x00, 0x0E, 0xB3,
+   0x01, 0x03, 0x23, 0x00, 0x0C, 0x3A, 0x01, 0x30, 0x72, 0x6F, 0x74, 0x36, 0x00, 0x05, 0x07, 0x01,
+   0x2F, 0x36, 0x34, 0x30, 0x01, 0x03, 0x0F, 0x51, 0x00, 0x06, 0x09, 0xA2, 0x00, 0x0F, 0xE8, 0x03,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x79, 0x50, 0x73, 0x63,
+   0x61, 0x6C, 0x65, 0x09, 0x78, 0x1D, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x88, 0xE2, 0xDB, 0x55
+};
+
+static const uint8_t sZstdFrameLevel3[] = {
+   0x28, 0xB5, 0x2F, 0xFD, 0xA4, 0x00, 0x80, 0x02, 0x00, 0xD4, 0x09, 0x00, 0x22, 0x8B, 0x25, 0x20,
+   0x50, 0x69, 0xF3, 0x8C, 0x86, 0x67, 0x7B, 0xCF, 0xB6, 0xBC, 0x3C, 0x30, 0x0D, 0x05, 0x6A, 0x00,
+   0x21, 0x5B, 0x06, 0x84, 0xC4, 0x90, 0x0C, 0x55, 0xA5, 0xF9, 0x2F, 0x47, 0xD5, 0x18, 0x15, 0x06,
+   0xEF, 0x4A, 0x4A, 0xEE, 0x31, 0xCA, 0xAD, 0xA4, 0x9C, 0x01, 0x1E, 0x5E, 0x53, 0x8C, 0xE1, 0x50,
+   0xED, 0xB1, 0x83, 0xAC, 0x9E, 0x24, 0xE8, 0x20, 0x4B, 0xA7, 0x09, 0x80, 0xCD, 0xC9, 0x81, 0xBA,
+   0xBB, 0xFC, 0x2C, 0xD0, 0x08, 0x3C, 0x0B, 0xBA, 0x72, 0xA2, 0x13, 0x4E, 0x50, 0x9C, 0xB8, 0xA8,
+   0x74, 0x83, 0xA7, 0x8B, 0xCF, 0xE6, 0x80, 0x9F, 0x91, 0x86, 0x39, 0x11, 0xB1, 0x65, 0xCB, 0xBA,
+   0xC1, 0x8B, 0x7A, 0x62, 0x2F, 0xCA, 0x2F, 0x62, 0x13, 0x9E, 0xDD, 0xDE, 0xD1, 0x54, 0x4A, 0x16,
+   0x57, 0x08, 0xA6, 0x54, 0xEC, 0x42, 0xD3, 0x13, 0x51, 0x7D, 0x04, 0xE0, 0x44, 0xB4, 0xBE, 0x2B,
+   0x83, 0xE1, 0x27, 0xA2, 0xB5, 0x8C, 0xBA, 0x7C, 0x7E, 0x57, 0xDE, 0x81, 0x16, 0xB1, 0x0A, 0x0B,
+   0x6F, 0x24, 0xF8, 0x19, 0x09, 0x43, 0xA8, 0x31, 0x22, 0x54, 0xA6, 0x38, 0xF5, 0x68, 0x0E, 0x20,
+   0x02, 0x42, 0x94, 0x53, 0x78, 0x03, 0x12, 0xC0, 0x31, 0x0C, 0x4A, 0x11, 0xA0, 0x04, 0x20, 0xE4,
+   0x08, 0x28, 0x75, 0x63, 0xD7, 0xFF, 0xFF, 0x33, 0x08, 0xFC, 0xEB, 0x0B, 0xA8, 0x11, 0x7A, 0xA4,
+   0xD9, 0xE2, 0x9B, 0x9A, 0x80, 0xF2, 0x52, 0x71, 0x7B, 0xF9, 0x95, 0x5E, 0x2F, 0x2D, 0x13, 0xB8,
+   0x4A, 0x81, 0x26, 0x6B, 0x03, 0x99, 0xCE, 0x76, 0xF6, 0x6D, 0xC2, 0x25, 0x72, 0xDC, 0xC6, 0xB1,
+   0x24, 0xBA, 0x68, 0x02, 0x0A, 0x04, 0x29, 0x07, 0x72, 0xCE, 0x12, 0xB3, 0x27, 0xF5, 0xE9, 0xF8,
+   0xD2, 0x0C, 0x40, 0x29, 0xF7, 0x9C, 0x44, 0xA5, 0x1E, 0x50, 0xB7, 0xB5, 0x56, 0x95, 0x1A, 0x36,
+   0x41, 0x5D, 0x04, 0x26, 0x2F, 0x8F, 0xB0, 0xB6, 0x99, 0x61, 0xCB, 0x23, 0x01, 0xE8, 0x18, 0x99,
+   0x0B, 0x9D, 0x21, 0x76, 0x5C, 0x79, 0xEB, 0x4E, 0x45, 0xD0, 0xF5, 0x7D, 0x97, 0x80, 0xF9, 0xEE,
+   0x37, 0x77, 0x09, 0xE7, 0x79, 0x24, 0xB7, 0x05, 0x39, 0x1D, 0x8B, 0xB2, 0x36, 0x29, 0x2C, 0xAE,
+   0xAC, 0xF7, 0xEC, 0xC3, 0x37, 0xD5, 0x45, 0x00, 0x00, 0x08, 0x75, 0x01, 0x00, 0xFC, 0xFF, 0x0E,
+   0x84, 0x26, 0x65, 0x38, 0xDD
+};
+
+static const uint8_t sZstdFrameLevel19[] = {
+   0x28, 0xB5, 0x2F, 0xFD, 0xA4, 0x00, 0x80, 0x02, 0x00, 0x34, 0x09, 0x00, 0xB2, 0x89, 0x20, 0x19,
+   0x50, 0xD7, 0x03, 0x60, 0xD4, 0x32, 0x22, 0x1D, 0x85, 0xD0, 0x35, 0xE5, 0x5D, 0x24, 0x7F, 0xFF,
+   0x5E, 0x00, 0xE8, 0xAE, 0x66, 0xCC, 0x24, 0x66, 0x7C, 0xB2, 0x5A, 0x70, 0x56, 0x41, 0xCE, 0x4A,
+   0x18, 0x87, 0xA5, 0x13, 0x24, 0x8A, 0x49, 0xED, 0x70, 0x60, 0x9D, 0x39, 0x69, 0x54, 0x63, 0x90,
+   0x31, 0x44, 0x0C, 0x5A, 0x71, 0xA3, 0xDD, 0xFD, 0xF7, 0x33, 0xD7, 0x7A, 0xED, 0xB9, 0xFA, 0x97,
+   0xCB, 0xFD, 0x15, 0xC5, 0x44, 0xD8, 0x70, 0x86, 0xF6, 0xE6, 0x65, 0x2D, 0x94, 0x42, 0xF0, 0x66,
+   0x3F, 0xE9, 0x98, 0x5C, 0xAF, 0xDB, 0xAE, 0x38, 0xF7, 0xDA, 0xA5, 0xB6, 0xA0, 0x53, 0x72, 0x5E,
+   0xEE, 0x1C, 0x0D, 0x47, 0xFE, 0xDD, 0x4D, 0x6F, 0x2A, 0xD8, 0x57, 0x57, 0x55, 0x8E, 0x09, 0x20,
+   0xF8, 0xB0, 0x65, 0xBC, 0x7F, 0xE7, 0xCE, 0x16, 0x80, 0x2B, 0x8E, 0x4D, 0x39, 0x5B, 0x7E, 0x3F,
+   0x15, 0x44, 0xA0, 0x51, 0x22, 0xA4, 0xCB, 0xAC, 0x4F, 0x6B, 0x20, 0x84, 0x10, 0xA6, 0x0A, 0x6F,
+   0x15, 0xFC, 0xEB, 0xCB, 0x43, 0x16, 0xF8, 0x48, 0x75, 0x5B, 0x7A, 0x42, 0x1D, 0x84, 0x10, 0xC0,
+   0xC6, 0x71, 0x11, 0xA9, 0xF4, 0x30, 0x69, 0xC9, 0x81, 0xE3, 0xF2, 0xE0, 0x31, 0x5D, 0x61, 0x9D,
+   0x79, 0xC9, 0x3D, 0x9D, 0x20, 0x23, 0xCA, 0xBC, 0x4D, 0x07, 0xB0, 0xE8, 0xE8, 0x22, 0xA2, 0xE4,
+   0xA8, 0xEA, 0x0D, 0x72, 0xDC, 0xD1, 0x91, 0x11, 0x49, 0x98, 0x9F, 0x62, 0x5E, 0xC3, 0x8C, 0x1E,
+   0x4F, 0x01, 0xE1, 0x74, 0x5B, 0x25, 0xFB, 0xC0, 0x65, 0xB4, 0xF6, 0xAA, 0xCA, 0x31, 0x1C, 0x21,
+   0xEC, 0xBD, 0xC4, 0xE1, 0xDE, 0x3C, 0x54, 0xDB, 0x24, 0x1C, 0x66, 0x8F, 0x07, 0x07, 0x20, 0x8F,
+   0x91, 0xDA, 0xCB, 0x0E, 0x32, 0x1E, 0x39, 0xE6, 0x74, 0x88, 0x39, 0x2A, 0x40, 0x57, 0xFE, 0x13,
+   0x56, 0xCC, 0x3C, 0xDB, 0xF8, 0xEA, 0xC0, 0x29, 0xF1, 0x71, 0x4E, 0xDC, 0xC2, 0x96, 0x8E, 0x9E,
+   0xD9, 0x81, 0x0C, 0x66, 0x3A, 0x6B, 0xA8, 0x02, 0x8B, 0xD4, 0x6E, 0x46, 0xCA, 0x11, 0x8D, 0x20,
+   0xA8, 0x01, 0x4D, 0x00, 0x00, 0x00, 0x01, 0x00, 0xFD, 0xFF, 0xEE, 0xFF, 0xAE, 0x81, 0x26, 0x65,
+   0x38, 0xDD
+};
+
+#endif
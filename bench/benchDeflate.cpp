@@ -0,0 +1,191 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "benchDeflate.h"
+
+namespace
+{
+
+static const uint16_t sLengthBase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const uint8_t sLengthExtra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const uint16_t sDistBase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const uint8_t sDistExtra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+enum
+{
+   WindowSize = 32768,
+   MinMatch = 3,
+   MaxMatch = 258,
+   HashBits = 15
+};
+
+class BitWriter
+{
+public:
+   std::vector<uint8_t>& mOut;
+   uint32_t mBits;
+   uint32_t mNumBits;
+   
+   BitWriter(std::vector<uint8_t>& out) : mOut(out), mBits(0), mNumBits(0) {;}
+   
+   // Writes value LSB first
+   inline void writeBits(uint32_t value, uint32_t count)
+   {
+      mBits |= value << mNumBits;
+      mNumBits += count;
+      while (mNumBits >= 8)
+      {
+         mOut.push_back(mBits & 0xFF);
+         mBits >>= 8;
+         mNumBits -= 8;
+      }
+   }
+   
+   // Huffman codes are stored MSB first
+   inline void writeCode(uint32_t code, uint32_t count)
+   {
+      uint32_t rev = 0;
+      for (uint32_t i=0; i<count; i++)
+      {
+         rev = (rev << 1) | (code & 1);
+         code >>= 1;
+      }
+      writeBits(rev, count);
+   }
+   
+   inline void flush()
+   {
+      if (mNumBits > 0)
+         mOut.push_back(mBits & 0xFF);
+      mBits = 0;
+      mNumBits = 0;
+   }
+};
+
+static void writeLiteral(BitWriter& writer, uint32_t sym)
+{
+   if (sym < 144)
+      writer.writeCode(0x30 + sym, 8);
+   else if (sym < 256)
+      writer.writeCode(0x190 + (sym - 144), 9);
+   else if (sym < 280)
+      writer.writeCode(sym - 256, 7);
+   else
+      writer.writeCode(0xC0 + (sym - 280), 8);
+}
+
+static void writeMatch(BitWriter& writer, uint32_t length, uint32_t dist)
+{
+   uint32_t lcode = 28;
+   while (sLengthBase[lcode] > length)
+      lcode--;
+   writeLiteral(writer, 257 + lcode);
+   writer.writeBits(length - sLengthBase[lcode], sLengthExtra[lcode]);
+   
+   uint32_t dcode = 29;
+   while (sDistBase[dcode] > dist)
+      dcode--;
+   writer.writeCode(dcode, 5);
+   writer.writeBits(dist - sDistBase[dcode], sDistExtra[dcode]);
+}
+
+static inline uint32_t hash3(const uint8_t* p)
+{
+   uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+   return (v * 2654435761U) >> (32 - HashBits);
+}
+
+}
+
+void benchDeflateFixed(const uint8_t* data, size_t size, std::vector<uint8_t>& outData, size_t blockSize)
+{
+   outData.clear();
+   outData.reserve(size);
+   
+   size_t blockEnd = blockSize > 0 ? blockSize : size;
+   
+   BitWriter writer(outData);
+   writer.writeBits(blockEnd >= size ? 1 : 0, 1); // BFINAL
+   writer.writeBits(1, 2); // BTYPE = fixed huffman
+   
+   std::vector<int64_t> head(1 << HashBits, -1);
+   size_t pos = 0;
+   
+   while (pos < size)
+   {
+      // Matches can still reach back into earlier blocks
+      if (pos >= blockEnd)
+      {
+         writeLiteral(writer, 256);
+         blockEnd += blockSize;
+         writer.writeBits(blockEnd >= size ? 1 : 0, 1);
+         writer.writeBits(1, 2);
+      }
+      
+      uint32_t bestLen = 0;
+      size_t bestDist = 0;
+      
+      if (pos + MinMatch <= size)
+      {
+         uint32_t h = hash3(data + pos);
+         int64_t cand = head[h];
+         head[h] = (int64_t)pos;
+         
+         if (cand >= 0 && pos - (size_t)cand <= WindowSize)
+         {
+            size_t maxLen = std::min<size_t>(MaxMatch, size - pos);
+            uint32_t len = 0;
+            while (len < maxLen && data[cand + len] == data[pos + len])
+               len++;
+            
+            if (len >= MinMatch)
+            {
+               bestLen = len;
+               bestDist = pos - (size_t)cand;
+            }
+         }
+      }
+      
+      if (bestLen > 0)
+      {
+         writeMatch(writer, bestLen, (uint32_t)bestDist);
+         
+         // Keep the hash chain roughly up to date within the match
+         for (size_t i=pos+1; i<pos+bestLen && i+MinMatch <= size; i++)
+            head[hash3(data + i)] = (int64_t)i;
+         
+         pos += bestLen;
+      }
+      else
+      {
+         writeLiteral(writer, data[pos]);
+         pos++;
+      }
+   }
+   
+   writeLiteral(writer, 256);
+   writer.flush();
+}
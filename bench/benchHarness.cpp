@@ -0,0 +1,310 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "benchHarness.h"
+#include "benchLODReport.h"
+
+std::vector<BenchDef>& BenchRegistry::getList()
+{
+   static std::vector<BenchDef> sList;
+   return sList;
+}
+
+void BenchRegistry::add(const char* name, BenchFunc func)
+{
+   BenchDef def;
+   def.name = name;
+   def.func = func;
+   getList().push_back(def);
+}
+
+static double runSample(const BenchDef& def, uint64_t iterations, BenchResult& outResult)
+{
+   BenchState state(iterations);
+   def.func(state);
+   
+   if (state.mFailed)
+   {
+      outResult.failed = true;
+      outResult.error = state.mError;
+      return -1.0;
+   }
+   
+   if (!state.mStarted)
+   {
+      outResult.failed = true;
+      outResult.error = "benchmark never called keepRunning";
+      return -1.0;
+   }
+   
+   outResult.bytesPerIteration = state.mBytesPerIteration;
+   outResult.itemsPerIteration = state.mItemsPerIteration;
+   return state.getElapsedNS();
+}
+
+static double percentile(const std::vector<double>& sorted, double pct)
+{
+   if (sorted.empty())
+      return 0.0;
+   
+   double pos = pct * (double)(sorted.size() - 1);
+   size_t lo = (size_t)floor(pos);
+   size_t hi = std::min(lo + 1, sorted.size() - 1);
+   double frac = pos - (double)lo;
+   return sorted[lo] + ((sorted[hi] - sorted[lo]) * frac);
+}
+
+bool BenchRegistry::runOne(const BenchDef& def, const BenchOptions& options, BenchResult& outResult)
+{
+   outResult = {};
+   outResult.name = def.name;
+   
+   // Calibrate so each sample runs for at least minSampleMS
+   const double targetNS = options.minSampleMS * 1000000.0;
+   uint64_t iterations = 1;
+   
+   for (;;)
+   {
+      double elapsed = runSample(def, iterations, outResult);
+      if (elapsed < 0.0)
+         return false;
+      
+      if (elapsed >= targetNS || iterations >= (1ULL << 30))
+         break;
+      
+      double scale = elapsed > 0.0 ? (targetNS / elapsed) * 1.2 : 10.0;
+      scale = std::clamp(scale, 2.0, 10.0);
+      iterations = (uint64_t)ceil((double)iterations * scale);
+   }
+   
+   for (uint32_t i=0; i<options.numWarmup; i++)
+   {
+      if (runSample(def, iterations, outResult) < 0.0)
+         return false;
+   }
+   
+   std::vector<double> samples;
+   samples.reserve(options.numSamples);
+   
+   for (uint32_t i=0; i<options.numSamples; i++)
+   {
+      double elapsed = runSample(def, iterations, outResult);
+      if (elapsed < 0.0)
+         return false;
+      samples.push_back(elapsed / (double)iterations);
+   }
+   
+   std::sort(samples.begin(), samples.end());
+   
+   double sum = 0.0;
+   for (double v : samples)
+      sum += v;
+   double mean = sum / (double)samples.size();
+   
+   double variance = 0.0;
+   for (double v : samples)
+      variance += (v - mean) * (v - mean);
+   variance = samples.size() > 1 ? variance / (double)(samples.size() - 1) : 0.0;
+   
+   outResult.iterations = iterations;
+   outResult.numSamples = (uint32_t)samples.size();
+   outResult.minNS = samples.front();
+   outResult.medianNS = percentile(samples, 0.5);
+   outResult.meanNS = mean;
+   outResult.stddevNS = sqrt(variance);
+   outResult.p90NS = percentile(samples, 0.9);
+   return true;
+}
+
+static void writeJSONString(FILE* fp, const std::string& str)
+{
+   fputc('"', fp);
+   for (char c : str)
+   {
+      if (c == '"' || c == '\\')
+         fputc('\\', fp);
+      if ((unsigned char)c < 0x20)
+         fprintf(fp, "\\u%04x", (unsigned)c);
+      else
+         fputc(c, fp);
+   }
+   fputc('"', fp);
+}
+
+bool BenchRegistry::writeJSON(const char* path, const std::vector<BenchResult>& results)
+{
+   FILE* fp = fopen(path, "wb");
+   if (fp == NULL)
+   {
+      printf("Couldn't open %s for writing\n", path);
+      return false;
+   }
+   
+   fprintf(fp, "{\n  \"benchmarks\": [\n");
+   
+   for (size_t i=0; i<results.size(); i++)
+   {
+      const BenchResult& res = results[i];
+      fprintf(fp, "    {\"name\": ");
+      writeJSONString(fp, res.name);
+      
+      if (res.failed)
+      {
+         fprintf(fp, ", \"failed\": true, \"error\": ");
+         writeJSONString(fp, res.error);
+      }
+      else
+      {
+         double bytesPerSec = res.bytesPerIteration > 0 ? (double)res.bytesPerIteration / (res.medianNS * 1e-9) : 0.0;
+         double itemsPerSec = res.itemsPerIteration > 0 ? (double)res.itemsPerIteration / (res.medianNS * 1e-9) : 0.0;
+         
+         fprintf(fp, ", \"iterations\": %llu, \"samples\": %u, \"min_ns\": %.3f, \"median_ns\": %.3f, \"mean_ns\": %.3f, \"stddev_ns\": %.3f, \"p90_ns\": %.3f, \"bytes_per_second\": %.1f, \"items_per_second\": %.1f",
+                 (unsigned long long)res.iterations, res.numSamples,
+                 res.minNS, res.medianNS, res.meanNS, res.stddevNS, res.p90NS,
+                 bytesPerSec, itemsPerSec);
+      }
+      
+      fprintf(fp, "}%s\n", i+1 < results.size() ? "," : "");
+   }
+   
+   fprintf(fp, "  ]\n}\n");
+   fclose(fp);
+   return true;
+}
+
+static void formatTime(char* buffer, size_t bufferSize, double ns)
+{
+   if (ns >= 1000000.0)
+      snprintf(buffer, bufferSize, "%.3f ms", ns / 1000000.0);
+   else if (ns >= 1000.0)
+      snprintf(buffer, bufferSize, "%.3f us", ns / 1000.0);
+   else
+      snprintf(buffer, bufferSize, "%.2f ns", ns);
+}
+
+int BenchRegistry::runAll(const BenchOptions& options)
+{
+   std::vector<BenchDef> list = getList();
+   std::sort(list.begin(), list.end(), [](const BenchDef& a, const BenchDef& b){
+      return strcmp(a.name, b.name) < 0;
+   });
+   
+   std::vector<BenchResult> results;
+   int numFailed = 0;
+   
+   printf("%-32s %14s %14s %12s %14s %12s\n", "Benchmark", "Median", "Min", "StdDev", "P90", "MB/s");
+   
+   for (const BenchDef& def : list)
+   {
+      if (options.filter && strstr(def.name, options.filter) == NULL)
+         continue;
+      
+      BenchResult res;
+      if (!runOne(def, options, res))
+      {
+         printf("%-32s FAILED: %s\n", def.name, res.error.c_str());
+         numFailed++;
+      }
+      else
+      {
+         char medianStr[32], minStr[32], stddevStr[32], p90Str[32];
+         formatTime(medianStr, sizeof(medianStr), res.medianNS);
+         formatTime(minStr, sizeof(minStr), res.minNS);
+         formatTime(stddevStr, sizeof(stddevStr), res.stddevNS);
+         formatTime(p90Str, sizeof(p90Str), res.p90NS);
+         
+         double mbPerSec = res.bytesPerIteration > 0 ? ((double)res.bytesPerIteration / (res.medianNS * 1e-9)) / (1024.0*1024.0) : 0.0;
+         printf("%-32s %14s %14s %12s %14s %12.1f\n", def.name, medianStr, minStr, stddevStr, p90Str, mbPerSec);
+      }
+      
+      fflush(stdout);
+      results.push_back(res);
+   }
+   
+   if (options.jsonPath && !writeJSON(options.jsonPath, results))
+      return 1;
+   
+   return numFailed > 0 ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+   BenchOptions options;
+   uint32_t numThreads = 0;
+   
+   for (int i=1; i<argc; i++)
+   {
+      const char* arg = argv[i];
+      const bool hasValue = i+1 < argc;
+      
+      if (strcasecmp(arg, "-filter") == 0 && hasValue)
+      {
+         options.filter = argv[++i];
+      }
+      else if (strcasecmp(arg, "-json") == 0 && hasValue)
+      {
+         options.jsonPath = argv[++i];
+      }
+      else if (strcasecmp(arg, "-samples") == 0 && hasValue)
+      {
+         options.numSamples = std::max(1, atoi(argv[++i]));
+      }
+      else if (strcasecmp(arg, "-warmup") == 0 && hasValue)
+      {
+         options.numWarmup = std::max(0, atoi(argv[++i]));
+      }
+      else if (strcasecmp(arg, "-minms") == 0 && hasValue)
+      {
+         options.minSampleMS = std::max(0.01, atof(argv[++i]));
+      }
+      else if (strcasecmp(arg, "-threads") == 0 && hasValue)
+      {
+         numThreads = std::max(0, atoi(argv[++i]));
+      }
+      else if (strcasecmp(arg, "-lodreport") == 0 && hasValue)
+      {
+         return benchLODReport(argc - (i+1), argv + i + 1, numThreads);
+      }
+      else if (strcasecmp(arg, "-list") == 0)
+      {
+         for (const BenchDef& def : BenchRegistry::getList())
+            printf("%s\n", def.name);
+         return 0;
+      }
+      else
+      {
+         printf("Usage: %s [-filter substr] [-json out.json] [-samples N] [-warmup N] [-minms ms] [-list] [-threads N] [-lodreport file.dts...]\n", argv[0]);
+         return 1;
+      }
+   }
+   
+   return BenchRegistry::runAll(options);
+}
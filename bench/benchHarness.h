@@ -0,0 +1,180 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#ifndef _BENCHHARNESS_H_
+#define _BENCHHARNESS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Minimal micro-benchmark harness.
+//
+// Each benchmark is a function which does its setup, then loops on
+// state.keepRunning(). Only the loop is timed. The runner calibrates the
+// iteration count so a sample takes roughly BenchOptions::minSampleMS, then
+// collects a number of samples and reports min/median/mean/stddev/p90 per
+// iteration.
+
+class BenchState
+{
+public:
+   typedef std::chrono::steady_clock Clock;
+   
+   uint64_t mIterations;
+   uint64_t mRemaining;
+   uint64_t mBytesPerIteration;
+   uint64_t mItemsPerIteration;
+   bool mStarted;
+   bool mFailed;
+   std::string mError;
+   
+   Clock::time_point mStartTime;
+   Clock::time_point mEndTime;
+   
+   BenchState(uint64_t iterations) :
+   mIterations(iterations),
+   mRemaining(iterations),
+   mBytesPerIteration(0),
+   mItemsPerIteration(0),
+   mStarted(false),
+   mFailed(false)
+   {
+   }
+   
+   inline bool keepRunning()
+   {
+      if (!mStarted)
+      {
+         mStarted = true;
+         mStartTime = Clock::now();
+      }
+      
+      if (mRemaining == 0 || mFailed)
+      {
+         mEndTime = Clock::now();
+         return false;
+      }
+      
+      mRemaining--;
+      return true;
+   }
+   
+   inline void setBytesProcessed(uint64_t bytes) { mBytesPerIteration = bytes; }
+   inline void setItemsProcessed(uint64_t items) { mItemsPerIteration = items; }
+   
+   // Marks the benchmark as failed (e.g. output did not verify)
+   inline void fail(const char* error)
+   {
+      mFailed = true;
+      mError = error;
+   }
+   
+   inline double getElapsedNS() const
+   {
+      return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(mEndTime - mStartTime).count();
+   }
+};
+
+typedef void (*BenchFunc)(BenchState& state);
+
+struct BenchDef
+{
+   const char* name;
+   BenchFunc func;
+};
+
+struct BenchOptions
+{
+   uint32_t numSamples;
+   uint32_t numWarmup;
+   double minSampleMS;
+   const char* filter;
+   const char* jsonPath;
+   
+   BenchOptions() : numSamples(15), numWarmup(2), minSampleMS(10.0), filter(NULL), jsonPath(NULL) {;}
+};
+
+struct BenchResult
+{
+   std::string name;
+   uint64_t iterations;
+   uint32_t numSamples;
+   double minNS;
+   double medianNS;
+   double meanNS;
+   double stddevNS;
+   double p90NS;
+   uint64_t bytesPerIteration;
+   uint64_t itemsPerIteration;
+   bool failed;
+   std::string error;
+};
+
+class BenchRegistry
+{
+public:
+   static std::vector<BenchDef>& getList();
+   static void add(const char* name, BenchFunc func);
+   
+   static bool runOne(const BenchDef& def, const BenchOptions& options, BenchResult& outResult);
+   static int runAll(const BenchOptions& options);
+   static bool writeJSON(const char* path, const std::vector<BenchResult>& results);
+};
+
+struct BenchRegistrar
+{
+   BenchRegistrar(const char* name, BenchFunc func)
+   {
+      BenchRegistry::add(name, func);
+   }
+};
+
+#define TV_BENCHMARK(NAME) \
+   static void NAME(BenchState& state); \
+   static BenchRegistrar sBenchRegistrar_##NAME(#NAME, NAME); \
+   static void NAME(BenchState& state)
+
+// Prevents the compiler from discarding a computed value
+template<typename T> inline void benchKeep(T const& value)
+{
+#if defined(_MSC_VER)
+   static volatile const void* sSink;
+   sSink = &value;
+#else
+   asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+// Prevents the compiler from assuming memory is unchanged across iterations
+inline void benchClobber()
+{
+#if defined(_MSC_VER)
+   _ReadWriteBarrier();
+#else
+   asm volatile("" : : : "memory");
+#endif
+}
+
+#endif
@@ -0,0 +1,3253 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include "CommonData.h"
+#include "shapeData.h"
+#include "shapeSimplify.h"
+#include "shapeAnimation.h"
+#include "interiorData.h"
+#include "lightmapAtlas.h"
+#include "missionData.h"
+#include "sceneContainer.h"
+#include "missionSnapshot.h"
+#include "interiorCulling.h"
+#include "meshletCulling.h"
+#include "textureCache.h"
+#include "textureStreamer.h"
+#include "materialTextures.h"
+#include "shaderPreprocessor.h"
+#include "deflateIndex.h"
+#include "volumeCodecs.h"
+#include "volumeWriter.h"
+#include "modelShader.wgsl.h"
+#include "interiorShader.wgsl.h"
+#include "stb_image.h"
+#include "benchHarness.h"
+#include "benchDeflate.h"
+#include "benchCodecFrames.h"
+
+// Kernels benchmarked in isolation. Inputs are generated from a fixed seed
+// so results are comparable between runs.
+
+namespace
+{
+
+class BenchRandom
+{
+public:
+   uint64_t mState;
+   
+   BenchRandom(uint64_t seed=0x9E3779B97F4A7C15ULL) : mState(seed) {;}
+   
+   inline uint32_t next()
+   {
+      mState ^= mState << 13;
+      mState ^= mState >> 7;
+      mState ^= mState << 17;
+      return (uint32_t)(mState >> 16);
+   }
+   
+   inline float nextFloat(float minVal, float maxVal)
+   {
+      return minVal + ((float)(next() & 0xFFFFFF) / (float)0xFFFFFF) * (maxVal - minVal);
+   }
+   
+   inline slm::quat nextQuat()
+   {
+      slm::quat q(nextFloat(-1,1), nextFloat(-1,1), nextFloat(-1,1), nextFloat(-1,1));
+      float len = sqrtf(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w);
+      if (len < 0.0001f)
+         return slm::quat(0,0,0,1);
+      return slm::quat(q.x/len, q.y/len, q.z/len, q.w/len);
+   }
+};
+
+static void fillRandom(std::vector<uint8_t>& data, size_t size, uint64_t seed)
+{
+   BenchRandom rng(seed);
+   data.resize(size);
+   for (size_t i=0; i<size; i++)
+      data[i] = rng.next() & 0xFF;
+}
+
+// Roughly resembles DTS / text asset content: repeated tokens with noise
+static void fillCompressible(std::vector<uint8_t>& data, size_t size, uint64_t seed)
+{
+   static const char* sTokens[] = {
+      "datablock ", "ShapeBaseImageData", "(", ")", "{", "}\n", "   shapeFile = \"", ".dts\";\n",
+      "mountPoint = 0;\n", "offset = \"0 0 0\";\n", "emap = true;\n", "new SimGroup(", "position = \"",
+      "rotation = \"1 0 0 0\";\n", "scale = \"1 1 1\";\n", "dataBlock = \""
+   };
+   const uint32_t numTokens = sizeof(sTokens) / sizeof(sTokens[0]);
+   
+   BenchRandom rng(seed);
+   data.clear();
+   data.reserve(size);
+   
+   while (data.size() < size)
+   {
+      uint32_t r = rng.next();
+      if ((r & 7) == 0)
+      {
+         // Noise
+         data.push_back('0' + (r >> 8) % 10);
+         data.push_back('0' + (r >> 16) % 10);
+      }
+      else
+      {
+         const char* token = sTokens[(r >> 8) % numTokens];
+         data.insert(data.end(), token, token + strlen(token));
+      }
+   }
+   
+   data.resize(size);
+}
+
+}
+
+// MemRStream
+
+TV_BENCHMARK(MemRStream_ReadScalar)
+{
+   const size_t numValues = 64 * 1024;
+   std::vector<uint8_t> data;
+   fillRandom(data, numValues * sizeof(uint32_t), 1);
+   
+   while (state.keepRunning())
+   {
+      MemRStream stream(data.size(), data.data());
+      uint32_t sum = 0;
+      uint32_t value = 0;
+      while (stream.read(value))
+         sum += value;
+      benchKeep(sum);
+   }
+   
+   state.setBytesProcessed(data.size());
+}
+
+TV_BENCHMARK(MemRStream_ReadBulk)
+{
+   const size_t chunkSize = 4096;
+   std::vector<uint8_t> data;
+   std::vector<uint8_t> dest(chunkSize);
+   fillRandom(data, 1024 * 1024, 2);
+   
+   while (state.keepRunning())
+   {
+      MemRStream stream(data.size(), data.data());
+      while (stream.read(chunkSize, dest.data()))
+         benchClobber();
+   }
+   
+   state.setBytesProcessed(data.size());
+}
+
+// SplitStream (DTS v24+ split buffer reads)
+
+TV_BENCHMARK(SplitStream_ReadBulk)
+{
+   const uint32_t numWords32 = 32 * 1024;
+   const uint32_t numWords16 = 16 * 1024; // in 32bit words
+   const uint32_t numWords8 = 8 * 1024;   // in 32bit words
+   const uint32_t elemsPerRead = 64;
+   
+   std::vector<uint8_t> data;
+   fillRandom(data, sizeof(uint32_t) * (4 + numWords32 + numWords16 + numWords8), 3);
+   
+   uint32_t* hdr = (uint32_t*)data.data();
+   hdr[0] = Dts3::DefaultVersion;
+   hdr[1] = numWords32 + numWords16 + numWords8;
+   hdr[2] = numWords32;
+   hdr[3] = numWords32 + numWords16;
+   
+   uint32_t dest[elemsPerRead];
+   
+   while (state.keepRunning())
+   {
+      MemRStream stream(data.size(), data.data());
+      Dts3::SplitStream split;
+      split.floodFromStream(stream);
+      
+      for (uint32_t i=0; i<numWords32 / elemsPerRead; i++)
+         split.read32(elemsPerRead, dest);
+      for (uint32_t i=0; i<(numWords16*2) / elemsPerRead; i++)
+         split.read16(elemsPerRead, dest);
+      for (uint32_t i=0; i<(numWords8*4) / elemsPerRead; i++)
+         split.read8(elemsPerRead, dest);
+      
+      benchKeep(dest[0]);
+   }
+   
+   state.setBytesProcessed(data.size());
+}
+
+// BitSet
+
+TV_BENCHMARK(BitSet_Ops)
+{
+   typedef BitSet<IntegerSetBits> SetType;
+   SetType setA, setB, setC;
+   
+   // Bits either side of a word boundary have to land in their own words
+   const std::size_t edgeBits[] = {0, 31, 32, 63, 64, 65, 127, 128, IntegerSetBits-1};
+   const size_t numEdgeBits = sizeof(edgeBits) / sizeof(edgeBits[0]);
+   for (size_t i=0; i<numEdgeBits; i++)
+      setA.set(edgeBits[i], true);
+   
+   bool edgesOK = SetType::TotalWords == IntegerSetBits / 64 &&
+                  setA.count() == numEdgeBits &&
+                  setA.mWords[0] == (((std::size_t)1 << 63) | ((std::size_t)1 << 32) | ((std::size_t)1 << 31) | 1) &&
+                  setA.mWords[1] == (((std::size_t)1 << 63) | 3) &&
+                  setA.mWords[2] == 1 &&
+                  !setA.test(62) && !setA.test(66) && !setA.test(129) &&
+                  setA.findLast() == IntegerSetBits-1 &&
+                  setA.setWordSize() == SetType::TotalWords;
+   
+   size_t numFound = 0;
+   for (std::ptrdiff_t idx = setA.findFirst(); idx >= 0 && edgesOK; idx = setA.findNext(idx+1), numFound++)
+      edgesOK = numFound < numEdgeBits && (std::size_t)idx == edgeBits[numFound];
+   
+   setA.set(64, false);
+   edgesOK = edgesOK && numFound == numEdgeBits && !setA.test(64) && setA.test(63) && setA.test(65);
+   setA.flip(64);
+   edgesOK = edgesOK && setA.test(64) && setA == (setA | setB);
+   
+   // Same again with the 32-bit words sequences use
+   IntegerSet intSet;
+   for (size_t i=0; i<numEdgeBits; i++)
+      intSet.set(edgeBits[i], true);
+   numFound = 0;
+   for (std::ptrdiff_t idx = intSet.findFirst(); idx >= 0 && edgesOK; idx = intSet.findNext(idx+1), numFound++)
+      edgesOK = numFound < numEdgeBits && (std::size_t)idx == edgeBits[numFound];
+   edgesOK = edgesOK && numFound == numEdgeBits && intSet.count() == numEdgeBits &&
+             intSet.mWords[0] == 0x80000001 && intSet.mWords[1] == 0x80000001 && intSet.mWords[2] == 3 &&
+             intSet.setWordSize() == IntegerSet::MaxWords;
+   
+   if (!edgesOK)
+   {
+      state.fail("bits across word boundaries were misplaced");
+      return;
+   }
+   
+   BenchRandom rng(4);
+   for (size_t i=0; i<SetType::TotalWords; i++)
+   {
+      setA.mWords[i] = ((uint64_t)rng.next() << 32) | rng.next();
+      setB.mWords[i] = ((uint64_t)rng.next() << 32) | rng.next();
+   }
+   
+   while (state.keepRunning())
+   {
+      setC = setA;
+      setC &= setB;
+      setC |= setA;
+      setC ^= setB;
+      setC.sub(setA);
+      benchKeep(setC.count());
+   }
+   
+   state.setBytesProcessed(sizeof(SetType::mWords) * 5);
+}
+
+TV_BENCHMARK(BitSet_FindNext)
+{
+   typedef BitSet<IntegerSetBits> SetType;
+   SetType set;
+   
+   // ~1/16 density, similar to sparse node visibility sets
+   BenchRandom rng(5);
+   size_t numSet = 0;
+   for (size_t i=0; i<SetType::TotalWords; i++)
+   {
+      std::size_t word = 0;
+      for (uint32_t b=0; b<SetType::WordBits; b++)
+      {
+         if ((rng.next() & 15) == 0)
+         {
+            word |= ((std::size_t)1) << b;
+            numSet++;
+         }
+      }
+      set.mWords[i] = word;
+   }
+   
+   while (state.keepRunning())
+   {
+      size_t found = 0;
+      for (std::ptrdiff_t idx = set.findNext(-1); idx >= 0; idx = set.findNext(idx+1))
+         found++;
+      benchKeep(found);
+   }
+   
+   state.setItemsProcessed(numSet);
+}
+
+// Texture conversion
+
+TV_BENCHMARK(Texture_CopyMipRGB)
+{
+   const uint32_t width = 256;
+   const uint32_t height = 256;
+   
+   Palette::Data pal;
+   BenchRandom rng(6);
+   for (uint32_t i=0; i<256; i++)
+      pal.colors[i] = rng.next();
+   
+   std::vector<uint8_t> src;
+   fillRandom(src, width * height, 7);
+   std::vector<uint8_t> dest(width * height * 4);
+   
+   while (state.keepRunning())
+   {
+      copyMipRGB(width, height, width * 4, &pal, src.data(), dest.data());
+      benchClobber();
+   }
+   
+   state.setBytesProcessed(width * height);
+}
+
+TV_BENCHMARK(Texture_CopyMipRGBA)
+{
+   const uint32_t width = 256;
+   const uint32_t height = 256;
+   
+   Palette::Data pal;
+   pal.type = Palette::FORMAT_RGBA;
+   BenchRandom rng(8);
+   for (uint32_t i=0; i<256; i++)
+      pal.colors[i] = rng.next();
+   
+   std::vector<uint8_t> src;
+   fillRandom(src, width * height, 9);
+   std::vector<uint8_t> dest(width * height * 4);
+   
+   while (state.keepRunning())
+   {
+      copyMipRGBA(width, height, width * 4, &pal, src.data(), dest.data(), 1);
+      benchClobber();
+   }
+   
+   state.setBytesProcessed(width * height);
+}
+
+TV_BENCHMARK(Texture_CopyLMMipDirect)
+{
+   const uint32_t width = 256;
+   const uint32_t height = 256;
+   
+   std::vector<uint8_t> src;
+   fillRandom(src, width * height * 2, 10);
+   std::vector<uint8_t> dest(width * height * 4);
+   
+   while (state.keepRunning())
+   {
+      copyLMMipDirect(height, width * 2, width * 4, src.data(), dest.data());
+      benchClobber();
+   }
+   
+   state.setBytesProcessed(width * height * 2);
+}
+
+TV_BENCHMARK(Texture_CopyRGBToRGBA)
+{
+   const uint32_t width = 256;
+   const uint32_t height = 256;
+   
+   std::vector<uint8_t> src;
+   fillRandom(src, width * height * 3, 11);
+   std::vector<uint8_t> dest(width * height * 4);
+   
+   while (state.keepRunning())
+   {
+      copyRGBToRGBA(dest.data(), src.data(), width * height);
+      benchClobber();
+   }
+   
+   // Odd count so the vector, word and tail paths all run
+   const uint32_t numCheck = (width * height) - 3;
+   std::fill(dest.begin(), dest.end(), 0);
+   copyRGBToRGBA(dest.data(), src.data(), numCheck);
+   for (uint32_t i=0; i<width * height; i++)
+   {
+      bool ok = i < numCheck ?
+         (dest[(i*4)+0] == src[(i*3)+0] && dest[(i*4)+1] == src[(i*3)+1] &&
+          dest[(i*4)+2] == src[(i*3)+2] && dest[(i*4)+3] == 255) :
+         (dest[(i*4)+0] == 0 && dest[(i*4)+3] == 0);
+      if (!ok)
+      {
+         state.fail("RGB expansion didn't match");
+         break;
+      }
+   }
+   
+   state.setBytesProcessed(width * height * 3);
+}
+
+TV_BENCHMARK(Texture_Copy565ToRGBA)
+{
+   const uint32_t width = 256;
+   const uint32_t height = 256;
+   
+   std::vector<uint8_t> src;
+   fillRandom(src, width * height * 2, 12);
+   std::vector<uint8_t> dest(width * height * 4);
+   
+   while (state.keepRunning())
+   {
+      copy565ToRGBA(dest.data(), (const uint16_t*)src.data(), width * height);
+      benchClobber();
+   }
+   
+   // Odd count so the vector and tail paths both run
+   const uint32_t numCheck = (width * height) - 3;
+   std::fill(dest.begin(), dest.end(), 0);
+   copy565ToRGBA(dest.data(), (const uint16_t*)src.data(), numCheck);
+   for (uint32_t i=0; i<width * height; i++)
+   {
+      uint32_t c = src[i*2] | (src[(i*2)+1] << 8);
+      uint32_t r = (c >> 11) & 0x1F;
+      uint32_t g = (c >> 5) & 0x3F;
+      uint32_t b = c & 0x1F;
+      bool ok = i < numCheck ?
+         (dest[(i*4)+0] == ((r << 3) | (r >> 2)) && dest[(i*4)+1] == ((g << 2) | (g >> 4)) &&
+          dest[(i*4)+2] == ((b << 3) | (b >> 2)) && dest[(i*4)+3] == 255) :
+         (dest[(i*4)+0] == 0 && dest[(i*4)+3] == 0);
+      if (!ok)
+      {
+         state.fail("565 expansion didn't match");
+         break;
+      }
+   }
+   
+   state.setBytesProcessed(width * height * 2);
+}
+
+// Hashing
+
+TV_BENCHMARK(Hash_Bytes64)
+{
+   std::vector<uint8_t> data;
+   fillRandom(data, 1024 * 1024, 13);
+   
+   while (state.keepRunning())
+      benchKeep(hashBytes64(data.data(), data.size()));
+   
+   state.setBytesProcessed(data.size());
+}
+
+TV_BENCHMARK(Hash_Content64)
+{
+   std::vector<uint8_t> data;
+   fillRandom(data, 1024 * 1024, 13);
+   
+   // Any single byte change (including the unaligned tail) should change the hash
+   uint64_t base = hashContent64(data.data(), data.size());
+   const size_t offsets[] = {0, 7, 63, 64, 1023, 1024 * 512 + 5, data.size() - 1};
+   for (size_t offset : offsets)
+   {
+      data[offset] ^= 0x10;
+      uint64_t changed = hashContent64(data.data(), data.size());
+      data[offset] ^= 0x10;
+      if (changed == base)
+      {
+         state.fail("content hash missed a changed byte");
+         return;
+      }
+   }
+   
+   if (hashContent64(data.data(), data.size()) != base ||
+       hashContent64(data.data(), data.size() - 1) == base ||
+       hashContent64(data.data(), data.size(), 1) == base)
+   {
+      state.fail("content hash isn't stable");
+      return;
+   }
+   
+   // Reference XXH3 64-bit values, covering each of its length ranges
+   static const struct { uint32_t size; uint64_t hash; uint64_t seededHash; } sKnown[] = {
+      {0, 0x2d06800538d394c2ULL, 0x602b0e2cd6662c8bULL},
+      {1, 0xc44bdff4074eecdbULL, 0x062b185e4e01441aULL},
+      {3, 0x52aab5efb65ba70cULL, 0x943e3bbc42a56eafULL},
+      {4, 0xad400f5ff0348d48ULL, 0x7bf5d652bb0d826fULL},
+      {8, 0xa4525fd03fd9b3fbULL, 0xac080a82806403daULL},
+      {9, 0x34ef567b4f2f73ecULL, 0x52344cff99949af2ULL},
+      {16, 0x2f104d56be42214aULL, 0xc327581b6d224d11ULL},
+      {17, 0x3e6df1cc1fb35f38ULL, 0x6cde5338ab7a0fadULL},
+      {128, 0x65313193ac18bfceULL, 0x0508d5f72b8a3c98ULL},
+      {129, 0x43107010904f124dULL, 0xa4a63ca213e585b6ULL},
+      {240, 0x8aa7f1fc572d11d6ULL, 0xe70e5042211388ddULL},
+      {241, 0xddb128241a3b606bULL, 0x3314f6d6cd1bf1f3ULL},
+      {1024, 0x7e5f60b49bfb2c59ULL, 0x9ea3ddbf3332920aULL},
+      {4096, 0x2584629371ea1d8fULL, 0xd3e91f8738602a1dULL},
+      {100003, 0xf804395d230c0efdULL, 0xe4ec0b65bde4b142ULL}
+   };
+   std::vector<uint8_t> pattern(100003);
+   for (size_t i=0; i<pattern.size(); i++)
+      pattern[i] = (uint8_t)(((uint64_t)i * 2654435761ULL) >> 7);
+   for (const auto& known : sKnown)
+   {
+      if (hashContent64(pattern.data(), known.size) != known.hash ||
+          hashContent64(pattern.data(), known.size, 0x9E3779B97F4A7C15ULL) != known.seededHash)
+      {
+         state.fail("content hash doesn't match reference XXH3");
+         return;
+      }
+   }
+   
+   // Near-identical blobs are what dedup sees most: every single bit flip of a
+   // 4K block, every prefix of it, and small counters all have to stay distinct
+   std::vector<uint64_t> hashes;
+   const size_t blockSize = 4096;
+   uint64_t flipBits = 0;
+   for (size_t bit=0; bit<blockSize * 8; bit++)
+   {
+      data[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+      uint64_t h = hashContent64(data.data(), blockSize);
+      data[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+      flipBits += std::popcount(h ^ hashContent64(data.data(), blockSize));
+      hashes.push_back(h);
+   }
+   for (size_t len=0; len<=blockSize; len++)
+      hashes.push_back(hashContent64(data.data(), len));
+   for (uint32_t i=0; i<65536; i++)
+      hashes.push_back(hashContent64(&i, sizeof(i)));
+   
+   std::sort(hashes.begin(), hashes.end());
+   if (std::adjacent_find(hashes.begin(), hashes.end()) != hashes.end())
+   {
+      state.fail("content hash collided on near-identical inputs");
+      return;
+   }
+   
+   // A flipped input bit should flip about half of the output bits
+   double avgFlipped = (double)flipBits / (double)(blockSize * 8);
+   if (avgFlipped < 31.0 || avgFlipped > 33.0)
+   {
+      state.fail("content hash doesn't avalanche");
+      return;
+   }
+   
+   while (state.keepRunning())
+      benchKeep(hashContent64(data.data(), data.size()));
+   
+   state.setBytesProcessed(data.size());
+}
+
+// Uncompressed 32bit TGA, which stbi reads; idLength extra bytes change the file but not the pixels
+static void buildTGA(std::vector<uint8_t>& out, uint32_t width, uint32_t height, const uint8_t* rgba, uint8_t idLength)
+{
+   uint8_t header[18] = {};
+   header[0] = idLength;
+   header[2] = 2; // truecolor
+   header[12] = (uint8_t)width; header[13] = (uint8_t)(width >> 8);
+   header[14] = (uint8_t)height; header[15] = (uint8_t)(height >> 8);
+   header[16] = 32;
+   header[17] = 0x28; // top left origin, 8 alpha bits
+   
+   out.assign(header, header + sizeof(header));
+   out.resize(out.size() + idLength, 'x');
+   for (uint32_t i=0; i<width*height; i++, rgba += 4)
+   {
+      uint8_t bgra[4] = { rgba[2], rgba[1], rgba[0], rgba[3] };
+      out.insert(out.end(), bgra, bgra + 4);
+   }
+}
+
+TV_BENCHMARK(Texture_CacheDedup)
+{
+   // 256 material texture loads of 32 distinct 64x64 images, each under 4 different names.
+   // Three of the copies are identical files and one is re-encoded with the same pixels.
+   const uint32_t numImages = 32;
+   const uint32_t numCopies = 4;
+   const uint32_t numLoads = 256;
+   const uint32_t texSize = 64;
+   const uint32_t imageBytes = texSize * texSize * 4;
+   std::vector<uint8_t> images;
+   fillRandom(images, numImages * imageBytes, 17);
+   
+   std::error_code ec;
+   std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "TorqueViewerBench_textures";
+   std::filesystem::remove_all(dir, ec);
+   std::filesystem::create_directories(dir, ec);
+   
+   bool ok = true;
+   std::vector<uint8_t> file;
+   for (uint32_t i=0; i<numImages; i++)
+   {
+      for (uint32_t c=0; c<numCopies; c++)
+      {
+         char name[64];
+         snprintf(name, sizeof(name), "tex%02u_%u", i, c);
+         buildTGA(file, texSize, texSize, &images[i * imageBytes], c == 2 ? 4 : 0);
+         
+         FILE* fp = fopen((dir / name).string().c_str(), "wb");
+         ok = ok && fp != NULL && fwrite(file.data(), 1, file.size(), fp) == file.size();
+         if (fp)
+            fclose(fp);
+      }
+   }
+   
+   if (!ok)
+   {
+      state.fail("couldn't write texture files");
+      return;
+   }
+   
+   ResManager mgr;
+   mgr.mPaths.push_back(dir.string());
+   
+   uint32_t numUploads = 0;
+   uint32_t numFreed = 0;
+   int32_t nextTexID = 0;
+   MaterialTextureLoader loader([&](uint32_t width, uint32_t height, const uint8_t* pixels) {
+      numUploads++;
+      return nextTexID++;
+   }, [&](int32_t texID) {});
+   TextureCache cache([&](int32_t texID) {
+      numFreed++;
+      loader.freeTexture(texID);
+   });
+   loader.mCache = &cache;
+   
+   TextureStreamer streamer([&](int32_t texID, uint32_t width, uint32_t height, const uint8_t* pixels) {
+      if (texID < 0)
+         return nextTexID++;
+      cache.setBytes(texID, TextureStreamer::getMipBytes(width, height, 0));
+      return texID;
+   }, [&](int32_t texID) {});
+   
+   std::vector<int32_t> loaded(numLoads);
+   auto loadAll = [&]() {
+      for (uint32_t i=0; i<numLoads; i++)
+      {
+         char name[64];
+         snprintf(name, sizeof(name), "tex%02u_%u", i % numImages, (i / numImages) % numCopies);
+         loaded[i] = loader.load(&mgr, name);
+      }
+   };
+   
+   auto releaseAll = [&]() {
+      for (int32_t texID : loaded)
+         loader.release(texID);
+   };
+   
+   loadAll();
+   uint64_t texBytes = TextureStreamer::getMipBytes(texSize, texSize, 0);
+   if (numUploads != numImages || cache.mStats.numTextures != numImages || cache.mStats.savedBytes != (uint64_t)(numLoads - numImages) * texBytes)
+   {
+      state.fail("duplicate textures weren't shared");
+      return;
+   }
+   
+   releaseAll();
+   if (numFreed != numImages || cache.mStats.numRefs != 0 || cache.mStats.savedBytes != 0)
+   {
+      state.fail("shared textures weren't freed with their last reference");
+      return;
+   }
+   
+   // Streamed textures should only count what's resident, including after
+   // raises which reload the source on the async reader
+   loader.mStreamer = &streamer;
+   loadAll();
+   for (uint32_t frame=0; frame<4; frame++)
+   {
+      for (int32_t texID : loaded)
+         streamer.requestSize(texID, (texID & 1) ? (float)texSize : 1.0f);
+      streamer.update();
+      mgr.waitAsync();
+      
+      if (cache.mStats.residentBytes != streamer.mStats.residentBytes ||
+          cache.mStats.savedBytes != (uint64_t)(numLoads / numImages - 1) * streamer.mStats.residentBytes)
+      {
+         state.fail("cached bytes don't follow the streamed mips");
+         return;
+      }
+   }
+   
+   if (streamer.mStats.residentBytes >= numImages * texBytes || streamer.mStats.failedReloads != 0 ||
+       streamer.getResidentMip(loaded[1]) != 0)
+   {
+      state.fail("streamed textures weren't raised from a reload");
+      return;
+   }
+   
+   releaseAll();
+   if (streamer.getResidentMip(loaded[0]) >= 0)
+   {
+      state.fail("streamed textures weren't freed with their last reference");
+      return;
+   }
+   loader.mStreamer = NULL;
+   
+   while (state.keepRunning())
+   {
+      loadAll();
+      releaseAll();
+   }
+   
+   std::filesystem::remove_all(dir, ec);
+   state.setItemsProcessed(numLoads);
+}
+
+static void appendLE(std::vector<uint8_t>& out, uint64_t value, uint32_t bytes)
+{
+   for (uint32_t i=0; i<bytes; i++)
+      out.push_back((uint8_t)(value >> (i * 8)));
+}
+
+TV_BENCHMARK(Texture_StreamPalettized)
+{
+   // A palettized bitmap whose stored mips don't match a box filter, so using
+   // them rather than rebuilding can be told apart
+   const uint32_t texSize = 64;
+   const uint32_t numStored = 4;
+   std::vector<uint8_t> colors;
+   fillRandom(colors, 256 * 4, 23);
+   
+   std::vector<uint8_t> data;
+   std::vector<uint32_t> offsets;
+   for (uint32_t i=0; i<numStored; i++)
+   {
+      uint32_t size = texSize >> i;
+      offsets.push_back((uint32_t)data.size());
+      for (uint32_t p=0; p<size*size; p++)
+         data.push_back((uint8_t)((p * 7) + (i * 61)));
+   }
+   
+   std::vector<uint8_t> file;
+   auto put32 = [&file](uint32_t value) { appendLE(file, value, 4); };
+   put32(1); put32(Bitmap::FORMAT_PAL); put32(texSize); put32(texSize); put32((uint32_t)data.size());
+   file.insert(file.end(), data.begin(), data.end());
+   put32(numStored);
+   for (uint32_t offset : offsets)
+      put32(offset);
+   put32(1); put32(0); put32(Palette::FORMAT_RGBA);
+   file.insert(file.end(), colors.begin(), colors.end());
+   
+   std::error_code ec;
+   std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "TorqueViewerBench_palettized";
+   std::filesystem::remove_all(dir, ec);
+   std::filesystem::create_directories(dir, ec);
+   FILE* fp = fopen((dir / "skin.bmp").string().c_str(), "wb");
+   bool ok = fp != NULL && fwrite(file.data(), 1, file.size(), fp) == file.size();
+   if (fp)
+      fclose(fp);
+   
+   Bitmap bmp;
+   MemRStream mem(file.size(), file.data());
+   if (!ok || !bmp.read(mem) || bmp.mFormat != Bitmap::FORMAT_PAL || bmp.mMipLevels != numStored || bmp.mPal == NULL)
+   {
+      state.fail("palettized bitmap didn't read back");
+      return;
+   }
+   
+   // What each stored mip should upload as
+   auto expectMip = [&](uint32_t mip, const uint8_t* pixels) {
+      const uint8_t* src = &data[offsets[mip]];
+      uint32_t size = texSize >> mip;
+      for (uint32_t p=0; p<size*size; p++)
+      {
+         if (memcmp(pixels + p*4, &colors[src[p] * 4], 4) != 0)
+            return false;
+      }
+      return true;
+   };
+   
+   bool badPixels = false;
+   std::vector<uint32_t> uploadedMips;
+   TextureStreamer streamer([&](int32_t texID, uint32_t width, uint32_t height, const uint8_t* pixels) {
+      uint32_t mip = 0;
+      while ((texSize >> mip) > width)
+         mip++;
+      if (mip < numStored && !expectMip(mip, pixels))
+         badPixels = true;
+      uploadedMips.push_back(mip);
+      return 0;
+   }, [](int32_t texID) {});
+   
+   ResManager mgr;
+   mgr.mPaths.push_back(dir.string());
+   MaterialTextureLoader loader([](uint32_t, uint32_t, const uint8_t*) { return -1; }, [](int32_t) {});
+   loader.mStreamer = &streamer;
+   
+   int32_t texID = loader.uploadPalettized(&mgr, "skin.bmp", bmp, NULL, 1);
+   for (uint32_t frame=0; texID >= 0 && frame<3; frame++)
+   {
+      streamer.requestSize(texID, (float)texSize);
+      streamer.update();
+      mgr.waitAsync();
+   }
+   
+   if (texID < 0 || badPixels || uploadedMips.size() != 2 || uploadedMips[0] != 1 || uploadedMips[1] != 0 ||
+       streamer.mStats.failedReloads != 0)
+   {
+      state.fail("palettized textures didn't stream from their stored mips");
+      return;
+   }
+   
+   std::vector<uint8_t> pixels;
+   while (state.keepRunning())
+      benchKeep(MaterialTextureLoader::expandPalettized(bmp, bmp.mPal, pixels));
+   
+   std::filesystem::remove_all(dir, ec);
+   state.setBytesProcessed(pixels.size());
+}
+
+// Zip inflate (same decoder Volume::openStream uses for method 8)
+
+TV_BENCHMARK(Zip_Inflate)
+{
+   std::vector<uint8_t> original;
+   std::vector<uint8_t> compressed;
+   fillCompressible(original, 1024 * 1024, 11);
+   benchDeflateFixed(original.data(), original.size(), compressed);
+   
+   std::vector<uint8_t> dest(original.size());
+   
+   DeflateDecoder decoder;
+   DeflateDecoder::Status status = decoder.decode(compressed.data(), compressed.size(), 0, dest.data(), 0, dest.size());
+   if (status == DeflateDecoder::Error || status == DeflateDecoder::NeedInput ||
+       decoder.getOutPos() != original.size() || memcmp(dest.data(), original.data(), original.size()) != 0)
+   {
+      state.fail("inflate output did not match input");
+      return;
+   }
+   
+   // Should agree with stb on the same stream
+   int outSize = stbi_zlib_decode_noheader_buffer((char*)dest.data(), (int)dest.size(), (const char*)compressed.data(), (int)compressed.size());
+   if (outSize != (int)original.size() || memcmp(dest.data(), original.data(), original.size()) != 0)
+   {
+      state.fail("stb inflate output did not match input");
+      return;
+   }
+   
+   while (state.keepRunning())
+   {
+      status = decoder.decode(compressed.data(), compressed.size(), 0, dest.data(), 0, dest.size());
+      benchKeep(status);
+   }
+   
+   state.setBytesProcessed(original.size());
+}
+
+// Minimal single entry zip with a deflated file
+static void buildSyntheticZip(std::vector<uint8_t>& out, const char* name, const std::vector<uint8_t>& compressed, uint64_t uncompressedSize)
+{
+   uint32_t nameLen = (uint32_t)strlen(name);
+   out.clear();
+   
+   appendLE(out, 0x04034b50, 4); // local header
+   appendLE(out, 20, 2);
+   appendLE(out, 0, 2);
+   appendLE(out, 8, 2);
+   appendLE(out, 0, 4);
+   appendLE(out, 0, 4);
+   appendLE(out, compressed.size(), 4);
+   appendLE(out, uncompressedSize, 4);
+   appendLE(out, nameLen, 2);
+   appendLE(out, 0, 2);
+   out.insert(out.end(), name, name + nameLen);
+   out.insert(out.end(), compressed.begin(), compressed.end());
+   
+   uint64_t cdOffset = out.size();
+   appendLE(out, 0x02014b50, 4); // central header
+   appendLE(out, 20, 2);
+   appendLE(out, 20, 2);
+   appendLE(out, 0, 2);
+   appendLE(out, 8, 2);
+   appendLE(out, 0, 4);
+   appendLE(out, 0, 4);
+   appendLE(out, compressed.size(), 4);
+   appendLE(out, uncompressedSize, 4);
+   appendLE(out, nameLen, 2);
+   appendLE(out, 0, 2);
+   appendLE(out, 0, 2);
+   appendLE(out, 0, 2);
+   appendLE(out, 0, 2);
+   appendLE(out, 0, 4);
+   appendLE(out, 0, 4);
+   out.insert(out.end(), name, name + nameLen);
+   uint64_t cdSize = out.size() - cdOffset;
+   
+   appendLE(out, 0x06054b50, 4); // end of central directory
+   appendLE(out, 0, 2);
+   appendLE(out, 0, 2);
+   appendLE(out, 1, 2);
+   appendLE(out, 1, 2);
+   appendLE(out, cdSize, 4);
+   appendLE(out, cdOffset, 4);
+   appendLE(out, 0, 2);
+}
+
+// Random 64KB reads from a large deflated volume entry
+
+TV_BENCHMARK(Zip_RangeRead)
+{
+   const uint64_t dataSize = 8 * 1024 * 1024;
+   const uint64_t blockSize = 64 * 1024;
+   const uint64_t readSize = 64 * 1024;
+   const char* entryName = "terrains/Big.ter";
+   
+   std::vector<uint8_t> original;
+   std::vector<uint8_t> compressed;
+   std::vector<uint8_t> zipData;
+   fillCompressible(original, dataSize, 12);
+   benchDeflateFixed(original.data(), original.size(), compressed, blockSize);
+   buildSyntheticZip(zipData, entryName, compressed, original.size());
+   
+   std::error_code ec;
+   std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "TorqueViewerBench_zip";
+   std::filesystem::remove_all(dir, ec);
+   std::filesystem::create_directories(dir, ec);
+   std::string zipName = (dir / "synthetic.zip").string();
+   
+   FILE* fp = fopen(zipName.c_str(), "wb");
+   if (fp == NULL)
+   {
+      state.fail("couldn't write scratch zip");
+      return;
+   }
+   fwrite(zipData.data(), 1, zipData.size(), fp);
+   fclose(fp);
+   
+   // A directory record whose name runs past the directory shouldn't mount
+   {
+      static const uint8_t sCDSig[4] = { 0x50, 0x4b, 0x01, 0x02 };
+      std::vector<uint8_t> badData = zipData;
+      auto itr = std::search(badData.begin(), badData.end(), sCDSig, sCDSig + 4);
+      if (itr != badData.end())
+      {
+         itr[28] = 0xFF;
+         itr[29] = 0xFF;
+      }
+      
+      std::string badName = (dir / "bad.zip").string();
+      fp = fopen(badName.c_str(), "wb");
+      if (fp)
+      {
+         fwrite(badData.data(), 1, badData.size(), fp);
+         fclose(fp);
+      }
+      
+      ResManager mgr;
+      mgr.addVolume(badName.c_str());
+      if (itr == badData.end() || !mgr.mVolumes.empty())
+      {
+         state.fail("corrupt central directory was accepted");
+         return;
+      }
+   }
+   
+   auto check = [&](ResManager& mgr, uint64_t offset, uint64_t size) {
+      MemRStream stream;
+      return mgr.openFileRange(entryName, offset, size, stream) &&
+             stream.mSize == size &&
+             memcmp(stream.mPtr, original.data() + offset, size) == 0;
+   };
+   
+   ResManager::ReadStats stats;
+   {
+      ResManager mgr;
+      mgr.setIndexCachePath(dir.string().c_str());
+      mgr.addVolume(zipName.c_str());
+      
+      // Header peeks shouldn't need the whole entry
+      if (!check(mgr, 0, 4096))
+      {
+         state.fail("header read did not match");
+         return;
+      }
+      mgr.getReadStats(stats);
+      if (stats.compressedRead * 16 > compressed.size())
+      {
+         state.fail("header read touched too much of the entry");
+         return;
+      }
+      
+      MemRStream full;
+      if (!mgr.openFile(entryName, full) || full.mSize != original.size() ||
+          memcmp(full.mPtr, original.data(), original.size()) != 0)
+      {
+         state.fail("full read did not match");
+         return;
+      }
+      mgr.getReadStats(stats);
+      if (stats.numCheckpoints < dataSize / DeflateIndex::DefaultSpacing)
+      {
+         state.fail("full read did not index the entry");
+         return;
+      }
+   }
+   
+   // A cached index claiming more checkpoints than the entry can hold is ignored
+   // before anything is allocated for them
+   bool checkedCache = false;
+   for (const std::filesystem::directory_entry& file : std::filesystem::directory_iterator(dir, ec))
+   {
+      if (file.path().extension() != ".dfi")
+         continue;
+      
+      std::vector<uint8_t> cacheData;
+      {
+         MappedFile cacheFile;
+         if (cacheFile.open(file.path().string().c_str()))
+            cacheData.assign(cacheFile.mPtr, cacheFile.mPtr + cacheFile.mSize);
+      }
+      
+      const size_t keyOffset = 8;
+      const size_t numCheckpointsOffset = 40;
+      uint64_t key = 0;
+      if (cacheData.size() >= numCheckpointsOffset + 4)
+         memcpy(&key, &cacheData[keyOffset], sizeof(key));
+      
+      DeflateIndex goodIndex(compressed.size(), original.size());
+      if (!goodIndex.readCache(file.path().string().c_str(), key))
+      {
+         state.fail("cached index couldn't be read back");
+         return;
+      }
+      
+      uint32_t count = 0x40000000;
+      memcpy(&cacheData[numCheckpointsOffset], &count, sizeof(count));
+      std::string badName = (dir / "bad.dfi").string();
+      fp = fopen(badName.c_str(), "wb");
+      bool writeOK = fp != NULL && fwrite(cacheData.data(), 1, cacheData.size(), fp) == cacheData.size();
+      if (fp)
+         fclose(fp);
+      
+      DeflateIndex badIndex(compressed.size(), original.size());
+      bool readOK = badIndex.readCache(badName.c_str(), key);
+      std::filesystem::remove(badName, ec);
+      DeflateIndex::Stats badStats;
+      badIndex.getStats(badStats);
+      if (!writeOK || readOK || badStats.numRejectedCaches != 1)
+      {
+         state.fail("corrupt index checkpoint count was accepted");
+         return;
+      }
+      checkedCache = true;
+      break;
+   }
+   if (!checkedCache)
+   {
+      state.fail("full read did not save its index");
+      return;
+   }
+   
+   // A new manager picks the index up from the cache folder
+   ResManager mgr;
+   mgr.setIndexCachePath(dir.string().c_str());
+   mgr.addVolume(zipName.c_str());
+   
+   uint64_t maxInflate = DeflateIndex::DefaultSpacing + blockSize + readSize;
+   if (!check(mgr, dataSize - readSize, readSize))
+   {
+      state.fail("tail read did not match");
+      return;
+   }
+   mgr.getReadStats(stats);
+   if (stats.inflated > maxInflate)
+   {
+      state.fail("cached index wasn't used");
+      return;
+   }
+   
+   BenchRandom rng(13);
+   const uint32_t numChecks = 32;
+   for (uint32_t i=0; i<numChecks; i++)
+   {
+      uint64_t offset = rng.next() % (dataSize - readSize);
+      if (!check(mgr, offset, readSize))
+      {
+         state.fail("range read did not match");
+         return;
+      }
+   }
+   
+   mgr.getReadStats(stats);
+   if (stats.numRetries != 0 || stats.inflated > maxInflate * (numChecks + 1))
+   {
+      state.fail("range reads inflated more than one checkpoint span");
+      return;
+   }
+   
+   while (state.keepRunning())
+   {
+      MemRStream stream;
+      uint64_t offset = rng.next() % (dataSize - readSize);
+      if (!mgr.openFileRange(entryName, offset, readSize, stream))
+      {
+         state.fail("range read failed");
+         break;
+      }
+      benchKeep(stream.mPtr[0]);
+   }
+   
+   std::filesystem::remove_all(dir, ec);
+   
+   state.setBytesProcessed(readSize);
+   state.setItemsProcessed(1);
+}
+
+// LZ4 decode of the same data as Zip_Inflate
+
+TV_BENCHMARK(Zip_LZ4Decode)
+{
+   std::vector<uint8_t> original;
+   std::vector<uint8_t> compressed;
+   fillCompressible(original, 1024 * 1024, 11);
+   LZ4Codec::compress(original.data(), original.size(), compressed);
+   
+   std::vector<uint8_t> dest(original.size());
+   if (!LZ4Codec::decompress(compressed.data(), compressed.size(), dest.data(), dest.size()) ||
+       memcmp(dest.data(), original.data(), original.size()) != 0)
+   {
+      state.fail("lz4 output did not match input");
+      return;
+   }
+   
+   while (state.keepRunning())
+   {
+      bool ok = LZ4Codec::decompress(compressed.data(), compressed.size(), dest.data(), dest.size());
+      benchKeep(ok);
+   }
+   
+   state.setBytesProcessed(original.size());
+}
+
+// Decoding frames written by the reference lz4 and zstd tools
+
+TV_BENCHMARK(Zip_ReferenceFrames)
+{
+   struct TestFrame
+   {
+      const char* name;
+      uint16_t method;
+      const uint8_t* data;
+      size_t size;
+   };
+   
+   const TestFrame frames[] = {
+      { "lz4", ZipMethod_LZ4, sLZ4FrameDefault, sizeof(sLZ4FrameDefault) },
+      { "lz4 -BD", ZipMethod_LZ4, sLZ4FrameLinked, sizeof(sLZ4FrameLinked) },
+      { "lz4 -BX", ZipMethod_LZ4, sLZ4FrameBlockChecksum, sizeof(sLZ4FrameBlockChecksum) },
+      { "zstd -3", ZipMethod_Zstd, sZstdFrameLevel3, sizeof(sZstdFrameLevel3) },
+      { "zstd -19", ZipMethod_Zstd, sZstdFrameLevel19, sizeof(sZstdFrameLevel19) }
+   };
+   const size_t numFrames = sizeof(frames) / sizeof(frames[0]);
+   
+   std::vector<uint8_t> tile;
+   std::vector<uint8_t> original;
+   fillCompressible(tile, kReferenceFrameTileSize, 31);
+   while (original.size() < kReferenceFrameSize)
+      original.insert(original.end(), tile.begin(), tile.end());
+   original.resize(kReferenceFrameSize);
+   
+   std::vector<uint8_t> dest(original.size());
+   for (size_t i=0; i<numFrames; i++)
+   {
+      const TestFrame& frame = frames[i];
+      std::fill(dest.begin(), dest.end(), 0);
+      bool ok = frame.method == ZipMethod_LZ4 ?
+         LZ4Codec::decompress(frame.data, frame.size, dest.data(), dest.size()) :
+         ZstdCodec::decompress(frame.data, frame.size, dest.data(), dest.size());
+      if (!ok || dest != original)
+      {
+         state.fail((std::string(frame.name) + " frame did not match its input").c_str());
+         return;
+      }
+   }
+   
+   while (state.keepRunning())
+   {
+      for (size_t i=0; i<numFrames; i++)
+      {
+         const TestFrame& frame = frames[i];
+         bool ok = frame.method == ZipMethod_LZ4 ?
+            LZ4Codec::decompress(frame.data, frame.size, dest.data(), dest.size()) :
+            ZstdCodec::decompress(frame.data, frame.size, dest.data(), dest.size());
+         benchKeep(ok);
+      }
+   }
+   
+   state.setBytesProcessed(original.size() * numFrames);
+   state.setItemsProcessed(numFrames);
+}
+
+// Loading every entry of a volume written by VolumeWriter
+
+TV_BENCHMARK(Volume_RepackedLoad)
+{
+   struct TestEntry
+   {
+      const char* name;
+      uint16_t method;
+      std::vector<uint8_t> data;
+   };
+   
+   TestEntry entries[4] = {
+      { "shapes/player.dts", ZipMethod_LZ4, {} },
+      { "textures/skin.png", ZipMethod_Store, {} },
+      { "scripts/player.cs", ZipMethod_LZ4, {} },
+      { "readme.txt", ZipMethod_Store, {} }
+   };
+   fillCompressible(entries[0].data, 2 * 1024 * 1024, 21);
+   fillRandom(entries[1].data, 100 * 1024, 22);
+   fillCompressible(entries[2].data, 64 * 1024, 23);
+   fillCompressible(entries[3].data, 100, 24);
+   
+   std::error_code ec;
+   std::string zipName = (std::filesystem::temp_directory_path(ec) / "TorqueViewerBench_repack.zip").string();
+   
+   VolumeWriter writer;
+   bool ok = writer.open(zipName.c_str());
+   for (TestEntry& entry : entries)
+      ok = ok && writer.addEntry(entry.name, entry.data.data(), entry.data.size(), entry.method);
+   ok = ok && writer.close();
+   if (!ok || writer.mStats.numMethod[1] != 2)
+   {
+      state.fail("couldn't write volume");
+      return;
+   }
+   
+   // Stored data should start on an alignment boundary
+   std::vector<uint8_t> zipData;
+   {
+      MappedFile file;
+      if (file.open(zipName.c_str()))
+         zipData.assign(file.mPtr, file.mPtr + file.mSize);
+   }
+   bool aligned = false;
+   const std::vector<uint8_t>& storedData = entries[1].data;
+   for (size_t pos=0; pos + storedData.size() <= zipData.size(); pos += VolumeWriter::DefaultAlignment)
+   {
+      if (memcmp(zipData.data() + pos, storedData.data(), storedData.size()) == 0)
+         aligned = true;
+   }
+   if (!aligned)
+   {
+      state.fail("stored entry wasn't aligned");
+      return;
+   }
+   
+   ResManager mgr;
+   mgr.addVolume(zipName.c_str());
+   for (TestEntry& entry : entries)
+   {
+      MemRStream stream;
+      if (!mgr.openFile(entry.name, stream) || stream.mSize != entry.data.size() ||
+          memcmp(stream.mPtr, entry.data.data(), entry.data.size()) != 0)
+      {
+         state.fail("volume entry did not match");
+         return;
+      }
+   }
+   
+   uint64_t bytes = 0;
+   while (state.keepRunning())
+   {
+      bytes = 0;
+      for (TestEntry& entry : entries)
+      {
+         MemRStream stream;
+         mgr.openFile(entry.name, stream);
+         bytes += stream.mSize;
+      }
+      benchKeep(bytes);
+   }
+   
+   std::filesystem::remove(zipName, ec);
+   
+   state.setBytesProcessed(bytes);
+   state.setItemsProcessed(4);
+}
+
+// Loading many small files through the async reader
+
+TV_BENCHMARK(Async_ReadFiles)
+{
+   const uint32_t numFiles = 64;
+   const uint64_t fileSize = 256 * 1024;
+   
+   std::error_code ec;
+   std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "TorqueViewerBench_async";
+   std::filesystem::remove_all(dir, ec);
+   std::filesystem::create_directories(dir, ec);
+   
+   std::vector<std::vector<uint8_t> > files(numFiles);
+   std::vector<std::string> names(numFiles);
+   VolumeWriter writer;
+   bool ok = writer.open((dir / "packed.zip").string().c_str());
+   for (uint32_t i=0; i<numFiles; i++)
+   {
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "file%02u.bin", i);
+      names[i] = buffer;
+      fillCompressible(files[i], fileSize - i * 512, 40 + i);
+      
+      FILE* fp = fopen((dir / names[i]).string().c_str(), "wb");
+      ok = ok && fp != NULL && fwrite(files[i].data(), 1, files[i].size(), fp) == files[i].size();
+      if (fp)
+         fclose(fp);
+      
+      // The volume gets one of each method
+      snprintf(buffer, sizeof(buffer), "packed%02u.bin", i);
+      static const uint16_t sMethods[3] = { ZipMethod_Store, ZipMethod_LZ4, ZipMethod_Store };
+      ok = ok && writer.addEntry(buffer, files[i].data(), files[i].size(), sMethods[i % 3]);
+   }
+   ok = ok && writer.close();
+   if (!ok)
+   {
+      state.fail("couldn't write scratch files");
+      return;
+   }
+   
+   std::string zipName = (dir / "deflated.zip").string();
+   {
+      std::vector<uint8_t> compressed;
+      std::vector<uint8_t> zipData;
+      benchDeflateFixed(files[0].data(), files[0].size(), compressed, 64 * 1024);
+      buildSyntheticZip(zipData, "deflated.bin", compressed, files[0].size());
+      FILE* fp = fopen(zipName.c_str(), "wb");
+      if (fp)
+      {
+         fwrite(zipData.data(), 1, zipData.size(), fp);
+         fclose(fp);
+      }
+   }
+   
+   // Both backends should read every file intact
+   for (uint32_t pass=0; pass<2; pass++)
+   {
+      AsyncReader reader(4, 16, pass == 0);
+      std::atomic<uint32_t> numBad(0);
+      std::vector<int> fds(numFiles);
+      for (uint32_t i=0; i<numFiles; i++)
+      {
+         fds[i] = open((dir / names[i]).string().c_str(), O_RDONLY);
+         const std::vector<uint8_t>& expected = files[i];
+         reader.read(fds[i], 0, expected.size(), AsyncReader::Priority_Prefetch, [&numBad, &expected](uint8_t* data, uint64_t size){
+            if (data == NULL || size != expected.size() || memcmp(data, expected.data(), size) != 0)
+               numBad++;
+            free(data);
+         });
+      }
+      reader.wait();
+      for (int fd : fds)
+         close(fd);
+      
+      AsyncReader::Stats stats;
+      reader.getStats(stats);
+      if (numBad != 0 || stats.numReads != numFiles || stats.maxInFlight > 16)
+      {
+         state.fail(pass == 0 ? "default backend read mismatch" : "thread backend read mismatch");
+         return;
+      }
+   }
+   
+   // An interactive read queued behind a pile of prefetches should overtake them
+   {
+      AsyncReader reader(1, 4);
+      std::mutex orderLock;
+      std::vector<uint32_t> order;
+      std::atomic<bool> gate(false);
+      int fd = open((dir / names[0]).string().c_str(), O_RDONLY);
+      auto record = [&](uint32_t id){
+         return [&, id](uint8_t* data, uint64_t size){
+            while (!gate)
+               std::this_thread::yield();
+            free(data);
+            std::lock_guard<std::mutex> lock(orderLock);
+            order.push_back(id);
+         };
+      };
+      
+      for (uint32_t i=0; i<32; i++)
+         reader.read(fd, 0, fileSize / 4, AsyncReader::Priority_Prefetch, record(i));
+      reader.read(fd, 0, fileSize / 4, AsyncReader::Priority_Interactive, record(1000));
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      gate = true;
+      reader.wait();
+      close(fd);
+      
+      size_t position = std::find(order.begin(), order.end(), 1000) - order.begin();
+      if (order.size() != 33 || position >= 8)
+      {
+         state.fail("interactive read was not prioritized");
+         return;
+      }
+   }
+   
+   ResManager mgr;
+   mgr.mPaths.push_back(dir.string());
+   mgr.addVolume((dir / "packed.zip").string().c_str());
+   mgr.addVolume(zipName.c_str());
+   
+   std::atomic<uint32_t> numBad(0);
+   std::atomic<uint64_t> bytes(0);
+   auto queueFile = [&](const char* name, const std::vector<uint8_t>* expected){
+      bool queued = mgr.openFileAsync(name, AsyncReader::Priority_Interactive, [&numBad, &bytes, expected](bool ok, MemRStream& stream){
+         if (!ok || (expected && (stream.mSize != expected->size() || memcmp(stream.mPtr, expected->data(), stream.mSize) != 0)))
+            numBad++;
+         bytes += stream.mSize;
+      });
+      if (!queued)
+         numBad++;
+   };
+   
+   // Loose files, volume entries of each method, and a deflated entry
+   for (uint32_t i=0; i<numFiles; i++)
+   {
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "packed%02u.bin", i);
+      queueFile(names[i].c_str(), &files[i]);
+      queueFile(buffer, &files[i]);
+   }
+   queueFile("deflated.bin", &files[0]);
+   mgr.waitAsync();
+   
+   if (numBad != 0 || mgr.openFileAsync("missing.bin", AsyncReader::Priority_Interactive, [](bool, MemRStream&){}))
+   {
+      state.fail("async open did not match");
+      return;
+   }
+   
+   // Local headers come along with the first read of each entry, then their
+   // data starts are known; nothing should seek on the calling thread
+   for (uint32_t i=0; i<numFiles; i++)
+   {
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "packed%02u.bin", i);
+      queueFile(buffer, &files[i]);
+   }
+   mgr.waitAsync();
+   
+   ResManager::ReadStats readStats;
+   mgr.getReadStats(readStats);
+   if (numBad != 0 || readStats.numHeaderReads != 0)
+   {
+      state.fail("async volume open read a local header on the caller's thread");
+      return;
+   }
+   
+   while (state.keepRunning())
+   {
+      bytes = 0;
+      for (uint32_t i=0; i<numFiles; i++)
+         queueFile(names[i].c_str(), NULL);
+      mgr.waitAsync();
+      benchKeep(bytes.load());
+   }
+   
+   std::filesystem::remove_all(dir, ec);
+   
+   state.setBytesProcessed(bytes);
+   state.setItemsProcessed(numFiles);
+}
+
+// Shape data
+
+TV_BENCHMARK(NameTable_AddString)
+{
+   const uint32_t numNames = 256;
+   std::vector<std::string> names;
+   names.reserve(numNames * 2);
+   
+   for (uint32_t i=0; i<numNames; i++)
+   {
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "Bip01 Node%u", i);
+      names.push_back(buffer);
+   }
+   
+   // Second half re-adds existing names with different case
+   for (uint32_t i=0; i<numNames; i++)
+   {
+      std::string name = names[(i * 7) % numNames];
+      std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+      names.push_back(name);
+   }
+   
+   while (state.keepRunning())
+   {
+      Dts3::NameTable table;
+      int last = 0;
+      for (const std::string& name : names)
+         last = table.addString(name);
+      benchKeep(last);
+   }
+   
+   state.setItemsProcessed(names.size());
+}
+
+TV_BENCHMARK(Mesh_CalculateBounds)
+{
+   const uint32_t numVerts = 16 * 1024;
+   
+   Dts3::BasicData* data = new Dts3::BasicData();
+   BenchRandom rng(12);
+   data->verts.resize(numVerts);
+   for (uint32_t i=0; i<numVerts; i++)
+      data->verts[i] = slm::vec3(rng.nextFloat(-100,100), rng.nextFloat(-100,100), rng.nextFloat(-100,100));
+   
+   Dts3::Mesh mesh(Dts3::Mesh::T_Standard);
+   mesh.mData = data;
+   
+   while (state.keepRunning())
+   {
+      mesh.calculateBounds();
+      benchKeep(mesh.mBounds);
+   }
+   
+   state.setItemsProcessed(numVerts);
+}
+
+// Builds the three buffers of a split DTS stream by hand
+struct SplitStreamBuilder
+{
+   std::vector<uint32_t> mBuffer32;
+   std::vector<uint16_t> mBuffer16;
+   std::vector<uint8_t> mBuffer8;
+   uint32_t mCheckCount;
+   
+   SplitStreamBuilder() : mCheckCount(0) {;}
+   
+   void add32(uint32_t value) { mBuffer32.push_back(value); }
+   void addFloat(float value) { uint32_t bits; memcpy(&bits, &value, 4); mBuffer32.push_back(bits); }
+   void addFloats(float value, uint32_t count) { for (uint32_t i=0; i<count; i++) addFloat(value); }
+   
+   void addCheck()
+   {
+      mBuffer32.push_back(mCheckCount);
+      mBuffer16.push_back((uint16_t)mCheckCount);
+      mBuffer8.push_back((uint8_t)mCheckCount);
+      mCheckCount++;
+   }
+   
+   void setup(Dts3::SplitStream& ds, uint16_t version)
+   {
+      ds.dtsVersion = version;
+      ds.buffer32 = MemRStream(mBuffer32.size() * 4, mBuffer32.data());
+      ds.buffer16 = MemRStream(mBuffer16.size() * 2, mBuffer16.data());
+      ds.buffer8 = MemRStream(mBuffer8.size(), mBuffer8.data());
+   }
+};
+
+// A skinned mesh with no primitives and no weights; empty arrays mustn't be indexed
+
+TV_BENCHMARK(Mesh_ReadEmptySkin)
+{
+   const uint32_t numVerts = 4;
+   
+   SplitStreamBuilder builder;
+   builder.addCheck();
+   builder.add32(1);           // frames
+   builder.add32(1);           // material frames
+   builder.add32(0xFFFFFFFF);  // parent
+   builder.addFloats(0.0f, 6); // bounds
+   builder.addFloats(0.0f, 3); // center
+   builder.addFloat(1.0f);     // radius
+   builder.add32(numVerts);
+   builder.addFloats(0.5f, numVerts * 3);
+   builder.add32(numVerts);
+   builder.addFloats(0.5f, numVerts * 2);
+   builder.addFloats(1.0f, numVerts * 3);
+   builder.mBuffer8.resize(builder.mBuffer8.size() + numVerts);
+   builder.add32(0);           // primitives
+   builder.add32(0);           // indices
+   builder.add32(0);           // merge indices
+   builder.add32(numVerts);    // verts per frame
+   builder.add32(0);           // flags
+   builder.addCheck();
+   builder.add32(numVerts);
+   builder.addFloats(0.5f, numVerts * 3);
+   builder.addFloats(1.0f, numVerts * 3);
+   builder.mBuffer8.resize(builder.mBuffer8.size() + numVerts);
+   builder.add32(0);           // node transforms
+   builder.add32(0);           // weights
+   builder.add32(0);           // node indices
+   builder.addCheck();
+   
+   Dts3::Shape shape;
+   {
+      Dts3::SplitStream ds;
+      builder.setup(ds, 24);
+      Dts3::Mesh mesh(Dts3::Mesh::T_Skin);
+      Dts3::IO::readMesh(&mesh, &shape, ds);
+      
+      Dts3::SkinData* skin = mesh.getSkinData();
+      if (skin == NULL || skin->verts.size() != numVerts || !skin->indices.empty() ||
+          !skin->vindex.empty() || !skin->nodeIndex.empty() ||
+          ds.buffer32.getPosition() != builder.mBuffer32.size() * 4 ||
+          ds.buffer8.getPosition() != builder.mBuffer8.size())
+      {
+         state.fail("empty skinned mesh didn't read back");
+         return;
+      }
+   }
+   
+   while (state.keepRunning())
+   {
+      Dts3::SplitStream ds;
+      builder.setup(ds, 24);
+      Dts3::Mesh mesh(Dts3::Mesh::T_Skin);
+      Dts3::IO::readMesh(&mesh, &shape, ds);
+      benchKeep(mesh.mData);
+   }
+   
+   state.setItemsProcessed(1);
+}
+
+// Waving flag style morph: a grid displaced by a travelling wave each frame
+static void buildWaveFrames(std::vector<slm::vec3>& verts, std::vector<slm::vec3>& normals, uint32_t gridSize, uint32_t numFrames)
+{
+   const uint32_t vertsPerFrame = gridSize * gridSize;
+   verts.resize(vertsPerFrame * numFrames);
+   normals.resize(vertsPerFrame * numFrames);
+   
+   for (uint32_t f=0; f<numFrames; f++)
+   {
+      float phase = ((float)f / (float)numFrames) * 6.2831853f;
+      for (uint32_t y=0; y<gridSize; y++)
+      {
+         for (uint32_t x=0; x<gridSize; x++)
+         {
+            float u = (float)x / (float)(gridSize-1);
+            float v = (float)y / (float)(gridSize-1);
+            float wave = sinf((u * 6.0f) + phase) * u * 0.5f;
+            float slope = cosf((u * 6.0f) + phase) * u * 3.0f;
+            
+            uint32_t idx = (f * vertsPerFrame) + (y * gridSize) + x;
+            verts[idx] = slm::vec3(u * 4.0f, wave, v * 2.0f);
+            normals[idx] = slm::normalize(slm::vec3(-slope, 1.0f, 0.0f));
+         }
+      }
+   }
+}
+
+TV_BENCHMARK(Mesh_DecodeDeltaFrame)
+{
+   const uint32_t gridSize = 64;
+   const uint32_t numFrames = 32;
+   const uint32_t vertsPerFrame = gridSize * gridSize;
+   const float maxError = 0.001f;
+   
+   std::vector<slm::vec3> verts;
+   std::vector<slm::vec3> normals;
+   buildWaveFrames(verts, normals, gridSize, numFrames);
+   
+   Dts3::DeltaFrames frames;
+   if (!frames.encode(&verts[0], &normals[0], vertsPerFrame, numFrames, maxError))
+   {
+      state.fail("delta encode failed");
+      return;
+   }
+   
+   // Every frame must round trip within the error bounds
+   std::vector<ModelVertex> out(vertsPerFrame);
+   const float positionBound = std::min(frames.mMaxError, maxError) + 1e-5f;
+   const float normalBound = (0.5f / 127.0f) + 1e-5f;
+   for (uint32_t f=0; f<numFrames; f++)
+   {
+      frames.decodeFrame(f, &out[0]);
+      for (uint32_t i=0; i<vertsPerFrame; i++)
+      {
+         slm::vec3 dp = slm::abs(out[i].position - verts[(f * vertsPerFrame) + i]);
+         slm::vec3 dn = slm::abs(out[i].normal - normals[(f * vertsPerFrame) + i]);
+         if (std::max(dp.x, std::max(dp.y, dp.z)) > positionBound ||
+             std::max(dn.x, std::max(dn.y, dn.z)) > normalBound)
+         {
+            state.fail("decoded frame exceeds error bound");
+            return;
+         }
+      }
+   }
+   
+   if (frames.getDataSize() * 2 > frames.getRawSize())
+   {
+      state.fail("delta frames did not compress");
+      return;
+   }
+   
+   uint32_t frame = 0;
+   while (state.keepRunning())
+   {
+      frames.decodeFrame(frame, &out[0]);
+      frame = (frame + 1) % numFrames;
+      benchKeep(out[0]);
+   }
+   
+   state.setItemsProcessed(vertsPerFrame);
+}
+
+// Torus split into two materials; closed, so only the material boundary is locked
+// uvSeam gives the tube's wrap its own column of verts, like a texture seam
+static void buildTorusMesh(Dts3::Mesh& mesh, uint32_t ringSteps, uint32_t tubeSteps, bool uvSeam=false)
+{
+   Dts3::BasicData* data = new Dts3::BasicData();
+   uint32_t tubeVerts = uvSeam ? tubeSteps + 1 : tubeSteps;
+   data->verts.resize(ringSteps * tubeVerts);
+   data->normals.resize(ringSteps * tubeVerts);
+   data->tverts.resize(ringSteps * tubeVerts);
+   
+   for (uint32_t r=0; r<ringSteps; r++)
+   {
+      float ringAngle = ((float)r / (float)ringSteps) * 6.2831853f;
+      slm::vec3 ringDir(cosf(ringAngle), sinf(ringAngle), 0.0f);
+      for (uint32_t t=0; t<tubeVerts; t++)
+      {
+         float tubeAngle = ((float)(t % tubeSteps) / (float)tubeSteps) * 6.2831853f;
+         slm::vec3 normal = (ringDir * cosf(tubeAngle)) + slm::vec3(0.0f, 0.0f, sinf(tubeAngle));
+         uint32_t idx = (r * tubeVerts) + t;
+         data->verts[idx] = (ringDir * 2.0f) + (normal * 0.5f);
+         data->normals[idx] = normal;
+         data->tverts[idx] = slm::vec2((float)r / (float)ringSteps, (float)t / (float)tubeSteps);
+      }
+   }
+   
+   for (uint32_t mat=0; mat<2; mat++)
+   {
+      Dts3::Primitive prim((int)data->indices.size(), 0, (Dts3::Primitive::Type)(Dts3::Primitive::Triangles | Dts3::Primitive::Indexed | mat));
+      for (uint32_t r=mat*(ringSteps/2); r<(mat+1)*(ringSteps/2); r++)
+      {
+         for (uint32_t t=0; t<tubeSteps; t++)
+         {
+            uint32_t nextT = (t+1) % tubeVerts;
+            uint16_t a = (r * tubeVerts) + t;
+            uint16_t b = (((r+1) % ringSteps) * tubeVerts) + t;
+            uint16_t c = (((r+1) % ringSteps) * tubeVerts) + nextT;
+            uint16_t d = (r * tubeVerts) + nextT;
+            uint16_t quad[6] = {a, b, c, a, c, d};
+            data->indices.insert(data->indices.end(), quad, quad+6);
+         }
+      }
+      prim.numElements = (uint16_t)(data->indices.size() - prim.firstElement);
+      data->primitives.push_back(prim);
+   }
+   
+   mesh.clearData();
+   mesh.mType = Dts3::Mesh::T_Standard;
+   mesh.mData = data;
+   mesh.mVertsPerFrame = ringSteps * tubeVerts;
+   mesh.mRadius = 2.5f;
+   mesh.calculateBounds();
+   mesh.calculateCenter();
+}
+
+static void buildTorusShape(Dts3::Shape& shape)
+{
+   shape.mRadius = 2.5f;
+   shape.mMeshes.resize(1);
+   buildTorusMesh(shape.mMeshes[0], 128, 32);
+   
+   Dts3::Object obj = {shape.mNameTable.addString("torus"), 1, 0, 0, -1, -1};
+   shape.mObjects.push_back(obj);
+   shape.mSubshapes.push_back(Dts3::SubShape(0, 0, 0, 1, 1, 0));
+   shape.mDetailLevels.push_back(Dts3::DetailLevel(shape.mNameTable.addString("detail128"), 0, 0, 128.0f, 0.0f, 0.0f, (int)shape.mMeshes[0].getPolyCount()));
+}
+
+TV_BENCHMARK(Shape_SimplifyMesh)
+{
+   Dts3::Mesh src;
+   buildTorusMesh(src, 128, 32);
+   
+   Dts3::Mesh out;
+   Dts3::SimplifyResult result = {};
+   if (!Dts3::simplifyMesh(src, 0.25f, out, result))
+   {
+      state.fail("simplify failed");
+      return;
+   }
+   
+   // Collapses only move verts onto other verts, so output verts must come from the source
+   Dts3::BasicData* srcData = src.getBasicData();
+   Dts3::BasicData* outData = out.getBasicData();
+   for (const slm::vec3& vert : outData->verts)
+   {
+      if (std::find(srcData->verts.begin(), srcData->verts.end(), vert) == srcData->verts.end())
+      {
+         state.fail("simplified vert not in source");
+         return;
+      }
+   }
+   for (uint16_t idx : outData->indices)
+   {
+      if (idx >= outData->verts.size())
+      {
+         state.fail("simplified index out of range");
+         return;
+      }
+   }
+   
+   if (result.numTris > (result.numSourceTris / 4) + 64 || out.getPolyCount() != result.numTris)
+   {
+      state.fail("simplify missed the target");
+      return;
+   }
+   if (result.maxError > 0.1f || result.avgError > result.maxError)
+   {
+      state.fail("simplify error too high");
+      return;
+   }
+   
+   // A UV seam should collapse along itself rather than being locked, and
+   // stay closed: every edge between positions still has two triangles
+   Dts3::Mesh seamSrc;
+   Dts3::Mesh seamOut;
+   Dts3::SimplifyResult seamResult = {};
+   buildTorusMesh(seamSrc, 128, 32, true);
+   if (!Dts3::simplifyMesh(seamSrc, 0.25f, seamOut, seamResult) || seamResult.numTris > (seamResult.numSourceTris / 4) + 64)
+   {
+      state.fail("seamed simplify missed the target");
+      return;
+   }
+   
+   Dts3::BasicData* seamData = seamOut.getBasicData();
+   std::vector<uint32_t> positionIDs(seamData->verts.size());
+   for (uint32_t i=0; i<seamData->verts.size(); i++)
+      positionIDs[i] = (uint32_t)(std::find(seamData->verts.begin(), seamData->verts.end(), seamData->verts[i]) - seamData->verts.begin());
+   
+   std::unordered_map<uint64_t, uint32_t> edgeCounts;
+   for (size_t i=0; i+2<seamData->indices.size(); i+=3)
+   {
+      for (uint32_t j=0; j<3; j++)
+      {
+         uint32_t a = positionIDs[seamData->indices[i+j]];
+         uint32_t b = positionIDs[seamData->indices[i+((j+1)%3)]];
+         edgeCounts[((uint64_t)std::min(a, b) << 32) | std::max(a, b)]++;
+      }
+   }
+   
+   uint32_t numSeamVerts = 0;
+   for (const slm::vec2& tvert : seamData->tverts)
+      numSeamVerts += tvert.y == 1.0f ? 1 : 0;
+   
+   bool closed = true;
+   for (auto& itr : edgeCounts)
+      closed = closed && itr.second == 2;
+   if (!closed || numSeamVerts >= 128)
+   {
+      state.fail("UV seam was locked or opened");
+      return;
+   }
+   
+   while (state.keepRunning())
+   {
+      Dts3::simplifyMesh(src, 0.25f, out, result);
+      benchKeep(result.numTris);
+   }
+   
+   state.setItemsProcessed(result.numSourceTris);
+}
+
+TV_BENCHMARK(Shape_LODCacheRead)
+{
+   const std::vector<float> ratios = {0.5f, 0.25f, 0.125f};
+   
+   Dts3::Shape source;
+   buildTorusShape(source);
+   Dts3::LODGenerator::Report report;
+   if (!Dts3::LODGenerator::generate(&source, ratios, 0, report) ||
+       source.mDetailLevels.size() != 4 || source.mObjects[0].numMeshes != 4)
+   {
+      state.fail("LOD generation failed");
+      return;
+   }
+   
+   for (uint32_t i=1; i<source.mDetailLevels.size(); i++)
+   {
+      const Dts3::DetailLevel& level = source.mDetailLevels[i];
+      if (level.polyCount >= source.mDetailLevels[i-1].polyCount || level.size >= source.mDetailLevels[i-1].size ||
+          source.mMeshes[level.objectDetail].getPolyCount() != (size_t)level.polyCount)
+      {
+         state.fail("generated levels don't reduce");
+         return;
+      }
+   }
+   
+   std::error_code ec;
+   std::string path = (std::filesystem::temp_directory_path(ec) / "TorqueViewerBench.tvlod").string();
+   if (!Dts3::LODGenerator::writeCache(path.c_str(), &source, ratios, report))
+   {
+      state.fail("couldn't write LOD cache");
+      return;
+   }
+   
+   // Counts which don't fit the file have to be rejected before anything is allocated for them
+   std::vector<uint8_t> cacheData(std::filesystem::file_size(path, ec));
+   FILE* fp = fopen(path.c_str(), "rb");
+   bool readOK = fp != NULL && !ec && fread(cacheData.data(), 1, cacheData.size(), fp) == cacheData.size();
+   if (fp)
+      fclose(fp);
+   if (!readOK)
+   {
+      state.fail("couldn't read LOD cache");
+      return;
+   }
+   
+   const size_t numMeshesOffset = 40;
+   const size_t firstVertCountOffset = 48 + (ratios.size() * 24) + 20;
+   std::string badPath = path + ".bad";
+   for (size_t offset : {numMeshesOffset, firstVertCountOffset})
+   {
+      std::vector<uint8_t> bad = cacheData;
+      uint32_t count = 0x40000000;
+      memcpy(&bad[offset], &count, sizeof(count));
+      
+      fp = fopen(badPath.c_str(), "wb");
+      bool writeOK = fp != NULL && fwrite(bad.data(), 1, bad.size(), fp) == bad.size();
+      if (fp)
+         fclose(fp);
+      
+      Dts3::Shape shape;
+      buildTorusShape(shape);
+      if (!writeOK || Dts3::LODGenerator::readCache(badPath.c_str(), &shape, ratios, report))
+      {
+         state.fail("corrupt LOD cache counts were accepted");
+         remove(badPath.c_str());
+         return;
+      }
+   }
+   remove(badPath.c_str());
+   
+   while (state.keepRunning())
+   {
+      Dts3::Shape shape;
+      buildTorusShape(shape);
+      if (!Dts3::LODGenerator::readCache(path.c_str(), &shape, ratios, report) ||
+          shape.mDetailLevels.size() != source.mDetailLevels.size() ||
+          shape.mMeshes[3].getPolyCount() != source.mMeshes[3].getPolyCount())
+      {
+         state.fail("LOD cache read failed");
+         break;
+      }
+      benchKeep(shape.mMeshes.size());
+   }
+   
+   remove(path.c_str());
+   state.setItemsProcessed(ratios.size());
+}
+
+// Two chains of nodes; the first detail level only uses the first chain.
+// A single cyclic sequence swings every node back and forth around z.
+static void buildAnimatedShape(Dts3::Shape& shape, uint32_t numNodes, uint32_t numDetailNodes, uint32_t numKeys)
+{
+   shape.mRadius = 2.0f;
+   shape.mNodes.resize(numNodes);
+   shape.mDefaultRotations.resize(numNodes, Quat16(slm::quat(0, 0, 0, 1)));
+   shape.mDefaultTranslations.resize(numNodes, slm::vec3(0, 0, 0.25f));
+   for (uint32_t i=0; i<numNodes; i++)
+   {
+      shape.mNodes[i] = {shape.mNameTable.addString("node"), (i == 0 || i == numDetailNodes) ? -1 : (int)i-1, -1, -1, -1};
+   }
+   
+   shape.mSubshapes.push_back(Dts3::SubShape(0, 0, 0, numDetailNodes, 0, 0));
+   shape.mSubshapes.push_back(Dts3::SubShape(numDetailNodes, 0, 0, numNodes - numDetailNodes, 0, 0));
+   shape.mDetailLevels.push_back(Dts3::DetailLevel(shape.mNameTable.addString("detail128"), 0, 0, 128.0f, 0.0f, 0.0f, 0));
+   
+   Dts3::Sequence seq(shape.mNameTable.addString("swing"), Dts3::Sequence::Cyclic, numKeys, 1.0f);
+   seq.baseRot = 0;
+   for (uint32_t i=0; i<numNodes; i++)
+      seq.mattersRot.set(i, true);
+   shape.mSequences.push_back(seq);
+   
+   for (uint32_t i=0; i<numNodes; i++)
+   {
+      for (uint32_t k=0; k<numKeys; k++)
+      {
+         float angle = sinf(((float)k / (float)numKeys) * 6.2831853f) * (0.2f + (i * 0.01f));
+         shape.mNodeRotations.push_back(Quat16(slm::quat(0, 0, sinf(angle * 0.5f), cosf(angle * 0.5f))));
+      }
+   }
+}
+
+TV_BENCHMARK(Shape_AnimationScheduler)
+{
+   const uint32_t numNodes = 32;
+   const uint32_t numDetailNodes = 24;
+   const uint32_t numInstances = 4000;
+   const float dt = 1.0f / 60.0f;
+   
+   Dts3::Shape shape;
+   buildAnimatedShape(shape, numNodes, numDetailNodes, 16);
+   
+   // A crowd: a few instances up close, the rest at various distances
+   Dts3::AnimationScheduler scheduler;
+   scheduler.mBudgetMS = 1000.0f;
+   BenchRandom rng(23);
+   std::vector<int32_t> ids(numInstances);
+   for (uint32_t i=0; i<numInstances; i++)
+   {
+      ids[i] = scheduler.addInstance(&shape);
+      scheduler.setDetail(ids[i], 0, (i % 8) == 0 ? 400.0f : rng.nextFloat(8.0f, 200.0f));
+      scheduler.setSequence(ids[i], 0, (float)(i % 97) / 97.0f);
+   }
+   
+   uint32_t totalSampled = 0;
+   for (uint32_t frame=0; frame<64; frame++)
+   {
+      scheduler.update(dt);
+      if (scheduler.mStats.nodesSampled != scheduler.mStats.sampled * numDetailNodes)
+      {
+         state.fail("nodes outside the detail level's subshape were sampled");
+         return;
+      }
+      if (frame > 0)
+         totalSampled += scheduler.mStats.sampled;
+   }
+   
+   if (totalSampled * 2 > numInstances * 63)
+   {
+      state.fail("distant instances aren't updated at a reduced rate");
+      return;
+   }
+   
+   // Interpolated poses should stay close to the exact pose for the same position.
+   // Every node swings about z, so a node's angle error is the sum of its own and
+   // its parents'. Blending a swing of speed w over a span S of the sequence is at
+   // most 2t(1-t) * w * S off at fraction t, and a column's chord error is at most
+   // the angle error. Full rate instances (t = 0) should match.
+   const Dts3::Sequence& seq = shape.mSequences[0];
+   const uint32_t numKeys = (uint32_t)seq.numKeyFrames;
+   std::vector<float> nodeSpeeds(numNodes, 0.0f); // radians per unit of sequence position
+   for (uint32_t n=0; n<numNodes; n++)
+   {
+      for (uint32_t k=0; k<numKeys; k++)
+      {
+         slm::quat a = shape.mNodeRotations[(n * numKeys) + k].toQuat();
+         slm::quat b = shape.mNodeRotations[(n * numKeys) + ((k + 1) % numKeys)].toQuat();
+         float delta = fabsf((2.0f * atan2f(b.z, b.w)) - (2.0f * atan2f(a.z, a.w)));
+         nodeSpeeds[n] = std::max(nodeSpeeds[n], delta * numKeys);
+      }
+   }
+   
+   std::vector<slm::quat> rots(numNodes);
+   std::vector<slm::vec3> trans(numNodes);
+   std::vector<slm::mat4> exact(numNodes);
+   for (uint32_t i=0; i<numInstances; i += 7)
+   {
+      Dts3::AnimationScheduler::sampleNodes(shape, 0, scheduler.getPos(ids[i]), 0, numNodes, rots.data(), trans.data());
+      Dts3::AnimationScheduler::buildTransforms(shape, rots.data(), trans.data(), 0, numDetailNodes, exact.data());
+      const std::vector<slm::mat4>& shown = scheduler.getNodeTransforms(ids[i]);
+      
+      uint32_t interval = scheduler.getInterval(ids[i]);
+      float t = (float)scheduler.getSampleAge(ids[i]) / (float)interval;
+      float span = (interval * dt) / seq.duration;
+      
+      // Nodes are a chain from 0, so parents come first
+      float chainError = 0.0f;
+      for (uint32_t n=0; n<numDetailNodes; n++)
+      {
+         chainError += 2.0f * t * (1.0f - t) * nodeSpeeds[n] * span;
+         
+         float maxError = 0.0f;
+         for (uint32_t c=0; c<4; c++)
+            maxError = std::max(maxError, slm::length(shown[n][c] - exact[n][c]));
+         
+         // Slack covers Quat16 rounding and nlerp's slight non-linearity
+         if (maxError > chainError + 1.0e-3f)
+         {
+            state.fail("interpolated pose is too far from the exact pose");
+            return;
+         }
+      }
+   }
+   
+   // Sampling has to stop once the budget is gone, leaving the rest for later
+   scheduler.mBudgetMS = 0.0f;
+   for (uint32_t i=0; i<numInstances; i++)
+      scheduler.setSequence(ids[i], 0, scheduler.getPos(ids[i]));
+   scheduler.update(dt);
+   if (scheduler.mStats.sampled != 1 || scheduler.mStats.deferred != numInstances - 1)
+   {
+      state.fail("animation budget not respected");
+      return;
+   }
+   
+   scheduler.mBudgetMS = 1000.0f;
+   while (state.keepRunning())
+   {
+      scheduler.update(dt);
+      benchKeep(scheduler.mStats.sampled);
+   }
+   
+   state.setItemsProcessed(numInstances);
+}
+
+// Lots of sequences over a small skeleton, with the mix of still, steady and
+// swinging nodes typical of exported player animations
+static void buildPlayerShape(Dts3::Shape& shape, uint32_t numNodes, uint32_t numSequences)
+{
+   shape.mNodes.resize(numNodes);
+   shape.mDefaultRotations.resize(numNodes, Quat16(slm::quat(0, 0, 0, 1)));
+   shape.mDefaultTranslations.resize(numNodes, slm::vec3(0, 0, 0.25f));
+   for (uint32_t i=0; i<numNodes; i++)
+   {
+      shape.mNodes[i] = {shape.mNameTable.addString("node"), (int)i-1, -1, -1, -1};
+   }
+   
+   for (uint32_t s=0; s<numSequences; s++)
+   {
+      uint32_t numKeys = 8 + ((s * 7) % 56);
+      Dts3::Sequence seq(shape.mNameTable.addString("seq"), (s & 1) ? 0 : Dts3::Sequence::Cyclic, numKeys, numKeys / 30.0f);
+      seq.baseRot = (int)shape.mNodeRotations.size();
+      seq.baseTrans = (int)shape.mNodeTranslations.size();
+      
+      for (uint32_t i=0; i<numNodes; i++)
+      {
+         seq.mattersRot.set(i, true);
+         for (uint32_t k=0; k<numKeys; k++)
+         {
+            float pos = (float)k / (float)numKeys;
+            float angle = 0.1f * (i % 3);
+            switch ((i + s) % 4)
+            {
+               case 2:
+                  angle += pos * (0.5f + (i * 0.05f));
+                  break;
+               case 3:
+                  angle += sinf(pos * 6.2831853f) * 0.4f;
+                  break;
+            }
+            shape.mNodeRotations.push_back(Quat16(slm::quat(sinf(angle * 0.5f), 0, 0, cosf(angle * 0.5f))));
+         }
+      }
+      
+      // Root moves & bobs; the next node has a fixed offset
+      for (uint32_t i=0; i<2; i++)
+      {
+         seq.mattersTranslation.set(i, true);
+         for (uint32_t k=0; k<numKeys; k++)
+         {
+            float pos = (float)k / (float)numKeys;
+            shape.mNodeTranslations.push_back(i == 0 ? slm::vec3(0, pos * 2.0f, 1.0f + (sinf(pos * 12.566f) * 0.05f)) : slm::vec3(0, 0, 0.5f));
+         }
+      }
+      
+      shape.mSequences.push_back(seq);
+   }
+}
+
+static float quatAngle(const slm::quat& a, const slm::quat& b)
+{
+   float d = fabsf((a.x * b.x) + (a.y * b.y) + (a.z * b.z) + (a.w * b.w)) /
+             sqrtf(((a.x * a.x) + (a.y * a.y) + (a.z * a.z) + (a.w * a.w)) * ((b.x * b.x) + (b.y * b.y) + (b.z * b.z) + (b.w * b.w)));
+   return 2.0f * acosf(std::min(d, 1.0f));
+}
+
+TV_BENCHMARK(Shape_KeyframeCurves)
+{
+   const uint32_t numNodes = 30;
+   const uint32_t numSequences = 120;
+   const float rotTolerance = 0.005f;
+   const float transTolerance = 0.001f;
+   
+   Dts3::Shape raw;
+   Dts3::Shape shape;
+   buildPlayerShape(raw, numNodes, numSequences);
+   buildPlayerShape(shape, numNodes, numSequences);
+   
+   Dts3::KeyframeCurves::Report report;
+   if (!shape.compressKeyframes(rotTolerance, transTolerance, report) || !shape.mNodeRotations.empty())
+   {
+      state.fail("compressKeyframes failed");
+      return;
+   }
+   if (report.bytes * 3 > report.rawBytes || report.sequences.size() != numSequences)
+   {
+      state.fail("keyframes didn't shrink enough");
+      return;
+   }
+   if (report.maxRotError > rotTolerance || report.maxTransError > transTolerance)
+   {
+      state.fail("reported keyframe error is over tolerance");
+      return;
+   }
+   
+   // In between keyframes the error can't be much more than at them
+   std::vector<slm::quat> rots(numNodes), rawRots(numNodes);
+   std::vector<slm::vec3> trans(numNodes), rawTrans(numNodes);
+   for (uint32_t s=0; s<numSequences; s++)
+   {
+      for (uint32_t p=0; p<=32; p++)
+      {
+         float pos = std::min((float)p / 32.0f, 0.999f);
+         Dts3::AnimationScheduler::sampleNodes(raw, s, pos, 0, numNodes, rawRots.data(), rawTrans.data());
+         Dts3::AnimationScheduler::sampleNodes(shape, s, pos, 0, numNodes, rots.data(), trans.data());
+         for (uint32_t n=0; n<numNodes; n++)
+         {
+            if (quatAngle(rots[n], rawRots[n]) > rotTolerance * 2.0f ||
+                slm::length(trans[n] - rawTrans[n]) > transTolerance * 2.0f)
+            {
+               state.fail("compressed keyframes don't match the source");
+               return;
+            }
+         }
+      }
+   }
+   
+   float pos = 0.0f;
+   while (state.keepRunning())
+   {
+      for (uint32_t s=0; s<numSequences; s++)
+      {
+         Dts3::AnimationScheduler::sampleNodes(shape, s, pos, 0, numNodes, rots.data(), trans.data());
+         benchKeep(rots[numNodes-1].w);
+      }
+      pos += 0.013f;
+      pos -= floorf(pos);
+   }
+   
+   state.setItemsProcessed(numSequences);
+}
+
+TV_BENCHMARK(Mesh_MeshletCull)
+{
+   Dts3::Mesh mesh;
+   buildTorusMesh(mesh, 256, 64);
+   Dts3::BasicData* bd = mesh.getBasicData();
+   
+   std::vector<uint16_t> indices(bd->indices.begin(), bd->indices.end());
+   MeshletSet meshlets;
+   for (uint32_t i=0; i<bd->primitives.size(); i++)
+      meshlets.build(bd->verts.data(), bd->normals.data(), (uint32_t)bd->verts.size(), indices.data(),
+                     bd->primitives[i].firstElement, bd->primitives[i].numElements, i);
+   meshlets.finalize();
+   
+   // Reordering must keep every triangle of each primitive
+   for (const Dts3::Primitive& prim : bd->primitives)
+   {
+      std::vector<uint64_t> before, after;
+      for (uint32_t i=prim.firstElement; i<prim.firstElement + prim.numElements; i+=3)
+      {
+         uint16_t a[3] = {bd->indices[i], bd->indices[i+1], bd->indices[i+2]};
+         uint16_t b[3] = {indices[i], indices[i+1], indices[i+2]};
+         std::rotate(a, std::min_element(a, a+3), a+3);
+         std::rotate(b, std::min_element(b, b+3), b+3);
+         before.push_back(((uint64_t)a[0] << 32) | (a[1] << 16) | a[2]);
+         after.push_back(((uint64_t)b[0] << 32) | (b[1] << 16) | b[2]);
+      }
+      std::sort(before.begin(), before.end());
+      std::sort(after.begin(), after.end());
+      if (before != after)
+      {
+         state.fail("meshlet build lost triangles");
+         return;
+      }
+   }
+   
+   // Views from around the torus
+   const uint32_t numViews = 16;
+   std::vector<Dif::InteriorCuller::Frustum> frustums(numViews);
+   std::vector<slm::vec3> eyes(numViews);
+   slm::mat4 proj = slm::perspective_fov_rh(slm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+   for (uint32_t i=0; i<numViews; i++)
+   {
+      float angle = ((float)i / (float)numViews) * 6.2831853f;
+      eyes[i] = slm::vec3(cosf(angle) * 4.0f, sinf(angle) * 4.0f, (i & 1) ? 2.0f : 0.5f);
+      Dif::InteriorCuller::extractFrustum(proj * slm::look_at_rh(eyes[i], slm::vec3(2.0f, 0.0f, 0.0f), slm::vec3(0, 0, 1)), frustums[i]);
+   }
+   
+   // Anything rejected must be a backfacing or offscreen triangle
+   std::vector<MeshletSet::DrawRange> ranges;
+   MeshletSet::Stats stats = {};
+   for (uint32_t v=0; v<numViews; v++)
+   {
+      ranges.clear();
+      meshlets.cull(frustums[v].data(), (uint32_t)frustums[v].size(), eyes[v], ranges, stats);
+      
+      std::vector<uint8_t> drawn(indices.size() / 3, 0);
+      for (const MeshletSet::DrawRange& range : ranges)
+         std::fill(drawn.begin() + (range.indexStart / 3), drawn.begin() + ((range.indexStart + range.indexCount) / 3), 1);
+      
+      for (uint32_t t=0; t<drawn.size(); t++)
+      {
+         if (drawn[t])
+            continue;
+         
+         slm::vec3 p[3];
+         slm::vec3 vn(0);
+         for (uint32_t j=0; j<3; j++)
+         {
+            p[j] = bd->verts[indices[(t*3)+j]];
+            vn += bd->normals[indices[(t*3)+j]];
+         }
+         slm::vec3 n = slm::cross(p[1] - p[0], p[2] - p[0]);
+         if (slm::dot(n, vn) < 0.0f)
+            n = -n;
+         
+         bool backfacing = slm::dot(n, p[0] - eyes[v]) >= 0.0f;
+         bool offscreen = false;
+         for (const slm::vec4& plane : frustums[v])
+         {
+            if (slm::dot(plane.xyz(), p[0]) + plane.w < 0.0f &&
+                slm::dot(plane.xyz(), p[1]) + plane.w < 0.0f &&
+                slm::dot(plane.xyz(), p[2]) + plane.w < 0.0f)
+               offscreen = true;
+         }
+         
+         if (!backfacing && !offscreen)
+         {
+            state.fail("meshlet culling rejected a visible triangle");
+            return;
+         }
+      }
+   }
+   
+   if (stats.backfaceRejected == 0 || stats.trianglesRejected * 4 < stats.trianglesTested)
+   {
+      state.fail("meshlet culling rejected too little");
+      return;
+   }
+   
+   while (state.keepRunning())
+   {
+      for (uint32_t v=0; v<numViews; v++)
+      {
+         ranges.clear();
+         meshlets.cull(frustums[v].data(), (uint32_t)frustums[v].size(), eyes[v], ranges, stats);
+      }
+      benchKeep(ranges.size());
+   }
+   
+   state.setItemsProcessed(numViews * meshlets.mMeshlets.size());
+}
+
+TV_BENCHMARK(Texture_StreamUpdate)
+{
+   // Stand-in for the renderer which tracks what would be on the GPU
+   std::vector<uint64_t> gpuBytes;
+   uint64_t frameRaiseBytes = 0;
+   uint64_t largestRaise = 0;
+   bool badPixels = false;
+   
+   const uint32_t numTextures = 64;
+   const uint32_t texSize = 256;
+   std::vector<uint8_t> pixels(texSize * texSize * 4);
+   for (uint32_t i=0; i<pixels.size(); i++)
+      pixels[i] = (uint8_t)((i * 2654435761u) >> 24);
+   
+   // Every upload should match this, whether or not the mip was rebuilt from a reload
+   std::vector<std::vector<uint8_t> > mipChain(1, pixels);
+   for (uint32_t size=texSize; size > 1; size >>= 1)
+   {
+      mipChain.push_back(std::vector<uint8_t>((size / 2) * (size / 2) * 4));
+      TextureStreamer::downsample(size, size, &mipChain[mipChain.size()-2][0], &mipChain.back()[0]);
+   }
+   
+   TextureStreamer streamer([&](int32_t texID, uint32_t width, uint32_t height, const uint8_t* pixels) {
+      uint32_t mip = 0;
+      while ((texSize >> mip) > width)
+         mip++;
+      if (memcmp(pixels, &mipChain[mip][0], mipChain[mip].size()) != 0)
+         badPixels = true;
+      
+      uint64_t bytes = TextureStreamer::getMipBytes(width, height, 0);
+      if (texID < 0)
+      {
+         gpuBytes.push_back(bytes);
+         return (int32_t)(gpuBytes.size() - 1);
+      }
+      if (bytes > gpuBytes[texID])
+      {
+         frameRaiseBytes += bytes;
+         largestRaise = std::max(largestRaise, bytes);
+      }
+      gpuBytes[texID] = bytes;
+      return texID;
+   }, [&](int32_t texID) { gpuBytes[texID] = 0; });
+   
+   // Half of the textures only keep their coarse mips on the CPU. Reloads finish
+   // after the update which started them, like a decode on a worker would.
+   uint32_t numReloads = 0;
+   uint64_t frameReloadBytes = 0;
+   std::vector<TextureStreamer::ReloadDoneFunc> pendingReloads;
+   auto reload = [&](TextureStreamer::ReloadDoneFunc onDone) {
+      numReloads++;
+      frameReloadBytes += pixels.size();
+      pendingReloads.push_back(onDone);
+      return true;
+   };
+   
+   std::vector<int32_t> texIDs(numTextures);
+   for (uint32_t i=0; i<numTextures; i++)
+      texIDs[i] = (i & 1) ? streamer.addTexture(texSize, texSize, &pixels[0], reload) : streamer.addTexture(texSize, texSize, &pixels[0]);
+   
+   // One texture whose source has gone missing should only be tried once
+   uint32_t numBadReloads = 0;
+   int32_t badTexID = streamer.addTexture(texSize, texSize, &pixels[0], [&](TextureStreamer::ReloadDoneFunc onDone) {
+      numBadReloads++;
+      std::vector<uint8_t> none;
+      onDone(false, none, 0);
+      return true;
+   });
+   
+   if (streamer.getResidentMip(texIDs[0]) != 3)
+   {
+      state.fail("textures should start at the preview mip");
+      return;
+   }
+   
+   // Enough room for about a quarter of the textures at full size
+   streamer.mBudgetBytes = (numTextures / 4) * TextureStreamer::getMipBytes(texSize, texSize, 0);
+   streamer.mUploadBytesPerFrame = 512 * 1024;
+   
+   auto runFrame = [&](uint32_t frame) {
+      for (uint32_t i=0; i<numTextures; i++)
+         streamer.requestSize(texIDs[i], (float)(((i + frame) % numTextures) * 8));
+      streamer.requestSize(badTexID, (float)texSize);
+      frameRaiseBytes = 0;
+      frameReloadBytes = 0;
+      largestRaise = 0;
+      streamer.update();
+      
+      for (TextureStreamer::ReloadDoneFunc& onDone : pendingReloads)
+      {
+         std::vector<uint8_t> src = pixels;
+         onDone(true, src, 1);
+      }
+      pendingReloads.clear();
+   };
+   
+   for (uint32_t frame=0; frame<256; frame++)
+   {
+      runFrame(frame / 64);
+      
+      uint64_t totalBytes = 0;
+      for (uint64_t bytes : gpuBytes)
+         totalBytes += bytes;
+      
+      if (totalBytes != streamer.mStats.residentBytes || totalBytes > streamer.mBudgetBytes)
+      {
+         state.fail("resident textures exceed the budget");
+         return;
+      }
+      
+      if (frameRaiseBytes + frameReloadBytes > std::max(streamer.mUploadBytesPerFrame, std::max(largestRaise, (uint64_t)pixels.size())))
+      {
+         state.fail("uploads exceed the per frame limit");
+         return;
+      }
+   }
+   
+   if (badPixels || numReloads == 0)
+   {
+      state.fail("mips rebuilt from a reload don't match the original chain");
+      return;
+   }
+   
+   if (numBadReloads != 1 || streamer.getResidentMip(badTexID) != 3)
+   {
+      state.fail("failed reloads should be given up on");
+      return;
+   }
+   
+   // Once settled, the most requested textures should be the sharpest
+   int32_t mostWanted = streamer.getResidentMip(texIDs[numTextures-4]);
+   int32_t leastWanted = streamer.getResidentMip(texIDs[4]);
+   if (mostWanted != 0 || mostWanted > leastWanted || streamer.mStats.deferred != 0)
+   {
+      state.fail("texture residency doesn't follow requests");
+      return;
+   }
+   
+   uint32_t frame = 0;
+   while (state.keepRunning())
+   {
+      runFrame(frame++);
+      benchKeep(streamer.mStats.residentBytes);
+   }
+   
+   state.setItemsProcessed(numTextures);
+}
+
+static uint32_t countLines(const char* code)
+{
+   uint32_t count = 0;
+   for (const char* ptr = code; *ptr; ptr++)
+      count += *ptr == '\n' ? 1 : 0;
+   return count;
+}
+
+TV_BENCHMARK(Shader_Permutations)
+{
+   static const char* const featureDefines[ModelFeature_Count] = { "ALPHA_TEST" };
+   const char* sources[2] = { sModelShaderCode, sInteriorShaderCode };
+   
+   // Nesting, #else & #define; inactive lines are kept as blank lines
+   ShaderPreprocessor pp;
+   std::string code;
+   if (!pp.process("#define A\n#ifdef A\na\n  #ifndef A\nb\n  #else\nc\n  #endif\n#else\nd\n#endif\ne", code) ||
+       code != "\n\na\n\n\n\nc\n\n\n\n\ne")
+   {
+      state.fail("preprocessor output is wrong");
+      return;
+   }
+   if (pp.process("#ifdef A\nx\n", code) || pp.process("#endif\n", code) ||
+       pp.process("#ifdef A\n#else\n#else\n#endif\n", code) || pp.process("#include x\n", code))
+   {
+      state.fail("preprocessor accepted bad directives");
+      return;
+   }
+   
+   // Every permutation has to be plain WGSL, and opaque ones mustn't branch on alpha
+   for (const char* source : sources)
+   {
+      for (uint32_t mask=0; mask<ModelFeature_Permutations; mask++)
+      {
+         if (!ShaderPreprocessor::buildPermutation(source, mask, featureDefines, ModelFeature_Count, code))
+         {
+            state.fail("shader permutation failed to build");
+            return;
+         }
+         
+         bool hasDiscard = code.find("discard;") != std::string::npos;
+         if (code.find('#') != std::string::npos || countLines(code.c_str()) != countLines(source) ||
+             hasDiscard != ((mask & ModelFeature_AlphaTest) != 0))
+         {
+            state.fail("shader permutation doesn't match its features");
+            return;
+         }
+      }
+   }
+   
+   while (state.keepRunning())
+   {
+      for (const char* source : sources)
+      {
+         for (uint32_t mask=0; mask<ModelFeature_Permutations; mask++)
+         {
+            ShaderPreprocessor::buildPermutation(source, mask, featureDefines, ModelFeature_Count, code);
+            benchKeep(code.size());
+         }
+      }
+   }
+   
+   state.setItemsProcessed(2 * ModelFeature_Permutations);
+}
+
+// Math
+
+TV_BENCHMARK(Quat16_ToQuat)
+{
+   const uint32_t numQuats = 4096;
+   std::vector<Quat16> quats(numQuats);
+   BenchRandom rng(13);
+   for (uint32_t i=0; i<numQuats; i++)
+      quats[i] = Quat16(rng.nextQuat());
+   
+   std::vector<slm::quat> out(numQuats);
+   
+   while (state.keepRunning())
+   {
+      for (uint32_t i=0; i<numQuats; i++)
+         out[i] = quats[i].toQuat();
+      benchClobber();
+   }
+   
+   state.setItemsProcessed(numQuats);
+}
+
+TV_BENCHMARK(Math_CompatInterpolate)
+{
+   const uint32_t numQuats = 4096;
+   std::vector<slm::quat> from(numQuats), to(numQuats), out(numQuats);
+   BenchRandom rng(14);
+   for (uint32_t i=0; i<numQuats; i++)
+   {
+      from[i] = rng.nextQuat();
+      to[i] = rng.nextQuat();
+   }
+   
+   while (state.keepRunning())
+   {
+      for (uint32_t i=0; i<numQuats; i++)
+         out[i] = CompatInterpolate(from[i], to[i], (float)(i & 255) / 255.0f);
+      benchClobber();
+   }
+   
+   state.setItemsProcessed(numQuats);
+}
+
+TV_BENCHMARK(Math_CompatQuatSetMatrix)
+{
+   const uint32_t numQuats = 4096;
+   std::vector<slm::quat> quats(numQuats);
+   std::vector<slm::mat4> out(numQuats);
+   BenchRandom rng(15);
+   for (uint32_t i=0; i<numQuats; i++)
+      quats[i] = rng.nextQuat();
+   
+   while (state.keepRunning())
+   {
+      for (uint32_t i=0; i<numQuats; i++)
+         CompatQuatSetMatrix(quats[i], out[i]);
+      benchClobber();
+   }
+   
+   state.setItemsProcessed(numQuats);
+}
+
+TV_BENCHMARK(Math_Mat4Multiply)
+{
+   const uint32_t numMats = 1024;
+   std::vector<slm::mat4> mats(numMats), out(numMats);
+   BenchRandom rng(16);
+   for (uint32_t i=0; i<numMats; i++)
+   {
+      slm::mat4 rot;
+      CompatQuatSetMatrix(rng.nextQuat(), rot);
+      mats[i] = slm::translation(slm::vec3(rng.nextFloat(-10,10), rng.nextFloat(-10,10), rng.nextFloat(-10,10))) * rot;
+   }
+   
+   while (state.keepRunning())
+   {
+      slm::mat4 accum = slm::mat4(1);
+      for (uint32_t i=0; i<numMats; i++)
+      {
+         out[i] = accum * mats[i];
+         accum = out[i];
+      }
+      benchClobber();
+   }
+   
+   state.setItemsProcessed(numMats);
+}
+
+TV_BENCHMARK(Math_Mat4Inverse)
+{
+   const uint32_t numMats = 1024;
+   std::vector<slm::mat4> mats(numMats), out(numMats);
+   BenchRandom rng(17);
+   for (uint32_t i=0; i<numMats; i++)
+   {
+      slm::mat4 rot;
+      CompatQuatSetMatrix(rng.nextQuat(), rot);
+      mats[i] = slm::translation(slm::vec3(rng.nextFloat(-10,10), rng.nextFloat(-10,10), rng.nextFloat(-10,10))) * rot;
+   }
+   
+   while (state.keepRunning())
+   {
+      for (uint32_t i=0; i<numMats; i++)
+         out[i] = slm::inverse(mats[i]);
+      benchClobber();
+   }
+   
+   state.setItemsProcessed(numMats);
+}
+
+TV_BENCHMARK(Math_Mat4TransformPoint)
+{
+   const uint32_t numVerts = 16 * 1024;
+   std::vector<slm::vec3> verts(numVerts), out(numVerts);
+   BenchRandom rng(18);
+   for (uint32_t i=0; i<numVerts; i++)
+      verts[i] = slm::vec3(rng.nextFloat(-100,100), rng.nextFloat(-100,100), rng.nextFloat(-100,100));
+   
+   slm::mat4 rot;
+   CompatQuatSetMatrix(rng.nextQuat(), rot);
+   slm::mat4 xfm = slm::translation(slm::vec3(1,2,3)) * rot;
+   
+   while (state.keepRunning())
+   {
+      for (uint32_t i=0; i<numVerts; i++)
+         out[i] = (xfm * slm::vec4(verts[i], 1.0f)).xyz();
+      benchClobber();
+   }
+   
+   state.setItemsProcessed(numVerts);
+}
+
+// Interiors
+
+namespace
+{
+
+template<class T> static void benchPut(std::vector<uint8_t>& out, const T& value)
+{
+   const uint8_t* ptr = (const uint8_t*)&value;
+   out.insert(out.end(), ptr, ptr + sizeof(T));
+}
+
+// Builds a flat grid of quad surfaces in .dif layout (no lightmaps). A single
+// BSP node is added if node is given.
+static void buildSyntheticInterior(std::vector<uint8_t>& out, uint32_t gridSize, uint32_t numMaterials, const Dif::BSPNode* node=NULL)
+{
+   BenchRandom rng(19);
+   uint32_t numPoints = (gridSize + 1) * (gridSize + 1);
+   uint32_t numSurfaces = gridSize * gridSize;
+   
+   out.clear();
+   benchPut<uint32_t>(out, Dif::ResourceFileVersion);
+   benchPut<uint8_t>(out, 0);  // no preview
+   benchPut<uint32_t>(out, 1); // detail levels
+   
+   benchPut<uint32_t>(out, Dif::InteriorFileVersion);
+   benchPut<uint32_t>(out, 0);
+   benchPut<uint32_t>(out, 0);
+   float bounds[10] = {0, 0, 0, (float)gridSize, (float)gridSize, 0, gridSize * 0.5f, gridSize * 0.5f, 0, (float)gridSize};
+   benchPut(out, bounds);
+   benchPut<uint8_t>(out, 0);
+   benchPut<uint32_t>(out, 0);
+   
+   // normals, planes
+   benchPut<uint32_t>(out, 1);
+   benchPut(out, slm::vec3(0, 0, 1));
+   benchPut<uint32_t>(out, 1);
+   benchPut<uint16_t>(out, 0);
+   benchPut<float>(out, 0.0f);
+   
+   // points, visibility
+   benchPut<uint32_t>(out, numPoints);
+   for (uint32_t y=0; y<=gridSize; y++)
+      for (uint32_t x=0; x<=gridSize; x++)
+         benchPut(out, slm::vec3((float)x, (float)y, rng.nextFloat(-0.01f, 0.01f)));
+   benchPut<uint32_t>(out, numPoints);
+   for (uint32_t i=0; i<numPoints; i++)
+      benchPut<uint8_t>(out, 1);
+   
+   // texgens, BSP nodes, solid leaves
+   float texGen[8] = {0.25f, 0, 0, 0, 0, 0.25f, 0, 0};
+   benchPut<uint32_t>(out, 1);
+   benchPut(out, texGen);
+   benchPut<uint32_t>(out, node ? 1 : 0);
+   if (node)
+      benchPut(out, *node);
+   benchPut<uint32_t>(out, 0);
+   
+   // materials
+   benchPut<uint8_t>(out, MaterialList::BINARY_FILE_VERSION);
+   benchPut<uint32_t>(out, numMaterials);
+   for (uint32_t i=0; i<numMaterials; i++)
+   {
+      char name[32];
+      uint8_t len = (uint8_t)snprintf(name, sizeof(name), "material%u", i);
+      benchPut(out, len);
+      out.insert(out.end(), name, name + len);
+   }
+   
+   // windings (one 4 point strip per surface)
+   benchPut<uint32_t>(out, numSurfaces * 4);
+   for (uint32_t y=0; y<gridSize; y++)
+   {
+      for (uint32_t x=0; x<gridSize; x++)
+      {
+         uint32_t base = (y * (gridSize + 1)) + x;
+         benchPut<uint32_t>(out, base);
+         benchPut<uint32_t>(out, base + 1);
+         benchPut<uint32_t>(out, base + gridSize + 1);
+         benchPut<uint32_t>(out, base + gridSize + 2);
+      }
+   }
+   
+   // winding indices, zones, zone surfaces, zone portals, portals
+   for (uint32_t i=0; i<5; i++)
+      benchPut<uint32_t>(out, 0);
+   
+   benchPut<uint32_t>(out, numSurfaces);
+   for (uint32_t i=0; i<numSurfaces; i++)
+   {
+      Dif::Surface surface = {};
+      surface.windingStart = i * 4;
+      surface.windingCount = 4;
+      surface.textureIndex = rng.next() % numMaterials;
+      surface.lmFinalWord = (4 << 6) | 4;
+      benchPut(out, surface);
+   }
+   
+   benchPut<uint32_t>(out, numSurfaces);
+   for (uint32_t i=0; i<numSurfaces; i++)
+      benchPut<uint8_t>(out, 0);
+   benchPut<uint32_t>(out, 0); // alarm lightmaps
+   benchPut<uint32_t>(out, 0); // null surfaces
+   benchPut<uint32_t>(out, 0); // lightmaps
+}
+
+}
+
+TV_BENCHMARK(Interior_Load)
+{
+   std::vector<uint8_t> data;
+   
+   // BSP nodes referring to missing planes or nodes should be rejected
+   Dif::BSPNode badNodes[3] = { { 1, Dif::BSPNode::LeafFlag, Dif::BSPNode::LeafFlag }, { 0, 1, Dif::BSPNode::LeafFlag }, { 0, Dif::BSPNode::LeafFlag | Dif::BSPNode::SolidFlag, Dif::BSPNode::LeafFlag } };
+   for (const Dif::BSPNode& node : badNodes)
+   {
+      buildSyntheticInterior(data, 2, 1, &node);
+      MemRStream mem(data.size(), &data[0]);
+      Dif::InteriorResource res;
+      if (res.read(mem))
+      {
+         state.fail("malformed BSP node was accepted");
+         return;
+      }
+   }
+   
+   Dif::BSPNode goodNode = { 0, Dif::BSPNode::LeafFlag, Dif::BSPNode::LeafFlag };
+   buildSyntheticInterior(data, 2, 1, &goodNode);
+   {
+      MemRStream mem(data.size(), &data[0]);
+      Dif::InteriorResource res;
+      if (!res.read(mem) || res.findZone(slm::vec3(0, 0, 1)) != -1)
+      {
+         state.fail("valid BSP node was rejected");
+         return;
+      }
+   }
+   
+   buildSyntheticInterior(data, 128, 16);
+   
+   while (state.keepRunning())
+   {
+      MemRStream mem(data.size(), &data[0]);
+      Dif::InteriorResource res;
+      if (!res.read(mem))
+      {
+         state.fail("interior read failed");
+         return;
+      }
+      benchKeep(res.mRenderIndices.size());
+   }
+   
+   state.setBytesProcessed(data.size());
+   state.setItemsProcessed(128 * 128);
+}
+
+TV_BENCHMARK(Interior_PackLightmaps)
+{
+   // Mix of lightmap sizes similar to a large interior
+   const uint32_t numLightmaps = 128;
+   const uint32_t maxSize = 256;
+   
+   BenchRandom rng(20);
+   std::vector<uint16_t> sizes(numLightmaps * 2);
+   for (uint32_t i=0; i<numLightmaps; i++)
+   {
+      sizes[i*2] = (uint16_t)(32 << (rng.next() % 4));
+      sizes[(i*2)+1] = (uint16_t)(32 << (rng.next() % 4));
+   }
+   
+   std::vector<uint8_t> pixels;
+   fillRandom(pixels, maxSize * maxSize * 3, 21);
+   
+   Bitmap bmp;
+   bmp.mFormat = Bitmap::FORMAT_RGB;
+   bmp.mBitDepth = 24;
+   bmp.mMips[0] = pixels.data();
+   
+   uint64_t texels = 0;
+   while (state.keepRunning())
+   {
+      LightmapAtlas atlas;
+      if (!atlas.pack(numLightmaps, sizes.data(), 2048))
+      {
+         state.fail("lightmap pack failed");
+         return;
+      }
+      
+      texels = 0;
+      for (uint32_t i=0; i<numLightmaps; i++)
+      {
+         bmp.mWidth = sizes[i*2];
+         bmp.mHeight = sizes[(i*2)+1];
+         bmp.mStride = bmp.mWidth * 3;
+         atlas.copyBitmap(i, bmp);
+         texels += bmp.mWidth * bmp.mHeight;
+      }
+      benchKeep(atlas.mNumLayers);
+   }
+   
+   // Texel centres in each source lightmap have to land on the same texel in the atlas
+   LightmapAtlas atlas;
+   atlas.pack(numLightmaps, sizes.data(), 2048);
+   uint32_t numOffset = 0;
+   for (uint32_t i=0; i<numLightmaps; i++)
+   {
+      const LightmapAtlas::Entry& entry = atlas.mEntries[i];
+      bmp.mWidth = sizes[i*2];
+      bmp.mHeight = sizes[(i*2)+1];
+      bmp.mStride = bmp.mWidth * 3;
+      atlas.copyBitmap(i, bmp);
+      if (entry.x == 0 || entry.y == 0)
+         continue;
+      numOffset++;
+      
+      const uint32_t checkTexels[4][2] = {{0, 0}, {bmp.mWidth-1, 0}, {bmp.mWidth / 3, bmp.mHeight / 2}, {bmp.mWidth-1, bmp.mHeight-1}};
+      for (uint32_t t=0; t<4; t++)
+      {
+         uint32_t x = checkTexels[t][0];
+         uint32_t y = checkTexels[t][1];
+         slm::vec2 uv(((float)x + 0.5f) / (float)bmp.mWidth, ((float)y + 0.5f) / (float)bmp.mHeight);
+         slm::vec3 coord = atlas.remapCoord(i, uv);
+         
+         const uint8_t* expected = pixels.data() + (y * bmp.mStride) + (x * 3);
+         const uint8_t* got = atlas.getPixel((uint32_t)(coord.z + 0.5f), (uint32_t)(coord.x * atlas.mLayerSize), (uint32_t)(coord.y * atlas.mLayerSize));
+         if (coord.z != (float)entry.layer || memcmp(expected, got, 3) != 0)
+         {
+            state.fail("lightmap uv doesn't map to its texel in the atlas");
+            return;
+         }
+      }
+      
+      // The corners of the source map to the corners of the entry
+      slm::vec3 lo = atlas.remapCoord(i, slm::vec2(0.0f, 0.0f)) * (float)atlas.mLayerSize;
+      slm::vec3 hi = atlas.remapCoord(i, slm::vec2(1.0f, 1.0f)) * (float)atlas.mLayerSize;
+      if (fabsf(lo.x - entry.x) > 1.0e-3f || fabsf(lo.y - entry.y) > 1.0e-3f ||
+          fabsf(hi.x - (entry.x + entry.width)) > 1.0e-3f || fabsf(hi.y - (entry.y + entry.height)) > 1.0e-3f)
+      {
+         state.fail("lightmap uv corners don't match the atlas entry");
+         return;
+      }
+   }
+   
+   if (numOffset == 0)
+      state.fail("no lightmaps were packed away from the atlas origin");
+   
+   state.setItemsProcessed(numLightmaps);
+   state.setBytesProcessed(texels * 3);
+}
+
+// Mission with numInteriors interiors cycling through numFiles distinct files,
+// plus a few shapes for each interior
+static void buildSyntheticMission(std::string& out, uint32_t numInteriors, uint32_t numFiles)
+{
+   char buf[512];
+   out = "// Synthetic mission\n\nnew SimGroup(MissionGroup) {\n   musicTrack = \"lush\";\n";
+   out += "   new TerrainBlock(Terrain) {\n      position = \"-1024 -1024 0\";\n      terrainFile = \"Synthetic.ter\";\n      squareSize = \"8\";\n   };\n";
+   out += "   new SimGroup(Interiors) {\n";
+   for (uint32_t i=0; i<numInteriors; i++)
+   {
+      snprintf(buf, sizeof(buf),
+               "      new InteriorInstance() {\n"
+               "         position = \"%u %u %u.5\";\n"
+               "         rotation = \"0 0 1 %u\";\n"
+               "         scale = \"1 1 1\";\n"
+               "         interiorFile = \"synth%u.dif\";\n"
+               "         showTerrainInside = \"0\";\n"
+               "      };\n"
+               "      new StaticShape() {\n"
+               "         position = \"%u %u %u\";\n"
+               "         rotation = \"1 0 0 0\";\n"
+               "         dataBlock = \"GeneratorLarge\";\n"
+               "         lockCount = \"0\";\n"
+               "      };\n",
+               (i * 37) % 2048, (i * 91) % 2048, i % 200, i % 360, i % numFiles,
+               (i * 37) % 2048, (i * 91) % 2048, i % 200);
+      out += buf;
+   }
+   out += "   };\n};\n";
+}
+
+TV_BENCHMARK(Mission_Parse)
+{
+   Mission::registerClasses();
+   
+   std::string text;
+   buildSyntheticMission(text, 4096, 64);
+   
+   while (state.keepRunning())
+   {
+      Mission::MissionFile mission;
+      if (!mission.parse(text.c_str(), text.size()))
+      {
+         state.fail("mission parse failed");
+         return;
+      }
+      benchKeep(mission.mStats.numObjects);
+   }
+   
+   state.setBytesProcessed(text.size());
+   state.setItemsProcessed((4096 * 2) + 3);
+}
+
+TV_BENCHMARK(Mission_LoadResources)
+{
+   const uint32_t numFiles = 64;
+   
+   Mission::registerClasses();
+   ResManager::registerCreateFunc(".dif", []() -> ResourceInstance* { return new Dif::InteriorResource(); });
+   
+   std::string text;
+   buildSyntheticMission(text, 256, numFiles);
+   
+   // Resources are read from a scratch folder so this includes real file I/O
+   std::error_code ec;
+   std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "TorqueViewerBench_mission";
+   std::filesystem::create_directories(dir / "interiors", ec);
+   std::filesystem::create_directories(dir / "terrains", ec);
+   
+   std::vector<uint8_t> data;
+   buildSyntheticInterior(data, 32, 4);
+   for (uint32_t i=0; i<numFiles; i++)
+   {
+      char name[64];
+      snprintf(name, sizeof(name), "synth%u.dif", i);
+      FILE* fp = fopen((dir / "interiors" / name).string().c_str(), "wb");
+      if (fp == NULL)
+      {
+         state.fail("couldn't write scratch interior");
+         return;
+      }
+      fwrite(data.data(), 1, data.size(), fp);
+      fclose(fp);
+   }
+   
+   // Terrains are only kept as raw data
+   std::vector<uint8_t> terrainData;
+   fillRandom(terrainData, 256 * 256 * 2, 30);
+   FILE* fp = fopen((dir / "terrains" / "Synthetic.ter").string().c_str(), "wb");
+   if (fp)
+   {
+      fwrite(terrainData.data(), 1, terrainData.size(), fp);
+      fclose(fp);
+   }
+   
+   ResManager mgr;
+   mgr.mPaths.push_back(dir.string());
+   
+   // A broken copy found first shouldn't hide the good one in the usual folder
+   {
+      std::vector<uint8_t> brokenData;
+      fillRandom(brokenData, 256, 31);
+      std::string brokenName = (dir / "synth0.dif").string();
+      fp = fopen(brokenName.c_str(), "wb");
+      if (fp)
+      {
+         fwrite(brokenData.data(), 1, brokenData.size(), fp);
+         fclose(fp);
+      }
+      
+      // The browser's header peek should already turn it away
+      ResManager::registerPeekFunc(".dif", 4, Dif::InteriorResource::peekHeader);
+      if (mgr.canRead("synth0.dif") || !mgr.canRead("interiors/synth0.dif"))
+      {
+         std::filesystem::remove(brokenName, ec);
+         state.fail("interior header peek didn't match the resource version");
+         return;
+      }
+      
+      Mission::MissionFile mission;
+      mission.parse(text.c_str(), text.size());
+      mission.loadResources(mgr);
+      std::filesystem::remove(brokenName, ec);
+      
+      bool fellBack = false;
+      for (Mission::LoadedResource* res : mission.mResources)
+      {
+         if (res->filename == "synth0.dif")
+            fellBack = res->instance != NULL && res->resolvedName == "interiors/synth0.dif";
+      }
+      if (fp == NULL || !fellBack || mission.mStats.numResourcesMissing != 0)
+      {
+         state.fail("broken first candidate wasn't skipped");
+         return;
+      }
+   }
+   
+   uint64_t bytes = 0;
+   while (state.keepRunning())
+   {
+      Mission::MissionFile mission;
+      mission.parse(text.c_str(), text.size());
+      mission.loadResources(mgr);
+      if (mission.mStats.numResourcesMissing != 0)
+      {
+         state.fail("mission resources missing");
+         break;
+      }
+      bytes = mission.mStats.bytesLoaded;
+      benchKeep(mission.mStats.numResources);
+   }
+   
+   std::filesystem::remove_all(dir, ec);
+   
+   state.setBytesProcessed(bytes);
+   state.setItemsProcessed(numFiles + 1);
+}
+
+// 100k objects scattered over a 4km world, sized like a mix of shapes & interiors
+static const uint32_t kSceneObjects = 100000;
+
+static void buildSyntheticScene(SceneContainer& scene, BenchRandom& rng)
+{
+   scene.reset(slm::vec3(0), 2048.0f);
+   for (uint32_t i=0; i<kSceneObjects; i++)
+   {
+      slm::vec3 pos(rng.nextFloat(-2048.0f, 2048.0f), rng.nextFloat(-2048.0f, 2048.0f), rng.nextFloat(0.0f, 200.0f));
+      float size = (i % 50) == 0 ? rng.nextFloat(20.0f, 100.0f) : rng.nextFloat(0.5f, 5.0f);
+      slm::mat4 xfm = slm::translation(pos) * slm::rotation_z(rng.nextFloat(0.0f, 6.28f));
+      scene.addInstance(NULL, xfm, slm::vec3(-size), slm::vec3(size));
+   }
+}
+
+TV_BENCHMARK(Scene_FrustumQuery)
+{
+   BenchRandom rng(40);
+   SceneContainer scene;
+   buildSyntheticScene(scene, rng);
+   
+   // Set of views looking across the world
+   const uint32_t numViews = 16;
+   std::vector<Dif::InteriorCuller::Frustum> frustums(numViews);
+   slm::mat4 proj = slm::perspective_fov_rh(slm::radians(90.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+   for (uint32_t i=0; i<numViews; i++)
+   {
+      slm::vec3 eye(rng.nextFloat(-1500.0f, 1500.0f), rng.nextFloat(-1500.0f, 1500.0f), 50.0f);
+      slm::vec3 target = eye + slm::vec3(rng.nextFloat(-1.0f, 1.0f), rng.nextFloat(-1.0f, 1.0f), -0.1f);
+      Dif::InteriorCuller::extractFrustum(proj * slm::look_at_rh(eye, target, slm::vec3(0, 0, 1)), frustums[i]);
+   }
+   
+   std::vector<uint32_t> ids;
+   uint64_t found = 0;
+   while (state.keepRunning())
+   {
+      found = 0;
+      for (uint32_t i=0; i<numViews; i++)
+      {
+         scene.findInFrustum(frustums[i].data(), (uint32_t)frustums[i].size(), ids);
+         found += ids.size();
+      }
+      benchKeep(found);
+   }
+   
+   state.setItemsProcessed(numViews * kSceneObjects);
+}
+
+TV_BENCHMARK(Scene_RayQuery)
+{
+   BenchRandom rng(41);
+   SceneContainer scene;
+   buildSyntheticScene(scene, rng);
+   
+   const uint32_t numRays = 1024;
+   std::vector<slm::vec3> starts(numRays);
+   std::vector<slm::vec3> dirs(numRays);
+   for (uint32_t i=0; i<numRays; i++)
+   {
+      starts[i] = slm::vec3(rng.nextFloat(-2000.0f, 2000.0f), rng.nextFloat(-2000.0f, 2000.0f), 50.0f);
+      dirs[i] = slm::normalize(slm::vec3(rng.nextFloat(-1.0f, 1.0f), rng.nextFloat(-1.0f, 1.0f), rng.nextFloat(-0.2f, 0.0f)));
+   }
+   
+   std::vector<uint32_t> ids;
+   while (state.keepRunning())
+   {
+      uint64_t hits = 0;
+      for (uint32_t i=0; i<numRays; i++)
+      {
+         scene.findOnRay(starts[i], dirs[i], 500.0f, ids);
+         hits += ids.size();
+      }
+      benchKeep(hits);
+   }
+   
+   state.setItemsProcessed(numRays);
+}
+
+TV_BENCHMARK(Scene_Update)
+{
+   BenchRandom rng(42);
+   SceneContainer scene;
+   buildSyntheticScene(scene, rng);
+   
+   // Move 10% of objects a short distance each frame
+   const uint32_t numMoved = kSceneObjects / 10;
+   std::vector<slm::vec3> offsets(numMoved);
+   for (uint32_t i=0; i<numMoved; i++)
+      offsets[i] = slm::vec3(rng.nextFloat(-2.0f, 2.0f), rng.nextFloat(-2.0f, 2.0f), 0.0f);
+   
+   uint32_t frame = 0;
+   while (state.keepRunning())
+   {
+      // Alternate directions so objects stay in the world
+      float sign = (frame++ & 1) ? -1.0f : 1.0f;
+      for (uint32_t i=0; i<numMoved; i++)
+      {
+         uint32_t id = i * 10;
+         slm::mat4 xfm = scene.mInstances[id].transform;
+         xfm[3] += slm::vec4(offsets[i] * sign, 0.0f);
+         scene.setTransform(id, xfm);
+      }
+      benchKeep(scene.getNumNodes());
+   }
+   
+   state.setItemsProcessed(numMoved);
+}
+
+TV_BENCHMARK(Mission_SnapshotRestore)
+{
+   Mission::registerClasses();
+   
+   std::string text;
+   buildSyntheticMission(text, 4096, 64);
+   
+   Mission::MissionFile source;
+   source.parse(text.c_str(), text.size());
+   
+   SceneContainer sourceScene;
+   source.forEachObject([&sourceScene](Mission::SimObject* obj){
+      Mission::SceneObject* sceneObj = dynamic_cast<Mission::SceneObject*>(obj);
+      if (sceneObj)
+         sourceScene.addInstance(NULL, sceneObj->getTransform(), slm::vec3(-1), slm::vec3(1), obj);
+   });
+   
+   std::error_code ec;
+   std::string path = (std::filesystem::temp_directory_path(ec) / "TorqueViewerBench.tvsnap").string();
+   if (!Mission::MissionSnapshot::write(path.c_str(), source, sourceScene))
+   {
+      state.fail("couldn't write snapshot");
+      return;
+   }
+   
+   while (state.keepRunning())
+   {
+      Mission::MissionSnapshot snapshot;
+      Mission::MissionFile mission;
+      SceneContainer scene;
+      if (!snapshot.open(path.c_str()) || !mission.restore(snapshot) || !snapshot.restoreScene(mission, scene))
+      {
+         state.fail("snapshot restore failed");
+         break;
+      }
+      benchKeep(scene.getNumInstances());
+   }
+   
+   remove(path.c_str());
+   state.setItemsProcessed(source.mStats.numObjects);
+}
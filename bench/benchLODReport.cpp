@@ -0,0 +1,115 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "CommonData.h"
+#include "shapeData.h"
+#include "shapeSimplify.h"
+#include "benchLODReport.h"
+
+static bool loadShape(const char* filename, Dts3::Shape& outShape)
+{
+   MappedFile file;
+   if (!file.open(filename))
+   {
+      printf("%s: couldn't open\n", filename);
+      return false;
+   }
+   
+   MemRStream stream(file.mSize, (void*)file.mPtr);
+   if (!outShape.read(stream))
+   {
+      printf("%s: couldn't read shape\n", filename);
+      return false;
+   }
+   
+   return true;
+}
+
+static bool reportShape(const char* filename, const std::vector<float>& ratios, uint32_t numThreads)
+{
+   Dts3::Shape shape;
+   if (!loadShape(filename, shape))
+      return false;
+   
+   Dts3::LODGenerator::Report report;
+   if (!Dts3::LODGenerator::generate(&shape, ratios, numThreads, report))
+   {
+      printf("%s: skipped (%u detail levels already)\n", filename, (uint32_t)shape.mDetailLevels.size());
+      return true;
+   }
+   
+   printf("%s: %u polys, %u meshes simplified, %u aliased, %.2f ms on %u threads\n",
+          filename, report.basePolyCount, report.numSimplified, report.numAliased, report.generateMS, report.numThreads);
+   printf("   %8s %8s %10s %8s %12s %12s\n", "Ratio", "Size", "Polys", "Kept", "MaxError", "AvgError");
+   for (const Dts3::LODGenerator::LevelReport& level : report.levels)
+   {
+      float kept = report.basePolyCount > 0 ? (float)level.polyCount / (float)report.basePolyCount : 0.0f;
+      printf("   %8.3f %8.1f %10u %7.1f%% %12.5f %12.5f\n",
+             level.ratio, level.size, level.polyCount, kept * 100.0f, level.maxError, level.avgError);
+   }
+   
+   // Cached levels must come back the same
+   std::error_code ec;
+   std::string path = (std::filesystem::temp_directory_path(ec) / "TorqueViewerLODReport.tvlod").string();
+   if (!Dts3::LODGenerator::writeCache(path.c_str(), &shape, ratios, report))
+   {
+      printf("   couldn't write cache\n");
+      return false;
+   }
+   
+   Dts3::Shape cachedShape;
+   Dts3::LODGenerator::Report cachedReport;
+   bool ok = loadShape(filename, cachedShape) &&
+             Dts3::LODGenerator::readCache(path.c_str(), &cachedShape, ratios, cachedReport) &&
+             cachedShape.mMeshes.size() == shape.mMeshes.size();
+   for (uint32_t i=0; ok && i<shape.mMeshes.size(); i++)
+      ok = cachedShape.mMeshes[i].getPolyCount() == shape.mMeshes[i].getPolyCount();
+   
+   remove(path.c_str());
+   if (!ok)
+   {
+      printf("   cache round trip failed\n");
+      return false;
+   }
+   
+   printf("   cache reload %.2f ms\n", cachedReport.generateMS);
+   return true;
+}
+
+int benchLODReport(int numFiles, char** files, uint32_t numThreads)
+{
+   const std::vector<float> ratios = {0.5f, 0.25f, 0.125f};
+   
+   int numFailed = 0;
+   for (int i=0; i<numFiles; i++)
+   {
+      if (!reportShape(files[i], ratios, numThreads))
+         numFailed++;
+   }
+   
+   return numFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,243 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2018-2024 James S Urquhart.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include "CommonData.h"
+#include "volumeCodecs.h"
+#include "volumeWriter.h"
+
+/*
+ TorqueVolumeRepack rewrites a zip volume with a codec picked per entry by
+ size and type, then reads both volumes back to check they match and compare
+ load throughput.
+ */
+
+struct RepackOptions
+{
+   uint16_t method;      // for binary assets
+   uint16_t textMethod;  // for scripts & missions
+   uint32_t alignment;
+   uint32_t minSize;     // smaller entries are always stored
+};
+
+static bool parseMethod(const char* name, uint16_t& outMethod)
+{
+   if (strcasecmp(name, "lz4") == 0)
+      outMethod = ZipMethod_LZ4;
+   else if (strcasecmp(name, "zstd") == 0)
+      outMethod = ZipMethod_Zstd;
+   else if (strcasecmp(name, "store") == 0)
+      outMethod = ZipMethod_Store;
+   else
+      return false;
+   
+   if (outMethod == ZipMethod_Zstd && !ZstdCodec::canCompress())
+   {
+      printf("Writing zstd entries needs a build with USE_ZSTD\n");
+      return false;
+   }
+   
+   return true;
+}
+
+static const char* getMethodName(uint16_t method)
+{
+   switch (method)
+   {
+      case ZipMethod_Store: return "store";
+      case ZipMethod_LZ4: return "lz4";
+      case ZipMethod_Zstd: return "zstd";
+      default: return "?";
+   }
+}
+
+static uint16_t chooseMethod(const std::string& name, uint64_t size, const RepackOptions& options)
+{
+   static const char* sCompressedExts[] = { ".png", ".jpg", ".jpeg", ".ogg", ".mp3", ".zip", ".vol" };
+   static const char* sTextExts[] = { ".cs", ".mis", ".txt", ".gui", ".cfg", ".hfl", ".ini" };
+   
+   if (size < options.minSize)
+      return ZipMethod_Store;
+   
+   std::string ext = std::filesystem::path(name).extension().string();
+   std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+   
+   for (const char* compressedExt : sCompressedExts)
+   {
+      if (ext == compressedExt)
+         return ZipMethod_Store;
+   }
+   
+   for (const char* textExt : sTextExts)
+   {
+      if (ext == textExt)
+         return options.textMethod;
+   }
+   
+   return options.method;
+}
+
+// Reads every entry of the volume, returning the total size and time taken
+static bool readVolume(const char* filename, const std::vector<ResManager::EnumEntry>& entries, uint64_t& outBytes, double& outMS)
+{
+   ResManager mgr;
+   mgr.addVolume(filename);
+   if (mgr.mVolumes.empty())
+      return false;
+   
+   outBytes = 0;
+   auto startTime = std::chrono::steady_clock::now();
+   for (const ResManager::EnumEntry& entry : entries)
+   {
+      MemRStream stream;
+      if (!mgr.openFile(entry.filename.c_str(), stream, 0))
+      {
+         printf("%s: couldn't read %s\n", filename, entry.filename.c_str());
+         return false;
+      }
+      outBytes += stream.mSize;
+   }
+   outMS = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+   return true;
+}
+
+int main(int argc, char** argv)
+{
+   RepackOptions options;
+   options.method = ZipMethod_LZ4;
+   options.textMethod = ZstdCodec::canCompress() ? ZipMethod_Zstd : ZipMethod_LZ4;
+   options.alignment = VolumeWriter::DefaultAlignment;
+   options.minSize = 256;
+   
+   const char* inName = NULL;
+   const char* outName = NULL;
+   
+   for (int i=1; i<argc; i++)
+   {
+      const char* arg = argv[i];
+      const bool hasValue = i+1 < argc;
+      
+      if (strcasecmp(arg, "-codec") == 0 && hasValue)
+      {
+         if (!parseMethod(argv[++i], options.method))
+            return 1;
+      }
+      else if (strcasecmp(arg, "-textcodec") == 0 && hasValue)
+      {
+         if (!parseMethod(argv[++i], options.textMethod))
+            return 1;
+      }
+      else if (strcasecmp(arg, "-align") == 0 && hasValue)
+      {
+         options.alignment = std::max(1, atoi(argv[++i]));
+      }
+      else if (strcasecmp(arg, "-minsize") == 0 && hasValue)
+      {
+         options.minSize = std::max(0, atoi(argv[++i]));
+      }
+      else if (inName == NULL)
+      {
+         inName = arg;
+      }
+      else if (outName == NULL)
+      {
+         outName = arg;
+      }
+   }
+   
+   if (inName == NULL || outName == NULL)
+   {
+      printf("Usage: %s [-codec lz4|zstd|store] [-textcodec lz4|zstd|store] [-align N] [-minsize N] in.zip out.zip\n", argv[0]);
+      return 1;
+   }
+   
+   ResManager mgr;
+   mgr.addVolume(inName);
+   if (mgr.mVolumes.empty())
+   {
+      printf("%s: couldn't open volume\n", inName);
+      return 1;
+   }
+   
+   std::vector<ResManager::EnumEntry> entries;
+   mgr.enumerateVolume(0, entries, NULL);
+   
+   // Directories don't need entries
+   entries.erase(std::remove_if(entries.begin(), entries.end(), [](const ResManager::EnumEntry& entry){
+      return entry.filename.empty() || entry.filename.back() == '/';
+   }), entries.end());
+   
+   VolumeWriter writer;
+   if (!writer.open(outName))
+      return 1;
+   
+   auto startTime = std::chrono::steady_clock::now();
+   for (const ResManager::EnumEntry& entry : entries)
+   {
+      MemRStream stream;
+      if (!mgr.openFile(entry.filename.c_str(), stream, 0))
+      {
+         printf("%s: couldn't read %s\n", inName, entry.filename.c_str());
+         return 1;
+      }
+      
+      uint16_t method = chooseMethod(entry.filename, stream.mSize, options);
+      if (!writer.addEntry(entry.filename.c_str(), stream.mPtr, stream.mSize, method, options.alignment))
+         return 1;
+   }
+   if (!writer.close())
+      return 1;
+   double packMS = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+   
+   const VolumeWriter::Stats& stats = writer.mStats;
+   printf("%s: %u entries, %.2f MB -> %.2f MB in %.1f ms (%u stored, %u lz4, %u zstd, %.1f KB alignment)\n",
+          outName, stats.numEntries, stats.inputBytes / (1024.0 * 1024.0), stats.outputBytes / (1024.0 * 1024.0), packMS,
+          stats.numMethod[0], stats.numMethod[1], stats.numMethod[2], stats.paddingBytes / 1024.0);
+   printf("   binary assets: %s, text: %s\n", getMethodName(options.method), getMethodName(options.textMethod));
+   
+   // Both volumes should load the same data; report how long each takes
+   uint64_t oldBytes = 0;
+   uint64_t newBytes = 0;
+   double oldMS = 0;
+   double newMS = 0;
+   if (!readVolume(inName, entries, oldBytes, oldMS) || !readVolume(outName, entries, newBytes, newMS))
+      return 1;
+   
+   if (oldBytes != newBytes)
+   {
+      printf("%s: read %llu bytes, expected %llu\n", outName, (unsigned long long)newBytes, (unsigned long long)oldBytes);
+      return 1;
+   }
+   
+   double mb = oldBytes / (1024.0 * 1024.0);
+   printf("   load: %.1f ms (%.1f MB/s) -> %.1f ms (%.1f MB/s)\n",
+          oldMS, oldMS > 0 ? mb / (oldMS / 1000.0) : 0.0, newMS, newMS > 0 ? mb / (newMS / 1000.0) : 0.0);
+   return 0;
+}